@@ -1,18 +1,942 @@
+#include "capture_file.hpp"
+#include "capture_index.hpp"
+#include "column_file.hpp"
+#include "decoder.hpp"
+#include "display.hpp"
+#include "fragment_reassembler.hpp"
+#include "http_streams.hpp"
+#include "layerspy_engine.hpp"
+#include "load_shedder.hpp"
+#include "metrics.hpp"
+#include "packet_filter.hpp"
+#include "parallel_capture.hpp"
+#include "sniffer.hpp"
+#include "talker_sketch.hpp"
+#include "tcp_reassembler.hpp"
+#include "traffic_generator.hpp"
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) { g_stop.store(true); }
+
+void print_stats(const LayerSpyEngine &engine,
+                 const std::vector<std::unique_ptr<Sniffer>> &sniffers) {
+  for (std::size_t i = 0; i < engine.workers(); ++i) {
+    const WorkerStats stats = engine.stats(i);
+    std::cout << "  worker " << i << ": " << stats.decoded << " decoded, "
+              << stats.malformed << " malformed, " << stats.filtered
+              << " filtered, " << stats.dropped << " dropped";
+    if (stats.oversized != 0) {
+      std::cout << " (" << stats.oversized << " too long for the ring)";
+    }
+    std::cout << ", queue " << stats.queue_depth << " (max "
+              << stats.max_queue_depth << ")";
+    if (stats.shed != 0 || stats.sample_rate != 1) {
+      std::cout << ", " << stats.shed << " shed (now 1 in "
+                << stats.sample_rate << " flows)";
+    }
+    std::cout << '\n';
+  }
+  SnifferStats capture;
+  for (const auto &sniffer : sniffers) {
+    const SnifferStats stats = sniffer->stats();
+    capture.received += stats.received;
+    capture.dropped += stats.dropped;
+    capture.if_dropped += stats.if_dropped;
+  }
+  std::cout << "  capture: " << capture.received << " received, "
+            << capture.dropped << " dropped by kernel, " << capture.if_dropped
+            << " dropped by interface" << std::endl;
+}
+
+void print_throughput(uint64_t packets, uint64_t packet_bytes,
+                      std::size_t file_bytes, double seconds) {
+  seconds = std::max(seconds, 1e-9);
+  std::cout << std::fixed << std::setprecision(3) << "Read " << packets
+            << " packets (" << packet_bytes << " bytes) in " << seconds
+            << " s: " << static_cast<double>(packets) / seconds / 1e6
+            << " Mpkt/s, " << static_cast<double>(file_bytes) / seconds / 1e9
+            << " GB/s" << std::endl;
+}
+
+template <typename Key>
+void print_top(const char *title, const HeavyHitters<Key> &top,
+               std::size_t n) {
+  std::cout << "  " << title << ":\n";
+  for (const auto &entry : top.top(n)) {
+    std::cout << "    ";
+    if constexpr (std::is_same_v<Key, Ipv6Address>) {
+      std::cout << entry.key.toString();
+    } else {
+      std::cout << entry.key;
+    }
+    // count - error is what the key was seen to send for certain.
+    std::cout << "  " << entry.count;
+    if (entry.error != 0) {
+      std::cout << " (at least " << entry.count - entry.error << ")";
+    }
+    std::cout << '\n';
+  }
+}
+
+void print_talkers(const TalkerSketch &talkers, std::size_t n) {
+  using Weight = TalkerSketch::Weight;
+  std::cout << std::fixed << std::setprecision(0) << "Top talkers of "
+            << talkers.packets() << " IP packets (" << talkers.bytes()
+            << " bytes), about " << talkers.distinct_sources()
+            << " sources and " << talkers.distinct_destinations()
+            << " destinations:\n";
+  print_top("sources by bytes", talkers.sources(Weight::Bytes), n);
+  print_top("sources by packets", talkers.sources(Weight::Packets), n);
+  print_top("destinations by bytes", talkers.destinations(Weight::Bytes), n);
+  print_top("destinations by packets", talkers.destinations(Weight::Packets),
+            n);
+  print_top("destination ports by packets", talkers.ports(Weight::Packets),
+            n);
+  std::cout << std::flush;
+}
+
+// What one worker puts back together with --reassemble: IP datagrams from
+// their fragments, then TCP streams from their segments, and with
+// --parse-http the HTTP messages in those streams
+class Reassembly : public TcpReassembler::Handler {
+public:
+  explicit Reassembly(bool parse_http)
+      : m_fragments(FragmentReassembler::Config{}),
+        m_streams(TcpReassembler::Config{}, *this) {
+    if (parse_http) {
+      m_http = std::make_unique<HttpStreams>(
+          TcpReassembler::Config{}.max_streams, m_messages);
+    }
+  }
+
+  // Feeds one packet the worker handled.
+  void handle(const PacketRef &packet, const LayerStack &stack) {
+    PacketRef datagram;
+    switch (m_fragments.process(packet, stack, datagram)) {
+    case FragmentReassembler::Result::NotFragment:
+      m_streams.process(packet, stack);
+      break;
+    case FragmentReassembler::Result::Complete:
+      if (m_decoder.decode(datagram.data, m_stack)) {
+        m_streams.process(datagram, m_stack);
+      }
+      break;
+    default:
+      break;
+    }
+    // Packet timestamps are the clock, so files replay as captured.
+    if (++m_packets % EXPIRE_EVERY == 0) {
+      m_fragments.expire(packet.timestamp_ns);
+      m_streams.expire(packet.timestamp_ns);
+    }
+  }
+
+  // Ends every stream still open. Only once the workers have stopped.
+  void flush() { m_streams.flush(); }
+
+  // Stream bytes are counted in ReassemblyStats.
+  void on_data(const FlowKey &stream, std::string_view data) override {
+    if (m_http) {
+      m_http->on_data(stream, data);
+    }
+  }
+  void on_gap(const FlowKey &stream, uint64_t bytes) override {
+    if (m_http) {
+      m_http->on_gap(stream, bytes);
+    }
+  }
+  void on_close(const FlowKey &stream,
+                TcpReassembler::CloseReason reason) override {
+    ++m_closed[static_cast<std::size_t>(reason)];
+    if (m_http) {
+      m_http->on_close(stream, reason);
+    }
+  }
+
+  const FragmentStats &fragments() const { return m_fragments.stats(); }
+  const ReassemblyStats &streams() const { return m_streams.stats(); }
+  // Streams ended by a FIN, a RST, or eviction (idle, full, or flush())
+  const std::array<uint64_t, 3> &closed() const { return m_closed; }
+  // Null without --parse-http
+  const HttpStreams *http() const { return m_http.get(); }
+  uint64_t requests() const { return m_messages.requests; }
+
+private:
+  // Packets between two sweeps for idle state
+  inline static constexpr uint64_t EXPIRE_EVERY = 1024;
+
+  struct MessageCounter : HttpStreams::Handler {
+    void on_message(const FlowKey &, const HttpMessage &message) override {
+      requests += message.is_request ? 1 : 0;
+    }
+    uint64_t requests = 0;
+  };
+
+  MessageCounter m_messages;
+  std::unique_ptr<HttpStreams> m_http;
+  FragmentReassembler m_fragments;
+  TcpReassembler m_streams;
+  // Decodes reassembled datagrams, which the engine's Decoder never sees
+  Decoder m_decoder;
+  LayerStack m_stack;
+  std::array<uint64_t, 3> m_closed{};
+  uint64_t m_packets = 0;
+};
+
+void print_reassembly(
+    const std::vector<std::unique_ptr<Reassembly>> &reassembly) {
+  FragmentStats total;
+  ReassemblyStats streams;
+  std::array<uint64_t, 3> closed{};
+  for (const auto &worker : reassembly) {
+    const ReassemblyStats &tcp = worker->streams();
+    streams.segments += tcp.segments;
+    streams.out_of_order += tcp.out_of_order;
+    streams.delivered_bytes += tcp.delivered_bytes;
+    streams.gaps += tcp.gaps;
+    streams.gap_bytes += tcp.gap_bytes;
+    for (std::size_t i = 0; i < closed.size(); ++i) {
+      closed[i] += worker->closed()[i];
+    }
+    const FragmentStats &stats = worker->fragments();
+    total.fragments += stats.fragments;
+    total.reassembled += stats.reassembled;
+    total.timeouts += stats.timeouts;
+    total.overlaps += stats.overlaps;
+    total.cap_hits += stats.cap_hits;
+    total.evictions += stats.evictions;
+    total.invalid += stats.invalid;
+  }
+  std::cout << "  fragments: " << total.fragments << " seen, "
+            << total.reassembled << " datagrams reassembled, "
+            << total.timeouts << " timed out, " << total.evictions
+            << " evicted, " << total.overlaps << " overlapping, "
+            << total.invalid << " invalid\n";
+  std::cout << "  TCP streams: " << streams.segments << " segments ("
+            << streams.out_of_order << " out of order), "
+            << streams.delivered_bytes << " bytes delivered, "
+            << streams.gaps << " gaps (" << streams.gap_bytes
+            << " bytes); " << closed[0] << " ended by FIN, " << closed[1]
+            << " by RST, " << closed[2] << " evicted" << std::endl;
+  if (reassembly.front()->http() == nullptr) {
+    return;
+  }
+  uint64_t messages = 0;
+  uint64_t requests = 0;
+  uint64_t errors = 0;
+  uint64_t evicted = 0;
+  for (const auto &worker : reassembly) {
+    messages += worker->http()->messages();
+    requests += worker->requests();
+    errors += worker->http()->errors();
+    evicted += worker->http()->evicted();
+  }
+  std::cout << "  HTTP: " << requests << " requests, " << messages - requests
+            << " responses, " << errors << " streams not HTTP or with a gap, "
+            << evicted << " parsers evicted" << std::endl;
+}
+
+// Parses "size:weight" pairs such as "40:7,576:4,1500:1".
+std::vector<TrafficGenerator::SizeWeight>
+parse_sizes(const std::vector<std::string> &pairs) {
+  std::vector<TrafficGenerator::SizeWeight> sizes;
+  for (const std::string &pair : pairs) {
+    const std::size_t colon = pair.find(':');
+    try {
+      const unsigned long size = std::stoul(pair.substr(0, colon));
+      const double weight =
+          colon == std::string::npos ? 1 : std::stod(pair.substr(colon + 1));
+      if (size > UINT16_MAX) {
+        throw std::out_of_range(pair);
+      }
+      sizes.push_back({static_cast<uint16_t>(size), weight});
+    } catch (const std::logic_error &) {
+      throw std::invalid_argument("Bad packet size '" + pair +
+                                  "', expected size:weight");
+    }
+  }
+  return sizes;
+}
+
+// Parses seconds since the epoch, such as "1700000000.25", to nanoseconds.
+uint64_t parse_time(const std::string &text) {
+  const std::size_t dot = text.find('.');
+  const std::string seconds = text.substr(0, dot);
+  std::string fraction =
+      dot == std::string::npos ? "" : text.substr(dot + 1);
+  const auto digits = [](const std::string &part) {
+    return std::all_of(part.begin(), part.end(), [](char c) {
+      return std::isdigit(static_cast<unsigned char>(c)) != 0;
+    });
+  };
+  if (seconds.empty() || seconds.length() > 10 || fraction.length() > 9 ||
+      !digits(seconds) || !digits(fraction)) {
+    throw std::invalid_argument("Bad time '" + text +
+                                "', expected seconds since the epoch");
+  }
+  fraction.resize(9, '0');
+  return std::stoull(seconds) * 1000000000ULL + std::stoull(fraction);
+}
+
+// Parses "proto,address,port,address,port", e.g. "tcp,10.0.0.1,5000,
+// 10.0.0.2,80"; the protocol is tcp, udp or a number.
+FlowKey parse_flow(const std::vector<std::string> &fields) {
+  const auto fail = [&fields]() {
+    std::string text;
+    for (const std::string &field : fields) {
+      text += (text.empty() ? "" : ",") + field;
+    }
+    return std::invalid_argument(
+        "Bad flow '" + text + "', expected proto,address,port,address,port");
+  };
+  if (fields.size() != 5) {
+    throw fail();
+  }
+  unsigned long protocol = 0;
+  uint16_t ports[2] = {};
+  try {
+    protocol = fields[0] == "tcp"   ? 6
+               : fields[0] == "udp" ? 17
+                                    : std::stoul(fields[0]);
+    for (int i = 0; i < 2; ++i) {
+      const unsigned long port = std::stoul(fields[2 + 2 * i]);
+      if (port > UINT16_MAX) {
+        throw std::out_of_range(fields[2 + 2 * i]);
+      }
+      ports[i] = static_cast<uint16_t>(port);
+    }
+  } catch (const std::logic_error &) {
+    throw fail();
+  }
+  if (protocol > UINT8_MAX) {
+    throw fail();
+  }
+  unsigned char src[16];
+  unsigned char dst[16];
+  if (inet_pton(AF_INET, fields[1].c_str(), src) == 1 &&
+      inet_pton(AF_INET, fields[3].c_str(), dst) == 1) {
+    return FlowKey(Ipv4Address(src), ports[0], Ipv4Address(dst), ports[1],
+                   static_cast<uint8_t>(protocol));
+  }
+  if (inet_pton(AF_INET6, fields[1].c_str(), src) == 1 &&
+      inet_pton(AF_INET6, fields[3].c_str(), dst) == 1) {
+    return FlowKey(Ipv6Address(src), ports[0], Ipv6Address(dst), ports[1],
+                   static_cast<uint8_t>(protocol));
+  }
+  throw fail();
+}
+
+// "tcp 10.0.0.1:5000 <-> 10.0.0.2:80", IPv6 addresses in brackets
+std::string format_flow(const FlowKey &key) {
+  const int family = key.family == 6 ? AF_INET6 : AF_INET;
+  const auto endpoint = [&key, family](const std::array<uint8_t, 16> &addr,
+                                       uint16_t port) {
+    char text[INET6_ADDRSTRLEN] = {};
+    inet_ntop(family, addr.data(), text, sizeof text);
+    return (family == AF_INET6 ? "[" + std::string(text) + "]"
+                               : std::string(text)) +
+           ":" + std::to_string(port);
+  };
+  const std::string protocol = key.protocol == 6    ? "tcp"
+                               : key.protocol == 17 ? "udp"
+                                  : std::to_string(key.protocol);
+  return protocol + " " + endpoint(key.src_addr, key.src_port) + " <-> " +
+         endpoint(key.dst_addr, key.dst_port);
+}
+
+void print_summary(const CaptureSummary &summary, std::size_t n) {
+  std::cout << summary.packets << " packets (" << summary.bytes
+            << " bytes), " << summary.malformed << " malformed: "
+            << summary.ipv4 << " IPv4, " << summary.ipv6 << " IPv6, "
+            << summary.tcp << " TCP, " << summary.udp << " UDP in "
+            << summary.flows.size() << " flows\n";
+  for (const auto &[key, flow] : summary.top_flows(n)) {
+    std::cout << "  " << format_flow(key) << "  " << flow.packets
+              << " packets, " << flow.bytes << " bytes, "
+              << static_cast<double>(flow.last_seen_ns - flow.first_seen_ns) /
+                     1e9
+              << " s\n";
+  }
+  std::cout << std::flush;
+}
+
+// Loads the sidecar index of `path` (or starts one) and brings it up to
+// date with the file, saving it if anything changed.
+CaptureIndex updated_index(const std::string &path) {
+  const std::string index_path = CaptureIndex::path_for(path);
+  CaptureIndex index(CaptureIndex::Config{});
+  bool saved = false;
+  if (std::ifstream(index_path)) {
+    try {
+      index = CaptureIndex::load(index_path);
+      saved = true;
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << "; indexing again" << std::endl;
+    }
+  }
+  const uint64_t indexed = index.indexed_bytes();
+  CaptureFileReader reader(path);
+  const uint64_t added = index.update(reader);
+  if (!saved || index.indexed_bytes() != indexed) {
+    index.save(index_path);
+  }
+  std::cout << "Index " << index_path << ": " << index.packets()
+            << " packets in " << index.blocks().size() << " blocks, "
+            << added << " new" << std::endl;
+  return index;
+}
+
+} // namespace
 
 int main(int argc, char **argv) {
   CLI::App app{"LayerSpy - Network Packet Analyzer"};
 
-  // TODO: Add CLI options here
   std::string interface = "eth0";
   app.add_option("-i,--interface", interface,
                  "Network interface to capture from");
 
+  // One core is left for the capture thread.
+  std::size_t workers = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+  app.add_option("-w,--workers", workers, "Number of decode threads")
+      ->check(CLI::PositiveNumber);
+
+  std::size_t ring_mb = 8;
+  app.add_option("--ring-mb", ring_mb, "Queue size per decode thread, MiB")
+      ->check(CLI::PositiveNumber);
+
+  std::string read_path;
+  CLI::Option *read_option =
+      app.add_option("-r,--read", read_path,
+                     "Analyze a pcap or pcapng file instead of capturing")
+          ->check(CLI::ExistingFile);
+
+  std::string capture = "auto";
+  app.add_option("--capture", capture,
+                 "Capture backend: auto, tpacket (zero-copy ring) or pcap")
+      ->check(CLI::IsMember({"auto", "tpacket", "pcap"}));
+
+  std::string filter_text;
+  app.add_option("-f,--filter", filter_text,
+                 "Only decode packets matching this filter, e.g. "
+                 "'ip.src in 10.0.0.0/8 && tcp.dst_port == 80'");
+
+  bool pin = false;
+  app.add_flag("--pin", pin, "Pin capture and decode threads to CPUs");
+
+  bool verify = false;
+  app.add_flag("--verify-checksums", verify,
+               "Count packets with a wrong IPv4, TCP or UDP checksum");
+
+  // Live capture only: a file or generator can always wait for workers.
+  bool shed = false;
+  LoadShedder::Config shedding;
+  double shed_latency_ms = 20;
+  CLI::Option_group *shedding_group = app.add_option_group(
+      "Load shedding",
+      "When decoding falls behind, keep only 1 in N flows (all packets of "
+      "each) rather than dropping packets at random; N doubles while the "
+      "overload lasts and halves back to full capture after it. Counts "
+      "are scaled by N");
+  shedding_group->add_flag("--shed", shed, "Shed load under overload")
+      ->excludes(read_option);
+  shedding_group
+      ->add_option("--shed-queue", shedding.queue_high,
+                   "Share of a decode queue in use that starts shedding; it "
+                   "eases off below a quarter of that")
+      ->check(CLI::Range(0.0, 1.0));
+  shedding_group
+      ->add_option("--shed-latency-ms", shed_latency_ms,
+                   "Wait before decoding that starts shedding; it eases off "
+                   "below a tenth of that")
+      ->check(CLI::PositiveNumber);
+  shedding_group->add_option("--shed-max-rate", shedding.max_rate,
+                             "Coarsest sampling, 1 in this many flows (a "
+                             "power of two)");
+
+  bool print = false;
+  CLI::Option *print_option =
+      app.add_flag("-p,--print", print, "Print a line per packet");
+  uint32_t print_sample = 1;
+  app.add_option("--print-sample", print_sample,
+                 "Print one packet in this many (per decode thread)")
+      ->check(CLI::PositiveNumber)
+      ->needs(print_option);
+  uint32_t print_rate = 0;
+  app.add_option("--print-rate", print_rate,
+                 "Print at most this many lines per second; 0 for no limit")
+      ->needs(print_option);
+
+  std::string columns_path;
+  app.add_option("--write-columns", columns_path,
+                 "Also keep the decoded headers in compact column files, "
+                 "PATH.0 to PATH.<workers - 1>");
+
+  std::size_t top = 0;
+  app.add_option("--top", top,
+                 "Report the N heaviest sources, destinations and ports at "
+                 "the end");
+
+  bool reassemble = false;
+  CLI::Option *reassemble_option =
+      app.add_flag("--reassemble", reassemble,
+                   "Put fragmented IP datagrams and TCP streams back "
+                   "together and report on them");
+  bool parse_http = false;
+  app.add_flag("--parse-http", parse_http,
+               "Count the HTTP/1.x requests and responses in the TCP "
+               "streams")
+      ->needs(reassemble_option);
+
+  std::string stats_path;
+  CLI::Option *stats_option = app.add_option(
+      "--stats-file", stats_path,
+      "Keep per-stage counters and latency histograms in this file, in "
+      "Prometheus text format (needs LAYERSPY_INSTRUMENTATION)");
+  double stats_interval = 10;
+  app.add_option("--stats-interval", stats_interval,
+                 "Seconds between rewrites of the stats file")
+      ->check(CLI::PositiveNumber)
+      ->needs(stats_option);
+
+  // Synthetic traffic, for load tests without a network
+  uint64_t generate = 0;
+  std::string write_path;
+  TrafficGenerator::Config traffic;
+  std::vector<std::string> sizes = {"40:7", "576:4", "1500:1"};
+  CLI::Option_group *generator = app.add_option_group(
+      "Traffic generator", "Analyze generated traffic instead of capturing");
+  CLI::Option *generate_option =
+      generator
+          ->add_option("--generate", generate,
+                       "Number of packets to generate; each decode thread "
+                       "generates its share")
+          ->check(CLI::PositiveNumber)
+          ->excludes(read_option);
+  generator
+      ->add_option("--write-pcap", write_path,
+                   "Write the generated packets to this pcap file and exit")
+      ->needs(generate_option);
+  generator->add_option("--seed", traffic.seed,
+                        "Seed; the same options give the same packets");
+  generator->add_option("--flows", traffic.flows, "Number of flows");
+  generator->add_option("--zipf", traffic.zipf_skew,
+                        "Zipf skew of flow popularity, 0 for uniform");
+  generator->add_option("--ipv6", traffic.ipv6_ratio, "Share of IPv6 flows");
+  generator->add_option("--udp", traffic.udp_ratio, "Share of UDP flows");
+  generator->add_option("--http", traffic.http_ratio,
+                        "Share of TCP flows carrying HTTP");
+  generator->add_option("--fragments", traffic.fragment_ratio,
+                        "Share of UDP datagrams sent as fragments");
+  generator->add_option("--mtu", traffic.mtu, "Largest IP packet");
+  generator
+      ->add_option("--sizes", sizes,
+                   "IP packet sizes and their weights, size:weight,...")
+      ->delimiter(',');
+
+  // Sidecar index, for reading one flow or stretch of time of a big file
+  bool build_index = false;
+  std::string from_text;
+  std::string to_text;
+  std::vector<std::string> flow_fields;
+  CLI::Option_group *indexing = app.add_option_group(
+      "Capture index",
+      "Index the file given with --read in FILE.lsidx (incrementally, as it "
+      "grows) and read only the packets asked for");
+  indexing
+      ->add_flag("--index", build_index,
+                 "Build or update the index of the file and exit")
+      ->needs(read_option);
+  indexing
+      ->add_option("--from", from_text,
+                   "Only packets at or after this time, in seconds since the "
+                   "epoch")
+      ->needs(read_option);
+  indexing
+      ->add_option("--to", to_text,
+                   "Only packets at or before this time, in seconds since the "
+                   "epoch")
+      ->needs(read_option);
+  indexing
+      ->add_option("--flow", flow_fields,
+                   "Only packets of this flow, either direction: "
+                   "proto,address,port,address,port")
+      ->delimiter(',')
+      ->needs(read_option);
+
+  // Whole-file statistics, decoded on all workers at once
+  bool summarize = false;
+  std::size_t chunk_mb = 32;
+  CLI::Option_group *summary_group = app.add_option_group(
+      "Flow summary",
+      "Split the file given with --read into chunks, decode them on "
+      "--workers threads and print exact per-flow totals; the result does "
+      "not depend on the number of threads");
+  summary_group
+      ->add_flag("--summarize", summarize,
+                 "Print the totals and the --top busiest flows and exit")
+      ->needs(read_option);
+  summary_group
+      ->add_option("--chunk-mb", chunk_mb,
+                   "Size of the pieces threads take from the file, MiB")
+      ->check(CLI::PositiveNumber);
+
   CLI11_PARSE(app, argc, argv);
 
-  std::cout << "LayerSpy starting on interface: " << interface << std::endl;
-  std::cout << "TODO: Implement packet capture logic" << std::endl;
+  if (!stats_path.empty() && !METRICS_ENABLED) {
+    std::cerr << "--stats-file needs a build with LAYERSPY_INSTRUMENTATION=ON"
+              << std::endl;
+    return 1;
+  }
+
+  const CaptureBackend backend = capture == "tpacket" ? CaptureBackend::Tpacket
+                                 : capture == "pcap"  ? CaptureBackend::Pcap
+                                                      : CaptureBackend::Auto;
+  // Generated traffic is handled like a file: read as fast as it decodes.
+  const bool offline = !read_path.empty() || generate != 0;
+  std::vector<std::unique_ptr<Sniffer>> sniffers;
+  const CaptureFileSniffer *file = nullptr;
+  const CaptureIndexSniffer *indexed = nullptr;
+  PacketFilter filter;
+  try {
+    filter = PacketFilter(filter_text);
+    if (generate != 0) {
+      traffic.sizes = parse_sizes(sizes);
+      if (!write_path.empty()) {
+        TrafficGenerator(traffic).write_pcap(write_path, generate);
+        std::cout << "Wrote " << generate << " packets to " << write_path
+                  << std::endl;
+        return 0;
+      }
+      // One generator per worker, so each decodes what it generates.
+      const uint64_t seed = traffic.seed;
+      for (std::size_t i = 0; i < workers; ++i) {
+        traffic.seed = seed + i;
+        sniffers.push_back(std::make_unique<TrafficGeneratorSniffer>(
+            traffic, generate / workers + (i < generate % workers ? 1 : 0)));
+      }
+    } else if (build_index) {
+      updated_index(read_path);
+      return 0;
+    } else if (summarize) {
+      ParallelCaptureReader::Config summary_config;
+      summary_config.threads = workers;
+      summary_config.chunk_bytes = chunk_mb * 1024 * 1024;
+      summary_config.filter = filter.empty() ? nullptr : &filter;
+      ParallelCaptureReader::Stats stats;
+      const auto start = std::chrono::steady_clock::now();
+      const CaptureSummary summary =
+          summarize_capture(read_path, summary_config, &stats);
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      print_summary(summary, top);
+      if (stats.filtered != 0) {
+        std::cout << stats.filtered << " packets filtered out" << std::endl;
+      }
+      print_throughput(stats.packets, stats.bytes,
+                       CaptureFileReader(read_path).file_size(),
+                       elapsed.count());
+      return 0;
+    } else if (!from_text.empty() || !to_text.empty() ||
+               !flow_fields.empty()) {
+      CaptureIndex::Query query;
+      if (!from_text.empty()) {
+        query.from_ns = parse_time(from_text);
+      }
+      if (!to_text.empty()) {
+        query.to_ns = parse_time(to_text);
+      }
+      if (!flow_fields.empty()) {
+        query.flow = parse_flow(flow_fields);
+      }
+      const CaptureIndex index = updated_index(read_path);
+      auto index_sniffer =
+          std::make_unique<CaptureIndexSniffer>(read_path, index, query);
+      std::cout << "Reading " << index_sniffer->blocks() << " of "
+                << index.blocks().size() << " blocks ("
+                << index_sniffer->bytes() << " of " << index.indexed_bytes()
+                << " bytes)" << std::endl;
+      indexed = index_sniffer.get();
+      sniffers.push_back(std::move(index_sniffer));
+    } else if (offline) {
+      auto file_sniffer = std::make_unique<CaptureFileSniffer>(read_path);
+      file = file_sniffer.get();
+      sniffers.push_back(std::move(file_sniffer));
+    } else {
+      sniffers = open_sniffers(interface, backend, workers);
+    }
+    // The kernel drops what it can; workers still check the whole filter.
+    bool in_kernel = !filter.empty();
+    for (const auto &sniffer : sniffers) {
+      in_kernel = sniffer->set_filter(filter) && in_kernel;
+    }
+    if (!filter.empty()) {
+      std::cout << "Filter: " << filter.expression() << " ("
+                << (in_kernel ? "in the kernel" : "checked in userspace")
+                << ")" << std::endl;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  shedding.queue_low = shedding.queue_high / 4;
+  shedding.latency_high_ns = static_cast<uint64_t>(shed_latency_ms * 1e6);
+  shedding.latency_low_ns = shedding.latency_high_ns / 10;
+  if (shed) {
+    if (generate != 0) {
+      std::cerr << "--shed is for live capture" << std::endl;
+      return 1;
+    }
+    try {
+      LoadShedder check(shedding);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  LayerSpyEngine::Config config;
+  config.workers = workers;
+  config.ring_bytes = ring_mb * 1024 * 1024;
+  config.pin_threads = pin;
+  config.verify_checksums = verify;
+  config.shed_load = shed;
+  config.shedding = shedding;
+  // A file can wait for slow workers; a live interface cannot.
+  config.block_when_full = offline;
+  if (!filter.empty()) {
+    config.filter = &filter;
+  }
+
+  // Lines are written by a thread of their own, so a slow terminal
+  // drops lines rather than slowing down decoding.
+  std::unique_ptr<Display> display;
+  if (print) {
+    Display::Config display_config;
+    display_config.workers = workers;
+    display_config.sample_every = print_sample;
+    display_config.max_lines_per_second = print_rate;
+    display = std::make_unique<Display>(display_config);
+  }
+
+  // One column file per worker, so workers never share a writer.
+  std::vector<std::unique_ptr<ColumnFileWriter>> columns(
+      columns_path.empty() ? 0 : workers);
+  std::vector<std::string> column_errors(columns.size());
+  try {
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+      columns[i] = std::make_unique<ColumnFileWriter>(columns_path + "." +
+                                                      std::to_string(i));
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  // One talker sketch per worker, merged once the workers stop.
+  std::vector<TalkerSketch> talkers;
+  if (top != 0) {
+    TalkerSketch::Config talker_config;
+    talker_config.capacity = std::max<std::size_t>(top, 256);
+    talkers.assign(workers, TalkerSketch(talker_config));
+  }
+
+  // Reassembly state per worker, allocated up front
+  std::vector<std::unique_ptr<Reassembly>> reassembly;
+  if (reassemble) {
+    for (std::size_t i = 0; i < workers; ++i) {
+      reassembly.push_back(std::make_unique<Reassembly>(parse_http));
+    }
+  }
+
+  // Per-worker byte counts; each worker only writes its own entry.
+  std::vector<uint64_t> bytes(workers);
+  const LayerSpyEngine::Handler count_bytes =
+      [&bytes, &display, &columns, &column_errors, &talkers, &reassembly](
+          std::size_t worker, const PacketRef &packet,
+          const LayerStack &stack) {
+        // Scaled up for the flows load shedding skipped
+        bytes[worker] += packet.data.length() * packet.sample_rate;
+        if (display) {
+          display->push(worker, packet, stack);
+        }
+        if (!talkers.empty()) {
+          talkers[worker].update(packet, stack);
+        }
+        if (!reassembly.empty()) {
+          reassembly[worker]->handle(packet, stack);
+        }
+        if (!columns.empty() && columns[worker]) {
+          try {
+            columns[worker]->append(packet, stack);
+          } catch (const std::exception &e) {
+            // Reported at the end; the worker carries on without its file.
+            column_errors[worker] = e.what();
+            columns[worker].reset();
+          }
+        }
+      };
+
+  // With one Sniffer per worker each worker decodes in place. Otherwise
+  // (libpcap with several workers) a capture thread shares the one Sniffer.
+  std::unique_ptr<LayerSpyEngine> engine;
+  if (sniffers.size() == workers) {
+    std::vector<Sniffer *> sources;
+    for (const auto &sniffer : sniffers) {
+      sources.push_back(sniffer.get());
+    }
+    engine = std::make_unique<LayerSpyEngine>(sources, config, count_bytes);
+  } else {
+    engine = std::make_unique<LayerSpyEngine>(*sniffers.front(), config,
+                                              count_bytes);
+  }
+
+  // Its last write, on destruction, comes after engine->stop().
+  std::unique_ptr<MetricsFileWriter> stats_writer;
+  if (!stats_path.empty()) {
+    try {
+      stats_writer = std::make_unique<MetricsFileWriter>(
+          stats_path, std::chrono::milliseconds(
+                          static_cast<int64_t>(stats_interval * 1000)));
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  const std::string source =
+      generate != 0 ? "generating " + std::to_string(generate) + " packets"
+      : offline     ? "reading " + read_path
+                    : "capturing on " + interface;
+  std::cout << "LayerSpy " << source
+            << " with " << workers
+            << " decode thread(s). Press Ctrl-C to stop." << std::endl;
+  const auto started = std::chrono::steady_clock::now();
+  engine->start();
+
+  // Short sleeps so the end of a file is noticed promptly; live counters
+  // are printed once a second.
+  uint64_t last_packets = 0;
+  auto next_report = started + std::chrono::seconds(1);
+  while (!g_stop.load() && engine->running()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // Printed packets are the live output; counters would interleave.
+    if (offline || display ||
+        std::chrono::steady_clock::now() < next_report) {
+      continue;
+    }
+    next_report += std::chrono::seconds(1);
+    const WorkerStats totals = engine->totals();
+    const uint64_t packets =
+        totals.decoded + totals.malformed + totals.filtered;
+    std::cout << packets - last_packets << " pkt/s, " << totals.dropped
+              << " dropped, queued " << totals.queue_depth;
+    if (totals.sample_rate != 1) {
+      std::cout << ", shedding: 1 in " << totals.sample_rate << " flows";
+    }
+    std::cout << std::endl;
+    last_packets = packets;
+  }
+
+  engine->stop();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - started;
+  if (display) {
+    display->stop();
+  }
 
-  return 0;
+  uint64_t total_bytes = 0;
+  for (uint64_t worker_bytes : bytes) {
+    total_bytes += worker_bytes;
+  }
+  if (offline) {
+    const WorkerStats totals = engine->totals();
+    print_throughput(totals.decoded + totals.malformed + totals.filtered,
+                     total_bytes,
+                     file != nullptr      ? file->reader().position()
+                     : indexed != nullptr ? indexed->bytes()
+                                          : total_bytes,
+                     elapsed.count());
+  }
+  if (file != nullptr) {
+    if (file->reader().skipped() != 0) {
+      std::cout << "Skipped " << file->reader().skipped()
+                << " packets from non-Ethernet interfaces." << std::endl;
+    }
+    if (file->reader().truncated()) {
+      std::cout << "Warning: the file ends in a truncated record."
+                << std::endl;
+    }
+  } else if (!offline) {
+    std::cout << "Stopped after " << total_bytes << " bytes." << std::endl;
+  }
+  print_stats(*engine, sniffers);
+  if (verify) {
+    std::cout << "  checksums: " << engine->totals().bad_checksums
+              << " packets with a bad checksum" << std::endl;
+  }
+  if (display) {
+    const Display::Stats printed = display->stats();
+    std::cout << "  printed " << printed.written << " lines, "
+              << printed.dropped << " dropped (queue full), "
+              << printed.suppressed << " over --print-rate" << std::endl;
+  }
+  if (!reassembly.empty()) {
+    for (const auto &worker : reassembly) {
+      worker->flush();
+    }
+    print_reassembly(reassembly);
+  }
+  if (!talkers.empty()) {
+    for (std::size_t i = 1; i < talkers.size(); ++i) {
+      talkers[0].merge(talkers[i]);
+    }
+    print_talkers(talkers[0], top);
+  }
+  int status = 0;
+  if (!columns.empty()) {
+    uint64_t rows = 0;
+    uint64_t column_bytes = 0;
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+      try {
+        if (columns[i]) {
+          columns[i]->close();
+          rows += columns[i]->rows();
+          column_bytes += columns[i]->bytes();
+        }
+      } catch (const std::exception &e) {
+        column_errors[i] = e.what();
+      }
+      if (!column_errors[i].empty()) {
+        std::cerr << column_errors[i] << std::endl;
+        status = 1;
+      }
+    }
+    std::cout << "  wrote " << rows << " rows, " << column_bytes
+              << " bytes to " << columns_path << ".*" << std::endl;
+  }
+  return status;
 }
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * @brief Number of calls to global operator new since the bench started.
+ *
+ * The bench binary replaces the global allocation functions with counting
+ * wrappers (see alloc_counter.cpp), so a benchmark can assert that a hot
+ * path performs no heap allocation at all.
+ */
+std::size_t allocation_count();
@@ -0,0 +1,99 @@
+#include "alloc_counter.hpp"
+#include "types/address_format.hpp"
+#include "types/ipv4_address.hpp"
+#include "types/ipv6_address.hpp"
+#include "types/mac_address.hpp"
+#include <arpa/inet.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t ADDRESSES = 100000;
+
+template <typename Address>
+std::vector<Address> random_addresses(std::size_t length) {
+  std::mt19937 rng(11);
+  std::vector<Address> addresses;
+  addresses.reserve(ADDRESSES);
+  unsigned char bytes[16] = {};
+  for (std::size_t i = 0; i < ADDRESSES; ++i) {
+    for (std::size_t b = 0; b < length; ++b) {
+      // Mostly small values, like real address plans
+      bytes[b] = static_cast<unsigned char>(rng() % 4 == 0 ? 0 : rng());
+    }
+    addresses.emplace_back(bytes);
+  }
+  return addresses;
+}
+
+} // namespace
+
+TEST_CASE("Address formatting does not allocate",
+          "[address_format][benchmark]") {
+  const auto v4 = random_addresses<Ipv4Address>(Ipv4Address::LENGTH);
+  const auto v6 = random_addresses<Ipv6Address>(Ipv6Address::LENGTH);
+  const auto mac = random_addresses<MacAddress>(MacAddress::LENGTH);
+  std::vector<char> out(ADDRESSES * (Ipv6Address::MAX_STRING_LENGTH + 1));
+
+  const std::size_t before = allocation_count();
+  format_addresses(v4.data(), v4.size(), out.data());
+  format_addresses(v6.data(), v6.size(), out.data());
+  format_addresses(mac.data(), mac.size(), out.data());
+  CHECK(allocation_count() == before);
+}
+
+TEST_CASE("Address formatting - throughput", "[address_format][benchmark]") {
+  const auto v4 = random_addresses<Ipv4Address>(Ipv4Address::LENGTH);
+  const auto v6 = random_addresses<Ipv6Address>(Ipv6Address::LENGTH);
+  const auto mac = random_addresses<MacAddress>(MacAddress::LENGTH);
+  std::vector<char> out(ADDRESSES * (Ipv6Address::MAX_STRING_LENGTH + 1));
+
+  BENCHMARK("IPv4 format_addresses (100k)") {
+    return format_addresses(v4.data(), v4.size(), out.data());
+  };
+  BENCHMARK("IPv4 inet_ntop (100k)") {
+    char *p = out.data();
+    for (const Ipv4Address &address : v4) {
+      const in_addr addr{htonl(address.hostOrder())};
+      inet_ntop(AF_INET, &addr, p, INET_ADDRSTRLEN);
+      p += Ipv4Address::MAX_STRING_LENGTH + 1;
+    }
+    return p;
+  };
+  BENCHMARK("IPv6 format_addresses (100k)") {
+    return format_addresses(v6.data(), v6.size(), out.data());
+  };
+  BENCHMARK("IPv6 inet_ntop (100k)") {
+    char *p = out.data();
+    for (const Ipv6Address &address : v6) {
+      inet_ntop(AF_INET6, address.bytes().data(), p, INET6_ADDRSTRLEN);
+      p += Ipv6Address::MAX_STRING_LENGTH + 1;
+    }
+    return p;
+  };
+  BENCHMARK("MAC format_addresses (100k)") {
+    return format_addresses(mac.data(), mac.size(), out.data());
+  };
+}
+
+TEST_CASE("Address formatting - toString", "[address_format][benchmark]") {
+  const auto v4 = random_addresses<Ipv4Address>(Ipv4Address::LENGTH);
+  const auto v6 = random_addresses<Ipv6Address>(Ipv6Address::LENGTH);
+  const auto mac = random_addresses<MacAddress>(MacAddress::LENGTH);
+
+  // The allocating API most callers still use, for comparison
+  const auto total_length = [](const auto &addresses) {
+    std::size_t length = 0;
+    for (const auto &address : addresses) {
+      length += address.toString().length();
+    }
+    return length;
+  };
+  BENCHMARK("Ipv4Address::toString (100k)") { return total_length(v4); };
+  BENCHMARK("Ipv6Address::toString (100k)") { return total_length(v6); };
+  BENCHMARK("MacAddress::toString (100k)") { return total_length(mac); };
+}
@@ -0,0 +1,81 @@
+#include "capture_file.hpp"
+#include "decoder.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t PACKETS = 200000;
+
+// Writes a little-endian microsecond pcap of Ethernet/IPv4/TCP frames with
+// payloads of 0..1399 bytes and returns its path.
+std::string write_capture() {
+  char path[] = "/tmp/layerspy_bench_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  FILE *out = fdopen(fd, "wb");
+
+  const uint32_t header[6] = {0xA1B2C3D4, 0x00040002, 0, 0, 65535, 1};
+  std::fwrite(header, sizeof(header), 1, out);
+
+  std::string frame;
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    const std::size_t payload = (i * 37) % 1400;
+    const std::size_t ip_len = 20 + 20 + payload;
+    frame.assign(14 + ip_len, '\0');
+    auto *b = reinterpret_cast<unsigned char *>(frame.data());
+    b[12] = 0x08;
+    b[14] = 0x45;
+    b[16] = static_cast<unsigned char>(ip_len >> 8);
+    b[17] = static_cast<unsigned char>(ip_len);
+    b[23] = 6;
+    b[29] = static_cast<unsigned char>(i);
+    b[37] = 80;
+    b[46] = 0x50;
+
+    const uint32_t record[4] = {static_cast<uint32_t>(i / 1000),
+                                static_cast<uint32_t>(i % 1000),
+                                static_cast<uint32_t>(frame.size()),
+                                static_cast<uint32_t>(frame.size())};
+    std::fwrite(record, sizeof(record), 1, out);
+    std::fwrite(frame.data(), frame.size(), 1, out);
+  }
+  std::fclose(out);
+  return path;
+}
+
+} // namespace
+
+TEST_CASE("CaptureFileReader - mmap read and decode",
+          "[capture_file][benchmark]") {
+  const std::string path = write_capture();
+  CaptureFileReader reader(path);
+  Decoder decoder;
+  LayerStack stack;
+
+  BENCHMARK("walk records (200k packets)") {
+    reader.rewind();
+    std::size_t bytes = 0;
+    PacketRef packet;
+    while (reader.next(packet)) {
+      bytes += packet.data.size();
+    }
+    return bytes;
+  };
+
+  BENCHMARK("walk records + decode (200k packets)") {
+    reader.rewind();
+    std::size_t decoded = 0;
+    PacketRef packet;
+    while (reader.next(packet)) {
+      decoded += decoder.decode(packet.data, stack) ? 1 : 0;
+    }
+    return decoded;
+  };
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,105 @@
+#include "capture_file.hpp"
+#include "capture_index.hpp"
+#include "decoder.hpp"
+#include "flow_key.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t PACKETS = 500000;
+
+std::string temp_path() {
+  char path[] = "/tmp/layerspy_bench_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  return path;
+}
+
+// A flow of middling popularity: its 500th packet
+FlowKey some_flow(const std::string &pcap) {
+  CaptureFileReader reader(pcap);
+  Decoder decoder;
+  LayerStack stack;
+  PacketRef packet;
+  FlowKey flow;
+  for (int i = 0; i < 500 && reader.next(packet); ++i) {
+    decoder.decode(packet.data, stack);
+    FlowKey::from_packet(packet.data, stack, flow);
+  }
+  return flow;
+}
+
+} // namespace
+
+TEST_CASE("CaptureIndex - build and query", "[capture_index][benchmark]") {
+  const std::string pcap = temp_path();
+  TrafficGenerator::Config traffic;
+  traffic.flows = 100000;
+  TrafficGenerator(traffic).write_pcap(pcap, PACKETS);
+
+  BENCHMARK("build the index (500k packets)") {
+    CaptureIndex index(CaptureIndex::Config{});
+    CaptureFileReader reader(pcap);
+    return index.update(reader);
+  };
+
+  CaptureIndex index(CaptureIndex::Config{});
+  {
+    CaptureFileReader reader(pcap);
+    index.update(reader);
+  }
+  CaptureIndex::Query query;
+  query.flow = some_flow(pcap);
+  const auto count = [](Sniffer &sniffer) {
+    uint64_t packets = 0;
+    while (sniffer.poll(64, [&packets](const PacketRef &) { ++packets; }) >
+           0) {
+    }
+    return packets;
+  };
+
+  BENCHMARK("one flow, full scan (500k packets)") {
+    CaptureFileReader reader(pcap);
+    Decoder decoder;
+    LayerStack stack;
+    const FlowKey wanted = query.flow.canonical();
+    PacketRef packet;
+    FlowKey flow;
+    uint64_t packets = 0;
+    while (reader.next(packet)) {
+      decoder.decode(packet.data, stack);
+      packets += FlowKey::from_packet(packet.data, stack, flow) &&
+                         flow.canonical() == wanted
+                     ? 1
+                     : 0;
+    }
+    return packets;
+  };
+  BENCHMARK("one flow, through the index (500k packets)") {
+    CaptureIndexSniffer sniffer(pcap, index, query);
+    return count(sniffer);
+  };
+
+  // A tenth of the capture by time alone
+  CaptureIndex::Query stretch;
+  stretch.from_ns = PACKETS / 2 * traffic.interval_ns;
+  stretch.to_ns = stretch.from_ns + PACKETS / 10 * traffic.interval_ns;
+  BENCHMARK("a tenth of the time, through the index (500k packets)") {
+    CaptureIndexSniffer sniffer(pcap, index, stretch);
+    return count(sniffer);
+  };
+
+  CaptureIndexSniffer sniffer(pcap, index, query);
+  std::cout << "CaptureIndex: one flow in " << sniffer.blocks() << " of "
+            << index.blocks().size() << " blocks, " << count(sniffer)
+            << " packets" << std::endl;
+  std::remove(pcap.c_str());
+}
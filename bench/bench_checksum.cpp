@@ -0,0 +1,79 @@
+#include "checksum.hpp"
+#include "decoder.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t PACKETS = 10000;
+
+// IMIX traffic (7 x 40, 4 x 576 and 1 x 1500 bytes), so most checksum
+// bytes are in the few full-size packets.
+std::vector<std::string> imix() {
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  std::vector<std::string> frames;
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    frames.emplace_back(generator.next().data);
+  }
+  return frames;
+}
+
+} // namespace
+
+TEST_CASE("Checksum - kernels", "[checksum][benchmark]") {
+  const std::string data(1500, '\x5a');
+  for (Checksum::Kernel kernel :
+       {Checksum::Kernel::Scalar, Checksum::Kernel::SSE2,
+        Checksum::Kernel::AVX2}) {
+    if (!Checksum::isSupported(kernel)) {
+      continue;
+    }
+    const char *name = kernel == Checksum::Kernel::AVX2   ? "AVX2"
+                       : kernel == Checksum::Kernel::SSE2 ? "SSE2"
+                                                          : "scalar";
+    Checksum checksum(kernel);
+    BENCHMARK(std::string("sum 1500 bytes, ") + name) {
+      checksum.clear();
+      checksum.add(data);
+      return checksum.sum();
+    };
+  }
+}
+
+TEST_CASE("Checksum - cost next to decoding", "[checksum][benchmark]") {
+  const std::vector<std::string> frames = imix();
+  Decoder decoder;
+  LayerStack stack;
+
+  BENCHMARK("decode, IMIX (10k packets)") {
+    std::size_t decoded = 0;
+    for (const std::string &frame : frames) {
+      decoded += decoder.decode(frame, stack) ? 1 : 0;
+    }
+    return decoded;
+  };
+  BENCHMARK("decode and verify, IMIX (10k packets)") {
+    std::size_t bad = 0;
+    for (const std::string &frame : frames) {
+      decoder.decode(frame, stack);
+      bad += verify_checksums(PacketRef{frame, 0}, stack).bad() ? 1 : 0;
+    }
+    return bad;
+  };
+  BENCHMARK("decode and verify, scalar, IMIX (10k packets)") {
+    std::size_t bad = 0;
+    for (const std::string &frame : frames) {
+      decoder.decode(frame, stack);
+      bad += verify_checksums(PacketRef{frame, 0}, stack,
+                              Checksum::Kernel::Scalar)
+                     .bad()
+                 ? 1
+                 : 0;
+    }
+    return bad;
+  };
+}
@@ -0,0 +1,70 @@
+#include "decoder.hpp"
+#include "packet_classifier.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t BATCH = 256;
+
+// A shuffled mix of IPv4 TCP/UDP, IPv6 TCP and ARP frames, so branchy code
+// cannot learn the pattern.
+std::vector<std::string> make_frames() {
+  std::mt19937 rng(42);
+  std::vector<std::string> frames;
+  for (std::size_t i = 0; i < BATCH; ++i) {
+    std::string f(128, '\0');
+    switch (rng() % 4) {
+    case 0:
+    case 1:
+      f[12] = '\x08';
+      f[14] = '\x45';
+      f[23] = (i % 4 == 0) ? 6 : 17;
+      f[36] = 0;
+      f[37] = (i % 8 == 0) ? 80 : 53;
+      break;
+    case 2:
+      f[12] = '\x86';
+      f[13] = '\xdd';
+      f[14] = '\x60';
+      f[20] = 6;
+      f[57] = static_cast<char>(i);
+      break;
+    default:
+      f[12] = '\x08';
+      f[13] = '\x06';
+      break;
+    }
+    frames.push_back(std::move(f));
+  }
+  return frames;
+}
+
+} // namespace
+
+TEST_CASE("PacketClassifier - classify vs full decode",
+          "[classifier][benchmark]") {
+  const std::vector<std::string> frames = make_frames();
+  std::vector<PacketRef> refs;
+  for (const std::string &f : frames) {
+    refs.push_back(PacketRef{f, 0});
+  }
+  std::vector<PacketClassifier::Tag> tags(refs.size());
+
+  PacketClassifier classifier;
+  classifier.monitorPort(80);
+
+  BENCHMARK("classify (256 frames)") {
+    classifier.classify(refs.data(), refs.size(), tags.data());
+    return tags[0];
+  };
+
+  Decoder decoder;
+  PacketColumns columns;
+  BENCHMARK("decodeBatch (256 frames)") {
+    return decoder.decodeBatch(refs.data(), refs.size(), columns);
+  };
+}
@@ -0,0 +1,114 @@
+#include "capture_file.hpp"
+#include "column_file.hpp"
+#include "decoder.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t PACKETS = 200000;
+
+std::string temp_path() {
+  char path[] = "/tmp/layerspy_bench_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  return path;
+}
+
+struct Decoded {
+  std::vector<std::string> frames;
+  std::vector<PacketRef> packets;
+  std::vector<LayerStack> stacks;
+};
+
+Decoded decoded_traffic() {
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  Decoded traffic;
+  traffic.frames.reserve(PACKETS);
+  traffic.stacks.resize(PACKETS);
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    const PacketRef packet = generator.next();
+    traffic.frames.emplace_back(packet.data);
+    traffic.packets.push_back(
+        PacketRef{traffic.frames.back(), packet.timestamp_ns});
+    decoder.decode(traffic.frames.back(), traffic.stacks[i]);
+  }
+  return traffic;
+}
+
+} // namespace
+
+TEST_CASE("ColumnFile - write", "[column_file][benchmark]") {
+  const Decoded traffic = decoded_traffic();
+  const std::string path = temp_path();
+
+  BENCHMARK("append and close (200k packets)") {
+    ColumnFileWriter writer(path);
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      writer.append(traffic.packets[i], traffic.stacks[i]);
+    }
+    writer.close();
+    return writer.bytes();
+  };
+  std::remove(path.c_str());
+}
+
+// The same question asked of both formats: how many bytes went to port 80?
+TEST_CASE("ColumnFile - query against pcap", "[column_file][benchmark]") {
+  const std::string pcap = temp_path();
+  const std::string columns = temp_path();
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  generator.write_pcap(pcap, PACKETS);
+  {
+    const Decoded traffic = decoded_traffic();
+    ColumnFileWriter writer(columns);
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      writer.append(traffic.packets[i], traffic.stacks[i]);
+    }
+  }
+
+  BENCHMARK("pcap: read and decode (200k packets)") {
+    CaptureFileReader reader(pcap);
+    Decoder decoder;
+    LayerStack stack;
+    PacketRef packet;
+    uint64_t bytes = 0;
+    while (reader.next(packet)) {
+      decoder.decode(packet.data, stack);
+      const TCPHeader *tcp = stack.get<TCP>();
+      if (tcp != nullptr && tcp->dst_port == 80) {
+        bytes += packet.data.length();
+      }
+    }
+    return bytes;
+  };
+
+  BENCHMARK("columns: two columns (200k packets)") {
+    ColumnFileReader reader(columns);
+    std::vector<uint64_t> ports;
+    std::vector<uint64_t> lengths;
+    uint64_t bytes = 0;
+    for (std::size_t chunk = 0; chunk < reader.chunks(); ++chunk) {
+      const ColumnStats range = reader.stats(chunk, Column::DstPort);
+      if (range.max < 80 || range.min > 80) {
+        continue;
+      }
+      reader.read(chunk, Column::DstPort, ports);
+      reader.read(chunk, Column::Length, lengths);
+      for (std::size_t row = 0; row < ports.size(); ++row) {
+        bytes += ports[row] == 80 ? lengths[row] : 0;
+      }
+    }
+    return bytes;
+  };
+  std::remove(pcap.c_str());
+  std::remove(columns.c_str());
+}
@@ -0,0 +1,85 @@
+#include "alloc_counter.hpp"
+#include "decoder.hpp"
+#include "packet_columns.hpp"
+#include "packet_ref.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t BATCH = 256;
+
+// Builds a batch of Ethernet/IPv4/TCP frames with varying addresses, ports
+// and payload sizes. The returned strings own the bytes the refs point into.
+std::vector<std::string> make_frames() {
+  std::vector<std::string> frames;
+  for (std::size_t i = 0; i < BATCH; ++i) {
+    const std::size_t payload = (i * 37) % 1400;
+    const std::size_t ip_len = 20 + 20 + payload;
+    std::string frame(14 + ip_len, '\0');
+    auto *b = reinterpret_cast<unsigned char *>(frame.data());
+    b[12] = 0x08; // IPv4
+    b[14] = 0x45;
+    b[16] = static_cast<unsigned char>(ip_len >> 8);
+    b[17] = static_cast<unsigned char>(ip_len);
+    b[22] = 64;
+    b[23] = 6; // TCP
+    b[26] = 10;
+    b[29] = static_cast<unsigned char>(i);
+    b[30] = 192;
+    b[31] = 168;
+    b[33] = static_cast<unsigned char>(i >> 2);
+    b[34] = static_cast<unsigned char>(0xC0 | (i & 0x3F));
+    b[35] = static_cast<unsigned char>(i);
+    b[37] = (i % 3 == 0) ? 80 : 53;
+    b[46] = 0x50;
+    b[47] = 0x18;
+    frames.push_back(std::move(frame));
+  }
+  return frames;
+}
+
+} // namespace
+
+TEST_CASE("Decoder - decodeBatch vs decodePacket loop",
+          "[decoder][batch][benchmark]") {
+  const std::vector<std::string> frames = make_frames();
+  std::vector<PacketRef> refs;
+  for (const std::string &frame : frames) {
+    refs.push_back(PacketRef{frame, 0});
+  }
+
+  Decoder decoder;
+  PacketColumns columns;
+  decoder.decodeBatch(refs.data(), refs.size(), columns);
+
+  const std::size_t before = allocation_count();
+  decoder.decodeBatch(refs.data(), refs.size(), columns);
+  CHECK(allocation_count() == before);
+
+  // Both variants compute the same aggregate: bytes sent to port 80.
+  BENCHMARK("decodePacket loop (256 packets)") {
+    uint64_t http_bytes = 0;
+    for (const PacketRef &packet : refs) {
+      LayerPtr tree = decoder.decodePacket(packet.data);
+      auto *ipv4 = dynamic_cast<IPv4 *>(tree->payload.get());
+      auto *tcp = ipv4 ? dynamic_cast<TCP *>(ipv4->payload.get()) : nullptr;
+      if (tcp != nullptr && tcp->dst_port == 80) {
+        http_bytes += tcp->raw_payload.size();
+      }
+    }
+    return http_bytes;
+  };
+
+  BENCHMARK("decodeBatch + column scan (256 packets)") {
+    decoder.decodeBatch(refs.data(), refs.size(), columns);
+    uint64_t http_bytes = 0;
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+      http_bytes += (columns.dst_port[i] == 80) ? columns.payload_length[i] : 0;
+    }
+    return http_bytes;
+  };
+}
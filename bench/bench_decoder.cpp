@@ -0,0 +1,193 @@
+#include "alloc_counter.hpp"
+#include "decoder.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv4 / TCP carrying the start of an HTTP request
+const unsigned char tcp_packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x08, 0x00, 0x45, 0x00, 0x00, 0x38, 0x00, 0x01, 0x40, 0x00, 0x40, 0x06,
+    0x00, 0x00, 0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00, 0x01, 0xc7, 0x38,
+    0x00, 0x50, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xc8, 0x50, 0x18,
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 'G',  'E',  'T',  ' ',  '/',  ' ',
+    'H',  'T',  'T',  'P',  '/',  '1',  '.',  '1',  '\r', '\n'};
+
+// Stands in for a plugin parser; never reached by tcp_packet.
+NextLayer parse_nothing(DecodeState &, void *) { return {}; }
+
+std::string_view packet_view() {
+  return std::string_view(reinterpret_cast<const char *>(tcp_packet),
+                          sizeof(tcp_packet));
+}
+
+// Ethernet / IPv4 / TCP with `payload` bytes of data
+std::string ipv4_tcp(std::size_t payload) {
+  std::string f(14 + 20 + 20 + payload, '\0');
+  f[12] = 0x08;
+  f[14] = 0x45;
+  f[16] = static_cast<char>((40 + payload) >> 8);
+  f[17] = static_cast<char>(40 + payload);
+  f[23] = 6;
+  f[46] = 0x50;
+  return f;
+}
+
+// Ethernet / IPv6 / `extension` bytes of Hop-by-Hop options / TCP
+std::string ipv6_tcp(std::size_t payload, std::size_t extension = 0) {
+  std::string f(14 + 40 + extension + 20 + payload, '\0');
+  f[12] = static_cast<char>(0x86);
+  f[13] = static_cast<char>(0xdd);
+  f[14] = 0x60;
+  const std::size_t length = extension + 20 + payload;
+  f[18] = static_cast<char>(length >> 8);
+  f[19] = static_cast<char>(length);
+  f[20] = extension == 0 ? 6 : 0;
+  if (extension != 0) {
+    f[54] = 6;
+    f[55] = static_cast<char>(extension / 8 - 1);
+  }
+  f[54 + extension + 12] = 0x50;
+  return f;
+}
+
+// A capture-like mix: mostly IPv4 TCP (bare ACKs and full segments), some
+// IPv6, IPv6 with extension headers, UDP and ARP, shuffled.
+std::vector<std::string> traffic_mix(std::size_t count) {
+  std::mt19937 rng(3);
+  std::vector<std::string> frames;
+  frames.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const unsigned pick = rng() % 100;
+    if (pick < 40) {
+      frames.push_back(ipv4_tcp(0));
+    } else if (pick < 70) {
+      frames.push_back(ipv4_tcp(1460));
+    } else if (pick < 82) {
+      frames.push_back(ipv6_tcp(rng() % 2 == 0 ? 0 : 1440));
+    } else if (pick < 85) {
+      frames.push_back(ipv6_tcp(512, 8));
+    } else if (pick < 95) {
+      std::string udp = ipv4_tcp(100);
+      udp[23] = 17;
+      frames.push_back(std::move(udp));
+    } else {
+      std::string arp(60, '\0');
+      arp[12] = 0x08;
+      arp[13] = 0x06;
+      frames.push_back(std::move(arp));
+    }
+  }
+  return frames;
+}
+
+} // namespace
+
+TEST_CASE("Decoder - zero allocations per packet in steady state",
+          "[decoder][alloc]") {
+  constexpr int BATCH = 512;
+  constexpr int ROUNDS = 200;
+
+  Decoder decoder;
+  std::vector<LayerPtr> batch;
+  batch.reserve(BATCH);
+
+  // Warm-up batch grows the arena to the working-set size.
+  for (int i = 0; i < BATCH; ++i) {
+    batch.push_back(decoder.decodePacket(packet_view()));
+  }
+  batch.clear();
+
+  const std::size_t before = allocation_count();
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (int i = 0; i < BATCH; ++i) {
+      batch.push_back(decoder.decodePacket(packet_view()));
+    }
+    batch.clear();
+  }
+  const std::size_t allocations = allocation_count() - before;
+
+  INFO("allocations per packet: "
+       << static_cast<double>(allocations) / (BATCH * ROUNDS));
+  CHECK(allocations == 0);
+}
+
+TEST_CASE("Decoder - decodePacket throughput", "[decoder][benchmark]") {
+  Decoder decoder;
+  const std::string_view packet = packet_view();
+
+  BENCHMARK("decodePacket Ethernet/IPv4/TCP") {
+    return decoder.decodePacket(packet) != nullptr;
+  };
+
+  LayerStack stack;
+  BENCHMARK("decode into LayerStack Ethernet/IPv4/TCP") {
+    return decoder.decode(packet, stack);
+  };
+}
+
+TEST_CASE("Decoder - traffic mix", "[decoder][benchmark]") {
+  const std::vector<std::string> frames = traffic_mix(1024);
+  Decoder decoder;
+  decoder.reserve(1);
+
+  BENCHMARK("decodePacket (1024 mixed frames)") {
+    std::size_t layers = 0;
+    for (const std::string &frame : frames) {
+      const LayerPtr root = decoder.decodePacket(frame);
+      for (const BaseProtocol *layer = root.get(); layer != nullptr;
+           layer = layer->payload.get()) {
+        ++layers;
+      }
+    }
+    return layers;
+  };
+
+  LayerStack stack;
+  BENCHMARK("decode into LayerStack (1024 mixed frames)") {
+    std::size_t layers = 0;
+    for (const std::string &frame : frames) {
+      decoder.decode(frame, stack);
+      layers += stack.size();
+    }
+    return layers;
+  };
+}
+
+TEST_CASE("Decoder - dispatch cost does not grow with registered protocols",
+          "[decoder][benchmark]") {
+  const std::string_view packet = packet_view();
+  LayerStack stack;
+
+  Decoder builtin;
+  BENCHMARK("decode, built-in parsers only") {
+    return builtin.decode(packet, stack);
+  };
+
+  // Every key on the path but the ones tcp_packet uses, with up to 250
+  // distinct parsers
+  ProtocolRegistry crowded;
+  int contexts[250];
+  for (uint16_t key = 0; key < 250; ++key) {
+    if (key != IPv4::PROTO_TCP) {
+      crowded.add(Dispatch::IpProtocol, key, parse_nothing, &contexts[key]);
+    }
+    crowded.add(Dispatch::EtherType, static_cast<uint16_t>(0x9000 + key),
+                parse_nothing, &contexts[key]);
+  }
+  for (uint32_t port = 1024; port <= 65535; ++port) {
+    if (port != 51000) {
+      crowded.add(Dispatch::Port, static_cast<uint16_t>(port), parse_nothing,
+                  &contexts[port % 250]);
+    }
+  }
+  Decoder decoder(crowded);
+  BENCHMARK("decode, 250 parsers and 64k ports registered") {
+    return decoder.decode(packet, stack);
+  };
+}
@@ -0,0 +1,89 @@
+#include "alloc_counter.hpp"
+#include "decoder.hpp"
+#include "display.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t PACKETS = 10000;
+
+struct Decoded {
+  std::vector<std::string> frames;
+  std::vector<LayerStack> stacks;
+  std::vector<PacketSummary> summaries;
+};
+
+Decoded decoded_traffic() {
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  Decoded traffic;
+  traffic.stacks.resize(PACKETS);
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    const PacketRef packet = generator.next();
+    traffic.frames.emplace_back(packet.data);
+    decoder.decode(traffic.frames.back(), traffic.stacks[i]);
+    traffic.summaries.push_back(
+        PacketSummary::from(0, packet, traffic.stacks[i]));
+  }
+  return traffic;
+}
+
+} // namespace
+
+TEST_CASE("Display - formatting", "[display][benchmark]") {
+  const Decoded traffic = decoded_traffic();
+  std::vector<char> out(PACKETS * Display::MAX_LINE);
+
+  const std::size_t before = allocation_count();
+  Display::format(traffic.summaries.front(), out.data());
+  CHECK(allocation_count() == before);
+
+  BENCHMARK("format (10k lines)") {
+    char *p = out.data();
+    for (const PacketSummary &summary : traffic.summaries) {
+      p = Display::format(summary, p);
+    }
+    return p;
+  };
+  // What printing each packet with iostreams would cost, before any I/O
+  BENCHMARK("ostringstream (10k lines)") {
+    std::ostringstream text;
+    for (const PacketSummary &summary : traffic.summaries) {
+      text << summary.timestamp_ns / 1000000000 << '.'
+           << summary.timestamp_ns % 1000000000 << " #" << summary.worker
+           << ' ' << unsigned{summary.flow.protocol} << ' '
+           << summary.flow.src_port << " > " << summary.flow.dst_port
+           << " len " << summary.length << std::endl;
+    }
+    return text.str().length();
+  };
+}
+
+// The cost a worker pays per printed packet
+TEST_CASE("Display - push", "[display][benchmark]") {
+  const Decoded traffic = decoded_traffic();
+  const int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  REQUIRE(fd >= 0);
+  Display::Config config;
+  config.fd = fd;
+  config.queue_records = 1 << 16;
+  Display display(config);
+
+  BENCHMARK("push (10k packets)") {
+    std::size_t queued = 0;
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      const PacketRef packet{traffic.frames[i], 0};
+      queued += display.push(0, packet, traffic.stacks[i]) ? 1 : 0;
+    }
+    return queued;
+  };
+  display.stop();
+  close(fd);
+}
@@ -0,0 +1,117 @@
+#include "layerspy_engine.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t FLOWS = 1024;
+constexpr std::size_t PACKETS = 200000;
+
+// Ethernet/IPv4/TCP frames spread over FLOWS flows, both directions.
+std::vector<std::string> make_frames() {
+  std::vector<std::string> frames;
+  for (std::size_t i = 0; i < FLOWS; ++i) {
+    const std::size_t payload = (i * 37) % 1400;
+    const std::size_t ip_len = 20 + 20 + payload;
+    std::string frame(14 + ip_len, '\0');
+    auto *b = reinterpret_cast<unsigned char *>(frame.data());
+    b[12] = 0x08; // IPv4
+    b[14] = 0x45;
+    b[16] = static_cast<unsigned char>(ip_len >> 8);
+    b[17] = static_cast<unsigned char>(ip_len);
+    b[22] = 64;
+    b[23] = 6; // TCP
+    b[26] = 10;
+    b[28] = static_cast<unsigned char>(i >> 8);
+    b[29] = static_cast<unsigned char>(i);
+    b[30] = 192;
+    b[31] = 168;
+    b[34] = static_cast<unsigned char>(0xC0 | (i & 0x3F));
+    b[35] = static_cast<unsigned char>(i);
+    b[37] = 80;
+    b[46] = 0x50;
+    frames.push_back(frame);
+
+    // Reply: swap addresses and ports.
+    for (int k = 0; k < 4; ++k) {
+      std::swap(b[26 + k], b[30 + k]);
+    }
+    std::swap(b[34], b[36]);
+    std::swap(b[35], b[37]);
+    frames.push_back(std::move(frame));
+  }
+  return frames;
+}
+
+// Hands out `count` packets from `frames` as fast as the engine takes them.
+class ReplaySniffer : public Sniffer {
+public:
+  ReplaySniffer(const std::vector<std::string> &frames, std::size_t count)
+      : m_frames(frames), m_remaining(count) {}
+
+  int poll(int max_packets, const Callback &callback) override {
+    if (m_remaining == 0) {
+      return -1;
+    }
+    int delivered = 0;
+    while (delivered < max_packets && m_remaining != 0) {
+      callback(PacketRef{m_frames[m_next], 0});
+      m_next = (m_next + 1) % m_frames.size();
+      --m_remaining;
+      ++delivered;
+    }
+    return delivered;
+  }
+
+  void interrupt() override {}
+  void clear_interrupt() override {}
+  SnifferStats stats() const override { return {}; }
+
+private:
+  const std::vector<std::string> &m_frames;
+  std::size_t m_remaining;
+  std::size_t m_next = 0;
+};
+
+uint64_t run_engine(const std::vector<std::string> &frames,
+                    std::size_t workers, bool shed_load = false) {
+  ReplaySniffer sniffer(frames, PACKETS);
+  LayerSpyEngine::Config config;
+  config.workers = workers;
+  config.block_when_full = true;
+  // Armed but never triggered, to measure what watching the load costs
+  config.shed_load = shed_load;
+  config.shedding.queue_high = 1;
+  config.shedding.latency_high_ns = UINT64_MAX;
+  LayerSpyEngine engine(sniffer, config, nullptr);
+  engine.start();
+  engine.wait();
+  return engine.totals().decoded;
+}
+
+} // namespace
+
+// Compare the per-packet time across worker counts: on a machine with at
+// least workers + 1 free cores it should drop roughly as 1 / workers until
+// the capture thread saturates.
+TEST_CASE("LayerSpyEngine - throughput by worker count",
+          "[engine][benchmark]") {
+  const std::vector<std::string> frames = make_frames();
+  REQUIRE(run_engine(frames, 1) == PACKETS);
+
+  BENCHMARK("engine, 1 worker (200k packets)") {
+    return run_engine(frames, 1);
+  };
+  BENCHMARK("engine, 2 workers (200k packets)") {
+    return run_engine(frames, 2);
+  };
+  BENCHMARK("engine, 4 workers (200k packets)") {
+    return run_engine(frames, 4);
+  };
+  BENCHMARK("engine, 1 worker, load shedding armed (200k packets)") {
+    return run_engine(frames, 1, true);
+  };
+}
@@ -0,0 +1,113 @@
+#include "decoder.hpp"
+#include "lazy_packet.hpp"
+#include "packet_filter.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t BATCH = 256;
+
+// A shuffled mix of IPv4 TCP from inside and outside 10/8, to port 80 or
+// not, SYN or not, plus IPv6 TCP and ARP.
+std::vector<std::string> make_frames() {
+  std::mt19937 rng(7);
+  std::vector<std::string> frames;
+  for (std::size_t i = 0; i < BATCH; ++i) {
+    std::string f(14 + 20 + 20 + 64, '\0');
+    if (rng() % 4 == 0) {
+      f[12] = '\x86';
+      f[13] = '\xdd';
+      f[14] = '\x60';
+      f[19] = 84;
+      f[20] = 6;
+      f[66] = '\x50';
+    } else if (rng() % 8 == 0) {
+      f[12] = '\x08';
+      f[13] = '\x06';
+    } else {
+      f[12] = '\x08';
+      f[14] = '\x45';
+      f[17] = static_cast<char>(f.length() - 14);
+      f[23] = 6;
+      f[26] = (rng() % 2 == 0) ? 10 : static_cast<char>(192);
+      f[37] = (rng() % 2 == 0) ? 80 : 53;
+      f[46] = '\x50';
+      f[47] = (rng() % 2 == 0) ? '\x02' : '\x10';
+    }
+    frames.push_back(std::move(f));
+  }
+  return frames;
+}
+
+} // namespace
+
+TEST_CASE("PacketFilter - interpreted filter vs decode-then-check",
+          "[filter][benchmark]") {
+  const std::vector<std::string> frames = make_frames();
+  const PacketFilter filter(
+      "ip.src in 10.0.0.0/8 && tcp.dst_port == 80 && tcp.flags.syn");
+
+  // The same predicate, evaluated on decoded headers
+  const auto check = [](const IPv4Header *ip, const TCPHeader *tcp) {
+    return ip != nullptr && (ip->source_ip.hostOrder() >> 24) == 10 &&
+           tcp != nullptr && tcp->dst_port == 80 && tcp->flag_syn;
+  };
+
+  std::size_t expected = 0;
+  for (const std::string &f : frames) {
+    expected += filter.matches(f) ? 1 : 0;
+  }
+  REQUIRE(expected > 0);
+
+  BENCHMARK("PacketFilter::matches (256 frames)") {
+    std::size_t matched = 0;
+    for (const std::string &f : frames) {
+      matched += filter.matches(f) ? 1 : 0;
+    }
+    return matched;
+  };
+
+  BENCHMARK("LazyPacket then check (256 frames)") {
+    std::size_t matched = 0;
+    for (const std::string &f : frames) {
+      LazyPacket pkt(f);
+      const IPv4Header *ip = pkt.ipv4();
+      matched += check(ip, ip != nullptr ? pkt.tcp() : nullptr) ? 1 : 0;
+    }
+    return matched;
+  };
+
+  Decoder decoder;
+  LayerStack stack;
+  BENCHMARK("Decoder::decode then check (256 frames)") {
+    std::size_t matched = 0;
+    for (const std::string &f : frames) {
+      decoder.decode(f, stack);
+      matched += check(stack.get<IPv4>(), stack.get<TCP>()) ? 1 : 0;
+    }
+    return matched;
+  };
+
+  BENCHMARK("Decoder::decodePacket then check (256 frames)") {
+    std::size_t matched = 0;
+    for (const std::string &f : frames) {
+      const LayerPtr root = decoder.decodePacket(f);
+      const IPv4 *ip = nullptr;
+      const TCP *tcp = nullptr;
+      for (const BaseProtocol *layer = root.get(); layer != nullptr;
+           layer = layer->payload.get()) {
+        if (const auto *as_ip = dynamic_cast<const IPv4 *>(layer)) {
+          ip = as_ip;
+        } else if (const auto *as_tcp = dynamic_cast<const TCP *>(layer)) {
+          tcp = as_tcp;
+        }
+      }
+      matched += check(ip, tcp) ? 1 : 0;
+    }
+    return matched;
+  };
+}
@@ -0,0 +1,82 @@
+#include "alloc_counter.hpp"
+#include "flow_tracker.hpp"
+#include <arpa/inet.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t MAX_FLOWS = 100000;
+constexpr std::size_t OPERATIONS = 1000000;
+
+struct FlowKeyHash {
+  std::size_t operator()(const FlowKey &key) const { return key.hash(); }
+};
+
+// A stream of flow lookups where 1 in 4 is a new flow and the rest hit one
+// of the recent ones, so a table capped at MAX_FLOWS churns constantly.
+std::vector<FlowKey> make_keys() {
+  std::mt19937 rng(7);
+  std::vector<FlowKey> keys;
+  keys.reserve(OPERATIONS);
+  uint32_t next_flow = 0;
+  for (std::size_t i = 0; i < OPERATIONS; ++i) {
+    uint32_t flow = next_flow;
+    if (next_flow != 0 && rng() % 4 != 0) {
+      flow = next_flow - 1 - rng() % std::min(next_flow, 50000U);
+    } else {
+      ++next_flow;
+    }
+    keys.emplace_back(Ipv4Address(htonl(0x0A000000 + flow)), 40000,
+                      Ipv4Address(htonl(0xC0A80001)), 443,
+                      IPv4Header::PROTO_TCP);
+  }
+  return keys;
+}
+
+} // namespace
+
+TEST_CASE("FlowTable - no allocation under churn", "[flow_table][benchmark]") {
+  const std::vector<FlowKey> keys = make_keys();
+  FlowTable<FlowStats>::Config config;
+  config.max_flows = MAX_FLOWS;
+  FlowTable<FlowStats> table(config);
+
+  const std::size_t before = allocation_count();
+  uint64_t now = 0;
+  for (const FlowKey &key : keys) {
+    ++table.touch(key, now += 1000).packets;
+  }
+  CHECK(allocation_count() == before);
+  CHECK(table.size() == MAX_FLOWS);
+}
+
+TEST_CASE("FlowTable - churn against std::unordered_map",
+          "[flow_table][benchmark]") {
+  const std::vector<FlowKey> keys = make_keys();
+
+  BENCHMARK("FlowTable (1M lookups, 100k flow cap)") {
+    FlowTable<FlowStats>::Config config;
+    config.max_flows = MAX_FLOWS;
+    FlowTable<FlowStats> table(config);
+    uint64_t now = 0;
+    for (const FlowKey &key : keys) {
+      ++table.touch(key, now += 1000).packets;
+    }
+    return table.size();
+  };
+
+  // No eviction at all, so this is a lower bound for the node-based map.
+  BENCHMARK("std::unordered_map (1M lookups, unbounded)") {
+    std::unordered_map<FlowKey, FlowStats, FlowKeyHash> map;
+    for (const FlowKey &key : keys) {
+      ++map[key].packets;
+    }
+    return map.size();
+  };
+}
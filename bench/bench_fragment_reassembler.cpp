@@ -0,0 +1,116 @@
+#include "alloc_counter.hpp"
+#include "decoder.hpp"
+#include "fragment_reassembler.hpp"
+#include <algorithm>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint16_t DATAGRAMS = 2000;
+constexpr std::size_t FRAGMENT = 1480;
+
+// An IPv4 fragment of datagram `id`; `source` varies the sender.
+std::string fragment(uint16_t id, uint8_t source, uint16_t offset, bool more,
+                     std::size_t length) {
+  std::string f(14 + 20 + length, 'x');
+  std::fill_n(f.begin(), 34, '\0');
+  f[12] = 0x08;
+  f[14] = 0x45;
+  f[16] = static_cast<char>((20 + length) >> 8);
+  f[17] = static_cast<char>(20 + length);
+  f[18] = static_cast<char>(id >> 8);
+  f[19] = static_cast<char>(id);
+  const uint16_t field =
+      static_cast<uint16_t>((more ? 0x2000 : 0) | offset / 8);
+  f[20] = static_cast<char>(field >> 8);
+  f[21] = static_cast<char>(field);
+  f[23] = 17;
+  f[26] = 10;
+  f[29] = static_cast<char>(source);
+  f[30] = 10;
+  f[33] = 1;
+  return f;
+}
+
+// DATAGRAMS 4000-byte datagrams in three fragments each, interleaved in
+// groups of 8 datagrams with the last fragment first, plus the same
+// number of ordinary packets decoded beside them.
+struct Capture {
+  Capture() {
+    for (uint16_t base = 0; base < DATAGRAMS; base += 8) {
+      for (const int part : {2, 0, 1}) {
+        for (uint16_t id = base; id < base + 8; ++id) {
+          const uint16_t offset = static_cast<uint16_t>(part * FRAGMENT);
+          frames.push_back(fragment(id, static_cast<uint8_t>(id % 7), offset,
+                                    part != 2, part == 2 ? 1040 : FRAGMENT));
+        }
+      }
+    }
+    plain = fragment(1, 1, 0, false, 1400);
+  }
+
+  std::vector<std::string> frames;
+  std::string plain;
+};
+
+std::size_t run(FragmentReassembler &reassembler,
+                const std::vector<std::string> &frames, Decoder &decoder,
+                LayerStack &stack) {
+  std::size_t completed = 0;
+  PacketRef reassembled;
+  uint64_t now = 0;
+  for (const std::string &frame : frames) {
+    decoder.decode(frame, stack);
+    const PacketRef packet{frame, now += 1000};
+    if (reassembler.process(packet, stack, reassembled) ==
+        FragmentReassembler::Result::Complete) {
+      decoder.decode(reassembled.data, stack);
+      ++completed;
+    }
+  }
+  return completed;
+}
+
+} // namespace
+
+TEST_CASE("FragmentReassembler - no allocation while reassembling",
+          "[fragment_reassembler][benchmark]") {
+  const Capture capture;
+  Decoder decoder;
+  LayerStack stack;
+  FragmentReassembler reassembler(FragmentReassembler::Config{});
+
+  const std::size_t before = allocation_count();
+  CHECK(run(reassembler, capture.frames, decoder, stack) == DATAGRAMS);
+  CHECK(allocation_count() == before);
+  CHECK(reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("FragmentReassembler - throughput",
+          "[fragment_reassembler][benchmark]") {
+  const Capture capture;
+  Decoder decoder;
+  LayerStack stack;
+  FragmentReassembler reassembler(FragmentReassembler::Config{});
+
+  BENCHMARK("reassemble 2000 datagrams (6000 fragments)") {
+    return run(reassembler, capture.frames, decoder, stack);
+  };
+
+  // What every packet that is not a fragment pays
+  decoder.decode(capture.plain, stack);
+  const PacketRef packet{capture.plain, 0};
+  PacketRef reassembled;
+  BENCHMARK("not a fragment (6000 packets)") {
+    std::size_t passed = 0;
+    for (std::size_t i = 0; i < 6000; ++i) {
+      passed += reassembler.process(packet, stack, reassembled) ==
+                FragmentReassembler::Result::NotFragment;
+    }
+    return passed;
+  };
+}
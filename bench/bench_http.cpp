@@ -0,0 +1,104 @@
+#include "alloc_counter.hpp"
+#include "protocols/http.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace {
+
+constexpr std::size_t MESSAGES = 20000;
+
+// Browser-like pipelined traffic: GETs with a realistic header set, and
+// every tenth message a small form POST.
+std::string make_corpus() {
+  std::string corpus;
+  for (std::size_t i = 0; i < MESSAGES; ++i) {
+    if (i % 10 == 9) {
+      corpus += "POST /api/v1/events HTTP/1.1\r\n"
+                "Host: www.example.com\r\n"
+                "Content-Type: application/x-www-form-urlencoded\r\n"
+                "Content-Length: 27\r\n"
+                "\r\n"
+                "event=click&target=button42";
+      continue;
+    }
+    corpus += "GET /static/js/app." + std::to_string(i) +
+              ".js HTTP/1.1\r\n"
+              "Host: www.example.com\r\n"
+              "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:124.0) "
+              "Gecko/20100101 Firefox/124.0\r\n"
+              "Accept: text/html,application/xhtml+xml,application/xml;"
+              "q=0.9,*/*;q=0.8\r\n"
+              "Accept-Language: en-US,en;q=0.5\r\n"
+              "Accept-Encoding: gzip, deflate, br\r\n"
+              "Referer: https://www.example.com/index.html\r\n"
+              "Connection: keep-alive\r\n"
+              "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; "
+              "theme=dark\r\n"
+              "Sec-Fetch-Dest: script\r\n"
+              "Sec-Fetch-Mode: no-cors\r\n"
+              "\r\n";
+  }
+  return corpus;
+}
+
+struct CountingHandler : HttpParser::Handler {
+  void on_message(const HttpMessage &message) override {
+    headers += message.header_count();
+    host_bytes += message.host().length();
+  }
+  void on_body(std::string_view data) override { bytes += data.length(); }
+  void on_message_complete() override { ++messages; }
+
+  uint64_t headers = 0;
+  uint64_t host_bytes = 0;
+  uint64_t bytes = 0;
+  uint64_t messages = 0;
+};
+
+// Feeds the corpus in segment-sized pieces, as TCP reassembly would.
+uint64_t run(const std::string &corpus, std::size_t piece,
+             CountingHandler &handler) {
+  HttpParser parser;
+  for (std::size_t i = 0; i < corpus.length(); i += piece) {
+    parser.feed(std::string_view(corpus).substr(i, piece), handler);
+  }
+  return parser.messages();
+}
+
+} // namespace
+
+TEST_CASE("HttpParser - pipelined messages do not allocate",
+          "[http][benchmark]") {
+  const std::string corpus = make_corpus();
+  CountingHandler handler;
+  HttpParser parser;
+
+  const std::size_t before = allocation_count();
+  REQUIRE(parser.feed(corpus, handler));
+  CHECK(allocation_count() == before);
+  CHECK(handler.messages == MESSAGES);
+  CHECK(handler.headers == MESSAGES / 10 * (9 * 10 + 3));
+}
+
+TEST_CASE("HttpParser - throughput", "[http][benchmark]") {
+  const std::string corpus = make_corpus();
+  CountingHandler handler;
+
+  // A rough GB/s figure next to the per-run timings below.
+  const auto start = std::chrono::steady_clock::now();
+  REQUIRE(run(corpus, corpus.length(), handler) == MESSAGES);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "HttpParser: " << corpus.length() / elapsed.count() / 1e9
+            << " GB/s on one buffer\n";
+
+  BENCHMARK("one buffer (20k messages, " +
+            std::to_string(corpus.length() >> 20) + " MiB)") {
+    return run(corpus, corpus.length(), handler);
+  };
+  BENCHMARK("1448-byte segments") { return run(corpus, 1448, handler); };
+}
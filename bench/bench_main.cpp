@@ -0,0 +1,82 @@
+#include "bench_results.hpp"
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_case_info.hpp>
+#include <catch2/reporters/catch_reporter_event_listener.hpp>
+#include <catch2/reporters/catch_reporter_registrars.hpp>
+#include <exception>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Records the mean of every benchmark as it ends.
+class BenchmarkRecorder : public Catch::EventListenerBase {
+public:
+  using Catch::EventListenerBase::EventListenerBase;
+
+  void testCaseStarting(const Catch::TestCaseInfo &info) override {
+    m_test_case = info.name;
+  }
+
+  void benchmarkEnded(const Catch::BenchmarkStats<> &stats) override {
+    recorded_results().push_back(
+        BenchmarkResult{m_test_case + " / " + stats.info.name,
+                        stats.mean.point.count(),
+                        stats.standardDeviation.point.count()});
+  }
+
+private:
+  std::string m_test_case;
+};
+
+} // namespace
+
+CATCH_REGISTER_LISTENER(BenchmarkRecorder)
+
+// Catch2's own main, plus options to save results and to check them
+// against a baseline:
+//
+//   layerspy_bench --results baseline.tsv          # record a baseline
+//   layerspy_bench --baseline baseline.tsv --tolerance 5
+//
+// The check exits non-zero if any benchmark got slower than the tolerance.
+int main(int argc, char *argv[]) {
+  Catch::Session session;
+  std::string results_path;
+  std::string baseline_path;
+  double tolerance = 10;
+
+  using namespace Catch::Clara;
+  session.cli(session.cli() |
+              Opt(results_path, "file")["--results"](
+                  "write benchmark means to a tab-separated file") |
+              Opt(baseline_path, "file")["--baseline"](
+                  "fail if benchmarks are slower than in this results file") |
+              Opt(tolerance, "percent")["--tolerance"](
+                  "slowdown against --baseline still accepted (default 10)"));
+  if (const int status = session.applyCommandLine(argc, argv)) {
+    return status;
+  }
+
+  try {
+    // Read first, so a missing baseline fails before a long run.
+    const std::vector<BenchmarkResult> baseline =
+        baseline_path.empty() ? std::vector<BenchmarkResult>{}
+                              : read_results(baseline_path);
+    int status = session.run();
+    if (!results_path.empty()) {
+      write_results(results_path, recorded_results());
+    }
+    if (!baseline_path.empty()) {
+      std::cout << "Compared with " << baseline_path << ":\n";
+      if (compare_results(baseline, recorded_results(), tolerance,
+                          std::cout) != 0) {
+        status = 1;
+      }
+    }
+    return status;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
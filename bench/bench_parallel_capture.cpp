@@ -0,0 +1,57 @@
+#include "parallel_capture.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t PACKETS = 1000000;
+
+std::string temp_path() {
+  char path[] = "/tmp/layerspy_bench_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  return path;
+}
+
+} // namespace
+
+TEST_CASE("ParallelCaptureReader - flow summary by thread count",
+          "[parallel_capture][benchmark]") {
+  const std::string pcap = temp_path();
+  TrafficGenerator::Config traffic;
+  traffic.flows = 100000;
+  TrafficGenerator(traffic).write_pcap(pcap, PACKETS);
+
+  BENCHMARK("split into 4 MiB chunks (1M packets)") {
+    CaptureFileReader reader(pcap);
+    return reader.split(4 << 20).size();
+  };
+
+  const std::size_t cores =
+      std::max<std::size_t>(1, std::thread::hardware_concurrency());
+  for (std::size_t threads = 1; threads <= cores; threads *= 2) {
+    ParallelCaptureReader::Config config;
+    config.threads = threads;
+    config.chunk_bytes = 4 << 20;
+    BENCHMARK("summarize, " + std::to_string(threads) +
+              " threads (1M packets)") {
+      return summarize_capture(pcap, config).flows.size();
+    };
+  }
+
+  ParallelCaptureReader::Config config;
+  config.threads = cores;
+  const CaptureSummary summary = summarize_capture(pcap, config);
+  std::cout << "ParallelCaptureReader: " << summary.packets << " packets, "
+            << summary.flows.size() << " flows on " << cores << " threads"
+            << std::endl;
+  std::remove(pcap.c_str());
+}
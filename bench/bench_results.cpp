@@ -0,0 +1,98 @@
+#include "bench_results.hpp"
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr const char *HEADER =
+    "# layerspy_bench results: benchmark\tmean ns\tstd dev ns";
+
+const BenchmarkResult *find(const std::vector<BenchmarkResult> &results,
+                            const std::string &name) {
+  for (const BenchmarkResult &result : results) {
+    if (result.name == name) {
+      return &result;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+std::vector<BenchmarkResult> &recorded_results() {
+  static std::vector<BenchmarkResult> results;
+  return results;
+}
+
+void write_results(const std::string &path,
+                   const std::vector<BenchmarkResult> &results) {
+  std::ofstream out(path);
+  out << HEADER << '\n' << std::fixed << std::setprecision(2);
+  for (const BenchmarkResult &result : results) {
+    out << result.name << '\t' << result.mean_ns << '\t' << result.std_dev_ns
+        << '\n';
+  }
+  out.flush();
+  if (!out) {
+    throw std::runtime_error("Cannot write benchmark results to " + path);
+  }
+}
+
+std::vector<BenchmarkResult> read_results(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    throw std::runtime_error("Cannot read benchmark results from " + path);
+  }
+  std::vector<BenchmarkResult> results;
+  std::string line;
+  for (std::size_t number = 1; std::getline(in, line); ++number) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    const std::size_t tab = line.find('\t');
+    BenchmarkResult result{line.substr(0, tab), 0, 0};
+    std::istringstream fields(tab == std::string::npos ? ""
+                                                       : line.substr(tab));
+    if (!(fields >> result.mean_ns >> result.std_dev_ns) ||
+        result.mean_ns <= 0) {
+      throw std::runtime_error(path + ":" + std::to_string(number) +
+                               ": expected name, mean and std dev");
+    }
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+std::size_t compare_results(const std::vector<BenchmarkResult> &baseline,
+                            const std::vector<BenchmarkResult> &current,
+                            double tolerance_percent, std::ostream &out) {
+  std::size_t regressions = 0;
+  out << std::fixed << std::setprecision(1);
+  for (const BenchmarkResult &result : current) {
+    const BenchmarkResult *base = find(baseline, result.name);
+    if (base == nullptr) {
+      out << "  new        " << result.name << ": " << result.mean_ns
+          << " ns\n";
+      continue;
+    }
+    // Positive when slower, i.e. lower throughput
+    const double change = (result.mean_ns / base->mean_ns - 1) * 100;
+    const bool regressed = change > tolerance_percent;
+    regressions += regressed ? 1 : 0;
+    out << (regressed ? "  REGRESSED  " : "  ok         ") << result.name
+        << ": " << base->mean_ns << " -> " << result.mean_ns << " ns ("
+        << std::showpos << change << std::noshowpos << "%)\n";
+  }
+  for (const BenchmarkResult &base : baseline) {
+    if (find(current, base.name) == nullptr) {
+      out << "  not run    " << base.name << '\n';
+    }
+  }
+  out << regressions << " of " << current.size()
+      << " benchmark(s) more than " << tolerance_percent
+      << "% slower than the baseline" << std::endl;
+  return regressions;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The mean time of one benchmark, as stored in a results file.
+ *
+ * `name` is "<test case> / <benchmark>", so benchmarks with the same name
+ * in different test cases stay apart.
+ */
+struct BenchmarkResult {
+  std::string name;
+  double mean_ns;
+  double std_dev_ns;
+};
+
+// Results of this run, filled in as each benchmark ends.
+std::vector<BenchmarkResult> &recorded_results();
+
+/**
+ * @brief Writes `results` as tab-separated lines: name, mean and standard
+ * deviation in nanoseconds, after a `#` header line.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void write_results(const std::string &path,
+                   const std::vector<BenchmarkResult> &results);
+
+/**
+ * @brief Reads a file written by write_results().
+ * @throws std::runtime_error if it cannot be read or a line is malformed.
+ */
+std::vector<BenchmarkResult> read_results(const std::string &path);
+
+/**
+ * @brief Prints each benchmark of `current` next to its `baseline`.
+ *
+ * A benchmark regresses when its mean is more than `tolerance_percent`
+ * slower than the baseline's. Benchmarks missing from either side (e.g. a
+ * run filtered by tag) are listed but never fail.
+ * @return The number of regressions.
+ */
+std::size_t compare_results(const std::vector<BenchmarkResult> &baseline,
+                            const std::vector<BenchmarkResult> &current,
+                            double tolerance_percent, std::ostream &out);
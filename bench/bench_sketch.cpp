@@ -0,0 +1,60 @@
+#include "decoder.hpp"
+#include "talker_sketch.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t PACKETS = 100000;
+
+struct Decoded {
+  std::vector<std::string> frames;
+  std::vector<LayerStack> stacks;
+};
+
+// One million flows drawn uniformly: nearly every source is new, as under a
+// scan or a spoofed flood.
+Decoded flood() {
+  TrafficGenerator::Config config;
+  config.flows = 1000000;
+  config.zipf_skew = 0;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  Decoded traffic;
+  traffic.stacks.resize(PACKETS);
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    traffic.frames.emplace_back(generator.next().data);
+    decoder.decode(traffic.frames.back(), traffic.stacks[i]);
+  }
+  return traffic;
+}
+
+} // namespace
+
+TEST_CASE("TalkerSketch - update", "[talker_sketch][benchmark]") {
+  const Decoded traffic = flood();
+  TalkerSketch sketch(TalkerSketch::Config{});
+
+  BENCHMARK("sketch update, flood (100k packets)") {
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      sketch.update(PacketRef{traffic.frames[i], i}, traffic.stacks[i]);
+    }
+    return sketch.packets();
+  };
+  // What a map of exact counters costs, and it grows with every source
+  BENCHMARK("std::map of sources, flood (100k packets)") {
+    std::map<Ipv6Address, uint64_t> bytes;
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      if (const IPv4Header *ipv4 = traffic.stacks[i].get<IPv4>()) {
+        bytes[Ipv6Address::mapped_ipv4(ipv4->source_ip.hostOrder())] +=
+            traffic.frames[i].length();
+      }
+    }
+    return bytes.size();
+  };
+}
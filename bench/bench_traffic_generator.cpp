@@ -0,0 +1,44 @@
+#include "decoder.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+namespace {
+
+constexpr std::size_t PACKETS = 100000;
+
+std::size_t generate(TrafficGenerator &generator) {
+  std::size_t bytes = 0;
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    bytes += generator.next().data.length();
+  }
+  return bytes;
+}
+
+} // namespace
+
+// The generator should cost well under what the code it drives does.
+TEST_CASE("TrafficGenerator - packets per second",
+          "[traffic_generator][benchmark]") {
+  TrafficGenerator::Config config;
+  TrafficGenerator generator(config);
+  BENCHMARK("IMIX, 10k flows (100k packets)") { return generate(generator); };
+
+  config.flows = 1000000;
+  config.fragment_ratio = 0.05;
+  TrafficGenerator large(config);
+  BENCHMARK("IMIX, 1M flows, fragments (100k packets)") {
+    return generate(large);
+  };
+
+  Decoder decoder;
+  LayerStack stack;
+  BENCHMARK("generate and decode (100k packets)") {
+    std::size_t decoded = 0;
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      decoded += decoder.decode(generator.next().data, stack) ? 1 : 0;
+    }
+    return decoded;
+  };
+}
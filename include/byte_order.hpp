@@ -0,0 +1,23 @@
+#pragma once
+#include <arpa/inet.h> // For ntohs() and ntohl()
+#include <cstdint>
+#include <cstring> // For memcpy
+
+/**
+ * @brief Unaligned big-endian loads for header parsing.
+ *
+ * Packet buffers give no alignment guarantees, so casting a byte pointer to
+ * `uint16_t *` is undefined behaviour. Each load memcpys into an integer and
+ * swaps it to host order, which compilers turn into a load and a byte swap.
+ */
+inline uint16_t load_be16(const unsigned char *bytes) {
+  uint16_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return ntohs(value);
+}
+
+inline uint32_t load_be32(const unsigned char *bytes) {
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return ntohl(value);
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include "packet_ref.hpp"
+#include "sniffer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Reads pcap and pcapng files through a read-only memory mapping.
+ *
+ * Record headers are decoded in place and every PacketRef points straight
+ * into the mapping, so reading costs no copies and no per-packet buffers;
+ * the views stay valid for as long as the reader is alive. The kernel is
+ * told the file will be read sequentially, so it reads ahead aggressively.
+ *
+ * Both byte orders are supported, as are microsecond and nanosecond pcap
+ * files and any pcapng timestamp resolution. Only Ethernet interfaces are
+ * returned (that is what the Decoder understands); packets captured on
+ * other link types are skipped and counted.
+ */
+class CaptureFileReader {
+public:
+  enum class Format { Pcap, PcapNg };
+
+  // Ethernet, as stored in pcap and pcapng link-type fields
+  inline static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+  // How one pcapng interface (or the whole pcap file) stores timestamps
+  struct Interface {
+    uint16_t link_type = LINKTYPE_ETHERNET;
+    // Timestamp unit: 10^-exponent seconds, or 2^-exponent if binary
+    uint8_t exponent = 6;
+    bool binary = false;
+
+    bool operator==(const Interface &other) const {
+      return link_type == other.link_type && exponent == other.exponent &&
+             binary == other.binary;
+    }
+  };
+
+  /**
+   * @brief A read position together with the state needed to carry on from
+   * it (pcapng byte order and interfaces), so reading can resume mid-file
+   * without going over what came before.
+   */
+  struct Cursor {
+    std::size_t position = 0;
+    bool swapped = false;
+    std::vector<Interface> interfaces;
+  };
+
+  /**
+   * @brief Maps `path` and reads its file header.
+   * @throws std::runtime_error if the file cannot be opened or is neither
+   * pcap nor pcapng.
+   */
+  explicit CaptureFileReader(const std::string &path);
+  ~CaptureFileReader();
+
+  CaptureFileReader(const CaptureFileReader &) = delete;
+  CaptureFileReader &operator=(const CaptureFileReader &) = delete;
+
+  /**
+   * @brief Advances to the next Ethernet packet.
+   * @return false at the end of the file (or at the first record that runs
+   * past it, see truncated()).
+   */
+  bool next(PacketRef &packet);
+
+  // Goes back to the first packet.
+  void rewind();
+
+  // Where the next record will be read from
+  Cursor cursor() const {
+    return Cursor{m_position, m_swapped, m_interfaces};
+  }
+
+  /**
+   * @brief Carries on reading at `cursor`, taken from a reader of this file
+   * (or of the same file before it was appended to).
+   * @throws std::out_of_range if the cursor lies past the end of the file.
+   */
+  void seek(const Cursor &cursor);
+
+  // Asks the kernel to read `length` bytes at `offset` ahead of use, for
+  // reads that jump around the file. Only a hint.
+  void prefetch(std::size_t offset, std::size_t length) const;
+
+  // Records from `start` up to (not including) those starting at `end`
+  struct Chunk {
+    Cursor start;
+    std::size_t end = 0;
+  };
+
+  /**
+   * @brief Cuts the file into consecutive chunks of about `chunk_bytes`,
+   * each starting on a record, for reading them in parallel: seek() to
+   * `start`, then read while position() < `end`. The chunks depend only on
+   * the file and `chunk_bytes`. The reader is left where it was.
+   *
+   * Finding the cuts walks the record headers, as nothing inside a pcap
+   * record tells it apart from payload and a pcapng chunk needs the
+   * interfaces described before it; that is cheap next to decoding.
+   * @throws std::invalid_argument if `chunk_bytes` is 0.
+   */
+  std::vector<Chunk> split(std::size_t chunk_bytes);
+
+  Format format() const { return m_format; }
+  std::size_t file_size() const { return m_size; }
+  // The whole file, as mapped
+  std::string_view contents() const {
+    return std::string_view(reinterpret_cast<const char *>(m_data), m_size);
+  }
+  // Offset of the next record to be read
+  std::size_t position() const { return m_position; }
+
+  // Packets skipped because their interface is not Ethernet
+  uint64_t skipped() const { return m_skipped; }
+  // True if reading stopped at a record cut short by the end of the file,
+  // or at one too malformed to find the next record after it
+  bool truncated() const { return m_truncated; }
+
+private:
+  void read_pcap_header();
+  bool next_pcap(PacketRef &packet);
+  bool next_pcapng(PacketRef &packet);
+  // False if the header is cut short or its byte-order magic is unknown
+  bool read_section_header(std::size_t offset);
+  void read_interface(std::size_t offset, std::size_t length);
+
+  uint16_t load16(std::size_t offset) const;
+  uint32_t load32(std::size_t offset) const;
+  uint64_t to_ns(uint64_t timestamp, const Interface &interface) const;
+
+  const unsigned char *m_data = nullptr;
+  std::size_t m_size = 0;
+  std::size_t m_position = 0;
+  std::size_t m_first_record = 0;
+  Format m_format = Format::Pcap;
+  bool m_swapped = false; // file byte order differs from the host's
+
+  // pcap: a single entry; pcapng: interfaces of the current section
+  std::vector<Interface> m_interfaces;
+
+  uint64_t m_skipped = 0;
+  bool m_truncated = false;
+};
+
+/**
+ * @brief Feeds a capture file to anything that takes a Sniffer, such as
+ * LayerSpyEngine.
+ *
+ * poll() returns -1 once the file is exhausted. Views point into the file
+ * mapping, so a LayerSpyEngine worker polling this directly decodes with no
+ * copy at all.
+ */
+class CaptureFileSniffer : public Sniffer {
+public:
+  explicit CaptureFileSniffer(const std::string &path) : m_reader(path) {}
+
+  int poll(int max_packets, const Callback &callback) override;
+  void interrupt() override { m_interrupted = true; }
+  void clear_interrupt() override { m_interrupted = false; }
+  SnifferStats stats() const override {
+    return SnifferStats{m_received, 0, 0};
+  }
+
+  const CaptureFileReader &reader() const { return m_reader; }
+
+private:
+  CaptureFileReader m_reader;
+  std::atomic<bool> m_interrupted{false};
+  std::atomic<uint64_t> m_received{0};
+};
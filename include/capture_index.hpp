@@ -0,0 +1,179 @@
+#pragma once
+#include "capture_file.hpp"
+#include "decoder.hpp"
+#include "flow_key.hpp"
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include "sniffer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A sidecar index of a capture file, so the packets of one flow or
+ * one stretch of time can be read without scanning the whole file.
+ *
+ * The file is cut into blocks of about Config::block_bytes. Each block
+ * keeps the offset it starts at, the reader state needed to resume there
+ * (pcapng byte order and interfaces), its packet count and its earliest and
+ * latest timestamp: a sparse map from time to file offset. Flows are hashed
+ * (FlowKey::canonical(), so both directions together) into Config::buckets
+ * buckets, and each bucket keeps the list of blocks holding one of its
+ * flows, stored as varint deltas. A query reads only the blocks that may
+ * match and decodes their packets to keep the ones that really do.
+ *
+ * update() starts where the last one stopped, so a file that is still
+ * being appended to is indexed a piece at a time. The index remembers a
+ * hash of the file's first bytes and of the bytes just before where it
+ * stopped; if either changed (or the file shrank) it starts over.
+ */
+class CaptureIndex {
+public:
+  struct Config {
+    // File bytes per block: the least a query for one flow reads
+    std::size_t block_bytes = 4 << 20;
+    // Flow hash buckets; a power of two
+    uint32_t buckets = 1 << 16;
+  };
+
+  struct Block {
+    uint64_t offset = 0; // first record
+    uint64_t end = 0;    // just past the last packet
+    uint64_t first_ns = 0;
+    uint64_t last_ns = 0;
+    uint32_t packets = 0;
+    uint32_t state = 0; // reader state at `offset`, see cursor()
+  };
+
+  struct Query {
+    // Inclusive range of timestamps, nanoseconds since the epoch
+    uint64_t from_ns = 0;
+    uint64_t to_ns = std::numeric_limits<uint64_t>::max();
+    // Either direction of this flow; an empty key (family 0) for any
+    FlowKey flow;
+  };
+
+  // The conventional sidecar of `capture_path`
+  static std::string path_for(const std::string &capture_path) {
+    return capture_path + ".lsidx";
+  }
+
+  /**
+   * @brief An empty index; update() fills it.
+   * @throws std::invalid_argument if block_bytes is 0 or buckets is not a
+   * power of two.
+   */
+  explicit CaptureIndex(const Config &config);
+
+  /**
+   * @brief Reads an index written by save().
+   * @throws std::runtime_error if the file cannot be read or is not an
+   * index.
+   */
+  static CaptureIndex load(const std::string &path);
+
+  /**
+   * @brief Writes the index to `path`, through a temporary file renamed
+   * over it, so readers never see half an index.
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  void save(const std::string &path) const;
+
+  /**
+   * @brief Indexes the part of `reader`'s file not indexed yet, or all of
+   * it if the file is not the one indexed so far. Moves `reader`.
+   * @return the number of packets added.
+   */
+  uint64_t update(CaptureFileReader &reader);
+
+  // Blocks that may hold packets matching `query`, in file order
+  std::vector<std::size_t> find(const Query &query) const;
+
+  // Where to resume reading to read `block`
+  CaptureFileReader::Cursor cursor(std::size_t block) const;
+
+  const Config &config() const { return m_config; }
+  const std::vector<Block> &blocks() const { return m_blocks; }
+  uint64_t packets() const { return m_packets; }
+  // File bytes covered; update() carries on from here.
+  uint64_t indexed_bytes() const { return m_end.position; }
+
+private:
+  struct State {
+    bool swapped = false;
+    std::vector<CaptureFileReader::Interface> interfaces;
+  };
+
+  bool same_file(const CaptureFileReader &reader) const;
+  uint32_t add_state(const CaptureFileReader::Cursor &cursor);
+  void add_posting(uint32_t bucket, uint32_t block);
+
+  Config m_config;
+  std::vector<Block> m_blocks;
+  std::vector<State> m_states;
+  // Per bucket: block numbers plus one, as varint deltas
+  std::vector<std::vector<uint8_t>> m_postings;
+  // Per bucket: the last block added plus one (0: none yet)
+  std::vector<uint32_t> m_last;
+  uint64_t m_packets = 0;
+
+  // Where update() stopped, and hashes of the file as it was then
+  CaptureFileReader::Cursor m_end;
+  uint64_t m_head_hash = 0;
+  uint64_t m_tail_hash = 0;
+};
+
+/**
+ * @brief Feeds the packets of a capture file that match a
+ * CaptureIndex::Query to anything that takes a Sniffer.
+ *
+ * Only the blocks the index points at are read (each prefetched as the one
+ * before it is decoded), and their packets are decoded to drop those of
+ * other flows sharing a hash bucket or outside the time range. poll()
+ * returns -1 once the last block is done.
+ */
+class CaptureIndexSniffer : public Sniffer {
+public:
+  // The index is only needed during construction.
+  CaptureIndexSniffer(const std::string &path, const CaptureIndex &index,
+                      const CaptureIndex::Query &query);
+
+  int poll(int max_packets, const Callback &callback) override;
+  void interrupt() override { m_interrupted = true; }
+  void clear_interrupt() override { m_interrupted = false; }
+  SnifferStats stats() const override {
+    return SnifferStats{m_received, 0, 0};
+  }
+
+  const CaptureFileReader &reader() const { return m_reader; }
+  // Blocks the query selected
+  std::size_t blocks() const { return m_spans.size(); }
+  // File bytes the selected blocks cover
+  uint64_t bytes() const { return m_bytes; }
+  // Packets read from the blocks, matching or not
+  uint64_t scanned() const { return m_scanned; }
+
+private:
+  struct Span {
+    CaptureFileReader::Cursor cursor;
+    uint64_t end;
+  };
+
+  bool matches(const PacketRef &packet);
+
+  CaptureFileReader m_reader;
+  CaptureIndex::Query m_query;
+  FlowKey m_flow; // m_query.flow, canonical
+  std::vector<Span> m_spans;
+  std::size_t m_span = 0;
+  bool m_in_span = false;
+  uint64_t m_bytes = 0;
+  uint64_t m_scanned = 0;
+  Decoder m_decoder;
+  LayerStack m_stack;
+  std::atomic<bool> m_interrupted{false};
+  std::atomic<uint64_t> m_received{0};
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief The Internet checksum (RFC 1071): a ones'-complement sum of 16-bit
+ * big-endian words.
+ *
+ * Bytes can be added in pieces of any length, so a header, a pseudo-header
+ * and a payload sitting in different buffers sum the same as one contiguous
+ * block. Data that includes a correct checksum field sums to 0xFFFF.
+ *
+ * The bulk of the work is done by an AVX2 kernel (32 bytes per step), an
+ * SSE2 kernel (16 bytes per step) or a scalar loop (8 bytes per step); all
+ * three give identical sums. They read one contiguous buffer, so the widest
+ * one the CPU supports is used.
+ */
+class Checksum {
+public:
+  enum class Kernel : uint8_t { Scalar, SSE2, AVX2 };
+
+  // Uses the widest kernel on this CPU.
+  Checksum();
+
+  // Forces a kernel (for tests and benchmarks). Falls back to the scalar
+  // loop if the CPU lacks `kernel`.
+  explicit Checksum(Kernel kernel);
+
+  static Kernel bestKernel();
+  static bool isSupported(Kernel kernel);
+
+  Kernel kernel() const { return m_kernel; }
+
+  // Adds `bytes` as if they followed everything added so far.
+  void add(std::string_view bytes);
+
+  // The 16-bit ones'-complement sum of everything added.
+  uint16_t sum() const;
+
+  // The value a checksum field must hold for the data added so far (the
+  // field itself counted as zero) to verify.
+  uint16_t checksum() const { return static_cast<uint16_t>(~sum()); }
+
+  // True if the data added, checksum field included, verifies.
+  bool verifies() const { return sum() == 0xFFFF; }
+
+  void clear() {
+    m_sum = 0;
+    m_odd = false;
+  }
+
+private:
+  Kernel m_kernel;
+  // Sum of the bytes read as native-order words; byte-swapped at the end
+  // on little-endian CPUs (RFC 1071 section 2(B)).
+  uint64_t m_sum = 0;
+  // An odd number of bytes was added: the next one is a low-order byte.
+  bool m_odd = false;
+};
+
+/**
+ * @brief What verify_checksums() found for one packet.
+ */
+struct ChecksumCheck {
+  enum class Result : uint8_t {
+    Unchecked, // no such checksum, or it could not be (or need not be) checked
+    Good,
+    Bad,
+  };
+
+  Result ipv4 = Result::Unchecked;      // IPv4 header checksum
+  Result transport = Result::Unchecked; // TCP or UDP, with the pseudo-header
+
+  bool bad() const { return ipv4 == Result::Bad || transport == Result::Bad; }
+};
+
+/**
+ * @brief Verifies the IPv4 header checksum and the TCP or UDP checksum (over
+ * IPv4 or IPv6) of a packet already decoded into `stack`.
+ *
+ * A transport checksum is left unchecked when the capture source already
+ * verified it or knows it is not filled in yet (PacketRef::CHECKSUM_VALID,
+ * PacketRef::CHECKSUM_PARTIAL), for fragments, for packets cut short by the
+ * snap length, and for UDP sent without one.
+ */
+ChecksumCheck
+verify_checksums(const PacketRef &packet, const LayerStack &stack,
+                 Checksum::Kernel kernel = Checksum::bestKernel());
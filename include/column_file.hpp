@@ -0,0 +1,219 @@
+#pragma once
+#include "layer_stack.hpp"
+#include "packet_columns.hpp"
+#include "packet_ref.hpp"
+#include "types/ipv4_address.hpp"
+#include "types/ipv6_address.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The fields a column file keeps of each packet.
+ *
+ * Fields a packet does not carry are zero; Layers (PacketColumns::HAS_*
+ * bits) tells which ones are meaningful.
+ */
+enum class Column : uint8_t {
+  Timestamp, // nanoseconds since the epoch
+  Length,    // captured bytes
+  Layers,
+  SrcAddress, // IPv4 addresses as IPv4-mapped IPv6 (::ffff:a.b.c.d)
+  DstAddress,
+  Protocol, // IPv4 protocol / IPv6 upper-layer protocol
+  Ttl,      // TTL / hop limit
+  SrcPort,  // TCP or UDP
+  DstPort,
+  TcpFlags, // TCPHeader::flags()
+  PayloadLength, // bytes after the innermost decoded header
+  Count
+};
+
+inline constexpr std::size_t COLUMN_COUNT =
+    static_cast<std::size_t>(Column::Count);
+
+// Smallest and largest value of a column within one chunk
+struct ColumnStats {
+  uint64_t min = 0;
+  uint64_t max = 0;
+};
+
+/**
+ * @brief Writes decoded packets to a compact columnar file.
+ *
+ * Rows are buffered and written in chunks of `chunk_rows`. Inside a chunk
+ * each column is stored on its own:
+ *   - timestamps as zigzag varint deltas from the previous packet;
+ *   - addresses as indices into a sorted dictionary of the chunk's
+ *     addresses, each entry stored as the bytes it does not share with the
+ *     one before;
+ *   - everything else bit-packed as the offset from the chunk minimum, in
+ *     as many bits as the chunk's range needs.
+ * Every column records its minimum and maximum, so readers can skip
+ * chunks. A typical packet takes about 15 bytes, against its full length
+ * plus 16 in a pcap file.
+ *
+ * The file is a 16-byte header followed by chunks, each starting with its
+ * own size, so a file cut short is readable up to its last whole chunk.
+ * All integers are little-endian.
+ */
+class ColumnFileWriter {
+public:
+  inline static constexpr std::size_t DEFAULT_CHUNK_ROWS = 65536;
+
+  /**
+   * @brief Creates (or truncates) `path` and writes the file header.
+   * @throws std::invalid_argument if `chunk_rows` is 0.
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  explicit ColumnFileWriter(const std::string &path,
+                            std::size_t chunk_rows = DEFAULT_CHUNK_ROWS);
+  // Calls close(), ignoring errors: call it yourself to see them.
+  ~ColumnFileWriter();
+
+  ColumnFileWriter(const ColumnFileWriter &) = delete;
+  ColumnFileWriter &operator=(const ColumnFileWriter &) = delete;
+
+  // Adds a packet decoded with Decoder::decode().
+  void append(const PacketRef &packet, const LayerStack &stack);
+
+  // Adds a batch decoded with Decoder::decodeBatch(); `packets` are the
+  // packets it was given, one per row.
+  void append(const PacketRef *packets, const PacketColumns &columns);
+
+  /**
+   * @brief Writes the rows still buffered and closes the file.
+   * @throws std::runtime_error if a write failed.
+   */
+  void close();
+
+  uint64_t rows() const { return m_rows; }
+  // Bytes written to the file so far
+  uint64_t bytes() const { return m_bytes; }
+
+private:
+  using Address = std::array<uint8_t, 16>;
+
+  void add(uint64_t timestamp, uint32_t length, uint8_t layers,
+           const Address &src, const Address &dst, uint8_t protocol,
+           uint8_t ttl, uint16_t src_port, uint16_t dst_port,
+           uint8_t tcp_flags, uint32_t payload_length);
+  // Index of `address` in m_addresses, adding it if new
+  uint32_t intern(const Address &address);
+  void write_chunk();
+
+  std::string m_path;
+  std::ofstream m_out;
+  std::size_t m_chunk_rows;
+  uint64_t m_rows = 0;
+  uint64_t m_bytes = 0;
+  bool m_closed = false;
+
+  // The buffered rows. Address columns hold indices into m_addresses until
+  // the chunk is written and they are renumbered in sorted order.
+  std::array<std::vector<uint64_t>, COLUMN_COUNT> m_values;
+  // The chunk's distinct addresses, in the order they were first seen
+  std::vector<Address> m_addresses;
+  // Open addressing table of m_addresses indices plus one (0 is empty)
+  std::vector<uint32_t> m_slots;
+  // Scratch space for encoding a chunk
+  std::vector<uint32_t> m_order;
+  std::vector<uint32_t> m_rank;
+  std::vector<unsigned char> m_chunk;
+};
+
+/**
+ * @brief Reads a column file through a read-only memory mapping.
+ *
+ * Columns are decoded one chunk at a time, and only the ones asked for:
+ * a query over two columns never touches the others' bytes. stats() gives
+ * a chunk's range of a column before decoding anything.
+ */
+class ColumnFileReader {
+public:
+  using Address = std::array<uint8_t, 16>;
+
+  /**
+   * @brief Maps `path` and indexes its chunks.
+   * @throws std::runtime_error if the file cannot be opened or is not a
+   * column file.
+   */
+  explicit ColumnFileReader(const std::string &path);
+  ~ColumnFileReader();
+
+  ColumnFileReader(const ColumnFileReader &) = delete;
+  ColumnFileReader &operator=(const ColumnFileReader &) = delete;
+
+  std::size_t chunks() const { return m_chunks.size(); }
+  uint64_t rows() const { return m_rows; }
+  std::size_t chunk_rows(std::size_t chunk) const;
+  // True if the file ends in a chunk cut short (which is ignored)
+  bool truncated() const { return m_truncated; }
+
+  /**
+   * @brief Range of `column` in `chunk`. For the address columns these are
+   * indices into dictionary(); it is sorted, so they still bound the
+   * addresses.
+   */
+  ColumnStats stats(std::size_t chunk, Column column) const;
+
+  // Decodes `column` of `chunk` into `values`, one per row. Address
+  // columns give indices into dictionary().
+  void read(std::size_t chunk, Column column,
+            std::vector<uint64_t> &values) const;
+
+  // The sorted addresses of `chunk`
+  void dictionary(std::size_t chunk, std::vector<Address> &addresses) const;
+
+  /**
+   * @brief Calls `fn(chunk, row, value)` for every row whose `column` is
+   * within [low, high], decoding only chunks whose range overlaps it.
+   * Not for the address columns.
+   * @return The number of chunks decoded.
+   */
+  template <typename Fn>
+  std::size_t scan(Column column, uint64_t low, uint64_t high,
+                   Fn &&fn) const {
+    std::vector<uint64_t> values;
+    std::size_t decoded = 0;
+    for (std::size_t chunk = 0; chunk < chunks(); ++chunk) {
+      const ColumnStats range = stats(chunk, column);
+      if (range.max < low || range.min > high) {
+        continue;
+      }
+      ++decoded;
+      read(chunk, column, values);
+      for (std::size_t row = 0; row < values.size(); ++row) {
+        if (values[row] >= low && values[row] <= high) {
+          fn(chunk, row, values[row]);
+        }
+      }
+    }
+    return decoded;
+  }
+
+  // How addresses are stored: IPv4 as IPv4-mapped IPv6
+  static Address to_address(const Ipv4Address &address);
+  static Address to_address(const Ipv6Address &address);
+
+private:
+  struct Chunk {
+    std::size_t offset; // of its header in the file
+    uint32_t rows;
+  };
+  // Where and how one column (or the dictionary) of a chunk is stored
+  struct Section;
+
+  Section section(std::size_t chunk, std::size_t index) const;
+  const unsigned char *section_data(std::size_t chunk,
+                                    const Section &section) const;
+
+  const unsigned char *m_data = nullptr;
+  std::size_t m_size = 0;
+  std::vector<Chunk> m_chunks;
+  uint64_t m_rows = 0;
+  bool m_truncated = false;
+};
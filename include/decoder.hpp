@@ -1,38 +1,96 @@
 #pragma once
+#include "layer_stack.hpp"
+#include "packet_columns.hpp"
+#include "packet_ref.hpp"
+#include "protocol_registry.hpp"
 #include "protocols/base_protocol.hpp" // Our "interface"
+#include <cstddef>
 #include <memory>
 #include <string_view>
 
-// Forward-declare the structs we will parse
-struct Ethernet;
-struct IPv4;
-struct TCP;
+class LayerArena;
 
 /**
  * @brief The "Brain" of LayerSpy.
  * * This class takes raw bytes and implements the "Chain of Responsibility"
- * pattern to parse the protocol stack.
+ * pattern to parse the protocol stack. Which parser handles each layer is
+ * looked up in a ProtocolRegistry, so new protocols are added by
+ * registering a parser rather than by editing the Decoder.
+ *
+ * decode() is the primary API: it fills a flat LayerStack and never
+ * allocates. decodePacket() is an adapter that turns that result into the
+ * BaseProtocol tree for callers that have not moved over yet. Tree layers are
+ * taken from a LayerArena owned by the Decoder, so the returned LayerPtr must
+ * not outlive the Decoder that produced it.
  */
 class Decoder {
 public:
+  // Decodes with ProtocolRegistry::global().
+  Decoder();
+  // Decodes with `registry`, which must outlive the Decoder.
+  explicit Decoder(const ProtocolRegistry &registry);
+  ~Decoder();
+
+  Decoder(Decoder &&) noexcept;
+  Decoder &operator=(Decoder &&) noexcept;
+
+  /**
+   * @brief Decodes a raw packet into a flat LayerStack.
+   * @param data A string_view of the raw packet bytes.
+   * @param stack Output; cleared first. Offsets are relative to `data`.
+   * @return false if not even the Ethernet header could be decoded.
+   */
+  bool decode(std::string_view data, LayerStack &stack);
+
+  /**
+   * @brief Decodes a batch of packets into struct-of-arrays columns.
+   *
+   * Row `i` of `columns` describes `packets[i]`; packets that are not even
+   * Ethernet get an all-zero row. No allocation happens once `columns` has
+   * held a batch this large.
+   * @return The number of packets with at least an Ethernet header.
+   */
+  std::size_t decodeBatch(const PacketRef *packets, std::size_t count,
+                          PacketColumns &columns);
+
   /**
    * @brief Main entry point. Decodes a raw packet.
    * @param data A string_view of the raw packet bytes.
-   * @return A unique_ptr to the base of the protocol tree (Ethernet).
+   * @return A handle to the base of the protocol tree (Ethernet).
    */
-  std::unique_ptr<BaseProtocol> decodePacket(std::string_view data);
+  LayerPtr decodePacket(std::string_view data);
+
+  /**
+   * @brief Builds the BaseProtocol tree for an already decoded stack.
+   * @param data The same bytes that were passed to decode().
+   */
+  LayerPtr toTree(std::string_view data, const LayerStack &stack);
+
+  /**
+   * @brief Pre-sizes the layer arena for `packets` trees alive at once
+   * (e.g. one batch), so even the first batch does not allocate.
+   */
+  void reserve(std::size_t packets);
+
+  const LayerArena &arena() const { return *m_arena; }
+
+  /**
+   * @brief Sets what plugin parsers get as DecodeState::output, e.g. a
+   * struct they fill in; nullptr by default.
+   *
+   * Unlike a parser's registered context, it is not shared with the other
+   * Decoders, so a Decoder per thread needs no locking to collect results.
+   */
+  void set_output(void *output) { m_output = output; }
+  void *output() const { return m_output; }
 
 private:
-  // --- The Parser Chain ---
-  // Each function parses its layer, modifies the 'data' view
-  // to remove the header, and calls the next parser in the chain.
-
-  std::unique_ptr<BaseProtocol> parse_ethernet(std::string_view &data);
-  std::unique_ptr<BaseProtocol> parse_ipv4(std::string_view &data);
-  std::unique_ptr<BaseProtocol> parse_ipv6(std::string_view &data);
-  std::unique_ptr<BaseProtocol> parse_tcp(std::string_view &data);
-  std::unique_ptr<BaseProtocol> parse_udp(std::string_view &data);
-  std::unique_ptr<BaseProtocol> parse_icmp(std::string_view &data);
-  std::unique_ptr<BaseProtocol> parse_http(std::string_view &data);
-
-};
\ No newline at end of file
+  const ProtocolRegistry *m_registry;
+  void *m_output = nullptr;
+
+  // Scratch result reused by decodePacket()
+  LayerStack m_stack;
+
+  // Held by pointer so handles stay valid when the Decoder is moved
+  std::unique_ptr<LayerArena> m_arena;
+};
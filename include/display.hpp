@@ -0,0 +1,122 @@
+#pragma once
+#include "flow_key.hpp"
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @brief What the display prints about a packet, taken from its decoded
+ * layers so the output thread never touches the packet itself.
+ */
+struct PacketSummary {
+  uint64_t timestamp_ns = 0;
+  FlowKey flow; // family 0 if the packet has no IP layer
+  uint32_t length = 0;  // bytes captured
+  uint32_t payload = 0; // bytes after the last decoded header
+  uint16_t worker = 0;
+  bool tcp = false; // TCP was decoded
+  uint8_t tcp_flags = 0; // TCPHeader::flags()
+  bool malformed = false; // not even Ethernet decoded
+  uint8_t reserved = 0; // keeps the struct free of padding
+
+  static PacketSummary from(std::size_t worker, const PacketRef &packet,
+                            const LayerStack &stack);
+};
+
+static_assert(sizeof(PacketSummary) == 64,
+              "PacketSummary is one cache line in the display queues");
+
+/**
+ * @brief Prints one line per packet without slowing down the workers.
+ *
+ * Workers push() a PacketSummary into a lock-free queue of their own; a
+ * display thread formats them into large buffers with std::to_chars and
+ * writes several buffers at a time with writev(). A worker never waits:
+ * when its queue is full (the terminal or pipe cannot keep up) the summary
+ * is dropped and counted. Config::sample_every thins out what workers
+ * queue, and Config::max_lines_per_second what is written.
+ *
+ * Lines look like
+ *
+ *     12.000001000 #0 TCP 10.0.0.1:80 > 10.0.0.2:5000 [S.] len 74 payload 0
+ *
+ * with IPv6 addresses in brackets and "ETH" or "MALFORMED" for packets
+ * without an IP layer. Lines of different workers are interleaved in no
+ * particular order; each worker's lines are in order.
+ */
+class Display {
+public:
+  struct Config {
+    std::size_t workers = 1;
+    std::size_t queue_records = 8192; // per worker; rounded up to 2^k
+    int fd = STDOUT_FILENO; // not closed by the Display
+    // Show one packet in this many, per worker
+    uint32_t sample_every = 1;
+    // Lines beyond this rate are counted and skipped; 0 for no limit.
+    uint32_t max_lines_per_second = 0;
+  };
+
+  struct Stats {
+    uint64_t pushed = 0;      // push() calls
+    uint64_t queued = 0;      // summaries that made it into a queue
+    uint64_t dropped = 0;     // queue full
+    uint64_t suppressed = 0;  // over max_lines_per_second
+    uint64_t written = 0;     // lines written
+    uint64_t write_errors = 0; // failed writev() calls; their lines are lost
+  };
+
+  // Longest line format() writes, including the newline
+  inline static constexpr std::size_t MAX_LINE = 256;
+
+  /**
+   * @brief Allocates the queues and starts the display thread.
+   * @throws std::invalid_argument if there are no workers or
+   * sample_every is 0.
+   */
+  explicit Display(const Config &config);
+  ~Display();
+
+  Display(const Display &) = delete;
+  Display &operator=(const Display &) = delete;
+
+  /**
+   * @brief Queues a summary of `packet` for printing, unless sampling
+   * skips it. Only ever call it for a given `worker` from one thread, e.g.
+   * from a LayerSpyEngine handler.
+   * @return false if the queue was full.
+   */
+  bool push(std::size_t worker, const PacketRef &packet,
+            const LayerStack &stack);
+
+  /**
+   * @brief Writes out everything queued so far and joins the display
+   * thread. push() must not be called anymore. Safe to call more than once.
+   */
+  void stop();
+
+  Stats stats() const;
+
+  // Writes the line for `summary` into `out`, which needs room for
+  // MAX_LINE bytes. Returns one past the newline.
+  static char *format(const PacketSummary &summary, char *out);
+
+private:
+  struct Queue;
+  class Writer;
+
+  void run();
+
+  Config m_config;
+  std::unique_ptr<Queue[]> m_queues;
+  // Written only by the display thread
+  std::atomic<uint64_t> m_suppressed{0};
+  std::atomic<uint64_t> m_written{0};
+  std::atomic<uint64_t> m_write_errors{0};
+  std::atomic<bool> m_running{true};
+  std::thread m_thread;
+};
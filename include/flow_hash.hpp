@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief splitmix64 finalizer: spreads every input bit over the whole
+ * result. Shared by the flow hashes.
+ */
+inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * @brief Hash of a frame's 5-tuple that is the same for both directions of
+ * a flow.
+ *
+ * Reads the addresses, IP protocol and (for TCP/UDP) ports straight from the
+ * raw Ethernet frame, without decoding it, so it is cheap enough for a
+ * capture thread to call on every packet before handing it to a worker.
+ *
+ * IPv6 extension headers are walked as the decoder walks them, so the
+ * protocol and ports are those of the upper layer. Fragments, IPv4 and
+ * IPv6 alike, hash on addresses and upper-layer protocol only, since only
+ * the first fragment carries ports. A datagram rebuilt from them therefore
+ * goes to the worker of its fragments, which may not be the worker of its
+ * flow's unfragmented packets. Non-IP and truncated frames hash to 0.
+ */
+uint64_t symmetric_flow_hash(std::string_view frame);
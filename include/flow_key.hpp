@@ -0,0 +1,63 @@
+#pragma once
+#include "layer_stack.hpp"
+#include "types/ipv4_address.hpp"
+#include "types/ipv6_address.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * @brief The 5-tuple of a flow as a flat, trivially copyable value.
+ *
+ * IPv4 addresses sit in the first 4 bytes of the address fields (network
+ * byte order) with the rest zeroed, so both families share one layout and
+ * equality is a single 40-byte compare. Protocols without ports (or
+ * packets whose ports were not decoded) use port 0.
+ *
+ * A key is directional (source, then destination); canonical() gives the
+ * same key for both directions of a conversation.
+ */
+struct FlowKey {
+  std::array<uint8_t, 16> src_addr{};
+  std::array<uint8_t, 16> dst_addr{};
+  uint16_t src_port = 0;
+  uint16_t dst_port = 0;
+  uint8_t protocol = 0;
+  uint8_t family = 0; // 4 or 6; 0 for an empty key
+  uint16_t reserved = 0; // keeps the struct free of padding
+
+  FlowKey() = default;
+  FlowKey(const Ipv4Address &src, uint16_t sport, const Ipv4Address &dst,
+          uint16_t dport, uint8_t proto);
+  FlowKey(const Ipv6Address &src, uint16_t sport, const Ipv6Address &dst,
+          uint16_t dport, uint8_t proto);
+
+  /**
+   * @brief Builds the key of a decoded packet.
+   *
+   * Ports come from the TCP layer, or straight from the IP payload for UDP
+   * (which the Decoder does not decode).
+   * @return false if the packet has no IPv4 or IPv6 layer.
+   */
+  static bool from_packet(std::string_view packet, const LayerStack &stack,
+                          FlowKey &key);
+
+  // The same flow seen from the other end
+  FlowKey reversed() const;
+
+  // Orders the endpoints so both directions map to the same key
+  FlowKey canonical() const;
+
+  uint64_t hash() const;
+
+  bool operator==(const FlowKey &other) const {
+    return std::memcmp(this, &other, sizeof(FlowKey)) == 0;
+  }
+  bool operator!=(const FlowKey &other) const { return !(*this == other); }
+};
+
+static_assert(sizeof(FlowKey) == 40, "FlowKey must not contain padding");
+static_assert(std::is_trivially_copyable<FlowKey>::value,
+              "FlowKey is stored inline in flow tables");
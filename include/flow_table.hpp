@@ -0,0 +1,412 @@
+#pragma once
+#include "flow_key.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Why a FlowTable dropped an entry
+enum class EvictReason : uint8_t { Idle, Capacity };
+
+/**
+ * @brief Bounded open-addressing hash table from FlowKey to per-flow state.
+ *
+ * Swiss-table layout: one control byte per slot (empty, or 7 bits of the
+ * key's hash) in groups of 16, so a lookup compares a whole group with one
+ * SSE2 instruction and only touches slots whose tag matches. Keys and
+ * values live inline in one flat slot array that is allocated once, up
+ * front; inserting and evicting flows never allocates.
+ *
+ * Instead of tombstones each group counts the keys that probed past it
+ * (as in F14). A lookup stops at the first group nobody overflowed, and a
+ * removed slot is simply empty again, so heavy churn neither lengthens
+ * probe sequences nor ever forces a rehash.
+ *
+ * The table never holds more than `max_flows` entries. Inserting into a
+ * full table first evicts the least recently used flow, and flows idle for
+ * `idle_timeout_ns` are evicted as time advances: every touch() checks the
+ * oldest flows, so no periodic sweep is needed. Both go through the
+ * eviction callback, which is where finished flows should be exported.
+ *
+ * Recency is kept in an intrusive list threaded through the slots. To
+ * spare a hot flow the list update on every packet, a flow is only moved to
+ * the young end once per `lru_slack_ns`, so evictions can be that much out
+ * of order ("LRU-ish").
+ *
+ * Not thread-safe: give each worker its own table (flows are already
+ * pinned to workers by symmetric_flow_hash()). `Value` must be default
+ * constructible and move assignable; a slot's value is reset to `Value{}`
+ * when its flow is removed.
+ */
+template <typename Value> class FlowTable {
+public:
+  struct Config {
+    std::size_t max_flows = 1 << 20;
+    // Flows untouched for this long are evicted; 0 keeps them until the
+    // table fills up
+    uint64_t idle_timeout_ns = 60ULL * 1000000000ULL;
+    // How out of date a flow's place in the LRU order may get; 0 gives
+    // exact LRU at the cost of a list update per touch
+    uint64_t lru_slack_ns = 1000000000ULL;
+  };
+
+  // Called just before a flow is evicted. It may move out of `value` but
+  // must not modify the table.
+  using EvictCallback = std::function<void(const FlowKey &key, Value &value,
+                                           EvictReason reason)>;
+
+  // Largest supported `max_flows`: slot indices are 32-bit.
+  inline static constexpr std::size_t MAX_FLOWS = std::size_t{1} << 31;
+
+  /**
+   * @brief Allocates room for `config.max_flows` flows.
+   * @throws std::invalid_argument if max_flows is 0 or above MAX_FLOWS.
+   */
+  explicit FlowTable(const Config &config, EvictCallback on_evict = {});
+
+  FlowTable(const FlowTable &) = delete;
+  FlowTable &operator=(const FlowTable &) = delete;
+
+  /**
+   * @brief Returns the state of `key`'s flow, inserting a `Value{}` for a
+   * new flow, and marks the flow as used at `now_ns`.
+   *
+   * Idle flows are evicted first, then the oldest flow if the table is
+   * full. `inserted`, if given, is set to whether the flow is new.
+   */
+  Value &touch(const FlowKey &key, uint64_t now_ns, bool *inserted = nullptr);
+
+  // Looks a flow up without changing its recency; nullptr if absent.
+  Value *find(const FlowKey &key) {
+    const std::size_t index = find_index(key, key.hash());
+    return index == NPOS ? nullptr : &m_slots[index].value;
+  }
+  const Value *find(const FlowKey &key) const {
+    return const_cast<FlowTable *>(this)->find(key);
+  }
+
+  // Removes a flow without calling the eviction callback.
+  bool erase(const FlowKey &key);
+
+  // Evicts every flow idle at `now_ns`, oldest first. Returns the count.
+  std::size_t expire(uint64_t now_ns);
+
+  // Evicts the least recently used flow as if the table were full, e.g. to
+  // free memory its state holds. False if the table is empty.
+  bool evict_lru() {
+    if (m_oldest == NIL) {
+      return false;
+    }
+    evict_oldest(EvictReason::Capacity);
+    return true;
+  }
+
+  // Removes every flow without calling the eviction callback.
+  void clear();
+
+  // Calls fn(key, value) for every flow, least recently used first.
+  template <typename Fn> void for_each(Fn &&fn) const {
+    for (uint32_t i = m_oldest; i != NIL; i = m_slots[i].newer) {
+      fn(static_cast<const FlowKey &>(m_slots[i].key),
+         static_cast<const Value &>(m_slots[i].value));
+    }
+  }
+
+  std::size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  std::size_t max_flows() const { return m_config.max_flows; }
+  // Allocated slots (max_flows plus headroom for short probe sequences)
+  std::size_t slot_count() const { return m_groups * GROUP; }
+
+  uint64_t idle_evictions() const { return m_idle_evictions; }
+  uint64_t capacity_evictions() const { return m_capacity_evictions; }
+
+private:
+  inline static constexpr std::size_t GROUP = 16;
+  // Control bytes: a full slot holds 7 hash bits (0 - 127)
+  inline static constexpr int8_t EMPTY = -128;
+  // An overflow count this high sticks, which only costs longer probes.
+  inline static constexpr uint8_t OVERFLOW_STUCK = UINT8_MAX;
+  inline static constexpr uint32_t NIL = UINT32_MAX;
+  inline static constexpr std::size_t NPOS = SIZE_MAX;
+
+  struct Slot {
+    FlowKey key;
+    uint32_t older = NIL; // LRU list neighbours
+    uint32_t newer = NIL;
+    uint64_t linked_ns = 0; // when the flow last moved to the young end
+    uint64_t last_used_ns = 0;
+    Value value{};
+  };
+
+  static int8_t tag_of(uint64_t hash) {
+    return static_cast<int8_t>(hash & 0x7F);
+  }
+
+  // Bit i is set if control byte i of the group equals `tag`.
+  static uint32_t match(const int8_t *group, int8_t tag) {
+#if defined(__SSE2__)
+    const __m128i ctrl =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag))));
+#else
+    uint32_t bits = 0;
+    for (std::size_t i = 0; i < GROUP; ++i) {
+      bits |= static_cast<uint32_t>(group[i] == tag) << i;
+    }
+    return bits;
+#endif
+  }
+
+  // Probing is double hashing over a prime number of groups: the first
+  // group and the stride both come from the hash (multiply-shift), so keys
+  // that collide once go separate ways instead of piling up in clusters.
+  std::size_t home_group(uint64_t hash) const {
+    return static_cast<std::size_t>(((hash >> 32) * m_groups) >> 32);
+  }
+  std::size_t stride(uint64_t hash) const {
+    return 1 + static_cast<std::size_t>(
+                   (((hash >> 7) & UINT32_MAX) * (m_groups - 1)) >> 32);
+  }
+  std::size_t next_group(std::size_t group, std::size_t step) const {
+    group += step;
+    return group >= m_groups ? group - m_groups : group;
+  }
+  static std::size_t next_prime(std::size_t n) {
+    for (;; ++n) {
+      bool prime = n >= 2;
+      for (std::size_t d = 2; prime && d * d <= n; ++d) {
+        prime = n % d != 0;
+      }
+      if (prime) {
+        return n;
+      }
+    }
+  }
+
+  std::size_t find_index(const FlowKey &key, uint64_t hash) const;
+  // Claims a free slot for a new key with `hash`.
+  std::size_t claim_index(uint64_t hash);
+
+  void link_newest(uint32_t index);
+  void unlink(uint32_t index);
+  void remove(std::size_t index);
+  void evict_oldest(EvictReason reason);
+
+  Config m_config;
+  EvictCallback m_on_evict;
+  std::size_t m_groups = 0;
+  std::unique_ptr<int8_t[]> m_ctrl;
+  // Per group: keys stored further along the probe sequence
+  std::unique_ptr<uint8_t[]> m_overflow;
+  std::unique_ptr<Slot[]> m_slots;
+
+  std::size_t m_size = 0;
+
+  uint32_t m_oldest = NIL;
+  uint32_t m_newest = NIL;
+
+  uint64_t m_idle_evictions = 0;
+  uint64_t m_capacity_evictions = 0;
+};
+
+template <typename Value>
+FlowTable<Value>::FlowTable(const Config &config, EvictCallback on_evict)
+    : m_config(config), m_on_evict(std::move(on_evict)) {
+  if (config.max_flows == 0 || config.max_flows > MAX_FLOWS) {
+    throw std::invalid_argument("FlowTable: max_flows out of range");
+  }
+  // At most 80% of the slots are ever in use, which keeps probe sequences
+  // short.
+  const std::size_t slots = config.max_flows + config.max_flows / 4 + 1;
+  m_groups = next_prime((slots + GROUP - 1) / GROUP);
+  m_ctrl = std::make_unique<int8_t[]>(slot_count());
+  m_overflow = std::make_unique<uint8_t[]>(m_groups);
+  m_slots = std::make_unique<Slot[]>(slot_count());
+  std::fill_n(m_ctrl.get(), slot_count(), EMPTY);
+}
+
+template <typename Value>
+Value &FlowTable<Value>::touch(const FlowKey &key, uint64_t now_ns,
+                               bool *inserted) {
+  expire(now_ns);
+
+  const uint64_t hash = key.hash();
+  std::size_t index = find_index(key, hash);
+  if (index != NPOS) {
+    Slot &slot = m_slots[index];
+    slot.last_used_ns = now_ns;
+    if (now_ns >= slot.linked_ns + m_config.lru_slack_ns &&
+        m_newest != index) {
+      unlink(static_cast<uint32_t>(index));
+      link_newest(static_cast<uint32_t>(index));
+      slot.linked_ns = now_ns;
+    }
+    if (inserted != nullptr) {
+      *inserted = false;
+    }
+    return slot.value;
+  }
+
+  if (m_size == m_config.max_flows) {
+    evict_oldest(EvictReason::Capacity);
+  }
+  index = claim_index(hash);
+  Slot &slot = m_slots[index];
+  slot.key = key;
+  slot.linked_ns = now_ns;
+  slot.last_used_ns = now_ns;
+  link_newest(static_cast<uint32_t>(index));
+  ++m_size;
+  if (inserted != nullptr) {
+    *inserted = true;
+  }
+  return slot.value;
+}
+
+template <typename Value> bool FlowTable<Value>::erase(const FlowKey &key) {
+  const std::size_t index = find_index(key, key.hash());
+  if (index == NPOS) {
+    return false;
+  }
+  remove(index);
+  return true;
+}
+
+template <typename Value>
+std::size_t FlowTable<Value>::expire(uint64_t now_ns) {
+  if (m_config.idle_timeout_ns == 0) {
+    return 0;
+  }
+  std::size_t evicted = 0;
+  while (m_oldest != NIL &&
+         m_slots[m_oldest].last_used_ns + m_config.idle_timeout_ns <= now_ns) {
+    evict_oldest(EvictReason::Idle);
+    ++evicted;
+  }
+  return evicted;
+}
+
+template <typename Value> void FlowTable<Value>::clear() {
+  for (uint32_t i = m_oldest; i != NIL;) {
+    const uint32_t next = m_slots[i].newer;
+    m_slots[i].value = Value{};
+    i = next;
+  }
+  std::fill_n(m_ctrl.get(), slot_count(), EMPTY);
+  std::fill_n(m_overflow.get(), m_groups, 0);
+  m_oldest = NIL;
+  m_newest = NIL;
+  m_size = 0;
+}
+
+template <typename Value>
+std::size_t FlowTable<Value>::find_index(const FlowKey &key,
+                                         uint64_t hash) const {
+  const int8_t tag = tag_of(hash);
+  const std::size_t step = stride(hash);
+  std::size_t group = home_group(hash);
+  for (std::size_t probe = 0; probe < m_groups; ++probe) {
+    const int8_t *ctrl = &m_ctrl[group * GROUP];
+    for (uint32_t bits = match(ctrl, tag); bits != 0; bits &= bits - 1) {
+      const std::size_t index =
+          group * GROUP + static_cast<std::size_t>(__builtin_ctz(bits));
+      if (m_slots[index].key == key) {
+        return index;
+      }
+    }
+    if (m_overflow[group] == 0) {
+      return NPOS;
+    }
+    group = next_group(group, step);
+  }
+  return NPOS;
+}
+
+template <typename Value>
+std::size_t FlowTable<Value>::claim_index(uint64_t hash) {
+  const std::size_t step = stride(hash);
+  std::size_t group = home_group(hash);
+  // The table is never more than 80% full, so this finds a slot.
+  for (;;) {
+    const uint32_t bits = match(&m_ctrl[group * GROUP], EMPTY);
+    if (bits != 0) {
+      const std::size_t index =
+          group * GROUP + static_cast<std::size_t>(__builtin_ctz(bits));
+      m_ctrl[index] = tag_of(hash);
+      return index;
+    }
+    if (m_overflow[group] != OVERFLOW_STUCK) {
+      ++m_overflow[group];
+    }
+    group = next_group(group, step);
+  }
+}
+
+template <typename Value>
+void FlowTable<Value>::link_newest(uint32_t index) {
+  Slot &slot = m_slots[index];
+  slot.older = m_newest;
+  slot.newer = NIL;
+  if (m_newest != NIL) {
+    m_slots[m_newest].newer = index;
+  } else {
+    m_oldest = index;
+  }
+  m_newest = index;
+}
+
+template <typename Value> void FlowTable<Value>::unlink(uint32_t index) {
+  Slot &slot = m_slots[index];
+  if (slot.older != NIL) {
+    m_slots[slot.older].newer = slot.newer;
+  } else {
+    m_oldest = slot.newer;
+  }
+  if (slot.newer != NIL) {
+    m_slots[slot.newer].older = slot.older;
+  } else {
+    m_newest = slot.older;
+  }
+}
+
+template <typename Value> void FlowTable<Value>::remove(std::size_t index) {
+  unlink(static_cast<uint32_t>(index));
+  m_slots[index].value = Value{};
+  m_ctrl[index] = EMPTY;
+  --m_size;
+
+  // Undo the overflow counts the key left on its way from its home group.
+  const uint64_t hash = m_slots[index].key.hash();
+  const std::size_t step = stride(hash);
+  const std::size_t last = index / GROUP;
+  for (std::size_t group = home_group(hash); group != last;
+       group = next_group(group, step)) {
+    if (m_overflow[group] != OVERFLOW_STUCK) {
+      --m_overflow[group];
+    }
+  }
+}
+
+template <typename Value>
+void FlowTable<Value>::evict_oldest(EvictReason reason) {
+  const uint32_t index = m_oldest;
+  Slot &slot = m_slots[index];
+  if (m_on_evict) {
+    m_on_evict(slot.key, slot.value, reason);
+  }
+  if (reason == EvictReason::Idle) {
+    ++m_idle_evictions;
+  } else {
+    ++m_capacity_evictions;
+  }
+  remove(index);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "flow_table.hpp"
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include <cstdint>
+#include <utility>
+
+/**
+ * @brief Counters kept for each flow, covering both directions.
+ */
+struct FlowStats {
+  uint64_t packets = 0;
+  uint64_t bytes = 0; // whole frames, as captured
+  uint64_t first_seen_ns = 0;
+  uint64_t last_seen_ns = 0;
+  uint8_t tcp_flags = 0; // union of TCPHeader::FLAG_* seen on the flow
+};
+
+/**
+ * @brief Accounts decoded packets to their flows in a bounded FlowTable.
+ *
+ * Both directions of a conversation share one entry (the table is keyed by
+ * FlowKey::canonical()). Time is taken from the packet timestamps, so the
+ * idle timeout works the same on live traffic and on capture files.
+ *
+ * One tracker per worker thread; see FlowTable.
+ */
+class FlowTracker {
+public:
+  using Table = FlowTable<FlowStats>;
+
+  explicit FlowTracker(const Table::Config &config,
+                       Table::EvictCallback on_evict = {})
+      : m_table(config, std::move(on_evict)) {}
+
+  /**
+   * @brief Adds `packet` (already decoded into `stack`) to its flow.
+   * @return false if the packet is not IP and was not counted.
+   */
+  bool update(const PacketRef &packet, const LayerStack &stack);
+
+  Table &table() { return m_table; }
+  const Table &table() const { return m_table; }
+
+private:
+  Table m_table;
+};
@@ -0,0 +1,177 @@
+#pragma once
+#include "flow_table.hpp"
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Counters kept by a FragmentReassembler, for sizing its limits.
+ */
+struct FragmentStats {
+  uint64_t fragments = 0;   // IPv4 and IPv6 fragments seen
+  uint64_t reassembled = 0; // datagrams completed
+  // Datagrams given up on after Config::timeout_ns without a new fragment
+  uint64_t timeouts = 0;
+  // Fragments overlapping data already held. Exact repeats are ignored;
+  // any other overlap drops the whole datagram (RFC 5722).
+  uint64_t overlaps = 0;
+  // Fragments that found Config::memory_cap used up. The least recently
+  // used datagrams are dropped to make room, or this one if none is left.
+  uint64_t cap_hits = 0;
+  // Unfinished datagrams dropped to make room (table full, or memory cap)
+  uint64_t evictions = 0;
+  // Fragments with impossible offsets or lengths (their datagram is dropped)
+  uint64_t invalid = 0;
+};
+
+/**
+ * @brief Puts fragmented IPv4 and IPv6 datagrams back together, so their
+ * L4 header can be decoded.
+ *
+ * Fragments are grouped by (source, destination, identification, protocol)
+ * in a bounded FlowTable; the identification takes the place of the ports
+ * in the FlowKey. Their payloads are copied into fixed-size chunks from a
+ * pool of `memory_cap` bytes that is allocated once, up front, so neither
+ * fragments nor datagrams allocate. A datagram with no new fragment for
+ * `timeout_ns` is dropped by the table's LRU list, oldest first, without
+ * ever scanning the table.
+ *
+ * A completed datagram is handed back as a whole frame: the Ethernet and IP
+ * header of the first fragment, with the length, fragment and (IPv4)
+ * checksum fields rewritten and the IPv6 fragment header removed, followed
+ * by the payload. Decoding it gives the L4 layers the fragments lost.
+ *
+ * An IPv6 Fragment header is found wherever IPv6Header::parse_extensions()
+ * finds it; the extension headers before it (the unfragmentable part) are
+ * kept from the first fragment, as part of its IP header.
+ *
+ * A packet that is not a fragment costs two field checks. Not thread-safe;
+ * run one reassembler per worker (the fragments of a datagram share its
+ * addresses and protocol, so symmetric_flow_hash() sends them to the same
+ * worker). That worker is picked without the ports, though, so it need not
+ * be the one handling the rest of the datagram's flow: per-flow state fed
+ * with reassembled datagrams can be split across workers.
+ */
+class FragmentReassembler {
+public:
+  struct Config {
+    std::size_t max_datagrams = 4096; // incomplete datagrams held at once
+    uint64_t timeout_ns = 30ULL * 1000000000ULL;
+    std::size_t memory_cap = 16 * 1024 * 1024; // payload bytes, all datagrams
+  };
+
+  enum class Result : uint8_t {
+    NotFragment, // the packet was not a fragment; use it as it is
+    Held,        // kept until the rest of its datagram arrives
+    Complete,    // completed a datagram, see `reassembled`
+    Dropped,     // overlapping, invalid, or no memory for it
+  };
+
+  // Payload chunk size; the pool holds memory_cap / CHUNK_SIZE chunks.
+  inline static constexpr std::size_t CHUNK_SIZE = 2048;
+  // Largest payload an IP datagram can have
+  inline static constexpr std::size_t MAX_PAYLOAD = 65535;
+
+  /**
+   * @brief Allocates the datagram table and the chunk pool.
+   * @throws std::invalid_argument if max_datagrams is 0 or memory_cap is
+   * smaller than one chunk.
+   */
+  explicit FragmentReassembler(const Config &config);
+
+  FragmentReassembler(const FragmentReassembler &) = delete;
+  FragmentReassembler &operator=(const FragmentReassembler &) = delete;
+
+  /**
+   * @brief Feeds one decoded packet.
+   *
+   * On Complete, `reassembled` views the rebuilt frame (with the timestamp
+   * of this last fragment); it stays valid until the next call.
+   */
+  Result process(const PacketRef &packet, const LayerStack &stack,
+                 PacketRef &reassembled);
+
+  // Drops datagrams idle at `now_ns`. Returns how many were dropped.
+  std::size_t expire(uint64_t now_ns) { return m_datagrams.expire(now_ns); }
+
+  // Drops every incomplete datagram (e.g. at the end of a capture file).
+  void clear();
+
+  const FragmentStats &stats() const { return m_stats; }
+  std::size_t datagrams() const { return m_datagrams.size(); }
+  // Chunk bytes currently in use
+  std::size_t buffered_bytes() const {
+    return (m_chunk_count - m_free.size()) * CHUNK_SIZE;
+  }
+
+private:
+  inline static constexpr std::size_t MAX_CHUNKS =
+      (MAX_PAYLOAD + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  // Separate byte ranges a datagram may have before it is given up on
+  inline static constexpr std::size_t MAX_RANGES = 8;
+  // Ethernet plus the longest IPv4 header, or the IPv6 base header and up
+  // to 200 bytes of extension headers before the Fragment header
+  inline static constexpr std::size_t MAX_HEADER = 14 + 40 + 200;
+  inline static constexpr uint32_t NO_CHUNK = UINT32_MAX;
+
+  // Payload bytes [begin, end) received
+  struct Range {
+    uint16_t begin;
+    uint16_t end;
+  };
+
+  struct Datagram {
+    Datagram() { chunks.fill(NO_CHUNK); }
+
+    std::array<uint32_t, MAX_CHUNKS> chunks;
+    std::array<Range, MAX_RANGES> ranges{};
+    uint8_t range_count = 0;
+    bool last_seen = false;
+    uint32_t total = 0; // payload length, once the last fragment arrived
+    // Ethernet + IP header of the first fragment; 0 until it arrived
+    uint8_t header_length = 0;
+    uint8_t next_header = 0; // IPv6: protocol after the fragment header
+    uint8_t link = 0;        // IPv6: where in the IP header it goes
+    std::array<uint8_t, MAX_HEADER> header;
+  };
+
+  // One fragment, as found in either IP version
+  struct Fragment {
+    FlowKey key;
+    std::string_view header; // Ethernet + IP header (+ unfragmentable part)
+    std::string_view data;
+    uint32_t offset;
+    bool last;
+    uint8_t next_header;
+    uint8_t link; // IPv6: IPv6Header::fragment_link
+  };
+
+  Result add(const Fragment &fragment, uint64_t now_ns,
+             PacketRef &reassembled);
+  // Makes sure the chunks under [begin, end) exist; false if out of memory.
+  bool reserve(Datagram &datagram, uint32_t begin, uint32_t end);
+  void copy(Datagram &datagram, uint32_t offset, std::string_view data);
+  // Records [begin, end); false if the datagram has too many holes.
+  static bool add_range(Datagram &datagram, uint32_t begin, uint32_t end);
+  void build(const Datagram &datagram, bool ipv6);
+  void release(Datagram &datagram);
+  Result drop(const FlowKey &key, Datagram &datagram);
+
+  char *chunk(uint32_t index) {
+    return m_memory.get() + static_cast<std::size_t>(index) * CHUNK_SIZE;
+  }
+
+  Config m_config;
+  FlowTable<Datagram> m_datagrams;
+  std::size_t m_chunk_count;
+  std::unique_ptr<char[]> m_memory;
+  std::vector<uint32_t> m_free; // indices of unused chunks
+  std::string m_output;         // the last completed frame
+  FragmentStats m_stats;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include "flow_table.hpp"
+#include "protocols/http.hpp"
+#include "tcp_reassembler.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Parses HTTP/1.x out of reassembled TCP streams.
+ *
+ * Plugs into a TcpReassembler as its handler and runs one HttpParser per
+ * stream direction, so requests and responses are reported separately,
+ * each under the key of the side that sent it. Streams that turn out not
+ * to be HTTP are reported once through on_error() and ignored from then
+ * on; parsers are dropped when the reassembler closes their stream.
+ *
+ * Each side also remembers which of its requests were HEAD or CONNECT, so
+ * the parser of the other side knows which responses have no body and
+ * when the connection becomes a tunnel. This needs the requesting side's
+ * parser to still be open when the response arrives.
+ *
+ * When more than `max_streams` directions are open at once the least
+ * recently active parser is finished as if its stream had closed (a body
+ * delimited by the end of the connection is reported up to there) and then
+ * dropped; evicted() counts those.
+ */
+class HttpStreams : public TcpReassembler::Handler {
+public:
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+    // Views in `message` are only valid during the call.
+    virtual void on_message(const FlowKey &stream,
+                            const HttpMessage &message) = 0;
+    virtual void on_body(const FlowKey &stream, std::string_view data) {
+      static_cast<void>(stream);
+      static_cast<void>(data);
+    }
+    virtual void on_message_complete(const FlowKey &stream) {
+      static_cast<void>(stream);
+    }
+    virtual void on_error(const FlowKey &stream, HttpParser::Error error) {
+      static_cast<void>(stream);
+      static_cast<void>(error);
+    }
+  };
+
+  // `max_streams` should match the reassembler's Config::max_streams.
+  HttpStreams(std::size_t max_streams, Handler &handler);
+
+  void on_data(const FlowKey &stream, std::string_view data) override;
+  void on_gap(const FlowKey &stream, uint64_t bytes) override;
+  void on_close(const FlowKey &stream,
+                TcpReassembler::CloseReason reason) override;
+
+  uint64_t messages() const { return m_messages; }
+  uint64_t errors() const { return m_errors; }
+  std::size_t streams() const { return m_streams.size(); }
+  // Parsers dropped to make room for another stream
+  uint64_t evicted() const { return m_evicted; }
+
+private:
+  // Framing of the responses to a side's requests, oldest first. Requests
+  // past CAPACITY are only counted; their responses are framed normally.
+  class PendingRequests {
+  public:
+    void push(HttpParser::ResponseFraming framing);
+    HttpParser::ResponseFraming pop();
+
+  private:
+    inline static constexpr std::size_t CAPACITY = 16;
+    std::array<HttpParser::ResponseFraming, CAPACITY> m_framing{};
+    uint8_t m_first = 0;
+    uint8_t m_count = 0;
+    // Requests newer than all of m_framing that did not fit
+    uint32_t m_untracked = 0;
+  };
+
+  struct Stream {
+    HttpParser parser;
+    PendingRequests requests; // sent by this side, not yet answered
+  };
+
+  // Forwards one parser's callbacks with the key of its stream, and
+  // matches responses to the other side's requests.
+  class Forwarder : public HttpParser::Handler {
+  public:
+    Forwarder(HttpStreams::Handler &handler, const FlowKey &stream,
+              Stream &own, Stream *peer)
+        : m_handler(handler), m_stream(stream), m_own(own), m_peer(peer) {}
+    void on_message(const HttpMessage &message) override;
+    void on_body(std::string_view data) override {
+      m_handler.on_body(m_stream, data);
+    }
+    void on_message_complete() override {
+      m_handler.on_message_complete(m_stream);
+    }
+
+  private:
+    HttpStreams::Handler &m_handler;
+    const FlowKey &m_stream;
+    Stream &m_own;
+    Stream *m_peer;
+  };
+
+  void check(const FlowKey &stream, const HttpParser &parser,
+             uint64_t messages_before);
+  // Reports what the stream's parser still holds, as the stream ends.
+  void finish(const FlowKey &stream, Stream &state);
+
+  Handler &m_handler;
+  // Idle streams are already expired by the reassembler, which closes them.
+  FlowTable<Stream> m_streams;
+  uint64_t m_messages = 0;
+  uint64_t m_errors = 0;
+  uint64_t m_evicted = 0;
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include "protocols/base_protocol.hpp"
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include "protocols/tcp.hpp"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Owning handle to a layer of a known type.
+ *
+ * Converts implicitly to LayerPtr, so it can be stored straight into
+ * `BaseProtocol::payload`.
+ */
+template <typename T> using TypedLayerPtr = std::unique_ptr<T, LayerDeleter>;
+
+/**
+ * @brief Free-list pool of fixed-size slots for one layer type.
+ *
+ * Slots are carved out of slabs that are never returned to the allocator, so
+ * once the pool has grown to the working-set size acquire()/release() are a
+ * couple of pointer swaps.
+ */
+template <typename T> class LayerPool {
+public:
+  // Slots allocated per slab when the free list runs dry
+  inline static constexpr std::size_t SLAB_SIZE = 64;
+
+  LayerPool() = default;
+  LayerPool(const LayerPool &) = delete;
+  LayerPool &operator=(const LayerPool &) = delete;
+
+  ~LayerPool() = default;
+
+  // Constructs a fresh T in a free slot. The handle returns it on destruction.
+  TypedLayerPtr<T> make() {
+    if (m_free == nullptr) {
+      grow(SLAB_SIZE);
+    }
+    Slot *slot = m_free;
+    m_free = slot->next;
+    ++m_in_use;
+
+    T *layer = ::new (static_cast<void *>(slot->storage)) T();
+    return TypedLayerPtr<T>(layer, LayerDeleter{&LayerPool::release_thunk, this});
+  }
+
+  // Makes sure at least `count` slots exist without further allocation.
+  void reserve(std::size_t count) {
+    if (count > m_capacity) {
+      grow(count - m_capacity);
+    }
+  }
+
+  std::size_t capacity() const { return m_capacity; }
+  std::size_t in_use() const { return m_in_use; }
+
+private:
+  union Slot {
+    Slot *next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  static void release_thunk(void *pool, BaseProtocol *layer) {
+    static_cast<LayerPool *>(pool)->release(static_cast<T *>(layer));
+  }
+
+  void release(T *layer) {
+    layer->~T();
+    Slot *slot = reinterpret_cast<Slot *>(layer);
+    slot->next = m_free;
+    m_free = slot;
+    --m_in_use;
+  }
+
+  void grow(std::size_t count) {
+    auto slab = std::make_unique<Slot[]>(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      slab[i].next = m_free;
+      m_free = &slab[i];
+    }
+    m_slabs.push_back(std::move(slab));
+    m_capacity += count;
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> m_slabs;
+  Slot *m_free = nullptr;
+  std::size_t m_capacity = 0;
+  std::size_t m_in_use = 0;
+};
+
+/**
+ * @brief One LayerPool per protocol the Decoder knows how to build.
+ *
+ * Handles created here point back into the arena, so every LayerPtr must be
+ * destroyed before the arena is. The arena is not thread-safe; give each
+ * decoding thread its own (the Decoder already does).
+ */
+class LayerArena {
+public:
+  LayerArena() = default;
+  LayerArena(const LayerArena &) = delete;
+  LayerArena &operator=(const LayerArena &) = delete;
+
+  template <typename T> TypedLayerPtr<T> make() { return pool<T>().make(); }
+
+  // Pre-sizes every pool for `packets` packets kept alive at the same time.
+  void reserve(std::size_t packets);
+
+  // Total slots owned / currently handed out, across all layer types
+  std::size_t capacity() const;
+  std::size_t in_use() const;
+
+private:
+  template <typename T> LayerPool<T> &pool();
+
+  LayerPool<Ethernet> m_ethernet;
+  LayerPool<IPv4> m_ipv4;
+  LayerPool<IPv6> m_ipv6;
+  LayerPool<TCP> m_tcp;
+};
+
+template <> inline LayerPool<Ethernet> &LayerArena::pool<Ethernet>() {
+  return m_ethernet;
+}
+template <> inline LayerPool<IPv4> &LayerArena::pool<IPv4>() { return m_ipv4; }
+template <> inline LayerPool<IPv6> &LayerArena::pool<IPv6>() { return m_ipv6; }
+template <> inline LayerPool<TCP> &LayerArena::pool<TCP>() { return m_tcp; }
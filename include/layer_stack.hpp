@@ -0,0 +1,163 @@
+#pragma once
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include "protocols/tcp.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Identifies a decoded layer inside a LayerStack.
+ */
+enum class LayerKind : uint8_t { Ethernet, IPv4, IPv6, TCP, Count };
+
+/**
+ * @brief Where one layer sits in the packet.
+ *
+ * `offset`/`length` cover the whole layer (header + payload, after trimming
+ * padding); the header itself is the first `header_length` bytes of it.
+ */
+struct LayerEntry {
+  LayerKind kind;
+  uint16_t header_length;
+  uint32_t offset;
+  uint32_t length;
+};
+
+/**
+ * @brief Maps a tree node type (Ethernet, IPv4, ...) to its flat header
+ * struct and LayerKind, so `stack.get<TCP>()` reads like the tree API.
+ */
+template <typename T> struct LayerTraits;
+
+template <> struct LayerTraits<Ethernet> {
+  using Header = EthernetHeader;
+  inline static constexpr LayerKind KIND = LayerKind::Ethernet;
+};
+template <> struct LayerTraits<IPv4> {
+  using Header = IPv4Header;
+  inline static constexpr LayerKind KIND = LayerKind::IPv4;
+};
+template <> struct LayerTraits<IPv6> {
+  using Header = IPv6Header;
+  inline static constexpr LayerKind KIND = LayerKind::IPv6;
+};
+template <> struct LayerTraits<TCP> {
+  using Header = TCPHeader;
+  inline static constexpr LayerKind KIND = LayerKind::TCP;
+};
+
+/**
+ * @brief Flat, fixed-size result of decoding one packet.
+ *
+ * Holds the ordered list of layers found plus inline storage for every
+ * header type, so decoding into it needs no allocation, no vtables and no
+ * pointer chasing. A packet carries each layer kind at most once, which
+ * lets get<T>() be a single table lookup.
+ *
+ * Offsets are relative to the packet passed to Decoder::decode(); the stack
+ * itself holds no pointers and can be copied freely.
+ */
+class alignas(64) LayerStack {
+public:
+  inline static constexpr std::size_t MAX_LAYERS = 8;
+
+  LayerStack() { clear(); }
+
+  void clear() {
+    m_count = 0;
+    m_payload_offset = 0;
+    m_payload_length = 0;
+    for (auto &index : m_index) {
+      index = NO_LAYER;
+    }
+  }
+
+  std::size_t size() const { return m_count; }
+  bool empty() const { return m_count == 0; }
+  const LayerEntry &operator[](std::size_t i) const { return m_entries[i]; }
+  const LayerEntry *begin() const { return m_entries; }
+  const LayerEntry *end() const { return m_entries + m_count; }
+
+  bool has(LayerKind kind) const {
+    return m_index[static_cast<std::size_t>(kind)] != NO_LAYER;
+  }
+
+  // Decoded header of layer T, or nullptr if the packet does not carry it.
+  template <typename T> const typename LayerTraits<T>::Header *get() const {
+    return has(LayerTraits<T>::KIND) ? &header<T>() : nullptr;
+  }
+
+  // Position of layer T in the packet, or nullptr if absent.
+  template <typename T> const LayerEntry *entry() const {
+    const uint8_t index = m_index[static_cast<std::size_t>(LayerTraits<T>::KIND)];
+    return index == NO_LAYER ? nullptr : &m_entries[index];
+  }
+
+  // Bytes left over after the innermost decoded header.
+  std::size_t payload_offset() const { return m_payload_offset; }
+  std::size_t payload_length() const { return m_payload_length; }
+
+  std::string_view payload(std::string_view packet) const {
+    return packet.substr(m_payload_offset, m_payload_length);
+  }
+
+  // Bytes following the header of `layer`, bounded by the layer's length.
+  static std::string_view layer_payload(std::string_view packet,
+                                        const LayerEntry &layer) {
+    return packet.substr(layer.offset + layer.header_length,
+                         layer.length - layer.header_length);
+  }
+
+  // --- Used by the Decoder while filling the stack ---
+
+  // Header storage for layer T; filled in before push<T>() commits it.
+  template <typename T> typename LayerTraits<T>::Header &header();
+  template <typename T> const typename LayerTraits<T>::Header &header() const {
+    return const_cast<LayerStack *>(this)->header<T>();
+  }
+
+  // Records layer T at [offset, offset + length). False if the stack is full.
+  template <typename T>
+  bool push(std::size_t offset, std::size_t header_length,
+            std::size_t length) {
+    if (m_count == MAX_LAYERS) {
+      return false;
+    }
+    m_entries[m_count] = LayerEntry{LayerTraits<T>::KIND,
+                                    static_cast<uint16_t>(header_length),
+                                    static_cast<uint32_t>(offset),
+                                    static_cast<uint32_t>(length)};
+    m_index[static_cast<std::size_t>(LayerTraits<T>::KIND)] = m_count;
+    ++m_count;
+    set_payload(offset + header_length, length - header_length);
+    return true;
+  }
+
+  void set_payload(std::size_t offset, std::size_t length) {
+    m_payload_offset = static_cast<uint32_t>(offset);
+    m_payload_length = static_cast<uint32_t>(length);
+  }
+
+private:
+  inline static constexpr uint8_t NO_LAYER = 0xFF;
+
+  LayerEntry m_entries[MAX_LAYERS];
+  uint8_t m_index[static_cast<std::size_t>(LayerKind::Count)];
+  uint8_t m_count;
+  uint32_t m_payload_offset;
+  uint32_t m_payload_length;
+
+  EthernetHeader m_ethernet;
+  IPv4Header m_ipv4;
+  IPv6Header m_ipv6;
+  TCPHeader m_tcp;
+};
+
+template <> inline EthernetHeader &LayerStack::header<Ethernet>() {
+  return m_ethernet;
+}
+template <> inline IPv4Header &LayerStack::header<IPv4>() { return m_ipv4; }
+template <> inline IPv6Header &LayerStack::header<IPv6>() { return m_ipv6; }
+template <> inline TCPHeader &LayerStack::header<TCP>() { return m_tcp; }
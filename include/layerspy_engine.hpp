@@ -0,0 +1,186 @@
+#pragma once
+#include "layer_stack.hpp"
+#include "load_shedder.hpp"
+#include "packet_classifier.hpp"
+#include "packet_filter.hpp"
+#include "packet_ref.hpp"
+#include "sniffer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Snapshot of one decode worker's counters.
+ */
+struct WorkerStats {
+  // Packets queued for it (or read from its socket), not counting shed ones
+  uint64_t enqueued = 0;
+  // Packets lost on the way: its ring was full (shared capture), or the
+  // kernel dropped them on its own socket (one Sniffer per worker)
+  uint64_t dropped = 0;
+  // Of those, packets longer than its ring can hold at all (see
+  // PacketRing::max_packet()); dropped even with Config::block_when_full
+  uint64_t oversized = 0;
+  uint64_t decoded = 0;     // packets that decoded to at least Ethernet
+  uint64_t malformed = 0;   // packets the Decoder rejected
+  // Packets Config::filter or Config::classifier rejected (not decoded)
+  uint64_t filtered = 0;
+  // Decoded packets whose IPv4, TCP or UDP checksum is wrong (counted only
+  // with Config::verify_checksums; they are still handled)
+  uint64_t bad_checksums = 0;
+  uint64_t queue_depth = 0; // packets queued but not yet decoded
+  uint64_t max_queue_depth = 0; // highest queue_depth seen (sampled)
+  // Packets of flows load shedding skipped before decoding (and queueing),
+  // and the current sampling: 1 in sample_rate flows, 1 under full capture
+  uint64_t shed = 0;
+  uint32_t sample_rate = 1;
+};
+
+/**
+ * @brief Multi-threaded capture and decode pipeline.
+ *
+ * One capture thread polls the Sniffer and copies each frame into the
+ * PacketRing of one decode worker, chosen by symmetric_flow_hash() so both
+ * directions of a flow are always decoded by the same worker. Each worker
+ * owns its Decoder and LayerStack and calls the handler for every packet;
+ * nothing is shared between workers, so throughput scales with the number
+ * of workers until the capture thread itself becomes the bottleneck.
+ *
+ * When a worker falls behind its ring fills up and new packets for it are
+ * dropped (and counted) rather than stalling capture for every other flow,
+ * unless Config::block_when_full asks for lossless delivery.
+ *
+ * With Config::shed_load a worker that falls behind sheds whole flows
+ * instead (see LoadShedder): the capture thread watches how full its ring
+ * is and how long a packet queued now would wait to be decoded, and skips
+ * the flows it does not sample before copying them.
+ *
+ * Alternatively each worker can be given its own Sniffer (e.g. TPACKET
+ * sockets in one fanout group, see open_sniffers()). Workers then poll their
+ * socket directly and decode packets where the kernel put them: there is no
+ * capture thread, no ring and no copy. Load is then judged by the age of
+ * the packets the kernel hands over, which needs capture timestamps taken
+ * from the wall clock (a live interface, not a replayed file).
+ */
+class LayerSpyEngine {
+public:
+  /**
+   * @brief Called on a worker thread for every captured packet.
+   *
+   * `worker` identifies the calling thread (0 .. workers - 1); calls with the
+   * same `worker` never overlap, so per-worker state indexed by it needs no
+   * locking. `packet` and `stack` are only valid during the call; `stack` is
+   * empty if the packet was malformed.
+   */
+  using Handler = std::function<void(
+      std::size_t worker, const PacketRef &packet, const LayerStack &stack)>;
+
+  struct Config {
+    std::size_t workers = 1;
+    std::size_t ring_bytes = 8 * 1024 * 1024; // per worker
+    int poll_batch = 64; // packets the capture thread asks for per poll
+    std::size_t decode_batch = 64; // packets a worker drains at a time
+    // Wait for room instead of dropping when a worker's ring is full. For
+    // sources that can be paused, such as capture files.
+    bool block_when_full = false;
+    // Pin the capture thread and each worker to its own CPU (Linux only)
+    bool pin_threads = false;
+    // Packets it rejects are counted and dropped before decoding; the
+    // handler never sees them. Must outlive the engine.
+    const PacketFilter *filter = nullptr;
+    // Tags each batch a worker takes from its ring in one call, and drops
+    // the packets whose tag lacks a bit of classify_mask (e.g. TCP |
+    // MONITORED) before the filter and decoding. A worker with its own
+    // Sniffer gets packets one at a time and tags them singly. Must
+    // outlive the engine.
+    const PacketClassifier *classifier = nullptr;
+    PacketClassifier::Tag classify_mask = 0;
+    // Check IPv4, TCP and UDP checksums (see verify_checksums()) and count
+    // the packets that fail, e.g. to spot a tap that corrupts frames.
+    bool verify_checksums = false;
+    // Sample whole flows when a worker cannot keep up rather than lose
+    // packets at random; the handler sees the rate in
+    // PacketRef::sample_rate. Meant for live capture: with
+    // block_when_full nothing is lost anyway.
+    bool shed_load = false;
+    LoadShedder::Config shedding;
+  };
+
+  /**
+   * @brief One capture thread reading `sniffer` feeds Config::workers
+   * workers.
+   * @throws std::invalid_argument if Config::shedding is invalid (with
+   * Config::shed_load).
+   */
+  LayerSpyEngine(Sniffer &sniffer, Config config, Handler handler);
+
+  // One worker per entry of `sniffers`; Config::workers is ignored.
+  // Throws like the constructor above.
+  LayerSpyEngine(std::vector<Sniffer *> sniffers, Config config,
+                 Handler handler);
+  ~LayerSpyEngine();
+
+  LayerSpyEngine(const LayerSpyEngine &) = delete;
+  LayerSpyEngine &operator=(const LayerSpyEngine &) = delete;
+
+  // Spawns the capture thread and the workers.
+  void start();
+
+  /**
+   * @brief Stops capturing, lets every worker finish the packets already
+   * queued for it, and joins all threads. Safe to call more than once.
+   */
+  void stop();
+
+  /**
+   * @brief Blocks until the Sniffer runs dry (poll() returned -1) and every
+   * queued packet has been handled, then joins all threads.
+   */
+  void wait();
+
+  // False once stop() was called or the Sniffer ran dry.
+  bool running() const { return m_running.load(std::memory_order_acquire); }
+
+  std::size_t workers() const { return m_workers.size(); }
+  WorkerStats stats(std::size_t worker) const;
+
+  // Sum over all workers (max_queue_depth is the maximum).
+  WorkerStats totals() const;
+
+private:
+  struct Worker;
+
+  void capture_loop();
+  void worker_loop(Worker &worker);
+  void direct_loop(Worker &worker, Sniffer &sniffer);
+  // Decodes one packet and passes it to the handler
+  void handle(Worker &worker, const PacketRef &packet);
+  // Handles the packets Config::classifier keeps (all without one)
+  void handle_batch(Worker &worker, const PacketRef *packets,
+                    std::size_t count);
+  // Feeds a new measurement of `worker`'s load to its LoadShedder
+  void measure_load(Worker &worker, double queue_fill, uint64_t latency_ns);
+  // False if load shedding skips the flow `flow_hash`; otherwise sets
+  // `packet.sample_rate`
+  bool sample(Worker &worker, uint64_t flow_hash, PacketRef &packet);
+  void join();
+
+  // A single shared source, or one per worker
+  std::vector<Sniffer *> m_sniffers;
+  bool m_shared_capture;
+  Config m_config;
+  Handler m_handler;
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::thread m_capture;
+
+  std::atomic<bool> m_running{false};
+  // Set once the capture thread has queued its last packet
+  std::atomic<bool> m_capture_done{false};
+  // Direct mode: workers whose Sniffer has not run dry yet
+  std::atomic<std::size_t> m_active{0};
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief A view over one raw packet that decodes each layer the first time
+ * it is asked for.
+ *
+ * Where Decoder::decode() parses every layer it knows up front, a
+ * LazyPacket parses nothing until an accessor is called, then only the
+ * layer asked for (plus the EtherType or IP protocol byte that says whether
+ * it is there) and keeps the result in inline storage. A filter that
+ * rejects on an IP address never pays for the TCP header:
+ *
+ *   LazyPacket pkt(ref);
+ *   if (const IPv4Header *ip = pkt.ipv4(); ip && ip->ttl < 2) {
+ *     if (const TCPHeader *tcp = pkt.tcp()) { ... }
+ *   }
+ *
+ * Layers are found exactly as the Decoder finds them (same trimming of
+ * padding, same handling of fragments), so both views of a packet agree.
+ *
+ * Accessors memoize into the object, so they are non-const; use one
+ * LazyPacket per thread. It holds a view of the bytes, which must outlive
+ * it. It never allocates.
+ *
+ * LayerSpyEngine does not use it: its handler is given a LayerStack, so a
+ * kept packet is decoded in full anyway, and PacketFilter, which does look
+ * at packets before decoding, finds layers lazily with a cursor of its own
+ * that mirrors its kernel program. It is meant for code that sees raw
+ * packets, such as a Sniffer callback.
+ */
+class LazyPacket {
+public:
+  explicit LazyPacket(std::string_view data, uint64_t timestamp_ns = 0)
+      : m_data(data), m_timestamp_ns(timestamp_ns) {}
+  explicit LazyPacket(const PacketRef &packet)
+      : LazyPacket(packet.data, packet.timestamp_ns) {}
+
+  std::string_view data() const { return m_data; }
+  uint64_t timestamp_ns() const { return m_timestamp_ns; }
+
+  // EtherType, read without decoding the rest of the Ethernet header;
+  // 0 if the frame is too short.
+  uint16_t eth_type() const;
+
+  // Decoded headers, or nullptr if the packet does not carry the layer.
+  const EthernetHeader *ethernet() {
+    return decoded(LayerKind::Ethernet)
+               ? present_or_null(LayerKind::Ethernet, m_ethernet)
+               : decode_ethernet();
+  }
+  const IPv4Header *ipv4() {
+    return decoded(LayerKind::IPv4) ? present_or_null(LayerKind::IPv4, m_ipv4)
+                                    : decode_ipv4();
+  }
+  const IPv6Header *ipv6() {
+    return decoded(LayerKind::IPv6) ? present_or_null(LayerKind::IPv6, m_ipv6)
+                                    : decode_ipv6();
+  }
+  const TCPHeader *tcp() {
+    return decoded(LayerKind::TCP) ? present_or_null(LayerKind::TCP, m_tcp)
+                                   : decode_tcp();
+  }
+
+  // True once the layer has been looked for (found or not)
+  bool decoded(LayerKind kind) const { return (m_decoded & bit(kind)) != 0; }
+
+  // Position of a layer in the packet, or nullptr if absent. Decodes the
+  // layer first if needed.
+  const LayerEntry *entry(LayerKind kind);
+
+  // Bytes after the innermost header the Decoder would find; decodes every
+  // layer to get there.
+  std::string_view payload();
+
+private:
+  static uint8_t bit(LayerKind kind) {
+    return static_cast<uint8_t>(1u << static_cast<unsigned>(kind));
+  }
+  bool present(LayerKind kind) const { return (m_present & bit(kind)) != 0; }
+  template <typename Header>
+  const Header *present_or_null(LayerKind kind, const Header &header) const {
+    return present(kind) ? &header : nullptr;
+  }
+
+  const EthernetHeader *decode_ethernet();
+  const IPv4Header *decode_ipv4();
+  const IPv6Header *decode_ipv6();
+  const TCPHeader *decode_tcp();
+  // Records a layer found at [offset, offset + length).
+  void found(LayerKind kind, std::size_t offset, std::size_t header_length,
+             std::size_t length);
+
+  std::string_view m_data;
+  uint64_t m_timestamp_ns;
+  // One bit per LayerKind: looked for / found
+  uint8_t m_decoded = 0;
+  uint8_t m_present = 0;
+
+  LayerEntry m_entries[static_cast<std::size_t>(LayerKind::Count)];
+  EthernetHeader m_ethernet;
+  IPv4Header m_ipv4;
+  IPv6Header m_ipv6;
+  TCPHeader m_tcp;
+};
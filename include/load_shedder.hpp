@@ -0,0 +1,85 @@
+#pragma once
+#include "flow_hash.hpp"
+#include <cstdint>
+
+/**
+ * @brief Decides how many flows to skip when decoding cannot keep up.
+ *
+ * Under full capture every packet is kept. Once a worker's queue fills past
+ * Config::queue_high or packets wait longer than Config::latency_high_ns
+ * before being decoded, the shedder keeps only 1 in `rate()` flows, chosen
+ * by their symmetric_flow_hash(): every packet of a kept flow gets through
+ * and the others are skipped before they cost a copy or a decode, so
+ * per-flow statistics of kept flows stay exact instead of being thinned
+ * out by random drops. The one exception is IP fragments, which hash
+ * without ports: they are kept or shed by their addresses and protocol,
+ * not with the rest of their flow.
+ *
+ * The rate doubles for as long as load stays above a high watermark and
+ * halves again once both queue and latency are below their low watermarks,
+ * at most one step per Config::hold_ns, until it is back to 1. Rates are
+ * powers of two and the flows kept at 1 in 2N are a subset of those kept at
+ * 1 in N, so a kept flow only loses packets when the rate goes up.
+ *
+ * A kept packet stands for about rate() packets; LayerSpyEngine passes the
+ * rate on in PacketRef::sample_rate so counters can scale their estimates.
+ *
+ * Not thread-safe: each worker's shedder is driven by one thread.
+ */
+class LoadShedder {
+public:
+  struct Config {
+    // Share of the worker's queue in use (0 to 1) above which sampling
+    // gets coarser, and below which it may get finer again
+    double queue_high = 0.5;
+    double queue_low = 0.125;
+    // Time packets wait before being decoded, with the same roles
+    uint64_t latency_high_ns = 20ULL * 1000000ULL;
+    uint64_t latency_low_ns = 2ULL * 1000000ULL;
+    // Coarsest sampling, 1 in max_rate flows; a power of two
+    uint32_t max_rate = 256;
+    // Least time between two changes of the rate, so each step can take
+    // effect before the next
+    uint64_t hold_ns = 50ULL * 1000000ULL;
+  };
+
+  /**
+   * @throws std::invalid_argument if a low watermark is not below its high
+   * one, queue watermarks are outside 0 to 1, or max_rate is not a power of
+   * two.
+   */
+  explicit LoadShedder(const Config &config);
+
+  /**
+   * @brief Takes a new measurement of the load and adjusts the rate.
+   * @param queue_fill share of the queue in use, 0 to 1
+   * @param latency_ns how long a packet waits before being decoded
+   * @param now_ns any steadily increasing clock
+   * @return the rate from now on
+   */
+  uint32_t update(double queue_fill, uint64_t latency_ns, uint64_t now_ns);
+
+  // Sampling 1 in rate() flows; 1 under full capture
+  uint32_t rate() const { return m_rate; }
+
+  // True if the flow with this symmetric_flow_hash() is kept at rate().
+  bool keep(uint64_t flow_hash) const { return kept(flow_hash, m_rate); }
+
+  // True if the flow with this hash is kept when sampling 1 in `rate`.
+  static bool kept(uint64_t flow_hash, uint32_t rate) {
+    // Re-mixed so the choice does not line up with the flow hash modulo
+    // the worker count, which picks the worker.
+    return (mix64(flow_hash ^ SALT) & (rate - 1)) == 0;
+  }
+
+  // Times the rate went up or down
+  uint64_t changes() const { return m_changes; }
+
+private:
+  inline static constexpr uint64_t SALT = 0x5851f42d4c957f2dULL;
+
+  Config m_config;
+  uint32_t m_rate = 1;
+  uint64_t m_changed_ns = 0;
+  uint64_t m_changes = 0;
+};
@@ -0,0 +1,316 @@
+#pragma once
+#include "relaxed_counter.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Set by CMake's LAYERSPY_INSTRUMENTATION option. When 0, every hook below
+// (StageTimer, StageClock, count_*) compiles to nothing.
+#ifndef LAYERSPY_INSTRUMENTATION
+#define LAYERSPY_INSTRUMENTATION 0
+#endif
+
+inline constexpr bool METRICS_ENABLED = LAYERSPY_INSTRUMENTATION != 0;
+
+/**
+ * @brief The steps a packet goes through, each measured on its own.
+ */
+enum class Stage : uint8_t {
+  Capture,  // capture thread: hashing and queueing for a worker
+  Filter,   // LayerSpyEngine::Config::filter and classifier
+  Ethernet, // the built-in parsers
+  IPv4,
+  IPv6,
+  TCP,
+  Plugin,   // parsers added to a ProtocolRegistry
+  Checksum, // LayerSpyEngine::Config::verify_checksums
+  Output,   // the LayerSpyEngine handler
+  Count
+};
+
+inline constexpr std::size_t STAGE_COUNT =
+    static_cast<std::size_t>(Stage::Count);
+
+// Lower-case name, as used for the `stage` label
+const char *stage_name(Stage stage);
+
+// A cycle counter for timing short stretches of code: the TSC on x86,
+// nanoseconds elsewhere.
+inline uint64_t cycle_count() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/**
+ * @brief Log-bucketed histogram in the style of HdrHistogram.
+ *
+ * Values below 8 have a bucket each; above that every power of two is
+ * split into 8 buckets, so a value is known to within 12.5% from 1 cycle
+ * to 2^40 cycles (larger values share the last bucket) in 304 counters.
+ */
+class LatencyHistogram {
+public:
+  inline static constexpr unsigned SUB_BUCKET_BITS = 3;
+  inline static constexpr unsigned MAX_EXPONENT = 40;
+  inline static constexpr std::size_t BUCKETS =
+      (MAX_EXPONENT - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  static std::size_t bucket_of(uint64_t value) {
+    constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+    if (value < SUB_BUCKETS) {
+      return static_cast<std::size_t>(value);
+    }
+    if (value >= uint64_t{1} << MAX_EXPONENT) {
+      return BUCKETS - 1;
+    }
+    const unsigned exponent =
+        63U - static_cast<unsigned>(__builtin_clzll(value));
+    const unsigned shift = exponent - SUB_BUCKET_BITS;
+    return (static_cast<std::size_t>(shift + 1) << SUB_BUCKET_BITS) +
+           static_cast<std::size_t>((value >> shift) - SUB_BUCKETS);
+  }
+
+  // The largest value that falls in `bucket`
+  static uint64_t bucket_limit(std::size_t bucket);
+
+  void record(uint64_t value) { add(bucket_of(value), 1, value); }
+  void add(std::size_t bucket, uint64_t count, uint64_t sum) {
+    m_buckets[bucket] += count;
+    m_count += count;
+    m_sum += sum;
+  }
+  void merge(const LatencyHistogram &other);
+
+  // Upper limit of the bucket holding the `quantile` (0 to 1) value; 0 if
+  // the histogram is empty.
+  uint64_t percentile(double quantile) const;
+
+  uint64_t count() const { return m_count; }
+  uint64_t sum() const { return m_sum; }
+  uint64_t bucket(std::size_t index) const { return m_buckets[index]; }
+
+private:
+  std::array<uint64_t, BUCKETS> m_buckets{};
+  uint64_t m_count = 0;
+  uint64_t m_sum = 0;
+};
+
+/**
+ * @brief Totals of one stage, over all threads.
+ */
+struct StageMetrics {
+  uint64_t packets = 0;   // packets that went through the stage
+  uint64_t malformed = 0; // parsers: header truncated or invalid
+  // Capture: worker ring full. Filter: rejected.
+  uint64_t dropped = 0;
+  LatencyHistogram latency; // cycles per packet
+};
+
+struct MetricsSnapshot {
+  std::array<StageMetrics, STAGE_COUNT> stages;
+
+  const StageMetrics &operator[](Stage stage) const {
+    return stages[static_cast<std::size_t>(stage)];
+  }
+  StageMetrics &operator[](Stage stage) {
+    return stages[static_cast<std::size_t>(stage)];
+  }
+};
+
+/**
+ * @brief The counters of one thread.
+ *
+ * Each thread only writes its own block, so the hot path is a few plain
+ * loads and stores: the atomics are only there so collect_metrics() may
+ * read them from another thread, and use relaxed load/store pairs rather
+ * than locked read-modify-writes. A thread's counts are folded into a
+ * shared total when it exits.
+ */
+class ThreadMetrics {
+public:
+  // This thread's block, created on first use
+  static ThreadMetrics &local() {
+    thread_local Registration registration;
+    return *registration.metrics;
+  }
+
+  void record(Stage stage, uint64_t cycles) {
+    Cell &cell = m_cells[static_cast<std::size_t>(stage)];
+    bump(cell.packets, 1);
+    bump(cell.sum, cycles);
+    bump(cell.buckets[LatencyHistogram::bucket_of(cycles)], 1);
+  }
+  void count_packets(Stage stage, uint64_t count) {
+    bump(m_cells[static_cast<std::size_t>(stage)].packets, count);
+  }
+  void count_malformed(Stage stage) {
+    bump(m_cells[static_cast<std::size_t>(stage)].malformed, 1);
+  }
+  void count_dropped(Stage stage) {
+    bump(m_cells[static_cast<std::size_t>(stage)].dropped, 1);
+  }
+
+  // Adds this thread's counts to `snapshot`.
+  void add_to(MetricsSnapshot &snapshot) const;
+
+private:
+  struct Cell {
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> malformed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> sum{0};
+    std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> buckets{};
+  };
+
+  // Registers the block for collect_metrics() and retires it on exit.
+  struct Registration {
+    Registration();
+    ~Registration();
+    ThreadMetrics *metrics;
+  };
+
+  std::array<Cell, STAGE_COUNT> m_cells;
+};
+
+// --- Hooks ---
+// Free when LAYERSPY_INSTRUMENTATION is off.
+
+/**
+ * @brief Counts a packet through `stage` and records the cycles from its
+ * construction to its destruction.
+ */
+class StageTimer {
+public:
+#if LAYERSPY_INSTRUMENTATION
+  explicit StageTimer(Stage stage) : m_stage(stage), m_start(cycle_count()) {}
+  ~StageTimer() {
+    ThreadMetrics::local().record(m_stage, cycle_count() - m_start);
+  }
+
+private:
+  Stage m_stage;
+  uint64_t m_start;
+#else
+  explicit StageTimer(Stage) {}
+#endif
+
+public:
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+};
+
+/**
+ * @brief Times consecutive stages with one cycle count between each, for
+ * code that goes through several in a row (the decoder's layers).
+ *
+ * lap() records the cycles since the previous lap, or since construction,
+ * against `stage`.
+ */
+class StageClock {
+public:
+#if LAYERSPY_INSTRUMENTATION
+  StageClock() : m_metrics(ThreadMetrics::local()), m_last(cycle_count()) {}
+  void lap(Stage stage) {
+    const uint64_t now = cycle_count();
+    m_metrics.record(stage, now - m_last);
+    m_last = now;
+  }
+
+private:
+  ThreadMetrics &m_metrics;
+  uint64_t m_last;
+#else
+  StageClock() = default;
+  void lap(Stage) {}
+#endif
+
+public:
+  StageClock(const StageClock &) = delete;
+  StageClock &operator=(const StageClock &) = delete;
+};
+
+// Counts packets through a stage that is not timed.
+inline void count_packets([[maybe_unused]] Stage stage,
+                          [[maybe_unused]] uint64_t count) {
+#if LAYERSPY_INSTRUMENTATION
+  ThreadMetrics::local().count_packets(stage, count);
+#endif
+}
+
+inline void count_malformed([[maybe_unused]] Stage stage) {
+#if LAYERSPY_INSTRUMENTATION
+  ThreadMetrics::local().count_malformed(stage);
+#endif
+}
+
+inline void count_dropped([[maybe_unused]] Stage stage) {
+#if LAYERSPY_INSTRUMENTATION
+  ThreadMetrics::local().count_dropped(stage);
+#endif
+}
+
+// --- Export ---
+
+// Sums the counters of every thread, live or exited.
+MetricsSnapshot collect_metrics();
+
+/**
+ * @brief Writes `snapshot` in the Prometheus text exposition format.
+ *
+ * Counters are layerspy_stage_{packets,malformed,dropped}_total and the
+ * latency is the histogram layerspy_stage_latency_cycles, all labelled by
+ * `stage`. Histogram buckets are exported per power of two (`le` is
+ * 2^k - 1), which the in-memory buckets resolve exactly.
+ */
+void write_prometheus(std::ostream &out, const MetricsSnapshot &snapshot);
+
+/**
+ * @brief Rewrites a Prometheus text file with collect_metrics() every
+ * `interval`, e.g. for node_exporter's textfile collector.
+ *
+ * Each write goes to `<path>.tmp` first and is renamed over `path`, so
+ * readers never see half a file. Runs a thread of its own, and writes a
+ * last time when destroyed.
+ */
+class MetricsFileWriter {
+public:
+  /**
+   * @brief Writes the file once and starts the thread.
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  MetricsFileWriter(std::string path, std::chrono::milliseconds interval);
+  ~MetricsFileWriter();
+
+  MetricsFileWriter(const MetricsFileWriter &) = delete;
+  MetricsFileWriter &operator=(const MetricsFileWriter &) = delete;
+
+  // Writes in the background that failed (e.g. the disk is full)
+  uint64_t failures() const { return m_failures.load(); }
+
+private:
+  bool write() const;
+  void run();
+
+  std::string m_path;
+  std::chrono::milliseconds m_interval;
+  std::atomic<uint64_t> m_failures{0};
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop = false;
+  std::thread m_thread;
+};
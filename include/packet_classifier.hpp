@@ -0,0 +1,99 @@
+#pragma once
+#include "packet_ref.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Batch pre-classifier that runs on raw frames before any decoding.
+ *
+ * For every frame it looks at the EtherType, IP version/IHL, IP protocol
+ * (or IPv6 next header) and the L4 ports, and writes a one-byte tag. The
+ * caller can then drop or just count uninteresting traffic without building
+ * a LayerStack or a protocol tree for it.
+ *
+ * It is a plain scalar loop, with no SIMD kernels. Two kinds were tried
+ * and both lost to it on every frame mix measured:
+ * - Kernels that gathered each frame's fields into lanes. The gathering
+ *   cost more than the lane-parallel checks saved.
+ * - Kernels that loaded one 16-byte window per frame and checked it with
+ *   byte compares. That costs more than the loop's handful of byte
+ *   compares, and the ports and lengths are still checked one frame at
+ *   a time.
+ *
+ * Only the first few header bytes are inspected: IPv6 extension headers are
+ * not walked, so e.g. TCP behind a hop-by-hop header is tagged as "other".
+ *
+ * LayerSpyEngine runs it, given Config::classifier, on each batch a worker
+ * drains, and drops the packets it does not want before decoding them.
+ */
+class PacketClassifier {
+public:
+  using Tag = uint8_t;
+
+  // --- Tag layout ---
+  // Bits 0-1: network layer (by EtherType)
+  inline static constexpr Tag L3_MASK = 0x03;
+  // Non-IP frame, or nothing after the Ethernet header
+  inline static constexpr Tag L3_NONE = 0x00;
+  inline static constexpr Tag L3_IPV4 = 0x01;
+  inline static constexpr Tag L3_IPV6 = 0x02;
+  // Transport protocol
+  inline static constexpr Tag TCP = 0x04;
+  inline static constexpr Tag UDP = 0x08;
+  // IPv4 fragment (MF set or non-zero offset)
+  inline static constexpr Tag FRAGMENT = 0x10;
+  // Headers are malformed or run past the end of the frame
+  inline static constexpr Tag TRUNCATED = 0x20;
+  // Source or destination port is in the monitored set
+  inline static constexpr Tag MONITORED = 0x40;
+
+  // --- Monitored ports ---
+  void monitorPort(uint16_t port);
+  void unmonitorPort(uint16_t port);
+  bool isMonitored(uint16_t port) const {
+    return (m_port_bitmap[port >> 5] >> (port & 31)) & 1U;
+  }
+
+  /**
+   * @brief Writes one tag per packet into `tags[0..count)`.
+   */
+  void classify(const PacketRef *packets, std::size_t count, Tag *tags) const;
+
+  /**
+   * @brief Writes the indices of packets whose tag has every bit of `mask`
+   * set into `indices` (which must hold `count` entries).
+   * @return The number of indices written.
+   */
+  static std::size_t select(const Tag *tags, std::size_t count, Tag mask,
+                            uint32_t *indices);
+
+private:
+  // One bit per port, 8 KiB
+  std::array<uint32_t, 65536 / 32> m_port_bitmap{};
+};
+
+/**
+ * @brief Per-tag packet counters, for traffic that is classified but never
+ * decoded.
+ */
+struct ClassCounters {
+  std::array<uint64_t, 256> packets{};
+
+  void add(const PacketClassifier::Tag *tags, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      ++packets[tags[i]];
+    }
+  }
+
+  // Sum over every tag that has all bits of `mask` set.
+  uint64_t matching(PacketClassifier::Tag mask) const {
+    uint64_t total = 0;
+    for (std::size_t tag = 0; tag < packets.size(); ++tag) {
+      if ((tag & mask) == mask) {
+        total += packets[tag];
+      }
+    }
+    return total;
+  }
+};
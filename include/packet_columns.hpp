@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Struct-of-arrays output of Decoder::decodeBatch().
+ *
+ * Row `i` of every column describes packet `i` of the batch. Fields a packet
+ * does not carry are zero; `layers` tells which ones are meaningful. Keeping
+ * one column per field lets aggregations run as flat loops the compiler can
+ * vectorize. Columns keep their capacity between batches, so a reused
+ * PacketColumns stops allocating once it has seen its largest batch.
+ */
+struct PacketColumns {
+  // Bits of `layers`, one per decoded layer
+  inline static constexpr uint8_t HAS_ETHERNET = 0x01;
+  inline static constexpr uint8_t HAS_IPV4 = 0x02;
+  inline static constexpr uint8_t HAS_IPV6 = 0x04;
+  inline static constexpr uint8_t HAS_TCP = 0x08;
+
+  using Ipv6Lane = std::array<uint8_t, 16>;
+
+  std::vector<uint8_t> layers;
+
+  std::vector<uint64_t> timestamp_ns;
+  std::vector<uint16_t> eth_type;
+
+  // IPv4 addresses in host byte order
+  std::vector<uint32_t> src_ipv4;
+  std::vector<uint32_t> dst_ipv4;
+
+  // IPv6 addresses as raw 16-byte lanes (network byte order)
+  std::vector<Ipv6Lane> src_ipv6;
+  std::vector<Ipv6Lane> dst_ipv6;
+
+  // IPv4 protocol / IPv6 next header, and TTL / hop limit
+  std::vector<uint8_t> ip_protocol;
+  std::vector<uint8_t> ttl;
+
+  // TCP or UDP ports; zero in later fragments of a datagram
+  std::vector<uint16_t> src_port;
+  std::vector<uint16_t> dst_port;
+  std::vector<uint8_t> tcp_flags; // TCPHeader::flags() bitmask
+
+  // Bytes following the innermost decoded header
+  std::vector<uint32_t> payload_offset;
+  std::vector<uint32_t> payload_length;
+
+  std::size_t size() const { return layers.size(); }
+
+  // Sets every column to `rows` zeroed entries.
+  void reset(std::size_t rows);
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "packet_ref.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief One classic BPF instruction.
+ *
+ * Same layout as Linux's `struct sock_filter` and libpcap's
+ * `struct bpf_insn`, so a program can be handed to either unchanged.
+ */
+struct BpfInstruction {
+  uint16_t code;
+  uint8_t jt;
+  uint8_t jf;
+  uint32_t k;
+};
+
+/**
+ * @brief A display/capture filter compiled to bytecode that runs on raw
+ * frames, before the Decoder builds anything.
+ *
+ * The language is a small subset of Wireshark's display filters:
+ *
+ *   ip.src in 10.0.0.0/8 && tcp.dst_port == 80 && tcp.flags.syn
+ *   ipv6.addr == 2001:db8::1 || !(tcp.port == 22)
+ *
+ * - `&&`/`and`, `||`/`or`, `!`/`not` and parentheses, with the usual
+ *   precedence (not, then and, then or).
+ * - `field <op> value` with `==`, `!=`, `<`, `<=`, `>`, `>=`; values are
+ *   decimal or 0x-prefixed hex numbers, or addresses for address fields.
+ * - `field in address/prefix` (or `==` with a prefix) for address fields.
+ * - A bare protocol (`tcp`) is true if the packet carries that layer; a bare
+ *   field (`tcp.flags.syn`) is true if it is present and non-zero.
+ * - `ip.addr`, `ipv6.addr` and `tcp.port` match either direction; with `!=`
+ *   they match when neither side equals the value.
+ *
+ * A comparison on a layer the packet does not carry is false. Layers are
+ * found as the Decoder finds them (same padding trimming, TCP past IPv6
+ * extension headers, and only in the first fragment), so a filter agrees
+ * with decode-then-check.
+ *
+ * The same expression is also compiled to a classic BPF program that a
+ * capture socket can run in the kernel (see Sniffer::set_filter()), so
+ * unwanted packets never reach userspace. Classic BPF limits jumps to 255
+ * instructions; if the whole expression does not fit, only the top-level
+ * `&&` terms that do are pushed down, and the kernel then passes a superset
+ * of the matching packets.
+ */
+class PacketFilter {
+public:
+  // Matches every packet.
+  PacketFilter() = default;
+
+  /**
+   * @brief Compiles `expression`; an empty one matches every packet.
+   * @throws std::invalid_argument if the expression is malformed, with the
+   * offending offset in the message.
+   */
+  explicit PacketFilter(std::string_view expression);
+
+  // True if `packet` (a raw Ethernet frame) passes the filter.
+  bool matches(std::string_view packet) const;
+  bool matches(const PacketRef &packet) const { return matches(packet.data); }
+
+  const std::string &expression() const { return m_expression; }
+  bool empty() const { return m_code.empty(); }
+
+  /**
+   * @brief The part of the filter the kernel can run, as classic BPF.
+   *
+   * Accepts a packet by returning 0xFFFFFFFF (keep it all) and rejects it by
+   * returning 0. Empty if nothing could be pushed down.
+   */
+  const std::vector<BpfInstruction> &kernel_program() const {
+    return m_kernel;
+  }
+
+  // True if kernel_program() implements the whole expression.
+  bool kernel_exact() const { return m_kernel_exact; }
+
+private:
+  struct Instruction {
+    uint8_t op;    // comparison, see packet_filter.cpp
+    uint8_t field; // index into the field table
+    // Next instruction if the comparison is true / false; size() and
+    // size() + 1 mean accept and reject.
+    uint16_t jt;
+    uint16_t jf;
+    uint32_t value;
+    uint32_t mask;
+  };
+
+  // An IPv6 prefix an `in` comparison refers to (through Instruction::value)
+  struct Ipv6Prefix {
+    std::array<uint8_t, 16> bytes;
+    uint8_t length;
+  };
+
+  friend class FilterCompiler;
+
+  std::string m_expression;
+  std::vector<Instruction> m_code;
+  std::vector<Ipv6Prefix> m_prefixes;
+  std::vector<BpfInstruction> m_kernel;
+  bool m_kernel_exact = true;
+};
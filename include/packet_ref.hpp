@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief A captured packet as handed to the Decoder: a view of its bytes plus
+ * the capture timestamp and whatever the capture source knows about it.
+ *
+ * Like `raw_payload`, `data` is a view — it must not outlive the capture
+ * buffer it points into.
+ */
+struct PacketRef {
+  std::string_view data;
+  uint64_t timestamp_ns = 0; // Capture time, nanoseconds since the epoch
+  uint32_t flags = 0;        // What the capture source knows, see below
+  // Load shedding kept only 1 in this many flows (see LoadShedder), so the
+  // packet stands for about this many; a power of two, 1 under full capture
+  uint32_t sample_rate = 1;
+
+  // --- Flags ---
+  // The NIC or kernel already verified the TCP/UDP checksum.
+  inline static constexpr uint32_t CHECKSUM_VALID = 0x1;
+  // Sent with checksum offload: the TCP/UDP checksum is filled in later by
+  // the NIC, so the captured one is meaningless.
+  inline static constexpr uint32_t CHECKSUM_PARTIAL = 0x2;
+};
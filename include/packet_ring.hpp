@@ -0,0 +1,193 @@
+#pragma once
+#include "packet_ref.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+/**
+ * @brief Bounded lock-free packet queue for exactly one producer thread and
+ * one consumer thread.
+ *
+ * Packets of any length are copied back to back into one byte buffer, so a
+ * jumbo or GRO-merged frame costs no more slots than a runt, and nothing is
+ * allocated after construction. The consumer reads packets in place: the
+ * views passed to drain()'s callback point into the ring and stay valid
+ * until the callback returns.
+ *
+ * Each side keeps a private copy of the other side's position and only
+ * reloads the shared one when that copy says the ring is full (or empty), so
+ * in the common case the two threads do not touch each other's cache lines.
+ */
+class PacketRing {
+public:
+  // `bytes` is rounded up to a power of two, at least two records.
+  explicit PacketRing(std::size_t bytes)
+      : m_mask(round_up(bytes) - 1),
+        m_buffer(std::make_unique<Record[]>((m_mask + 1) / sizeof(Record))) {}
+
+  PacketRing(const PacketRing &) = delete;
+  PacketRing &operator=(const PacketRing &) = delete;
+
+  std::size_t capacity() const { return m_mask + 1; }
+
+  // Longest packet push() accepts. A packet never straddles the end of the
+  // buffer, so a longer one would not fit at every position even in an
+  // empty ring.
+  std::size_t max_packet() const {
+    return capacity() / 2 - sizeof(Record);
+  }
+
+  // Bytes currently queued, including per-packet overhead.
+  std::size_t used() const {
+    return m_tail.value.load(std::memory_order_acquire) -
+           m_head.value.load(std::memory_order_acquire);
+  }
+
+  // --- Producer side ---
+
+  // Copies `packet` into the ring. False if there is not enough room, and
+  // always for packets longer than max_packet(). `packet.sample_rate` must
+  // be a power of two.
+  bool push(const PacketRef &packet) {
+    assert(packet.sample_rate != 0 &&
+           (packet.sample_rate & (packet.sample_rate - 1)) == 0);
+    if (packet.data.length() > max_packet()) {
+      return false;
+    }
+    const std::size_t need = record_size(packet.data.length());
+    std::size_t tail = m_tail.value.load(std::memory_order_relaxed);
+    const std::size_t contiguous = capacity() - (tail & m_mask);
+    // A packet never straddles the end of the buffer: the rest of it is
+    // skipped with a wrap marker instead.
+    const std::size_t total = need <= contiguous ? need : contiguous + need;
+
+    if (capacity() - (tail - m_tail.cached) < total) {
+      m_tail.cached = m_head.value.load(std::memory_order_acquire);
+      if (capacity() - (tail - m_tail.cached) < total) {
+        return false;
+      }
+    }
+
+    if (need > contiguous) {
+      at(tail).length = WRAP;
+      tail += contiguous;
+    }
+    Record &record = at(tail);
+    record.timestamp_ns = packet.timestamp_ns;
+    record.length = static_cast<uint32_t>(packet.data.length());
+    record.flags =
+        packet.flags |
+        static_cast<uint32_t>(__builtin_ctz(packet.sample_rate)) << RATE_SHIFT;
+    std::memcpy(&record + 1, packet.data.data(), packet.data.length());
+
+    m_tail.value.store(tail + need, std::memory_order_release);
+    return true;
+  }
+
+  // --- Consumer side ---
+
+  /**
+   * @brief Calls `fn(const PacketRef &)` for up to `max_packets` queued
+   * packets, oldest first, then hands their space back to the producer.
+   * @return The number of packets passed to `fn`.
+   */
+  template <typename Fn> std::size_t drain(std::size_t max_packets, Fn &&fn) {
+    std::size_t head = m_head.value.load(std::memory_order_relaxed);
+    const std::size_t count = read(head, max_packets, fn);
+    m_head.value.store(head, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * @brief Like drain(), but views up to `max_packets` packets at once:
+   * fills `packets` and calls `fn(const PacketRef *, std::size_t)` once
+   * (unless the ring is empty). The views stay valid until `fn` returns.
+   * @return The number of packets passed to `fn`.
+   */
+  template <typename Fn>
+  std::size_t drain_batch(PacketRef *packets, std::size_t max_packets,
+                          Fn &&fn) {
+    std::size_t head = m_head.value.load(std::memory_order_relaxed);
+    std::size_t count = 0;
+    read(head, max_packets,
+         [&](const PacketRef &packet) { packets[count++] = packet; });
+    if (count != 0) {
+      fn(static_cast<const PacketRef *>(packets), count);
+    }
+    m_head.value.store(head, std::memory_order_release);
+    return count;
+  }
+
+private:
+  // Passes up to `max_packets` packets from `head` on to `fn`, moving
+  // `head` past them without handing their space back.
+  template <typename Fn>
+  std::size_t read(std::size_t &head, std::size_t max_packets, Fn &&fn) {
+    std::size_t count = 0;
+    while (count < max_packets) {
+      if (head == m_head.cached) {
+        m_head.cached = m_tail.value.load(std::memory_order_acquire);
+        if (head == m_head.cached) {
+          break;
+        }
+      }
+      const Record &record = at(head);
+      if (record.length == WRAP) {
+        head += capacity() - (head & m_mask);
+        continue;
+      }
+      fn(PacketRef{
+          std::string_view(reinterpret_cast<const char *>(&record + 1),
+                           record.length),
+          record.timestamp_ns, record.flags & FLAGS_MASK,
+          uint32_t{1} << (record.flags >> RATE_SHIFT)});
+      head += record_size(record.length);
+      ++count;
+    }
+    return count;
+  }
+
+  // Per-packet header; also the unit of alignment inside the buffer.
+  struct Record {
+    uint64_t timestamp_ns;
+    uint32_t length;
+    // PacketRef::flags, with log2 of PacketRef::sample_rate in the top byte
+    uint32_t flags;
+  };
+  inline static constexpr uint32_t WRAP = UINT32_MAX;
+  inline static constexpr unsigned RATE_SHIFT = 24;
+  inline static constexpr uint32_t FLAGS_MASK = (1U << RATE_SHIFT) - 1;
+
+  static std::size_t record_size(std::size_t length) {
+    return sizeof(Record) +
+           (length + sizeof(Record) - 1) / sizeof(Record) * sizeof(Record);
+  }
+
+  static std::size_t round_up(std::size_t bytes) {
+    std::size_t size = 2 * sizeof(Record);
+    while (size < bytes) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  Record &at(std::size_t position) {
+    return m_buffer[(position & m_mask) / sizeof(Record)];
+  }
+
+  // A position plus the owner's cached copy of the other side's position,
+  // alone on its cache line.
+  struct alignas(64) Position {
+    std::atomic<std::size_t> value{0};
+    std::size_t cached = 0;
+  };
+
+  const std::size_t m_mask;
+  std::unique_ptr<Record[]> m_buffer;
+
+  Position m_head; // advanced by the consumer
+  Position m_tail; // advanced by the producer
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include "capture_file.hpp"
+#include "flow_key.hpp"
+#include "flow_tracker.hpp"
+#include "layer_stack.hpp"
+#include "packet_filter.hpp"
+#include "packet_ref.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Decodes one capture file on several threads.
+ *
+ * The file is cut into record-aligned chunks of about Config::chunk_bytes
+ * (CaptureFileReader::split()). Threads take chunks in file order from a
+ * shared counter, each with its own mapping of the file, Decoder and
+ * LayerStack, and decode them where they lie in the mapping. Chunks are
+ * much smaller than a thread's share of the file, so threads that draw
+ * slow chunks are evened out by the others.
+ *
+ * The handler is told which chunk a packet came from. Chunk boundaries
+ * depend only on the file and chunk_bytes, so results kept per chunk and
+ * merged in chunk order come out the same for any number of threads.
+ */
+class ParallelCaptureReader {
+public:
+  struct Config {
+    std::size_t threads = 1;
+    std::size_t chunk_bytes = 32 * 1024 * 1024;
+    // Packets it rejects are counted and never decoded. Must outlive the
+    // reader.
+    const PacketFilter *filter = nullptr;
+  };
+
+  /**
+   * @brief Called on a worker thread for every packet that passed the
+   * filter, in file order within a chunk.
+   *
+   * Calls with the same `thread` (0 .. threads - 1) never overlap. `stack`
+   * is empty if the packet was malformed; both are only valid during the
+   * call.
+   */
+  using Handler =
+      std::function<void(std::size_t thread, std::size_t chunk,
+                         const PacketRef &packet, const LayerStack &stack)>;
+
+  // Called on a worker thread once it has handled every packet of `chunk`.
+  using ChunkDone = std::function<void(std::size_t thread, std::size_t chunk)>;
+
+  struct Stats {
+    uint64_t packets = 0; // read from the file
+    uint64_t bytes = 0;   // captured bytes of those packets
+    uint64_t decoded = 0;
+    uint64_t malformed = 0;
+    uint64_t filtered = 0;
+  };
+
+  /**
+   * @brief Maps `path` and cuts it into chunks.
+   * @throws std::invalid_argument if threads or chunk_bytes is 0.
+   * @throws std::runtime_error if the file cannot be read.
+   */
+  ParallelCaptureReader(const std::string &path, const Config &config);
+
+  const std::vector<CaptureFileReader::Chunk> &chunks() const {
+    return m_chunks;
+  }
+  const CaptureFileReader &reader() const { return m_reader; }
+
+  /**
+   * @brief Reads every chunk on Config::threads threads and returns once
+   * all are done. If a callback throws, the other threads stop after their
+   * current chunk and the first exception is rethrown here.
+   */
+  void run(const Handler &handler, const ChunkDone &done = {});
+
+  // Totals of the last run()
+  const Stats &stats() const { return m_stats; }
+
+private:
+  std::string m_path;
+  Config m_config;
+  CaptureFileReader m_reader;
+  std::vector<CaptureFileReader::Chunk> m_chunks;
+  Stats m_stats;
+};
+
+/**
+ * @brief Counters and exact per-flow statistics of a whole capture.
+ *
+ * Merging adds counters and combines the statistics of flows seen in both
+ * parts (first_seen_ns is the earliest, last_seen_ns the latest), and
+ * flows are kept sorted by key, so a summary does not depend on how the
+ * file was cut up or in which order the parts were merged.
+ */
+struct CaptureSummary {
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t malformed = 0;
+  uint64_t ipv4 = 0;
+  uint64_t ipv6 = 0;
+  uint64_t tcp = 0;
+  uint64_t udp = 0;
+  // Canonical flow keys (FlowKey::canonical()), sorted
+  std::vector<std::pair<FlowKey, FlowStats>> flows;
+
+  void merge(const CaptureSummary &other);
+
+  // The `n` flows with the most bytes, busiest first (ties by key)
+  std::vector<std::pair<FlowKey, FlowStats>> top_flows(std::size_t n) const;
+};
+
+/**
+ * @brief Summarizes `path` with a ParallelCaptureReader.
+ *
+ * Each thread accounts flows in a FlowTable of its own; flows it has to
+ * evict when full, and at the end all the others, go to that thread's
+ * summary, and the thread summaries are merged. Since merging does not
+ * depend on order, the result is the same for any number of threads.
+ */
+CaptureSummary summarize_capture(const std::string &path,
+                                 const ParallelCaptureReader::Config &config,
+                                 ParallelCaptureReader::Stats *stats = nullptr);
@@ -0,0 +1,147 @@
+#pragma once
+#include "layer_stack.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief The table the Decoder looks the next layer up in.
+ */
+enum class Dispatch : uint8_t {
+  None,       // nothing follows; decoding stops
+  EtherType,  // keyed on the Ethernet type, e.g. 0x0800
+  IpProtocol, // keyed on the IPv4 protocol / IPv6 upper-layer protocol
+  Port,       // keyed on a transport port
+};
+
+/**
+ * @brief One packet being decoded, handed to each parser in turn.
+ */
+struct DecodeState {
+  std::string_view packet; // the whole frame
+  std::string_view data;   // what is left: this layer and everything after
+  LayerStack &stack;
+  // Where plugin parsers report what they find: the decoding Decoder's
+  // output (see Decoder::set_output()), or nullptr
+  void *output = nullptr;
+
+  // Offset of `data` within the packet, for LayerStack::push()
+  std::size_t offset() const {
+    return static_cast<std::size_t>(data.data() - packet.data());
+  }
+};
+
+/**
+ * @brief Where a parser says decoding goes next.
+ *
+ * For Port dispatch the lower of `key` and `other_key` is tried first, so
+ * the well-known side of a connection wins in either direction.
+ */
+struct NextLayer {
+  Dispatch table = Dispatch::None;
+  uint16_t key = 0;
+  uint16_t other_key = 0; // Port only: the second port to try
+};
+
+/**
+ * @brief Parses one layer.
+ *
+ * Reads its header from the front of `state.data`, may record it in
+ * `state.stack`, removes what it consumed and names the next table. It
+ * must not allocate or throw: it runs for every packet. `context` is the
+ * pointer it was registered with, shared by every Decoder using the
+ * registry, possibly on several threads at once: treat it as read-only
+ * configuration (or synchronise writes to it). Results for the packet go
+ * to `state.output`, which belongs to one Decoder.
+ */
+using ProtocolParser = NextLayer (*)(DecodeState &state, void *context);
+
+/**
+ * @brief Maps EtherTypes, IP protocols and ports to layer parsers.
+ *
+ * Every table is a flat array indexed by the key (256 entries for IP
+ * protocols, 65536 for EtherTypes and ports) holding a one-byte index into
+ * the parser list, so finding the next parser is one load however many
+ * protocols are registered.
+ *
+ * Decoding always starts with Ethernet. The built-in IPv4, IPv6 (walking
+ * its extension headers) and TCP parsers are registered by the
+ * constructor and can be replaced like any other. Plugins register theirs
+ * at startup, in global() or with a static ProtocolRegistration, before
+ * any Decoder runs: lookups take no lock. As LayerKind is fixed, a plugin
+ * parser reports what it finds through `state.output`, and may check
+ * `state.stack` to tell which transport a Port dispatch came from.
+ */
+class ProtocolRegistry {
+public:
+  // Parsers with different (parser, context) pairs one registry can hold
+  inline static constexpr std::size_t MAX_PARSERS = 255;
+  // Layers followed per packet, so a parser consuming nothing cannot loop
+  inline static constexpr std::size_t MAX_DEPTH = 16;
+
+  // A registry holding the built-in parsers.
+  ProtocolRegistry();
+
+  /**
+   * @brief Routes `key` in `table` to `parser`, replacing what was there.
+   * @throws std::invalid_argument if `table` is None, `parser` is null, or
+   * MAX_PARSERS different parsers are already registered.
+   */
+  void add(Dispatch table, uint16_t key, ProtocolParser parser,
+           void *context = nullptr);
+
+  // Unroutes `key` in `table`; decoding then stops there.
+  void remove(Dispatch table, uint16_t key);
+
+  // Whether `key` in `table` has a parser.
+  bool contains(Dispatch table, uint16_t key) const {
+    return slot(table, key) != NONE;
+  }
+
+  /**
+   * @brief Parses Ethernet at the front of `state.data`, then follows the
+   * tables until a parser returns Dispatch::None or a key has no parser.
+   */
+  void decode(DecodeState &state) const;
+
+  /**
+   * @brief The registry Decoders use by default.
+   *
+   * Only modify it before starting threads that decode.
+   */
+  static ProtocolRegistry &global();
+
+private:
+  inline static constexpr uint8_t NONE = 0;
+
+  struct Entry {
+    ProtocolParser parser;
+    void *context;
+  };
+
+  uint8_t slot(Dispatch table, uint16_t key) const;
+  uint8_t *table_for(Dispatch table, uint16_t key);
+
+  std::array<uint8_t, 65536> m_ether_types{};
+  std::array<uint8_t, 256> m_ip_protocols{};
+  std::array<uint8_t, 65536> m_ports{};
+  // Index 0 is NONE; slot i of a table calls m_parsers[i].
+  std::vector<Entry> m_parsers;
+};
+
+/**
+ * @brief Registers a parser in ProtocolRegistry::global() when the program
+ * starts, so a plugin needs no change to the Decoder:
+ *
+ *   static const ProtocolRegistration dns(Dispatch::Port, 53, parse_dns);
+ *
+ * In a static library, make sure the object file is linked in.
+ */
+struct ProtocolRegistration {
+  ProtocolRegistration(Dispatch table, uint16_t key, ProtocolParser parser,
+                       void *context = nullptr) {
+    ProtocolRegistry::global().add(table, key, parser, context);
+  }
+};
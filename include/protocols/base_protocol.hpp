@@ -3,6 +3,28 @@
 #include <string>
 #include <string_view> // The C++17 workhorse
 
+struct BaseProtocol;
+
+/**
+ * @brief Deleter used by LayerPtr.
+ *
+ * Layers built by the Decoder live in a LayerArena and are handed back to it
+ * instead of being freed. A default-constructed deleter falls back to plain
+ * `delete`, so layers created with `new` can still be chained by hand.
+ */
+struct LayerDeleter {
+  void (*release)(void *pool, BaseProtocol *layer) = nullptr;
+  void *pool = nullptr;
+
+  void operator()(BaseProtocol *layer) const;
+};
+
+/**
+ * @brief Owning handle to a parsed layer (and, through `payload`, to every
+ * layer above it).
+ */
+using LayerPtr = std::unique_ptr<BaseProtocol, LayerDeleter>;
+
 /**
  * @brief Base struct for all parsed protocol headers.
  */
@@ -11,7 +33,7 @@ struct BaseProtocol {
   virtual ~BaseProtocol() = default;
 
   // The next layer in the chain (e.g., Ethernet's payload is IPv4)
-  std::unique_ptr<BaseProtocol> payload;
+  LayerPtr payload;
 
   // The raw bytes of the *next* layer, which might be
   // an unparsed protocol or the final application data.
@@ -19,4 +41,12 @@ struct BaseProtocol {
 
   // A helper for the Display component
   virtual std::string get_name() const = 0;
-};
\ No newline at end of file
+};
+
+inline void LayerDeleter::operator()(BaseProtocol *layer) const {
+  if (release != nullptr) {
+    release(pool, layer);
+  } else {
+    delete layer;
+  }
+}
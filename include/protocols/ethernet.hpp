@@ -3,11 +3,15 @@
 #include "types/mac_address.hpp"
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 /**
- * @brief Holds data for an Ethernet II frame.
+ * @brief Plain Ethernet II header fields (no vtable, no payload chain).
+ *
+ * This is what a LayerStack stores inline; the Ethernet tree node below
+ * inherits the same fields.
  */
-struct Ethernet : BaseProtocol {
+struct EthernetHeader {
   MacAddress dest_mac;
   MacAddress source_mac;
   uint16_t eth_type;
@@ -18,5 +22,16 @@ struct Ethernet : BaseProtocol {
   inline static constexpr std::size_t HEADER_SIZE = 14; // 6+6+2
   inline static constexpr std::size_t ETH_TYPE_OFFSET = 12;
 
+  /**
+   * @brief Decodes the header at the start of `data`.
+   * @return Header length in bytes, or 0 if `data` is too short.
+   */
+  std::size_t parse(std::string_view data);
+};
+
+/**
+ * @brief Holds data for an Ethernet II frame.
+ */
+struct Ethernet : BaseProtocol, EthernetHeader {
   std::string get_name() const override { return "Ethernet II"; }
-};
\ No newline at end of file
+};
@@ -1,51 +1,244 @@
 #pragma once
 #include "base_protocol.hpp"
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <map>
 #include <string>
+#include <string_view>
 
 /**
- * @brief Represents parsed HTTP data (request OR response).
+ * @brief Header fields the parser recognises by name while parsing, so
+ * reading them back is a single array lookup.
+ */
+enum class HttpField : uint8_t {
+  Host,
+  ContentLength,
+  TransferEncoding,
+  ContentType,
+  Connection,
+  UserAgent,
+  Accept,
+  AcceptEncoding,
+  Cookie,
+  SetCookie,
+  Location,
+  Server,
+  Count
+};
+
+struct HttpHeaderField {
+  std::string_view name;
+  std::string_view value;
+};
+
+/**
+ * @brief The head (start line and headers) of one HTTP/1.x request or
+ * response.
  *
- * We don't try to model every RFC detail.
- * Goal: something easy to print / log.
+ * Nothing is copied: every field is a view into the bytes the parser was
+ * given (or, for a head split across several calls, into the parser's
+ * carry-over buffer), so a message is only valid inside the
+ * HttpParser::Handler::on_message() call that delivers it. Header names
+ * keep their original case; lookups ignore it.
  */
-struct HTTP : BaseProtocol {
+struct HttpMessage {
+  inline static constexpr std::size_t MAX_HEADERS = 64;
+
   // High-level classification
-  bool is_request; // true = HTTP request, false = HTTP response
-
-  // ---- Request-line fields (only valid if is_request == true) ----
-  std::string method;       // "GET", "POST", ...
-  std::string uri;          // "/index.html", "/api/v1/user?id=5"
-  std::string http_version; // "HTTP/1.1"
-
-  // ---- Status-line fields (only valid if is_request == false) ----
-  std::string status_code;   // "200", "404", ...
-  std::string reason_phrase; // "OK", "Not Found", ...
-  // http_version is reused above
-
-  // ---- Headers ----
-  // Header names canonicalized to lowercase for lookup convenience
-  std::map<std::string, std::string> headers;
-
-  // ---- Body ----
-  std::string body; // raw body payload (may be binary in real life, but string
-                    // is fine for inspection)
-
-  // Helper: check common headers
-  std::string get_header(const std::string &name_lowercase) const {
-    auto it = headers.find(name_lowercase);
-    if (it != headers.end()) {
-      return it->second;
-    }
-    return "";
+  bool is_request = true;
+
+  // ---- Request line (is_request) ----
+  std::string_view method; // "GET", "POST", ...
+  std::string_view uri;    // "/index.html", "/api/v1/user?id=5"
+
+  // ---- Status line (!is_request) ----
+  uint16_t status_code = 0;
+  std::string_view reason_phrase; // "OK", "Not Found", ...
+
+  std::string_view http_version; // "HTTP/1.1", in both kinds
+
+  // ---- Body framing, derived from the headers ----
+  bool chunked = false;
+  bool has_content_length = false;
+  uint64_t content_length = 0;
+
+  // The whole head, from the start line to the blank line
+  std::string_view head;
+
+  std::size_t header_count() const { return m_header_count; }
+  HttpHeaderField header(std::size_t i) const {
+    const Span &span = m_spans[i];
+    return HttpHeaderField{head.substr(span.name_offset, span.name_length),
+                           head.substr(span.value_offset, span.value_length)};
+  }
+
+  // Value of a well-known header (the first one, if repeated); empty if
+  // absent.
+  std::string_view get(HttpField field) const {
+    const uint8_t index = m_field_index[static_cast<std::size_t>(field)];
+    return index == 0 ? std::string_view() : header(index - 1u).value;
+  }
+
+  // Value of the first header called `name` (any case); empty if absent.
+  std::string_view get_header(std::string_view name) const;
+
+  std::string_view content_type() const {
+    return get(HttpField::ContentType);
+  }
+  std::string_view host() const { return get(HttpField::Host); }
+
+  // --- Used by the parser while filling the message ---
+
+  // Header positions relative to `head` (which is at most
+  // HttpParser::MAX_HEAD_SIZE bytes long)
+  struct Span {
+    uint16_t name_offset;
+    uint16_t name_length;
+    uint16_t value_offset;
+    uint16_t value_length;
+  };
+
+  void clear_headers() {
+    m_header_count = 0;
+    m_field_index.fill(0);
+  }
+  bool add_header(Span span, HttpField field);
+
+private:
+  // Left uninitialized: only the first m_header_count entries are read.
+  Span m_spans[MAX_HEADERS];
+  std::size_t m_header_count = 0;
+  // 1 + index into m_spans for each HttpField; 0 if absent
+  std::array<uint8_t, static_cast<std::size_t>(HttpField::Count)>
+      m_field_index{};
+};
+
+/**
+ * @brief Resumable HTTP/1.x parser for one direction of a connection.
+ *
+ * feed() takes the stream in pieces of any size (as they come out of TCP
+ * reassembly) and reports each message through a Handler: its head, then
+ * its body in pieces, then its end. Pipelined messages, Content-Length and
+ * chunked bodies, and responses whose body runs until the connection closes
+ * are handled; responses to HEAD and CONNECT, whose framing depends on the
+ * request, need expect_response(). Body pieces are views into the fed
+ * bytes; a head is parsed in place too, unless it is split across feed()
+ * calls, in which case it is collected in a carry-over buffer of at most
+ * MAX_HEAD_SIZE bytes first.
+ *
+ * Delimiters are found 16 bytes at a time with SSE2 where available.
+ *
+ * The parser holds no pointers into fed data between calls, so it is a
+ * small value that can live in a FlowTable, one per stream.
+ */
+class HttpParser {
+public:
+  inline static constexpr std::size_t MAX_HEAD_SIZE = 16 * 1024;
+
+  enum class Error : uint8_t {
+    None,
+    BadStartLine,
+    BadHeader,
+    TooManyHeaders,
+    HeadTooLarge,
+    BadContentLength,
+    BadChunk,
+    Gap, // data lost outside a body of known length
+  };
+
+  // What a response's request says about its body, which the response
+  // itself does not: a response to HEAD has none, and a 2xx to CONNECT
+  // turns the rest of the connection into an opaque tunnel.
+  enum class ResponseFraming : uint8_t { Normal, NoBody, Tunnel };
+
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+    // A complete head has been parsed; its body (if any) follows.
+    virtual void on_message(const HttpMessage &message) = 0;
+    // The next bytes of the body, already de-chunked
+    virtual void on_body(std::string_view data) { static_cast<void>(data); }
+    virtual void on_message_complete() {}
+  };
+
+  /**
+   * @brief Parses the next `data` bytes of the stream.
+   * @return false once the stream turned out not to be valid HTTP; the
+   * parser then ignores all input until reset().
+   */
+  bool feed(std::string_view data, Handler &handler);
+
+  /**
+   * @brief Skips `bytes` lost from the stream (a TCP gap).
+   * @return true if they fell inside a body of known length, so parsing
+   * can go on; otherwise the parser gives up as after an error.
+   */
+  bool skip(uint64_t bytes, Handler &handler);
+
+  // The stream has ended; completes a body that runs until then.
+  void finish(Handler &handler);
+
+  /**
+   * @brief Sets how the next final (non-1xx) response is framed.
+   *
+   * Applies to the first such response whose head has not been delivered
+   * yet, or, if called from Handler::on_message(), to the one being
+   * delivered. Only that response is affected.
+   */
+  void expect_response(ResponseFraming framing) { m_next_response = framing; }
+
+  // Treats everything from now on as tunnelled, non-HTTP data and ignores
+  // it, e.g. for the client side once the server accepted a CONNECT.
+  void start_tunnel() {
+    m_state = State::Tunnel;
+    m_head.clear();
   }
+  bool in_tunnel() const { return m_state == State::Tunnel; }
+
+  void reset();
 
-  // Helper: guess content type
-  std::string content_type() const { return get_header("content-type"); }
+  Error error() const { return m_error; }
+  // True between a message's head and its end
+  bool in_message() const {
+    return m_state != State::Head && m_state != State::Failed &&
+           m_state != State::Tunnel;
+  }
+  uint64_t messages() const { return m_messages; }
 
-  // Helper: guess host (useful for requests)
-  std::string host() const { return get_header("host"); }
+private:
+  enum class State : uint8_t {
+    Head,
+    Body,            // m_remaining bytes of a Content-Length body
+    BodyUntilClose,  // response without length: body ends with the stream
+    ChunkSize,       // hex digits of a chunk-size line
+    ChunkExtension,  // rest of a chunk-size line
+    ChunkData,       // m_remaining bytes of chunk data
+    ChunkDataEnd,    // CRLF after chunk data
+    TrailerStart,    // start of a trailer line (or the final blank line)
+    Trailer,         // rest of a trailer line
+    Tunnel,          // after a CONNECT: the rest is not HTTP
+    Failed,
+  };
 
+  std::size_t feed_head(std::string_view data, Handler &handler);
+  std::size_t feed_chunked(std::string_view data, Handler &handler);
+  void begin_body(const HttpMessage &message, Handler &handler);
+  void complete(Handler &handler);
+  void fail(Error error);
+
+  State m_state = State::Head;
+  Error m_error = Error::None;
+  bool m_chunk_digits = false; // a chunk-size line has a digit so far
+  ResponseFraming m_next_response = ResponseFraming::Normal;
+  uint64_t m_remaining = 0;
+  uint64_t m_messages = 0;
+  // A head that did not fit in one feed() call
+  std::string m_head;
+};
+
+/**
+ * @brief Holds decoded data for an HTTP message head in the protocol tree.
+ */
+struct HTTP : BaseProtocol, HttpMessage {
   std::string get_name() const override { return "HTTP"; }
 };
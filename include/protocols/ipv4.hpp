@@ -3,11 +3,12 @@
 #include "types/ipv4_address.hpp"
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 /**
- * @brief Holds decoded data for an IPv4 packet header.
+ * @brief Plain IPv4 header fields (no vtable, no payload chain).
  */
-struct IPv4 : BaseProtocol {
+struct IPv4Header {
   // Basic header info
   uint8_t version; // should be 4
   uint8_t ihl;     // Internet Header Length in 32-bit words
@@ -29,9 +30,24 @@ struct IPv4 : BaseProtocol {
   Ipv4Address source_ip; // Source IPv4 address
   Ipv4Address dest_ip;   // Destination IPv4 address
 
+  // Header without options (IHL = 5)
+  inline static constexpr std::size_t MIN_HEADER_SIZE = 20;
+
   // For chaining
   inline static const uint8_t PROTO_TCP = 6;
   inline static const uint8_t PROTO_UDP = 17;
 
+  /**
+   * @brief Decodes the header (including options) at the start of `data`.
+   * @return Header length in bytes (IHL * 4), or 0 if the header is
+   * truncated or not IPv4.
+   */
+  std::size_t parse(std::string_view data);
+};
+
+/**
+ * @brief Holds decoded data for an IPv4 packet header.
+ */
+struct IPv4 : BaseProtocol, IPv4Header {
   std::string get_name() const override { return "IPv4"; }
 };
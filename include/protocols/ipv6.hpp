@@ -3,9 +3,10 @@
 #include "types/ipv6_address.hpp"
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 /**
- * @brief Holds decoded data for an IPv6 packet header.
+ * @brief Plain IPv6 base header fields (no vtable, no payload chain).
  *
  * Reference: RFC 8200 (high level).
  *
@@ -14,7 +15,7 @@
  * - No fragmentation fields in the base header (fragmentation is done via an
  * extension header).
  */
-struct IPv6 : BaseProtocol {
+struct IPv6Header {
   // ---- Version / Traffic / Flow ----
   uint8_t version;       // should be 6
   uint8_t traffic_class; // like DSCP/ECN combined; QoS-ish
@@ -30,6 +31,19 @@ struct IPv6 : BaseProtocol {
   Ipv6Address source_ip; // Source IPv6 address
   Ipv6Address dest_ip;   // Destination IPv6 address
 
+  // ---- Extension headers (filled in by parse_extensions()) ----
+  uint8_t upper_protocol;    // next_header after the last extension header
+  uint16_t extension_length; // bytes of extension headers after the base
+  bool fragmented;           // a Fragment header was among them
+  uint16_t fragment_offset;  // its offset, in 8-byte units (like IPv4)
+  uint16_t fragment_header;  // where it starts, in the bytes after the base
+  // The next_header field naming it, counted from the start of the base
+  // header (6 is the base header's own)
+  uint16_t fragment_link;
+
+  // The base header has a fixed size; extension headers follow it
+  inline static constexpr std::size_t HEADER_SIZE = 40;
+
   // Common next_header values for chaining upper layers
   inline static const uint8_t NH_TCP = 6;        // TCP
   inline static const uint8_t NH_UDP = 17;       // UDP
@@ -37,16 +51,43 @@ struct IPv6 : BaseProtocol {
   inline static const uint8_t NH_FRAG = 44;      // Fragment header
   inline static const uint8_t NH_ROUTING = 43;   // Routing header
   inline static const uint8_t NH_HOP_BY_HOP = 0; // Hop-by-Hop Options
+  inline static const uint8_t NH_AUTH = 51;      // Authentication Header
+  inline static const uint8_t NH_DEST_OPTS = 60; // Destination Options
+
+  // Extension headers walked before giving up on reaching the upper layer
+  inline static constexpr std::size_t MAX_EXTENSIONS = 8;
 
   /**
    * @brief Convenience: is this carrying TCP directly?
    *
-   * NOTE: In real IPv6, there may be extension headers (hop-by-hop, routing,
-   * fragment, etc.) between the base header and TCP. This just checks the
-   * immediate next_header value. A more advanced parser would walk extension
-   * headers to find the "final" upper-layer header.
+   * Only checks the immediate next_header value; upper_protocol is the one
+   * found past any extension headers.
    */
   bool is_tcp_immediate() const { return next_header == NH_TCP; }
 
+  /**
+   * @brief Decodes the base header at the start of `data`.
+   * @return HEADER_SIZE, or 0 if the header is truncated or not IPv6.
+   */
+  std::size_t parse(std::string_view data);
+
+  /**
+   * @brief Walks the Hop-by-Hop, Routing, Fragment, Destination Options and
+   * Authentication headers at the start of `payload` (the bytes after the
+   * base header), filling in the extension fields.
+   *
+   * Stops at the first other header, a truncated one, after the Fragment
+   * header of a non-first fragment (what follows is payload), or after
+   * MAX_EXTENSIONS; upper_protocol is then the type of the header it
+   * stopped at.
+   * @return extension_length.
+   */
+  std::size_t parse_extensions(std::string_view payload);
+};
+
+/**
+ * @brief Holds decoded data for an IPv6 packet header.
+ */
+struct IPv6 : BaseProtocol, IPv6Header {
   std::string get_name() const override { return "IPv6"; }
 };
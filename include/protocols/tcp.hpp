@@ -2,11 +2,12 @@
 #include "base_protocol.hpp"
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 /**
- * @brief Holds decoded data for a TCP segment header.
+ * @brief Plain TCP header fields (no vtable, no payload chain).
  */
-struct TCP : BaseProtocol {
+struct TCPHeader {
   // Ports
   uint16_t src_port;
   uint16_t dst_port;
@@ -32,6 +33,28 @@ struct TCP : BaseProtocol {
   uint16_t checksum;
   uint16_t urgent_pointer; // valid if URG flag set
 
+  // Header without options (data offset = 5)
+  inline static constexpr std::size_t MIN_HEADER_SIZE = 20;
+
+  // Bits of flags(), laid out like byte 13 of the header
+  inline static constexpr uint8_t FLAG_FIN = 0x01;
+  inline static constexpr uint8_t FLAG_SYN = 0x02;
+  inline static constexpr uint8_t FLAG_RST = 0x04;
+  inline static constexpr uint8_t FLAG_PSH = 0x08;
+  inline static constexpr uint8_t FLAG_ACK = 0x10;
+  inline static constexpr uint8_t FLAG_URG = 0x20;
+  inline static constexpr uint8_t FLAG_ECE = 0x40;
+  inline static constexpr uint8_t FLAG_CWR = 0x80;
+
+  // The eight classic flags packed into one byte (NS is left out)
+  uint8_t flags() const {
+    return static_cast<uint8_t>(
+        (flag_fin ? FLAG_FIN : 0) | (flag_syn ? FLAG_SYN : 0) |
+        (flag_rst ? FLAG_RST : 0) | (flag_psh ? FLAG_PSH : 0) |
+        (flag_ack ? FLAG_ACK : 0) | (flag_urg ? FLAG_URG : 0) |
+        (flag_ece ? FLAG_ECE : 0) | (flag_cwr ? FLAG_CWR : 0));
+  }
+
   // Convenience helpers for higher layer logic
   bool is_syn_only() const {
     return flag_syn && !flag_ack && !flag_fin && !flag_rst;
@@ -44,5 +67,16 @@ struct TCP : BaseProtocol {
             src_port == 8080);
   }
 
+  /**
+   * @brief Decodes the header at the start of `data`, skipping options.
+   * @return Header length in bytes (data_offset * 4), or 0 if truncated.
+   */
+  std::size_t parse(std::string_view data);
+};
+
+/**
+ * @brief Holds decoded data for a TCP segment header.
+ */
+struct TCP : BaseProtocol, TCPHeader {
   std::string get_name() const override { return "TCP"; }
 };
@@ -0,0 +1,15 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Adds `amount` to a counter that only one thread ever writes.
+ *
+ * Other threads may read it at any time. With a single writer a relaxed
+ * load and store is enough, and avoids the locked read-modify-write of
+ * fetch_add.
+ */
+inline void bump(std::atomic<uint64_t> &counter, uint64_t amount = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+}
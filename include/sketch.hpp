@@ -0,0 +1,453 @@
+#pragma once
+#include "flow_hash.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+// Fixed-memory summaries of a stream of keys. None allocates after
+// construction on its update path, and two sketches built with the same
+// settings can be merged, so each worker keeps its own and a reporter
+// combines them. Not thread-safe.
+
+/**
+ * @brief Count-Min sketch: estimated weight of any key, never below the
+ * true weight.
+ *
+ * `depth` rows of `width` counters; a key adds its weight to one counter
+ * per row and its estimate is the smallest of them. With N the total
+ * weight, an estimate exceeds the truth by more than e/width * N with
+ * probability at most e^-depth.
+ */
+class CountMinSketch {
+public:
+  /**
+   * @brief `width` is rounded up to a power of two.
+   * @throws std::invalid_argument if `width` or `depth` is 0, or `width`
+   * is above 2^32.
+   */
+  CountMinSketch(std::size_t width, std::size_t depth);
+
+  // `hash` is the key's 64-bit hash; rows use independent parts of it.
+  // Returns the key's estimate, counting this weight.
+  uint64_t add(uint64_t hash, uint64_t weight) {
+    const uint64_t step = (hash >> 32) | 1;
+    uint64_t position = hash;
+    uint64_t smallest = UINT64_MAX;
+    for (std::size_t row = 0; row < m_depth; ++row) {
+      uint64_t &counter = m_counters[row * m_width + (position & m_mask)];
+      counter += weight;
+      smallest = std::min(smallest, counter);
+      position += step;
+    }
+    m_total += weight;
+    return smallest;
+  }
+
+  uint64_t estimate(uint64_t hash) const;
+
+  /**
+   * @brief Adds `other`'s counts to this sketch.
+   * @throws std::invalid_argument if the sizes differ.
+   */
+  void merge(const CountMinSketch &other);
+  void clear();
+
+  std::size_t width() const { return m_width; }
+  std::size_t depth() const { return m_depth; }
+  // Sum of every weight added
+  uint64_t total() const { return m_total; }
+
+private:
+  std::size_t m_width;
+  std::size_t m_depth;
+  uint64_t m_mask;
+  uint64_t m_total = 0;
+  std::vector<uint64_t> m_counters;
+};
+
+/**
+ * @brief HyperLogLog: estimated number of distinct keys.
+ *
+ * 2^precision one-byte registers; the standard error is about
+ * 1.04 / sqrt(2^precision), 1.6% at the default precision of 12 (4 KiB).
+ * Small counts use linear counting and are close to exact.
+ */
+class HyperLogLog {
+public:
+  inline static constexpr unsigned MIN_PRECISION = 4;
+  inline static constexpr unsigned MAX_PRECISION = 18;
+
+  /**
+   * @throws std::invalid_argument if `precision` is outside
+   * [MIN_PRECISION, MAX_PRECISION].
+   */
+  explicit HyperLogLog(unsigned precision = 12);
+
+  // `hash` must be a well-mixed 64-bit hash of the key.
+  void add(uint64_t hash) {
+    const std::size_t index = static_cast<std::size_t>(hash >> m_shift);
+    // Leading zeros of the remaining bits, plus one; the guard bit caps it.
+    const uint64_t rest =
+        (hash << m_precision) | (uint64_t{1} << (m_precision - 1));
+    const uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    m_registers[index] = std::max(m_registers[index], rank);
+  }
+
+  double estimate() const;
+
+  /**
+   * @brief Makes this sketch count the union of both streams.
+   * @throws std::invalid_argument if the precisions differ.
+   */
+  void merge(const HyperLogLog &other);
+  void clear();
+
+  unsigned precision() const { return m_precision; }
+
+private:
+  unsigned m_precision;
+  unsigned m_shift;
+  std::vector<uint8_t> m_registers;
+};
+
+/**
+ * @brief Top-k: the keys with the largest total weight, in fixed memory.
+ *
+ * Every weight goes into a Count-Min sketch; at most `capacity` keys are
+ * monitored exactly alongside it. A key that is not monitored is admitted
+ * once its Count-Min estimate exceeds the smallest monitored count, taking
+ * that entry's place, and starts from the estimate. Its `error` is the
+ * part of that estimate it has not been seen to send, so `count` never
+ * underestimates and `count - error` never overestimates. Keys heavier
+ * than the smallest monitored count are all monitored, up to the
+ * sketch's error.
+ *
+ * Unlike plain Space-Saving, a flood of one-off keys costs a sketch update
+ * and a failed lookup each, and never churns the monitored entries.
+ * Counts sit in a min-heap and keys in an open addressing index, all
+ * sized up front. `Hash` may be weak (e.g. std::hash of an integer); it is
+ * mixed again.
+ */
+template <typename Key, typename Hash = std::hash<Key>> class HeavyHitters {
+public:
+  struct Entry {
+    Key key{};
+    uint64_t count = 0;
+    uint64_t error = 0; // how much of `count` may belong to other keys
+  };
+
+  /**
+   * @brief `width` and `depth` size the Count-Min sketch (see
+   * CountMinSketch).
+   * @throws std::invalid_argument if `capacity` is 0 or above 2^30, or the
+   * sketch size is out of range.
+   */
+  explicit HeavyHitters(std::size_t capacity, std::size_t width = 4096,
+                        std::size_t depth = 4);
+
+  void add(const Key &key, uint64_t weight = 1) {
+    add(key, hash(key), weight);
+  }
+  // For callers that already computed hash(key).
+  void add(const Key &key, uint64_t hash, uint64_t weight);
+
+  /**
+   * @brief Entries with the largest counts, largest first.
+   */
+  std::vector<Entry> top(std::size_t n) const;
+
+  // Upper bound on the weight of any key, monitored or not
+  uint64_t estimate(const Key &key) const {
+    return m_counts.estimate(hash(key));
+  }
+
+  /**
+   * @brief Combines `other` into this summary as if it had seen both
+   * streams; the result keeps the same guarantees. Allocates.
+   * @throws std::invalid_argument if the sizes differ.
+   */
+  void merge(const HeavyHitters &other);
+  void clear();
+
+  std::size_t capacity() const { return m_capacity; }
+  std::size_t size() const { return m_entries.size(); }
+  uint64_t total() const { return m_counts.total(); }
+  // What a key must exceed to be admitted
+  uint64_t min_count() const {
+    return m_entries.size() < m_capacity ? 0 : m_heap[0].count;
+  }
+
+  static uint64_t hash(const Key &key) {
+    return mix64(static_cast<uint64_t>(Hash{}(key)));
+  }
+
+private:
+  inline static constexpr uint32_t EMPTY = UINT32_MAX;
+  // Children per heap node: four counts share a cache line, and a key
+  // that replaces the smallest sinks through half as many levels.
+  inline static constexpr std::size_t ARITY = 4;
+
+  struct Node {
+    uint64_t count; // a copy of the entry's, so sifting stays in the heap
+    uint32_t entry;
+  };
+
+  // The low half of the key's hash is kept in the index, so probing past
+  // other keys seldom touches their entries.
+  struct Slot {
+    uint32_t entry;
+    uint32_t hash;
+  };
+
+  // Index slot of `key`, or the empty slot where it would go
+  std::size_t find_slot(const Key &key, uint64_t hash) const;
+  // Monitors a new key while there is room
+  void insert(std::size_t slot, const Key &key, uint64_t hash, uint64_t count,
+              uint64_t error);
+  void erase_slot(std::size_t slot);
+  void clear_entries();
+  void sift_up(std::size_t position);
+  void sift_down(std::size_t position);
+
+  std::size_t m_capacity;
+  CountMinSketch m_counts;
+  std::vector<Entry> m_entries;
+  std::vector<uint64_t> m_hashes; // of each entry's key
+  // Min-heap of entries by count, and each entry's place in it
+  std::vector<Node> m_heap;
+  std::vector<uint32_t> m_position;
+  // Linear probing index, at most a quarter full; EMPTY entries end a
+  // probe
+  std::vector<Slot> m_index;
+  std::size_t m_index_mask;
+};
+
+template <typename Key, typename Hash>
+HeavyHitters<Key, Hash>::HeavyHitters(std::size_t capacity, std::size_t width,
+                                      std::size_t depth)
+    : m_capacity(capacity), m_counts(width, depth) {
+  if (capacity == 0 || capacity > (std::size_t{1} << 30)) {
+    throw std::invalid_argument("HeavyHitters: capacity out of range");
+  }
+  m_entries.reserve(capacity);
+  m_hashes.reserve(capacity);
+  m_heap.reserve(capacity);
+  m_position.reserve(capacity);
+  std::size_t slots = 16;
+  while (slots < capacity * 4) {
+    slots *= 2;
+  }
+  m_index.assign(slots, Slot{EMPTY, 0});
+  m_index_mask = slots - 1;
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::add(const Key &key, uint64_t hash,
+                                  uint64_t weight) {
+  const uint64_t estimate = m_counts.add(hash, weight);
+  std::size_t slot = find_slot(key, hash);
+  if (m_index[slot].entry != EMPTY) {
+    const uint32_t entry = m_index[slot].entry;
+    m_entries[entry].count += weight;
+    m_heap[m_position[entry]].count = m_entries[entry].count;
+    sift_down(m_position[entry]);
+    return;
+  }
+
+  if (m_entries.size() < m_capacity) {
+    insert(slot, key, hash, estimate, estimate - weight);
+    return;
+  }
+  if (estimate <= m_heap[0].count) {
+    return;
+  }
+
+  // Replace the smallest entry. Removing its key may shift the slot found
+  // for the new key, so look it up again.
+  const uint32_t entry = m_heap[0].entry;
+  Entry &smallest = m_entries[entry];
+  erase_slot(find_slot(smallest.key, m_hashes[entry]));
+  slot = find_slot(key, hash);
+  m_index[slot] = Slot{entry, static_cast<uint32_t>(hash)};
+  smallest = Entry{key, estimate, estimate - weight};
+  m_hashes[entry] = hash;
+  m_heap[0].count = estimate;
+  sift_down(0);
+}
+
+template <typename Key, typename Hash>
+std::vector<typename HeavyHitters<Key, Hash>::Entry>
+HeavyHitters<Key, Hash>::top(std::size_t n) const {
+  std::vector<Entry> entries(m_entries);
+  const std::size_t count = std::min(n, entries.size());
+  const auto larger = [](const Entry &a, const Entry &b) {
+    return a.count > b.count;
+  };
+  std::partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+                    larger);
+  entries.resize(count);
+  return entries;
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::merge(const HeavyHitters &other) {
+  if (other.m_capacity != m_capacity) {
+    throw std::invalid_argument("HeavyHitters: capacities differ");
+  }
+  // Each side bounds a key's weight by its count if it monitors the key,
+  // or by its sketch otherwise; what either side saw exactly is a floor.
+  struct Candidate {
+    Entry entry;
+    uint64_t hash;
+  };
+  std::vector<Candidate> candidates;
+  candidates.reserve(m_entries.size() + other.m_entries.size());
+  for (std::size_t i = 0; i < m_entries.size(); ++i) {
+    const Entry &own = m_entries[i];
+    const uint64_t key_hash = m_hashes[i];
+    uint64_t upper = own.count;
+    uint64_t lower = own.count - own.error;
+    const uint32_t match =
+        other.m_index[other.find_slot(own.key, key_hash)].entry;
+    if (match != EMPTY) {
+      upper += other.m_entries[match].count;
+      lower += other.m_entries[match].count - other.m_entries[match].error;
+    } else {
+      upper += other.m_counts.estimate(key_hash);
+    }
+    candidates.push_back(Candidate{Entry{own.key, upper, upper - lower},
+                                   key_hash});
+  }
+  for (std::size_t i = 0; i < other.m_entries.size(); ++i) {
+    const Entry &theirs = other.m_entries[i];
+    const uint64_t key_hash = other.m_hashes[i];
+    if (m_index[find_slot(theirs.key, key_hash)].entry == EMPTY) {
+      const uint64_t upper = theirs.count + m_counts.estimate(key_hash);
+      const uint64_t lower = theirs.count - theirs.error;
+      candidates.push_back(Candidate{Entry{theirs.key, upper, upper - lower},
+                                     key_hash});
+    }
+  }
+  m_counts.merge(other.m_counts);
+
+  // Keep the largest `capacity` candidates.
+  const std::size_t keep = std::min(m_capacity, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + keep,
+                    candidates.end(),
+                    [](const Candidate &a, const Candidate &b) {
+                      return a.entry.count > b.entry.count;
+                    });
+  clear_entries();
+  for (std::size_t i = 0; i < keep; ++i) {
+    const Entry &entry = candidates[i].entry;
+    insert(find_slot(entry.key, candidates[i].hash), entry.key,
+           candidates[i].hash, entry.count, entry.error);
+  }
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::clear() {
+  m_counts.clear();
+  clear_entries();
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::clear_entries() {
+  m_entries.clear();
+  m_hashes.clear();
+  m_heap.clear();
+  m_position.clear();
+  std::fill(m_index.begin(), m_index.end(), Slot{EMPTY, 0});
+}
+
+template <typename Key, typename Hash>
+std::size_t HeavyHitters<Key, Hash>::find_slot(const Key &key,
+                                               uint64_t hash) const {
+  const auto tag = static_cast<uint32_t>(hash);
+  std::size_t slot = hash & m_index_mask;
+  while (m_index[slot].entry != EMPTY) {
+    if (m_index[slot].hash == tag &&
+        m_entries[m_index[slot].entry].key == key) {
+      break;
+    }
+    slot = (slot + 1) & m_index_mask;
+  }
+  return slot;
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::insert(std::size_t slot, const Key &key,
+                                     uint64_t hash, uint64_t count,
+                                     uint64_t error) {
+  const auto entry = static_cast<uint32_t>(m_entries.size());
+  m_entries.push_back(Entry{key, count, error});
+  m_hashes.push_back(hash);
+  m_position.push_back(static_cast<uint32_t>(m_heap.size()));
+  m_heap.push_back(Node{count, entry});
+  m_index[slot] = Slot{entry, static_cast<uint32_t>(hash)};
+  sift_up(m_heap.size() - 1);
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::erase_slot(std::size_t slot) {
+  // Backward shift deletion: move later keys of the probe run into the
+  // hole when their home slot allows it, so no tombstones are needed.
+  std::size_t hole = slot;
+  std::size_t next = (hole + 1) & m_index_mask;
+  while (m_index[next].entry != EMPTY) {
+    const std::size_t home = m_index[next].hash & m_index_mask;
+    // Movable unless its home lies cyclically in (hole, next]
+    if (((next - home) & m_index_mask) >= ((next - hole) & m_index_mask)) {
+      m_index[hole] = m_index[next];
+      hole = next;
+    }
+    next = (next + 1) & m_index_mask;
+  }
+  m_index[hole].entry = EMPTY;
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::sift_up(std::size_t position) {
+  const Node node = m_heap[position];
+  while (position > 0) {
+    const std::size_t parent = (position - 1) / ARITY;
+    if (m_heap[parent].count <= node.count) {
+      break;
+    }
+    m_heap[position] = m_heap[parent];
+    m_position[m_heap[position].entry] = static_cast<uint32_t>(position);
+    position = parent;
+  }
+  m_heap[position] = node;
+  m_position[node.entry] = static_cast<uint32_t>(position);
+}
+
+template <typename Key, typename Hash>
+void HeavyHitters<Key, Hash>::sift_down(std::size_t position) {
+  const Node node = m_heap[position];
+  const std::size_t size = m_heap.size();
+  for (;;) {
+    const std::size_t first = position * ARITY + 1;
+    if (first >= size) {
+      break;
+    }
+    const std::size_t last = std::min(first + ARITY, size);
+    std::size_t smallest = first;
+    for (std::size_t child = first + 1; child < last; ++child) {
+      if (m_heap[child].count < m_heap[smallest].count) {
+        smallest = child;
+      }
+    }
+    if (m_heap[smallest].count >= node.count) {
+      break;
+    }
+    m_heap[position] = m_heap[smallest];
+    m_position[m_heap[position].entry] = static_cast<uint32_t>(position);
+    position = smallest;
+  }
+  m_heap[position] = node;
+  m_position[node.entry] = static_cast<uint32_t>(position);
+}
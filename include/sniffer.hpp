@@ -0,0 +1,208 @@
+#pragma once
+#include "packet_ref.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class PacketFilter;
+struct pcap;
+
+/**
+ * @brief Counters reported by a capture source.
+ */
+struct SnifferStats {
+  uint64_t received = 0; // packets seen by the capture source
+  uint64_t dropped = 0;  // dropped because the capture buffer was full
+  uint64_t if_dropped = 0; // dropped by the interface or its driver
+};
+
+/**
+ * @brief A source of raw frames.
+ *
+ * The engine only talks to this interface, so live capture backends (and
+ * the fake sources used in tests) are interchangeable.
+ */
+class Sniffer {
+public:
+  // Called once per packet. `packet.data` is only valid during the call,
+  // but it may point straight into a kernel ring: decode it in place rather
+  // than copying it.
+  using Callback = std::function<void(const PacketRef &packet)>;
+
+  virtual ~Sniffer() = default;
+
+  /**
+   * @brief Delivers up to `max_packets` packets to `callback`.
+   *
+   * Blocks for at most the backend's read timeout, so the caller can check
+   * for shutdown between calls.
+   * @return The number of packets delivered (0 on timeout), or -1 once the
+   * source is exhausted, closed or failed.
+   */
+  virtual int poll(int max_packets, const Callback &callback) = 0;
+
+  // Makes a poll() in progress on another thread return as soon as it can;
+  // every poll() returns -1 from then on, until clear_interrupt().
+  virtual void interrupt() = 0;
+
+  // Undoes interrupt() so polling can resume, e.g. when an engine that was
+  // stopped starts again. Not to be called while another thread polls.
+  virtual void clear_interrupt() = 0;
+
+  virtual SnifferStats stats() const = 0;
+
+  /**
+   * @brief Runs PacketFilter::kernel_program() in the kernel, so packets it
+   * rejects are never delivered. Call before the first poll().
+   *
+   * Packets queued before the filter was attached may still arrive, so the
+   * caller should keep checking the full filter in userspace.
+   * @return true if the source now only delivers packets the whole filter
+   * accepts; false if it filters only in part, or not at all (the default).
+   */
+  virtual bool set_filter(const PacketFilter &filter) {
+    static_cast<void>(filter);
+    return false;
+  }
+};
+
+/**
+ * @brief Live capture through libpcap.
+ */
+class PcapSniffer : public Sniffer {
+public:
+  struct Options {
+    int snaplen = 65535;
+    bool promiscuous = true;
+    int timeout_ms = 100;
+    int buffer_size = 64 * 1024 * 1024; // kernel ring, bytes
+  };
+
+  /**
+   * @brief Opens and activates `interface`.
+   * @throws std::runtime_error if libpcap cannot open the interface.
+   */
+  explicit PcapSniffer(const std::string &interface);
+  PcapSniffer(const std::string &interface, const Options &options);
+  ~PcapSniffer() override;
+
+  PcapSniffer(const PcapSniffer &) = delete;
+  PcapSniffer &operator=(const PcapSniffer &) = delete;
+
+  int poll(int max_packets, const Callback &callback) override;
+  void interrupt() override;
+  void clear_interrupt() override;
+  SnifferStats stats() const override;
+
+  // Installs the program with pcap_setfilter().
+  // @throws std::runtime_error if libpcap rejects it.
+  bool set_filter(const PacketFilter &filter) override;
+
+private:
+  pcap *m_handle = nullptr;
+  // libpcap forgets a pcap_breakloop() once a dispatch has seen it, so
+  // whether this sniffer is interrupted is kept here.
+  std::atomic<bool> m_interrupted{false};
+};
+
+#ifdef __linux__
+/**
+ * @brief Zero-copy live capture through an AF_PACKET TPACKET_V3 ring.
+ *
+ * The kernel writes frames into blocks of a ring that is mapped into this
+ * process, and poll() passes views of them straight to the callback. A
+ * block is handed back to the kernel only after the callback has returned
+ * for its last packet.
+ *
+ * Several sniffers opened with the same `fanout_group` split one
+ * interface's traffic between them by the kernel's symmetric flow hash, so
+ * each decode thread can own a socket instead of sharing a capture thread.
+ *
+ * VLAN tags are stripped by the kernel before frames reach the ring.
+ */
+class TpacketSniffer : public Sniffer {
+public:
+  struct Options {
+    std::size_t block_size = 4 * 1024 * 1024; // bytes, power of two
+    std::size_t block_count = 64;
+    // How long the kernel waits before handing over a partly filled block
+    int block_timeout_ms = 10;
+    int poll_timeout_ms = 100;
+    bool promiscuous = true;
+    // Skip frames this host sends (on loopback every frame shows up twice)
+    bool ignore_outgoing = false;
+    // Join this PACKET_FANOUT group (0 - 65535); -1 for no fanout
+    int fanout_group = -1;
+  };
+
+  /**
+   * @brief Opens `interface` ("any" for all interfaces).
+   * @throws std::system_error if the socket or ring cannot be set up
+   * (e.g. without CAP_NET_RAW).
+   */
+  explicit TpacketSniffer(const std::string &interface);
+  TpacketSniffer(const std::string &interface, const Options &options);
+  ~TpacketSniffer() override;
+
+  TpacketSniffer(const TpacketSniffer &) = delete;
+  TpacketSniffer &operator=(const TpacketSniffer &) = delete;
+
+  int poll(int max_packets, const Callback &callback) override;
+  void interrupt() override;
+  void clear_interrupt() override;
+
+  // Safe to call from any thread while another one polls.
+  SnifferStats stats() const override;
+
+  // Attaches the program with SO_ATTACH_FILTER.
+  // @throws std::system_error if the kernel rejects it.
+  bool set_filter(const PacketFilter &filter) override;
+
+private:
+  void setup(const std::string &interface, const Options &options);
+  void close_socket();
+
+  bool block_ready() const;
+  // Waits up to poll_timeout_ms for the current block to be handed over.
+  bool wait_for_block();
+  void release_block();
+
+  int m_fd = -1;
+  unsigned char *m_ring = nullptr;
+  std::size_t m_ring_size = 0;
+  std::size_t m_block_size = 0;
+  std::size_t m_block_count = 0;
+  int m_poll_timeout_ms = 0;
+  bool m_ignore_outgoing = false;
+
+  // Read position: current block, next packet in it, packets left in it
+  std::size_t m_block = 0;
+  const unsigned char *m_next = nullptr;
+  uint32_t m_left = 0;
+
+  std::atomic<bool> m_interrupted{false};
+
+  // The kernel resets its counters on every read, so they are summed here.
+  mutable std::atomic<uint64_t> m_received{0};
+  mutable std::atomic<uint64_t> m_dropped{0};
+};
+#endif
+
+enum class CaptureBackend { Auto, Tpacket, Pcap };
+
+/**
+ * @brief Opens a live capture on `interface` for `count` decode threads.
+ *
+ * Auto prefers TPACKET_V3 and falls back to libpcap where the ring cannot
+ * be set up (non-Linux, or missing privileges). TPACKET returns `count`
+ * sniffers in one fanout group, one per thread; libpcap returns a single
+ * sniffer to be shared through a capture thread.
+ * @throws std::runtime_error if no backend can open the interface.
+ */
+std::vector<std::unique_ptr<Sniffer>>
+open_sniffers(const std::string &interface, CaptureBackend backend,
+              std::size_t count);
@@ -0,0 +1,98 @@
+#pragma once
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include "sketch.hpp"
+#include "types/ipv4_address.hpp"
+#include "types/ipv6_address.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Top talkers and distinct hosts of a stream of decoded packets, in
+ * fixed memory.
+ *
+ * Keeps HeavyHitters top lists of source and destination addresses and of
+ * TCP/UDP destination ports, each by packets and by bytes, and HyperLogLog
+ * counts of distinct sources and destinations. Memory is set by the Config
+ * alone (about 350 KiB by default): a scan or a flood of spoofed sources
+ * costs the same as any other traffic.
+ *
+ * IPv4 addresses are kept as IPv4-mapped IPv6 (::ffff:a.b.c.d, see
+ * Ipv6Address::mapped_ipv4()), so both families share one key type. Bytes
+ * are whole frames. A packet kept by load shedding counts
+ * PacketRef::sample_rate times, so totals and top lists estimate the
+ * traffic before sampling; distinct counts are of the hosts in the sampled
+ * flows only.
+ *
+ * One sketch per worker, like FlowTracker; merge() them to report, and
+ * clear() to start a new interval.
+ */
+class TalkerSketch {
+public:
+  struct Config {
+    std::size_t capacity = 256; // keys monitored by each top list
+    // Count-Min sketch behind each top list: counters per row, and rows
+    std::size_t width = 1024;
+    std::size_t depth = 4;
+    unsigned precision = 12;     // HyperLogLog registers: 2^precision
+  };
+
+  enum class Weight : uint8_t { Packets, Bytes };
+
+  using Hosts = HeavyHitters<Ipv6Address>;
+  using Ports = HeavyHitters<uint16_t>;
+
+  /**
+   * @throws std::invalid_argument if a sketch size is out of range.
+   */
+  explicit TalkerSketch(const Config &config);
+
+  /**
+   * @brief Counts `packet`, already decoded into `stack`.
+   * @return false if the packet is not IP and was not counted.
+   */
+  bool update(const PacketRef &packet, const LayerStack &stack);
+
+  const Hosts &sources(Weight weight) const {
+    return m_sources[index(weight)];
+  }
+  const Hosts &destinations(Weight weight) const {
+    return m_destinations[index(weight)];
+  }
+  // TCP and UDP destination ports
+  const Ports &ports(Weight weight) const { return m_ports[index(weight)]; }
+
+  // Bytes sent by `source`, monitored or not; never less than the truth
+  uint64_t source_bytes(const Ipv6Address &source) const {
+    return sources(Weight::Bytes).estimate(source);
+  }
+
+  double distinct_sources() const { return m_distinct_sources.estimate(); }
+  double distinct_destinations() const {
+    return m_distinct_destinations.estimate();
+  }
+
+  uint64_t packets() const { return m_packets; }
+  uint64_t bytes() const { return m_bytes; }
+
+  /**
+   * @brief Adds `other`'s traffic, as if this sketch had seen it too.
+   * @throws std::invalid_argument if the configs differ.
+   */
+  void merge(const TalkerSketch &other);
+  void clear();
+
+private:
+  static std::size_t index(Weight weight) {
+    return static_cast<std::size_t>(weight);
+  }
+
+  std::array<Hosts, 2> m_sources;
+  std::array<Hosts, 2> m_destinations;
+  std::array<Ports, 2> m_ports;
+  HyperLogLog m_distinct_sources;
+  HyperLogLog m_distinct_destinations;
+  uint64_t m_packets = 0;
+  uint64_t m_bytes = 0;
+};
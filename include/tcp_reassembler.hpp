@@ -0,0 +1,152 @@
+#pragma once
+#include "flow_table.hpp"
+#include "layer_stack.hpp"
+#include "packet_ref.hpp"
+#include "protocols/tcp.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Counters kept by a TcpReassembler, for sizing its limits.
+ */
+struct ReassemblyStats {
+  uint64_t segments = 0;     // TCP segments seen
+  uint64_t in_order = 0;     // delivered straight from the packet
+  uint64_t out_of_order = 0; // copied into a stream buffer to wait
+  uint64_t delivered_bytes = 0;
+  // Segments (and bytes) that repeated data already delivered or buffered
+  uint64_t overlaps = 0;
+  uint64_t overlap_bytes = 0;
+  // Holes in a stream that were given up on and skipped
+  uint64_t gaps = 0;
+  uint64_t gap_bytes = 0;
+  // Out-of-order segments that found their stream's buffer full; the
+  // stream skips ahead to them instead of waiting any longer
+  uint64_t stream_buffer_full = 0;
+  // Out-of-order segments dropped because all streams together hit
+  // Config::memory_cap
+  uint64_t pressure_drops = 0;
+};
+
+/**
+ * @brief Rebuilds the byte streams of TCP connections from their segments.
+ *
+ * Each direction of a connection is a separate stream, keyed by its
+ * directional FlowKey and kept in a bounded FlowTable. Streams start at the
+ * SYN, or at the first segment seen when the capture joined mid-connection.
+ *
+ * Data reaches the Handler as contiguous byte ranges, in stream order.
+ * Segments that arrive in order are handed over as views into the packet,
+ * without a copy; only segments that arrive ahead of a hole are copied, into
+ * a per-stream buffer of at most `max_stream_buffer` bytes. All buffers
+ * together are capped at `memory_cap`.
+ *
+ * Lost segments do not stall a stream forever: when its buffer fills up, or
+ * when the stream ends (FIN, RST, idle or capacity eviction) with data
+ * still buffered, the holes are reported through on_gap() and skipped.
+ *
+ * Not thread-safe; run one reassembler per worker.
+ */
+class TcpReassembler {
+public:
+  struct Config {
+    std::size_t max_streams = 1 << 18; // directions tracked at once
+    uint64_t idle_timeout_ns = 120ULL * 1000000000ULL;
+    std::size_t max_stream_buffer = 256 * 1024; // out-of-order bytes
+    std::size_t memory_cap = 64 * 1024 * 1024;  // across all streams
+  };
+
+  // Evicted covers idle timeout, the stream cap and flush().
+  enum class CloseReason : uint8_t { Fin, Reset, Evicted };
+
+  /**
+   * @brief Receives reassembled streams.
+   *
+   * `stream` is the directional key (source = sender). Views passed to
+   * on_data() are only valid during the call. The handler must not feed
+   * the reassembler from inside a callback.
+   */
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+    // The next bytes of the stream
+    virtual void on_data(const FlowKey &stream, std::string_view data) = 0;
+    // `bytes` of the stream are missing before the next on_data()
+    virtual void on_gap(const FlowKey &stream, uint64_t bytes) {
+      static_cast<void>(stream);
+      static_cast<void>(bytes);
+    }
+    // The stream is finished; no more calls for it follow
+    virtual void on_close(const FlowKey &stream, CloseReason reason) {
+      static_cast<void>(stream);
+      static_cast<void>(reason);
+    }
+  };
+
+  TcpReassembler(const Config &config, Handler &handler);
+
+  TcpReassembler(const TcpReassembler &) = delete;
+  TcpReassembler &operator=(const TcpReassembler &) = delete;
+
+  /**
+   * @brief Feeds one decoded packet.
+   * @return false if it is not a TCP segment (and was ignored).
+   */
+  bool process(const PacketRef &packet, const LayerStack &stack);
+
+  // Feeds one segment whose key and payload were already extracted.
+  void process(const FlowKey &stream, const TCPHeader &tcp,
+               std::string_view payload, uint64_t now_ns);
+
+  // Ends streams idle at `now_ns`. Returns how many were closed.
+  std::size_t expire(uint64_t now_ns) { return m_streams.expire(now_ns); }
+
+  // Ends every stream (e.g. at the end of a capture file).
+  void flush();
+
+  const ReassemblyStats &stats() const { return m_stats; }
+  std::size_t streams() const { return m_streams.size(); }
+  // Out-of-order bytes currently held, across all streams
+  std::size_t buffered_bytes() const { return m_buffered_bytes; }
+
+private:
+  struct Segment {
+    uint32_t seq;
+    std::string data;
+  };
+
+  struct Stream {
+    uint32_t next_seq = 0; // first byte not yet delivered
+    uint32_t isn = 0;      // initial sequence number, if the SYN was seen
+    uint32_t fin_seq = 0;
+    bool syn = false;
+    bool fin = false;
+    std::size_t buffered_bytes = 0;
+    std::vector<Segment> segments; // out of order, sorted by seq
+  };
+
+  void accept(const FlowKey &key, Stream &stream, uint32_t seq,
+              std::string_view data);
+  void buffer(Stream &stream, uint32_t seq, std::string_view data);
+  void deliver(const FlowKey &key, Stream &stream, std::string_view data);
+  // Delivers `data` starting at `seq`: skips a hole before it, or trims
+  // what was already delivered. False if nothing was new.
+  bool deliver_from(const FlowKey &key, Stream &stream, uint32_t seq,
+                    std::string_view data);
+  // Delivers buffered segments that have become contiguous.
+  void drain(const FlowKey &key, Stream &stream);
+  // Delivers everything buffered, skipping the holes.
+  void skip_holes(const FlowKey &key, Stream &stream);
+  void release(Stream &stream, std::size_t bytes);
+  void finish(const FlowKey &key, Stream &stream, CloseReason reason);
+  void close(const FlowKey &key, CloseReason reason);
+
+  Config m_config;
+  Handler &m_handler;
+  FlowTable<Stream> m_streams;
+  std::size_t m_buffered_bytes = 0;
+  ReassemblyStats m_stats;
+};
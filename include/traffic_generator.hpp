@@ -0,0 +1,192 @@
+#pragma once
+#include "packet_ref.hpp"
+#include "sniffer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Synthesizes Ethernet traffic for load tests, reproducibly.
+ *
+ * Packets belong to `flows` flows between 10.0.0.0/8 clients and
+ * 172.16.0.0/12 servers (the same numbers under 2001:db8::/32 for IPv6
+ * flows). Whether a flow is IPv6, UDP or HTTP is drawn once, when it is
+ * created; each packet then picks a flow by Zipf popularity, a direction,
+ * and an IP length from `sizes`. TCP sequence numbers advance per direction,
+ * so reassemblers see gap-free streams. HTTP flows carry one complete
+ * message per packet (a request from the client, a response from the
+ * server) whose Content-Length covers the rest of the payload. Any other
+ * payload is zero bytes, so every IPv4, TCP and UDP checksum is valid at
+ * the cost of summing the header fields as they are written.
+ *
+ * A fraction of UDP datagrams is sent as IPv4 or IPv6 fragments, on
+ * consecutive calls to next(). There is no handshake or teardown: flows are
+ * established from their first packet.
+ *
+ * Everything, including the random generator, is implemented here, so the
+ * same Config gives the same packets on every platform. Frames are built in
+ * place in one buffer and flows and sizes are drawn from alias tables in
+ * O(1), so a packet costs a few tens of nanoseconds however many flows
+ * there are (beyond the cache misses of a large flow table).
+ */
+class TrafficGenerator {
+public:
+  // An IP packet length and how often it is drawn relative to the others
+  struct SizeWeight {
+    uint16_t size;
+    double weight;
+  };
+
+  struct Config {
+    uint64_t seed = 1;
+    std::size_t flows = 10000; // at most 2^24
+    // Flow k (from 1) is drawn with weight 1 / k^zipf_skew; 0 is uniform.
+    double zipf_skew = 1.0;
+    double ipv6_ratio = 0.2; // flows over IPv6
+    double udp_ratio = 0.1;  // flows over UDP; the others are TCP
+    double http_ratio = 0.3; // TCP flows carrying HTTP to port 80
+    // UDP datagrams sent as fragments; they are `fragmented_size` bytes of
+    // UDP header and data (more than the MTU).
+    double fragment_ratio = 0;
+    std::size_t fragmented_size = 4000;
+    std::size_t mtu = 1500; // 576 to 9216
+    // IP packet lengths, raised to fit the headers and lowered to the MTU.
+    // The default is the simple IMIX mix.
+    std::vector<SizeWeight> sizes = {{40, 7}, {576, 4}, {1500, 1}};
+    uint64_t start_ns = 0;
+    uint64_t interval_ns = 1000; // between packet timestamps
+  };
+
+  /**
+   * @brief Creates the flows and the tables they are drawn from.
+   * @throws std::invalid_argument if a ratio is outside [0, 1], or the
+   * flows, sizes, MTU or fragmented size are out of range.
+   */
+  explicit TrafficGenerator(const Config &config);
+
+  TrafficGenerator(const TrafficGenerator &) = delete;
+  TrafficGenerator &operator=(const TrafficGenerator &) = delete;
+
+  // The next packet. Its view is valid until the next call.
+  PacketRef next();
+
+  // Starts the same sequence of packets again.
+  void reset();
+
+  /**
+   * @brief Writes the next `packets` packets to a pcap file with
+   * nanosecond timestamps.
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  void write_pcap(const std::string &path, uint64_t packets);
+
+  const Config &config() const { return m_config; }
+  uint64_t generated() const { return m_generated; }
+
+  // Largest frame next() returns: Ethernet header plus the MTU
+  std::size_t max_frame() const { return m_frame.size(); }
+
+private:
+  // Draws one of n choices with given weights from one 64-bit random
+  // number (Vose's alias method).
+  class AliasTable {
+  public:
+    AliasTable() = default;
+    explicit AliasTable(const std::vector<double> &weights);
+    uint32_t sample(uint64_t random) const;
+    void prefetch(uint64_t random) const;
+
+  private:
+    // Choice i is kept if the low 32 random bits are below its threshold,
+    // and replaced by its alias otherwise.
+    struct Column {
+      uint32_t threshold;
+      uint32_t alias;
+    };
+    uint32_t column(uint64_t random) const;
+
+    std::vector<Column> m_columns;
+  };
+
+  struct Flow {
+    uint32_t client; // IPv4 address, or the last 32 bits of the IPv6 one
+    uint32_t server;
+    uint16_t client_port;
+    uint16_t server_port;
+    bool ipv6;
+    bool udp;
+    bool http;
+    uint32_t seq[2]; // next TCP sequence number, client and server side
+    // Sum of the 16-bit words of both addresses, for checksums
+    uint32_t address_sum;
+  };
+
+  // The UDP datagram being sent as fragments; total is 0 when there is none.
+  struct Fragments {
+    uint32_t flow = 0;
+    bool reply = false;
+    uint32_t id = 0;
+    uint32_t offset = 0; // bytes of UDP header and data already sent
+    uint32_t total = 0;
+  };
+
+  uint64_t random();
+  std::size_t write_packet();
+  std::size_t write_fragment();
+  // Ethernet and IP headers for `l4_length` bytes (after any fragment
+  // header); returns the offset of those bytes.
+  std::size_t write_ip(const Flow &flow, bool reply, std::size_t l4_length,
+                       bool fragment, bool more);
+  // The ones' complement sum of the TCP/UDP pseudo-header
+  static uint32_t pseudo_header_sum(const Flow &flow, std::size_t l4_length);
+
+  Config m_config;
+  std::vector<Flow> m_flows;
+  AliasTable m_flow_table;
+  AliasTable m_size_table;
+  uint64_t m_state = 0; // random generator
+  // Flows are drawn ahead, so the cache misses of a large flow table
+  // overlap with building the packets before them: the draw for the packet
+  // after next, and the flow of the next one.
+  uint64_t m_flow_draw = 0;
+  uint32_t m_next_flow = 0;
+  uint64_t m_generated = 0;
+  uint16_t m_ip_id = 0;
+  uint32_t m_fragment_id = 0;
+  Fragments m_fragments;
+  std::vector<unsigned char> m_frame;
+  // Bytes of m_frame that may be non-zero; cleared before the next packet
+  std::size_t m_dirty = 0;
+};
+
+/**
+ * @brief Feeds `packets` generated packets to anything that takes a
+ * Sniffer, such as LayerSpyEngine, as fast as they are polled.
+ *
+ * poll() returns -1 once they have all been delivered. Give each
+ * LayerSpyEngine worker its own (with different seeds), and every worker
+ * decodes what it generates, in place.
+ */
+class TrafficGeneratorSniffer : public Sniffer {
+public:
+  TrafficGeneratorSniffer(const TrafficGenerator::Config &config,
+                          uint64_t packets)
+      : m_generator(config), m_packets(packets) {}
+
+  int poll(int max_packets, const Callback &callback) override;
+  void interrupt() override { m_interrupted = true; }
+  void clear_interrupt() override { m_interrupted = false; }
+  SnifferStats stats() const override {
+    return SnifferStats{m_received, 0, 0};
+  }
+
+  const TrafficGenerator &generator() const { return m_generator; }
+
+private:
+  TrafficGenerator m_generator;
+  uint64_t m_packets;
+  std::atomic<bool> m_interrupted{false};
+  std::atomic<uint64_t> m_received{0};
+};
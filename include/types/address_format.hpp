@@ -0,0 +1,60 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Lookup tables and helpers shared by the address types' format_to().
+ *
+ * Formatting writes into caller-provided buffers and never allocates, so it
+ * can run per packet.
+ */
+namespace address_format {
+
+// "00" .. "ff": two lowercase hex digits for every byte value
+inline constexpr std::array<std::array<char, 2>, 256> HEX_BYTES = [] {
+  constexpr char digits[] = "0123456789abcdef";
+  std::array<std::array<char, 2>, 256> table{};
+  for (std::size_t i = 0; i < 256; ++i) {
+    table[i] = {digits[i >> 4], digits[i & 0xF]};
+  }
+  return table;
+}();
+
+// "0" .. "255": up to three decimal digits for every byte value, padded to
+// three characters, followed by the digit count
+inline constexpr std::array<std::array<char, 4>, 256> DECIMAL_BYTES = [] {
+  std::array<std::array<char, 4>, 256> table{};
+  for (std::size_t i = 0; i < 256; ++i) {
+    const char hundreds = static_cast<char>('0' + i / 100);
+    const char tens = static_cast<char>('0' + i / 10 % 10);
+    const char ones = static_cast<char>('0' + i % 10);
+    if (i >= 100) {
+      table[i] = {hundreds, tens, ones, 3};
+    } else if (i >= 10) {
+      table[i] = {tens, ones, '0', 2};
+    } else {
+      table[i] = {ones, '0', '0', 1};
+    }
+  }
+  return table;
+}();
+
+} // namespace address_format
+
+/**
+ * @brief Formats `count` addresses into `out`, each followed by `separator`.
+ *
+ * `out` needs room for `count * (Address::MAX_STRING_LENGTH + 1)` bytes.
+ * Works with Ipv4Address, Ipv6Address and MacAddress.
+ * @return One past the last byte written.
+ */
+template <typename Address>
+char *format_addresses(const Address *addresses, std::size_t count, char *out,
+                       char separator = '\n') {
+  for (std::size_t i = 0; i < count; ++i) {
+    out = addresses[i].format_to(out);
+    *out++ = separator;
+  }
+  return out;
+}
@@ -1,16 +1,24 @@
 #pragma once
+#include "flow_hash.hpp"
+#include <cstddef>
 #include <cstdint> // For uint32_t
+#include <functional>
 #include <string>
+#include <type_traits>
 
 /**
  * @brief Represents an IPv4 address (32-bit).
  * Stores the address in host byte order internally for efficient operations.
+ * A plain 4-byte value: cheap to copy and safe to share between threads.
  */
 class Ipv4Address {
 public:
   // Size constant for IPv4 addresses
   inline static constexpr std::size_t LENGTH = 4;
 
+  // Longest text form, "255.255.255.255"
+  inline static constexpr std::size_t MAX_STRING_LENGTH = 15;
+
   Ipv4Address();
 
   // Constructor from a 32-bit integer in *network byte order*
@@ -21,12 +29,38 @@ public:
 
   std::string toString() const;
 
-  bool operator==(const Ipv4Address &other) const;
+  // Writes the dotted-quad form (no terminating NUL) into `out`, which needs
+  // room for MAX_STRING_LENGTH bytes. Returns one past the last byte.
+  char *format_to(char *out) const;
+
+  // The address as a number in host byte order (e.g. 10.0.0.1 = 0x0A000001)
+  uint32_t hostOrder() const { return m_ip_host_order; }
+
+  uint64_t hash() const { return mix64(m_ip_host_order); }
+
+  bool operator==(const Ipv4Address &other) const {
+    return m_ip_host_order == other.m_ip_host_order;
+  }
+  bool operator!=(const Ipv4Address &other) const { return !(*this == other); }
+  // Numeric order, so 9.0.0.0 sorts before 10.0.0.0
+  bool operator<(const Ipv4Address &other) const {
+    return m_ip_host_order < other.m_ip_host_order;
+  }
 
 private:
   // Store the IP in *host byte order* for easier math
   uint32_t m_ip_host_order;
+};
+
+static_assert(sizeof(Ipv4Address) == Ipv4Address::LENGTH,
+              "Ipv4Address must stay a bare 32-bit value");
+static_assert(std::is_trivially_copyable<Ipv4Address>::value,
+              "Ipv4Address is copied into packet and flow structures");
 
-  mutable std::string m_string_cache;
-  mutable bool m_cache_dirty = true;
-};
\ No newline at end of file
+namespace std {
+template <> struct hash<Ipv4Address> {
+  size_t operator()(const Ipv4Address &address) const noexcept {
+    return static_cast<size_t>(address.hash());
+  }
+};
+} // namespace std
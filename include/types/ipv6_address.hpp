@@ -1,31 +1,69 @@
 #pragma once
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
+#include <type_traits>
 
 /**
  * @brief Represents an IPv6 address (128-bit).
  * Stores the address as 16 bytes for straightforward parsing and formatting.
+ * A plain 16-byte value: cheap to copy and safe to share between threads.
  */
 class Ipv6Address {
 public:
   // Size constant for IPv6 addresses
   inline static constexpr std::size_t LENGTH = 16;
 
+  // Longest text form, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"
+  inline static constexpr std::size_t MAX_STRING_LENGTH = 39;
+
   Ipv6Address();
 
   // Constructor from raw bytes (what our parser will use)
   explicit Ipv6Address(const unsigned char *ip_bytes);
 
+  // The IPv4-mapped address ::ffff:a.b.c.d (RFC 4291) of an IPv4 address
+  // given in host byte order, for keying both families alike
+  static Ipv6Address mapped_ipv4(uint32_t ipv4_host_order);
+
   // Convert to human-readable IPv6 string (compressed format like "2001:db8::1")
   std::string toString() const;
 
-  bool operator==(const Ipv6Address &other) const;
+  // Writes the same text as toString() (and inet_ntop()), without a
+  // terminating NUL, into `out`, which needs room for MAX_STRING_LENGTH
+  // bytes. Returns one past the last byte.
+  char *format_to(char *out) const;
+
+  // The 16 raw address bytes, in network byte order
+  const std::array<uint8_t, 16> &bytes() const { return m_bytes; }
+
+  uint64_t hash() const;
+
+  bool operator==(const Ipv6Address &other) const {
+    return m_bytes == other.m_bytes;
+  }
+  bool operator!=(const Ipv6Address &other) const { return !(*this == other); }
+  // Numeric order (the bytes are big-endian)
+  bool operator<(const Ipv6Address &other) const {
+    return m_bytes < other.m_bytes;
+  }
 
 private:
   // Store the 128-bit IPv6 address as 16 bytes
   std::array<uint8_t, 16> m_bytes;
+};
+
+static_assert(sizeof(Ipv6Address) == Ipv6Address::LENGTH,
+              "Ipv6Address must stay a bare 128-bit value");
+static_assert(std::is_trivially_copyable<Ipv6Address>::value,
+              "Ipv6Address is copied into packet and flow structures");
 
-  mutable std::string m_string_cache;
-  mutable bool m_cache_dirty = true;
+namespace std {
+template <> struct hash<Ipv6Address> {
+  size_t operator()(const Ipv6Address &address) const noexcept {
+    return static_cast<size_t>(address.hash());
+  }
 };
+} // namespace std
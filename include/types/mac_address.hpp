@@ -1,14 +1,20 @@
 #pragma once
 #include <array>
+#include <cstddef>
 #include <cstdint> // For uint8_t
+#include <functional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 
 class MacAddress {
 public:
   // Number of bytes in a MAC address
   inline static constexpr std::size_t LENGTH = 6;
 
+  // Length of the text form, "aa:bb:cc:dd:ee:ff"
+  inline static constexpr std::size_t MAX_STRING_LENGTH = 17;
+
   // Default constructor (initializes to 00:00:00:00:00:00)
   MacAddress();
 
@@ -18,15 +24,39 @@ public:
   // Converts the 6-byte array into a human-readable string
   std::string toString() const;
 
+  // Writes the lowercase colon-separated form (no terminating NUL) into
+  // `out`, which needs room for MAX_STRING_LENGTH bytes. Returns one past
+  // the last byte.
+  char *format_to(char *out) const;
+
+  const std::array<uint8_t, 6> &bytes() const { return m_bytes; }
+
+  uint64_t hash() const;
+
   // (Optional but good) Overload the == operator for comparisons
-  bool operator==(const MacAddress &other) const;
+  bool operator==(const MacAddress &other) const {
+    return m_bytes == other.m_bytes;
+  }
+  bool operator!=(const MacAddress &other) const { return !(*this == other); }
+  bool operator<(const MacAddress &other) const {
+    return m_bytes < other.m_bytes;
+  }
 
   bool operator==(std::string_view other_str) const;
 
 private:
   std::array<uint8_t, 6> m_bytes;
-
-  // We can cache the string representation so we only build it once
-  mutable std::string m_string_cache;
-  mutable bool m_cache_dirty = true;
-};
\ No newline at end of file
+};
+
+static_assert(sizeof(MacAddress) == MacAddress::LENGTH,
+              "MacAddress must stay a bare 6-byte value");
+static_assert(std::is_trivially_copyable<MacAddress>::value,
+              "MacAddress is copied into packet structures");
+
+namespace std {
+template <> struct hash<MacAddress> {
+  size_t operator()(const MacAddress &address) const noexcept {
+    return static_cast<size_t>(address.hash());
+  }
+};
+} // namespace std
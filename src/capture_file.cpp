@@ -0,0 +1,403 @@
+#include "capture_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+// pcap magic numbers as read in host order
+constexpr uint32_t PCAP_MAGIC_US = 0xA1B2C3D4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+constexpr uint32_t PCAP_MAGIC_US_SWAPPED = 0xD4C3B2A1;
+constexpr uint32_t PCAP_MAGIC_NS_SWAPPED = 0x4D3CB2A1;
+constexpr std::size_t PCAP_FILE_HEADER = 24;
+constexpr std::size_t PCAP_RECORD_HEADER = 16;
+
+// pcapng block types and the section byte-order magic
+constexpr uint32_t BLOCK_SECTION_HEADER = 0x0A0D0D0A;
+constexpr uint32_t BLOCK_INTERFACE = 0x00000001;
+constexpr uint32_t BLOCK_PACKET_OBSOLETE = 0x00000002;
+constexpr uint32_t BLOCK_SIMPLE_PACKET = 0x00000003;
+constexpr uint32_t BLOCK_ENHANCED_PACKET = 0x00000006;
+constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+constexpr uint16_t OPTION_END = 0;
+constexpr uint16_t OPTION_IF_TSRESOL = 9;
+
+uint64_t pow10(unsigned exponent) {
+  uint64_t value = 1;
+  while (exponent-- > 0) {
+    value *= 10;
+  }
+  return value;
+}
+
+std::size_t pad4(std::size_t length) { return (length + 3) & ~std::size_t{3}; }
+
+} // namespace
+
+CaptureFileReader::CaptureFileReader(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  struct stat info = {};
+  if (fstat(fd, &info) != 0) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  m_size = static_cast<std::size_t>(info.st_size);
+  if (m_size < 4) {
+    close(fd);
+    throw std::runtime_error(path + ": too short for a capture file");
+  }
+
+  void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  const int error = errno;
+  close(fd); // the mapping keeps the file alive
+  if (mapping == MAP_FAILED) {
+    throw std::system_error(error, std::generic_category(), "mmap " + path);
+  }
+  m_data = static_cast<const unsigned char *>(mapping);
+  // Aggressive readahead, and pages behind the read position may be
+  // dropped first. Only a hint: failure changes nothing but speed.
+  madvise(mapping, m_size, MADV_SEQUENTIAL);
+
+  try {
+    uint32_t magic;
+    std::memcpy(&magic, m_data, sizeof(magic));
+    if (magic == BLOCK_SECTION_HEADER) {
+      m_format = Format::PcapNg;
+      if (!read_section_header(0)) {
+        throw std::runtime_error("capture file: bad pcapng section header");
+      }
+      m_first_record = 0;
+    } else {
+      read_pcap_header();
+      m_first_record = PCAP_FILE_HEADER;
+    }
+  } catch (...) {
+    munmap(mapping, m_size);
+    throw;
+  }
+  m_position = m_first_record;
+}
+
+CaptureFileReader::~CaptureFileReader() {
+  munmap(const_cast<unsigned char *>(m_data), m_size);
+}
+
+void CaptureFileReader::rewind() {
+  m_position = m_first_record;
+  m_skipped = 0;
+  m_truncated = false;
+  if (m_format == Format::PcapNg) {
+    m_interfaces.clear();
+  }
+}
+
+void CaptureFileReader::seek(const Cursor &cursor) {
+  if (cursor.position < m_first_record || cursor.position > m_size) {
+    throw std::out_of_range("capture file: seek past the end of the file");
+  }
+  if (m_format == Format::Pcap && cursor.interfaces.size() != 1) {
+    throw std::out_of_range("capture file: cursor is not from a pcap file");
+  }
+  m_position = cursor.position;
+  m_swapped = cursor.swapped;
+  m_interfaces = cursor.interfaces;
+  m_truncated = false;
+}
+
+void CaptureFileReader::prefetch(std::size_t offset,
+                                 std::size_t length) const {
+  if (offset >= m_size) {
+    return;
+  }
+  // madvise() wants a page-aligned start.
+  const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const std::size_t start = offset & ~(page - 1);
+  const std::size_t end = std::min(m_size, offset + length);
+  madvise(const_cast<unsigned char *>(m_data) + start, end - start,
+          MADV_WILLNEED);
+}
+
+std::vector<CaptureFileReader::Chunk>
+CaptureFileReader::split(std::size_t chunk_bytes) {
+  if (chunk_bytes == 0) {
+    throw std::invalid_argument("Capture file chunks need at least a byte");
+  }
+  std::vector<Chunk> chunks;
+  const Cursor saved = cursor();
+  const uint64_t skipped = m_skipped;
+  const bool truncated = m_truncated;
+  rewind();
+
+  // Only record headers are read, so this costs a fraction of decoding.
+  PacketRef packet;
+  Cursor start = cursor();
+  while (m_position < m_size) {
+    if (m_position - start.position >= chunk_bytes) {
+      chunks.push_back(Chunk{start, m_position});
+      start = cursor();
+    }
+    if (!next(packet)) {
+      break;
+    }
+  }
+  if (start.position < m_size) {
+    chunks.push_back(Chunk{start, m_size});
+  }
+
+  seek(saved);
+  m_skipped = skipped;
+  m_truncated = truncated;
+  return chunks;
+}
+
+bool CaptureFileReader::next(PacketRef &packet) {
+  return m_format == Format::Pcap ? next_pcap(packet) : next_pcapng(packet);
+}
+
+uint16_t CaptureFileReader::load16(std::size_t offset) const {
+  uint16_t value;
+  std::memcpy(&value, m_data + offset, sizeof(value));
+  return m_swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t CaptureFileReader::load32(std::size_t offset) const {
+  uint32_t value;
+  std::memcpy(&value, m_data + offset, sizeof(value));
+  return m_swapped ? __builtin_bswap32(value) : value;
+}
+
+uint64_t CaptureFileReader::to_ns(uint64_t timestamp,
+                                  const Interface &interface) const {
+  if (interface.binary) {
+    const unsigned shift = interface.exponent;
+    if (shift >= 64) {
+      return 0;
+    }
+    const uint64_t seconds = shift == 0 ? timestamp : timestamp >> shift;
+    const uint64_t fraction = timestamp - (seconds << shift);
+    // fraction < 2^shift, so scale in two steps to stay within 64 bits.
+    const long double ns = static_cast<long double>(fraction) * 1e9L /
+                           static_cast<long double>(1ULL << shift);
+    return seconds * 1000000000ULL + static_cast<uint64_t>(ns);
+  }
+  if (interface.exponent <= 9) {
+    return timestamp * pow10(9 - interface.exponent);
+  }
+  return timestamp / pow10(interface.exponent - 9);
+}
+
+// --- pcap ---
+
+void CaptureFileReader::read_pcap_header() {
+  if (m_size < PCAP_FILE_HEADER) {
+    throw std::runtime_error("capture file: truncated pcap header");
+  }
+  uint32_t magic;
+  std::memcpy(&magic, m_data, sizeof(magic));
+
+  Interface interface;
+  switch (magic) {
+  case PCAP_MAGIC_US:
+    break;
+  case PCAP_MAGIC_NS:
+    interface.exponent = 9;
+    break;
+  case PCAP_MAGIC_US_SWAPPED:
+    m_swapped = true;
+    break;
+  case PCAP_MAGIC_NS_SWAPPED:
+    m_swapped = true;
+    interface.exponent = 9;
+    break;
+  default:
+    throw std::runtime_error("capture file: not a pcap or pcapng file");
+  }
+  // The low 16 bits hold the link type; the rest are FCS flags.
+  interface.link_type = static_cast<uint16_t>(load32(20));
+  m_interfaces.assign(1, interface);
+}
+
+bool CaptureFileReader::next_pcap(PacketRef &packet) {
+  const Interface &interface = m_interfaces.front();
+  while (m_position + PCAP_RECORD_HEADER <= m_size) {
+    const uint32_t seconds = load32(m_position);
+    const uint32_t fraction = load32(m_position + 4);
+    const uint32_t captured = load32(m_position + 8);
+    const std::size_t data = m_position + PCAP_RECORD_HEADER;
+    if (captured > m_size - data) {
+      m_truncated = true;
+      return false;
+    }
+    m_position = data + captured;
+
+    if (interface.link_type != LINKTYPE_ETHERNET) {
+      ++m_skipped;
+      continue;
+    }
+    packet.data = std::string_view(
+        reinterpret_cast<const char *>(m_data + data), captured);
+    packet.timestamp_ns = static_cast<uint64_t>(seconds) * 1000000000ULL +
+                          (interface.exponent == 9
+                               ? fraction
+                               : static_cast<uint64_t>(fraction) * 1000ULL);
+    return true;
+  }
+  m_truncated = m_position != m_size;
+  return false;
+}
+
+// --- pcapng ---
+
+bool CaptureFileReader::read_section_header(std::size_t offset) {
+  if (offset + 28 > m_size) {
+    return false;
+  }
+  uint32_t order;
+  std::memcpy(&order, m_data + offset + 8, sizeof(order));
+  if (order == BYTE_ORDER_MAGIC) {
+    m_swapped = false;
+  } else if (order == __builtin_bswap32(BYTE_ORDER_MAGIC)) {
+    m_swapped = true;
+  } else {
+    return false;
+  }
+  // Interface ids are numbered per section.
+  m_interfaces.clear();
+  return true;
+}
+
+void CaptureFileReader::read_interface(std::size_t offset,
+                                       std::size_t length) {
+  Interface interface;
+  interface.link_type = load16(offset + 8);
+
+  // Options start after link type, reserved and snaplen.
+  std::size_t option = offset + 16;
+  const std::size_t end = offset + length - 4;
+  while (option + 4 <= end) {
+    const uint16_t code = load16(option);
+    const uint16_t option_length = load16(option + 2);
+    if (code == OPTION_END || option + 4 + option_length > end) {
+      break;
+    }
+    if (code == OPTION_IF_TSRESOL && option_length >= 1) {
+      const uint8_t resolution = m_data[option + 4];
+      interface.binary = (resolution & 0x80) != 0;
+      interface.exponent = resolution & 0x7F;
+    }
+    option += 4 + pad4(option_length);
+  }
+  m_interfaces.push_back(interface);
+}
+
+bool CaptureFileReader::next_pcapng(PacketRef &packet) {
+  while (m_position + 12 <= m_size) {
+    const std::size_t block = m_position;
+    uint32_t type;
+    std::memcpy(&type, m_data + block, sizeof(type));
+    // A section header may switch the byte order, so it is recognised
+    // before its length is decoded.
+    if (type == BLOCK_SECTION_HEADER) {
+      // Without its byte order nothing after it can be read.
+      if (!read_section_header(block)) {
+        m_truncated = true;
+        return false;
+      }
+    } else {
+      type = load32(block);
+    }
+    const uint32_t length = load32(block + 4);
+    if (length < 12 || length % 4 != 0 || length > m_size - block) {
+      m_truncated = true;
+      return false;
+    }
+    m_position = block + length;
+
+    uint32_t interface_id = 0;
+    uint64_t timestamp = 0;
+    std::size_t data = 0;
+    std::size_t captured = 0;
+    switch (type) {
+    case BLOCK_INTERFACE:
+      if (length >= 20) {
+        read_interface(block, length);
+      }
+      continue;
+    case BLOCK_ENHANCED_PACKET:
+      if (length < 32) {
+        continue;
+      }
+      interface_id = load32(block + 8);
+      timestamp = (static_cast<uint64_t>(load32(block + 12)) << 32) |
+                  load32(block + 16);
+      captured = load32(block + 20);
+      data = block + 28;
+      break;
+    case BLOCK_SIMPLE_PACKET:
+      if (length < 16) {
+        continue;
+      }
+      // No capture length field: it is the original length, bounded by the
+      // block.
+      captured = std::min<std::size_t>(load32(block + 8), length - 16);
+      data = block + 12;
+      break;
+    case BLOCK_PACKET_OBSOLETE:
+      if (length < 32) {
+        continue;
+      }
+      interface_id = load16(block + 8);
+      timestamp = (static_cast<uint64_t>(load32(block + 12)) << 32) |
+                  load32(block + 16);
+      captured = load32(block + 20);
+      data = block + 28;
+      break;
+    default:
+      continue; // statistics, name resolution, custom blocks, ...
+    }
+
+    if (data + captured > block + length - 4) {
+      m_truncated = true;
+      return false;
+    }
+    if (interface_id >= m_interfaces.size() ||
+        m_interfaces[interface_id].link_type != LINKTYPE_ETHERNET) {
+      ++m_skipped;
+      continue;
+    }
+    packet.data = std::string_view(
+        reinterpret_cast<const char *>(m_data + data), captured);
+    packet.timestamp_ns = to_ns(timestamp, m_interfaces[interface_id]);
+    return true;
+  }
+  m_truncated = m_position != m_size;
+  return false;
+}
+
+// --- CaptureFileSniffer ---
+
+int CaptureFileSniffer::poll(int max_packets, const Callback &callback) {
+  if (m_interrupted.load(std::memory_order_relaxed)) {
+    return -1;
+  }
+  int delivered = 0;
+  PacketRef packet;
+  while (delivered < max_packets && m_reader.next(packet)) {
+    callback(packet);
+    ++delivered;
+  }
+  m_received.fetch_add(static_cast<uint64_t>(delivered),
+                       std::memory_order_relaxed);
+  return delivered == 0 ? -1 : delivered;
+}
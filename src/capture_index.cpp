@@ -0,0 +1,480 @@
+#include "capture_index.hpp"
+#include "flow_hash.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+// Integers are copied to and from the file as they are in memory.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "capture indexes are little-endian");
+
+namespace {
+
+// --- File layout ---
+//
+// Header, the reader state at the end of the indexed part, the block
+// states, the blocks, then per bucket a varint byte count and the bucket's
+// varint deltas.
+
+constexpr char FILE_MAGIC[8] = {'L', 'S', 'P', 'Y', 'I', 'N', 'D', 'X'};
+constexpr uint32_t FILE_VERSION = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t buckets;
+  uint64_t block_bytes;
+  uint64_t packets;
+  uint64_t head_hash;
+  uint64_t tail_hash;
+  uint64_t end_position;
+  uint32_t states;
+  uint32_t blocks;
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader has no padding");
+static_assert(sizeof(CaptureIndex::Block) == 40, "Block has no padding");
+
+// Bytes of the file hashed at its start and before the end of the index
+constexpr std::size_t IDENTITY_BYTES = 4096;
+
+uint64_t hash_bytes(std::string_view bytes) {
+  uint64_t hash = mix64(bytes.length());
+  std::size_t at = 0;
+  for (; at + 8 <= bytes.length(); at += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes.data() + at, sizeof(word));
+    hash = mix64(hash ^ word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, bytes.data() + at, bytes.length() - at);
+  return mix64(hash ^ tail);
+}
+
+uint64_t head_hash(std::string_view file, std::size_t end) {
+  return hash_bytes(file.substr(0, std::min(end, IDENTITY_BYTES)));
+}
+
+uint64_t tail_hash(std::string_view file, std::size_t end) {
+  const std::size_t start = end - std::min(end, IDENTITY_BYTES);
+  return hash_bytes(file.substr(start, end - start));
+}
+
+void put_varint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a varint at `at`; false if it runs past `end` or 64 bits.
+bool get_varint(const uint8_t *&at, const uint8_t *end, uint64_t &value) {
+  value = 0;
+  for (unsigned shift = 0; at < end && shift < 64; shift += 7) {
+    const uint8_t byte = *at++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T> void put(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Bounds-checked reads from a loaded index
+class Input {
+public:
+  Input(const std::string &data, const std::string &path)
+      : m_data(data), m_path(path) {}
+
+  template <typename T> T get() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  const uint8_t *take(uint64_t length) {
+    if (length > m_data.length() - m_at) {
+      corrupt();
+    }
+    const char *at = m_data.data() + m_at;
+    m_at += length;
+    return reinterpret_cast<const uint8_t *>(at);
+  }
+
+  uint64_t varint() {
+    const auto *start = reinterpret_cast<const uint8_t *>(m_data.data());
+    const uint8_t *at = start + m_at;
+    uint64_t value;
+    if (!get_varint(at, start + m_data.length(), value)) {
+      corrupt();
+    }
+    m_at = static_cast<std::size_t>(at - start);
+    return value;
+  }
+
+  std::size_t remaining() const { return m_data.length() - m_at; }
+
+  [[noreturn]] void corrupt() const {
+    throw std::runtime_error(m_path + ": corrupt capture index");
+  }
+
+private:
+  const std::string &m_data;
+  const std::string &m_path;
+  std::size_t m_at = 0;
+};
+
+void put_state(std::string &out, bool swapped,
+               const std::vector<CaptureFileReader::Interface> &interfaces) {
+  put(out, static_cast<uint8_t>(swapped));
+  put(out, static_cast<uint8_t>(0));
+  put(out, static_cast<uint16_t>(interfaces.size()));
+  for (const CaptureFileReader::Interface &interface : interfaces) {
+    put(out, interface.link_type);
+    put(out, interface.exponent);
+    put(out, static_cast<uint8_t>(interface.binary));
+  }
+}
+
+void get_state(Input &in, bool &swapped,
+               std::vector<CaptureFileReader::Interface> &interfaces) {
+  swapped = in.get<uint8_t>() != 0;
+  in.get<uint8_t>();
+  interfaces.resize(in.get<uint16_t>());
+  for (CaptureFileReader::Interface &interface : interfaces) {
+    interface.link_type = in.get<uint16_t>();
+    interface.exponent = in.get<uint8_t>();
+    interface.binary = in.get<uint8_t>() != 0;
+  }
+}
+
+// The flow of a packet, both directions alike; false if it has none.
+bool packet_flow(const PacketRef &packet, Decoder &decoder, LayerStack &stack,
+                 FlowKey &flow) {
+  // Malformed packets keep the layers decoded before the problem.
+  decoder.decode(packet.data, stack);
+  if (!FlowKey::from_packet(packet.data, stack, flow)) {
+    return false;
+  }
+  flow = flow.canonical();
+  return true;
+}
+
+} // namespace
+
+// --- CaptureIndex ---
+
+CaptureIndex::CaptureIndex(const Config &config)
+    : m_config(config), m_postings(config.buckets), m_last(config.buckets) {
+  if (config.block_bytes == 0) {
+    throw std::invalid_argument("Capture index blocks need at least a byte");
+  }
+  if (config.buckets == 0 || (config.buckets & (config.buckets - 1)) != 0) {
+    throw std::invalid_argument(
+        "Capture index bucket count must be a power of two");
+  }
+}
+
+bool CaptureIndex::same_file(const CaptureFileReader &reader) const {
+  if (m_end.position == 0) {
+    return true; // nothing indexed yet
+  }
+  const std::string_view file = reader.contents();
+  return file.length() >= m_end.position &&
+         head_hash(file, m_end.position) == m_head_hash &&
+         tail_hash(file, m_end.position) == m_tail_hash;
+}
+
+uint32_t CaptureIndex::add_state(const CaptureFileReader::Cursor &cursor) {
+  if (m_states.empty() || m_states.back().swapped != cursor.swapped ||
+      m_states.back().interfaces != cursor.interfaces) {
+    m_states.push_back(State{cursor.swapped, cursor.interfaces});
+  }
+  return static_cast<uint32_t>(m_states.size() - 1);
+}
+
+void CaptureIndex::add_posting(uint32_t bucket, uint32_t block) {
+  // Packets of a flow mostly come in runs, so most calls stop here.
+  if (m_last[bucket] == block + 1) {
+    return;
+  }
+  put_varint(m_postings[bucket], block + 1 - m_last[bucket]);
+  m_last[bucket] = block + 1;
+}
+
+uint64_t CaptureIndex::update(CaptureFileReader &reader) {
+  if (!same_file(reader)) {
+    *this = CaptureIndex(m_config);
+  }
+  if (m_end.position == 0) {
+    reader.rewind();
+  } else {
+    reader.seek(m_end);
+  }
+
+  Decoder decoder;
+  LayerStack stack;
+  PacketRef packet;
+  FlowKey flow;
+  const uint64_t before = m_packets;
+  for (;;) {
+    // A block starts at a record, so the reader state there is kept.
+    const bool open =
+        m_blocks.empty() ||
+        reader.position() - m_blocks.back().offset >= m_config.block_bytes;
+    CaptureFileReader::Cursor start;
+    if (open) {
+      start = reader.cursor();
+    }
+    if (!reader.next(packet)) {
+      break;
+    }
+    if (open) {
+      Block block;
+      block.offset = start.position;
+      block.first_ns = block.last_ns = packet.timestamp_ns;
+      block.state = add_state(start);
+      m_blocks.push_back(block);
+    }
+    Block &block = m_blocks.back();
+    block.end = reader.position();
+    block.first_ns = std::min(block.first_ns, packet.timestamp_ns);
+    block.last_ns = std::max(block.last_ns, packet.timestamp_ns);
+    ++block.packets;
+    ++m_packets;
+
+    if (packet_flow(packet, decoder, stack, flow)) {
+      add_posting(static_cast<uint32_t>(flow.hash() & (m_config.buckets - 1)),
+                  static_cast<uint32_t>(m_blocks.size() - 1));
+    }
+  }
+
+  m_end = reader.cursor();
+  m_head_hash = head_hash(reader.contents(), m_end.position);
+  m_tail_hash = tail_hash(reader.contents(), m_end.position);
+  return m_packets - before;
+}
+
+std::vector<std::size_t> CaptureIndex::find(const Query &query) const {
+  const auto in_range = [&query](const Block &block) {
+    return block.last_ns >= query.from_ns && block.first_ns <= query.to_ns;
+  };
+  std::vector<std::size_t> found;
+  if (query.flow.family == 0) {
+    for (std::size_t i = 0; i < m_blocks.size(); ++i) {
+      if (in_range(m_blocks[i])) {
+        found.push_back(i);
+      }
+    }
+    return found;
+  }
+
+  const std::vector<uint8_t> &posting =
+      m_postings[query.flow.canonical().hash() & (m_config.buckets - 1)];
+  const uint8_t *at = posting.data();
+  const uint8_t *end = at + posting.size();
+  uint64_t block = 0;
+  uint64_t delta;
+  while (at < end && get_varint(at, end, delta)) {
+    block += delta;
+    if (in_range(m_blocks[block - 1])) {
+      found.push_back(block - 1);
+    }
+  }
+  return found;
+}
+
+CaptureFileReader::Cursor CaptureIndex::cursor(std::size_t block) const {
+  const State &state = m_states[m_blocks[block].state];
+  return CaptureFileReader::Cursor{m_blocks[block].offset, state.swapped,
+                                   state.interfaces};
+}
+
+void CaptureIndex::save(const std::string &path) const {
+  FileHeader header = {};
+  std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.version = FILE_VERSION;
+  header.buckets = m_config.buckets;
+  header.block_bytes = m_config.block_bytes;
+  header.packets = m_packets;
+  header.head_hash = m_head_hash;
+  header.tail_hash = m_tail_hash;
+  header.end_position = m_end.position;
+  header.states = static_cast<uint32_t>(m_states.size());
+  header.blocks = static_cast<uint32_t>(m_blocks.size());
+
+  std::string out;
+  put(out, header);
+  put_state(out, m_end.swapped, m_end.interfaces);
+  for (const State &state : m_states) {
+    put_state(out, state.swapped, state.interfaces);
+  }
+  out.append(reinterpret_cast<const char *>(m_blocks.data()),
+             m_blocks.size() * sizeof(Block));
+  std::vector<uint8_t> length;
+  for (const std::vector<uint8_t> &posting : m_postings) {
+    length.clear();
+    put_varint(length, posting.size());
+    out.append(length.begin(), length.end());
+    out.append(posting.begin(), posting.end());
+  }
+
+  const std::string temporary = path + ".tmp";
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  file.write(out.data(), static_cast<std::streamsize>(out.size()));
+  file.close();
+  if (!file) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Cannot write capture index " + path);
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    const int error = errno;
+    std::remove(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), path);
+  }
+}
+
+CaptureIndex CaptureIndex::load(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Cannot read capture index " + path);
+  }
+  const std::string data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  if (file.bad()) {
+    throw std::runtime_error("Cannot read capture index " + path);
+  }
+
+  Input in(data, path);
+  const FileHeader header = in.get<FileHeader>();
+  if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+      header.version != FILE_VERSION) {
+    throw std::runtime_error(path + ": not a capture index");
+  }
+  Config config;
+  config.buckets = header.buckets;
+  config.block_bytes = header.block_bytes;
+  if (config.block_bytes == 0 || config.buckets == 0 ||
+      (config.buckets & (config.buckets - 1)) != 0) {
+    in.corrupt();
+  }
+
+  CaptureIndex index(config);
+  index.m_packets = header.packets;
+  index.m_head_hash = header.head_hash;
+  index.m_tail_hash = header.tail_hash;
+  index.m_end.position = header.end_position;
+  get_state(in, index.m_end.swapped, index.m_end.interfaces);
+  // Counts are checked against the bytes left before anything is sized
+  // by them; a state takes at least 4 bytes.
+  if (header.states > in.remaining() / 4) {
+    in.corrupt();
+  }
+  index.m_states.resize(header.states);
+  for (State &state : index.m_states) {
+    get_state(in, state.swapped, state.interfaces);
+  }
+  const uint8_t *blocks = in.take(header.blocks * sizeof(Block));
+  index.m_blocks.resize(header.blocks);
+  std::memcpy(index.m_blocks.data(), blocks, header.blocks * sizeof(Block));
+  for (const Block &block : index.m_blocks) {
+    if (block.state >= header.states || block.offset > block.end ||
+        block.end > header.end_position) {
+      in.corrupt();
+    }
+  }
+
+  // Decoding every list once checks it and finds each bucket's last block.
+  for (uint32_t bucket = 0; bucket < config.buckets; ++bucket) {
+    const uint64_t length = in.varint();
+    const uint8_t *at = in.take(length);
+    const uint8_t *end = at + length;
+    index.m_postings[bucket].assign(at, end);
+    uint64_t block = 0;
+    while (at < end) {
+      uint64_t delta;
+      if (!get_varint(at, end, delta) || delta == 0 ||
+          delta > header.blocks - block) {
+        in.corrupt();
+      }
+      block += delta;
+    }
+    index.m_last[bucket] = static_cast<uint32_t>(block);
+  }
+  if (in.remaining() != 0) {
+    in.corrupt();
+  }
+  return index;
+}
+
+// --- CaptureIndexSniffer ---
+
+CaptureIndexSniffer::CaptureIndexSniffer(const std::string &path,
+                                         const CaptureIndex &index,
+                                         const CaptureIndex::Query &query)
+    : m_reader(path), m_query(query), m_flow(query.flow.canonical()) {
+  for (std::size_t block : index.find(query)) {
+    const CaptureIndex::Block &span = index.blocks()[block];
+    if (span.end > m_reader.file_size()) {
+      throw std::runtime_error(path + ": shorter than its index");
+    }
+    m_spans.push_back(Span{index.cursor(block), span.end});
+    m_bytes += span.end - span.offset;
+  }
+}
+
+bool CaptureIndexSniffer::matches(const PacketRef &packet) {
+  if (packet.timestamp_ns < m_query.from_ns ||
+      packet.timestamp_ns > m_query.to_ns) {
+    return false;
+  }
+  if (m_flow.family == 0) {
+    return true;
+  }
+  FlowKey flow;
+  return packet_flow(packet, m_decoder, m_stack, flow) && flow == m_flow;
+}
+
+int CaptureIndexSniffer::poll(int max_packets, const Callback &callback) {
+  int delivered = 0;
+  PacketRef packet;
+  while (delivered < max_packets) {
+    if (!m_in_span) {
+      if (m_span == m_spans.size() ||
+          m_interrupted.load(std::memory_order_relaxed)) {
+        break;
+      }
+      m_reader.seek(m_spans[m_span].cursor);
+      if (m_span + 1 < m_spans.size()) {
+        const Span &next = m_spans[m_span + 1];
+        m_reader.prefetch(next.cursor.position,
+                          next.end - next.cursor.position);
+      }
+      m_in_span = true;
+    }
+    if (m_reader.position() >= m_spans[m_span].end ||
+        !m_reader.next(packet)) {
+      m_in_span = false;
+      ++m_span;
+      continue;
+    }
+    ++m_scanned;
+    if (matches(packet)) {
+      callback(packet);
+      ++delivered;
+    }
+  }
+  m_received.fetch_add(static_cast<uint64_t>(delivered),
+                       std::memory_order_relaxed);
+  return delivered == 0 ? -1 : delivered;
+}
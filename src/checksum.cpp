@@ -0,0 +1,332 @@
+#include "checksum.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LAYERSPY_X86 1
+#endif
+
+namespace {
+
+constexpr bool LITTLE_ENDIAN_CPU = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+// Ones'-complement addition: the carry out of bit 63 wraps around.
+uint64_t add_carry(uint64_t sum, uint64_t value) {
+  sum += value;
+  return sum + (sum < value ? 1 : 0);
+}
+
+uint16_t fold(uint64_t sum) {
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  return static_cast<uint16_t>(sum);
+}
+
+uint16_t swap16(uint16_t value) {
+  return static_cast<uint16_t>((value >> 8) | (value << 8));
+}
+
+// The last 0-7 bytes, as native-order words. A lone final byte is the first
+// byte of a word whose second byte is zero.
+uint64_t sum_tail(const unsigned char *data, std::size_t length,
+                  uint64_t sum) {
+  if (length >= 4) {
+    uint32_t word;
+    std::memcpy(&word, data, 4);
+    sum = add_carry(sum, word);
+    data += 4;
+    length -= 4;
+  }
+  if (length >= 2) {
+    uint16_t word;
+    std::memcpy(&word, data, 2);
+    sum = add_carry(sum, word);
+    data += 2;
+    length -= 2;
+  }
+  if (length != 0) {
+    const unsigned char pair[2] = {data[0], 0};
+    uint16_t word;
+    std::memcpy(&word, pair, 2);
+    sum = add_carry(sum, word);
+  }
+  return sum;
+}
+
+// `count` native-order 32-bit words; the sum cannot carry out of 64 bits.
+uint64_t sum_words(const unsigned char *data, std::size_t count) {
+  uint64_t sum = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    uint32_t word;
+    std::memcpy(&word, data + 4 * i, 4);
+    sum += word;
+  }
+  return sum;
+}
+
+// --- Scalar: 8 bytes per step ---
+
+uint64_t sum_scalar(const unsigned char *data, std::size_t length) {
+  // Carries are counted apart so the two chains do not wait on each other.
+  uint64_t sum = 0;
+  uint64_t carries = 0;
+  for (; length >= 8; data += 8, length -= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    sum += word;
+    carries += sum < word ? 1 : 0;
+  }
+  return sum_tail(data, length, add_carry(sum, carries));
+}
+
+#ifdef LAYERSPY_X86
+
+// The wide kernels split each 32-bit word into its two 16-bit halves and
+// add those to 32-bit lanes: no shuffles, and no carries to track. A lane
+// gains at most 2 * 0xFFFF per step, so it is drained into the 64-bit sum
+// every BLOCK_STEPS steps.
+constexpr std::size_t BLOCK_STEPS = 16384;
+
+// --- SSE2: 16 bytes per step ---
+
+uint64_t sum_sse2(const unsigned char *data, std::size_t length) {
+  const __m128i low = _mm_set1_epi32(0xFFFF);
+  alignas(16) uint32_t lanes[8];
+  uint64_t sum = 0;
+  while (length >= 16) {
+    __m128i first = _mm_setzero_si128();
+    __m128i second = _mm_setzero_si128();
+    std::size_t steps = std::min(length / 16, BLOCK_STEPS);
+    length -= steps * 16;
+    for (; steps >= 2; steps -= 2, data += 32) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16));
+      first = _mm_add_epi32(first, _mm_and_si128(a, low));
+      second = _mm_add_epi32(second, _mm_srli_epi32(a, 16));
+      first = _mm_add_epi32(first, _mm_and_si128(b, low));
+      second = _mm_add_epi32(second, _mm_srli_epi32(b, 16));
+    }
+    if (steps != 0) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+      first = _mm_add_epi32(first, _mm_and_si128(a, low));
+      second = _mm_add_epi32(second, _mm_srli_epi32(a, 16));
+      data += 16;
+    }
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), first);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes + 4), second);
+    for (uint32_t lane : lanes) {
+      sum += lane;
+    }
+  }
+  return add_carry(sum, sum_scalar(data, length));
+}
+
+// --- AVX2: 32 bytes per step ---
+
+__attribute__((target("avx2"))) uint64_t
+sum_avx2(const unsigned char *data, std::size_t length) {
+  const __m256i low = _mm256_set1_epi32(0xFFFF);
+  alignas(32) uint32_t lanes[16];
+  uint64_t sum = 0;
+  while (length >= 32) {
+    __m256i first = _mm256_setzero_si256();
+    __m256i second = _mm256_setzero_si256();
+    std::size_t steps = std::min(length / 32, BLOCK_STEPS);
+    length -= steps * 32;
+    for (; steps >= 2; steps -= 2, data += 64) {
+      const __m256i a =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+      const __m256i b =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32));
+      first = _mm256_add_epi32(first, _mm256_and_si256(a, low));
+      second = _mm256_add_epi32(second, _mm256_srli_epi32(a, 16));
+      first = _mm256_add_epi32(first, _mm256_and_si256(b, low));
+      second = _mm256_add_epi32(second, _mm256_srli_epi32(b, 16));
+    }
+    if (steps != 0) {
+      const __m256i a =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+      first = _mm256_add_epi32(first, _mm256_and_si256(a, low));
+      second = _mm256_add_epi32(second, _mm256_srli_epi32(a, 16));
+      data += 32;
+    }
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), first);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes + 8), second);
+    for (uint32_t lane : lanes) {
+      sum += lane;
+    }
+  }
+  // Clean upper halves before any SSE code runs, or every SSE instruction
+  // after this pays for the AVX state transition on older cores.
+  _mm256_zeroupper();
+  return add_carry(sum, sum_scalar(data, length));
+}
+
+#endif // LAYERSPY_X86
+
+bool supports(Checksum::Kernel kernel) {
+  switch (kernel) {
+  case Checksum::Kernel::Scalar:
+    return true;
+#ifdef LAYERSPY_X86
+  case Checksum::Kernel::SSE2:
+    return true;
+  case Checksum::Kernel::AVX2: {
+    // Checked once: verify_checksums() asks for every packet.
+    static const bool avx2 = [] {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return avx2;
+  }
+#else
+  default:
+    return false;
+#endif
+  }
+  return false;
+}
+
+// Below this a vector kernel's setup and reduction cost more than the
+// scalar loop: IPv4 headers and pseudo-headers go to the scalar loop.
+constexpr std::size_t VECTOR_MIN = 64;
+
+uint64_t sum_bytes(Checksum::Kernel kernel, const unsigned char *data,
+                   std::size_t length) {
+  if (length < VECTOR_MIN) {
+    return sum_scalar(data, length);
+  }
+  switch (kernel) {
+#ifdef LAYERSPY_X86
+  case Checksum::Kernel::AVX2:
+    return sum_avx2(data, length);
+  case Checksum::Kernel::SSE2:
+    return sum_sse2(data, length);
+#endif
+  default:
+    return sum_scalar(data, length);
+  }
+}
+
+using Result = ChecksumCheck::Result;
+
+constexpr uint8_t PROTO_TCP = 6;
+constexpr uint8_t PROTO_UDP = 17;
+constexpr std::size_t UDP_HEADER_SIZE = 8;
+
+} // namespace
+
+// --- Checksum ---
+
+Checksum::Kernel Checksum::bestKernel() {
+  // CPU features are checked once per process.
+  static const Kernel best = supports(Kernel::AVX2)   ? Kernel::AVX2
+                             : supports(Kernel::SSE2) ? Kernel::SSE2
+                                                      : Kernel::Scalar;
+  return best;
+}
+
+bool Checksum::isSupported(Kernel kernel) { return supports(kernel); }
+
+Checksum::Checksum() : m_kernel(bestKernel()) {}
+
+Checksum::Checksum(Kernel kernel)
+    : m_kernel(supports(kernel) ? kernel : Kernel::Scalar) {}
+
+void Checksum::add(std::string_view bytes) {
+  const uint64_t sum =
+      sum_bytes(m_kernel, reinterpret_cast<const unsigned char *>(bytes.data()),
+                bytes.length());
+  // After an odd number of bytes every word of this piece straddles two
+  // words of the whole: byte-swapping its sum lines them up again.
+  m_sum = add_carry(m_sum, m_odd ? swap16(fold(sum)) : sum);
+  m_odd = m_odd != ((bytes.length() & 1) != 0);
+}
+
+uint16_t Checksum::sum() const {
+  const uint16_t sum = fold(m_sum);
+  return LITTLE_ENDIAN_CPU ? swap16(sum) : sum;
+}
+
+// --- Packets ---
+
+ChecksumCheck verify_checksums(const PacketRef &packet,
+                               const LayerStack &stack,
+                               Checksum::Kernel kernel) {
+  // Headers and pseudo-headers are whole 32-bit words at known places, so
+  // they are summed here directly; only the segment goes through a kernel.
+  // A sum that verifies is 0xFFFF in either byte order, so nothing is
+  // swapped either.
+  ChecksumCheck check;
+  const auto *frame = reinterpret_cast<const unsigned char *>(
+      packet.data.data());
+  uint64_t sum;
+  uint8_t protocol;
+  std::string_view segment; // the TCP or UDP header and payload
+
+  if (const IPv4Header *ipv4 = stack.get<IPv4>()) {
+    const LayerEntry &layer = *stack.entry<IPv4>();
+    const unsigned char *header = frame + layer.offset;
+    check.ipv4 = fold(sum_words(header, layer.header_length / 4)) == 0xFFFF
+                     ? Result::Good
+                     : Result::Bad;
+
+    // The layer is cut at total_length, or earlier by the snap length.
+    if (ipv4->more_fragments || ipv4->fragment_offset != 0 ||
+        ipv4->total_length < layer.header_length ||
+        layer.length < ipv4->total_length) {
+      return check;
+    }
+    protocol = ipv4->protocol;
+    segment = LayerStack::layer_payload(packet.data, layer);
+    sum = sum_words(header + 12, 2); // both addresses
+  } else if (const IPv6Header *ipv6 = stack.get<IPv6>()) {
+    const LayerEntry &layer = *stack.entry<IPv6>();
+    if (ipv6->fragmented ||
+        layer.length < IPv6Header::HEADER_SIZE + ipv6->payload_length ||
+        ipv6->payload_length < ipv6->extension_length) {
+      return check;
+    }
+    protocol = ipv6->upper_protocol;
+    segment = LayerStack::layer_payload(packet.data, layer)
+                  .substr(ipv6->extension_length);
+    sum = sum_words(frame + layer.offset + 8, 8); // both addresses
+  } else {
+    return check;
+  }
+
+  if ((protocol != PROTO_TCP && protocol != PROTO_UDP) ||
+      (packet.flags & (PacketRef::CHECKSUM_VALID |
+                       PacketRef::CHECKSUM_PARTIAL)) != 0) {
+    return check;
+  }
+  const std::size_t header_size =
+      protocol == PROTO_TCP ? TCPHeader::MIN_HEADER_SIZE : UDP_HEADER_SIZE;
+  if (segment.length() < header_size || segment.length() > UINT16_MAX) {
+    return check;
+  }
+  // Zero means no UDP checksum: optional over IPv4, and allowed for
+  // tunnels over IPv6 (RFC 6935).
+  if (protocol == PROTO_UDP && segment[6] == 0 && segment[7] == 0) {
+    return check;
+  }
+
+  // The rest of the pseudo-header. Word order does not matter to the sum,
+  // so IPv6's 32-bit length and 24 zero bits fit the IPv4 layout.
+  const unsigned char pseudo[4] = {
+      0, protocol, static_cast<unsigned char>(segment.length() >> 8),
+      static_cast<unsigned char>(segment.length())};
+  sum += sum_words(pseudo, 1);
+  sum = add_carry(
+      sum, sum_bytes(supports(kernel) ? kernel : Checksum::Kernel::Scalar,
+                     reinterpret_cast<const unsigned char *>(segment.data()),
+                     segment.length()));
+  check.transport = fold(sum) == 0xFFFF ? Result::Good : Result::Bad;
+  return check;
+}
@@ -0,0 +1,563 @@
+#include "column_file.hpp"
+#include "flow_hash.hpp"
+#include "flow_key.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+// Headers and packed words are copied to and from the file as they are in
+// memory.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "column files are little-endian");
+
+namespace {
+
+// --- File layout ---
+
+constexpr char FILE_MAGIC[8] = {'L', 'S', 'P', 'Y', 'C', 'O', 'L', 'S'};
+constexpr uint32_t FILE_VERSION = 1;
+constexpr uint32_t CHUNK_MAGIC = 0x4B4E4843; // "CHNK"
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+enum class Encoding : uint8_t {
+  Packed,     // (value - min) in `bits` bits each, in 64-bit words
+  Delta,      // zigzag varint of the difference to the previous value
+  Dictionary, // addresses: shared prefix length, then the other bytes
+};
+
+struct SectionHeader {
+  uint64_t min;
+  uint64_t max;
+  uint32_t offset; // from the start of the chunk, a multiple of 8
+  uint32_t size;
+  uint32_t count; // values, or dictionary entries
+  Encoding encoding;
+  uint8_t bits;
+  uint16_t reserved;
+};
+
+// The columns, then the address dictionary
+constexpr std::size_t SECTIONS = COLUMN_COUNT + 1;
+constexpr std::size_t DICTIONARY = COLUMN_COUNT;
+
+struct ChunkHeader {
+  uint32_t magic;
+  uint32_t rows;
+  uint64_t bytes; // the whole chunk, header included; a multiple of 8
+  SectionHeader sections[SECTIONS];
+};
+
+static_assert(sizeof(FileHeader) == 16, "FileHeader has no padding");
+static_assert(sizeof(SectionHeader) == 32, "SectionHeader has no padding");
+
+std::size_t column_index(Column column) {
+  return static_cast<std::size_t>(column);
+}
+
+// --- Encoding ---
+
+void align8(std::vector<unsigned char> &out) {
+  out.resize((out.size() + 7) & ~std::size_t{7}, 0);
+}
+
+void put_varint(std::vector<unsigned char> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<unsigned char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<unsigned char>(value));
+}
+
+uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+unsigned bits_for(uint64_t range) {
+  return range == 0 ? 0 : 64U - static_cast<unsigned>(__builtin_clzll(range));
+}
+
+void pack(const std::vector<uint64_t> &values, uint64_t min, unsigned bits,
+          std::vector<unsigned char> &out) {
+  if (bits == 0) {
+    return;
+  }
+  const auto store = [&out](uint64_t word) {
+    const std::size_t at = out.size();
+    out.resize(at + sizeof(word));
+    std::memcpy(out.data() + at, &word, sizeof(word));
+  };
+  uint64_t word = 0;
+  unsigned used = 0;
+  for (uint64_t value : values) {
+    const uint64_t offset = value - min;
+    word |= offset << used;
+    if (used + bits >= 64) {
+      store(word);
+      // The bits of `offset` that did not fit
+      word = used == 0 ? 0 : offset >> (64 - used);
+      used = used + bits - 64;
+    } else {
+      used += bits;
+    }
+  }
+  if (used != 0) {
+    store(word);
+  }
+}
+
+uint64_t load64(const unsigned char *at) {
+  uint64_t word;
+  std::memcpy(&word, at, sizeof(word));
+  return word;
+}
+
+std::size_t address_hash(const std::array<uint8_t, 16> &address) {
+  uint64_t high;
+  uint64_t low;
+  std::memcpy(&high, address.data(), sizeof(high));
+  std::memcpy(&low, address.data() + sizeof(high), sizeof(low));
+  return static_cast<std::size_t>(mix64(high ^ mix64(low)));
+}
+
+[[noreturn]] void corrupt() {
+  throw std::runtime_error("column file: corrupt chunk");
+}
+
+} // namespace
+
+struct ColumnFileReader::Section : SectionHeader {};
+
+// --- ColumnFileWriter ---
+
+ColumnFileWriter::ColumnFileWriter(const std::string &path,
+                                   std::size_t chunk_rows)
+    : m_path(path), m_chunk_rows(chunk_rows) {
+  if (m_chunk_rows == 0) {
+    throw std::invalid_argument("Column file chunks need at least one row");
+  }
+  m_out.open(path, std::ios::binary | std::ios::trunc);
+  FileHeader header{};
+  std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.version = FILE_VERSION;
+  m_out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!m_out) {
+    throw std::runtime_error("Cannot write column file " + path);
+  }
+  m_bytes = sizeof(header);
+  for (auto &column : m_values) {
+    column.reserve(m_chunk_rows);
+  }
+}
+
+ColumnFileWriter::~ColumnFileWriter() {
+  try {
+    close();
+  } catch (const std::exception &) {
+    // Reported by close() when it is called explicitly.
+  }
+}
+
+void ColumnFileWriter::append(const PacketRef &packet,
+                              const LayerStack &stack) {
+  uint8_t layers = 0;
+  layers |= stack.has(LayerKind::Ethernet) ? PacketColumns::HAS_ETHERNET : 0;
+  layers |= stack.has(LayerKind::IPv4) ? PacketColumns::HAS_IPV4 : 0;
+  layers |= stack.has(LayerKind::IPv6) ? PacketColumns::HAS_IPV6 : 0;
+  layers |= stack.has(LayerKind::TCP) ? PacketColumns::HAS_TCP : 0;
+
+  Address src{};
+  Address dst{};
+  uint8_t ttl = 0;
+  FlowKey key;
+  FlowKey::from_packet(packet.data, stack, key);
+  if (const IPv4Header *ipv4 = stack.get<IPv4>()) {
+    src = ColumnFileReader::to_address(ipv4->source_ip);
+    dst = ColumnFileReader::to_address(ipv4->dest_ip);
+    ttl = ipv4->ttl;
+  } else if (const IPv6Header *ipv6 = stack.get<IPv6>()) {
+    src = ipv6->source_ip.bytes();
+    dst = ipv6->dest_ip.bytes();
+    ttl = ipv6->hop_limit;
+  }
+  const TCPHeader *tcp = stack.get<TCP>();
+  add(packet.timestamp_ns, static_cast<uint32_t>(packet.data.length()),
+      layers, src, dst, key.protocol, ttl, key.src_port, key.dst_port,
+      tcp != nullptr ? tcp->flags() : 0,
+      static_cast<uint32_t>(stack.payload_length()));
+}
+
+void ColumnFileWriter::append(const PacketRef *packets,
+                              const PacketColumns &columns) {
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    Address src{};
+    Address dst{};
+    if ((columns.layers[i] & PacketColumns::HAS_IPV4) != 0) {
+      src = Ipv6Address::mapped_ipv4(columns.src_ipv4[i]).bytes();
+      dst = Ipv6Address::mapped_ipv4(columns.dst_ipv4[i]).bytes();
+    } else if ((columns.layers[i] & PacketColumns::HAS_IPV6) != 0) {
+      src = columns.src_ipv6[i];
+      dst = columns.dst_ipv6[i];
+    }
+    add(columns.timestamp_ns[i],
+        static_cast<uint32_t>(packets[i].data.length()), columns.layers[i],
+        src, dst, columns.ip_protocol[i], columns.ttl[i],
+        columns.src_port[i], columns.dst_port[i], columns.tcp_flags[i],
+        columns.payload_length[i]);
+  }
+}
+
+void ColumnFileWriter::add(uint64_t timestamp, uint32_t length,
+                           uint8_t layers, const Address &src,
+                           const Address &dst, uint8_t protocol, uint8_t ttl,
+                           uint16_t src_port, uint16_t dst_port,
+                           uint8_t tcp_flags, uint32_t payload_length) {
+  const auto put = [this](Column column, uint64_t value) {
+    m_values[column_index(column)].push_back(value);
+  };
+  put(Column::Timestamp, timestamp);
+  put(Column::Length, length);
+  put(Column::Layers, layers);
+  put(Column::Protocol, protocol);
+  put(Column::Ttl, ttl);
+  put(Column::SrcPort, src_port);
+  put(Column::DstPort, dst_port);
+  put(Column::TcpFlags, tcp_flags);
+  put(Column::PayloadLength, payload_length);
+  put(Column::SrcAddress, intern(src));
+  put(Column::DstAddress, intern(dst));
+  ++m_rows;
+  if (m_values[column_index(Column::Timestamp)].size() == m_chunk_rows) {
+    write_chunk();
+  }
+}
+
+uint32_t ColumnFileWriter::intern(const Address &address) {
+  if ((m_addresses.size() + 1) * 2 > m_slots.size()) {
+    // Keep the table at most half full.
+    m_slots.assign(std::max<std::size_t>(m_slots.size() * 2, 1024), 0);
+    for (uint32_t i = 0; i < m_addresses.size(); ++i) {
+      std::size_t slot = address_hash(m_addresses[i]) & (m_slots.size() - 1);
+      while (m_slots[slot] != 0) {
+        slot = (slot + 1) & (m_slots.size() - 1);
+      }
+      m_slots[slot] = i + 1;
+    }
+  }
+  std::size_t slot = address_hash(address) & (m_slots.size() - 1);
+  while (m_slots[slot] != 0) {
+    const uint32_t index = m_slots[slot] - 1;
+    if (m_addresses[index] == address) {
+      return index;
+    }
+    slot = (slot + 1) & (m_slots.size() - 1);
+  }
+  m_addresses.push_back(address);
+  m_slots[slot] = static_cast<uint32_t>(m_addresses.size());
+  return static_cast<uint32_t>(m_addresses.size() - 1);
+}
+
+void ColumnFileWriter::write_chunk() {
+  const std::size_t rows = m_values[column_index(Column::Timestamp)].size();
+  if (rows == 0) {
+    return;
+  }
+
+  // Sources and destinations share one dictionary, since most addresses
+  // appear as both. Sorting only the distinct addresses is far cheaper than
+  // sorting every row's.
+  const std::size_t distinct = m_addresses.size();
+  m_order.resize(distinct);
+  for (uint32_t i = 0; i < distinct; ++i) {
+    m_order[i] = i;
+  }
+  std::sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+    return m_addresses[a] < m_addresses[b];
+  });
+  m_rank.resize(distinct);
+  for (uint32_t i = 0; i < distinct; ++i) {
+    m_rank[m_order[i]] = i;
+  }
+  for (Column column : {Column::SrcAddress, Column::DstAddress}) {
+    for (uint64_t &index : m_values[column_index(column)]) {
+      index = m_rank[index];
+    }
+  }
+
+  ChunkHeader header{};
+  header.magic = CHUNK_MAGIC;
+  header.rows = static_cast<uint32_t>(rows);
+  m_chunk.assign(sizeof(ChunkHeader), 0);
+
+  for (std::size_t i = 0; i < COLUMN_COUNT; ++i) {
+    const std::vector<uint64_t> &values = m_values[i];
+    SectionHeader &section = header.sections[i];
+    const auto range = std::minmax_element(values.begin(), values.end());
+    section.min = *range.first;
+    section.max = *range.second;
+    section.count = static_cast<uint32_t>(rows);
+    section.offset = static_cast<uint32_t>(m_chunk.size());
+    if (i == column_index(Column::Timestamp)) {
+      section.encoding = Encoding::Delta;
+      uint64_t previous = section.min;
+      for (uint64_t value : values) {
+        put_varint(m_chunk, zigzag(static_cast<int64_t>(value - previous)));
+        previous = value;
+      }
+    } else {
+      section.encoding = Encoding::Packed;
+      section.bits = static_cast<uint8_t>(bits_for(section.max - section.min));
+      pack(values, section.min, section.bits, m_chunk);
+    }
+    section.size = static_cast<uint32_t>(m_chunk.size() - section.offset);
+    align8(m_chunk);
+  }
+
+  SectionHeader &dictionary = header.sections[DICTIONARY];
+  dictionary.encoding = Encoding::Dictionary;
+  dictionary.count = static_cast<uint32_t>(distinct);
+  dictionary.offset = static_cast<uint32_t>(m_chunk.size());
+  const Address *previous = nullptr;
+  for (uint32_t index : m_order) {
+    const Address &address = m_addresses[index];
+    std::size_t shared = 0;
+    while (previous != nullptr && shared < address.size() &&
+           address[shared] == (*previous)[shared]) {
+      ++shared;
+    }
+    m_chunk.push_back(static_cast<unsigned char>(shared));
+    m_chunk.insert(m_chunk.end(), address.begin() + shared, address.end());
+    previous = &address;
+  }
+  dictionary.size = static_cast<uint32_t>(m_chunk.size() - dictionary.offset);
+  align8(m_chunk);
+
+  header.bytes = m_chunk.size();
+  std::memcpy(m_chunk.data(), &header, sizeof(header));
+  m_out.write(reinterpret_cast<const char *>(m_chunk.data()),
+              static_cast<std::streamsize>(m_chunk.size()));
+  if (!m_out) {
+    throw std::runtime_error("Cannot write column file " + m_path);
+  }
+  m_bytes += m_chunk.size();
+
+  for (auto &column : m_values) {
+    column.clear();
+  }
+  m_addresses.clear();
+  std::fill(m_slots.begin(), m_slots.end(), 0);
+}
+
+void ColumnFileWriter::close() {
+  if (m_closed) {
+    return;
+  }
+  m_closed = true;
+  write_chunk();
+  m_out.close();
+  if (!m_out) {
+    throw std::runtime_error("Cannot write column file " + m_path);
+  }
+}
+
+// --- ColumnFileReader ---
+
+ColumnFileReader::ColumnFileReader(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  struct stat info = {};
+  if (fstat(fd, &info) != 0) {
+    const int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  m_size = static_cast<std::size_t>(info.st_size);
+  if (m_size < sizeof(FileHeader)) {
+    ::close(fd);
+    throw std::runtime_error(path + ": too short for a column file");
+  }
+
+  void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  const int error = errno;
+  ::close(fd); // the mapping keeps the file alive
+  if (mapping == MAP_FAILED) {
+    throw std::system_error(error, std::generic_category(), "mmap " + path);
+  }
+  m_data = static_cast<const unsigned char *>(mapping);
+
+  FileHeader header;
+  std::memcpy(&header, m_data, sizeof(header));
+  if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+      header.version != FILE_VERSION) {
+    munmap(mapping, m_size);
+    throw std::runtime_error(path + ": not a column file");
+  }
+
+  // Only chunk headers are read here; column data is left to the page
+  // cache until a query asks for it.
+  std::size_t offset = sizeof(FileHeader);
+  while (offset < m_size) {
+    ChunkHeader chunk;
+    if (m_size - offset < sizeof(chunk)) {
+      m_truncated = true;
+      break;
+    }
+    std::memcpy(&chunk, m_data + offset, sizeof(chunk));
+    if (chunk.magic != CHUNK_MAGIC || chunk.bytes < sizeof(chunk) ||
+        chunk.bytes > m_size - offset) {
+      m_truncated = true;
+      break;
+    }
+    for (const SectionHeader &section : chunk.sections) {
+      if (section.offset < sizeof(chunk) ||
+          uint64_t{section.offset} + section.size > chunk.bytes) {
+        munmap(mapping, m_size);
+        corrupt();
+      }
+    }
+    m_chunks.push_back(Chunk{offset, chunk.rows});
+    m_rows += chunk.rows;
+    offset += chunk.bytes;
+  }
+}
+
+ColumnFileReader::~ColumnFileReader() {
+  munmap(const_cast<unsigned char *>(m_data), m_size);
+}
+
+std::size_t ColumnFileReader::chunk_rows(std::size_t chunk) const {
+  return m_chunks[chunk].rows;
+}
+
+ColumnFileReader::Section ColumnFileReader::section(std::size_t chunk,
+                                                    std::size_t index) const {
+  Section section;
+  std::memcpy(static_cast<SectionHeader *>(&section),
+              m_data + m_chunks[chunk].offset +
+                  offsetof(ChunkHeader, sections) +
+                  index * sizeof(SectionHeader),
+              sizeof(SectionHeader));
+  return section;
+}
+
+const unsigned char *
+ColumnFileReader::section_data(std::size_t chunk,
+                               const Section &section) const {
+  return m_data + m_chunks[chunk].offset + section.offset;
+}
+
+ColumnStats ColumnFileReader::stats(std::size_t chunk, Column column) const {
+  const Section found = section(chunk, column_index(column));
+  return ColumnStats{found.min, found.max};
+}
+
+void ColumnFileReader::read(std::size_t chunk, Column column,
+                            std::vector<uint64_t> &values) const {
+  const Section found = section(chunk, column_index(column));
+  const unsigned char *data = section_data(chunk, found);
+  const std::size_t rows = found.count;
+  // Every column has a value per row, and a varint takes at least a byte.
+  if (rows != m_chunks[chunk].rows ||
+      (found.encoding == Encoding::Delta && rows > found.size)) {
+    corrupt();
+  }
+  values.resize(rows);
+
+  if (found.encoding == Encoding::Delta) {
+    const unsigned char *end = data + found.size;
+    uint64_t value = found.min;
+    for (std::size_t row = 0; row < rows; ++row) {
+      uint64_t delta = 0;
+      for (unsigned shift = 0;; shift += 7) {
+        if (data == end || shift > 63) {
+          corrupt();
+        }
+        const unsigned char byte = *data++;
+        delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+          break;
+        }
+      }
+      value += static_cast<uint64_t>(unzigzag(delta));
+      values[row] = value;
+    }
+    return;
+  }
+
+  const unsigned bits = found.bits;
+  if (found.encoding != Encoding::Packed || bits > 64 ||
+      (uint64_t{rows} * bits + 63) / 64 * 8 > found.size) {
+    corrupt();
+  }
+  if (bits == 0) {
+    std::fill(values.begin(), values.end(), found.min);
+    return;
+  }
+  const std::size_t words = found.size / 8;
+  const uint64_t mask = bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1;
+  for (std::size_t row = 0; row < rows; ++row) {
+    const std::size_t bit = row * bits;
+    const std::size_t word = bit / 64;
+    const unsigned shift = static_cast<unsigned>(bit % 64);
+    uint64_t value = load64(data + word * 8) >> shift;
+    if (shift + bits > 64 && word + 1 < words) {
+      value |= load64(data + (word + 1) * 8) << (64 - shift);
+    }
+    values[row] = (value & mask) + found.min;
+  }
+}
+
+void ColumnFileReader::dictionary(std::size_t chunk,
+                                  std::vector<Address> &addresses) const {
+  const Section found = section(chunk, DICTIONARY);
+  const unsigned char *data = section_data(chunk, found);
+  const unsigned char *end = data + found.size;
+  // An entry takes at least its prefix length byte.
+  if (found.count > found.size) {
+    corrupt();
+  }
+  addresses.resize(found.count);
+  Address previous{};
+  for (Address &address : addresses) {
+    if (data == end || *data > previous.size()) {
+      corrupt();
+    }
+    const std::size_t shared = *data++;
+    const std::size_t rest = previous.size() - shared;
+    if (static_cast<std::size_t>(end - data) < rest) {
+      corrupt();
+    }
+    std::copy(previous.begin(), previous.begin() + shared, address.begin());
+    std::copy(data, data + rest, address.begin() + shared);
+    data += rest;
+    previous = address;
+  }
+}
+
+ColumnFileReader::Address
+ColumnFileReader::to_address(const Ipv4Address &address) {
+  return Ipv6Address::mapped_ipv4(address.hostOrder()).bytes();
+}
+
+ColumnFileReader::Address
+ColumnFileReader::to_address(const Ipv6Address &address) {
+  return address.bytes();
+}
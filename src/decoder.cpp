@@ -1,135 +1,143 @@
 #include "decoder.hpp"
 
 // Include all our protocol data structs
+#include "byte_order.hpp"
+#include "layer_arena.hpp"
 #include "protocols/ethernet.hpp"
-#include "protocols/ipv4.hpp" // We will create this next
-#include "protocols/ipv6.hpp" // And this after
-#include "protocols/tcp.hpp"  // And this after
-
-// System headers for byte manipulation
-#include <arpa/inet.h> // For ntohs() (Network to Host Short)
-
-// --- Public Decoder Methods ---
-
-std::unique_ptr<BaseProtocol> Decoder::decodePacket(std::string_view data) {
-  // The chain always starts at Layer 2.
-  // We pass the string_view by reference so the parsers can modify it.
-  return parse_ethernet(data);
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include "protocols/tcp.hpp"
+
+namespace {
+
+// Builds one tree node from the flat header stored in the stack.
+template <typename T>
+LayerPtr make_layer(LayerArena &arena, std::string_view data,
+                    const LayerStack &stack, const LayerEntry &entry) {
+  auto layer = arena.make<T>();
+  static_cast<typename LayerTraits<T>::Header &>(*layer) = stack.header<T>();
+  layer->raw_payload = LayerStack::layer_payload(data, entry);
+  return layer;
 }
 
-// --- Private Parser Chain Methods ---
+} // namespace
 
-/**
- * @brief Parses the Layer 2 Ethernet header.
- * THIS IS WHERE YOU LEARN MANUAL PARSING.
- */
-std::unique_ptr<BaseProtocol> Decoder::parse_ethernet(std::string_view &data) {
-  if (data.length() < Ethernet::HEADER_SIZE) {
-    return nullptr;
-  }
+// --- Public Decoder Methods ---
 
-  auto eth = std::make_unique<Ethernet>();
-  const unsigned char *bytes =
-      reinterpret_cast<const unsigned char *>(data.data());
+Decoder::Decoder() : Decoder(ProtocolRegistry::global()) {}
 
-  // --- NEW, CLEANER PARSING ---
-  // 1. Destination MAC (First 6 bytes)
-  eth->dest_mac = MacAddress(bytes);
+Decoder::Decoder(const ProtocolRegistry &registry)
+    : m_registry(&registry), m_arena(std::make_unique<LayerArena>()) {}
 
-  // 2. Source MAC (Next 6 bytes)
-  eth->source_mac = MacAddress(bytes + MacAddress::LENGTH);
-  // --- END NEW PARSING ---
+Decoder::~Decoder() = default;
 
-  eth->eth_type = ntohs(
-      *reinterpret_cast<const uint16_t *>(bytes + Ethernet::ETH_TYPE_OFFSET));
+Decoder::Decoder(Decoder &&) noexcept = default;
 
-  data.remove_prefix(Ethernet::HEADER_SIZE);
+Decoder &Decoder::operator=(Decoder &&) noexcept = default;
 
-  // --- CHAIN OF RESPONSIBILITY ---
-  // Look at the EtherType to decide which parser to call next.
-  switch (eth->eth_type) {
-  case Ethernet::ETH_TYPE_IPV4:      // 0x0800
-    eth->payload = parse_ipv4(data); // Call the L3 parser
-    break;
+bool Decoder::decode(std::string_view data, LayerStack &stack) {
+  stack.clear();
 
-  case Ethernet::ETH_TYPE_IPV6:      // 0x86DD
-    eth->payload = parse_ipv6(data); // (You can add this later)
-    break;
+  // The chain always starts at Layer 2; each parser narrows state.data.
+  DecodeState state{data, data, stack, m_output};
+  m_registry->decode(state);
+  return !stack.empty();
+}
 
-  default:
-    // We don't know this L3 protocol. Stop parsing
-    // and store the rest as the raw payload.
-    eth->raw_payload = data;
-    break;
+std::size_t Decoder::decodeBatch(const PacketRef *packets, std::size_t count,
+                                 PacketColumns &columns) {
+  columns.reset(count);
+  std::size_t decoded = 0;
+
+  for (std::size_t i = 0; i < count; ++i) {
+    columns.timestamp_ns[i] = packets[i].timestamp_ns;
+    if (!decode(packets[i].data, m_stack)) {
+      continue;
+    }
+    ++decoded;
+
+    uint8_t layers = PacketColumns::HAS_ETHERNET;
+    columns.eth_type[i] = m_stack.header<Ethernet>().eth_type;
+
+    // Where a UDP header would start, if this is the first fragment
+    std::string_view ip_payload;
+    if (const IPv4Header *ipv4 = m_stack.get<IPv4>()) {
+      layers |= PacketColumns::HAS_IPV4;
+      columns.src_ipv4[i] = ipv4->source_ip.hostOrder();
+      columns.dst_ipv4[i] = ipv4->dest_ip.hostOrder();
+      columns.ip_protocol[i] = ipv4->protocol;
+      columns.ttl[i] = ipv4->ttl;
+      if (ipv4->fragment_offset == 0) {
+        ip_payload = LayerStack::layer_payload(packets[i].data,
+                                               *m_stack.entry<IPv4>());
+      }
+    } else if (const IPv6Header *ipv6 = m_stack.get<IPv6>()) {
+      layers |= PacketColumns::HAS_IPV6;
+      columns.src_ipv6[i] = ipv6->source_ip.bytes();
+      columns.dst_ipv6[i] = ipv6->dest_ip.bytes();
+      columns.ip_protocol[i] = ipv6->upper_protocol;
+      columns.ttl[i] = ipv6->hop_limit;
+      if (ipv6->fragment_offset == 0) {
+        ip_payload = LayerStack::layer_payload(packets[i].data,
+                                               *m_stack.entry<IPv6>())
+                         .substr(ipv6->extension_length);
+      }
+    }
+
+    if (const TCPHeader *tcp = m_stack.get<TCP>()) {
+      layers |= PacketColumns::HAS_TCP;
+      columns.src_port[i] = tcp->src_port;
+      columns.dst_port[i] = tcp->dst_port;
+      columns.tcp_flags[i] = tcp->flags();
+    } else if (columns.ip_protocol[i] == IPv4Header::PROTO_UDP &&
+               ip_payload.length() >= 4) {
+      // UDP is not a layer of its own; its ports lead the IP payload.
+      const auto *udp =
+          reinterpret_cast<const unsigned char *>(ip_payload.data());
+      columns.src_port[i] = load_be16(udp);
+      columns.dst_port[i] = load_be16(udp + 2);
+    }
+
+    columns.layers[i] = layers;
+    columns.payload_offset[i] = static_cast<uint32_t>(m_stack.payload_offset());
+    columns.payload_length[i] = static_cast<uint32_t>(m_stack.payload_length());
   }
 
-  return eth;
+  return decoded;
 }
 
-/**
- * @brief STUB for Layer 3 IPv4 Parser.
- * This is your next task!
- */
-std::unique_ptr<BaseProtocol> Decoder::parse_ipv4(std::string_view &data) {
-  if(data.length() < IPv4::MIN_HEADER_SIZE) {
+LayerPtr Decoder::decodePacket(std::string_view data) {
+  if (!decode(data, m_stack)) {
     return nullptr;
   }
-
-  auto ipv4 = std::make_unique<IPv4>();
-  const unsigned char *bytes =
-      reinterpret_cast<const unsigned char *>(data.data());
-
-  
-
-  // For now, we'll just set the raw payload and return
-  ipv4->raw_payload = data;
-  return ipv4;
+  return toTree(data, m_stack);
 }
 
-/**
- * @brief STUB for Layer 4 TCP Parser.
- * This is your task after IPv4.
- */
-std::unique_ptr<BaseProtocol> Decoder::parse_tcp(std::string_view &data) {
-  // YOUR TODO:
-  // 1. Create `include/protocols/tcp.hpp`
-  //    Fields: source_port, dest_port, seq_num, ack_num, flags (SYN/ACK/...),
-  //    window_size
-  // 2. A TCP header is *at least* 20 bytes.
-  // 3. Parse all fields. Use ntohs() and ntohl() (Network to Host Long)
-  // 4. **IMPORTANT**: Get the "Data Offset" field.
-  //    The header length is `data_offset * 4` bytes!
-  // 5. Consume the header bytes from the data.
-  // 6. The remaining data is the Application Layer (e.g., HTTP).
-  //    Set `tcp->raw_payload = data;`
-
-  // For now, we'll just set the raw payload
-  auto tcp =
-      std::make_unique<TCP>(); // (This won't compile until you create the file)
-  tcp->raw_payload = data;
-  return tcp;
+LayerPtr Decoder::toTree(std::string_view data, const LayerStack &stack) {
+  LayerPtr root;
+  LayerPtr *next = &root;
+
+  for (const LayerEntry &entry : stack) {
+    switch (entry.kind) {
+    case LayerKind::Ethernet:
+      *next = make_layer<Ethernet>(*m_arena, data, stack, entry);
+      break;
+    case LayerKind::IPv4:
+      *next = make_layer<IPv4>(*m_arena, data, stack, entry);
+      break;
+    case LayerKind::IPv6:
+      *next = make_layer<IPv6>(*m_arena, data, stack, entry);
+      break;
+    case LayerKind::TCP:
+      *next = make_layer<TCP>(*m_arena, data, stack, entry);
+      break;
+    case LayerKind::Count:
+      break;
+    }
+    next = &(*next)->payload;
+  }
+
+  return root;
 }
 
-std::unique_ptr<BaseProtocol> Decoder::parse_ipv6(std::string_view &data) {
-  // YOUR TODO:
-  // 1. Create `include/protocols/ipv6.hpp` (like we did for IPv4)
-  //    It needs fields for: version, traffic_class, flow_label,
-  //    payload_length, next_header, hop_limit, source_ip, dest_ip, etc.
-  // 2. An IPv6 header is 40 bytes. Check data.length().
-  // 3. Create `auto ipv6 = std::make_unique<IPv6>();`
-  // 4. Parse all the fields. Use ntohs() for 16-bit fields.
-  // 5. Consume 40 bytes from the data (data.remove_prefix(40)).
-  // 6. Use a `switch(ipv6->next_header)` to call the next parser:
-  //    case 6: // TCP
-  //        ipv6->payload = parse_tcp(data);
-  //        break;
-  //    case 17: // UDP
-  //        // ipv6->payload = parse_udp(data);
-  //        break;
-
-  // For now, we'll just set the raw payload and return
-  auto ipv6 = std::make_unique<IPv6>(); // (This won't compile until you create
-                                        // the file)
-  ipv6->raw_payload = data;
-  return ipv6;
-}
\ No newline at end of file
+void Decoder::reserve(std::size_t packets) { m_arena->reserve(packets); }
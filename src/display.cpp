@@ -0,0 +1,393 @@
+#include "display.hpp"
+#include "protocols/tcp.hpp"
+#include "relaxed_counter.hpp"
+#include "types/ipv4_address.hpp"
+#include "types/ipv6_address.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <utility>
+
+namespace {
+
+// Summaries a queue hands over per turn, so a busy worker cannot starve
+// the others' output.
+constexpr std::size_t DRAIN_BATCH = 256;
+
+std::size_t round_up(std::size_t value) {
+  std::size_t size = 2;
+  while (size < value) {
+    size <<= 1;
+  }
+  return size;
+}
+
+char *append(char *out, const char *text) {
+  const std::size_t length = std::strlen(text);
+  std::memcpy(out, text, length);
+  return out + length;
+}
+
+char *append_number(char *out, uint64_t value) {
+  return std::to_chars(out, out + 20, value).ptr;
+}
+
+char *append_endpoint(char *out, const FlowKey &flow,
+                      const std::array<uint8_t, 16> &address, uint16_t port) {
+  if (flow.family == 4) {
+    out = Ipv4Address(address.data()).format_to(out);
+  } else {
+    *out++ = '[';
+    out = Ipv6Address(address.data()).format_to(out);
+    *out++ = ']';
+  }
+  if (flow.src_port != 0 || flow.dst_port != 0) {
+    *out++ = ':';
+    out = append_number(out, port);
+  }
+  return out;
+}
+
+const char *protocol_name(uint8_t protocol) {
+  switch (protocol) {
+  case 1:
+    return "ICMP";
+  case 6:
+    return "TCP";
+  case 17:
+    return "UDP";
+  case 58:
+    return "ICMPv6";
+  default:
+    return nullptr;
+  }
+}
+
+// tcpdump's letters, with '.' for ACK
+char *append_flags(char *out, uint8_t flags) {
+  constexpr struct {
+    uint8_t bit;
+    char letter;
+  } LETTERS[] = {{TCPHeader::FLAG_SYN, 'S'}, {TCPHeader::FLAG_FIN, 'F'},
+                 {TCPHeader::FLAG_RST, 'R'}, {TCPHeader::FLAG_PSH, 'P'},
+                 {TCPHeader::FLAG_URG, 'U'}, {TCPHeader::FLAG_ECE, 'E'},
+                 {TCPHeader::FLAG_CWR, 'W'}, {TCPHeader::FLAG_ACK, '.'}};
+  *out++ = ' ';
+  *out++ = '[';
+  for (const auto &letter : LETTERS) {
+    if ((flags & letter.bit) != 0) {
+      *out++ = letter.letter;
+    }
+  }
+  *out++ = ']';
+  return out;
+}
+
+} // namespace
+
+PacketSummary PacketSummary::from(std::size_t worker, const PacketRef &packet,
+                                  const LayerStack &stack) {
+  PacketSummary summary;
+  summary.timestamp_ns = packet.timestamp_ns;
+  summary.length = static_cast<uint32_t>(packet.data.length());
+  summary.payload = static_cast<uint32_t>(stack.payload_length());
+  summary.worker = static_cast<uint16_t>(worker);
+  summary.malformed = stack.empty();
+  FlowKey::from_packet(packet.data, stack, summary.flow);
+  if (const TCPHeader *tcp = stack.get<TCP>()) {
+    summary.tcp = true;
+    summary.tcp_flags = tcp->flags();
+  }
+  return summary;
+}
+
+// --- Queues ---
+
+// A single-producer, single-consumer ring of summaries. Like PacketRing,
+// each side keeps a copy of the other's position and only reloads it when
+// the ring looks full (or empty).
+struct Display::Queue {
+  std::unique_ptr<PacketSummary[]> slots;
+  std::size_t mask = 0;
+
+  // Written only by the worker
+  struct alignas(64) Producer {
+    std::atomic<std::size_t> tail{0};
+    std::size_t cached_head = 0;
+    uint32_t skip = 0; // packets left to skip before the next sample
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> queued{0};
+    std::atomic<uint64_t> dropped{0};
+  } producer;
+
+  // Written only by the display thread
+  struct alignas(64) Consumer {
+    std::atomic<std::size_t> head{0};
+    std::size_t cached_tail = 0;
+  } consumer;
+};
+
+// --- Output buffers ---
+
+// Collects lines in a few large buffers and hands all of them to one
+// writev() once they are full, or when asked to.
+class Display::Writer {
+public:
+  inline static constexpr std::size_t BUFFERS = 8;
+  inline static constexpr std::size_t BUFFER_BYTES = 64 * 1024;
+
+  explicit Writer(int fd)
+      : m_fd(fd), m_storage(std::make_unique<char[]>(BUFFERS * BUFFER_BYTES)) {
+  }
+
+  // Room for one line; commit() says how much of it was used.
+  char *line() {
+    if (BUFFER_BYTES - m_used[m_current] < MAX_LINE) {
+      if (++m_current == BUFFERS) {
+        flush();
+      }
+    }
+    return buffer(m_current) + m_used[m_current];
+  }
+  void commit(char *end) {
+    m_used[m_current] =
+        static_cast<std::size_t>(end - buffer(m_current));
+    ++m_lines;
+  }
+
+  bool pending() const { return m_lines != 0; }
+
+  // Writes every buffered line. Lines of a failed write are dropped.
+  void flush() {
+    iovec parts[BUFFERS];
+    int count = 0;
+    for (std::size_t i = 0; i < BUFFERS && i <= m_current; ++i) {
+      if (m_used[i] != 0) {
+        parts[count++] = iovec{buffer(i), m_used[i]};
+      }
+    }
+    bool ok = true;
+    iovec *next = parts;
+    while (count > 0) {
+      const ssize_t written = writev(m_fd, next, count);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ok = false;
+        break;
+      }
+      // Skip what a short write did take
+      std::size_t done = static_cast<std::size_t>(written);
+      while (count > 0 && done >= next->iov_len) {
+        done -= next->iov_len;
+        ++next;
+        --count;
+      }
+      if (count > 0) {
+        next->iov_base = static_cast<char *>(next->iov_base) + done;
+        next->iov_len -= done;
+      }
+    }
+    if (ok) {
+      m_written += m_lines;
+    } else {
+      ++m_errors;
+    }
+    std::fill(std::begin(m_used), std::end(m_used), 0);
+    m_current = 0;
+    m_lines = 0;
+  }
+
+  // Totals since the last call
+  uint64_t take_written() { return std::exchange(m_written, 0); }
+  uint64_t take_errors() { return std::exchange(m_errors, 0); }
+
+private:
+  char *buffer(std::size_t index) {
+    return m_storage.get() + index * BUFFER_BYTES;
+  }
+
+  int m_fd;
+  std::unique_ptr<char[]> m_storage;
+  std::size_t m_used[BUFFERS] = {};
+  std::size_t m_current = 0;
+  uint64_t m_lines = 0;
+  uint64_t m_written = 0;
+  uint64_t m_errors = 0;
+};
+
+// --- Display ---
+
+Display::Display(const Config &config) : m_config(config) {
+  if (m_config.workers == 0) {
+    throw std::invalid_argument("Display needs at least one worker");
+  }
+  if (m_config.sample_every == 0) {
+    throw std::invalid_argument("Display sampling must be 1 in 1 or more");
+  }
+  m_queues = std::make_unique<Queue[]>(m_config.workers);
+  const std::size_t slots = round_up(m_config.queue_records);
+  for (std::size_t i = 0; i < m_config.workers; ++i) {
+    m_queues[i].slots = std::make_unique<PacketSummary[]>(slots);
+    m_queues[i].mask = slots - 1;
+  }
+  m_thread = std::thread([this] { run(); });
+}
+
+Display::~Display() { stop(); }
+
+bool Display::push(std::size_t worker, const PacketRef &packet,
+                   const LayerStack &stack) {
+  Queue &queue = m_queues[worker];
+  Queue::Producer &producer = queue.producer;
+  bump(producer.pushed);
+  if (producer.skip != 0) {
+    --producer.skip;
+    return true;
+  }
+  producer.skip = m_config.sample_every - 1;
+
+  const std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+  if (tail - producer.cached_head > queue.mask) {
+    producer.cached_head =
+        queue.consumer.head.load(std::memory_order_acquire);
+    if (tail - producer.cached_head > queue.mask) {
+      bump(producer.dropped);
+      return false;
+    }
+  }
+  queue.slots[tail & queue.mask] = PacketSummary::from(worker, packet, stack);
+  producer.tail.store(tail + 1, std::memory_order_release);
+  bump(producer.queued);
+  return true;
+}
+
+void Display::stop() {
+  m_running.store(false, std::memory_order_release);
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+Display::Stats Display::stats() const {
+  Stats stats;
+  for (std::size_t i = 0; i < m_config.workers; ++i) {
+    const Queue::Producer &producer = m_queues[i].producer;
+    stats.pushed += producer.pushed.load(std::memory_order_relaxed);
+    stats.queued += producer.queued.load(std::memory_order_relaxed);
+    stats.dropped += producer.dropped.load(std::memory_order_relaxed);
+  }
+  stats.suppressed = m_suppressed.load(std::memory_order_relaxed);
+  stats.written = m_written.load(std::memory_order_relaxed);
+  stats.write_errors = m_write_errors.load(std::memory_order_relaxed);
+  return stats;
+}
+
+char *Display::format(const PacketSummary &summary, char *out) {
+  out = append_number(out, summary.timestamp_ns / 1000000000);
+  *out++ = '.';
+  // Nanoseconds, zero-padded to 9 digits
+  uint64_t nanoseconds = summary.timestamp_ns % 1000000000;
+  for (int i = 8; i >= 0; --i) {
+    out[i] = static_cast<char>('0' + nanoseconds % 10);
+    nanoseconds /= 10;
+  }
+  out += 9;
+  out = append(out, " #");
+  out = append_number(out, summary.worker);
+
+  const FlowKey &flow = summary.flow;
+  if (flow.family == 0) {
+    out = append(out, summary.malformed ? " MALFORMED" : " ETH");
+  } else {
+    *out++ = ' ';
+    if (const char *name = protocol_name(flow.protocol)) {
+      out = append(out, name);
+    } else {
+      out = append(out, "proto ");
+      out = append_number(out, flow.protocol);
+    }
+    *out++ = ' ';
+    out = append_endpoint(out, flow, flow.src_addr, flow.src_port);
+    out = append(out, " > ");
+    out = append_endpoint(out, flow, flow.dst_addr, flow.dst_port);
+    if (summary.tcp) {
+      out = append_flags(out, summary.tcp_flags);
+    }
+  }
+  out = append(out, " len ");
+  out = append_number(out, summary.length);
+  out = append(out, " payload ");
+  out = append_number(out, summary.payload);
+  *out++ = '\n';
+  return out;
+}
+
+void Display::run() {
+  Writer writer(m_config.fd);
+  const uint32_t rate = m_config.max_lines_per_second;
+  // Token bucket holding up to one second of lines
+  double tokens = rate;
+  auto refilled = std::chrono::steady_clock::now();
+
+  for (;;) {
+    // Read before draining: whatever was pushed before stop() is then
+    // drained in this round at the latest.
+    const bool running = m_running.load(std::memory_order_acquire);
+    if (rate != 0) {
+      const auto now = std::chrono::steady_clock::now();
+      const std::chrono::duration<double> elapsed = now - refilled;
+      tokens = std::min<double>(rate, tokens + elapsed.count() * rate);
+      refilled = now;
+    }
+
+    std::size_t drained = 0;
+    uint64_t suppressed = 0;
+    for (std::size_t i = 0; i < m_config.workers; ++i) {
+      Queue &queue = m_queues[i];
+      Queue::Consumer &consumer = queue.consumer;
+      std::size_t head = consumer.head.load(std::memory_order_relaxed);
+      if (head == consumer.cached_tail) {
+        consumer.cached_tail =
+            queue.producer.tail.load(std::memory_order_acquire);
+      }
+      const std::size_t end =
+          std::min(consumer.cached_tail, head + DRAIN_BATCH);
+      drained += end - head;
+      for (; head != end; ++head) {
+        if (rate != 0) {
+          if (tokens < 1) {
+            ++suppressed;
+            continue;
+          }
+          tokens -= 1;
+        }
+        writer.commit(format(queue.slots[head & queue.mask], writer.line()));
+      }
+      consumer.head.store(head, std::memory_order_release);
+    }
+    if (suppressed != 0) {
+      bump(m_suppressed, suppressed);
+    }
+
+    if (drained == 0) {
+      if (writer.pending()) {
+        writer.flush();
+      }
+    }
+    bump(m_written, writer.take_written());
+    bump(m_write_errors, writer.take_errors());
+    if (drained == 0) {
+      if (!running) {
+        break;
+      }
+      // Nobody is waiting on the output: poll lazily when idle.
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
@@ -0,0 +1,95 @@
+#include "flow_hash.hpp"
+#include "byte_order.hpp"
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Orders the two endpoints before hashing, which is what makes the result
+// independent of direction.
+uint64_t hash_endpoints(uint64_t addr_a, uint16_t port_a, uint64_t addr_b,
+                        uint16_t port_b, uint8_t protocol) {
+  if (addr_b < addr_a || (addr_b == addr_a && port_b < port_a)) {
+    std::swap(addr_a, addr_b);
+    std::swap(port_a, port_b);
+  }
+  uint64_t hash = mix64(addr_a ^ protocol);
+  hash = mix64(hash ^ addr_b);
+  return mix64(hash ^ ((static_cast<uint64_t>(port_a) << 16) | port_b));
+}
+
+bool has_ports(uint8_t protocol) {
+  return protocol == IPv4Header::PROTO_TCP ||
+         protocol == IPv4Header::PROTO_UDP;
+}
+
+// Folds a 16-byte IPv6 address into 64 bits.
+uint64_t fold_ipv6(const unsigned char *addr) {
+  uint64_t high;
+  uint64_t low;
+  std::memcpy(&high, addr, sizeof(high));
+  std::memcpy(&low, addr + 8, sizeof(low));
+  return mix64(high) ^ low;
+}
+
+} // namespace
+
+uint64_t symmetric_flow_hash(std::string_view frame) {
+  constexpr std::size_t L3 = EthernetHeader::HEADER_SIZE;
+  if (frame.length() < L3) {
+    return 0;
+  }
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(frame.data());
+  const uint16_t eth_type =
+      load_be16(bytes + EthernetHeader::ETH_TYPE_OFFSET);
+
+  if (eth_type == EthernetHeader::ETH_TYPE_IPV4) {
+    if (frame.length() < L3 + IPv4Header::MIN_HEADER_SIZE) {
+      return 0;
+    }
+    const unsigned char *ip = bytes + L3;
+    const std::size_t header_len = static_cast<std::size_t>(ip[0] & 0x0F) * 4;
+    const uint8_t protocol = ip[9];
+    const bool fragment = (load_be16(ip + 6) & 0x3FFF) != 0;
+
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    if (has_ports(protocol) && !fragment &&
+        frame.length() >= L3 + header_len + 4) {
+      src_port = load_be16(ip + header_len);
+      dst_port = load_be16(ip + header_len + 2);
+    }
+    return hash_endpoints(load_be32(ip + 12), src_port, load_be32(ip + 16),
+                          dst_port, protocol);
+  }
+
+  if (eth_type == EthernetHeader::ETH_TYPE_IPV6) {
+    if (frame.length() < L3 + IPv6Header::HEADER_SIZE) {
+      return 0;
+    }
+    const unsigned char *ip = bytes + L3;
+    // Past any extension headers, as Decoder::parse_ipv6() does, so this
+    // agrees with FlowKey::from_packet() on the protocol and ports.
+    IPv6Header ipv6{};
+    ipv6.next_header = ip[6];
+    ipv6.parse_extensions(frame.substr(L3 + IPv6Header::HEADER_SIZE));
+    const std::size_t l4 =
+        L3 + IPv6Header::HEADER_SIZE + ipv6.extension_length;
+
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    if (has_ports(ipv6.upper_protocol) && !ipv6.fragmented &&
+        frame.length() >= l4 + 4) {
+      src_port = load_be16(bytes + l4);
+      dst_port = load_be16(bytes + l4 + 2);
+    }
+    return hash_endpoints(fold_ipv6(ip + 8), src_port, fold_ipv6(ip + 24),
+                          dst_port, ipv6.upper_protocol);
+  }
+
+  return 0;
+}
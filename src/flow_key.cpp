@@ -0,0 +1,88 @@
+#include "flow_key.hpp"
+#include "byte_order.hpp"
+#include "flow_hash.hpp"
+#include <utility>
+
+namespace {
+
+uint64_t load64(const uint8_t *bytes) {
+  uint64_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+FlowKey::FlowKey(const Ipv4Address &src, uint16_t sport,
+                 const Ipv4Address &dst, uint16_t dport, uint8_t proto)
+    : src_port(sport), dst_port(dport), protocol(proto), family(4) {
+  const uint32_t src_host = src.hostOrder();
+  const uint32_t dst_host = dst.hostOrder();
+  for (std::size_t i = 0; i < Ipv4Address::LENGTH; ++i) {
+    src_addr[i] = static_cast<uint8_t>(src_host >> (24 - 8 * i));
+    dst_addr[i] = static_cast<uint8_t>(dst_host >> (24 - 8 * i));
+  }
+}
+
+FlowKey::FlowKey(const Ipv6Address &src, uint16_t sport,
+                 const Ipv6Address &dst, uint16_t dport, uint8_t proto)
+    : src_addr(src.bytes()), dst_addr(dst.bytes()), src_port(sport),
+      dst_port(dport), protocol(proto), family(6) {}
+
+bool FlowKey::from_packet(std::string_view packet, const LayerStack &stack,
+                          FlowKey &key) {
+  const LayerEntry *ip = nullptr;
+  std::size_t extensions = 0;
+  bool fragment = false;
+  if (const IPv4Header *ipv4 = stack.get<IPv4>()) {
+    key = FlowKey(ipv4->source_ip, 0, ipv4->dest_ip, 0, ipv4->protocol);
+    ip = stack.entry<IPv4>();
+    // Only the first fragment carries the ports.
+    fragment = ipv4->fragment_offset != 0;
+  } else if (const IPv6Header *ipv6 = stack.get<IPv6>()) {
+    key = FlowKey(ipv6->source_ip, 0, ipv6->dest_ip, 0, ipv6->upper_protocol);
+    ip = stack.entry<IPv6>();
+    extensions = ipv6->extension_length;
+    fragment = ipv6->fragment_offset != 0;
+  } else {
+    return false;
+  }
+
+  if (const TCPHeader *tcp = stack.get<TCP>()) {
+    key.src_port = tcp->src_port;
+    key.dst_port = tcp->dst_port;
+  } else if (key.protocol == IPv4Header::PROTO_UDP && !fragment) {
+    const std::string_view udp =
+        LayerStack::layer_payload(packet, *ip).substr(extensions);
+    if (udp.length() >= 4) {
+      const auto *bytes = reinterpret_cast<const unsigned char *>(udp.data());
+      key.src_port = load_be16(bytes);
+      key.dst_port = load_be16(bytes + 2);
+    }
+  }
+  return true;
+}
+
+FlowKey FlowKey::reversed() const {
+  FlowKey key = *this;
+  std::swap(key.src_addr, key.dst_addr);
+  std::swap(key.src_port, key.dst_port);
+  return key;
+}
+
+FlowKey FlowKey::canonical() const {
+  const int order = std::memcmp(src_addr.data(), dst_addr.data(), 16);
+  if (order > 0 || (order == 0 && src_port > dst_port)) {
+    return reversed();
+  }
+  return *this;
+}
+
+uint64_t FlowKey::hash() const {
+  uint64_t hash = mix64(load64(src_addr.data()) ^ protocol);
+  hash = mix64(hash ^ load64(src_addr.data() + 8));
+  hash = mix64(hash ^ load64(dst_addr.data()));
+  hash = mix64(hash ^ load64(dst_addr.data() + 8));
+  return mix64(hash ^ ((static_cast<uint64_t>(src_port) << 32) |
+                       (static_cast<uint64_t>(dst_port) << 16) | family));
+}
@@ -0,0 +1,22 @@
+#include "flow_tracker.hpp"
+
+bool FlowTracker::update(const PacketRef &packet, const LayerStack &stack) {
+  FlowKey key;
+  if (!FlowKey::from_packet(packet.data, stack, key)) {
+    return false;
+  }
+
+  bool inserted = false;
+  FlowStats &stats =
+      m_table.touch(key.canonical(), packet.timestamp_ns, &inserted);
+  if (inserted) {
+    stats.first_seen_ns = packet.timestamp_ns;
+  }
+  ++stats.packets;
+  stats.bytes += packet.data.length();
+  stats.last_seen_ns = packet.timestamp_ns;
+  if (const TCPHeader *tcp = stack.get<TCP>()) {
+    stats.tcp_flags |= tcp->flags();
+  }
+  return true;
+}
@@ -0,0 +1,310 @@
+#include "fragment_reassembler.hpp"
+#include "byte_order.hpp"
+#include "checksum.hpp"
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// The IPv6 fragment header (RFC 8200, section 4.5)
+constexpr std::size_t IPV6_FRAGMENT_HEADER_SIZE = 8;
+
+void store_be16(char *at, uint16_t value) {
+  at[0] = static_cast<char>(value >> 8);
+  at[1] = static_cast<char>(value);
+}
+
+} // namespace
+
+FragmentReassembler::FragmentReassembler(const Config &config)
+    : m_config(config),
+      m_datagrams(
+          [&config] {
+            FlowTable<Datagram>::Config table;
+            table.max_flows = config.max_datagrams;
+            table.idle_timeout_ns = config.timeout_ns;
+            // Exact LRU, so the datagram being added to is never the one
+            // evicted to make room for it
+            table.lru_slack_ns = 0;
+            return table;
+          }(),
+          [this](const FlowKey &, Datagram &datagram, EvictReason reason) {
+            release(datagram);
+            if (reason == EvictReason::Idle) {
+              ++m_stats.timeouts;
+            } else {
+              ++m_stats.evictions;
+            }
+          }),
+      m_chunk_count(config.memory_cap / CHUNK_SIZE) {
+  if (m_chunk_count == 0 || m_chunk_count > NO_CHUNK) {
+    throw std::invalid_argument("FragmentReassembler: memory_cap out of range");
+  }
+  m_memory = std::make_unique<char[]>(m_chunk_count * CHUNK_SIZE);
+  m_free.reserve(m_chunk_count);
+  for (std::size_t i = m_chunk_count; i > 0; --i) {
+    m_free.push_back(static_cast<uint32_t>(i - 1));
+  }
+  m_output.reserve(MAX_HEADER + MAX_PAYLOAD);
+}
+
+FragmentReassembler::Result
+FragmentReassembler::process(const PacketRef &packet, const LayerStack &stack,
+                             PacketRef &reassembled) {
+  if (const IPv4Header *ipv4 = stack.get<IPv4>()) {
+    if (!ipv4->more_fragments && ipv4->fragment_offset == 0) {
+      return Result::NotFragment;
+    }
+    const LayerEntry &entry = *stack.entry<IPv4>();
+    Fragment fragment;
+    fragment.key = FlowKey(ipv4->source_ip, ipv4->identification,
+                           ipv4->dest_ip, 0, ipv4->protocol);
+    fragment.header =
+        packet.data.substr(0, entry.offset + entry.header_length);
+    fragment.data = LayerStack::layer_payload(packet.data, entry);
+    fragment.offset = static_cast<uint32_t>(ipv4->fragment_offset) * 8;
+    fragment.last = !ipv4->more_fragments;
+    fragment.next_header = ipv4->protocol;
+    return add(fragment, packet.timestamp_ns, reassembled);
+  }
+
+  const IPv6Header *ipv6 = stack.get<IPv6>();
+  if (ipv6 == nullptr || !ipv6->fragmented) {
+    return Result::NotFragment;
+  }
+  // The headers before the Fragment header are the unfragmentable part,
+  // repeated in every fragment; the data starts right after it.
+  const LayerEntry &entry = *stack.entry<IPv6>();
+  const std::string_view payload =
+      LayerStack::layer_payload(packet.data, entry);
+  const auto *bytes = reinterpret_cast<const unsigned char *>(
+      payload.data() + ipv6->fragment_header);
+  const uint16_t offset_flags = load_be16(bytes + 2);
+  const uint32_t identification = load_be32(bytes + 4);
+
+  Fragment fragment;
+  fragment.key = FlowKey(ipv6->source_ip,
+                         static_cast<uint16_t>(identification >> 16),
+                         ipv6->dest_ip,
+                         static_cast<uint16_t>(identification), bytes[0]);
+  fragment.header = packet.data.substr(
+      0, entry.offset + entry.header_length + ipv6->fragment_header);
+  fragment.data =
+      payload.substr(ipv6->fragment_header + IPV6_FRAGMENT_HEADER_SIZE);
+  fragment.offset = offset_flags & 0xFFF8;
+  fragment.last = (offset_flags & 0x0001) == 0;
+  fragment.next_header = bytes[0];
+  fragment.link = static_cast<uint8_t>(ipv6->fragment_link);
+  return add(fragment, packet.timestamp_ns, reassembled);
+}
+
+void FragmentReassembler::clear() {
+  m_datagrams.clear();
+  m_free.clear();
+  for (std::size_t i = m_chunk_count; i > 0; --i) {
+    m_free.push_back(static_cast<uint32_t>(i - 1));
+  }
+}
+
+FragmentReassembler::Result
+FragmentReassembler::add(const Fragment &fragment, uint64_t now_ns,
+                         PacketRef &reassembled) {
+  ++m_stats.fragments;
+  const uint32_t begin = fragment.offset;
+  const uint32_t end = begin + static_cast<uint32_t>(fragment.data.length());
+
+  // Every fragment but the last carries a multiple of 8 bytes.
+  if (end > MAX_PAYLOAD || fragment.header.length() > MAX_HEADER ||
+      (!fragment.last &&
+       (fragment.data.empty() || fragment.data.length() % 8 != 0))) {
+    ++m_stats.invalid;
+    if (Datagram *datagram = m_datagrams.find(fragment.key)) {
+      drop(fragment.key, *datagram);
+    }
+    return Result::Dropped;
+  }
+
+  Datagram &datagram = m_datagrams.touch(fragment.key, now_ns);
+
+  // The end of the datagram must agree with everything seen so far.
+  if ((fragment.last && datagram.last_seen && datagram.total != end) ||
+      (!fragment.last && datagram.last_seen && end > datagram.total)) {
+    ++m_stats.invalid;
+    return drop(fragment.key, datagram);
+  }
+  if (fragment.last) {
+    for (std::size_t i = 0; i < datagram.range_count; ++i) {
+      if (datagram.ranges[i].end > end) {
+        ++m_stats.invalid;
+        return drop(fragment.key, datagram);
+      }
+    }
+    datagram.last_seen = true;
+    datagram.total = end;
+  }
+
+  for (std::size_t i = 0; i < datagram.range_count; ++i) {
+    const Range &range = datagram.ranges[i];
+    if (begin < range.end && end > range.begin) {
+      ++m_stats.overlaps;
+      if (begin >= range.begin && end <= range.end) {
+        return Result::Held; // a repeat of data already held
+      }
+      return drop(fragment.key, datagram);
+    }
+  }
+
+  if (begin != end) {
+    if (!reserve(datagram, begin, end)) {
+      return drop(fragment.key, datagram);
+    }
+    if (!add_range(datagram, begin, end)) {
+      ++m_stats.invalid;
+      return drop(fragment.key, datagram);
+    }
+    copy(datagram, begin, fragment.data);
+  }
+  if (begin == 0) {
+    std::copy(fragment.header.begin(), fragment.header.end(),
+              datagram.header.begin());
+    datagram.header_length = static_cast<uint8_t>(fragment.header.length());
+    datagram.next_header = fragment.next_header;
+    datagram.link = fragment.link;
+  }
+
+  const bool whole =
+      datagram.total == 0
+          ? datagram.range_count == 0
+          : datagram.range_count == 1 && datagram.ranges[0].begin == 0 &&
+                datagram.ranges[0].end == datagram.total;
+  if (!datagram.last_seen || datagram.header_length == 0 || !whole) {
+    return Result::Held;
+  }
+
+  const bool ipv6 = fragment.key.family == 6;
+  // IPv6 counts its extension headers in the payload length, IPv4 its
+  // whole header in the total length.
+  const std::size_t counted =
+      datagram.header_length - EthernetHeader::HEADER_SIZE -
+      (ipv6 ? IPv6Header::HEADER_SIZE : 0);
+  if (counted + datagram.total > MAX_PAYLOAD) {
+    ++m_stats.invalid;
+    return drop(fragment.key, datagram);
+  }
+  build(datagram, ipv6);
+  release(datagram);
+  m_datagrams.erase(fragment.key);
+  ++m_stats.reassembled;
+  reassembled = PacketRef{m_output, now_ns};
+  return Result::Complete;
+}
+
+bool FragmentReassembler::reserve(Datagram &datagram, uint32_t begin,
+                                  uint32_t end) {
+  bool hit_cap = false;
+  for (std::size_t i = begin / CHUNK_SIZE; i <= (end - 1) / CHUNK_SIZE; ++i) {
+    if (datagram.chunks[i] != NO_CHUNK) {
+      continue;
+    }
+    if (m_free.empty()) {
+      if (!hit_cap) {
+        ++m_stats.cap_hits;
+        hit_cap = true;
+      }
+      // This datagram is the most recently used, so it goes last.
+      while (m_free.empty() && m_datagrams.size() > 1) {
+        m_datagrams.evict_lru();
+      }
+      if (m_free.empty()) {
+        return false;
+      }
+    }
+    datagram.chunks[i] = m_free.back();
+    m_free.pop_back();
+  }
+  return true;
+}
+
+void FragmentReassembler::copy(Datagram &datagram, uint32_t offset,
+                               std::string_view data) {
+  while (!data.empty()) {
+    const std::size_t within = offset % CHUNK_SIZE;
+    const std::size_t length = std::min(CHUNK_SIZE - within, data.length());
+    std::copy_n(data.data(), length,
+                chunk(datagram.chunks[offset / CHUNK_SIZE]) + within);
+    data.remove_prefix(length);
+    offset += static_cast<uint32_t>(length);
+  }
+}
+
+bool FragmentReassembler::add_range(Datagram &datagram, uint32_t begin,
+                                    uint32_t end) {
+  // Absorb the ranges this one touches; they never overlap it.
+  for (std::size_t i = 0; i < datagram.range_count;) {
+    const Range &range = datagram.ranges[i];
+    if (range.end == begin || range.begin == end) {
+      begin = std::min<uint32_t>(begin, range.begin);
+      end = std::max<uint32_t>(end, range.end);
+      datagram.ranges[i] = datagram.ranges[--datagram.range_count];
+    } else {
+      ++i;
+    }
+  }
+  if (datagram.range_count == MAX_RANGES) {
+    return false;
+  }
+  datagram.ranges[datagram.range_count++] =
+      Range{static_cast<uint16_t>(begin), static_cast<uint16_t>(end)};
+  return true;
+}
+
+void FragmentReassembler::build(const Datagram &datagram, bool ipv6) {
+  m_output.assign(reinterpret_cast<const char *>(datagram.header.data()),
+                  datagram.header_length);
+  for (uint32_t offset = 0; offset < datagram.total;
+       offset += static_cast<uint32_t>(CHUNK_SIZE)) {
+    const std::size_t length =
+        std::min<std::size_t>(CHUNK_SIZE, datagram.total - offset);
+    m_output.append(chunk(datagram.chunks[offset / CHUNK_SIZE]), length);
+  }
+
+  char *ip = &m_output[EthernetHeader::HEADER_SIZE];
+  const std::size_t header_len =
+      datagram.header_length - EthernetHeader::HEADER_SIZE;
+  if (ipv6) {
+    // The fragment header is gone: the header before it points past it.
+    store_be16(ip + 4, static_cast<uint16_t>(header_len -
+                                             IPv6Header::HEADER_SIZE +
+                                             datagram.total));
+    ip[datagram.link] = static_cast<char>(datagram.next_header);
+    return;
+  }
+  store_be16(ip + 2, static_cast<uint16_t>(header_len + datagram.total));
+  // Keep DF; clear MF and the offset.
+  ip[6] = static_cast<char>(ip[6] & 0x40);
+  ip[7] = 0;
+  ip[10] = 0;
+  ip[11] = 0;
+  Checksum checksum;
+  checksum.add(std::string_view(ip, header_len));
+  store_be16(ip + 10, checksum.checksum());
+}
+
+void FragmentReassembler::release(Datagram &datagram) {
+  for (uint32_t &index : datagram.chunks) {
+    if (index != NO_CHUNK) {
+      m_free.push_back(index);
+      index = NO_CHUNK;
+    }
+  }
+}
+
+FragmentReassembler::Result
+FragmentReassembler::drop(const FlowKey &key, Datagram &datagram) {
+  release(datagram);
+  m_datagrams.erase(key);
+  return Result::Dropped;
+}
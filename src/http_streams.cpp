@@ -0,0 +1,124 @@
+#include "http_streams.hpp"
+
+namespace {
+
+template <typename Value>
+typename FlowTable<Value>::Config table_config(std::size_t max_streams) {
+  typename FlowTable<Value>::Config config;
+  config.max_flows = max_streams;
+  config.idle_timeout_ns = 0;
+  // touch() is given no clock, so only exact LRU keeps the order right.
+  config.lru_slack_ns = 0;
+  return config;
+}
+
+} // namespace
+
+HttpStreams::HttpStreams(std::size_t max_streams, Handler &handler)
+    : m_handler(handler),
+      m_streams(table_config<Stream>(max_streams),
+                [this](const FlowKey &stream, Stream &state, EvictReason) {
+                  // Only ever for capacity: there is no idle timeout.
+                  finish(stream, state);
+                  ++m_evicted;
+                }) {}
+
+void HttpStreams::PendingRequests::push(HttpParser::ResponseFraming framing) {
+  if (m_count == CAPACITY || m_untracked != 0) {
+    // Keep the order: once one request is untracked, so are later ones.
+    ++m_untracked;
+    return;
+  }
+  m_framing[(m_first + m_count) % CAPACITY] = framing;
+  ++m_count;
+}
+
+HttpParser::ResponseFraming HttpStreams::PendingRequests::pop() {
+  if (m_count != 0) {
+    const HttpParser::ResponseFraming framing = m_framing[m_first];
+    m_first = static_cast<uint8_t>((m_first + 1) % CAPACITY);
+    --m_count;
+    return framing;
+  }
+  if (m_untracked != 0) {
+    --m_untracked;
+  }
+  return HttpParser::ResponseFraming::Normal;
+}
+
+void HttpStreams::Forwarder::on_message(const HttpMessage &message) {
+  if (message.is_request) {
+    HttpParser::ResponseFraming framing = HttpParser::ResponseFraming::Normal;
+    if (message.method == "HEAD") {
+      framing = HttpParser::ResponseFraming::NoBody;
+    } else if (message.method == "CONNECT") {
+      framing = HttpParser::ResponseFraming::Tunnel;
+    }
+    m_own.requests.push(framing);
+  } else if (message.status_code >= 200) {
+    // Still in time: the parser frames the body after this call.
+    m_own.parser.expect_response(m_peer != nullptr
+                                     ? m_peer->requests.pop()
+                                     : HttpParser::ResponseFraming::Normal);
+  }
+  m_handler.on_message(m_stream, message);
+}
+
+void HttpStreams::on_data(const FlowKey &stream, std::string_view data) {
+  Stream &own = m_streams.touch(stream, 0);
+  if (own.parser.error() != HttpParser::Error::None) {
+    return;
+  }
+  // Looked up after touch(), which may evict.
+  Stream *peer = m_streams.find(stream.reversed());
+  const uint64_t messages_before = own.parser.messages();
+  Forwarder forwarder(m_handler, stream, own, peer);
+  own.parser.feed(data, forwarder);
+  if (own.parser.in_tunnel() && peer != nullptr) {
+    peer->parser.start_tunnel();
+  }
+  check(stream, own.parser, messages_before);
+}
+
+void HttpStreams::on_gap(const FlowKey &stream, uint64_t bytes) {
+  Stream *own = m_streams.find(stream);
+  if (own == nullptr || own->parser.error() != HttpParser::Error::None) {
+    return;
+  }
+  const uint64_t messages_before = own->parser.messages();
+  Forwarder forwarder(m_handler, stream, *own,
+                      m_streams.find(stream.reversed()));
+  own->parser.skip(bytes, forwarder);
+  check(stream, own->parser, messages_before);
+}
+
+void HttpStreams::on_close(const FlowKey &stream,
+                           TcpReassembler::CloseReason reason) {
+  static_cast<void>(reason);
+  Stream *own = m_streams.find(stream);
+  if (own == nullptr) {
+    return;
+  }
+  finish(stream, *own);
+  m_streams.erase(stream);
+}
+
+void HttpStreams::check(const FlowKey &stream, const HttpParser &parser,
+                        uint64_t messages_before) {
+  m_messages += parser.messages() - messages_before;
+  if (parser.error() != HttpParser::Error::None) {
+    ++m_errors;
+    m_handler.on_error(stream, parser.error());
+  }
+}
+
+void HttpStreams::finish(const FlowKey &stream, Stream &state) {
+  HttpParser &parser = state.parser;
+  if (parser.error() != HttpParser::Error::None) {
+    return;
+  }
+  const uint64_t messages_before = parser.messages();
+  Forwarder forwarder(m_handler, stream, state, nullptr);
+  parser.finish(forwarder);
+  m_messages += parser.messages() - messages_before;
+}
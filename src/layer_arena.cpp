@@ -0,0 +1,20 @@
+#include "layer_arena.hpp"
+
+void LayerArena::reserve(std::size_t packets) {
+  // Every packet has an Ethernet layer; the L3/L4 pools are sized for the
+  // worst case where all of them take the same path.
+  m_ethernet.reserve(packets);
+  m_ipv4.reserve(packets);
+  m_ipv6.reserve(packets);
+  m_tcp.reserve(packets);
+}
+
+std::size_t LayerArena::capacity() const {
+  return m_ethernet.capacity() + m_ipv4.capacity() + m_ipv6.capacity() +
+         m_tcp.capacity();
+}
+
+std::size_t LayerArena::in_use() const {
+  return m_ethernet.in_use() + m_ipv4.in_use() + m_ipv6.in_use() +
+         m_tcp.in_use();
+}
@@ -0,0 +1,476 @@
+#include "layerspy_engine.hpp"
+#include "checksum.hpp"
+#include "decoder.hpp"
+#include "flow_hash.hpp"
+#include "metrics.hpp"
+#include "packet_ring.hpp"
+#include "relaxed_counter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+// Spins briefly, then yields, then sleeps, so an idle worker neither adds
+// latency to the next burst nor burns a core forever.
+void back_off(unsigned &idle_rounds) {
+  ++idle_rounds;
+  if (idle_rounds < 64) {
+    return;
+  }
+  if (idle_rounds < 128) {
+    std::this_thread::yield();
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+constexpr uint64_t DEPTH_SAMPLE = 32;
+
+// Weight of a new per-packet decode time in its running average: 1/8
+constexpr unsigned DECODE_TIME_SHIFT = 3;
+
+uint64_t steady_ns() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+uint64_t wall_clock_ns() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+void pin_to_cpu(std::thread &thread, std::size_t cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(static_cast<int>(cpu), &set);
+  // Best effort: running unpinned is still correct.
+  pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+} // namespace
+
+struct LayerSpyEngine::Worker {
+  explicit Worker(std::size_t worker_index) : index(worker_index) {}
+
+  const std::size_t index;
+  // Only used with a shared capture thread
+  std::unique_ptr<PacketRing> ring;
+
+  // Written only by the capture thread
+  struct alignas(64) CaptureCounters {
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> oversized{0};
+    std::atomic<uint64_t> max_queue_depth{0};
+  } capture;
+
+  // Written only by this worker
+  struct alignas(64) DecodeCounters {
+    std::atomic<uint64_t> handled{0};
+    std::atomic<uint64_t> decoded{0};
+    std::atomic<uint64_t> malformed{0};
+    std::atomic<uint64_t> filtered{0};
+    std::atomic<uint64_t> bad_checksums{0};
+    // Running average of the time to handle one packet (with shed_load)
+    std::atomic<uint64_t> packet_ns{0};
+  } decode;
+
+  // Written only by the thread that samples for this worker: the capture
+  // thread, or the worker itself when it has its own Sniffer
+  struct alignas(64) SheddingCounters {
+    std::atomic<uint64_t> shed{0};
+    std::atomic<uint32_t> sample_rate{1};
+    uint64_t seen = 0; // packets offered, to pace measurements
+  } shedding;
+  std::unique_ptr<LoadShedder> shedder; // with Config::shed_load
+
+  Decoder decoder;
+  LayerStack stack;
+  // With Config::classifier: the batch drained from the ring, its tags
+  std::vector<PacketRef> batch;
+  std::vector<PacketClassifier::Tag> tags;
+  std::thread thread;
+};
+
+LayerSpyEngine::LayerSpyEngine(Sniffer &sniffer, Config config,
+                               Handler handler)
+    : m_sniffers{&sniffer}, m_shared_capture(true), m_config(config),
+      m_handler(std::move(handler)) {
+  const std::size_t count = std::max<std::size_t>(m_config.workers, 1);
+  m_workers.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    m_workers.push_back(std::make_unique<Worker>(i));
+    m_workers.back()->ring = std::make_unique<PacketRing>(m_config.ring_bytes);
+    if (m_config.shed_load) {
+      m_workers.back()->shedder =
+          std::make_unique<LoadShedder>(m_config.shedding);
+    }
+    if (m_config.classifier != nullptr) {
+      m_workers.back()->batch.resize(m_config.decode_batch);
+      m_workers.back()->tags.resize(m_config.decode_batch);
+    }
+  }
+}
+
+LayerSpyEngine::LayerSpyEngine(std::vector<Sniffer *> sniffers,
+                               Config config, Handler handler)
+    : m_sniffers(std::move(sniffers)), m_shared_capture(false),
+      m_config(config), m_handler(std::move(handler)) {
+  m_workers.reserve(m_sniffers.size());
+  for (std::size_t i = 0; i < m_sniffers.size(); ++i) {
+    m_workers.push_back(std::make_unique<Worker>(i));
+    if (m_config.shed_load) {
+      m_workers.back()->shedder =
+          std::make_unique<LoadShedder>(m_config.shedding);
+    }
+    if (m_config.classifier != nullptr) {
+      m_workers.back()->tags.resize(1);
+    }
+  }
+}
+
+LayerSpyEngine::~LayerSpyEngine() { stop(); }
+
+void LayerSpyEngine::start() {
+  if (m_running.exchange(true)) {
+    return;
+  }
+  join(); // threads of a previous run that ended on its own
+  // A previous stop() interrupted them.
+  for (Sniffer *sniffer : m_sniffers) {
+    sniffer->clear_interrupt();
+  }
+  m_capture_done.store(false, std::memory_order_release);
+  m_active.store(m_workers.size(), std::memory_order_release);
+
+  // With pinning the capture thread gets CPU 0 and workers the CPUs after
+  // it, wrapping around when there are more threads than CPUs.
+  const std::size_t cpus =
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+  for (auto &worker : m_workers) {
+    Worker &w = *worker;
+    if (m_shared_capture) {
+      w.thread = std::thread([this, &w] { worker_loop(w); });
+    } else {
+      Sniffer &sniffer = *m_sniffers[w.index];
+      w.thread = std::thread([this, &w, &sniffer] { direct_loop(w, sniffer); });
+    }
+    if (m_config.pin_threads) {
+      pin_to_cpu(w.thread, (w.index + 1) % cpus);
+    }
+  }
+  if (m_shared_capture) {
+    m_capture = std::thread([this] { capture_loop(); });
+    if (m_config.pin_threads) {
+      pin_to_cpu(m_capture, 0);
+    }
+  }
+}
+
+void LayerSpyEngine::stop() {
+  if (m_running.exchange(false)) {
+    for (Sniffer *sniffer : m_sniffers) {
+      sniffer->interrupt();
+    }
+  }
+  join();
+}
+
+void LayerSpyEngine::wait() { join(); }
+
+void LayerSpyEngine::join() {
+  // Workers only exit after the capture thread is done, so join it first.
+  if (m_capture.joinable()) {
+    m_capture.join();
+  }
+  for (auto &worker : m_workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+WorkerStats LayerSpyEngine::stats(std::size_t worker) const {
+  const Worker &w = *m_workers[worker];
+  WorkerStats stats;
+  stats.enqueued = w.capture.enqueued.load(std::memory_order_relaxed);
+  stats.dropped = m_shared_capture
+                      ? w.capture.dropped.load(std::memory_order_relaxed)
+                      : m_sniffers[worker]->stats().dropped;
+  stats.oversized = w.capture.oversized.load(std::memory_order_relaxed);
+  stats.max_queue_depth =
+      w.capture.max_queue_depth.load(std::memory_order_relaxed);
+  stats.decoded = w.decode.decoded.load(std::memory_order_relaxed);
+  stats.malformed = w.decode.malformed.load(std::memory_order_relaxed);
+  stats.filtered = w.decode.filtered.load(std::memory_order_relaxed);
+  stats.bad_checksums =
+      w.decode.bad_checksums.load(std::memory_order_relaxed);
+  stats.shed = w.shedding.shed.load(std::memory_order_relaxed);
+  stats.sample_rate = w.shedding.sample_rate.load(std::memory_order_relaxed);
+  const uint64_t handled = w.decode.handled.load(std::memory_order_relaxed);
+  stats.queue_depth = stats.enqueued > handled ? stats.enqueued - handled : 0;
+  return stats;
+}
+
+WorkerStats LayerSpyEngine::totals() const {
+  WorkerStats total;
+  for (std::size_t i = 0; i < m_workers.size(); ++i) {
+    const WorkerStats worker = stats(i);
+    total.enqueued += worker.enqueued;
+    total.dropped += worker.dropped;
+    total.oversized += worker.oversized;
+    total.decoded += worker.decoded;
+    total.malformed += worker.malformed;
+    total.filtered += worker.filtered;
+    total.bad_checksums += worker.bad_checksums;
+    total.queue_depth += worker.queue_depth;
+    total.max_queue_depth =
+        std::max(total.max_queue_depth, worker.max_queue_depth);
+    total.shed += worker.shed;
+    total.sample_rate = std::max(total.sample_rate, worker.sample_rate);
+  }
+  return total;
+}
+
+// --- Threads ---
+
+void LayerSpyEngine::capture_loop() {
+  const std::size_t count = m_workers.size();
+
+  const Sniffer::Callback enqueue = [this, count](const PacketRef &packet) {
+    const StageTimer timer(Stage::Capture);
+    const uint64_t flow_hash = symmetric_flow_hash(packet.data);
+    Worker &worker = *m_workers[flow_hash % count];
+    PacketRing &ring = *worker.ring;
+    PacketRef queued = packet;
+    if (worker.shedder) {
+      if (++worker.shedding.seen % DEPTH_SAMPLE == 0) {
+        const uint64_t enqueued =
+            worker.capture.enqueued.load(std::memory_order_relaxed);
+        const uint64_t handled =
+            worker.decode.handled.load(std::memory_order_relaxed);
+        // A packet queued now waits for those ahead of it to be handled.
+        const uint64_t depth = enqueued > handled ? enqueued - handled : 0;
+        measure_load(
+            worker,
+            static_cast<double>(ring.used()) /
+                static_cast<double>(ring.capacity()),
+            depth * worker.decode.packet_ns.load(std::memory_order_relaxed));
+      }
+      if (!sample(worker, flow_hash, queued)) {
+        return;
+      }
+    }
+    if (queued.data.length() > ring.max_packet()) {
+      // Waiting for room would never end.
+      bump(worker.capture.oversized);
+      bump(worker.capture.dropped);
+      count_dropped(Stage::Capture);
+      return;
+    }
+    if (!ring.push(queued)) {
+      if (!m_config.block_when_full) {
+        bump(worker.capture.dropped);
+        count_dropped(Stage::Capture);
+        return;
+      }
+      unsigned idle_rounds = 0;
+      while (!ring.push(queued)) {
+        if (!m_running.load(std::memory_order_relaxed)) {
+          bump(worker.capture.dropped);
+          count_dropped(Stage::Capture);
+          return;
+        }
+        back_off(idle_rounds);
+      }
+    }
+    bump(worker.capture.enqueued);
+
+    // Reading the worker's counter pulls its cache line over, so the depth
+    // high-water mark is only sampled every DEPTH_SAMPLE packets.
+    const uint64_t enqueued =
+        worker.capture.enqueued.load(std::memory_order_relaxed);
+    if (enqueued % DEPTH_SAMPLE != 0) {
+      return;
+    }
+    const uint64_t depth =
+        enqueued - worker.decode.handled.load(std::memory_order_relaxed);
+    std::atomic<uint64_t> &max_depth = worker.capture.max_queue_depth;
+    if (depth > max_depth.load(std::memory_order_relaxed)) {
+      max_depth.store(depth, std::memory_order_relaxed);
+    }
+  };
+
+  while (m_running.load(std::memory_order_acquire)) {
+    if (m_sniffers.front()->poll(m_config.poll_batch, enqueue) < 0) {
+      break;
+    }
+  }
+  m_running.store(false, std::memory_order_release);
+  m_capture_done.store(true, std::memory_order_release);
+}
+
+void LayerSpyEngine::handle(Worker &worker, const PacketRef &packet) {
+  // Runs on the raw bytes, so rejected packets cost no decoding at all.
+  if (m_config.filter != nullptr) {
+    bool matched;
+    {
+      const StageTimer timer(Stage::Filter);
+      matched = m_config.filter->matches(packet.data);
+    }
+    if (!matched) {
+      bump(worker.decode.filtered);
+      count_dropped(Stage::Filter);
+      return;
+    }
+  }
+  if (worker.decoder.decode(packet.data, worker.stack)) {
+    bump(worker.decode.decoded);
+    if (m_config.verify_checksums) {
+      const StageTimer timer(Stage::Checksum);
+      if (verify_checksums(packet, worker.stack).bad()) {
+        bump(worker.decode.bad_checksums);
+        count_malformed(Stage::Checksum);
+      }
+    }
+  } else {
+    bump(worker.decode.malformed);
+  }
+  if (m_handler) {
+    const StageTimer timer(Stage::Output);
+    m_handler(worker.index, packet, worker.stack);
+  }
+}
+
+void LayerSpyEngine::handle_batch(Worker &worker, const PacketRef *packets,
+                                  std::size_t count) {
+  if (m_config.classifier == nullptr) {
+    for (std::size_t i = 0; i < count; ++i) {
+      handle(worker, packets[i]);
+    }
+    return;
+  }
+  {
+    const StageTimer timer(Stage::Filter);
+    m_config.classifier->classify(packets, count, worker.tags.data());
+  }
+  const PacketClassifier::Tag mask = m_config.classify_mask;
+  for (std::size_t i = 0; i < count; ++i) {
+    if ((worker.tags[i] & mask) == mask) {
+      handle(worker, packets[i]);
+    } else {
+      bump(worker.decode.filtered);
+      count_dropped(Stage::Filter);
+    }
+  }
+}
+
+void LayerSpyEngine::measure_load(Worker &worker, double queue_fill,
+                                  uint64_t latency_ns) {
+  const uint32_t rate =
+      worker.shedder->update(queue_fill, latency_ns, steady_ns());
+  worker.shedding.sample_rate.store(rate, std::memory_order_relaxed);
+}
+
+bool LayerSpyEngine::sample(Worker &worker, uint64_t flow_hash,
+                            PacketRef &packet) {
+  if (!worker.shedder->keep(flow_hash)) {
+    bump(worker.shedding.shed);
+    return false;
+  }
+  packet.sample_rate = worker.shedder->rate();
+  return true;
+}
+
+void LayerSpyEngine::worker_loop(Worker &worker) {
+  const auto decode = [this, &worker](const PacketRef &packet) {
+    handle(worker, packet);
+  };
+  const auto decode_batch = [this, &worker](const PacketRef *packets,
+                                            std::size_t count) {
+    handle_batch(worker, packets, count);
+  };
+
+  unsigned idle_rounds = 0;
+  for (;;) {
+    // Batches are timed only for load shedding, which needs the time a
+    // packet takes to estimate how long the queue takes to drain.
+    const uint64_t start = worker.shedder ? steady_ns() : 0;
+    const std::size_t handled =
+        m_config.classifier != nullptr
+            ? worker.ring->drain_batch(worker.batch.data(),
+                                       m_config.decode_batch, decode_batch)
+            : worker.ring->drain(m_config.decode_batch, decode);
+    if (handled != 0) {
+      if (worker.shedder) {
+        std::atomic<uint64_t> &average = worker.decode.packet_ns;
+        const uint64_t packet_ns = (steady_ns() - start) / handled;
+        const uint64_t old = average.load(std::memory_order_relaxed);
+        average.store(old - (old >> DECODE_TIME_SHIFT) +
+                          (packet_ns >> DECODE_TIME_SHIFT),
+                      std::memory_order_relaxed);
+      }
+      bump(worker.decode.handled, handled);
+      idle_rounds = 0;
+      continue;
+    }
+    // Everything pushed before m_capture_done was set is visible once the
+    // flag is, so an empty ring at that point really is the end.
+    if (m_capture_done.load(std::memory_order_acquire) &&
+        worker.ring->used() == 0) {
+      break;
+    }
+    back_off(idle_rounds);
+  }
+}
+
+void LayerSpyEngine::direct_loop(Worker &worker, Sniffer &sniffer) {
+  // Packets are decoded inside the Sniffer's callback, straight from its
+  // buffer.
+  uint64_t reached = 0; // handled in this poll, i.e. not shed
+  const Sniffer::Callback decode = [this, &worker,
+                                    &reached](const PacketRef &packet) {
+    if (!worker.shedder) {
+      handle_batch(worker, &packet, 1);
+      ++reached;
+      return;
+    }
+    if (++worker.shedding.seen % DEPTH_SAMPLE == 0) {
+      // The backlog is in the kernel, out of sight; it shows in how old
+      // the packets are by the time they are read.
+      const uint64_t now = wall_clock_ns();
+      measure_load(worker, 0,
+                   now > packet.timestamp_ns ? now - packet.timestamp_ns : 0);
+    }
+    PacketRef sampled = packet;
+    if (sample(worker, symmetric_flow_hash(packet.data), sampled)) {
+      handle_batch(worker, &sampled, 1);
+      ++reached;
+    }
+  };
+
+  const int batch = static_cast<int>(m_config.decode_batch);
+  while (m_running.load(std::memory_order_acquire)) {
+    reached = 0;
+    const int delivered = sniffer.poll(batch, decode);
+    if (delivered < 0) {
+      break;
+    }
+    // As in capture_loop(), shed packets count as neither.
+    bump(worker.capture.enqueued, reached);
+    bump(worker.decode.handled, reached);
+    // The Sniffer times its own reads; just count what it delivered.
+    count_packets(Stage::Capture, static_cast<uint64_t>(delivered));
+  }
+
+  if (m_active.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    m_running.store(false, std::memory_order_release);
+  }
+}
@@ -0,0 +1,137 @@
+#include "lazy_packet.hpp"
+#include "byte_order.hpp"
+
+uint16_t LazyPacket::eth_type() const {
+  if (decoded(LayerKind::Ethernet)) {
+    return present(LayerKind::Ethernet) ? m_ethernet.eth_type : 0;
+  }
+  if (m_data.length() < EthernetHeader::HEADER_SIZE) {
+    return 0;
+  }
+  return load_be16(reinterpret_cast<const unsigned char *>(m_data.data()) +
+                   EthernetHeader::ETH_TYPE_OFFSET);
+}
+
+const LayerEntry *LazyPacket::entry(LayerKind kind) {
+  switch (kind) {
+  case LayerKind::Ethernet:
+    ethernet();
+    break;
+  case LayerKind::IPv4:
+    ipv4();
+    break;
+  case LayerKind::IPv6:
+    ipv6();
+    break;
+  case LayerKind::TCP:
+    tcp();
+    break;
+  case LayerKind::Count:
+    return nullptr;
+  }
+  return present(kind) ? &m_entries[static_cast<std::size_t>(kind)] : nullptr;
+}
+
+std::string_view LazyPacket::payload() {
+  // Innermost first, in the order the Decoder would stack them
+  for (const LayerKind kind : {LayerKind::TCP, LayerKind::IPv6,
+                               LayerKind::IPv4, LayerKind::Ethernet}) {
+    if (const LayerEntry *layer = entry(kind)) {
+      return LayerStack::layer_payload(m_data, *layer);
+    }
+  }
+  // Empty, but anchored at the packet like the Decoder's
+  return m_data.substr(0, 0);
+}
+
+void LazyPacket::found(LayerKind kind, std::size_t offset,
+                       std::size_t header_length, std::size_t length) {
+  m_entries[static_cast<std::size_t>(kind)] =
+      LayerEntry{kind, static_cast<uint16_t>(header_length),
+                 static_cast<uint32_t>(offset), static_cast<uint32_t>(length)};
+  m_present |= bit(kind);
+}
+
+const EthernetHeader *LazyPacket::decode_ethernet() {
+  m_decoded |= bit(LayerKind::Ethernet);
+  const std::size_t header_len = m_ethernet.parse(m_data);
+  if (header_len == 0) {
+    return nullptr;
+  }
+  found(LayerKind::Ethernet, 0, header_len, m_data.length());
+  return &m_ethernet;
+}
+
+const IPv4Header *LazyPacket::decode_ipv4() {
+  m_decoded |= bit(LayerKind::IPv4);
+  if (eth_type() != EthernetHeader::ETH_TYPE_IPV4) {
+    return nullptr;
+  }
+  std::string_view data = m_data.substr(EthernetHeader::HEADER_SIZE);
+  const std::size_t header_len = m_ipv4.parse(data);
+  if (header_len == 0) {
+    return nullptr;
+  }
+  // Drop Ethernet padding, as Decoder::parse_ipv4() does.
+  if (m_ipv4.total_length >= header_len &&
+      m_ipv4.total_length < data.length()) {
+    data = data.substr(0, m_ipv4.total_length);
+  }
+  found(LayerKind::IPv4, EthernetHeader::HEADER_SIZE, header_len,
+        data.length());
+  return &m_ipv4;
+}
+
+const IPv6Header *LazyPacket::decode_ipv6() {
+  m_decoded |= bit(LayerKind::IPv6);
+  if (eth_type() != EthernetHeader::ETH_TYPE_IPV6) {
+    return nullptr;
+  }
+  std::string_view data = m_data.substr(EthernetHeader::HEADER_SIZE);
+  const std::size_t header_len = m_ipv6.parse(data);
+  if (header_len == 0) {
+    return nullptr;
+  }
+  // As Decoder::parse_ipv6(), not for a jumbogram's payload_length of 0
+  if (m_ipv6.payload_length != 0 &&
+      header_len + m_ipv6.payload_length < data.length()) {
+    data = data.substr(0, header_len + m_ipv6.payload_length);
+  }
+  m_ipv6.parse_extensions(data.substr(header_len));
+  found(LayerKind::IPv6, EthernetHeader::HEADER_SIZE, header_len,
+        data.length());
+  return &m_ipv6;
+}
+
+const TCPHeader *LazyPacket::decode_tcp() {
+  m_decoded |= bit(LayerKind::TCP);
+  const LayerEntry *ip = nullptr;
+  std::size_t extensions = 0;
+  if (const IPv4Header *ipv4_header = ipv4()) {
+    // Only the first fragment carries the L4 header.
+    if (ipv4_header->protocol != IPv4Header::PROTO_TCP ||
+        ipv4_header->fragment_offset != 0) {
+      return nullptr;
+    }
+    ip = &m_entries[static_cast<std::size_t>(LayerKind::IPv4)];
+  } else if (const IPv6Header *ipv6_header = ipv6()) {
+    if (ipv6_header->upper_protocol != IPv6Header::NH_TCP ||
+        ipv6_header->fragment_offset != 0) {
+      return nullptr;
+    }
+    ip = &m_entries[static_cast<std::size_t>(LayerKind::IPv6)];
+    extensions = ipv6_header->extension_length;
+  } else {
+    return nullptr;
+  }
+
+  const std::string_view data =
+      LayerStack::layer_payload(m_data, *ip).substr(extensions);
+  const std::size_t header_len = m_tcp.parse(data);
+  if (header_len == 0) {
+    return nullptr;
+  }
+  found(LayerKind::TCP, ip->offset + ip->header_length + extensions,
+        header_len, data.length());
+  return &m_tcp;
+}
@@ -0,0 +1,41 @@
+#include "load_shedder.hpp"
+#include <stdexcept>
+
+LoadShedder::LoadShedder(const Config &config) : m_config(config) {
+  if (!(config.queue_low >= 0 && config.queue_low < config.queue_high &&
+        config.queue_high <= 1)) {
+    throw std::invalid_argument(
+        "LoadShedder queue watermarks need 0 <= low < high <= 1");
+  }
+  if (config.latency_low_ns >= config.latency_high_ns) {
+    throw std::invalid_argument(
+        "LoadShedder latency watermarks need low < high");
+  }
+  if (config.max_rate == 0 ||
+      (config.max_rate & (config.max_rate - 1)) != 0) {
+    throw std::invalid_argument(
+        "LoadShedder max_rate must be a power of two");
+  }
+}
+
+uint32_t LoadShedder::update(double queue_fill, uint64_t latency_ns,
+                             uint64_t now_ns) {
+  // Before the first change there is nothing to hold back from.
+  if (m_changes != 0 && now_ns - m_changed_ns < m_config.hold_ns) {
+    return m_rate;
+  }
+  const bool high = queue_fill >= m_config.queue_high ||
+                    latency_ns >= m_config.latency_high_ns;
+  const bool low = queue_fill <= m_config.queue_low &&
+                   latency_ns <= m_config.latency_low_ns;
+  if (high && m_rate < m_config.max_rate) {
+    m_rate *= 2;
+  } else if (low && m_rate > 1) {
+    m_rate /= 2;
+  } else {
+    return m_rate;
+  }
+  m_changed_ns = now_ns;
+  ++m_changes;
+  return m_rate;
+}
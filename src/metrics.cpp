@@ -0,0 +1,217 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Every thread's block, and the counts of threads that have exited
+struct Registry {
+  std::mutex mutex;
+  std::vector<ThreadMetrics *> live;
+  MetricsSnapshot retired;
+};
+
+Registry &registry() {
+  // Never destroyed, so threads exiting after main() can still retire.
+  static Registry *instance = new Registry;
+  return *instance;
+}
+
+constexpr const char *STAGE_NAMES[STAGE_COUNT] = {
+    "capture", "filter", "ethernet", "ipv4",     "ipv6",
+    "tcp",     "plugin", "checksum", "output"};
+
+void write_counter(std::ostream &out, const MetricsSnapshot &snapshot,
+                   const char *name, const char *help,
+                   uint64_t StageMetrics::*field) {
+  out << "# HELP " << name << ' ' << help << '\n';
+  out << "# TYPE " << name << " counter\n";
+  for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+    out << name << "{stage=\"" << STAGE_NAMES[i] << "\"} "
+        << snapshot.stages[i].*field << '\n';
+  }
+}
+
+} // namespace
+
+const char *stage_name(Stage stage) {
+  return stage < Stage::Count ? STAGE_NAMES[static_cast<std::size_t>(stage)]
+                              : "unknown";
+}
+
+// --- LatencyHistogram ---
+
+uint64_t LatencyHistogram::bucket_limit(std::size_t bucket) {
+  constexpr std::size_t SUB_BUCKETS = std::size_t{1} << SUB_BUCKET_BITS;
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  if (bucket >= BUCKETS - 1) {
+    return UINT64_MAX;
+  }
+  const unsigned shift =
+      static_cast<unsigned>(bucket >> SUB_BUCKET_BITS) - 1;
+  const uint64_t mantissa = SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1));
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+  for (std::size_t i = 0; i < BUCKETS; ++i) {
+    m_buckets[i] += other.m_buckets[i];
+  }
+  m_count += other.m_count;
+  m_sum += other.m_sum;
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+  if (m_count == 0) {
+    return 0;
+  }
+  // The rank of the value, from 1
+  const double clamped = std::clamp(quantile, 0.0, 1.0);
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(clamped * static_cast<double>(m_count) + 0.5));
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < BUCKETS; ++i) {
+    seen += m_buckets[i];
+    if (seen >= rank) {
+      return bucket_limit(i);
+    }
+  }
+  return bucket_limit(BUCKETS - 1);
+}
+
+// --- ThreadMetrics ---
+
+ThreadMetrics::Registration::Registration() : metrics(new ThreadMetrics) {
+  Registry &shared = registry();
+  const std::lock_guard<std::mutex> lock(shared.mutex);
+  shared.live.push_back(metrics);
+}
+
+ThreadMetrics::Registration::~Registration() {
+  Registry &shared = registry();
+  {
+    const std::lock_guard<std::mutex> lock(shared.mutex);
+    metrics->add_to(shared.retired);
+    shared.live.erase(
+        std::find(shared.live.begin(), shared.live.end(), metrics));
+  }
+  delete metrics;
+}
+
+void ThreadMetrics::add_to(MetricsSnapshot &snapshot) const {
+  for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+    const Cell &cell = m_cells[i];
+    StageMetrics &stage = snapshot.stages[i];
+    stage.packets += cell.packets.load(std::memory_order_relaxed);
+    stage.malformed += cell.malformed.load(std::memory_order_relaxed);
+    stage.dropped += cell.dropped.load(std::memory_order_relaxed);
+    // The sum is not kept per bucket; it goes in with the first one.
+    const uint64_t sum = cell.sum.load(std::memory_order_relaxed);
+    for (std::size_t b = 0; b < LatencyHistogram::BUCKETS; ++b) {
+      stage.latency.add(b, cell.buckets[b].load(std::memory_order_relaxed),
+                        b == 0 ? sum : 0);
+    }
+  }
+}
+
+// --- Export ---
+
+MetricsSnapshot collect_metrics() {
+  Registry &shared = registry();
+  const std::lock_guard<std::mutex> lock(shared.mutex);
+  MetricsSnapshot snapshot = shared.retired;
+  for (const ThreadMetrics *metrics : shared.live) {
+    metrics->add_to(snapshot);
+  }
+  return snapshot;
+}
+
+void write_prometheus(std::ostream &out, const MetricsSnapshot &snapshot) {
+  write_counter(out, snapshot, "layerspy_stage_packets_total",
+                "Packets through each stage.", &StageMetrics::packets);
+  write_counter(out, snapshot, "layerspy_stage_malformed_total",
+                "Truncated or invalid headers.", &StageMetrics::malformed);
+  write_counter(out, snapshot, "layerspy_stage_dropped_total",
+                "Packets dropped (capture) or rejected (filter).",
+                &StageMetrics::dropped);
+
+  constexpr const char *NAME = "layerspy_stage_latency_cycles";
+  constexpr std::size_t SUB_BUCKETS = std::size_t{1}
+                                      << LatencyHistogram::SUB_BUCKET_BITS;
+  out << "# HELP " << NAME << " Cycles spent per packet in each stage.\n";
+  out << "# TYPE " << NAME << " histogram\n";
+  for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+    const LatencyHistogram &latency = snapshot.stages[i].latency;
+    const char *stage = STAGE_NAMES[i];
+    // One line per power of two: the last bucket of each octave, starting
+    // with the exact buckets below 8.
+    uint64_t cumulative = 0;
+    for (std::size_t b = 0; b < LatencyHistogram::BUCKETS - 1; ++b) {
+      cumulative += latency.bucket(b);
+      if ((b + 1) % SUB_BUCKETS == 0) {
+        out << NAME << "_bucket{stage=\"" << stage << "\",le=\""
+            << LatencyHistogram::bucket_limit(b) << "\"} " << cumulative
+            << '\n';
+      }
+    }
+    out << NAME << "_bucket{stage=\"" << stage << "\",le=\"+Inf\"} "
+        << latency.count() << '\n';
+    out << NAME << "_sum{stage=\"" << stage << "\"} " << latency.sum()
+        << '\n';
+    out << NAME << "_count{stage=\"" << stage << "\"} " << latency.count()
+        << '\n';
+  }
+}
+
+// --- MetricsFileWriter ---
+
+MetricsFileWriter::MetricsFileWriter(std::string path,
+                                     std::chrono::milliseconds interval)
+    : m_path(std::move(path)), m_interval(interval) {
+  if (!write()) {
+    throw std::runtime_error("Cannot write metrics to " + m_path);
+  }
+  m_thread = std::thread(&MetricsFileWriter::run, this);
+}
+
+MetricsFileWriter::~MetricsFileWriter() {
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+  write();
+}
+
+bool MetricsFileWriter::write() const {
+  const std::string temporary = m_path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::trunc);
+    write_prometheus(out, collect_metrics());
+    out.flush();
+    if (!out) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  return std::rename(temporary.c_str(), m_path.c_str()) == 0;
+}
+
+void MetricsFileWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_wake.wait_for(lock, m_interval, [this] { return m_stop; })) {
+    lock.unlock();
+    if (!write()) {
+      ++m_failures;
+    }
+    lock.lock();
+  }
+}
@@ -0,0 +1,108 @@
+#include "packet_classifier.hpp"
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+
+namespace {
+
+using Tag = PacketClassifier::Tag;
+
+// Header positions relative to the start of the frame
+constexpr std::size_t ETH_LEN = Ethernet::HEADER_SIZE;       // 14
+constexpr std::size_t IPV6_L4 = ETH_LEN + IPv6::HEADER_SIZE; // 54
+constexpr std::size_t IP_FRAG = ETH_LEN + 6;   // IPv4 flags / fragment offset
+constexpr std::size_t IPV6_NH = ETH_LEN + 6;   // IPv6 next header
+constexpr std::size_t IPV4_PROTO = ETH_LEN + 9;
+
+Tag classify_one(const unsigned char *b, std::size_t len,
+                 const PacketClassifier &classifier) {
+  // Nothing after the Ethernet header: no L3 byte to look at
+  if (len <= ETH_LEN) {
+    return PacketClassifier::L3_NONE;
+  }
+
+  const uint16_t eth_type = static_cast<uint16_t>((b[12] << 8) | b[13]);
+  const uint8_t version = b[14] >> 4;
+  std::size_t l4 = 0;
+  uint8_t proto = 0;
+  bool first_fragment = true;
+  Tag tag = 0;
+
+  if (eth_type == Ethernet::ETH_TYPE_IPV4) {
+    tag = PacketClassifier::L3_IPV4;
+    const std::size_t ihl = b[14] & 0x0F;
+    if (version != 4 || ihl < 5 || len < ETH_LEN + ihl * 4) {
+      return tag | PacketClassifier::TRUNCATED;
+    }
+    const uint16_t frag = static_cast<uint16_t>((b[IP_FRAG] << 8) |
+                                                b[IP_FRAG + 1]);
+    if ((frag & 0x3FFF) != 0) {
+      tag |= PacketClassifier::FRAGMENT;
+      first_fragment = (frag & 0x1FFF) == 0;
+    }
+    proto = b[IPV4_PROTO];
+    l4 = ETH_LEN + ihl * 4;
+  } else if (eth_type == Ethernet::ETH_TYPE_IPV6) {
+    tag = PacketClassifier::L3_IPV6;
+    if (version != 6 || len < IPV6_L4) {
+      return tag | PacketClassifier::TRUNCATED;
+    }
+    proto = b[IPV6_NH];
+    l4 = IPV6_L4;
+  } else {
+    return PacketClassifier::L3_NONE;
+  }
+
+  if (proto == IPv4::PROTO_TCP) {
+    tag |= PacketClassifier::TCP;
+  } else if (proto == IPv4::PROTO_UDP) {
+    tag |= PacketClassifier::UDP;
+  } else {
+    return tag;
+  }
+
+  if (!first_fragment) {
+    return tag;
+  }
+  if (len < l4 + 4) {
+    return tag | PacketClassifier::TRUNCATED;
+  }
+
+  const uint16_t src_port = static_cast<uint16_t>((b[l4] << 8) | b[l4 + 1]);
+  const uint16_t dst_port =
+      static_cast<uint16_t>((b[l4 + 2] << 8) | b[l4 + 3]);
+  if (classifier.isMonitored(src_port) || classifier.isMonitored(dst_port)) {
+    tag |= PacketClassifier::MONITORED;
+  }
+  return tag;
+}
+
+} // namespace
+
+void PacketClassifier::monitorPort(uint16_t port) {
+  m_port_bitmap[port >> 5] |= 1U << (port & 31);
+}
+
+void PacketClassifier::unmonitorPort(uint16_t port) {
+  m_port_bitmap[port >> 5] &= ~(1U << (port & 31));
+}
+
+void PacketClassifier::classify(const PacketRef *packets, std::size_t count,
+                                Tag *tags) const {
+  for (std::size_t i = 0; i < count; ++i) {
+    tags[i] = classify_one(
+        reinterpret_cast<const unsigned char *>(packets[i].data.data()),
+        packets[i].data.size(), *this);
+  }
+}
+
+std::size_t PacketClassifier::select(const Tag *tags, std::size_t count,
+                                     Tag mask, uint32_t *indices) {
+  // Branch-free compaction: always write, advance only on a match.
+  std::size_t selected = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    indices[selected] = static_cast<uint32_t>(i);
+    selected += (tags[i] & mask) == mask;
+  }
+  return selected;
+}
@@ -0,0 +1,18 @@
+#include "packet_columns.hpp"
+
+void PacketColumns::reset(std::size_t rows) {
+  layers.assign(rows, 0);
+  timestamp_ns.assign(rows, 0);
+  eth_type.assign(rows, 0);
+  src_ipv4.assign(rows, 0);
+  dst_ipv4.assign(rows, 0);
+  src_ipv6.assign(rows, Ipv6Lane{});
+  dst_ipv6.assign(rows, Ipv6Lane{});
+  ip_protocol.assign(rows, 0);
+  ttl.assign(rows, 0);
+  src_port.assign(rows, 0);
+  dst_port.assign(rows, 0);
+  tcp_flags.assign(rows, 0);
+  payload_offset.assign(rows, 0);
+  payload_length.assign(rows, 0);
+}
@@ -0,0 +1,1346 @@
+#include "packet_filter.hpp"
+#include "byte_order.hpp"
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include "protocols/tcp.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// --- Fields ---
+
+enum class Layer : uint8_t { Ethernet, IPv4, IPv6, TCP };
+
+enum class FieldType : uint8_t {
+  Protocol, // the layer itself; only valid bare
+  Number,
+  Ipv4Address,
+  Ipv6Address,
+};
+
+/**
+ * A field is `size` big-endian bytes at `offset` from the start of its
+ * layer's header, shifted right by `shift` and masked with `mask`.
+ */
+struct Field {
+  const char *name;
+  Layer layer;
+  FieldType type;
+  uint8_t offset;
+  uint8_t size;
+  uint8_t shift;
+  uint32_t mask;
+};
+
+constexpr uint32_t ALL = 0xFFFFFFFF;
+
+const Field FIELDS[] = {
+    {"eth", Layer::Ethernet, FieldType::Protocol, 0, 0, 0, 0},
+    {"eth.type", Layer::Ethernet, FieldType::Number,
+     EthernetHeader::ETH_TYPE_OFFSET, 2, 0, 0xFFFF},
+
+    {"ip", Layer::IPv4, FieldType::Protocol, 0, 0, 0, 0},
+    {"ip.dscp", Layer::IPv4, FieldType::Number, 1, 1, 2, 0x3F},
+    {"ip.len", Layer::IPv4, FieldType::Number, 2, 2, 0, 0xFFFF},
+    {"ip.id", Layer::IPv4, FieldType::Number, 4, 2, 0, 0xFFFF},
+    {"ip.flags.df", Layer::IPv4, FieldType::Number, 6, 1, 6, 0x1},
+    {"ip.flags.mf", Layer::IPv4, FieldType::Number, 6, 1, 5, 0x1},
+    {"ip.frag_offset", Layer::IPv4, FieldType::Number, 6, 2, 0, 0x1FFF},
+    {"ip.ttl", Layer::IPv4, FieldType::Number, 8, 1, 0, 0xFF},
+    {"ip.proto", Layer::IPv4, FieldType::Number, 9, 1, 0, 0xFF},
+    {"ip.src", Layer::IPv4, FieldType::Ipv4Address, 12, 4, 0, ALL},
+    {"ip.dst", Layer::IPv4, FieldType::Ipv4Address, 16, 4, 0, ALL},
+
+    {"ipv6", Layer::IPv6, FieldType::Protocol, 0, 0, 0, 0},
+    {"ipv6.tclass", Layer::IPv6, FieldType::Number, 0, 2, 4, 0xFF},
+    {"ipv6.flow", Layer::IPv6, FieldType::Number, 0, 4, 0, 0xFFFFF},
+    {"ipv6.plen", Layer::IPv6, FieldType::Number, 4, 2, 0, 0xFFFF},
+    {"ipv6.nxt", Layer::IPv6, FieldType::Number, 6, 1, 0, 0xFF},
+    {"ipv6.hlim", Layer::IPv6, FieldType::Number, 7, 1, 0, 0xFF},
+    {"ipv6.src", Layer::IPv6, FieldType::Ipv6Address, 8, 16, 0, 0},
+    {"ipv6.dst", Layer::IPv6, FieldType::Ipv6Address, 24, 16, 0, 0},
+
+    {"tcp", Layer::TCP, FieldType::Protocol, 0, 0, 0, 0},
+    {"tcp.src_port", Layer::TCP, FieldType::Number, 0, 2, 0, 0xFFFF},
+    {"tcp.dst_port", Layer::TCP, FieldType::Number, 2, 2, 0, 0xFFFF},
+    {"tcp.seq", Layer::TCP, FieldType::Number, 4, 4, 0, ALL},
+    {"tcp.ack", Layer::TCP, FieldType::Number, 8, 4, 0, ALL},
+    {"tcp.data_offset", Layer::TCP, FieldType::Number, 12, 1, 4, 0xF},
+    {"tcp.flags", Layer::TCP, FieldType::Number, 13, 1, 0, 0xFF},
+    {"tcp.flags.fin", Layer::TCP, FieldType::Number, 13, 1, 0, 0x1},
+    {"tcp.flags.syn", Layer::TCP, FieldType::Number, 13, 1, 1, 0x1},
+    {"tcp.flags.rst", Layer::TCP, FieldType::Number, 13, 1, 2, 0x1},
+    {"tcp.flags.psh", Layer::TCP, FieldType::Number, 13, 1, 3, 0x1},
+    {"tcp.flags.ack", Layer::TCP, FieldType::Number, 13, 1, 4, 0x1},
+    {"tcp.flags.urg", Layer::TCP, FieldType::Number, 13, 1, 5, 0x1},
+    {"tcp.flags.ece", Layer::TCP, FieldType::Number, 13, 1, 6, 0x1},
+    {"tcp.flags.cwr", Layer::TCP, FieldType::Number, 13, 1, 7, 0x1},
+    {"tcp.window", Layer::TCP, FieldType::Number, 14, 2, 0, 0xFFFF},
+};
+
+// Fields that match either direction
+struct EitherField {
+  const char *name;
+  const char *first;
+  const char *second;
+};
+
+const EitherField EITHER_FIELDS[] = {
+    {"ip.addr", "ip.src", "ip.dst"},
+    {"ipv6.addr", "ipv6.src", "ipv6.dst"},
+    {"tcp.port", "tcp.src_port", "tcp.dst_port"},
+};
+
+int find_field(std::string_view name) {
+  for (std::size_t i = 0; i < sizeof(FIELDS) / sizeof(FIELDS[0]); ++i) {
+    if (name == FIELDS[i].name) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+// --- Comparisons ---
+
+enum Op : uint8_t {
+  OP_PRESENT, // the field's layer is there
+  OP_EQ,      // (field & mask) == value
+  OP_NE,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_PREFIX6, // IPv6 address field in prefix number `value`
+};
+
+// --- Locating layers in a raw frame ---
+
+/**
+ * Finds the layers of one frame the way the Decoder does, each one only the
+ * first time a comparison needs it.
+ */
+class Cursor {
+public:
+  explicit Cursor(std::string_view packet)
+      : m_bytes(reinterpret_cast<const unsigned char *>(packet.data())),
+        m_length(packet.length()) {}
+
+  // Offset of `layer`'s header, or NONE if the frame does not carry it.
+  std::size_t offset(Layer layer) {
+    switch (layer) {
+    case Layer::Ethernet:
+      return m_length >= EthernetHeader::HEADER_SIZE ? 0 : NONE;
+    case Layer::IPv4:
+      return network() == 4 ? EthernetHeader::HEADER_SIZE : NONE;
+    case Layer::IPv6:
+      return network() == 6 ? EthernetHeader::HEADER_SIZE : NONE;
+    case Layer::TCP:
+      return transport();
+    }
+    return NONE;
+  }
+
+  const unsigned char *bytes() const { return m_bytes; }
+
+  inline static constexpr std::size_t NONE = SIZE_MAX;
+
+private:
+  // 4 or 6 for the IP version found, 0 for none
+  int network() {
+    if (m_network < 0) {
+      m_network = find_network();
+    }
+    return m_network;
+  }
+
+  int find_network() {
+    if (m_length < EthernetHeader::HEADER_SIZE) {
+      return 0;
+    }
+    const unsigned char *ip = m_bytes + EthernetHeader::HEADER_SIZE;
+    std::size_t available = m_length - EthernetHeader::HEADER_SIZE;
+    const uint16_t eth_type =
+        load_be16(m_bytes + EthernetHeader::ETH_TYPE_OFFSET);
+
+    if (eth_type == EthernetHeader::ETH_TYPE_IPV4) {
+      if (available < IPv4Header::MIN_HEADER_SIZE || (ip[0] >> 4) != 4) {
+        return 0;
+      }
+      const std::size_t header_len = static_cast<std::size_t>(ip[0] & 0x0F) * 4;
+      if (header_len < IPv4Header::MIN_HEADER_SIZE || header_len > available) {
+        return 0;
+      }
+      // Drop Ethernet padding, as Decoder::parse_ipv4() does.
+      const std::size_t total_length = load_be16(ip + 2);
+      if (total_length >= header_len && total_length < available) {
+        available = total_length;
+      }
+      m_ip_header = header_len;
+      m_ip_length = available;
+      return 4;
+    }
+
+    if (eth_type == EthernetHeader::ETH_TYPE_IPV6) {
+      if (available < IPv6Header::HEADER_SIZE || (ip[0] >> 4) != 6) {
+        return 0;
+      }
+      // Not for a jumbogram's payload_length of 0
+      const std::size_t payload_length = load_be16(ip + 4);
+      if (payload_length != 0 &&
+          IPv6Header::HEADER_SIZE + payload_length < available) {
+        available = IPv6Header::HEADER_SIZE + payload_length;
+      }
+      m_ip_header = IPv6Header::HEADER_SIZE;
+      m_ip_length = available;
+      return 6;
+    }
+    return 0;
+  }
+
+  std::size_t transport() {
+    if (m_transport == UNKNOWN) {
+      m_transport = find_transport();
+    }
+    return m_transport;
+  }
+
+  std::size_t find_transport() {
+    const unsigned char *ip = m_bytes + EthernetHeader::HEADER_SIZE;
+    switch (network()) {
+    case 4:
+      // Only the first fragment carries the L4 header.
+      if (ip[9] != IPv4Header::PROTO_TCP ||
+          (load_be16(ip + 6) & 0x1FFF) != 0) {
+        return NONE;
+      }
+      break;
+    case 6: {
+      // Past any extension headers, as Decoder::parse_ipv6() does
+      IPv6Header ipv6{};
+      ipv6.next_header = ip[6];
+      ipv6.parse_extensions(std::string_view(
+          reinterpret_cast<const char *>(ip) + m_ip_header,
+          m_ip_length - m_ip_header));
+      if (ipv6.upper_protocol != IPv6Header::NH_TCP ||
+          ipv6.fragment_offset != 0) {
+        return NONE;
+      }
+      m_ip_header += ipv6.extension_length;
+      break;
+    }
+    default:
+      return NONE;
+    }
+
+    const std::size_t available = m_ip_length - m_ip_header;
+    if (available < TCPHeader::MIN_HEADER_SIZE) {
+      return NONE;
+    }
+    const std::size_t tcp = EthernetHeader::HEADER_SIZE + m_ip_header;
+    const std::size_t header_len =
+        static_cast<std::size_t>(m_bytes[tcp + 12] >> 4) * 4;
+    if (header_len < TCPHeader::MIN_HEADER_SIZE || header_len > available) {
+      return NONE;
+    }
+    return tcp;
+  }
+
+  inline static constexpr std::size_t UNKNOWN = SIZE_MAX - 1;
+
+  const unsigned char *m_bytes;
+  std::size_t m_length;
+  int m_network = -1;
+  std::size_t m_ip_header = 0; // with IPv6 extension headers once walked
+  std::size_t m_ip_length = 0; // IP header + payload, padding trimmed
+  std::size_t m_transport = UNKNOWN;
+};
+
+uint32_t load_field(const Field &field, const unsigned char *bytes) {
+  uint32_t value = 0;
+  switch (field.size) {
+  case 1:
+    value = bytes[0];
+    break;
+  case 2:
+    value = load_be16(bytes);
+    break;
+  case 4:
+    value = load_be32(bytes);
+    break;
+  default:
+    break;
+  }
+  return (value >> field.shift) & field.mask;
+}
+
+bool in_prefix(const unsigned char *address,
+               const std::array<uint8_t, 16> &prefix, std::size_t length) {
+  const std::size_t whole = length / 8;
+  if (std::memcmp(address, prefix.data(), whole) != 0) {
+    return false;
+  }
+  const unsigned bits = length % 8;
+  if (bits == 0) {
+    return true;
+  }
+  const uint8_t mask = static_cast<uint8_t>(0xFF << (8 - bits));
+  return (address[whole] & mask) == prefix[whole];
+}
+
+// --- Classic BPF ---
+
+// Opcode parts, as in <linux/filter.h> and <pcap/bpf.h>
+constexpr uint16_t BPF_LD = 0x00;
+constexpr uint16_t BPF_LDX = 0x01;
+constexpr uint16_t BPF_ST = 0x02;
+constexpr uint16_t BPF_ALU = 0x04;
+constexpr uint16_t BPF_JMP = 0x05;
+constexpr uint16_t BPF_RET = 0x06;
+constexpr uint16_t BPF_MISC = 0x07;
+
+constexpr uint16_t BPF_W = 0x00;
+constexpr uint16_t BPF_H = 0x08;
+constexpr uint16_t BPF_B = 0x10;
+
+constexpr uint16_t BPF_IMM = 0x00;
+constexpr uint16_t BPF_ABS = 0x20;
+constexpr uint16_t BPF_IND = 0x40;
+constexpr uint16_t BPF_MEM = 0x60;
+constexpr uint16_t BPF_LEN = 0x80;
+constexpr uint16_t BPF_MSH = 0xA0;
+
+constexpr uint16_t BPF_ADD = 0x00;
+constexpr uint16_t BPF_SUB = 0x10;
+constexpr uint16_t BPF_AND = 0x50;
+constexpr uint16_t BPF_LSH = 0x60;
+constexpr uint16_t BPF_RSH = 0x70;
+
+constexpr uint16_t BPF_JA = 0x00;
+constexpr uint16_t BPF_JEQ = 0x10;
+constexpr uint16_t BPF_JGT = 0x20;
+constexpr uint16_t BPF_JGE = 0x30;
+constexpr uint16_t BPF_JSET = 0x40;
+
+constexpr uint16_t BPF_K = 0x00;
+constexpr uint16_t BPF_X = 0x08;
+
+constexpr uint16_t BPF_TAX = 0x00;
+constexpr uint16_t BPF_TXA = 0x80;
+
+// Longest program the kernel accepts
+constexpr std::size_t BPF_MAXINSNS = 4096;
+
+// Scratch memory slots used by the prologue
+constexpr uint32_t SLOT_NETWORK = 0;   // 4, 6 or 0
+constexpr uint32_t SLOT_TRANSPORT = 1; // TCP header offset, or 0
+constexpr uint32_t SLOT_AVAILABLE = 2; // IP length with padding trimmed
+// While walking IPv6 extension headers
+constexpr uint32_t SLOT_IP_HEADER = 3;  // IPv6 header + extensions so far
+constexpr uint32_t SLOT_NEXT_TYPE = 4;  // type of the header found there
+constexpr uint32_t SLOT_FRAGMENT = 5;   // offset of the last Fragment header
+constexpr uint32_t SLOT_HEADER_END = 6; // end of the header being skipped
+
+/**
+ * Emits classic BPF with forward jumps to labels, resolved by finish().
+ */
+class BpfAssembler {
+public:
+  using Label = std::size_t;
+
+  // Falls through to the next instruction
+  inline static constexpr Label NEXT = SIZE_MAX;
+
+  Label label() {
+    m_labels.push_back(UNBOUND);
+    return m_labels.size() - 1;
+  }
+  void bind(Label label) { m_labels[label] = m_code.size(); }
+
+  void emit(uint16_t code, uint32_t k = 0) {
+    m_code.push_back(BpfInstruction{code, 0, 0, k});
+  }
+
+  void jump(uint16_t code, uint32_t k, Label jt, Label jf) {
+    m_fixups.push_back(Fixup{m_code.size(), jt, jf, false});
+    emit(static_cast<uint16_t>(BPF_JMP | code), k);
+  }
+
+  // Unconditional jump; its 32-bit offset has no length limit.
+  void jump_always(Label target) {
+    m_fixups.push_back(Fixup{m_code.size(), target, target, true});
+    emit(BPF_JMP | BPF_JA);
+  }
+
+  // False if a jump is too long for classic BPF or the program too big.
+  bool finish(std::vector<BpfInstruction> &program) {
+    if (m_code.size() > BPF_MAXINSNS) {
+      return false;
+    }
+    for (const Fixup &fixup : m_fixups) {
+      BpfInstruction &instruction = m_code[fixup.index];
+      const std::size_t jt = distance(fixup.index, fixup.jt);
+      if (fixup.always) {
+        instruction.k = static_cast<uint32_t>(jt);
+        continue;
+      }
+      const std::size_t jf = distance(fixup.index, fixup.jf);
+      if (jt > 0xFF || jf > 0xFF) {
+        return false;
+      }
+      instruction.jt = static_cast<uint8_t>(jt);
+      instruction.jf = static_cast<uint8_t>(jf);
+    }
+    program = std::move(m_code);
+    return true;
+  }
+
+private:
+  struct Fixup {
+    std::size_t index;
+    Label jt;
+    Label jf;
+    bool always;
+  };
+  inline static constexpr std::size_t UNBOUND = SIZE_MAX;
+
+  // Jumps are relative to the instruction after the jump.
+  std::size_t distance(std::size_t from, Label label) const {
+    return label == NEXT ? 0 : m_labels[label] - from - 1;
+  }
+
+  std::vector<BpfInstruction> m_code;
+  std::vector<std::size_t> m_labels;
+  std::vector<Fixup> m_fixups;
+};
+
+} // namespace
+
+// --- Parsing and code generation ---
+
+/**
+ * Parses an expression into a tree, then generates the userspace bytecode
+ * and the kernel program from it.
+ */
+class FilterCompiler {
+public:
+  FilterCompiler(PacketFilter &filter, std::string_view text)
+      : m_filter(filter), m_text(text) {}
+
+  void compile() {
+    skip_space();
+    if (m_pos == m_text.length()) {
+      return; // matches everything
+    }
+    const int root = parse_or();
+    if (m_pos != m_text.length()) {
+      fail("unexpected '" + std::string(next_token()) + "'");
+    }
+    generate(root);
+    generate_kernel(root);
+  }
+
+private:
+  struct Predicate {
+    uint8_t field;
+    uint8_t op;
+    uint32_t value;
+    uint32_t mask;
+  };
+
+  struct Node {
+    enum Kind { And, Or, Not, Leaf } kind;
+    int left = -1;
+    int right = -1;
+    Predicate predicate{};
+  };
+
+  int add(Node node) {
+    m_nodes.push_back(node);
+    return static_cast<int>(m_nodes.size()) - 1;
+  }
+  int add(Node::Kind kind, int left, int right = -1) {
+    Node node;
+    node.kind = kind;
+    node.left = left;
+    node.right = right;
+    return add(node);
+  }
+
+  [[noreturn]] void fail(const std::string &message) const {
+    throw std::invalid_argument("filter: " + message + " at offset " +
+                                std::to_string(m_token_start));
+  }
+
+  // --- Tokens ---
+
+  void skip_space() {
+    while (m_pos < m_text.length() &&
+           std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+      ++m_pos;
+    }
+  }
+
+  static bool is_word_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+           c == '.' || c == ':' || c == '/';
+  }
+
+  // The next token without consuming it: a word (field, keyword or value)
+  // or an operator.
+  std::string_view next_token() {
+    skip_space();
+    m_token_start = m_pos;
+    if (m_pos == m_text.length()) {
+      return {};
+    }
+    std::size_t end = m_pos;
+    if (is_word_char(m_text[end])) {
+      while (end < m_text.length() && is_word_char(m_text[end])) {
+        ++end;
+      }
+    } else {
+      static const char *const OPERATORS[] = {"&&", "||", "==", "!=", "<=",
+                                              ">=", "!",  "<",  ">",  "(",
+                                              ")"};
+      for (const char *op : OPERATORS) {
+        if (m_text.compare(m_pos, std::strlen(op), op) == 0) {
+          return m_text.substr(m_pos, std::strlen(op));
+        }
+      }
+      end = m_pos + 1;
+    }
+    return m_text.substr(m_pos, end - m_pos);
+  }
+
+  bool accept(std::string_view token) {
+    if (next_token() != token) {
+      return false;
+    }
+    m_pos += token.length();
+    return true;
+  }
+
+  std::string_view take() {
+    const std::string_view token = next_token();
+    m_pos += token.length();
+    return token;
+  }
+
+  // --- Grammar ---
+
+  int parse_or() {
+    int left = parse_and();
+    while (accept("||") || accept("or")) {
+      left = add(Node::Or, left, parse_and());
+    }
+    return left;
+  }
+
+  int parse_and() {
+    int left = parse_unary();
+    while (accept("&&") || accept("and")) {
+      left = add(Node::And, left, parse_unary());
+    }
+    return left;
+  }
+
+  int parse_unary() {
+    if (accept("!") || accept("not")) {
+      return add(Node::Not, parse_unary());
+    }
+    if (accept("(")) {
+      const int inner = parse_or();
+      if (!accept(")")) {
+        fail("expected ')'");
+      }
+      return inner;
+    }
+    return parse_comparison();
+  }
+
+  int parse_comparison() {
+    const std::string_view name = take();
+    if (name.empty()) {
+      fail("expected a field");
+    }
+
+    // ip.addr and friends become an `||` of both directions.
+    for (const EitherField &either : EITHER_FIELDS) {
+      if (name == either.name) {
+        const std::size_t op_start = m_pos;
+        const int first = parse_predicate(find_field(either.first));
+        m_pos = op_start;
+        const int second = parse_predicate(find_field(either.second));
+        // `!=` means neither side equals the value.
+        if (m_nodes[first].kind == Node::Not) {
+          return add(Node::Not, add(Node::Or, m_nodes[first].left,
+                                    m_nodes[second].left));
+        }
+        return add(Node::Or, first, second);
+      }
+    }
+
+    const int field = find_field(name);
+    if (field < 0) {
+      fail("unknown field '" + std::string(name) + "'");
+    }
+    return parse_predicate(field);
+  }
+
+  // Parses what follows the field: an operator and a value, or nothing.
+  int parse_predicate(int field_index) {
+    const Field &field = FIELDS[field_index];
+    Node node;
+    node.kind = Node::Leaf;
+    node.predicate.field = static_cast<uint8_t>(field_index);
+    node.predicate.mask = ALL;
+
+    static const struct {
+      const char *token;
+      Op op;
+    } OPERATORS[] = {{"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE},
+                     {">=", OP_GE}, {"<", OP_LT},  {">", OP_GT},
+                     {"in", OP_EQ}};
+    int op = -1;
+    bool in = false;
+    for (const auto &candidate : OPERATORS) {
+      if (accept(candidate.token)) {
+        op = candidate.op;
+        in = std::strcmp(candidate.token, "in") == 0;
+        break;
+      }
+    }
+
+    if (op < 0) {
+      // Bare field: layer present, or field non-zero
+      node.predicate.op =
+          field.type == FieldType::Protocol ? OP_PRESENT : OP_NE;
+      if (field.type == FieldType::Ipv6Address) {
+        fail("an IPv6 address needs a comparison");
+      }
+      return add(node);
+    }
+    if (field.type == FieldType::Protocol) {
+      fail("'" + std::string(field.name) + "' cannot be compared");
+    }
+
+    const std::string_view value = take();
+    if (value.empty()) {
+      fail("expected a value");
+    }
+    const std::size_t slash = value.find('/');
+    if (in && slash == std::string_view::npos) {
+      fail("'in' needs an address/prefix");
+    }
+
+    switch (field.type) {
+    case FieldType::Ipv4Address:
+      parse_ipv4(value, node.predicate);
+      break;
+    case FieldType::Ipv6Address:
+      if (op != OP_EQ && op != OP_NE) {
+        fail("IPv6 addresses only support ==, != and in");
+      }
+      parse_ipv6(value, node.predicate);
+      break;
+    default:
+      if (in) {
+        fail("'in' only applies to address fields");
+      }
+      node.predicate.value = parse_number(value, field);
+      break;
+    }
+
+    if (slash != std::string_view::npos && op != OP_EQ && op != OP_NE) {
+      fail("a prefix only supports ==, != and in");
+    }
+    // `!=` is generated as the negation of `==`, so that it also holds
+    // when the layer is absent, like the other negated forms.
+    if (op == OP_NE) {
+      if (field.type == FieldType::Ipv6Address) {
+        node.predicate.op = OP_PREFIX6;
+      } else {
+        node.predicate.op = OP_EQ;
+      }
+      return add(Node::Not, add(node));
+    }
+    if (field.type != FieldType::Ipv6Address) {
+      node.predicate.op = static_cast<uint8_t>(op);
+    }
+    return add(node);
+  }
+
+  uint32_t parse_number(std::string_view text, const Field &field) {
+    std::string digits(text);
+    int base = 10;
+    if (digits.size() > 2 && digits[0] == '0' &&
+        (digits[1] == 'x' || digits[1] == 'X')) {
+      digits.erase(0, 2);
+      base = 16;
+    }
+    uint64_t value = 0;
+    for (const char c : digits) {
+      const int digit =
+          std::isdigit(static_cast<unsigned char>(c))
+              ? c - '0'
+          : base == 16 && std::isxdigit(static_cast<unsigned char>(c))
+              ? std::tolower(static_cast<unsigned char>(c)) - 'a' + 10
+              : -1;
+      if (digit < 0) {
+        fail("bad number '" + std::string(text) + "'");
+      }
+      value = value * static_cast<uint64_t>(base) +
+              static_cast<uint64_t>(digit);
+      if (value > field.mask) {
+        fail(std::string(text) + " is out of range for " + field.name);
+      }
+    }
+    if (digits.empty()) {
+      fail("bad number '" + std::string(text) + "'");
+    }
+    return static_cast<uint32_t>(value);
+  }
+
+  // Prefix length after the '/', or `bits` if there is none.
+  unsigned parse_prefix_length(std::string_view text, unsigned bits) {
+    const std::size_t slash = text.find('/');
+    if (slash == std::string_view::npos) {
+      return bits;
+    }
+    const std::string_view digits = text.substr(slash + 1);
+    unsigned length = 0;
+    for (const char c : digits) {
+      if (!std::isdigit(static_cast<unsigned char>(c))) {
+        fail("bad prefix length in '" + std::string(text) + "'");
+      }
+      length = length * 10 + static_cast<unsigned>(c - '0');
+      if (length > bits) {
+        fail("bad prefix length in '" + std::string(text) + "'");
+      }
+    }
+    if (digits.empty()) {
+      fail("bad prefix length in '" + std::string(text) + "'");
+    }
+    return length;
+  }
+
+  void parse_ipv4(std::string_view text, Predicate &predicate) {
+    const std::string address(text.substr(0, text.find('/')));
+    in_addr parsed;
+    if (inet_pton(AF_INET, address.c_str(), &parsed) != 1) {
+      fail("bad IPv4 address '" + std::string(text) + "'");
+    }
+    const unsigned length = parse_prefix_length(text, 32);
+    predicate.mask = length == 0 ? 0 : ALL << (32 - length);
+    predicate.value = ntohl(parsed.s_addr) & predicate.mask;
+  }
+
+  void parse_ipv6(std::string_view text, Predicate &predicate) {
+    const std::string address(text.substr(0, text.find('/')));
+    PacketFilter::Ipv6Prefix prefix;
+    if (inet_pton(AF_INET6, address.c_str(), prefix.bytes.data()) != 1) {
+      fail("bad IPv6 address '" + std::string(text) + "'");
+    }
+    prefix.length = static_cast<uint8_t>(parse_prefix_length(text, 128));
+    // Clear the host bits so comparisons can use the bytes as they are.
+    for (std::size_t bit = prefix.length; bit < 128; ++bit) {
+      prefix.bytes[bit / 8] &= static_cast<uint8_t>(~(0x80 >> (bit % 8)));
+    }
+    predicate.op = OP_PREFIX6;
+    predicate.value = static_cast<uint32_t>(m_filter.m_prefixes.size());
+    m_filter.m_prefixes.push_back(prefix);
+  }
+
+  // --- Userspace bytecode ---
+
+  // Targets are labels until generate() maps them to instruction indices.
+  inline static constexpr uint16_t ACCEPT = 0xFFFF;
+  inline static constexpr uint16_t REJECT = 0xFFFE;
+
+  void generate(int root) {
+    std::vector<PacketFilter::Instruction> &code = m_filter.m_code;
+    m_targets.clear();
+    emit(root, ACCEPT, REJECT);
+    if (code.size() >= REJECT - 1) {
+      fail("expression is too long");
+    }
+    const auto resolve = [&](uint16_t label) -> uint16_t {
+      if (label == ACCEPT) {
+        return static_cast<uint16_t>(code.size());
+      }
+      if (label == REJECT) {
+        return static_cast<uint16_t>(code.size() + 1);
+      }
+      return static_cast<uint16_t>(m_targets[label]);
+    };
+    for (PacketFilter::Instruction &instruction : code) {
+      instruction.jt = resolve(instruction.jt);
+      instruction.jf = resolve(instruction.jf);
+    }
+  }
+
+  uint16_t new_label() {
+    m_targets.push_back(0);
+    return static_cast<uint16_t>(m_targets.size() - 1);
+  }
+  void bind(uint16_t label) { m_targets[label] = m_filter.m_code.size(); }
+
+  // Emits code that jumps to `jt` if `node` holds, else to `jf`.
+  void emit(int index, uint16_t jt, uint16_t jf) {
+    const Node &node = m_nodes[index];
+    switch (node.kind) {
+    case Node::And: {
+      const uint16_t right = new_label();
+      emit(node.left, right, jf);
+      bind(right);
+      emit(node.right, jt, jf);
+      break;
+    }
+    case Node::Or: {
+      const uint16_t right = new_label();
+      emit(node.left, jt, right);
+      bind(right);
+      emit(node.right, jt, jf);
+      break;
+    }
+    case Node::Not:
+      emit(node.left, jf, jt);
+      break;
+    case Node::Leaf: {
+      const Predicate &p = node.predicate;
+      m_filter.m_code.push_back(
+          PacketFilter::Instruction{p.op, p.field, jt, jf, p.value, p.mask});
+      break;
+    }
+    }
+  }
+
+  // --- Kernel program ---
+
+  void generate_kernel(int root) {
+    if (assemble_kernel({root})) {
+      return;
+    }
+    // Too big: push down the top-level && terms that fit. Dropping terms
+    // of a conjunction only lets more packets through, never fewer.
+    m_filter.m_kernel_exact = false;
+    std::vector<int> terms;
+    collect_terms(root, terms);
+    std::vector<int> kept;
+    for (const int term : terms) {
+      kept.push_back(term);
+      if (!assemble_kernel(kept)) {
+        kept.pop_back();
+      }
+    }
+    if (!kept.empty()) {
+      assemble_kernel(kept);
+    } else {
+      m_filter.m_kernel.clear();
+    }
+  }
+
+  void collect_terms(int index, std::vector<int> &terms) const {
+    if (m_nodes[index].kind == Node::And) {
+      collect_terms(m_nodes[index].left, terms);
+      collect_terms(m_nodes[index].right, terms);
+    } else {
+      terms.push_back(index);
+    }
+  }
+
+  // Assembles the conjunction of `terms`; false if it does not fit.
+  bool assemble_kernel(const std::vector<int> &terms) {
+    BpfAssembler bpf;
+    const BpfAssembler::Label accept = bpf.label();
+    const BpfAssembler::Label reject = bpf.label();
+
+    bool network = false;
+    bool transport = false;
+    for (const int term : terms) {
+      uses_layers(term, network, transport);
+    }
+    if (network || transport) {
+      emit_prologue(bpf, transport);
+    }
+
+    for (std::size_t i = 0; i < terms.size(); ++i) {
+      const BpfAssembler::Label next =
+          i + 1 == terms.size() ? accept : bpf.label();
+      emit_kernel(bpf, terms[i], next, reject);
+      if (next != accept) {
+        bpf.bind(next);
+      }
+    }
+
+    bpf.bind(accept);
+    bpf.emit(BPF_RET | BPF_K, 0xFFFFFFFF);
+    bpf.bind(reject);
+    bpf.emit(BPF_RET | BPF_K, 0);
+    return bpf.finish(m_filter.m_kernel);
+  }
+
+  void uses_layers(int index, bool &network, bool &transport) const {
+    const Node &node = m_nodes[index];
+    if (node.kind != Node::Leaf) {
+      uses_layers(node.left, network, transport);
+      if (node.right >= 0) {
+        uses_layers(node.right, network, transport);
+      }
+      return;
+    }
+    switch (FIELDS[node.predicate.field].layer) {
+    case Layer::Ethernet:
+      break;
+    case Layer::IPv4:
+    case Layer::IPv6:
+      network = true;
+      break;
+    case Layer::TCP:
+      transport = true;
+      break;
+    }
+  }
+
+  /**
+   * Finds the network and (if `transport`) TCP layers the same way Cursor
+   * does, and leaves them in scratch memory for the comparisons.
+   */
+  static void emit_prologue(BpfAssembler &bpf, bool transport) {
+    const BpfAssembler::Label done = bpf.label();
+    const BpfAssembler::Label ethernet = bpf.label();
+    const BpfAssembler::Label not_ipv4 = bpf.label();
+    const BpfAssembler::Label ipv6 = bpf.label();
+    const BpfAssembler::Label walk = bpf.label();
+    const uint32_t eth = EthernetHeader::HEADER_SIZE;
+
+    bpf.emit(BPF_LD | BPF_IMM, 0);
+    bpf.emit(BPF_ST, SLOT_NETWORK);
+    bpf.emit(BPF_ST, SLOT_TRANSPORT);
+    bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+    bpf.jump(BPF_JGE | BPF_K, eth, ethernet, done);
+    bpf.bind(ethernet);
+    bpf.emit(BPF_LD | BPF_H | BPF_ABS, EthernetHeader::ETH_TYPE_OFFSET);
+    bpf.jump(BPF_JEQ | BPF_K, EthernetHeader::ETH_TYPE_IPV4, BpfAssembler::NEXT,
+             not_ipv4);
+
+    // --- IPv4: version 4, 20 <= IHL * 4 <= bytes after Ethernet ---
+    {
+      bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+      bpf.jump(BPF_JGE | BPF_K, eth + IPv4Header::MIN_HEADER_SIZE,
+               BpfAssembler::NEXT, done);
+      bpf.emit(BPF_LD | BPF_B | BPF_ABS, eth);
+      bpf.emit(BPF_ALU | BPF_AND | BPF_K, 0xF0);
+      bpf.jump(BPF_JEQ | BPF_K, 0x40, BpfAssembler::NEXT, done);
+      bpf.emit(BPF_LDX | BPF_B | BPF_MSH, eth); // X = IHL * 4
+      bpf.emit(BPF_MISC | BPF_TXA);
+      bpf.jump(BPF_JGE | BPF_K, IPv4Header::MIN_HEADER_SIZE, BpfAssembler::NEXT,
+               done);
+      bpf.emit(BPF_ALU | BPF_ADD | BPF_K, eth);
+      bpf.emit(BPF_MISC | BPF_TAX);
+      bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+      bpf.jump(BPF_JGE | BPF_X, 0, BpfAssembler::NEXT, done);
+      bpf.emit(BPF_LD | BPF_IMM, 4);
+      bpf.emit(BPF_ST, SLOT_NETWORK);
+
+      if (transport) {
+        // TCP, and the first fragment
+        bpf.emit(BPF_LD | BPF_B | BPF_ABS, eth + 9);
+        bpf.jump(BPF_JEQ | BPF_K, IPv4Header::PROTO_TCP, BpfAssembler::NEXT,
+                 done);
+        bpf.emit(BPF_LD | BPF_H | BPF_ABS, eth + 6);
+        bpf.jump(BPF_JSET | BPF_K, 0x1FFF, done, BpfAssembler::NEXT);
+
+        // Available = total_length if IHL * 4 <= total_length < the bytes
+        // after Ethernet, else those bytes (padding trimmed)
+        const BpfAssembler::Label trimmed = bpf.label();
+        bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+        bpf.emit(BPF_ALU | BPF_SUB | BPF_K, eth);
+        bpf.emit(BPF_ST, SLOT_AVAILABLE);
+        bpf.emit(BPF_LDX | BPF_B | BPF_MSH, eth);
+        bpf.emit(BPF_LD | BPF_H | BPF_ABS, eth + 2);
+        bpf.jump(BPF_JGE | BPF_X, 0, BpfAssembler::NEXT, trimmed);
+        bpf.emit(BPF_LDX | BPF_MEM, SLOT_AVAILABLE);
+        bpf.jump(BPF_JGE | BPF_X, 0, trimmed, BpfAssembler::NEXT);
+        bpf.emit(BPF_ST, SLOT_AVAILABLE);
+        bpf.bind(trimmed);
+        emit_tcp_checks(bpf, done, [&bpf] {
+          bpf.emit(BPF_LDX | BPF_B | BPF_MSH, EthernetHeader::HEADER_SIZE);
+        });
+      }
+      bpf.jump_always(done);
+    }
+
+    // --- IPv6: version 6, the whole base header present ---
+    bpf.bind(not_ipv4);
+    bpf.jump(BPF_JEQ | BPF_K, EthernetHeader::ETH_TYPE_IPV6, ipv6, done);
+    bpf.bind(ipv6);
+    bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+    bpf.jump(BPF_JGE | BPF_K, eth + IPv6Header::HEADER_SIZE, BpfAssembler::NEXT,
+             done);
+    bpf.emit(BPF_LD | BPF_B | BPF_ABS, eth);
+    bpf.emit(BPF_ALU | BPF_AND | BPF_K, 0xF0);
+    bpf.jump(BPF_JEQ | BPF_K, 0x60, BpfAssembler::NEXT, done);
+    bpf.emit(BPF_LD | BPF_IMM, 6);
+    bpf.emit(BPF_ST, SLOT_NETWORK);
+
+    if (transport) {
+      // Available = 40 + payload_length if that is shorter than the bytes
+      // after Ethernet, and payload_length is not 0 (a jumbogram)
+      const BpfAssembler::Label trimmed = bpf.label();
+      bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+      bpf.emit(BPF_ALU | BPF_SUB | BPF_K, eth);
+      bpf.emit(BPF_ST, SLOT_AVAILABLE);
+      bpf.emit(BPF_MISC | BPF_TAX);
+      bpf.emit(BPF_LD | BPF_H | BPF_ABS, eth + 4);
+      bpf.jump(BPF_JEQ | BPF_K, 0, trimmed, BpfAssembler::NEXT);
+      bpf.emit(BPF_ALU | BPF_ADD | BPF_K, IPv6Header::HEADER_SIZE);
+      bpf.jump(BPF_JGE | BPF_X, 0, trimmed, BpfAssembler::NEXT);
+      bpf.emit(BPF_ST, SLOT_AVAILABLE);
+      bpf.bind(trimmed);
+
+      // TCP past any extension headers, and the first fragment
+      bpf.emit(BPF_LD | BPF_IMM, IPv6Header::HEADER_SIZE);
+      bpf.emit(BPF_ST, SLOT_IP_HEADER);
+      bpf.emit(BPF_LD | BPF_IMM, 0);
+      bpf.emit(BPF_ST, SLOT_FRAGMENT);
+      bpf.emit(BPF_LD | BPF_B | BPF_ABS, eth + 6);
+      bpf.emit(BPF_ST, SLOT_NEXT_TYPE);
+      bpf.jump_always(walk);
+    }
+    bpf.bind(done);
+
+    if (transport) {
+      // The walk is too long for the conditional jumps above to reach past
+      // it, so it comes after `done` and skips itself from there.
+      const BpfAssembler::Label walked = bpf.label();
+      const BpfAssembler::Label finished = bpf.label();
+      bpf.jump_always(finished);
+      bpf.bind(walk);
+      for (std::size_t i = 0; i < IPv6Header::MAX_EXTENSIONS; ++i) {
+        emit_ipv6_extension(bpf, walked, finished);
+      }
+      bpf.bind(walked);
+      bpf.emit(BPF_LD | BPF_MEM, SLOT_NEXT_TYPE);
+      bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_TCP, BpfAssembler::NEXT,
+               finished);
+      bpf.emit(BPF_LD | BPF_MEM, SLOT_FRAGMENT);
+      bpf.jump(BPF_JEQ | BPF_K, 0, BpfAssembler::NEXT, finished);
+      emit_tcp_checks(bpf, finished, [&bpf] {
+        bpf.emit(BPF_LDX | BPF_MEM, SLOT_IP_HEADER);
+      });
+      bpf.bind(finished);
+    }
+  }
+
+  /**
+   * Skips one IPv6 extension header the way IPv6Header::parse_extensions()
+   * does; classic BPF has no loops, so the prologue repeats this
+   * MAX_EXTENSIONS times. Jumps to `walked` at the first header that is not
+   * an extension, and to `done` at a truncated one.
+   */
+  static void emit_ipv6_extension(BpfAssembler &bpf,
+                                  BpfAssembler::Label walked,
+                                  BpfAssembler::Label done) {
+    const BpfAssembler::Label extension = bpf.label();
+    const BpfAssembler::Label fragment = bpf.label();
+    const BpfAssembler::Label auth = bpf.label();
+    const BpfAssembler::Label skip = bpf.label();
+    const BpfAssembler::Label stop = bpf.label();
+    const BpfAssembler::Label truncated = bpf.label();
+    const BpfAssembler::Label next = bpf.label();
+    const uint32_t eth = EthernetHeader::HEADER_SIZE;
+
+    // A non-first fragment's Fragment header is followed by payload.
+    bpf.emit(BPF_LD | BPF_MEM, SLOT_FRAGMENT);
+    bpf.jump(BPF_JEQ | BPF_K, 0, BpfAssembler::NEXT, stop);
+    bpf.emit(BPF_LD | BPF_MEM, SLOT_NEXT_TYPE);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_HOP_BY_HOP, extension,
+             BpfAssembler::NEXT);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_ROUTING, extension,
+             BpfAssembler::NEXT);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_DEST_OPTS, extension,
+             BpfAssembler::NEXT);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_AUTH, extension,
+             BpfAssembler::NEXT);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_FRAG, extension, stop);
+
+    // Every extension header is at least 8 bytes
+    bpf.bind(extension);
+    bpf.emit(BPF_LD | BPF_MEM, SLOT_IP_HEADER);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_K, 8);
+    bpf.emit(BPF_LDX | BPF_MEM, SLOT_AVAILABLE);
+    bpf.jump(BPF_JGT | BPF_X, 0, truncated, BpfAssembler::NEXT);
+    bpf.emit(BPF_LDX | BPF_MEM, SLOT_IP_HEADER);
+    bpf.emit(BPF_LD | BPF_MEM, SLOT_NEXT_TYPE);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_FRAG, fragment,
+             BpfAssembler::NEXT);
+    bpf.jump(BPF_JEQ | BPF_K, IPv6Header::NH_AUTH, auth, BpfAssembler::NEXT);
+    // (length + 1) * 8
+    bpf.emit(BPF_LD | BPF_B | BPF_IND, eth + 1);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_K, 1);
+    bpf.emit(BPF_ALU | BPF_LSH | BPF_K, 3);
+    bpf.jump_always(skip);
+    // (length + 2) * 4 (RFC 4302)
+    bpf.bind(auth);
+    bpf.emit(BPF_LD | BPF_B | BPF_IND, eth + 1);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_K, 2);
+    bpf.emit(BPF_ALU | BPF_LSH | BPF_K, 2);
+    bpf.jump_always(skip);
+    // 8, keeping the fragment offset
+    bpf.bind(fragment);
+    bpf.emit(BPF_LD | BPF_H | BPF_IND, eth + 2);
+    bpf.emit(BPF_ALU | BPF_RSH | BPF_K, 3);
+    bpf.emit(BPF_ST, SLOT_FRAGMENT);
+    bpf.emit(BPF_LD | BPF_IMM, 8);
+
+    // With A = its length and X = its offset: the whole header present
+    bpf.bind(skip);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_X);
+    bpf.emit(BPF_ST, SLOT_HEADER_END);
+    bpf.emit(BPF_LDX | BPF_MEM, SLOT_AVAILABLE);
+    bpf.jump(BPF_JGT | BPF_X, 0, truncated, BpfAssembler::NEXT);
+    bpf.emit(BPF_LDX | BPF_MEM, SLOT_IP_HEADER);
+    bpf.emit(BPF_LD | BPF_B | BPF_IND, eth);
+    bpf.emit(BPF_ST, SLOT_NEXT_TYPE);
+    bpf.emit(BPF_LD | BPF_MEM, SLOT_HEADER_END);
+    bpf.emit(BPF_ST, SLOT_IP_HEADER);
+    bpf.jump_always(next);
+
+    // Conditional jumps only reach 255 instructions ahead.
+    bpf.bind(stop);
+    bpf.jump_always(walked);
+    bpf.bind(truncated);
+    bpf.jump_always(done);
+    bpf.bind(next);
+  }
+
+  // Emits BPF that jumps to `jt` if `node` holds, else to `jf`.
+  void emit_kernel(BpfAssembler &bpf, int index, BpfAssembler::Label jt,
+                   BpfAssembler::Label jf) const {
+    const Node &node = m_nodes[index];
+    switch (node.kind) {
+    case Node::And: {
+      const BpfAssembler::Label right = bpf.label();
+      emit_kernel(bpf, node.left, right, jf);
+      bpf.bind(right);
+      emit_kernel(bpf, node.right, jt, jf);
+      break;
+    }
+    case Node::Or: {
+      const BpfAssembler::Label right = bpf.label();
+      emit_kernel(bpf, node.left, jt, right);
+      bpf.bind(right);
+      emit_kernel(bpf, node.right, jt, jf);
+      break;
+    }
+    case Node::Not:
+      emit_kernel(bpf, node.left, jf, jt);
+      break;
+    case Node::Leaf:
+      emit_kernel_predicate(bpf, node.predicate, jt, jf);
+      break;
+    }
+  }
+
+  void emit_kernel_predicate(BpfAssembler &bpf, const Predicate &predicate,
+                             BpfAssembler::Label jt,
+                             BpfAssembler::Label jf) const {
+    const Field &field = FIELDS[predicate.field];
+    const bool present = predicate.op == OP_PRESENT;
+    const BpfAssembler::Label found = present ? jt : BpfAssembler::NEXT;
+
+    // Is the layer there? Leaves X at the TCP header for TCP fields.
+    uint16_t mode = BPF_ABS;
+    uint32_t base = EthernetHeader::HEADER_SIZE;
+    switch (field.layer) {
+    case Layer::Ethernet:
+      base = 0;
+      bpf.emit(BPF_LD | BPF_W | BPF_LEN);
+      bpf.jump(BPF_JGE | BPF_K, EthernetHeader::HEADER_SIZE, found, jf);
+      break;
+    case Layer::IPv4:
+    case Layer::IPv6:
+      bpf.emit(BPF_LD | BPF_MEM, SLOT_NETWORK);
+      bpf.jump(BPF_JEQ | BPF_K, field.layer == Layer::IPv4 ? 4 : 6, found,
+               jf);
+      break;
+    case Layer::TCP:
+      mode = BPF_IND;
+      base = 0;
+      bpf.emit(BPF_LD | BPF_MEM, SLOT_TRANSPORT);
+      bpf.jump(BPF_JEQ | BPF_K, 0, jf, found);
+      if (!present) {
+        bpf.emit(BPF_MISC | BPF_TAX);
+      }
+      break;
+    }
+    if (present) {
+      return;
+    }
+    const uint32_t offset = base + field.offset;
+
+    if (predicate.op == OP_PREFIX6) {
+      // One 32-bit word of the address at a time
+      const PacketFilter::Ipv6Prefix &prefix =
+          m_filter.m_prefixes[predicate.value];
+      if (prefix.length == 0) {
+        bpf.jump_always(jt);
+        return;
+      }
+      for (unsigned word = 0; word * 32 < prefix.length; ++word) {
+        const unsigned bits = std::min(prefix.length - word * 32, 32u);
+        bpf.emit(BPF_LD | BPF_W | mode, offset + word * 4);
+        if (bits < 32) {
+          bpf.emit(BPF_ALU | BPF_AND | BPF_K, ALL << (32 - bits));
+        }
+        const bool last = (word + 1) * 32 >= prefix.length;
+        bpf.jump(BPF_JEQ | BPF_K, load_be32(prefix.bytes.data() + word * 4),
+                 last ? jt : BpfAssembler::NEXT, jf);
+      }
+      return;
+    }
+
+    const uint16_t size = field.size == 1   ? BPF_B
+                          : field.size == 2 ? BPF_H
+                                            : BPF_W;
+    bpf.emit(static_cast<uint16_t>(BPF_LD | size | mode), offset);
+    if (field.shift != 0) {
+      bpf.emit(BPF_ALU | BPF_RSH | BPF_K, field.shift);
+    }
+    const uint32_t width = field.size == 4 ? ALL : (1u << (field.size * 8)) - 1;
+    if (field.mask != (width >> field.shift)) {
+      bpf.emit(BPF_ALU | BPF_AND | BPF_K, field.mask);
+    }
+    if (predicate.mask != ALL) {
+      bpf.emit(BPF_ALU | BPF_AND | BPF_K, predicate.mask);
+    }
+
+    const uint32_t value = predicate.value;
+    switch (predicate.op) {
+    case OP_EQ:
+      bpf.jump(BPF_JEQ | BPF_K, value, jt, jf);
+      break;
+    case OP_NE:
+      bpf.jump(BPF_JEQ | BPF_K, value, jf, jt);
+      break;
+    case OP_LT:
+      bpf.jump(BPF_JGE | BPF_K, value, jf, jt);
+      break;
+    case OP_LE:
+      bpf.jump(BPF_JGT | BPF_K, value, jf, jt);
+      break;
+    case OP_GT:
+      bpf.jump(BPF_JGT | BPF_K, value, jt, jf);
+      break;
+    case OP_GE:
+      bpf.jump(BPF_JGE | BPF_K, value, jt, jf);
+      break;
+    default:
+      break;
+    }
+  }
+
+  /**
+   * With the available IP length in SLOT_AVAILABLE, checks that a TCP
+   * header fits after the IP header and stores its offset in
+   * SLOT_TRANSPORT. `load_ip_header` sets X to the IP header length.
+   */
+  template <typename LoadIpHeader>
+  static void emit_tcp_checks(BpfAssembler &bpf, BpfAssembler::Label done,
+                              const LoadIpHeader &load_ip_header) {
+    const uint32_t eth = EthernetHeader::HEADER_SIZE;
+    // IP header + 20 <= available
+    load_ip_header();
+    bpf.emit(BPF_MISC | BPF_TXA);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_K, TCPHeader::MIN_HEADER_SIZE);
+    bpf.emit(BPF_LDX | BPF_MEM, SLOT_AVAILABLE);
+    bpf.jump(BPF_JGT | BPF_X, 0, done, BpfAssembler::NEXT);
+    // 20 <= data_offset * 4, and IP header + data_offset * 4 <= available
+    load_ip_header();
+    bpf.emit(BPF_LD | BPF_B | BPF_IND, eth + 12);
+    bpf.emit(BPF_ALU | BPF_RSH | BPF_K, 4);
+    bpf.emit(BPF_ALU | BPF_LSH | BPF_K, 2);
+    bpf.jump(BPF_JGE | BPF_K, TCPHeader::MIN_HEADER_SIZE, BpfAssembler::NEXT,
+             done);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_X);
+    bpf.emit(BPF_LDX | BPF_MEM, SLOT_AVAILABLE);
+    bpf.jump(BPF_JGT | BPF_X, 0, done, BpfAssembler::NEXT);
+    load_ip_header();
+    bpf.emit(BPF_MISC | BPF_TXA);
+    bpf.emit(BPF_ALU | BPF_ADD | BPF_K, eth);
+    bpf.emit(BPF_ST, SLOT_TRANSPORT);
+  }
+
+  PacketFilter &m_filter;
+  std::string_view m_text;
+  std::size_t m_pos = 0;
+  std::size_t m_token_start = 0;
+  std::vector<Node> m_nodes;
+  std::vector<std::size_t> m_targets;
+};
+
+// --- PacketFilter ---
+
+PacketFilter::PacketFilter(std::string_view expression)
+    : m_expression(expression) {
+  FilterCompiler(*this, m_expression).compile();
+}
+
+bool PacketFilter::matches(std::string_view packet) const {
+  Cursor cursor(packet);
+  const std::size_t end = m_code.size();
+  std::size_t pc = 0;
+
+  while (pc < end) {
+    const Instruction &instruction = m_code[pc];
+    const Field &field = FIELDS[instruction.field];
+    const std::size_t layer = cursor.offset(field.layer);
+
+    bool result = false;
+    if (layer != Cursor::NONE) {
+      const unsigned char *bytes = cursor.bytes() + layer + field.offset;
+      const uint32_t value = instruction.op == OP_PRESENT ||
+                                     instruction.op == OP_PREFIX6
+                                 ? 0
+                                 : load_field(field, bytes) & instruction.mask;
+      switch (instruction.op) {
+      case OP_PRESENT:
+        result = true;
+        break;
+      case OP_EQ:
+        result = value == instruction.value;
+        break;
+      case OP_NE:
+        result = value != instruction.value;
+        break;
+      case OP_LT:
+        result = value < instruction.value;
+        break;
+      case OP_LE:
+        result = value <= instruction.value;
+        break;
+      case OP_GT:
+        result = value > instruction.value;
+        break;
+      case OP_GE:
+        result = value >= instruction.value;
+        break;
+      case OP_PREFIX6: {
+        const Ipv6Prefix &prefix = m_prefixes[instruction.value];
+        result = in_prefix(bytes, prefix.bytes, prefix.length);
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    pc = result ? instruction.jt : instruction.jf;
+  }
+  return pc == end;
+}
@@ -0,0 +1,234 @@
+#include "parallel_capture.hpp"
+#include "decoder.hpp"
+#include "flow_table.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Flows each summarize_capture() thread holds before evicting to its list
+constexpr std::size_t THREAD_FLOWS = 1 << 16;
+
+bool key_less(const FlowKey &a, const FlowKey &b) {
+  return std::memcmp(&a, &b, sizeof(FlowKey)) < 0;
+}
+
+void combine(FlowStats &into, const FlowStats &from) {
+  into.first_seen_ns = std::min(into.first_seen_ns, from.first_seen_ns);
+  into.last_seen_ns = std::max(into.last_seen_ns, from.last_seen_ns);
+  into.packets += from.packets;
+  into.bytes += from.bytes;
+  into.tcp_flags |= from.tcp_flags;
+}
+
+// Sorts `flows` by key and folds the entries of each flow into one.
+void normalize(std::vector<std::pair<FlowKey, FlowStats>> &flows) {
+  std::sort(flows.begin(), flows.end(), [](const auto &a, const auto &b) {
+    return key_less(a.first, b.first);
+  });
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < flows.size(); ++i) {
+    if (kept != 0 && flows[kept - 1].first == flows[i].first) {
+      combine(flows[kept - 1].second, flows[i].second);
+    } else {
+      flows[kept++] = flows[i];
+    }
+  }
+  flows.resize(kept);
+}
+
+} // namespace
+
+// --- ParallelCaptureReader ---
+
+ParallelCaptureReader::ParallelCaptureReader(const std::string &path,
+                                             const Config &config)
+    : m_path(path), m_config(config), m_reader(path) {
+  if (config.threads == 0) {
+    throw std::invalid_argument("ParallelCaptureReader needs a thread");
+  }
+  m_chunks = m_reader.split(config.chunk_bytes);
+}
+
+void ParallelCaptureReader::run(const Handler &handler,
+                                const ChunkDone &done) {
+  std::atomic<std::size_t> next_chunk{0};
+  std::atomic<bool> failed{false};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  std::vector<Stats> stats(m_config.threads);
+
+  const auto work = [&](std::size_t thread) {
+    try {
+      // A mapping per thread, so readers share nothing but the page cache.
+      CaptureFileReader reader(m_path);
+      Decoder decoder;
+      LayerStack stack;
+      PacketRef packet;
+      Stats &local = stats[thread];
+      while (!failed.load(std::memory_order_relaxed)) {
+        const std::size_t chunk =
+            next_chunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= m_chunks.size()) {
+          break;
+        }
+        reader.seek(m_chunks[chunk].start);
+        while (reader.position() < m_chunks[chunk].end &&
+               reader.next(packet)) {
+          ++local.packets;
+          local.bytes += packet.data.length();
+          if (m_config.filter != nullptr &&
+              !m_config.filter->matches(packet.data)) {
+            ++local.filtered;
+            continue;
+          }
+          if (decoder.decode(packet.data, stack)) {
+            ++local.decoded;
+          } else {
+            ++local.malformed;
+          }
+          if (handler) {
+            handler(thread, chunk, packet, stack);
+          }
+        }
+        if (done) {
+          done(thread, chunk);
+        }
+      }
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      failed.store(true, std::memory_order_relaxed);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < m_config.threads; ++i) {
+    threads.emplace_back(work, i);
+  }
+  work(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  m_stats = Stats{};
+  for (const Stats &local : stats) {
+    m_stats.packets += local.packets;
+    m_stats.bytes += local.bytes;
+    m_stats.decoded += local.decoded;
+    m_stats.malformed += local.malformed;
+    m_stats.filtered += local.filtered;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// --- CaptureSummary ---
+
+void CaptureSummary::merge(const CaptureSummary &other) {
+  packets += other.packets;
+  bytes += other.bytes;
+  malformed += other.malformed;
+  ipv4 += other.ipv4;
+  ipv6 += other.ipv6;
+  tcp += other.tcp;
+  udp += other.udp;
+  flows.insert(flows.end(), other.flows.begin(), other.flows.end());
+  normalize(flows);
+}
+
+std::vector<std::pair<FlowKey, FlowStats>>
+CaptureSummary::top_flows(std::size_t n) const {
+  std::vector<std::pair<FlowKey, FlowStats>> top(flows);
+  const auto busier = [](const auto &a, const auto &b) {
+    return a.second.bytes != b.second.bytes ? a.second.bytes > b.second.bytes
+                                            : key_less(a.first, b.first);
+  };
+  n = std::min(n, top.size());
+  std::partial_sort(top.begin(), top.begin() + static_cast<std::ptrdiff_t>(n),
+                    top.end(), busier);
+  top.resize(n);
+  return top;
+}
+
+CaptureSummary summarize_capture(const std::string &path,
+                                 const ParallelCaptureReader::Config &config,
+                                 ParallelCaptureReader::Stats *stats) {
+  ParallelCaptureReader reader(path, config);
+  using Table = FlowTable<FlowStats>;
+  std::vector<CaptureSummary> summaries(config.threads);
+  std::vector<std::unique_ptr<Table>> tables;
+  Table::Config table_config;
+  table_config.max_flows = THREAD_FLOWS;
+  table_config.idle_timeout_ns = 0;
+  for (std::size_t i = 0; i < config.threads; ++i) {
+    CaptureSummary &summary = summaries[i];
+    tables.push_back(std::make_unique<Table>(
+        table_config, [&summary](const FlowKey &key, FlowStats &value,
+                                 EvictReason) {
+          summary.flows.emplace_back(key, value);
+          // A flow evicted more than once is folded back into one entry.
+          if (summary.flows.size() >= 4 * THREAD_FLOWS &&
+              (summary.flows.size() & (summary.flows.size() - 1)) == 0) {
+            normalize(summary.flows);
+          }
+        }));
+  }
+
+  reader.run([&summaries, &tables](std::size_t thread, std::size_t,
+                                   const PacketRef &packet,
+                                   const LayerStack &stack) {
+    CaptureSummary &summary = summaries[thread];
+    ++summary.packets;
+    summary.bytes += packet.data.length();
+    if (stack.empty()) {
+      ++summary.malformed;
+      return;
+    }
+    summary.ipv4 += stack.has(LayerKind::IPv4) ? 1 : 0;
+    summary.ipv6 += stack.has(LayerKind::IPv6) ? 1 : 0;
+    FlowKey key;
+    if (!FlowKey::from_packet(packet.data, stack, key)) {
+      return;
+    }
+    summary.tcp += key.protocol == 6 ? 1 : 0;
+    summary.udp += key.protocol == 17 ? 1 : 0;
+
+    bool inserted = false;
+    FlowStats &flow = tables[thread]->touch(key.canonical(),
+                                            packet.timestamp_ns, &inserted);
+    // Earliest and latest rather than first and last read, so the order
+    // packets are read in does not matter.
+    if (inserted || packet.timestamp_ns < flow.first_seen_ns) {
+      flow.first_seen_ns = packet.timestamp_ns;
+    }
+    flow.last_seen_ns = std::max(flow.last_seen_ns, packet.timestamp_ns);
+    ++flow.packets;
+    flow.bytes += packet.data.length();
+    if (const TCPHeader *tcp = stack.get<TCP>()) {
+      flow.tcp_flags |= tcp->flags();
+    }
+  });
+
+  CaptureSummary total;
+  for (std::size_t i = 0; i < config.threads; ++i) {
+    tables[i]->for_each([&summaries, i](const FlowKey &key,
+                                        const FlowStats &value) {
+      summaries[i].flows.emplace_back(key, value);
+    });
+    total.merge(summaries[i]);
+  }
+  if (stats != nullptr) {
+    *stats = reader.stats();
+  }
+  return total;
+}
@@ -0,0 +1,223 @@
+#include "protocol_registry.hpp"
+#include "metrics.hpp"
+#include "protocols/ethernet.hpp"
+#include "protocols/ipv4.hpp"
+#include "protocols/ipv6.hpp"
+#include "protocols/tcp.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// --- Built-in parsers ---
+// Each parses its layer into the stack, removes the header from the data
+// view and names the table holding the next parser. They are `inline` so
+// that decode() can inline them where it calls them directly.
+
+/**
+ * @brief Parses the Layer 2 Ethernet header.
+ */
+inline NextLayer parse_ethernet(DecodeState &state, void *) {
+  EthernetHeader &eth = state.stack.header<Ethernet>();
+  const std::size_t header_len = eth.parse(state.data);
+  if (header_len == 0) {
+    count_malformed(Stage::Ethernet);
+    return {};
+  }
+
+  state.stack.push<Ethernet>(state.offset(), header_len, state.data.length());
+  state.data.remove_prefix(header_len);
+  // An unknown EtherType stops here; the rest stays available as payload.
+  return {Dispatch::EtherType, eth.eth_type};
+}
+
+/**
+ * @brief Parses the Layer 3 IPv4 header (RFC 791), including options.
+ */
+inline NextLayer parse_ipv4(DecodeState &state, void *) {
+  IPv4Header &ipv4 = state.stack.header<IPv4>();
+  const std::size_t header_len = ipv4.parse(state.data);
+  if (header_len == 0) {
+    count_malformed(Stage::IPv4);
+    return {};
+  }
+
+  // Drop Ethernet padding: total_length is authoritative when it fits.
+  if (ipv4.total_length >= header_len &&
+      ipv4.total_length < state.data.length()) {
+    state.data = state.data.substr(0, ipv4.total_length);
+  }
+  state.stack.push<IPv4>(state.offset(), header_len, state.data.length());
+  state.data.remove_prefix(header_len);
+
+  // Only the first fragment carries the L4 header.
+  if (ipv4.fragment_offset != 0) {
+    return {};
+  }
+  return {Dispatch::IpProtocol, ipv4.protocol};
+}
+
+/**
+ * @brief Parses the 40-byte IPv6 base header (RFC 8200) and walks the
+ * extension headers after it.
+ *
+ * The layer's header is the base header; the extension headers are
+ * skipped before dispatching on the upper-layer protocol. Like IPv4, only
+ * the first fragment carries the L4 header.
+ */
+inline NextLayer parse_ipv6(DecodeState &state, void *) {
+  IPv6Header &ipv6 = state.stack.header<IPv6>();
+  const std::size_t header_len = ipv6.parse(state.data);
+  if (header_len == 0) {
+    count_malformed(Stage::IPv6);
+    return {};
+  }
+
+  // A payload_length of 0 is a jumbogram (RFC 2675), whose length is in a
+  // Hop-by-Hop option: keep everything captured.
+  if (ipv6.payload_length != 0 &&
+      header_len + ipv6.payload_length < state.data.length()) {
+    state.data = state.data.substr(0, header_len + ipv6.payload_length);
+  }
+  state.stack.push<IPv6>(state.offset(), header_len, state.data.length());
+  state.data.remove_prefix(header_len);
+
+  // Extension headers are not a layer of their own: without an upper
+  // layer, they stay part of the payload.
+  state.data.remove_prefix(ipv6.parse_extensions(state.data));
+  if (ipv6.fragment_offset != 0) {
+    return {};
+  }
+  return {Dispatch::IpProtocol, ipv6.upper_protocol};
+}
+
+/**
+ * @brief Parses the Layer 4 TCP header (RFC 9293), skipping options.
+ */
+inline NextLayer parse_tcp(DecodeState &state, void *) {
+  TCPHeader &tcp = state.stack.header<TCP>();
+  const std::size_t header_len = tcp.parse(state.data);
+  if (header_len == 0) {
+    count_malformed(Stage::TCP);
+    return {};
+  }
+
+  // The remaining data is the Application Layer (e.g., HTTP).
+  state.stack.push<TCP>(state.offset(), header_len, state.data.length());
+  state.data.remove_prefix(header_len);
+  return {Dispatch::Port, tcp.src_port, tcp.dst_port};
+}
+
+} // namespace
+
+ProtocolRegistry::ProtocolRegistry() {
+  m_parsers.push_back(Entry{nullptr, nullptr}); // NONE
+  add(Dispatch::EtherType, EthernetHeader::ETH_TYPE_IPV4, parse_ipv4);
+  add(Dispatch::EtherType, EthernetHeader::ETH_TYPE_IPV6, parse_ipv6);
+  add(Dispatch::IpProtocol, IPv4Header::PROTO_TCP, parse_tcp);
+}
+
+void ProtocolRegistry::add(Dispatch table, uint16_t key, ProtocolParser parser,
+                           void *context) {
+  if (table == Dispatch::None || parser == nullptr) {
+    throw std::invalid_argument("ProtocolRegistry: no table or parser");
+  }
+  uint8_t *target = table_for(table, key);
+  if (target == nullptr) {
+    throw std::invalid_argument("ProtocolRegistry: IP protocol out of range");
+  }
+
+  const auto same = [parser, context](const Entry &entry) {
+    return entry.parser == parser && entry.context == context;
+  };
+  auto found = std::find_if(m_parsers.begin() + 1, m_parsers.end(), same);
+  if (found == m_parsers.end()) {
+    if (m_parsers.size() > MAX_PARSERS) {
+      throw std::invalid_argument("ProtocolRegistry: too many parsers");
+    }
+    m_parsers.push_back(Entry{parser, context});
+    found = m_parsers.end() - 1;
+  }
+  *target = static_cast<uint8_t>(found - m_parsers.begin());
+}
+
+void ProtocolRegistry::remove(Dispatch table, uint16_t key) {
+  if (uint8_t *target = table_for(table, key)) {
+    *target = NONE;
+  }
+}
+
+void ProtocolRegistry::decode(DecodeState &state) const {
+  // Each layer's time includes finding its parser.
+  StageClock clock;
+  NextLayer next = parse_ethernet(state, nullptr);
+  clock.lap(Stage::Ethernet);
+  for (std::size_t depth = 0;
+       next.table != Dispatch::None && depth < MAX_DEPTH; ++depth) {
+    uint8_t index;
+    if (next.table == Dispatch::Port) {
+      const uint16_t low = std::min(next.key, next.other_key);
+      const uint16_t high = std::max(next.key, next.other_key);
+      index = m_ports[low];
+      if (index == NONE) {
+        index = m_ports[high];
+      }
+    } else {
+      index = slot(next.table, next.key);
+    }
+    if (index == NONE) {
+      return;
+    }
+    // Built-ins are called directly so they can be inlined; only plugins
+    // pay for the indirect call.
+    const Entry &entry = m_parsers[index];
+    Stage stage;
+    if (entry.parser == parse_ipv4) {
+      stage = Stage::IPv4;
+      next = parse_ipv4(state, nullptr);
+    } else if (entry.parser == parse_ipv6) {
+      stage = Stage::IPv6;
+      next = parse_ipv6(state, nullptr);
+    } else if (entry.parser == parse_tcp) {
+      stage = Stage::TCP;
+      next = parse_tcp(state, nullptr);
+    } else {
+      stage = Stage::Plugin;
+      next = entry.parser(state, entry.context);
+    }
+    clock.lap(stage);
+  }
+}
+
+ProtocolRegistry &ProtocolRegistry::global() {
+  static ProtocolRegistry registry;
+  return registry;
+}
+
+uint8_t ProtocolRegistry::slot(Dispatch table, uint16_t key) const {
+  switch (table) {
+  case Dispatch::EtherType:
+    return m_ether_types[key];
+  case Dispatch::IpProtocol:
+    return key < m_ip_protocols.size() ? m_ip_protocols[key] : NONE;
+  case Dispatch::Port:
+    return m_ports[key];
+  case Dispatch::None:
+    break;
+  }
+  return NONE;
+}
+
+uint8_t *ProtocolRegistry::table_for(Dispatch table, uint16_t key) {
+  switch (table) {
+  case Dispatch::EtherType:
+    return &m_ether_types[key];
+  case Dispatch::IpProtocol:
+    return key < m_ip_protocols.size() ? &m_ip_protocols[key] : nullptr;
+  case Dispatch::Port:
+    return &m_ports[key];
+  case Dispatch::None:
+    break;
+  }
+  return nullptr;
+}
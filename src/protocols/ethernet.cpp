@@ -0,0 +1,20 @@
+#include "protocols/ethernet.hpp"
+#include "byte_order.hpp"
+
+std::size_t EthernetHeader::parse(std::string_view data) {
+  if (data.length() < HEADER_SIZE) {
+    return 0;
+  }
+
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(data.data());
+
+  // 1. Destination MAC (First 6 bytes)
+  dest_mac = MacAddress(bytes);
+
+  // 2. Source MAC (Next 6 bytes)
+  source_mac = MacAddress(bytes + MacAddress::LENGTH);
+
+  eth_type = load_be16(bytes + ETH_TYPE_OFFSET);
+  return HEADER_SIZE;
+}
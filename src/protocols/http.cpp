@@ -0,0 +1,665 @@
+#include "protocols/http.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Returns the first byte in [p, end) equal to `a` or `b`, or `end`.
+const char *find_first(const char *p, const char *end, char a, char b) {
+#if defined(__SSE2__)
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  while (end - p >= 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+    if (mask != 0) {
+      return p + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+    p += 16;
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == a || *p == b) {
+      return p;
+    }
+  }
+  return end;
+}
+
+const char *find_byte(const char *p, const char *end, char c) {
+  return find_first(p, end, c, c);
+}
+
+// RFC 9110 "tchar": the characters allowed in methods and header names
+constexpr std::array<bool, 256> TOKEN_CHARS = [] {
+  std::array<bool, 256> table{};
+  for (int c = '0'; c <= '9'; ++c) {
+    table[c] = true;
+  }
+  for (int c = 'a'; c <= 'z'; ++c) {
+    table[c] = true;
+    table[c - 'a' + 'A'] = true;
+  }
+  for (const char c : std::string_view("!#$%&'*+-.^_`|~")) {
+    table[static_cast<unsigned char>(c)] = true;
+  }
+  return table;
+}();
+
+bool is_token(std::string_view text) {
+  for (const char c : text) {
+    if (!TOKEN_CHARS[static_cast<unsigned char>(c)]) {
+      return false;
+    }
+  }
+  return !text.empty();
+}
+
+// Header names are nearly always letters, digits and '-'. Checks for those
+// 16 bytes at a time and leaves anything else to is_token(). Reads up to
+// `end`, past the name itself.
+bool is_header_name(std::string_view name, const char *end) {
+#if defined(__SSE2__)
+  const char *p = name.data();
+  const char *const name_end = p + name.length();
+  while (p < name_end && end - p >= 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // Signed compares: bytes >= 0x80 are negative and fail both ranges.
+    const __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    const __m128i alpha =
+        _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                      _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    const __m128i digit =
+        _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                      _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+    const __m128i dash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('-'));
+    const auto mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), dash)));
+    const auto count =
+        std::min<std::size_t>(16, static_cast<std::size_t>(name_end - p));
+    const unsigned wanted = count == 16 ? 0xFFFFu : (1u << count) - 1;
+    if ((mask & wanted) != wanted) {
+      return is_token(name);
+    }
+    p += count;
+  }
+  if (p != name.data()) {
+    return p == name_end ||
+           is_token(std::string_view(p, static_cast<std::size_t>(
+                                             name_end - p)));
+  }
+#else
+  static_cast<void>(end);
+#endif
+  return is_token(name);
+}
+
+char ascii_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+  if (a.length() != b.length()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.length(); ++i) {
+    if (ascii_lower(a[i]) != ascii_lower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+HttpField classify(std::string_view name) {
+  switch (name.length()) {
+  case 4:
+    if (iequals(name, "host")) {
+      return HttpField::Host;
+    }
+    break;
+  case 6:
+    if (iequals(name, "accept")) {
+      return HttpField::Accept;
+    }
+    if (iequals(name, "cookie")) {
+      return HttpField::Cookie;
+    }
+    if (iequals(name, "server")) {
+      return HttpField::Server;
+    }
+    break;
+  case 8:
+    if (iequals(name, "location")) {
+      return HttpField::Location;
+    }
+    break;
+  case 10:
+    if (iequals(name, "user-agent")) {
+      return HttpField::UserAgent;
+    }
+    if (iequals(name, "connection")) {
+      return HttpField::Connection;
+    }
+    if (iequals(name, "set-cookie")) {
+      return HttpField::SetCookie;
+    }
+    break;
+  case 12:
+    if (iequals(name, "content-type")) {
+      return HttpField::ContentType;
+    }
+    break;
+  case 14:
+    if (iequals(name, "content-length")) {
+      return HttpField::ContentLength;
+    }
+    break;
+  case 15:
+    if (iequals(name, "accept-encoding")) {
+      return HttpField::AcceptEncoding;
+    }
+    break;
+  case 17:
+    if (iequals(name, "transfer-encoding")) {
+      return HttpField::TransferEncoding;
+    }
+    break;
+  default:
+    break;
+  }
+  return HttpField::Count;
+}
+
+bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+// Strips surrounding whitespace (and the CR of a CRLF line ending).
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && (is_space(text.back()) || text.back() == '\r')) {
+    text.remove_suffix(1);
+  }
+  while (!text.empty() && is_space(text.front())) {
+    text.remove_prefix(1);
+  }
+  return text;
+}
+
+bool parse_content_length(std::string_view text, uint64_t &value) {
+  // 19 digits always fit in 64 bits.
+  if (text.empty() || text.length() > 19) {
+    return false;
+  }
+  value = 0;
+  for (const char c : text) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    value = value * 10 + static_cast<uint64_t>(c - '0');
+  }
+  return true;
+}
+
+// True if the last transfer coding listed is "chunked".
+bool ends_with_chunked(std::string_view codings) {
+  const std::size_t comma = codings.rfind(',');
+  if (comma != std::string_view::npos) {
+    codings.remove_prefix(comma + 1);
+  }
+  return iequals(trim(codings), "chunked");
+}
+
+bool parse_start_line(std::string_view line, HttpMessage &message) {
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  const std::size_t first_space = line.find(' ');
+  if (first_space == std::string_view::npos) {
+    return false;
+  }
+
+  if (line.compare(0, 5, "HTTP/") == 0) {
+    // HTTP-version SP status-code [SP reason-phrase]
+    message.is_request = false;
+    message.http_version = line.substr(0, first_space);
+    const std::string_view rest = line.substr(first_space + 1);
+    if (rest.length() < 3 || (rest.length() > 3 && rest[3] != ' ')) {
+      return false;
+    }
+    uint16_t status = 0;
+    for (std::size_t i = 0; i < 3; ++i) {
+      if (rest[i] < '0' || rest[i] > '9') {
+        return false;
+      }
+      status = static_cast<uint16_t>(status * 10 + (rest[i] - '0'));
+    }
+    message.status_code = status;
+    message.reason_phrase =
+        rest.length() > 4 ? rest.substr(4) : std::string_view();
+    return true;
+  }
+
+  // method SP request-target SP HTTP-version
+  const std::size_t second_space = line.find(' ', first_space + 1);
+  if (second_space == std::string_view::npos ||
+      second_space == first_space + 1) {
+    return false;
+  }
+  message.is_request = true;
+  message.method = line.substr(0, first_space);
+  message.uri = line.substr(first_space + 1, second_space - first_space - 1);
+  message.http_version = line.substr(second_space + 1);
+  return is_token(message.method) &&
+         message.http_version.compare(0, 5, "HTTP/") == 0;
+}
+
+// Parses the head at the start of `buffer` into `message`. Returns its
+// length, or 0 if it is not complete yet or `error` was set.
+std::size_t parse_head(std::string_view buffer, HttpMessage &message,
+                       HttpParser::Error &error) {
+  const char *const begin = buffer.data();
+  const char *const end = begin + buffer.length();
+
+  const char *line_end = find_byte(begin, end, '\n');
+  if (line_end == end) {
+    // Give up early on streams that are not HTTP at all, rather than
+    // buffering a whole MAX_HEAD_SIZE of them first.
+    const std::string_view start(begin, buffer.length());
+    const std::size_t space = start.find(' ');
+    if (start.compare(0, 5, "HTTP/") != 0 &&
+        !is_token(start.substr(0, std::min(space, start.length())))) {
+      error = HttpParser::Error::BadStartLine;
+    }
+    return 0;
+  }
+  if (!parse_start_line(std::string_view(begin, line_end - begin),
+                        message)) {
+    error = HttpParser::Error::BadStartLine;
+    return 0;
+  }
+
+  const char *line = line_end + 1;
+  while (true) {
+    // One pass finds the colon, or the end of a line without one.
+    const char *delimiter = find_first(line, end, ':', '\n');
+    if (delimiter == end) {
+      return 0;
+    }
+    if (*delimiter == '\n') {
+      if (delimiter == line || (delimiter == line + 1 && *line == '\r')) {
+        break; // the blank line ending the head
+      }
+      error = HttpParser::Error::BadHeader;
+      return 0;
+    }
+
+    const std::string_view name(line, delimiter - line);
+    line_end = find_byte(delimiter + 1, end, '\n');
+    if (line_end == end) {
+      return 0;
+    }
+    if (!is_header_name(name, end)) {
+      error = HttpParser::Error::BadHeader;
+      return 0;
+    }
+    const std::string_view value =
+        trim(std::string_view(delimiter + 1, line_end - delimiter - 1));
+
+    const HttpField field = classify(name);
+    if (field == HttpField::ContentLength) {
+      uint64_t length = 0;
+      if (!parse_content_length(value, length) ||
+          (message.has_content_length && length != message.content_length)) {
+        error = HttpParser::Error::BadContentLength;
+        return 0;
+      }
+      message.has_content_length = true;
+      message.content_length = length;
+    } else if (field == HttpField::TransferEncoding) {
+      message.chunked = ends_with_chunked(value);
+    }
+
+    const HttpMessage::Span span{
+        static_cast<uint16_t>(line - begin),
+        static_cast<uint16_t>(name.length()),
+        static_cast<uint16_t>(value.data() - begin),
+        static_cast<uint16_t>(value.length())};
+    if (!message.add_header(span, field)) {
+      error = HttpParser::Error::TooManyHeaders;
+      return 0;
+    }
+    line = line_end + 1;
+  }
+
+  const std::size_t length =
+      static_cast<std::size_t>(line - begin) + (*line == '\r' ? 2 : 1);
+  message.head = buffer.substr(0, length);
+  return length;
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = ascii_lower(c);
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+} // namespace
+
+bool HttpMessage::add_header(Span span, HttpField field) {
+  if (m_header_count == MAX_HEADERS) {
+    return false;
+  }
+  m_spans[m_header_count] = span;
+  if (field != HttpField::Count) {
+    uint8_t &index = m_field_index[static_cast<std::size_t>(field)];
+    if (index == 0) {
+      index = static_cast<uint8_t>(m_header_count + 1);
+    }
+  }
+  ++m_header_count;
+  return true;
+}
+
+std::string_view HttpMessage::get_header(std::string_view name) const {
+  const HttpField field = classify(name);
+  if (field != HttpField::Count) {
+    return get(field);
+  }
+  for (std::size_t i = 0; i < m_header_count; ++i) {
+    const HttpHeaderField entry = header(i);
+    if (iequals(entry.name, name)) {
+      return entry.value;
+    }
+  }
+  return {};
+}
+
+bool HttpParser::feed(std::string_view data, Handler &handler) {
+  while (!data.empty()) {
+    std::size_t used = 0;
+    switch (m_state) {
+    case State::Failed:
+      return false;
+    case State::Head:
+      used = feed_head(data, handler);
+      break;
+    case State::Body:
+      used = static_cast<std::size_t>(
+          std::min<uint64_t>(m_remaining, data.length()));
+      handler.on_body(data.substr(0, used));
+      m_remaining -= used;
+      if (m_remaining == 0) {
+        complete(handler);
+      }
+      break;
+    case State::BodyUntilClose:
+      used = data.length();
+      handler.on_body(data);
+      break;
+    case State::Tunnel:
+      return true;
+    default:
+      used = feed_chunked(data, handler);
+      break;
+    }
+    data.remove_prefix(used);
+  }
+  return m_state != State::Failed;
+}
+
+std::size_t HttpParser::feed_head(std::string_view data, Handler &handler) {
+  HttpMessage message;
+  Error error = Error::None;
+
+  if (m_head.empty()) {
+    // Tolerate the stray line breaks some clients send between messages.
+    std::size_t skipped = 0;
+    while (skipped < data.length() &&
+           (data[skipped] == '\r' || data[skipped] == '\n')) {
+      ++skipped;
+    }
+    if (skipped != 0) {
+      return skipped;
+    }
+
+    // Common case: the whole head is in `data`; parse it in place.
+    const std::size_t length =
+        parse_head(data.substr(0, MAX_HEAD_SIZE), message, error);
+    if (error != Error::None) {
+      fail(error);
+      return data.length();
+    }
+    if (length == 0) {
+      if (data.length() >= MAX_HEAD_SIZE) {
+        fail(Error::HeadTooLarge);
+        return data.length();
+      }
+      m_head.assign(data.data(), data.length());
+      return data.length();
+    }
+    handler.on_message(message);
+    begin_body(message, handler);
+    return length;
+  }
+
+  // Continue a head split across calls.
+  const std::size_t buffered = m_head.length();
+  const std::size_t take =
+      std::min(data.length(), MAX_HEAD_SIZE - buffered);
+  m_head.append(data.data(), take);
+  // The head ends with a line break, so it cannot have ended unless one
+  // just arrived.
+  if (std::memchr(data.data(), '\n', take) == nullptr) {
+    if (m_head.length() >= MAX_HEAD_SIZE) {
+      fail(Error::HeadTooLarge);
+      return data.length();
+    }
+    return take;
+  }
+
+  const std::size_t length = parse_head(m_head, message, error);
+  if (error != Error::None) {
+    fail(error);
+    return data.length();
+  }
+  if (length == 0) {
+    if (m_head.length() >= MAX_HEAD_SIZE) {
+      fail(Error::HeadTooLarge);
+      return data.length();
+    }
+    return take;
+  }
+  handler.on_message(message);
+  begin_body(message, handler);
+  m_head.clear();
+  return length - buffered;
+}
+
+std::size_t HttpParser::feed_chunked(std::string_view data,
+                                     Handler &handler) {
+  const char *const begin = data.data();
+  const char *const end = begin + data.length();
+  const char *p = begin;
+
+  switch (m_state) {
+  case State::ChunkSize:
+    for (; p < end; ++p) {
+      const int digit = hex_value(*p);
+      if (digit >= 0) {
+        if ((m_remaining >> 60) != 0) {
+          fail(Error::BadChunk);
+          return data.length();
+        }
+        m_remaining = (m_remaining << 4) | static_cast<uint64_t>(digit);
+        m_chunk_digits = true;
+        continue;
+      }
+      if (!m_chunk_digits) {
+        fail(Error::BadChunk);
+        return data.length();
+      }
+      if (*p == '\n') {
+        m_state = m_remaining == 0 ? State::TrailerStart : State::ChunkData;
+        return static_cast<std::size_t>(p + 1 - begin);
+      }
+      if (*p == ';' || *p == '\r' || is_space(*p)) {
+        m_state = State::ChunkExtension;
+        return static_cast<std::size_t>(p + 1 - begin);
+      }
+      fail(Error::BadChunk);
+      return data.length();
+    }
+    return data.length();
+
+  case State::ChunkExtension:
+    p = find_byte(p, end, '\n');
+    if (p == end) {
+      return data.length();
+    }
+    m_state = m_remaining == 0 ? State::TrailerStart : State::ChunkData;
+    return static_cast<std::size_t>(p + 1 - begin);
+
+  case State::ChunkData: {
+    const auto used = static_cast<std::size_t>(
+        std::min<uint64_t>(m_remaining, data.length()));
+    handler.on_body(data.substr(0, used));
+    m_remaining -= used;
+    if (m_remaining == 0) {
+      m_state = State::ChunkDataEnd;
+    }
+    return used;
+  }
+
+  case State::ChunkDataEnd:
+    if (*p == '\r') {
+      return 1;
+    }
+    if (*p != '\n') {
+      fail(Error::BadChunk);
+      return data.length();
+    }
+    m_state = State::ChunkSize;
+    m_chunk_digits = false;
+    return 1;
+
+  case State::TrailerStart:
+    if (*p == '\r') {
+      return 1;
+    }
+    if (*p == '\n') {
+      complete(handler);
+      return 1;
+    }
+    m_state = State::Trailer;
+    return 1;
+
+  case State::Trailer:
+    p = find_byte(p, end, '\n');
+    if (p == end) {
+      return data.length();
+    }
+    m_state = State::TrailerStart;
+    return static_cast<std::size_t>(p + 1 - begin);
+
+  default:
+    return data.length();
+  }
+}
+
+void HttpParser::begin_body(const HttpMessage &message, Handler &handler) {
+  m_remaining = 0;
+  ResponseFraming framing = ResponseFraming::Normal;
+  if (!message.is_request && message.status_code >= 200) {
+    // Interim (1xx) responses share their request with the final one.
+    framing = m_next_response;
+    m_next_response = ResponseFraming::Normal;
+  }
+  if (framing == ResponseFraming::Tunnel && message.status_code < 300) {
+    complete(handler);
+    m_state = State::Tunnel;
+  } else if (framing == ResponseFraming::NoBody ||
+             (!message.is_request &&
+              (message.status_code < 200 || message.status_code == 204 ||
+               message.status_code == 304))) {
+    // These responses never have a body, whatever the headers say.
+    complete(handler);
+  } else if (message.chunked) {
+    m_state = State::ChunkSize;
+    m_chunk_digits = false;
+  } else if (message.has_content_length) {
+    m_remaining = message.content_length;
+    if (m_remaining == 0) {
+      complete(handler);
+    } else {
+      m_state = State::Body;
+    }
+  } else if (message.is_request) {
+    complete(handler);
+  } else {
+    m_state = State::BodyUntilClose;
+  }
+}
+
+void HttpParser::complete(Handler &handler) {
+  m_state = State::Head;
+  ++m_messages;
+  handler.on_message_complete();
+}
+
+void HttpParser::fail(Error error) {
+  m_state = State::Failed;
+  m_error = error;
+  m_head.clear();
+}
+
+bool HttpParser::skip(uint64_t bytes, Handler &handler) {
+  switch (m_state) {
+  case State::Failed:
+    return false;
+  case State::BodyUntilClose:
+  case State::Tunnel:
+    return true;
+  case State::Body:
+  case State::ChunkData:
+    if (bytes > m_remaining) {
+      break; // the gap swallowed the end of the body, too
+    }
+    m_remaining -= bytes;
+    if (m_remaining == 0) {
+      if (m_state == State::Body) {
+        complete(handler);
+      } else {
+        m_state = State::ChunkDataEnd;
+      }
+    }
+    return true;
+  default:
+    break;
+  }
+  fail(Error::Gap);
+  return false;
+}
+
+void HttpParser::finish(Handler &handler) {
+  if (m_state == State::BodyUntilClose) {
+    complete(handler);
+  }
+}
+
+void HttpParser::reset() {
+  m_state = State::Head;
+  m_error = Error::None;
+  m_chunk_digits = false;
+  m_next_response = ResponseFraming::Normal;
+  m_remaining = 0;
+  m_head.clear();
+}
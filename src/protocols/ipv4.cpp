@@ -0,0 +1,36 @@
+#include "protocols/ipv4.hpp"
+#include "byte_order.hpp"
+
+std::size_t IPv4Header::parse(std::string_view data) {
+  if (data.length() < MIN_HEADER_SIZE) {
+    return 0;
+  }
+
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(data.data());
+
+  const std::size_t header_len = static_cast<std::size_t>(bytes[0] & 0x0F) * 4;
+  if ((bytes[0] >> 4) != 4 || header_len < MIN_HEADER_SIZE ||
+      header_len > data.length()) {
+    return 0;
+  }
+
+  version = bytes[0] >> 4;
+  ihl = bytes[0] & 0x0F;
+  dscp = bytes[1] >> 2;
+  ecn = bytes[1] & 0x03;
+  total_length = load_be16(bytes + 2);
+  identification = load_be16(bytes + 4);
+
+  const uint16_t flags_fragment = load_be16(bytes + 6);
+  dont_fragment = (flags_fragment & 0x4000) != 0;
+  more_fragments = (flags_fragment & 0x2000) != 0;
+  fragment_offset = flags_fragment & 0x1FFF;
+
+  ttl = bytes[8];
+  protocol = bytes[9];
+  header_checksum = load_be16(bytes + 10);
+  source_ip = Ipv4Address(bytes + 12);
+  dest_ip = Ipv4Address(bytes + 16);
+  return header_len;
+}
@@ -0,0 +1,81 @@
+#include "protocols/ipv6.hpp"
+#include "byte_order.hpp"
+
+std::size_t IPv6Header::parse(std::string_view data) {
+  if (data.length() < HEADER_SIZE) {
+    return 0;
+  }
+
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(data.data());
+  if ((bytes[0] >> 4) != 6) {
+    return 0;
+  }
+
+  version = bytes[0] >> 4;
+  traffic_class =
+      static_cast<uint8_t>(((bytes[0] & 0x0F) << 4) | (bytes[1] >> 4));
+  flow_label = load_be32(bytes) & 0x000FFFFF;
+  payload_length = load_be16(bytes + 4);
+  next_header = bytes[6];
+  hop_limit = bytes[7];
+  source_ip = Ipv6Address(bytes + 8);
+  dest_ip = Ipv6Address(bytes + 8 + Ipv6Address::LENGTH);
+  return HEADER_SIZE;
+}
+
+std::size_t IPv6Header::parse_extensions(std::string_view payload) {
+  upper_protocol = next_header;
+  extension_length = 0;
+  fragmented = false;
+  fragment_offset = 0;
+  fragment_header = 0;
+  fragment_link = 6;
+
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(payload.data());
+  std::size_t offset = 0;
+  std::size_t link = 6; // the next_header field naming the current header
+  for (std::size_t i = 0; i < MAX_EXTENSIONS; ++i) {
+    // Every extension header is at least 8 bytes and starts with the
+    // next header; all but the Fragment header give their length next.
+    if (payload.length() - offset < 8) {
+      break;
+    }
+    const unsigned char *header = bytes + offset;
+    std::size_t length;
+    switch (upper_protocol) {
+    case NH_HOP_BY_HOP:
+    case NH_ROUTING:
+    case NH_DEST_OPTS:
+      length = (static_cast<std::size_t>(header[1]) + 1) * 8;
+      break;
+    case NH_AUTH: // in 4-byte units, minus 2 (RFC 4302)
+      length = (static_cast<std::size_t>(header[1]) + 2) * 4;
+      break;
+    case NH_FRAG:
+      length = 8;
+      fragmented = true;
+      fragment_offset = static_cast<uint16_t>(load_be16(header + 2) >> 3);
+      fragment_header = static_cast<uint16_t>(offset);
+      fragment_link = static_cast<uint16_t>(link);
+      if (fragment_offset != 0) {
+        // The rest is a piece of the payload, not more headers.
+        upper_protocol = header[0];
+        extension_length = static_cast<uint16_t>(offset + length);
+        return extension_length;
+      }
+      break;
+    default:
+      return extension_length;
+    }
+    if (length > payload.length() - offset) {
+      break;
+    }
+    upper_protocol = header[0];
+    link = HEADER_SIZE + offset;
+    offset += length;
+    extension_length = static_cast<uint16_t>(offset);
+  }
+  return extension_length;
+}
@@ -0,0 +1,39 @@
+#include "protocols/tcp.hpp"
+#include "byte_order.hpp"
+
+std::size_t TCPHeader::parse(std::string_view data) {
+  if (data.length() < MIN_HEADER_SIZE) {
+    return 0;
+  }
+
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(data.data());
+
+  // The header length is `data_offset * 4` bytes!
+  const std::size_t header_len = static_cast<std::size_t>(bytes[12] >> 4) * 4;
+  if (header_len < MIN_HEADER_SIZE || header_len > data.length()) {
+    return 0;
+  }
+
+  src_port = load_be16(bytes);
+  dst_port = load_be16(bytes + 2);
+  seq_number = load_be32(bytes + 4);
+  ack_number = load_be32(bytes + 8);
+  data_offset = bytes[12] >> 4;
+
+  const uint8_t flags = bytes[13];
+  flag_ns = (bytes[12] & 0x01) != 0;
+  flag_cwr = (flags & 0x80) != 0;
+  flag_ece = (flags & 0x40) != 0;
+  flag_urg = (flags & 0x20) != 0;
+  flag_ack = (flags & 0x10) != 0;
+  flag_psh = (flags & 0x08) != 0;
+  flag_rst = (flags & 0x04) != 0;
+  flag_syn = (flags & 0x02) != 0;
+  flag_fin = (flags & 0x01) != 0;
+
+  window_size = load_be16(bytes + 14);
+  checksum = load_be16(bytes + 16);
+  urgent_pointer = load_be16(bytes + 18);
+  return header_len;
+}
@@ -0,0 +1,88 @@
+#include "sketch.hpp"
+#include <cmath>
+
+// --- CountMinSketch ---
+
+CountMinSketch::CountMinSketch(std::size_t width, std::size_t depth)
+    : m_width(1), m_depth(depth) {
+  if (width == 0 || depth == 0 || width > (std::size_t{1} << 32)) {
+    throw std::invalid_argument("CountMinSketch: width or depth out of range");
+  }
+  while (m_width < width) {
+    m_width *= 2;
+  }
+  m_mask = m_width - 1;
+  m_counters.assign(m_width * m_depth, 0);
+}
+
+uint64_t CountMinSketch::estimate(uint64_t hash) const {
+  const uint64_t step = (hash >> 32) | 1;
+  uint64_t position = hash;
+  uint64_t smallest = UINT64_MAX;
+  for (std::size_t row = 0; row < m_depth; ++row) {
+    smallest =
+        std::min(smallest, m_counters[row * m_width + (position & m_mask)]);
+    position += step;
+  }
+  return smallest;
+}
+
+void CountMinSketch::merge(const CountMinSketch &other) {
+  if (other.m_width != m_width || other.m_depth != m_depth) {
+    throw std::invalid_argument("CountMinSketch: sizes differ");
+  }
+  for (std::size_t i = 0; i < m_counters.size(); ++i) {
+    m_counters[i] += other.m_counters[i];
+  }
+  m_total += other.m_total;
+}
+
+void CountMinSketch::clear() {
+  std::fill(m_counters.begin(), m_counters.end(), 0);
+  m_total = 0;
+}
+
+// --- HyperLogLog ---
+
+HyperLogLog::HyperLogLog(unsigned precision)
+    : m_precision(precision), m_shift(64 - precision) {
+  if (precision < MIN_PRECISION || precision > MAX_PRECISION) {
+    throw std::invalid_argument("HyperLogLog: precision out of range");
+  }
+  m_registers.assign(std::size_t{1} << precision, 0);
+}
+
+double HyperLogLog::estimate() const {
+  const double registers = static_cast<double>(m_registers.size());
+  double sum = 0;
+  std::size_t zeros = 0;
+  for (uint8_t rank : m_registers) {
+    sum += std::ldexp(1.0, -static_cast<int>(rank));
+    zeros += rank == 0 ? 1 : 0;
+  }
+  // Bias correction constant from Flajolet et al.
+  const double alpha = m_precision == 4   ? 0.673
+                       : m_precision == 5 ? 0.697
+                       : m_precision == 6 ? 0.709
+                                          : 0.7213 / (1 + 1.079 / registers);
+  const double raw = alpha * registers * registers / sum;
+  if (raw <= 2.5 * registers && zeros != 0) {
+    // Linear counting, more accurate while many registers are still empty
+    return registers * std::log(registers / static_cast<double>(zeros));
+  }
+  // A 64-bit hash needs no large range correction.
+  return raw;
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+  if (other.m_precision != m_precision) {
+    throw std::invalid_argument("HyperLogLog: precisions differ");
+  }
+  for (std::size_t i = 0; i < m_registers.size(); ++i) {
+    m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+  }
+}
+
+void HyperLogLog::clear() {
+  std::fill(m_registers.begin(), m_registers.end(), 0);
+}
@@ -0,0 +1,403 @@
+#include "sniffer.hpp"
+#include "packet_filter.hpp"
+#include <pcap/pcap.h>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <arpa/inet.h> // For htons()
+#include <cerrno>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h> // For ETH_P_ALL
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+#endif
+
+namespace {
+
+void dispatch_thunk(u_char *user, const pcap_pkthdr *header,
+                    const u_char *bytes) {
+  const auto &callback = *reinterpret_cast<const Sniffer::Callback *>(user);
+  const uint64_t timestamp_ns =
+      static_cast<uint64_t>(header->ts.tv_sec) * 1000000000ULL +
+      static_cast<uint64_t>(header->ts.tv_usec) * 1000ULL;
+  callback(PacketRef{
+      std::string_view(reinterpret_cast<const char *>(bytes), header->caplen),
+      timestamp_ns});
+}
+
+#ifdef __linux__
+// What the kernel knows about the frame's TCP/UDP checksum. libpcap
+// delivers none of this, so only TpacketSniffer sets PacketRef::flags.
+uint32_t checksum_flags(uint32_t status) {
+  uint32_t flags = 0;
+#ifdef TP_STATUS_CSUM_VALID
+  if ((status & TP_STATUS_CSUM_VALID) != 0) {
+    flags |= PacketRef::CHECKSUM_VALID;
+  }
+#endif
+  if ((status & TP_STATUS_CSUMNOTREADY) != 0) {
+    flags |= PacketRef::CHECKSUM_PARTIAL;
+  }
+  return flags;
+}
+#endif
+
+} // namespace
+
+PcapSniffer::PcapSniffer(const std::string &interface)
+    : PcapSniffer(interface, Options{}) {}
+
+PcapSniffer::PcapSniffer(const std::string &interface,
+                         const Options &options) {
+  char errbuf[PCAP_ERRBUF_SIZE] = {};
+  m_handle = pcap_create(interface.c_str(), errbuf);
+  if (m_handle == nullptr) {
+    throw std::runtime_error("pcap_create(" + interface + "): " + errbuf);
+  }
+
+  pcap_set_snaplen(m_handle, options.snaplen);
+  pcap_set_promisc(m_handle, options.promiscuous ? 1 : 0);
+  pcap_set_timeout(m_handle, options.timeout_ms);
+  pcap_set_buffer_size(m_handle, options.buffer_size);
+
+  const int status = pcap_activate(m_handle);
+  if (status < 0) {
+    const std::string reason = status == PCAP_ERROR
+                                   ? pcap_geterr(m_handle)
+                                   : pcap_statustostr(status);
+    pcap_close(m_handle);
+    m_handle = nullptr;
+    throw std::runtime_error("pcap_activate(" + interface + "): " + reason);
+  }
+}
+
+PcapSniffer::~PcapSniffer() {
+  if (m_handle != nullptr) {
+    pcap_close(m_handle);
+  }
+}
+
+int PcapSniffer::poll(int max_packets, const Callback &callback) {
+  if (m_interrupted.load(std::memory_order_relaxed)) {
+    return -1;
+  }
+  const int count = pcap_dispatch(
+      m_handle, max_packets, dispatch_thunk,
+      reinterpret_cast<u_char *>(const_cast<Callback *>(&callback)));
+  if (count == PCAP_ERROR_BREAK &&
+      !m_interrupted.load(std::memory_order_relaxed)) {
+    return 0; // a break left over from before clear_interrupt()
+  }
+  // PCAP_ERROR or PCAP_ERROR_BREAK
+  return count < 0 ? -1 : count;
+}
+
+void PcapSniffer::interrupt() {
+  m_interrupted.store(true, std::memory_order_relaxed);
+  pcap_breakloop(m_handle);
+}
+
+void PcapSniffer::clear_interrupt() {
+  m_interrupted.store(false, std::memory_order_relaxed);
+}
+
+SnifferStats PcapSniffer::stats() const {
+  pcap_stat raw = {};
+  if (pcap_stats(m_handle, &raw) != 0) {
+    return {};
+  }
+  return SnifferStats{raw.ps_recv, raw.ps_drop, raw.ps_ifdrop};
+}
+
+bool PcapSniffer::set_filter(const PacketFilter &filter) {
+  static_assert(sizeof(BpfInstruction) == sizeof(bpf_insn),
+                "BpfInstruction must match struct bpf_insn");
+  if (filter.empty()) {
+    return true;
+  }
+  if (filter.kernel_program().empty()) {
+    return false;
+  }
+  // pcap_setfilter() copies the program.
+  bpf_program program;
+  program.bf_len = static_cast<u_int>(filter.kernel_program().size());
+  program.bf_insns = reinterpret_cast<bpf_insn *>(
+      const_cast<BpfInstruction *>(filter.kernel_program().data()));
+  if (pcap_setfilter(m_handle, &program) != 0) {
+    throw std::runtime_error(std::string("pcap_setfilter: ") +
+                             pcap_geterr(m_handle));
+  }
+  return filter.kernel_exact();
+}
+
+// --- TPACKET_V3 ---
+
+#ifdef __linux__
+
+namespace {
+
+// TPACKET_V3 packs frames of any size into a block; the frame size only has
+// to be a sane multiple of TPACKET_ALIGNMENT for the ring request.
+constexpr unsigned TPACKET_FRAME_SIZE = 2048;
+
+[[noreturn]] void throw_errno(const std::string &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+template <typename T>
+void set_option(int fd, int name, const T &value, const char *what) {
+  if (setsockopt(fd, SOL_PACKET, name, &value, sizeof(value)) != 0) {
+    throw_errno(what);
+  }
+}
+
+} // namespace
+
+TpacketSniffer::TpacketSniffer(const std::string &interface)
+    : TpacketSniffer(interface, Options{}) {}
+
+TpacketSniffer::TpacketSniffer(const std::string &interface,
+                               const Options &options)
+    : m_block_size(options.block_size), m_block_count(options.block_count),
+      m_poll_timeout_ms(options.poll_timeout_ms),
+      m_ignore_outgoing(options.ignore_outgoing) {
+  try {
+    setup(interface, options);
+  } catch (...) {
+    close_socket();
+    throw;
+  }
+}
+
+TpacketSniffer::~TpacketSniffer() { close_socket(); }
+
+void TpacketSniffer::setup(const std::string &interface,
+                           const Options &options) {
+  m_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (m_fd < 0) {
+    throw_errno("socket(AF_PACKET)");
+  }
+
+  set_option(m_fd, PACKET_VERSION, int{TPACKET_V3}, "PACKET_VERSION");
+  if (options.ignore_outgoing) {
+    // Saves the kernel the work, but fanout groups ignore it, so poll()
+    // filters outgoing frames as well.
+    set_option(m_fd, PACKET_IGNORE_OUTGOING, int{1},
+               "PACKET_IGNORE_OUTGOING");
+  }
+
+  tpacket_req3 request = {};
+  request.tp_block_size = static_cast<unsigned>(m_block_size);
+  request.tp_block_nr = static_cast<unsigned>(m_block_count);
+  request.tp_frame_size = TPACKET_FRAME_SIZE;
+  request.tp_frame_nr =
+      static_cast<unsigned>(m_block_size / TPACKET_FRAME_SIZE * m_block_count);
+  request.tp_retire_blk_tov = static_cast<unsigned>(options.block_timeout_ms);
+  set_option(m_fd, PACKET_RX_RING, request, "PACKET_RX_RING");
+
+  m_ring_size = m_block_size * m_block_count;
+  void *ring = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, 0);
+  if (ring == MAP_FAILED) {
+    throw_errno("mmap(PACKET_RX_RING)");
+  }
+  m_ring = static_cast<unsigned char *>(ring);
+
+  sockaddr_ll address = {};
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ALL);
+  if (interface != "any") {
+    address.sll_ifindex = static_cast<int>(if_nametoindex(interface.c_str()));
+    if (address.sll_ifindex == 0) {
+      throw_errno("if_nametoindex(" + interface + ")");
+    }
+  }
+  if (bind(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+      0) {
+    throw_errno("bind(" + interface + ")");
+  }
+
+  if (options.promiscuous && address.sll_ifindex != 0) {
+    packet_mreq membership = {};
+    membership.mr_ifindex = address.sll_ifindex;
+    membership.mr_type = PACKET_MR_PROMISC;
+    set_option(m_fd, PACKET_ADD_MEMBERSHIP, membership,
+               "PACKET_ADD_MEMBERSHIP");
+  }
+
+  // Must come after bind(). DEFRAG keeps IP fragments on one socket.
+  if (options.fanout_group >= 0) {
+    const int fanout =
+        (options.fanout_group & 0xFFFF) |
+        ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    set_option(m_fd, PACKET_FANOUT, fanout, "PACKET_FANOUT");
+  }
+}
+
+void TpacketSniffer::close_socket() {
+  if (m_ring != nullptr) {
+    munmap(m_ring, m_ring_size);
+    m_ring = nullptr;
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+bool TpacketSniffer::block_ready() const {
+  const auto *block = reinterpret_cast<const tpacket_block_desc *>(
+      m_ring + m_block * m_block_size);
+  return (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER) != 0;
+}
+
+bool TpacketSniffer::wait_for_block() {
+  pollfd descriptor = {};
+  descriptor.fd = m_fd;
+  descriptor.events = POLLIN | POLLERR;
+  ::poll(&descriptor, 1, m_poll_timeout_ms);
+  return block_ready();
+}
+
+void TpacketSniffer::release_block() {
+  auto *block =
+      reinterpret_cast<tpacket_block_desc *>(m_ring + m_block * m_block_size);
+  // Every view into the block is dead by now; the kernel may overwrite it.
+  __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                   __ATOMIC_RELEASE);
+  m_block = (m_block + 1) % m_block_count;
+  m_next = nullptr;
+}
+
+int TpacketSniffer::poll(int max_packets, const Callback &callback) {
+  int delivered = 0;
+  while (delivered < max_packets) {
+    if (m_interrupted.load(std::memory_order_relaxed)) {
+      return delivered > 0 ? delivered : -1;
+    }
+
+    if (m_next == nullptr) {
+      // Only block when there is nothing to return yet.
+      if (!block_ready() && (delivered > 0 || !wait_for_block())) {
+        break;
+      }
+      const auto *block = reinterpret_cast<const tpacket_block_desc *>(
+          m_ring + m_block * m_block_size);
+      m_left = block->hdr.bh1.num_pkts;
+      m_next = reinterpret_cast<const unsigned char *>(block) +
+               block->hdr.bh1.offset_to_first_pkt;
+      if (m_left == 0) {
+        release_block();
+        continue;
+      }
+    }
+
+    const auto *header = reinterpret_cast<const tpacket3_hdr *>(m_next);
+    // The kernel stores the link-level address right after the header.
+    const auto *link = reinterpret_cast<const sockaddr_ll *>(
+        m_next + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+    if (!m_ignore_outgoing || link->sll_pkttype != PACKET_OUTGOING) {
+      callback(PacketRef{
+          std::string_view(reinterpret_cast<const char *>(m_next) +
+                               header->tp_mac,
+                           header->tp_snaplen),
+          static_cast<uint64_t>(header->tp_sec) * 1000000000ULL +
+              header->tp_nsec,
+          checksum_flags(header->tp_status)});
+      ++delivered;
+    }
+
+    if (--m_left == 0) {
+      release_block();
+    } else {
+      m_next += header->tp_next_offset;
+    }
+  }
+  return delivered;
+}
+
+void TpacketSniffer::interrupt() {
+  m_interrupted.store(true, std::memory_order_relaxed);
+}
+
+void TpacketSniffer::clear_interrupt() {
+  m_interrupted.store(false, std::memory_order_relaxed);
+}
+
+SnifferStats TpacketSniffer::stats() const {
+  tpacket_stats_v3 raw = {};
+  socklen_t length = sizeof(raw);
+  if (getsockopt(m_fd, SOL_PACKET, PACKET_STATISTICS, &raw, &length) == 0) {
+    // tp_packets already includes tp_drops.
+    m_received.fetch_add(raw.tp_packets, std::memory_order_relaxed);
+    m_dropped.fetch_add(raw.tp_drops, std::memory_order_relaxed);
+  }
+  return SnifferStats{m_received.load(std::memory_order_relaxed),
+                      m_dropped.load(std::memory_order_relaxed), 0};
+}
+
+bool TpacketSniffer::set_filter(const PacketFilter &filter) {
+  static_assert(sizeof(BpfInstruction) == sizeof(sock_filter),
+                "BpfInstruction must match struct sock_filter");
+  if (filter.empty()) {
+    return true;
+  }
+  if (filter.kernel_program().empty()) {
+    return false;
+  }
+  // The kernel copies the program.
+  sock_fprog program;
+  program.len = static_cast<unsigned short>(filter.kernel_program().size());
+  program.filter = reinterpret_cast<sock_filter *>(
+      const_cast<BpfInstruction *>(filter.kernel_program().data()));
+  if (setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_FILTER, &program,
+                 sizeof(program)) != 0) {
+    throw_errno("setsockopt(SO_ATTACH_FILTER)");
+  }
+  return filter.kernel_exact();
+}
+
+#endif
+
+// --- Backend selection ---
+
+std::vector<std::unique_ptr<Sniffer>>
+open_sniffers(const std::string &interface, CaptureBackend backend,
+              std::size_t count) {
+  std::vector<std::unique_ptr<Sniffer>> sniffers;
+
+#ifdef __linux__
+  if (backend != CaptureBackend::Pcap) {
+    TpacketSniffer::Options options;
+    if (count > 1) {
+      options.fanout_group = static_cast<int>(getpid() & 0xFFFF);
+    }
+    try {
+      for (std::size_t i = 0; i < count; ++i) {
+        sniffers.push_back(
+            std::make_unique<TpacketSniffer>(interface, options));
+      }
+      return sniffers;
+    } catch (const std::system_error &) {
+      if (backend == CaptureBackend::Tpacket) {
+        throw;
+      }
+      sniffers.clear();
+    }
+  }
+#else
+  if (backend == CaptureBackend::Tpacket) {
+    throw std::runtime_error("TPACKET_V3 capture is only available on Linux");
+  }
+  static_cast<void>(count);
+#endif
+
+  sniffers.push_back(std::make_unique<PcapSniffer>(interface));
+  return sniffers;
+}
@@ -0,0 +1,80 @@
+#include "talker_sketch.hpp"
+#include "flow_key.hpp"
+
+namespace {
+
+Ipv6Address host_of(const FlowKey &key, const std::array<uint8_t, 16> &addr) {
+  if (key.family == 6) {
+    return Ipv6Address(addr.data());
+  }
+  return Ipv6Address::mapped_ipv4(Ipv4Address(addr.data()).hostOrder());
+}
+
+} // namespace
+
+TalkerSketch::TalkerSketch(const Config &config)
+    : m_sources{Hosts(config.capacity, config.width, config.depth),
+                Hosts(config.capacity, config.width, config.depth)},
+      m_destinations{Hosts(config.capacity, config.width, config.depth),
+                     Hosts(config.capacity, config.width, config.depth)},
+      m_ports{Ports(config.capacity, config.width, config.depth),
+              Ports(config.capacity, config.width, config.depth)},
+      m_distinct_sources(config.precision),
+      m_distinct_destinations(config.precision) {}
+
+bool TalkerSketch::update(const PacketRef &packet, const LayerStack &stack) {
+  FlowKey key;
+  if (!FlowKey::from_packet(packet.data, stack, key)) {
+    return false;
+  }
+  // A packet kept by load shedding stands for sample_rate packets.
+  const uint64_t packets = packet.sample_rate;
+  const uint64_t bytes = packet.data.length() * packets;
+  m_packets += packets;
+  m_bytes += bytes;
+
+  const Ipv6Address src = host_of(key, key.src_addr);
+  const Ipv6Address dst = host_of(key, key.dst_addr);
+  // Hashed once for every sketch
+  const uint64_t src_hash = Hosts::hash(src);
+  const uint64_t dst_hash = Hosts::hash(dst);
+  m_sources[index(Weight::Packets)].add(src, src_hash, packets);
+  m_sources[index(Weight::Bytes)].add(src, src_hash, bytes);
+  m_destinations[index(Weight::Packets)].add(dst, dst_hash, packets);
+  m_destinations[index(Weight::Bytes)].add(dst, dst_hash, bytes);
+  m_distinct_sources.add(src_hash);
+  m_distinct_destinations.add(dst_hash);
+
+  // Fragments after the first carry no ports.
+  if ((key.protocol == 6 || key.protocol == 17) && key.dst_port != 0) {
+    const uint64_t port_hash = Ports::hash(key.dst_port);
+    m_ports[index(Weight::Packets)].add(key.dst_port, port_hash, packets);
+    m_ports[index(Weight::Bytes)].add(key.dst_port, port_hash, bytes);
+  }
+  return true;
+}
+
+void TalkerSketch::merge(const TalkerSketch &other) {
+  for (std::size_t i = 0; i < 2; ++i) {
+    m_sources[i].merge(other.m_sources[i]);
+    m_destinations[i].merge(other.m_destinations[i]);
+    m_ports[i].merge(other.m_ports[i]);
+  }
+  m_distinct_sources.merge(other.m_distinct_sources);
+  m_distinct_destinations.merge(other.m_distinct_destinations);
+  m_packets += other.m_packets;
+  m_bytes += other.m_bytes;
+}
+
+void TalkerSketch::clear() {
+  for (std::size_t i = 0; i < 2; ++i) {
+    m_sources[i].clear();
+    m_destinations[i].clear();
+    m_ports[i].clear();
+  }
+  m_distinct_sources.clear();
+  m_distinct_destinations.clear();
+  m_packets = 0;
+  m_bytes = 0;
+}
+
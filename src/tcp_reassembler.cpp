@@ -0,0 +1,210 @@
+#include "tcp_reassembler.hpp"
+#include <algorithm>
+
+namespace {
+
+// Signed distance from `b` to `a` in sequence space, which wraps at 2^32.
+int32_t seq_diff(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b);
+}
+
+} // namespace
+
+TcpReassembler::TcpReassembler(const Config &config, Handler &handler)
+    : m_config(config), m_handler(handler),
+      m_streams(
+          [&config] {
+            FlowTable<Stream>::Config table;
+            table.max_flows = config.max_streams;
+            table.idle_timeout_ns = config.idle_timeout_ns;
+            return table;
+          }(),
+          [this](const FlowKey &key, Stream &stream, EvictReason) {
+            finish(key, stream, CloseReason::Evicted);
+          }) {}
+
+bool TcpReassembler::process(const PacketRef &packet,
+                             const LayerStack &stack) {
+  const TCPHeader *tcp = stack.get<TCP>();
+  FlowKey key;
+  if (tcp == nullptr || !FlowKey::from_packet(packet.data, stack, key)) {
+    return false;
+  }
+  process(key, *tcp,
+          LayerStack::layer_payload(packet.data, *stack.entry<TCP>()),
+          packet.timestamp_ns);
+  return true;
+}
+
+void TcpReassembler::process(const FlowKey &key, const TCPHeader &tcp,
+                             std::string_view payload, uint64_t now_ns) {
+  ++m_stats.segments;
+  if (tcp.flag_rst) {
+    close(key, CloseReason::Reset);
+    close(key.reversed(), CloseReason::Reset);
+    return;
+  }
+
+  uint32_t seq = tcp.seq_number;
+  if (tcp.flag_syn) {
+    // Unless it is a retransmission, a SYN on a known stream is a new
+    // connection reusing the tuple.
+    const Stream *old = m_streams.find(key);
+    if (old != nullptr && (!old->syn || old->isn != seq)) {
+      close(key, CloseReason::Reset);
+    }
+    ++seq; // the SYN itself takes one sequence number
+  } else if (payload.empty() && m_streams.find(key) == nullptr) {
+    // Bare ACKs and late FINs do not open a stream.
+    return;
+  }
+
+  bool inserted = false;
+  Stream &stream = m_streams.touch(key, now_ns, &inserted);
+  if (inserted) {
+    // From the SYN, or from wherever the capture joined the connection
+    stream.next_seq = seq;
+  }
+  if (tcp.flag_syn) {
+    stream.syn = true;
+    stream.isn = tcp.seq_number;
+  }
+
+  if (!payload.empty()) {
+    accept(key, stream, seq, payload);
+  }
+  if (tcp.flag_fin) {
+    stream.fin = true;
+    stream.fin_seq = seq + static_cast<uint32_t>(payload.length());
+  }
+  // Only once every byte before the FIN has been delivered
+  if (stream.fin && stream.next_seq == stream.fin_seq) {
+    finish(key, stream, CloseReason::Fin);
+    m_streams.erase(key);
+  }
+}
+
+void TcpReassembler::flush() {
+  std::vector<FlowKey> keys;
+  keys.reserve(m_streams.size());
+  m_streams.for_each(
+      [&keys](const FlowKey &key, const Stream &) { keys.push_back(key); });
+  for (const FlowKey &key : keys) {
+    close(key, CloseReason::Evicted);
+  }
+}
+
+void TcpReassembler::accept(const FlowKey &key, Stream &stream, uint32_t seq,
+                            std::string_view data) {
+  if (seq_diff(seq, stream.next_seq) <= 0) {
+    // The common case: the segment continues the stream and is handed
+    // over straight from the packet.
+    if (deliver_from(key, stream, seq, data)) {
+      ++m_stats.in_order;
+      drain(key, stream);
+    }
+    return;
+  }
+
+  if (stream.buffered_bytes + data.length() > m_config.max_stream_buffer) {
+    // Waited long enough for the hole: deliver what is buffered, then this
+    // segment, skipping whatever is still missing.
+    ++m_stats.stream_buffer_full;
+    skip_holes(key, stream);
+    deliver_from(key, stream, seq, data);
+    return;
+  }
+  if (m_buffered_bytes + data.length() > m_config.memory_cap) {
+    ++m_stats.pressure_drops;
+    return;
+  }
+  buffer(stream, seq, data);
+}
+
+void TcpReassembler::buffer(Stream &stream, uint32_t seq,
+                            std::string_view data) {
+  auto &segments = stream.segments;
+  const auto at = std::find_if(
+      segments.begin(), segments.end(), [seq](const Segment &segment) {
+        return seq_diff(segment.seq, seq) >= 0;
+      });
+  if (at != segments.end() && at->seq == seq &&
+      at->data.length() >= data.length()) {
+    // Retransmission of a segment that is already waiting
+    ++m_stats.overlaps;
+    m_stats.overlap_bytes += data.length();
+    return;
+  }
+
+  segments.insert(at, Segment{seq, std::string(data)});
+  stream.buffered_bytes += data.length();
+  m_buffered_bytes += data.length();
+  ++m_stats.out_of_order;
+}
+
+void TcpReassembler::deliver(const FlowKey &key, Stream &stream,
+                             std::string_view data) {
+  m_handler.on_data(key, data);
+  stream.next_seq += static_cast<uint32_t>(data.length());
+  m_stats.delivered_bytes += data.length();
+}
+
+bool TcpReassembler::deliver_from(const FlowKey &key, Stream &stream,
+                                  uint32_t seq, std::string_view data) {
+  const int32_t ahead = seq_diff(seq, stream.next_seq);
+  if (ahead > 0) {
+    ++m_stats.gaps;
+    m_stats.gap_bytes += static_cast<uint64_t>(ahead);
+    m_handler.on_gap(key, static_cast<uint64_t>(ahead));
+    stream.next_seq = seq;
+  } else if (ahead < 0) {
+    const std::size_t seen = static_cast<std::size_t>(-int64_t{ahead});
+    ++m_stats.overlaps;
+    m_stats.overlap_bytes += std::min(seen, data.length());
+    if (seen >= data.length()) {
+      return false;
+    }
+    data.remove_prefix(seen);
+  }
+  deliver(key, stream, data);
+  return true;
+}
+
+void TcpReassembler::drain(const FlowKey &key, Stream &stream) {
+  auto &segments = stream.segments;
+  std::size_t done = 0;
+  while (done < segments.size() &&
+         seq_diff(segments[done].seq, stream.next_seq) <= 0) {
+    deliver_from(key, stream, segments[done].seq, segments[done].data);
+    release(stream, segments[done].data.length());
+    ++done;
+  }
+  segments.erase(segments.begin(),
+                 segments.begin() + static_cast<std::ptrdiff_t>(done));
+}
+
+void TcpReassembler::skip_holes(const FlowKey &key, Stream &stream) {
+  for (const Segment &segment : stream.segments) {
+    deliver_from(key, stream, segment.seq, segment.data);
+    release(stream, segment.data.length());
+  }
+  stream.segments.clear();
+}
+
+void TcpReassembler::release(Stream &stream, std::size_t bytes) {
+  stream.buffered_bytes -= bytes;
+  m_buffered_bytes -= bytes;
+}
+
+void TcpReassembler::finish(const FlowKey &key, Stream &stream,
+                            CloseReason reason) {
+  skip_holes(key, stream);
+  m_handler.on_close(key, reason);
+}
+
+void TcpReassembler::close(const FlowKey &key, CloseReason reason) {
+  if (Stream *stream = m_streams.find(key)) {
+    finish(key, *stream, reason);
+    m_streams.erase(key);
+  }
+}
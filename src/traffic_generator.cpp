@@ -0,0 +1,474 @@
+#include "traffic_generator.hpp"
+#include "byte_order.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+constexpr std::size_t ETHERNET_SIZE = 14;
+constexpr std::size_t IPV4_SIZE = 20;
+constexpr std::size_t IPV6_SIZE = 40;
+constexpr std::size_t IPV6_FRAGMENT_SIZE = 8;
+constexpr std::size_t TCP_SIZE = 20;
+constexpr std::size_t UDP_SIZE = 8;
+constexpr uint8_t PROTO_TCP = 6;
+constexpr uint8_t PROTO_UDP = 17;
+constexpr uint8_t NH_FRAGMENT = 44;
+constexpr uint8_t TCP_PSH = 0x08;
+constexpr uint8_t TCP_ACK = 0x10;
+constexpr uint16_t TCP_WINDOW = 65535;
+
+constexpr std::size_t MIN_MTU = 576;
+constexpr std::size_t MAX_MTU = 9216;
+constexpr std::size_t MAX_FLOWS = std::size_t{1} << 24;
+// UDP header and data of the largest IPv4 datagram
+constexpr std::size_t MAX_UDP = 65535 - IPV4_SIZE;
+
+constexpr uint16_t HTTP_PORT = 80;
+constexpr uint16_t TLS_PORT = 443;
+
+// HTTP message heads; the Content-Length is written as 5 digits, so every
+// head has the same length.
+constexpr std::string_view HTTP_REQUEST =
+    "POST /upload HTTP/1.1\r\nHost: example.com\r\nContent-Length: ";
+constexpr std::string_view HTTP_RESPONSE =
+    "HTTP/1.1 200 OK\r\nContent-Length: ";
+constexpr std::size_t HTTP_DIGITS = 5;
+constexpr std::size_t HTTP_HEAD_MAX =
+    std::max(HTTP_REQUEST.size(), HTTP_RESPONSE.size()) + HTTP_DIGITS + 4;
+
+constexpr unsigned char CLIENT_MAC[6] = {0x02, 0, 0, 0, 0, 0x01};
+constexpr unsigned char SERVER_MAC[6] = {0x02, 0, 0, 0, 0, 0x02};
+
+// 10.0.0.0/8 and 172.16.0.0/12
+constexpr uint32_t CLIENT_NET = 0x0A000000;
+constexpr uint32_t SERVER_NET = 0xAC100000;
+constexpr uint32_t SERVER_HOSTS = 1 << 20;
+// 2001:db8::/32
+constexpr uint32_t IPV6_PREFIX = 0x20010DB8;
+
+// pcap, nanosecond timestamps, host byte order
+constexpr uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+constexpr uint32_t LINKTYPE_ETHERNET = 1;
+
+void store_be16(unsigned char *at, uint16_t value) {
+  at[0] = static_cast<unsigned char>(value >> 8);
+  at[1] = static_cast<unsigned char>(value);
+}
+
+void store_be32(unsigned char *at, uint32_t value) {
+  store_be16(at, static_cast<uint16_t>(value >> 16));
+  store_be16(at + 2, static_cast<uint16_t>(value));
+}
+
+// The ones' complement sum of the 16-bit words of `text`, as if it
+// started at an even offset
+constexpr uint32_t text_sum(std::string_view text) {
+  uint32_t sum = 0;
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    const uint32_t byte = static_cast<unsigned char>(text[i]);
+    sum += i % 2 == 0 ? byte << 8 : byte;
+  }
+  return sum;
+}
+
+// The sum of both halves of a 32-bit value
+uint32_t word_sum(uint32_t value) { return (value >> 16) + (value & 0xFFFF); }
+
+uint16_t finish(uint32_t sum) {
+  while (sum > 0xFFFF) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return static_cast<uint16_t>(~sum);
+}
+
+// The 2001:db8::/32 address ending in `host`
+void store_ipv6(unsigned char *at, uint32_t host) {
+  std::fill_n(at, 16, 0);
+  store_be32(at, IPV6_PREFIX);
+  store_be32(at + 12, host);
+}
+
+// Writes an HTTP message head whose body is the rest of a `payload` byte
+// payload, adds its words to `sum` and returns its length. The payload
+// starts at an even offset in the L4 header, so words line up.
+std::size_t write_http(unsigned char *at, std::size_t payload, bool reply,
+                       uint32_t &sum) {
+  const std::string_view prefix = reply ? HTTP_RESPONSE : HTTP_REQUEST;
+  std::copy(prefix.begin(), prefix.end(), at);
+  sum += reply ? text_sum(HTTP_RESPONSE) : text_sum(HTTP_REQUEST);
+  const std::size_t head = prefix.size() + HTTP_DIGITS + 4;
+  const auto put = [at, &sum](std::size_t position, char c) {
+    const auto byte = static_cast<unsigned char>(c);
+    at[position] = byte;
+    sum += position % 2 == 0 ? static_cast<uint32_t>(byte) << 8 : byte;
+  };
+  std::size_t body = payload - head;
+  for (std::size_t i = HTTP_DIGITS; i-- > 0; body /= 10) {
+    put(prefix.size() + i, static_cast<char>('0' + body % 10));
+  }
+  for (std::size_t i = 0; i < 4; ++i) {
+    put(prefix.size() + HTTP_DIGITS + i, "\r\n\r\n"[i]);
+  }
+  return head;
+}
+
+double unit(uint64_t random) {
+  return static_cast<double>(random >> 11) * 0x1.0p-53;
+}
+
+bool is_ratio(double value) { return value >= 0 && value <= 1; }
+
+} // namespace
+
+// --- AliasTable ---
+
+TrafficGenerator::AliasTable::AliasTable(const std::vector<double> &weights)
+    : m_columns(weights.size()) {
+  double total = 0;
+  for (const double weight : weights) {
+    total += weight;
+  }
+  const double n = static_cast<double>(weights.size());
+  std::vector<double> scaled(weights.size());
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+  for (uint32_t i = 0; i < weights.size(); ++i) {
+    scaled[i] = weights[i] * n / total;
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    const uint32_t less = small.back();
+    small.pop_back();
+    const uint32_t more = large.back();
+    m_columns[less] = Column{
+        static_cast<uint32_t>(std::max(scaled[less], 0.0) * 0x1.0p32), more};
+    scaled[more] -= 1 - scaled[less];
+    if (scaled[more] < 1) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+  // What is left has a probability of 1, give or take rounding.
+  for (const std::vector<uint32_t> *rest : {&small, &large}) {
+    for (const uint32_t i : *rest) {
+      m_columns[i] = Column{UINT32_MAX, i};
+    }
+  }
+}
+
+uint32_t TrafficGenerator::AliasTable::column(uint64_t random) const {
+  // The high half picks a column, the low half one of its two choices.
+  return static_cast<uint32_t>(
+      ((random >> 32) * static_cast<uint64_t>(m_columns.size())) >> 32);
+}
+
+void TrafficGenerator::AliasTable::prefetch(uint64_t random) const {
+  __builtin_prefetch(&m_columns[column(random)]);
+}
+
+uint32_t TrafficGenerator::AliasTable::sample(uint64_t random) const {
+  // Which of the two it is cannot be predicted, so choose without a branch.
+  const uint32_t index = column(random);
+  const Column &entry = m_columns[index];
+  const uint32_t keep =
+      0U - static_cast<uint32_t>(static_cast<uint32_t>(random) <
+                                 entry.threshold);
+  return (index & keep) | (entry.alias & ~keep);
+}
+
+// --- TrafficGenerator ---
+
+TrafficGenerator::TrafficGenerator(const Config &config) : m_config(config) {
+  if (config.flows == 0 || config.flows > MAX_FLOWS) {
+    throw std::invalid_argument("TrafficGenerator: flows must be 1 to " +
+                                std::to_string(MAX_FLOWS));
+  }
+  if (!is_ratio(config.ipv6_ratio) || !is_ratio(config.udp_ratio) ||
+      !is_ratio(config.http_ratio) || !is_ratio(config.fragment_ratio)) {
+    throw std::invalid_argument("TrafficGenerator: ratios must be 0 to 1");
+  }
+  if (!(config.zipf_skew >= 0)) {
+    throw std::invalid_argument("TrafficGenerator: negative Zipf skew");
+  }
+  if (config.mtu < MIN_MTU || config.mtu > MAX_MTU) {
+    throw std::invalid_argument("TrafficGenerator: MTU must be " +
+                                std::to_string(MIN_MTU) + " to " +
+                                std::to_string(MAX_MTU));
+  }
+  if (config.fragment_ratio > 0 &&
+      (config.fragmented_size <= config.mtu - IPV4_SIZE ||
+       config.fragmented_size > MAX_UDP)) {
+    throw std::invalid_argument("TrafficGenerator: fragmented datagrams "
+                                "must exceed the MTU and fit in " +
+                                std::to_string(MAX_UDP) + " bytes");
+  }
+  double total = 0;
+  std::vector<double> size_weights;
+  for (const SizeWeight &size : config.sizes) {
+    if (!(size.weight >= 0)) {
+      throw std::invalid_argument("TrafficGenerator: negative size weight");
+    }
+    total += size.weight;
+    size_weights.push_back(size.weight);
+  }
+  if (!(total > 0)) {
+    throw std::invalid_argument("TrafficGenerator: no packet sizes");
+  }
+
+  std::vector<double> flow_weights(config.flows);
+  for (std::size_t k = 0; k < config.flows; ++k) {
+    flow_weights[k] =
+        1 / std::pow(static_cast<double>(k + 1), config.zipf_skew);
+  }
+  m_flow_table = AliasTable(flow_weights);
+  m_size_table = AliasTable(size_weights);
+  m_frame.resize(ETHERNET_SIZE + config.mtu);
+  reset();
+}
+
+void TrafficGenerator::reset() {
+  m_state = m_config.seed;
+  m_flows.resize(m_config.flows);
+  for (uint32_t i = 0; i < m_flows.size(); ++i) {
+    Flow &flow = m_flows[i];
+    flow.client = CLIENT_NET | i;
+    flow.server =
+        SERVER_NET | static_cast<uint32_t>(random() % SERVER_HOSTS);
+    flow.client_port = static_cast<uint16_t>(1024 + random() % 64512);
+    flow.ipv6 = unit(random()) < m_config.ipv6_ratio;
+    flow.udp = unit(random()) < m_config.udp_ratio;
+    flow.http = !flow.udp && unit(random()) < m_config.http_ratio;
+    flow.server_port = flow.http ? HTTP_PORT : TLS_PORT;
+    flow.seq[0] = static_cast<uint32_t>(random());
+    flow.seq[1] = static_cast<uint32_t>(random());
+    flow.address_sum = word_sum(flow.client) + word_sum(flow.server) +
+                       (flow.ipv6 ? 2 * word_sum(IPV6_PREFIX) : 0);
+  }
+  m_next_flow = m_flow_table.sample(random());
+  m_flow_draw = random();
+  m_generated = 0;
+  m_ip_id = 0;
+  m_fragment_id = 0;
+  m_fragments = Fragments{};
+  std::fill(m_frame.begin(), m_frame.end(), 0);
+  m_dirty = 0;
+}
+
+uint64_t TrafficGenerator::random() {
+  // SplitMix64: fast, and the same everywhere, unlike <random>'s
+  // distributions.
+  uint64_t z = (m_state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+PacketRef TrafficGenerator::next() {
+  std::fill_n(m_frame.begin(), m_dirty, 0);
+  const std::size_t length =
+      m_fragments.total != 0 ? write_fragment() : write_packet();
+  return PacketRef{
+      std::string_view(reinterpret_cast<const char *>(m_frame.data()),
+                       length),
+      m_config.start_ns + m_generated++ * m_config.interval_ns};
+}
+
+std::size_t TrafficGenerator::write_packet() {
+  const uint32_t index = m_next_flow;
+  Flow &flow = m_flows[index];
+  // Draw ahead and prefetch what the next two packets will read
+  m_next_flow = m_flow_table.sample(m_flow_draw);
+  __builtin_prefetch(&m_flows[m_next_flow]);
+  m_flow_draw = random();
+  m_flow_table.prefetch(m_flow_draw);
+  const uint64_t draw = random();
+  const bool reply = (draw & 1) != 0;
+  if (flow.udp && m_config.fragment_ratio > 0 &&
+      unit(draw) < m_config.fragment_ratio) {
+    m_fragments = Fragments{index, reply, m_fragment_id++, 0,
+                            static_cast<uint32_t>(m_config.fragmented_size)};
+    return write_fragment();
+  }
+
+  const std::size_t ip_header = flow.ipv6 ? IPV6_SIZE : IPV4_SIZE;
+  const std::size_t l4_header = flow.udp ? UDP_SIZE : TCP_SIZE;
+  const std::size_t ip_length = std::clamp<std::size_t>(
+      m_config.sizes[m_size_table.sample(random())].size,
+      ip_header + l4_header + (flow.http ? HTTP_HEAD_MAX : 0), m_config.mtu);
+  const std::size_t l4_length = ip_length - ip_header;
+  const std::size_t payload = l4_length - l4_header;
+
+  const std::size_t offset = write_ip(flow, reply, l4_length, false, false);
+  unsigned char *l4 = m_frame.data() + offset;
+  const uint16_t source = reply ? flow.server_port : flow.client_port;
+  const uint16_t destination = reply ? flow.client_port : flow.server_port;
+  // Summed as written: reading the bytes back would stall on the stores.
+  // The rest of the payload is zero and adds nothing.
+  uint32_t sum = pseudo_header_sum(flow, l4_length) + source + destination;
+  const std::size_t head =
+      flow.http ? write_http(l4 + l4_header, payload, reply, sum) : 0;
+  m_dirty = offset + l4_header + head;
+
+  store_be16(l4, source);
+  store_be16(l4 + 2, destination);
+  if (flow.udp) {
+    store_be16(l4 + 4, static_cast<uint16_t>(l4_length));
+    const uint16_t checksum = finish(sum + static_cast<uint32_t>(l4_length));
+    // A computed 0 is sent as 0xFFFF; 0 means "no checksum".
+    store_be16(l4 + 6, checksum == 0 ? 0xFFFF : checksum);
+    return offset + l4_length;
+  }
+  const uint32_t seq = flow.seq[reply];
+  const uint32_t ack = flow.seq[!reply];
+  const uint16_t flags = static_cast<uint16_t>(
+      (TCP_SIZE / 4) << 12 | (payload != 0 ? TCP_PSH | TCP_ACK : TCP_ACK));
+  store_be32(l4 + 4, seq);
+  store_be32(l4 + 8, ack);
+  store_be16(l4 + 12, flags);
+  store_be16(l4 + 14, TCP_WINDOW);
+  store_be16(l4 + 16, finish(sum + word_sum(seq) + word_sum(ack) + flags +
+                             TCP_WINDOW));
+  flow.seq[reply] += static_cast<uint32_t>(payload);
+  return offset + l4_length;
+}
+
+std::size_t TrafficGenerator::write_fragment() {
+  const Flow &flow = m_flows[m_fragments.flow];
+  const std::size_t ip_header =
+      flow.ipv6 ? IPV6_SIZE + IPV6_FRAGMENT_SIZE : IPV4_SIZE;
+  // All but the last fragment carry a multiple of 8 bytes.
+  const std::size_t room = (m_config.mtu - ip_header) & ~std::size_t{7};
+  const std::size_t left = m_fragments.total - m_fragments.offset;
+  const bool more = left > room;
+  const std::size_t length = more ? room : left;
+
+  const std::size_t offset =
+      write_ip(flow, m_fragments.reply, length, true, more);
+  m_dirty = offset;
+  if (m_fragments.offset == 0) {
+    unsigned char *udp = m_frame.data() + offset;
+    store_be16(udp, m_fragments.reply ? flow.server_port : flow.client_port);
+    store_be16(udp + 2,
+               m_fragments.reply ? flow.client_port : flow.server_port);
+    store_be16(udp + 4, static_cast<uint16_t>(m_fragments.total));
+    const uint16_t checksum =
+        finish(pseudo_header_sum(flow, m_fragments.total) + flow.client_port +
+               flow.server_port + m_fragments.total);
+    store_be16(udp + 6, checksum == 0 ? 0xFFFF : checksum);
+    m_dirty += UDP_SIZE;
+  }
+  m_fragments.offset += static_cast<uint32_t>(length);
+  if (!more) {
+    m_fragments.total = 0;
+  }
+  return offset + length;
+}
+
+std::size_t TrafficGenerator::write_ip(const Flow &flow, bool reply,
+                                       std::size_t l4_length, bool fragment,
+                                       bool more) {
+  unsigned char *frame = m_frame.data();
+  std::copy_n(reply ? CLIENT_MAC : SERVER_MAC, 6, frame);
+  std::copy_n(reply ? SERVER_MAC : CLIENT_MAC, 6, frame + 6);
+  unsigned char *ip = frame + ETHERNET_SIZE;
+  const uint32_t source = reply ? flow.server : flow.client;
+  const uint32_t destination = reply ? flow.client : flow.server;
+  const uint8_t protocol = flow.udp ? PROTO_UDP : PROTO_TCP;
+
+  if (flow.ipv6) {
+    store_be16(frame + 12, 0x86DD);
+    ip[0] = 0x60;
+    store_be16(ip + 4, static_cast<uint16_t>(
+                           l4_length + (fragment ? IPV6_FRAGMENT_SIZE : 0)));
+    ip[6] = fragment ? NH_FRAGMENT : protocol;
+    ip[7] = 64;
+    store_ipv6(ip + 8, source);
+    store_ipv6(ip + 24, destination);
+    if (!fragment) {
+      return ETHERNET_SIZE + IPV6_SIZE;
+    }
+    unsigned char *header = ip + IPV6_SIZE;
+    header[0] = protocol;
+    store_be16(header + 2,
+               static_cast<uint16_t>(m_fragments.offset | (more ? 1 : 0)));
+    store_be32(header + 4, m_fragments.id);
+    return ETHERNET_SIZE + IPV6_SIZE + IPV6_FRAGMENT_SIZE;
+  }
+
+  const auto total = static_cast<uint16_t>(IPV4_SIZE + l4_length);
+  const uint16_t id =
+      fragment ? static_cast<uint16_t>(m_fragments.id) : m_ip_id++;
+  // Don't Fragment, unless this is a fragment
+  const uint16_t flags =
+      fragment ? static_cast<uint16_t>((more ? 0x2000 : 0) |
+                                       m_fragments.offset / 8)
+               : 0x4000;
+  const uint16_t ttl_protocol = static_cast<uint16_t>(64 << 8 | protocol);
+  store_be16(frame + 12, 0x0800);
+  store_be16(ip, 0x4500);
+  store_be16(ip + 2, total);
+  store_be16(ip + 4, id);
+  store_be16(ip + 6, flags);
+  store_be16(ip + 8, ttl_protocol);
+  store_be16(ip + 10, finish(0x4500 + total + id + flags + ttl_protocol +
+                             flow.address_sum));
+  store_be32(ip + 12, source);
+  store_be32(ip + 16, destination);
+  return ETHERNET_SIZE + IPV4_SIZE;
+}
+
+uint32_t TrafficGenerator::pseudo_header_sum(const Flow &flow,
+                                             std::size_t l4_length) {
+  return flow.address_sum + word_sum(static_cast<uint32_t>(l4_length)) +
+         (flow.udp ? PROTO_UDP : PROTO_TCP);
+}
+
+void TrafficGenerator::write_pcap(const std::string &path, uint64_t packets) {
+  std::ofstream out(path, std::ios::binary);
+  const auto put32 = [&out](uint32_t value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  const auto put16 = [&out](uint16_t value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  put32(PCAP_MAGIC_NS);
+  put16(2);
+  put16(4);
+  put32(0); // time zone
+  put32(0); // timestamp accuracy
+  put32(static_cast<uint32_t>(m_frame.size()));
+  put32(LINKTYPE_ETHERNET);
+  for (uint64_t i = 0; i < packets && out; ++i) {
+    const PacketRef packet = next();
+    put32(static_cast<uint32_t>(packet.timestamp_ns / 1000000000ULL));
+    put32(static_cast<uint32_t>(packet.timestamp_ns % 1000000000ULL));
+    put32(static_cast<uint32_t>(packet.data.length()));
+    put32(static_cast<uint32_t>(packet.data.length()));
+    out.write(packet.data.data(),
+              static_cast<std::streamsize>(packet.data.length()));
+  }
+  out.flush();
+  if (!out) {
+    throw std::runtime_error("Cannot write generated traffic to " + path);
+  }
+}
+
+// --- TrafficGeneratorSniffer ---
+
+int TrafficGeneratorSniffer::poll(int max_packets, const Callback &callback) {
+  if (m_interrupted.load(std::memory_order_relaxed)) {
+    return -1;
+  }
+  int delivered = 0;
+  while (delivered < max_packets && m_generator.generated() < m_packets) {
+    callback(m_generator.next());
+    ++delivered;
+  }
+  m_received.fetch_add(static_cast<uint64_t>(delivered),
+                       std::memory_order_relaxed);
+  return delivered == 0 ? -1 : delivered;
+}
@@ -1,5 +1,6 @@
 #include "types/ipv4_address.hpp"
-#include <arpa/inet.h> // For ntohl() and inet_ntoa()
+#include "types/address_format.hpp"
+#include <arpa/inet.h> // For ntohl()
 #include <cstring>     // For memcpy
 
 Ipv4Address::Ipv4Address() : m_ip_host_order(0) {}
@@ -16,28 +17,22 @@ Ipv4Address::Ipv4Address(const unsigned char *ip_bytes) {
   m_ip_host_order = ntohl(ip_network_order);
 }
 
-bool Ipv4Address::operator==(const Ipv4Address &other) const {
-  return m_ip_host_order == other.m_ip_host_order;
+char *Ipv4Address::format_to(char *out) const {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    const auto &octet =
+        address_format::DECIMAL_BYTES[(m_ip_host_order >> shift) & 0xFF];
+    // Copying all three digit slots is branch-free; the last octet starts
+    // at most 12 bytes in, so this stays inside MAX_STRING_LENGTH.
+    std::memcpy(out, octet.data(), 3);
+    out += octet[3];
+    if (shift != 0) {
+      *out++ = '.';
+    }
+  }
+  return out;
 }
 
 std::string Ipv4Address::toString() const {
-  if (!m_cache_dirty) {
-    return m_string_cache;
-  }
-
-  // `in_addr` is the struct `inet_ntoa` expects
-  struct in_addr addr;
-
-  // Convert our host-order IP back to network-order for the C function
-  addr.s_addr = htonl(m_ip_host_order);
-
-  // Convert to presentation format using inet_ntop (thread-safe)
-  char buf[INET_ADDRSTRLEN]; // 16 bytes for IPv4
-  if (inet_ntop(AF_INET, &addr, buf, sizeof(buf)) == nullptr) {
-    // On error return an empty string (shouldn't happen for valid IPs)
-    return std::string();
-  }
-  m_string_cache = buf;
-  m_cache_dirty = false;
-  return m_string_cache;
-}
\ No newline at end of file
+  char buf[MAX_STRING_LENGTH];
+  return std::string(buf, format_to(buf));
+}
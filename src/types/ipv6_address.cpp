@@ -1,6 +1,27 @@
 #include "types/ipv6_address.hpp"
-#include <arpa/inet.h> // For inet_ntop
-#include <cstring>     // For memcpy
+#include "flow_hash.hpp"
+#include "types/address_format.hpp"
+#include "types/ipv4_address.hpp"
+#include <cstring> // For memcpy
+
+namespace {
+
+// Writes `word` in lowercase hex without leading zeros.
+char *format_word(char *out, uint16_t word) {
+  const auto &high = address_format::HEX_BYTES[word >> 8];
+  const auto &low = address_format::HEX_BYTES[word & 0xFF];
+  const char digits[4] = {high[0], high[1], low[0], low[1]};
+  const int skip = word >= 0x1000 ? 0
+                   : word >= 0x100 ? 1
+                   : word >= 0x10  ? 2
+                                   : 3;
+  for (int i = skip; i < 4; ++i) {
+    *out++ = digits[i];
+  }
+  return out;
+}
+
+} // namespace
 
 Ipv6Address::Ipv6Address() : m_bytes{} { m_bytes.fill(0); }
 
@@ -8,23 +29,79 @@ Ipv6Address::Ipv6Address(const unsigned char *ip_bytes) {
   std::memcpy(m_bytes.data(), ip_bytes, 16);
 }
 
-bool Ipv6Address::operator==(const Ipv6Address &other) const {
-  return m_bytes == other.m_bytes;
+Ipv6Address Ipv6Address::mapped_ipv4(uint32_t ipv4_host_order) {
+  Ipv6Address address;
+  address.m_bytes[10] = 0xFF;
+  address.m_bytes[11] = 0xFF;
+  address.m_bytes[12] = static_cast<uint8_t>(ipv4_host_order >> 24);
+  address.m_bytes[13] = static_cast<uint8_t>(ipv4_host_order >> 16);
+  address.m_bytes[14] = static_cast<uint8_t>(ipv4_host_order >> 8);
+  address.m_bytes[15] = static_cast<uint8_t>(ipv4_host_order);
+  return address;
 }
 
-std::string Ipv6Address::toString() const {
-  if (!m_cache_dirty) {
-    return m_string_cache;
+uint64_t Ipv6Address::hash() const {
+  uint64_t high;
+  uint64_t low;
+  std::memcpy(&high, m_bytes.data(), 8);
+  std::memcpy(&low, m_bytes.data() + 8, 8);
+  return mix64(mix64(high) ^ low);
+}
+
+char *Ipv6Address::format_to(char *out) const {
+  uint16_t words[8];
+  for (std::size_t i = 0; i < 8; ++i) {
+    words[i] =
+        static_cast<uint16_t>((m_bytes[2 * i] << 8) | m_bytes[2 * i + 1]);
   }
 
-  // Use inet_ntop to convert 16 bytes to IPv6 string (with compression)
-  char buf[INET6_ADDRSTRLEN]; // 46 bytes for IPv6
-  if (inet_ntop(AF_INET6, m_bytes.data(), buf, sizeof(buf)) == nullptr) {
-    // On error return empty string (shouldn't happen for valid IPs)
-    return std::string();
+  // The longest run of two or more zero words (the first, on a tie) is
+  // written as "::", as inet_ntop() does.
+  int best_base = -1;
+  int best_len = 0;
+  for (int i = 0; i < 8;) {
+    if (words[i] != 0) {
+      ++i;
+      continue;
+    }
+    int end = i;
+    while (end < 8 && words[end] == 0) {
+      ++end;
+    }
+    if (end - i > best_len) {
+      best_base = i;
+      best_len = end - i;
+    }
+    i = end;
+  }
+  if (best_len < 2) {
+    best_base = -1;
   }
 
-  m_string_cache = buf;
-  m_cache_dirty = false;
-  return m_string_cache;
+  for (int i = 0; i < 8; ++i) {
+    if (best_base != -1 && i >= best_base && i < best_base + best_len) {
+      if (i == best_base) {
+        *out++ = ':';
+      }
+      continue;
+    }
+    if (i != 0) {
+      *out++ = ':';
+    }
+    // IPv4-compatible and IPv4-mapped addresses end in dotted-quad form.
+    if (i == 6 && best_base == 0 &&
+        (best_len == 6 || (best_len == 5 && words[5] == 0xFFFF))) {
+      return Ipv4Address(m_bytes.data() + 12).format_to(out);
+    }
+    out = format_word(out, words[i]);
+  }
+  if (best_base != -1 && best_base + best_len == 8) {
+    *out++ = ':';
+  }
+  return out;
+}
+
+std::string Ipv6Address::toString() const {
+  char buf[MAX_STRING_LENGTH];
+  return std::string(buf, format_to(buf));
 }
@@ -1,7 +1,8 @@
 #include "types/mac_address.hpp"
+#include "flow_hash.hpp"
+#include "types/address_format.hpp"
+#include <algorithm>
 #include <cstring> // For memcmp
-#include <iomanip> // For setw, setfill
-#include <sstream> // For stringstream
 #include <string_view>
 
 MacAddress::MacAddress() : m_bytes{} { // Zero-initialize
@@ -12,41 +13,37 @@ MacAddress::MacAddress(const unsigned char *mac_bytes) {
   std::copy(mac_bytes, mac_bytes + LENGTH, m_bytes.begin());
 }
 
-bool MacAddress::operator==(const MacAddress &other) const {
-  return m_bytes == other.m_bytes;
+uint64_t MacAddress::hash() const {
+  uint64_t value = 0;
+  for (const uint8_t byte : m_bytes) {
+    value = (value << 8) | byte;
+  }
+  return mix64(value);
 }
 
 bool MacAddress::operator==(std::string_view other_str) const {
-
   // Compare sizes first to avoid unnecessary work.
-  std::string s = toString();
-  if (s.size() != other_str.size())
+  if (other_str.size() != MAX_STRING_LENGTH) {
     return false;
-
-  // Safe to compare raw bytes because both are sequences of chars (hex digits
-  // and ':')
-
-  return std::memcmp(s.data(), other_str.data(), s.size()) == 0;
-}
-
-std::string MacAddress::toString() const {
-
-  // If our cache is clean, just return the cached string
-  if (!m_cache_dirty) {
-    return m_string_cache;
   }
+  char buf[MAX_STRING_LENGTH];
+  format_to(buf);
+  return std::memcmp(buf, other_str.data(), MAX_STRING_LENGTH) == 0;
+}
 
-  // Build the string (this is your old mac_to_string logic)
-  std::stringstream ss;
-  ss << std::hex << std::setfill('0');
-  for (int i = 0; i < 6; ++i) {
-    ss << std::setw(2) << static_cast<int>(m_bytes[i]);
-    if (i < 5)
-      ss << ":";
+char *MacAddress::format_to(char *out) const {
+  for (std::size_t i = 0; i < LENGTH; ++i) {
+    const auto &hex = address_format::HEX_BYTES[m_bytes[i]];
+    *out++ = hex[0];
+    *out++ = hex[1];
+    if (i + 1 < LENGTH) {
+      *out++ = ':';
+    }
   }
+  return out;
+}
 
-  // Update the cache
-  m_string_cache = ss.str();
-  m_cache_dirty = false; // The cache is now clean
-  return m_string_cache;
-}
\ No newline at end of file
+std::string MacAddress::toString() const {
+  char buf[MAX_STRING_LENGTH];
+  return std::string(buf, format_to(buf));
+}
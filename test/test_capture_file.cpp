@@ -0,0 +1,307 @@
+#include "capture_file.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Writes `bytes` to a fresh temporary file and removes it afterwards.
+class TempFile {
+public:
+  explicit TempFile(const std::string &bytes) {
+    char name[] = "/tmp/layerspy_test_XXXXXX";
+    const int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, bytes.data(), bytes.size()) ==
+            static_cast<ssize_t>(bytes.size()));
+    close(fd);
+    m_path = name;
+  }
+  ~TempFile() { std::remove(m_path.c_str()); }
+
+  const std::string &path() const { return m_path; }
+
+private:
+  std::string m_path;
+};
+
+// Appends integers in the byte order of the file being built.
+struct Writer {
+  bool big_endian;
+  std::string bytes;
+
+  void u16(uint16_t value) {
+    for (int i = 0; i < 2; ++i) {
+      const int shift = big_endian ? 8 * (1 - i) : 8 * i;
+      bytes.push_back(static_cast<char>(value >> shift));
+    }
+  }
+  void u32(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      const int shift = big_endian ? 8 * (3 - i) : 8 * i;
+      bytes.push_back(static_cast<char>(value >> shift));
+    }
+  }
+  void raw(const std::string &data) {
+    bytes += data;
+    while (bytes.size() % 4 != 0) {
+      bytes.push_back('\0');
+    }
+  }
+
+  // --- pcap ---
+  void pcap_header(bool nano, uint32_t link_type = 1) {
+    u32(nano ? 0xA1B23C4D : 0xA1B2C3D4);
+    u16(2);
+    u16(4);
+    u32(0);
+    u32(0);
+    u32(65535);
+    u32(link_type);
+  }
+  void pcap_record(uint32_t seconds, uint32_t fraction,
+                   const std::string &data) {
+    u32(seconds);
+    u32(fraction);
+    u32(static_cast<uint32_t>(data.size()));
+    u32(static_cast<uint32_t>(data.size()));
+    bytes += data;
+  }
+
+  // --- pcapng ---
+  void section() {
+    u32(0x0A0D0D0A);
+    u32(28);
+    u32(0x1A2B3C4D);
+    u16(1);
+    u16(0);
+    u32(0xFFFFFFFF); // section length unknown
+    u32(0xFFFFFFFF);
+    u32(28);
+  }
+  void interface(uint16_t link_type, int tsresol = -1) {
+    const uint32_t length = tsresol < 0 ? 20 : 32;
+    u32(1);
+    u32(length);
+    u16(link_type);
+    u16(0);
+    u32(65535);
+    if (tsresol >= 0) {
+      u16(9); // if_tsresol
+      u16(1);
+      raw(std::string(1, static_cast<char>(tsresol)));
+      u16(0); // opt_endofopt
+      u16(0);
+    }
+    u32(length);
+  }
+  void enhanced(uint32_t interface_id, uint64_t timestamp,
+                const std::string &data) {
+    const uint32_t length =
+        static_cast<uint32_t>(32 + (data.size() + 3) / 4 * 4);
+    u32(6);
+    u32(length);
+    u32(interface_id);
+    u32(static_cast<uint32_t>(timestamp >> 32));
+    u32(static_cast<uint32_t>(timestamp));
+    u32(static_cast<uint32_t>(data.size()));
+    u32(static_cast<uint32_t>(data.size()));
+    raw(data);
+    u32(length);
+  }
+  void simple(const std::string &data) {
+    const uint32_t length =
+        static_cast<uint32_t>(16 + (data.size() + 3) / 4 * 4);
+    u32(3);
+    u32(length);
+    u32(static_cast<uint32_t>(data.size()));
+    raw(data);
+    u32(length);
+  }
+  void custom() { // e.g. an Interface Statistics Block, to be skipped
+    u32(5);
+    u32(16);
+    u32(0);
+    u32(16);
+  }
+};
+
+std::vector<PacketRef> read_all(CaptureFileReader &reader) {
+  std::vector<PacketRef> packets;
+  PacketRef packet;
+  while (reader.next(packet)) {
+    packets.push_back(packet);
+  }
+  return packets;
+}
+
+} // namespace
+
+TEST_CASE("CaptureFileReader reads pcap in both byte orders",
+          "[capture_file]") {
+  for (const bool big_endian : {false, true}) {
+    for (const bool nano : {false, true}) {
+      INFO("big endian " << big_endian << ", nanosecond " << nano);
+      Writer w{big_endian, {}};
+      w.pcap_header(nano);
+      w.pcap_record(10, 5, "first frame");
+      w.pcap_record(11, 999, "second");
+      const TempFile file(w.bytes);
+
+      CaptureFileReader reader(file.path());
+      CHECK(reader.format() == CaptureFileReader::Format::Pcap);
+      const std::vector<PacketRef> packets = read_all(reader);
+      REQUIRE(packets.size() == 2);
+      CHECK(packets[0].data == "first frame");
+      CHECK(packets[1].data == "second");
+      CHECK(packets[0].timestamp_ns ==
+            10'000'000'000ULL + (nano ? 5ULL : 5'000ULL));
+      CHECK(packets[1].timestamp_ns ==
+            11'000'000'000ULL + (nano ? 999ULL : 999'000ULL));
+      CHECK_FALSE(reader.truncated());
+    }
+  }
+}
+
+TEST_CASE("CaptureFileReader reads pcapng blocks", "[capture_file]") {
+  for (const bool big_endian : {false, true}) {
+    INFO("big endian " << big_endian);
+    Writer w{big_endian, {}};
+    w.section();
+    w.interface(1);     // Ethernet, default microseconds
+    w.interface(1, 9);  // Ethernet, nanoseconds
+    w.interface(113);   // Linux cooked capture: skipped
+    w.interface(1, 0x80 | 10); // Ethernet, 2^-10 seconds
+    w.enhanced(0, 1'500'000, "usec");
+    w.custom();
+    w.enhanced(1, 2'000'000'123ULL, "nsec");
+    w.enhanced(2, 7, "cooked");
+    w.simple("simple!");
+    w.enhanced(3, (5ULL << 10) | 512, "binary");
+    const TempFile file(w.bytes);
+
+    CaptureFileReader reader(file.path());
+    CHECK(reader.format() == CaptureFileReader::Format::PcapNg);
+    const std::vector<PacketRef> packets = read_all(reader);
+    REQUIRE(packets.size() == 4);
+    CHECK(packets[0].data == "usec");
+    CHECK(packets[0].timestamp_ns == 1'500'000'000ULL);
+    CHECK(packets[1].data == "nsec");
+    CHECK(packets[1].timestamp_ns == 2'000'000'123ULL);
+    CHECK(packets[2].data == "simple!"); // no timestamp
+    CHECK(packets[2].timestamp_ns == 0);
+    CHECK(packets[3].data == "binary");
+    CHECK(packets[3].timestamp_ns == 5'500'000'000ULL);
+    CHECK(reader.skipped() == 1);
+    CHECK_FALSE(reader.truncated());
+
+    reader.rewind();
+    CHECK(read_all(reader).size() == 4);
+  }
+}
+
+TEST_CASE("CaptureFileReader handles a new section with another byte order",
+          "[capture_file]") {
+  Writer little{false, {}};
+  little.section();
+  little.interface(1);
+  little.enhanced(0, 1, "little");
+  Writer big{true, {}};
+  big.section();
+  big.interface(1);
+  big.enhanced(0, 2, "big");
+  const TempFile file(little.bytes + big.bytes);
+
+  CaptureFileReader reader(file.path());
+  const std::vector<PacketRef> packets = read_all(reader);
+  REQUIRE(packets.size() == 2);
+  CHECK(packets[0].data == "little");
+  CHECK(packets[1].data == "big");
+  CHECK(packets[1].timestamp_ns == 2000);
+
+  // A second section with an unknown byte-order magic ends the file.
+  std::string corrupt = little.bytes + big.bytes;
+  corrupt[little.bytes.size() + 8] ^= 0x55;
+  const TempFile bad(corrupt);
+  CaptureFileReader stops(bad.path());
+  REQUIRE(read_all(stops).size() == 1);
+  CHECK(stops.truncated());
+}
+
+TEST_CASE("CaptureFileReader resumes from a cursor", "[capture_file]") {
+  Writer w{true, {}};
+  w.section();
+  w.interface(1, 9);
+  w.enhanced(0, 1, "first");
+  w.enhanced(0, 2, "second");
+  w.interface(1, 3); // milliseconds
+  w.enhanced(1, 3, "third");
+  const TempFile file(w.bytes);
+
+  CaptureFileReader reader(file.path());
+  PacketRef packet;
+  REQUIRE(reader.next(packet));
+  const CaptureFileReader::Cursor cursor = reader.cursor();
+  CHECK(cursor.position == reader.position());
+  CHECK(cursor.swapped);
+  CHECK(cursor.interfaces.size() == 1);
+
+  // A fresh reader picks up the byte order and interfaces from the cursor.
+  CaptureFileReader resumed(file.path());
+  resumed.seek(cursor);
+  const std::vector<PacketRef> packets = read_all(resumed);
+  REQUIRE(packets.size() == 2);
+  CHECK(packets[0].data == "second");
+  CHECK(packets[0].timestamp_ns == 2);
+  CHECK(packets[1].data == "third");
+  CHECK(packets[1].timestamp_ns == 3'000'000);
+
+  CaptureFileReader::Cursor past = cursor;
+  past.position = resumed.file_size() + 4;
+  CHECK_THROWS_AS(resumed.seek(past), std::out_of_range);
+}
+
+TEST_CASE("CaptureFileReader stops at a truncated record", "[capture_file]") {
+  Writer w{false, {}};
+  w.pcap_header(false);
+  w.pcap_record(1, 0, "complete");
+  w.pcap_record(2, 0, "cut short");
+  w.bytes.resize(w.bytes.size() - 3);
+  const TempFile file(w.bytes);
+
+  CaptureFileReader reader(file.path());
+  CHECK(read_all(reader).size() == 1);
+  CHECK(reader.truncated());
+}
+
+TEST_CASE("CaptureFileReader rejects other files", "[capture_file]") {
+  const TempFile text("this is not a capture file at all");
+  CHECK_THROWS_AS(CaptureFileReader(text.path()), std::runtime_error);
+  CHECK_THROWS_AS(CaptureFileReader("/nonexistent/capture.pcap"),
+                  std::runtime_error);
+}
+
+TEST_CASE("CaptureFileSniffer replays a file through the Sniffer interface",
+          "[capture_file]") {
+  Writer w{false, {}};
+  w.pcap_header(true);
+  for (uint32_t i = 0; i < 10; ++i) {
+    w.pcap_record(i, 0, std::string(60, static_cast<char>('a' + i)));
+  }
+  const TempFile file(w.bytes);
+
+  CaptureFileSniffer sniffer(file.path());
+  std::string firsts;
+  const Sniffer::Callback callback = [&](const PacketRef &packet) {
+    firsts += packet.data[0];
+  };
+  CHECK(sniffer.poll(4, callback) == 4);
+  CHECK(sniffer.poll(100, callback) == 6);
+  CHECK(sniffer.poll(100, callback) == -1);
+  CHECK(firsts == "abcdefghij");
+  CHECK(sniffer.stats().received == 10);
+}
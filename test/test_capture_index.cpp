@@ -0,0 +1,385 @@
+#include "capture_index.hpp"
+#include "decoder.hpp"
+#include "flow_key.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// A fresh temporary path, removed afterwards with its index
+class TempPath {
+public:
+  TempPath() {
+    char name[] = "/tmp/layerspy_test_XXXXXX";
+    const int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    close(fd);
+    m_path = name;
+  }
+  ~TempPath() {
+    std::remove(m_path.c_str());
+    std::remove(CaptureIndex::path_for(m_path).c_str());
+  }
+
+  const std::string &path() const { return m_path; }
+  std::string index() const { return CaptureIndex::path_for(m_path); }
+
+private:
+  std::string m_path;
+};
+
+std::string read_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string &path, const std::string &bytes,
+                bool append = false) {
+  std::ofstream out(path, std::ios::binary |
+                              (append ? std::ios::app : std::ios::trunc));
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  REQUIRE(out);
+}
+
+CaptureIndex build(const std::string &path, std::size_t block_bytes) {
+  CaptureIndex::Config config;
+  config.block_bytes = block_bytes;
+  CaptureIndex index(config);
+  CaptureFileReader reader(path);
+  index.update(reader);
+  return index;
+}
+
+// Timestamps of the packets matching `query`, reading the whole file
+std::vector<uint64_t> scan(const std::string &path,
+                           const CaptureIndex::Query &query) {
+  CaptureFileReader reader(path);
+  Decoder decoder;
+  LayerStack stack;
+  const FlowKey wanted = query.flow.canonical();
+  std::vector<uint64_t> found;
+  PacketRef packet;
+  while (reader.next(packet)) {
+    if (packet.timestamp_ns < query.from_ns ||
+        packet.timestamp_ns > query.to_ns) {
+      continue;
+    }
+    if (wanted.family != 0) {
+      decoder.decode(packet.data, stack);
+      FlowKey flow;
+      if (!FlowKey::from_packet(packet.data, stack, flow) ||
+          flow.canonical() != wanted) {
+        continue;
+      }
+    }
+    found.push_back(packet.timestamp_ns);
+  }
+  return found;
+}
+
+// The same, reading only what the index points at
+std::vector<uint64_t> lookup(const std::string &path, const CaptureIndex &index,
+                             const CaptureIndex::Query &query,
+                             uint64_t *bytes = nullptr) {
+  CaptureIndexSniffer sniffer(path, index, query);
+  std::vector<uint64_t> found;
+  while (sniffer.poll(64, [&found](const PacketRef &packet) {
+    found.push_back(packet.timestamp_ns);
+  }) > 0) {
+  }
+  CHECK(sniffer.stats().received == found.size());
+  if (bytes != nullptr) {
+    *bytes = sniffer.bytes();
+  }
+  return found;
+}
+
+// Flows of the file, busiest first, as (packets, canonical key)
+std::vector<std::pair<std::size_t, FlowKey>>
+flows_of(const std::string &path) {
+  std::unordered_map<uint64_t, std::pair<std::size_t, FlowKey>> counts;
+  CaptureFileReader reader(path);
+  Decoder decoder;
+  LayerStack stack;
+  PacketRef packet;
+  while (reader.next(packet)) {
+    decoder.decode(packet.data, stack);
+    FlowKey flow;
+    if (FlowKey::from_packet(packet.data, stack, flow)) {
+      flow = flow.canonical();
+      auto &entry = counts[flow.hash()];
+      entry.second = flow;
+      ++entry.first;
+    }
+  }
+  std::vector<std::pair<std::size_t, FlowKey>> flows;
+  for (const auto &entry : counts) {
+    flows.push_back(entry.second);
+  }
+  std::sort(flows.begin(), flows.end(), [](const auto &a, const auto &b) {
+    return a.first > b.first;
+  });
+  return flows;
+}
+
+// Little- or big-endian pcapng, one interface per section
+struct PcapNgWriter {
+  bool big_endian;
+  std::string bytes;
+
+  void u16(uint16_t value) {
+    for (int i = 0; i < 2; ++i) {
+      bytes.push_back(static_cast<char>(value >> (big_endian ? 8 - 8 * i
+                                                             : 8 * i)));
+    }
+  }
+  void u32(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      bytes.push_back(static_cast<char>(value >> (big_endian ? 24 - 8 * i
+                                                             : 8 * i)));
+    }
+  }
+  void section(uint8_t tsresol) {
+    u32(0x0A0D0D0A);
+    u32(28);
+    u32(0x1A2B3C4D);
+    u16(1);
+    u16(0);
+    u32(0xFFFFFFFF);
+    u32(0xFFFFFFFF);
+    u32(28);
+    u32(1); // interface: Ethernet with if_tsresol
+    u32(32);
+    u16(1);
+    u16(0);
+    u32(65535);
+    u16(9);
+    u16(1);
+    bytes += std::string(1, static_cast<char>(tsresol)) + std::string(3, '\0');
+    u32(0);
+    u32(32);
+  }
+  void packet(uint64_t timestamp, std::string_view data) {
+    const uint32_t length =
+        static_cast<uint32_t>(32 + (data.size() + 3) / 4 * 4);
+    u32(6);
+    u32(length);
+    u32(0);
+    u32(static_cast<uint32_t>(timestamp >> 32));
+    u32(static_cast<uint32_t>(timestamp));
+    u32(static_cast<uint32_t>(data.size()));
+    u32(static_cast<uint32_t>(data.size()));
+    bytes += data;
+    bytes.append((4 - data.size() % 4) % 4, '\0');
+    u32(length);
+  }
+};
+
+} // namespace
+
+TEST_CASE("CaptureIndex - queries match a full scan", "[capture_index]") {
+  TempPath pcap;
+  TrafficGenerator::Config traffic;
+  traffic.flows = 2000;
+  traffic.udp_ratio = 0.3;
+  TrafficGenerator(traffic).write_pcap(pcap.path(), 30000);
+  const CaptureIndex index = build(pcap.path(), 64 * 1024);
+  CHECK(index.packets() == 30000);
+  CHECK(index.blocks().size() > 100);
+  const uint64_t file_bytes = read_file(pcap.path()).size();
+  CHECK(index.indexed_bytes() == file_bytes);
+
+  const auto flows = flows_of(pcap.path());
+  REQUIRE(flows.size() > 500);
+  // Timestamps run from 0 in steps of 1000 ns.
+  const uint64_t middle_from = 10000 * 1000;
+  const uint64_t middle_to = 20000 * 1000;
+  for (const std::size_t rank : {std::size_t{0}, std::size_t{10},
+                                 std::size_t{300}, std::size_t{1000},
+                                 flows.size() - 1}) {
+    INFO("flow rank " << rank << ", " << flows[rank].first << " packets");
+    CaptureIndex::Query query;
+    query.flow = flows[rank].second;
+    uint64_t bytes = 0;
+    const std::vector<uint64_t> found =
+        lookup(pcap.path(), index, query, &bytes);
+    CHECK(found == scan(pcap.path(), query));
+    CHECK(found.size() == flows[rank].first);
+    // Busy flows are in most blocks; quiet ones in a few.
+    if (rank >= 300) {
+      CHECK(bytes < file_bytes / 4);
+    }
+
+    // Either direction finds the flow; a time range narrows it.
+    query.flow = query.flow.reversed();
+    query.from_ns = middle_from;
+    query.to_ns = middle_to;
+    CHECK(lookup(pcap.path(), index, query) == scan(pcap.path(), query));
+  }
+
+  // Time alone reads about the blocks of that stretch.
+  CaptureIndex::Query stretch;
+  stretch.from_ns = middle_from;
+  stretch.to_ns = middle_to;
+  uint64_t bytes = 0;
+  CHECK(lookup(pcap.path(), index, stretch, &bytes).size() == 10001);
+  CHECK(bytes < file_bytes / 2);
+
+  // A flow that is not there reads next to nothing.
+  CaptureIndex::Query absent;
+  absent.flow =
+      FlowKey(Ipv4Address(0xC0000201), 1, Ipv4Address(0xC0000202), 2, 6);
+  CHECK(lookup(pcap.path(), index, absent, &bytes).empty());
+  CHECK(bytes < file_bytes / 50);
+}
+
+TEST_CASE("CaptureIndex - carries on where the file was appended to",
+          "[capture_index]") {
+  TempPath pcap;
+  TempPath more;
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  generator.write_pcap(pcap.path(), 10000);
+  generator.write_pcap(more.path(), 10000); // the 10000 after those
+  const std::string appended = read_file(more.path()).substr(24);
+
+  CaptureIndex::Config config;
+  config.block_bytes = 32 * 1024;
+  {
+    CaptureIndex index(config);
+    CaptureFileReader reader(pcap.path());
+    CHECK(index.update(reader) == 10000);
+    index.save(pcap.index());
+  }
+
+  // All but the end of the last record: it is left for next time.
+  write_file(pcap.path(), appended.substr(0, appended.size() - 10), true);
+  CaptureIndex index = CaptureIndex::load(pcap.index());
+  {
+    CaptureFileReader reader(pcap.path());
+    CHECK(index.update(reader) == 9999);
+    CHECK(reader.truncated());
+  }
+  write_file(pcap.path(), appended.substr(appended.size() - 10), true);
+  {
+    CaptureFileReader reader(pcap.path());
+    CHECK(index.update(reader) == 1);
+    CHECK(index.update(reader) == 0);
+  }
+  CHECK(index.packets() == 20000);
+
+  // The same blocks and lists as indexing the whole file at once, and the
+  // same again once saved and loaded.
+  index.save(pcap.index());
+  const CaptureIndex loaded = CaptureIndex::load(pcap.index());
+  const CaptureIndex whole = build(pcap.path(), config.block_bytes);
+  REQUIRE(whole.blocks().size() == index.blocks().size());
+  REQUIRE(loaded.blocks().size() == index.blocks().size());
+  const CaptureIndex *const others[] = {&index, &loaded};
+  for (std::size_t i = 0; i < whole.blocks().size(); ++i) {
+    for (const CaptureIndex *other : others) {
+      CHECK(other->blocks()[i].offset == whole.blocks()[i].offset);
+      CHECK(other->blocks()[i].end == whole.blocks()[i].end);
+      CHECK(other->blocks()[i].first_ns == whole.blocks()[i].first_ns);
+      CHECK(other->blocks()[i].last_ns == whole.blocks()[i].last_ns);
+      CHECK(other->blocks()[i].packets == whole.blocks()[i].packets);
+    }
+  }
+  const auto flows = flows_of(pcap.path());
+  for (std::size_t rank = 0; rank < flows.size(); rank += 97) {
+    CaptureIndex::Query query;
+    query.flow = flows[rank].second;
+    CHECK(index.find(query) == whole.find(query));
+    CHECK(loaded.find(query) == whole.find(query));
+  }
+
+  // Another capture in its place: indexed again from the start.
+  TrafficGenerator::Config other;
+  other.seed = 2;
+  TrafficGenerator(other).write_pcap(pcap.path(), 5000);
+  CaptureFileReader reader(pcap.path());
+  CHECK(index.update(reader) == 5000);
+  CHECK(index.packets() == 5000);
+}
+
+TEST_CASE("CaptureIndex - resumes pcapng sections mid-file",
+          "[capture_index]") {
+  TempPath file;
+  TrafficGenerator::Config traffic;
+  traffic.flows = 50;
+  TrafficGenerator generator(traffic);
+  // Nanoseconds in a little-endian section, then microseconds in a
+  // big-endian one, so blocks in each need their own reader state.
+  PcapNgWriter little{false, {}};
+  little.section(9);
+  PcapNgWriter big{true, {}};
+  big.section(6);
+  for (int i = 0; i < 600; ++i) {
+    const PacketRef packet = generator.next();
+    if (i < 300) {
+      little.packet(packet.timestamp_ns, packet.data);
+    } else {
+      big.packet(packet.timestamp_ns / 1000, packet.data);
+    }
+  }
+  write_file(file.path(), little.bytes + big.bytes);
+
+  const CaptureIndex index = build(file.path(), 4096);
+  CHECK(index.packets() == 600);
+  REQUIRE(index.blocks().size() > 10);
+  REQUIRE(index.cursor(1).interfaces.size() == 1);
+  CHECK(index.cursor(1).interfaces.front().exponent == 9);
+  CHECK(index.cursor(index.blocks().size() - 1).swapped);
+
+  const auto flows = flows_of(file.path());
+  for (std::size_t rank = 0; rank < flows.size(); rank += 7) {
+    CaptureIndex::Query query;
+    query.flow = flows[rank].second;
+    CHECK(lookup(file.path(), index, query) == scan(file.path(), query));
+  }
+  CaptureIndex::Query late;
+  late.from_ns = 450 * 1000;
+  CHECK(lookup(file.path(), index, late) == scan(file.path(), late));
+}
+
+TEST_CASE("CaptureIndex - rejects bad settings and files", "[capture_index]") {
+  CaptureIndex::Config config;
+  config.block_bytes = 0;
+  CHECK_THROWS_AS(CaptureIndex(config), std::invalid_argument);
+  config = CaptureIndex::Config{};
+  config.buckets = 1000;
+  CHECK_THROWS_AS(CaptureIndex(config), std::invalid_argument);
+
+  TempPath pcap;
+  TrafficGenerator(TrafficGenerator::Config{}).write_pcap(pcap.path(), 1000);
+  const CaptureIndex index = build(pcap.path(), 4096);
+  index.save(pcap.index());
+  const std::string saved = read_file(pcap.index());
+  CHECK_NOTHROW(CaptureIndex::load(pcap.index()));
+
+  write_file(pcap.index(), saved.substr(0, saved.size() - 5));
+  CHECK_THROWS_AS(CaptureIndex::load(pcap.index()), std::runtime_error);
+  write_file(pcap.index(), "LSPYCOLS" + saved.substr(8));
+  CHECK_THROWS_AS(CaptureIndex::load(pcap.index()), std::runtime_error);
+  CHECK_THROWS_AS(CaptureIndex::load("/nonexistent/capture.pcap.lsidx"),
+                  std::runtime_error);
+  CHECK_THROWS_AS(index.save("/nonexistent/dir/capture.lsidx"),
+                  std::runtime_error);
+
+  // An index outliving the end of its file
+  TrafficGenerator(TrafficGenerator::Config{}).write_pcap(pcap.path(), 100);
+  CHECK_THROWS_AS(
+      CaptureIndexSniffer(pcap.path(), index, CaptureIndex::Query{}),
+      std::runtime_error);
+}
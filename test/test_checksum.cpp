@@ -0,0 +1,200 @@
+#include "checksum.hpp"
+#include "decoder.hpp"
+#include "test_frames.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Result = ChecksumCheck::Result;
+
+const Checksum::Kernel all_kernels[] = {Checksum::Kernel::Scalar,
+                                        Checksum::Kernel::SSE2,
+                                        Checksum::Kernel::AVX2};
+
+// RFC 1071 done the slow way: big-endian words, an odd byte padded.
+uint16_t reference_sum(std::string_view bytes) {
+  uint32_t sum = 0;
+  for (std::size_t i = 0; i < bytes.length(); i += 2) {
+    sum += static_cast<uint32_t>(static_cast<unsigned char>(bytes[i])) << 8;
+    if (i + 1 < bytes.length()) {
+      sum += static_cast<unsigned char>(bytes[i + 1]);
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return static_cast<uint16_t>(sum);
+}
+
+} // namespace
+
+TEST_CASE("Checksum - kernels match the reference sum", "[checksum]") {
+  // The example of RFC 1071 section 3
+  const std::string example("\x00\x01\xf2\x03\xf4\xf5\xf6\xf7", 8);
+  Checksum rfc;
+  rfc.add(example);
+  CHECK(rfc.sum() == 0xDDF2);
+
+  std::mt19937 random(7);
+  std::string data(2000, '\0');
+  for (char &byte : data) {
+    // Mostly 0xFF, so the wide kernels carry out of every lane.
+    byte = static_cast<char>(random() % 4 == 0 ? random() : 0xFF);
+  }
+  for (Checksum::Kernel kernel : all_kernels) {
+    if (!Checksum::isSupported(kernel)) {
+      continue;
+    }
+    Checksum checksum(kernel);
+    CHECK(checksum.kernel() == kernel);
+    for (std::size_t length = 0; length <= 300; ++length) {
+      // Every start offset within a vector, for unaligned loads
+      const std::string_view bytes =
+          std::string_view(data).substr(length % 32, length);
+      checksum.clear();
+      checksum.add(bytes);
+      REQUIRE(checksum.sum() == reference_sum(bytes));
+    }
+    checksum.clear();
+    checksum.add(data);
+    CHECK(checksum.sum() == reference_sum(data));
+  }
+  CHECK(Checksum::isSupported(Checksum::bestKernel()));
+}
+
+TEST_CASE("Checksum - pieces sum like one buffer", "[checksum]") {
+  std::mt19937 random(11);
+  std::string data(1500, '\0');
+  for (char &byte : data) {
+    byte = static_cast<char>(random());
+  }
+  const uint16_t whole = reference_sum(data);
+  for (Checksum::Kernel kernel : all_kernels) {
+    Checksum checksum(kernel);
+    // Pieces of odd and even lengths, so words straddle the boundaries
+    for (std::size_t step : {1, 2, 3, 7, 33, 100, 701}) {
+      checksum.clear();
+      for (std::size_t at = 0; at < data.length(); at += step) {
+        checksum.add(std::string_view(data).substr(at, step));
+      }
+      REQUIRE(checksum.sum() == whole);
+    }
+  }
+
+  // A checksum written into the data makes it verify.
+  std::string header = data.substr(0, 20);
+  header[10] = header[11] = 0;
+  Checksum checksum;
+  checksum.add(header);
+  const uint16_t value = checksum.checksum();
+  header[10] = static_cast<char>(value >> 8);
+  header[11] = static_cast<char>(value);
+  checksum.clear();
+  checksum.add(header);
+  CHECK(checksum.verifies());
+}
+
+TEST_CASE("Checksum - verifies generated packets", "[checksum]") {
+  TrafficGenerator::Config config;
+  config.ipv6_ratio = 0.3;
+  config.udp_ratio = 0.3;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+
+  std::size_t ipv4 = 0;
+  std::size_t transport = 0;
+  for (int i = 0; i < 5000; ++i) {
+    const PacketRef packet = generator.next();
+    REQUIRE(decoder.decode(packet.data, stack));
+    for (Checksum::Kernel kernel : all_kernels) {
+      const ChecksumCheck check = verify_checksums(packet, stack, kernel);
+      REQUIRE_FALSE(check.bad());
+      REQUIRE(check.transport == Result::Good);
+      REQUIRE(check.ipv4 == (stack.has(LayerKind::IPv4) ? Result::Good
+                                                         : Result::Unchecked));
+    }
+
+    // One flipped bit anywhere past Ethernet is caught, except in the
+    // first 8 bytes of an IPv6 header, which no checksum covers.
+    std::string frame(packet.data);
+    const std::size_t first = stack.has(LayerKind::IPv6) ? 22 : 14;
+    const std::size_t at = first + (static_cast<std::size_t>(i) * 131) %
+                                       (frame.length() - first);
+    frame[at] = static_cast<char>(frame[at] ^ (1 << (i % 8)));
+    LayerStack corrupted;
+    if (!decoder.decode(frame, corrupted) ||
+        corrupted.has(LayerKind::IPv4) != stack.has(LayerKind::IPv4) ||
+        corrupted.payload_length() != stack.payload_length()) {
+      continue; // the flip changed how the packet parses
+    }
+    const ChecksumCheck check =
+        verify_checksums(PacketRef{frame, 0}, corrupted);
+    CHECK(check.bad());
+    ipv4 += check.ipv4 == Result::Bad ? 1 : 0;
+    transport += check.transport == Result::Bad ? 1 : 0;
+  }
+  CHECK(ipv4 > 100);
+  CHECK(transport > 1000);
+}
+
+TEST_CASE("Checksum - what is left unchecked", "[checksum]") {
+  TestFrame udp;
+  udp.protocol = IPv4Header::PROTO_UDP;
+  udp.payload.assign(200 - 20 - 8, 'x');
+  udp.checksums = true;
+  const std::string datagram = build_frame(udp);
+  const PacketRef packet{datagram, 0};
+  Decoder decoder;
+  LayerStack stack;
+  REQUIRE(decoder.decode(packet.data, stack));
+  REQUIRE(verify_checksums(packet, stack).transport == Result::Good);
+
+  // Offload flags from the capture source
+  std::string frame(packet.data);
+  frame[60] = static_cast<char>(frame[60] ^ 1); // in the UDP payload
+  CHECK(verify_checksums(PacketRef{frame, 0}, stack).transport ==
+        Result::Bad);
+  CHECK(verify_checksums(PacketRef{frame, 0, PacketRef::CHECKSUM_VALID},
+                         stack)
+            .transport == Result::Unchecked);
+  const ChecksumCheck partial = verify_checksums(
+      PacketRef{frame, 0, PacketRef::CHECKSUM_PARTIAL}, stack);
+  CHECK(partial.transport == Result::Unchecked);
+  CHECK(partial.ipv4 == Result::Good);
+
+  // UDP sent without a checksum
+  frame = std::string(packet.data);
+  frame[40] = frame[41] = 0;
+  CHECK(verify_checksums(PacketRef{frame, 0}, stack).transport ==
+        Result::Unchecked);
+
+  // Cut short by the snap length: only the IPv4 header can be checked.
+  const std::string_view cut = packet.data.substr(0, 100);
+  REQUIRE(decoder.decode(cut, stack));
+  const ChecksumCheck truncated = verify_checksums(PacketRef{cut, 0}, stack);
+  CHECK(truncated.ipv4 == Result::Good);
+  CHECK(truncated.transport == Result::Unchecked);
+
+  // Fragments
+  TrafficGenerator::Config config;
+  config.ipv6_ratio = 0;
+  config.udp_ratio = 1;
+  config.fragment_ratio = 1;
+  TrafficGenerator fragments(config);
+  for (int i = 0; i < 6; ++i) {
+    const PacketRef fragment = fragments.next();
+    REQUIRE(decoder.decode(fragment.data, stack));
+    const ChecksumCheck check = verify_checksums(fragment, stack);
+    CHECK(check.ipv4 == Result::Good);
+    CHECK(check.transport == Result::Unchecked);
+  }
+
+  // Not IP at all
+  stack.clear();
+  CHECK(verify_checksums(PacketRef{"not ip", 0}, stack).ipv4 ==
+        Result::Unchecked);
+}
@@ -0,0 +1,358 @@
+#include "column_file.hpp"
+#include "decoder.hpp"
+#include "flow_key.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// A fresh temporary path, removed afterwards
+class TempPath {
+public:
+  TempPath() {
+    char name[] = "/tmp/layerspy_test_XXXXXX";
+    const int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    close(fd);
+    m_path = name;
+  }
+  ~TempPath() { std::remove(m_path.c_str()); }
+
+  const std::string &path() const { return m_path; }
+
+private:
+  std::string m_path;
+};
+
+uint64_t file_size(const std::string &path) {
+  struct stat info = {};
+  REQUIRE(stat(path.c_str(), &info) == 0);
+  return static_cast<uint64_t>(info.st_size);
+}
+
+// Every row of `column`, chunk after chunk
+std::vector<uint64_t> column_values(const ColumnFileReader &reader,
+                                    Column column) {
+  std::vector<uint64_t> all;
+  std::vector<uint64_t> values;
+  for (std::size_t chunk = 0; chunk < reader.chunks(); ++chunk) {
+    reader.read(chunk, column, values);
+    all.insert(all.end(), values.begin(), values.end());
+  }
+  return all;
+}
+
+// Every row's address in `column`, looked up in its chunk's dictionary
+std::vector<ColumnFileReader::Address>
+addresses(const ColumnFileReader &reader, Column column) {
+  std::vector<ColumnFileReader::Address> all;
+  std::vector<ColumnFileReader::Address> dictionary;
+  std::vector<uint64_t> indices;
+  for (std::size_t chunk = 0; chunk < reader.chunks(); ++chunk) {
+    reader.dictionary(chunk, dictionary);
+    REQUIRE(std::is_sorted(dictionary.begin(), dictionary.end()));
+    reader.read(chunk, column, indices);
+    for (uint64_t index : indices) {
+      REQUIRE(index < dictionary.size());
+      all.push_back(dictionary[index]);
+    }
+  }
+  return all;
+}
+
+struct Expected {
+  std::vector<uint64_t> columns[COLUMN_COUNT];
+  std::vector<ColumnFileReader::Address> src;
+  std::vector<ColumnFileReader::Address> dst;
+};
+
+void expect(Expected &expected, const PacketRef &packet,
+            const LayerStack &stack) {
+  FlowKey key;
+  FlowKey::from_packet(packet.data, stack, key);
+  ColumnFileReader::Address src{};
+  ColumnFileReader::Address dst{};
+  uint64_t ttl = 0;
+  if (const IPv4Header *ipv4 = stack.get<IPv4>()) {
+    src = ColumnFileReader::to_address(ipv4->source_ip);
+    dst = ColumnFileReader::to_address(ipv4->dest_ip);
+    ttl = ipv4->ttl;
+  } else if (const IPv6Header *ipv6 = stack.get<IPv6>()) {
+    src = ColumnFileReader::to_address(ipv6->source_ip);
+    dst = ColumnFileReader::to_address(ipv6->dest_ip);
+    ttl = ipv6->hop_limit;
+  }
+  const TCPHeader *tcp = stack.get<TCP>();
+  const uint64_t row[COLUMN_COUNT] = {
+      packet.timestamp_ns,
+      packet.data.length(),
+      (stack.has(LayerKind::Ethernet) ? PacketColumns::HAS_ETHERNET : 0U) |
+          (stack.has(LayerKind::IPv4) ? PacketColumns::HAS_IPV4 : 0U) |
+          (stack.has(LayerKind::IPv6) ? PacketColumns::HAS_IPV6 : 0U) |
+          (stack.has(LayerKind::TCP) ? PacketColumns::HAS_TCP : 0U),
+      0,
+      0,
+      key.protocol,
+      ttl,
+      key.src_port,
+      key.dst_port,
+      tcp != nullptr ? tcp->flags() : 0U,
+      stack.payload_length()};
+  for (std::size_t i = 0; i < COLUMN_COUNT; ++i) {
+    expected.columns[i].push_back(row[i]);
+  }
+  expected.src.push_back(src);
+  expected.dst.push_back(dst);
+}
+
+void check(const ColumnFileReader &reader, const Expected &expected) {
+  for (std::size_t i = 0; i < COLUMN_COUNT; ++i) {
+    const Column column = static_cast<Column>(i);
+    if (column == Column::SrcAddress || column == Column::DstAddress) {
+      continue;
+    }
+    CHECK(column_values(reader, column) == expected.columns[i]);
+  }
+  CHECK(addresses(reader, Column::SrcAddress) == expected.src);
+  CHECK(addresses(reader, Column::DstAddress) == expected.dst);
+}
+
+} // namespace
+
+TEST_CASE("ColumnFile - every column reads back", "[column_file]") {
+  TempPath file;
+  TrafficGenerator::Config config;
+  config.fragment_ratio = 0.05;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+  Expected expected;
+  {
+    ColumnFileWriter writer(file.path(), 1000);
+    for (int i = 0; i < 2500; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      writer.append(packet, stack);
+      expect(expected, packet, stack);
+    }
+    // A packet that decodes to nothing is kept with zero fields.
+    stack.clear();
+    const PacketRef runt{"ab", 1};
+    writer.append(runt, stack);
+    expect(expected, runt, stack);
+    writer.close();
+    CHECK(writer.rows() == 2501);
+    CHECK(writer.bytes() == file_size(file.path()));
+  }
+
+  ColumnFileReader reader(file.path());
+  CHECK(reader.chunks() == 3);
+  CHECK(reader.rows() == 2501);
+  CHECK(reader.chunk_rows(2) == 501);
+  CHECK_FALSE(reader.truncated());
+  check(reader, expected);
+
+  const ColumnStats stats = reader.stats(0, Column::Timestamp);
+  CHECK(stats.min == expected.columns[0].front());
+  CHECK(stats.max == expected.columns[0][999]);
+}
+
+TEST_CASE("ColumnFile - batches match single packets", "[column_file]") {
+  TempPath file;
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+  Expected expected;
+  {
+    ColumnFileWriter writer(file.path());
+    std::vector<std::string> frames;
+    std::vector<PacketRef> batch;
+    PacketColumns columns;
+    for (int round = 0; round < 4; ++round) {
+      frames.clear();
+      batch.clear();
+      for (int i = 0; i < 256; ++i) {
+        const PacketRef packet = generator.next();
+        frames.emplace_back(packet.data);
+        decoder.decode(packet.data, stack);
+        expect(expected, packet, stack);
+        batch.push_back(PacketRef{{}, packet.timestamp_ns});
+      }
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        batch[i].data = frames[i];
+      }
+      decoder.decodeBatch(batch.data(), batch.size(), columns);
+      writer.append(batch.data(), columns);
+    }
+  }
+
+  ColumnFileReader reader(file.path());
+  CHECK(reader.rows() == 1024);
+  check(reader, expected);
+}
+
+TEST_CASE("ColumnFile - scans skip chunks out of range", "[column_file]") {
+  TempPath file;
+  TrafficGenerator::Config config;
+  config.start_ns = 1000000;
+  config.interval_ns = 1000;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+  {
+    ColumnFileWriter writer(file.path(), 100);
+    for (int i = 0; i < 1000; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      writer.append(packet, stack);
+    }
+  }
+
+  ColumnFileReader reader(file.path());
+  REQUIRE(reader.chunks() == 10);
+  // Rows 250 to 349: the end of chunk 2 and the start of chunk 3
+  std::vector<uint64_t> rows;
+  const std::size_t decoded = reader.scan(
+      Column::Timestamp, 1000000 + 250 * 1000, 1000000 + 349 * 1000,
+      [&](std::size_t chunk, std::size_t row, uint64_t) {
+        rows.push_back(chunk * 100 + row);
+      });
+  CHECK(decoded == 2);
+  REQUIRE(rows.size() == 100);
+  CHECK(rows.front() == 250);
+  CHECK(rows.back() == 349);
+
+  CHECK(reader.scan(Column::Timestamp, 0, 999999,
+                    [](std::size_t, std::size_t, uint64_t) {}) == 0);
+}
+
+TEST_CASE("ColumnFile - address lookups through the dictionary",
+          "[column_file]") {
+  TempPath file;
+  const unsigned char a[4] = {10, 0, 0, 1};
+  const unsigned char b[4] = {10, 0, 0, 2};
+  {
+    ColumnFileWriter writer(file.path());
+    PacketColumns columns;
+    columns.reset(3);
+    std::vector<PacketRef> packets(3, PacketRef{"packet", 0});
+    for (std::size_t i = 0; i < 3; ++i) {
+      columns.layers[i] = PacketColumns::HAS_IPV4;
+      columns.timestamp_ns[i] = i;
+      columns.src_ipv4[i] = Ipv4Address(i == 1 ? b : a).hostOrder();
+      columns.dst_ipv4[i] = Ipv4Address(i == 1 ? a : b).hostOrder();
+    }
+    writer.append(packets.data(), columns);
+  }
+
+  ColumnFileReader reader(file.path());
+  std::vector<ColumnFileReader::Address> dictionary;
+  reader.dictionary(0, dictionary);
+  // Sources and destinations share one dictionary.
+  REQUIRE(dictionary.size() == 2);
+  CHECK(dictionary[0] == ColumnFileReader::to_address(Ipv4Address(a)));
+  CHECK(dictionary[1] == ColumnFileReader::to_address(Ipv4Address(b)));
+  CHECK(dictionary[1][10] == 0xFF);
+
+  std::vector<uint64_t> src;
+  reader.read(0, Column::SrcAddress, src);
+  CHECK(src == std::vector<uint64_t>{0, 1, 0});
+  CHECK(reader.stats(0, Column::SrcAddress).max == 1);
+}
+
+TEST_CASE("ColumnFile - much smaller than pcap", "[column_file]") {
+  TempPath pcap;
+  TempPath columns;
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  generator.write_pcap(pcap.path(), 100000);
+  generator.reset();
+  Decoder decoder;
+  LayerStack stack;
+  {
+    ColumnFileWriter writer(columns.path());
+    for (int i = 0; i < 100000; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      writer.append(packet, stack);
+    }
+  }
+  const uint64_t size = file_size(columns.path());
+  CHECK(size * 10 < file_size(pcap.path()));
+  CHECK(size < 100000 * 24);
+}
+
+TEST_CASE("ColumnFile - a file cut short keeps its whole chunks",
+          "[column_file]") {
+  TempPath file;
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+  {
+    ColumnFileWriter writer(file.path(), 100);
+    for (int i = 0; i < 300; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      writer.append(packet, stack);
+    }
+  }
+  REQUIRE(truncate(file.path().c_str(),
+                   static_cast<off_t>(file_size(file.path()) - 10)) == 0);
+
+  ColumnFileReader reader(file.path());
+  CHECK(reader.truncated());
+  CHECK(reader.chunks() == 2);
+  CHECK(reader.rows() == 200);
+  CHECK(column_values(reader, Column::Length).size() == 200);
+}
+
+TEST_CASE("ColumnFile - rejects bad files and settings", "[column_file]") {
+  TempPath file;
+  {
+    std::ofstream out(file.path(), std::ios::binary);
+    out << "LSPYPCAP and some more bytes";
+  }
+  CHECK_THROWS_AS(ColumnFileReader(file.path()), std::runtime_error);
+  CHECK_THROWS_AS(ColumnFileReader("/nonexistent/file.cols"),
+                  std::runtime_error);
+  CHECK_THROWS_AS(ColumnFileWriter(file.path(), 0), std::invalid_argument);
+
+  // A section claiming more values than its chunk has rows
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+  {
+    ColumnFileWriter writer(file.path(), 100);
+    for (int i = 0; i < 100; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      writer.append(packet, stack);
+    }
+  }
+  {
+    // The count of the Timestamp section, the first after the file header,
+    // the chunk magic, row count and size
+    std::fstream out(file.path(),
+                     std::ios::binary | std::ios::in | std::ios::out);
+    out.seekp(16 + 16 + 24);
+    out.write("\xff\xff\xff\x7f", 4);
+  }
+  {
+    ColumnFileReader reader(file.path());
+    std::vector<uint64_t> values;
+    CHECK_THROWS_AS(reader.read(0, Column::Timestamp, values),
+                    std::runtime_error);
+    reader.read(0, Column::Length, values);
+    CHECK(values.size() == 100);
+  }
+  CHECK_THROWS_AS(ColumnFileWriter("/nonexistent/dir/out.cols"),
+                  std::runtime_error);
+}
@@ -0,0 +1,146 @@
+#include "decoder.hpp"
+#include "packet_columns.hpp"
+#include "packet_ref.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv4 / TCP, 192.168.1.1:51000 -> 10.0.0.1:80, SYN, payload "hi"
+const unsigned char ipv4_tcp_packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x08, 0x00, 0x45, 0x00, 0x00, 0x2a, 0x00, 0x01, 0x00, 0x00, 0x40, 0x06,
+    0x00, 0x00, 0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00, 0x01, 0xc7, 0x38,
+    0x00, 0x50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x50, 0x02,
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 'h',  'i'};
+
+// Ethernet / IPv6 / TCP, 2001:db8::1:443 -> 2001:db8::2:50000, FIN|ACK
+const unsigned char ipv6_tcp_packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x86, 0xdd, 0x60, 0x00, 0x00, 0x00, 0x00, 0x14, 0x06, 0x40, 0x20, 0x01,
+    0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x01, 0xbb, 0xc3, 0x50, 0x00, 0x00,
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x50, 0x11, 0xff, 0xff, 0x00, 0x00,
+    0x00, 0x00};
+
+// Ethernet carrying ARP (not decoded past L2)
+const unsigned char arp_packet[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xaa,
+                                    0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x08, 0x06,
+                                    0x00, 0x01, 0x08, 0x00};
+
+const unsigned char runt_packet[] = {0x00, 0x11, 0x22};
+
+template <std::size_t N>
+PacketRef ref(const unsigned char (&bytes)[N], uint64_t timestamp_ns) {
+  return PacketRef{
+      std::string_view(reinterpret_cast<const char *>(bytes), N),
+      timestamp_ns};
+}
+
+} // namespace
+
+TEST_CASE("Decoder::decodeBatch fills one row per packet", "[decoder][batch]") {
+  const std::vector<PacketRef> batch = {
+      ref(ipv4_tcp_packet, 100), ref(ipv6_tcp_packet, 200),
+      ref(arp_packet, 300), ref(runt_packet, 400)};
+
+  Decoder decoder;
+  PacketColumns columns;
+  CHECK(decoder.decodeBatch(batch.data(), batch.size(), columns) == 3);
+  REQUIRE(columns.size() == 4);
+
+  SECTION("IPv4 / TCP row") {
+    CHECK(columns.layers[0] == (PacketColumns::HAS_ETHERNET |
+                                PacketColumns::HAS_IPV4 |
+                                PacketColumns::HAS_TCP));
+    CHECK(columns.timestamp_ns[0] == 100);
+    CHECK(columns.src_ipv4[0] == 0xC0A80101);
+    CHECK(columns.dst_ipv4[0] == 0x0A000001);
+    CHECK(columns.ip_protocol[0] == 6);
+    CHECK(columns.ttl[0] == 64);
+    CHECK(columns.src_port[0] == 51000);
+    CHECK(columns.dst_port[0] == 80);
+    CHECK(columns.tcp_flags[0] == TCP::FLAG_SYN);
+    CHECK(columns.payload_offset[0] == 54);
+    CHECK(columns.payload_length[0] == 2);
+  }
+
+  SECTION("IPv6 / TCP row") {
+    CHECK(columns.layers[1] == (PacketColumns::HAS_ETHERNET |
+                                PacketColumns::HAS_IPV6 |
+                                PacketColumns::HAS_TCP));
+    CHECK(columns.src_ipv6[1][0] == 0x20);
+    CHECK(columns.src_ipv6[1][15] == 0x01);
+    CHECK(columns.dst_ipv6[1][15] == 0x02);
+    CHECK(columns.src_ipv4[1] == 0);
+    CHECK(columns.src_port[1] == 443);
+    CHECK(columns.tcp_flags[1] == (TCP::FLAG_FIN | TCP::FLAG_ACK));
+  }
+
+  SECTION("Non-IP and undersized rows") {
+    CHECK(columns.layers[2] == PacketColumns::HAS_ETHERNET);
+    CHECK(columns.eth_type[2] == 0x0806);
+    CHECK(columns.payload_offset[2] == Ethernet::HEADER_SIZE);
+    CHECK(columns.payload_length[2] == 4);
+
+    CHECK(columns.layers[3] == 0);
+    CHECK(columns.timestamp_ns[3] == 400);
+    CHECK(columns.payload_length[3] == 0);
+  }
+}
+
+TEST_CASE("Decoder::decodeBatch clears rows left by a previous batch",
+          "[decoder][batch]") {
+  Decoder decoder;
+  PacketColumns columns;
+
+  const PacketRef tcp = ref(ipv4_tcp_packet, 1);
+  decoder.decodeBatch(&tcp, 1, columns);
+  REQUIRE(columns.src_port[0] == 51000);
+
+  const PacketRef arp = ref(arp_packet, 2);
+  decoder.decodeBatch(&arp, 1, columns);
+  REQUIRE(columns.size() == 1);
+  CHECK(columns.src_port[0] == 0);
+  CHECK(columns.src_ipv4[0] == 0);
+}
+
+TEST_CASE("Decoder::decodeBatch fills UDP ports from the first fragment",
+          "[decoder][batch]") {
+  TestFrame udp;
+  udp.protocol = 17;
+  udp.src_port = 5353;
+  udp.dst_port = 53;
+  udp.payload = "query";
+  TestFrame udp6 = udp;
+  udp6.ipv6 = true;
+  udp6.extension_type = 0; // Hop-by-Hop
+  udp6.extensions = ipv6_extension_header(17, 8);
+  TestFrame later = udp;
+  later.raw_payload = true;
+  later.payload = std::string(16, '\x7f');
+  later.flags_fragment = 2; // offset 16
+
+  const std::vector<std::string> frames = {build_frame(udp), build_frame(udp6),
+                                           build_frame(later)};
+  std::vector<PacketRef> batch;
+  for (const std::string &frame : frames) {
+    batch.push_back(PacketRef{frame, 0});
+  }
+  Decoder decoder;
+  PacketColumns columns;
+  REQUIRE(decoder.decodeBatch(batch.data(), batch.size(), columns) == 3);
+  for (std::size_t row = 0; row < 2; ++row) {
+    CHECK(columns.ip_protocol[row] == 17);
+    CHECK(columns.src_port[row] == 5353);
+    CHECK(columns.dst_port[row] == 53);
+    CHECK(columns.tcp_flags[row] == 0);
+    CHECK((columns.layers[row] & PacketColumns::HAS_TCP) == 0);
+  }
+  CHECK(columns.src_port[2] == 0);
+  CHECK(columns.dst_port[2] == 0);
+}
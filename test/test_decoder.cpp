@@ -3,7 +3,8 @@
 // --- Headers to Test ---
 #include "decoder.hpp"
 #include "protocols/ethernet.hpp"
-#include "protocols/ipv4.hpp" // (Needed for the stubbed parse_ipv4)
+#include "protocols/ipv4.hpp"
+#include "protocols/tcp.hpp"
 
 // --- System Headers ---
 #include <cstdint>
@@ -19,7 +20,8 @@
 //   - Source MAC: aa:bb:cc:dd:ee:ff
 //   - EtherType:  0x0800 (IPv4)
 // L3: IPv4
-//   - (20 bytes of dummy IPv4 header starting with 0x45)
+//   - 20-byte header, TTL 64, protocol 6 (TCP), no L4 bytes
+//   - 192.168.1.1 -> 10.0.0.1
 //
 const unsigned char golden_packet_bytes[] = {
     // --- Ethernet Header (14 bytes) ---
@@ -27,8 +29,7 @@ const unsigned char golden_packet_bytes[] = {
     0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, // Source MAC
     0x08, 0x00,                         // EtherType (IPv4)
 
-    // --- Dummy IPv4 Header (20 bytes) ---
-    // (This is what will be passed to your stubbed parse_ipv4)
+    // --- IPv4 Header (20 bytes) ---
     0x45, 0x00, 0x00, 0x28, 0x12, 0x34, 0x00, 0x00, 0x40, 0x06, 0x00, 0x00,
     0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00, 0x01};
 
@@ -43,7 +44,7 @@ TEST_CASE("Decoder can parse a L2 Ethernet header", "[decoder]") {
 
   // 2. ACT
   // Call the method we want to test.
-  std::unique_ptr<BaseProtocol> parsed_tree = decoder.decodePacket(packet_data);
+  LayerPtr parsed_tree = decoder.decodePacket(packet_data);
 
   // 3. ASSERT
   // Now we check if everything is correct.
@@ -64,19 +65,30 @@ TEST_CASE("Decoder can parse a L2 Ethernet header", "[decoder]") {
 
   // Check 4: Was the payload chained correctly?
   // (This checks if the 'switch' statement in parse_ethernet worked)
-  // Our stubbed parse_ipv4 returns a non-null IPv4 object, so
-  // the payload pointer should not be null.
   REQUIRE(eth->payload != nullptr);
 
   // Check 5: Was the payload object the correct type?
   IPv4 *ipv4 = dynamic_cast<IPv4 *>(eth->payload.get());
   REQUIRE(ipv4 != nullptr);
 
-  // Check 6: Was the *remaining* data passed to the IPv4 payload?
-  // We check that the raw_payload of the *next* layer is correct.
+  // Check 6: Was the *remaining* data passed on to the IPv4 layer?
   // (This proves our string_view.remove_prefix(14) worked!)
-  CHECK(ipv4->raw_payload.length() == 20);
-  CHECK(ipv4->raw_payload.data()[0] == '\x45'); // First byte of IPv4
+  CHECK(eth->raw_payload.length() == 20);
+  CHECK(eth->raw_payload.data()[0] == '\x45'); // First byte of IPv4
+
+  // Check 7: Were the IPv4 fields decoded?
+  CHECK(ipv4->version == 4);
+  CHECK(ipv4->ihl == 5);
+  CHECK(ipv4->total_length == 40);
+  CHECK(ipv4->identification == 0x1234);
+  CHECK(ipv4->ttl == 64);
+  CHECK(ipv4->protocol == IPv4::PROTO_TCP);
+  CHECK(ipv4->source_ip.toString() == "192.168.1.1");
+  CHECK(ipv4->dest_ip.toString() == "10.0.0.1");
+
+  // The header claims TCP, but no bytes are left for it.
+  CHECK(ipv4->raw_payload.empty());
+  CHECK(ipv4->payload == nullptr);
 }
 
 TEST_CASE("Decoder handles undersized packets", "[decoder]") {
@@ -88,9 +100,52 @@ TEST_CASE("Decoder handles undersized packets", "[decoder]") {
                              sizeof(tiny_packet));
 
   // 2. ACT
-  std::unique_ptr<BaseProtocol> parsed_tree = decoder.decodePacket(tiny_data);
+  LayerPtr parsed_tree = decoder.decodePacket(tiny_data);
 
   // 3. ASSERT
   // The parser should have safely returned nothing.
   REQUIRE(parsed_tree == nullptr);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Decoder parses a full Ethernet/IPv4/TCP stack", "[decoder]") {
+  const unsigned char packet[] = {
+      // --- Ethernet Header (14 bytes) ---
+      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+      0x08, 0x00,
+      // --- IPv4 Header (20 bytes), total length 44 ---
+      0x45, 0x00, 0x00, 0x2c, 0x00, 0x01, 0x40, 0x00, 0x40, 0x06, 0x00, 0x00,
+      0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00, 0x01,
+      // --- TCP Header (20 bytes) 51000 -> 80, SYN|ACK ---
+      0xc7, 0x38, 0x00, 0x50, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xc8,
+      0x50, 0x12, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+      // --- Payload (4 bytes) ---
+      'G', 'E', 'T', ' ',
+      // --- Ethernet padding, not part of the IP datagram ---
+      0x00, 0x00};
+
+  Decoder decoder;
+  LayerPtr tree = decoder.decodePacket(std::string_view(
+      reinterpret_cast<const char *>(packet), sizeof(packet)));
+  REQUIRE(tree != nullptr);
+
+  IPv4 *ipv4 = dynamic_cast<IPv4 *>(tree->payload.get());
+  REQUIRE(ipv4 != nullptr);
+  CHECK(ipv4->dont_fragment);
+  CHECK_FALSE(ipv4->more_fragments);
+
+  TCP *tcp = dynamic_cast<TCP *>(ipv4->payload.get());
+  REQUIRE(tcp != nullptr);
+  CHECK(tcp->src_port == 51000);
+  CHECK(tcp->dst_port == 80);
+  CHECK(tcp->seq_number == 100);
+  CHECK(tcp->ack_number == 200);
+  CHECK(tcp->data_offset == 5);
+  CHECK(tcp->flag_syn);
+  CHECK(tcp->flag_ack);
+  CHECK_FALSE(tcp->flag_fin);
+  CHECK(tcp->window_size == 0xffff);
+  CHECK(tcp->is_http_candidate());
+
+  // Padding is trimmed using the IPv4 total length.
+  CHECK(tcp->raw_payload == "GET ");
+}
@@ -0,0 +1,245 @@
+#include "decoder.hpp"
+#include "display.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::string line(const PacketSummary &summary) {
+  char buffer[Display::MAX_LINE];
+  return std::string(buffer, Display::format(summary, buffer));
+}
+
+// Reads a file descriptor until end of file
+std::string read_all(int fd) {
+  std::string text;
+  char buffer[65536];
+  ssize_t got;
+  while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+    text.append(buffer, static_cast<std::size_t>(got));
+  }
+  return text;
+}
+
+Ipv4Address ipv4(unsigned char last) {
+  const unsigned char bytes[4] = {10, 0, 0, last};
+  return Ipv4Address(bytes);
+}
+
+std::size_t count_lines(const std::string &text) {
+  std::size_t lines = 0;
+  for (char c : text) {
+    lines += c == '\n' ? 1 : 0;
+  }
+  return lines;
+}
+
+} // namespace
+
+TEST_CASE("Display - line format", "[display]") {
+  PacketSummary summary;
+  summary.timestamp_ns = 1700000000000001000ULL;
+  summary.length = 74;
+  summary.worker = 3;
+
+  SECTION("IPv4 TCP") {
+    summary.flow = FlowKey(ipv4(1), 80, ipv4(2), 5000, 6);
+    summary.tcp = true;
+    summary.tcp_flags = TCPHeader::FLAG_SYN | TCPHeader::FLAG_ACK;
+    CHECK(line(summary) == "1700000000.000001000 #3 TCP 10.0.0.1:80 > "
+                           "10.0.0.2:5000 [S.] len 74 payload 0\n");
+  }
+  SECTION("IPv6 UDP") {
+    const unsigned char src[16] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0,
+                                   0,    0,    0,    0,    0, 0, 0, 1};
+    const unsigned char dst[16] = {0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+                                   0,    0,    0, 0, 0, 0, 0, 2};
+    summary.flow =
+        FlowKey(Ipv6Address(src), 53, Ipv6Address(dst), 40000, 17);
+    summary.payload = 12;
+    CHECK(line(summary) == "1700000000.000001000 #3 UDP [2001:db8::1]:53 > "
+                           "[fe80::2]:40000 len 74 payload 12\n");
+  }
+  SECTION("no IP layer") {
+    CHECK(line(summary) == "1700000000.000001000 #3 ETH len 74 payload 0\n");
+    summary.malformed = true;
+    summary.length = 3;
+    CHECK(line(summary) ==
+          "1700000000.000001000 #3 MALFORMED len 3 payload 0\n");
+  }
+  SECTION("other protocols") {
+    summary.flow = FlowKey(ipv4(1), 0, ipv4(2), 0, 47);
+    CHECK(line(summary) == "1700000000.000001000 #3 proto 47 10.0.0.1 > "
+                           "10.0.0.2 len 74 payload 0\n");
+  }
+}
+
+TEST_CASE("Display - summaries of decoded packets", "[display]") {
+  TrafficGenerator::Config config;
+  config.udp_ratio = 0;
+  config.ipv6_ratio = 0;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+  const PacketRef packet = generator.next();
+  REQUIRE(decoder.decode(packet.data, stack));
+
+  const PacketSummary summary = PacketSummary::from(2, packet, stack);
+  CHECK(summary.worker == 2);
+  CHECK(summary.timestamp_ns == packet.timestamp_ns);
+  CHECK(summary.length == packet.data.length());
+  CHECK(summary.payload == stack.payload_length());
+  CHECK(summary.flow.family == 4);
+  CHECK(summary.flow.protocol == 6);
+  CHECK(summary.tcp);
+  CHECK(summary.tcp_flags == stack.get<TCP>()->flags());
+  CHECK_FALSE(summary.malformed);
+
+  stack.clear();
+  const PacketSummary bad = PacketSummary::from(0, PacketRef{"ab", 1}, stack);
+  CHECK(bad.malformed);
+  CHECK(bad.flow.family == 0);
+}
+
+TEST_CASE("Display - writes every queued line", "[display]") {
+  char name[] = "/tmp/layerspy_test_XXXXXX";
+  const int fd = mkstemp(name);
+  REQUIRE(fd >= 0);
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+
+  Display::Config config;
+  config.workers = 2;
+  config.fd = fd;
+  std::vector<std::string> expected[2];
+  {
+    Display display(config);
+    for (std::size_t i = 0; i < 20000; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      const std::size_t worker = i % 2;
+      expected[worker].push_back(
+          line(PacketSummary::from(worker, packet, stack)));
+      // A full queue drops the summary instead of waiting.
+      if (!display.push(worker, packet, stack)) {
+        expected[worker].pop_back();
+      }
+    }
+    display.stop();
+    const Display::Stats stats = display.stats();
+    CHECK(stats.pushed == 20000);
+    CHECK(stats.queued + stats.dropped == 20000);
+    CHECK(stats.written == stats.queued);
+    CHECK(stats.write_errors == 0);
+  }
+  lseek(fd, 0, SEEK_SET);
+  const std::string text = read_all(fd);
+  close(fd);
+  std::remove(name);
+
+  // Each worker's lines appear in the order it pushed them.
+  std::size_t next[2] = {0, 0};
+  std::size_t start = 0;
+  while (start < text.length()) {
+    const std::size_t end = text.find('\n', start) + 1;
+    const std::string got = text.substr(start, end - start);
+    const std::size_t worker = got.find(" #1 ") != std::string::npos ? 1 : 0;
+    REQUIRE(next[worker] < expected[worker].size());
+    CHECK(got == expected[worker][next[worker]++]);
+    start = end;
+  }
+  CHECK(next[0] == expected[0].size());
+  CHECK(next[1] == expected[1].size());
+}
+
+TEST_CASE("Display - sampling and rate limiting", "[display]") {
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  std::string text;
+  std::thread reader([&] { text = read_all(fds[0]); });
+
+  Display::Config config;
+  config.fd = fds[1];
+  SECTION("one packet in four") {
+    config.sample_every = 4;
+    Display display(config);
+    for (int i = 0; i < 1000; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      display.push(0, packet, stack);
+    }
+    display.stop();
+    CHECK(display.stats().pushed == 1000);
+    CHECK(display.stats().queued + display.stats().dropped == 250);
+    CHECK(display.stats().written == display.stats().queued);
+  }
+  SECTION("lines per second") {
+    config.max_lines_per_second = 50;
+    Display display(config);
+    for (int i = 0; i < 1000; ++i) {
+      const PacketRef packet = generator.next();
+      decoder.decode(packet.data, stack);
+      display.push(0, packet, stack);
+    }
+    display.stop();
+    const Display::Stats stats = display.stats();
+    // A burst of one second's worth, plus what trickles in meanwhile
+    CHECK(stats.written >= 50);
+    CHECK(stats.written < 100);
+    CHECK(stats.written + stats.suppressed + stats.dropped == 1000);
+  }
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  CHECK(count_lines(text) > 0);
+}
+
+TEST_CASE("Display - a stalled output never blocks workers", "[display]") {
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+
+  Display::Config config;
+  config.fd = fds[1];
+  config.queue_records = 64;
+  Display display(config);
+  // Nobody reads the pipe, so the display thread soon blocks in writev().
+  bool dropped = false;
+  for (int i = 0; i < 100000 && !dropped; ++i) {
+    const PacketRef packet = generator.next();
+    decoder.decode(packet.data, stack);
+    dropped = !display.push(0, packet, stack);
+  }
+  CHECK(dropped);
+  CHECK(display.stats().dropped >= 1);
+
+  std::string text;
+  std::thread reader([&] { text = read_all(fds[0]); });
+  display.stop();
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  CHECK(count_lines(text) == display.stats().written);
+  CHECK(display.stats().written == display.stats().queued);
+}
+
+TEST_CASE("Display - rejects bad configurations", "[display]") {
+  Display::Config config;
+  config.workers = 0;
+  CHECK_THROWS_AS(Display(config), std::invalid_argument);
+  config.workers = 1;
+  config.sample_every = 0;
+  CHECK_THROWS_AS(Display(config), std::invalid_argument);
+}
@@ -0,0 +1,107 @@
+#include "flow_hash.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+
+namespace {
+
+TestFrame ports(uint16_t sport, uint16_t dport, uint8_t protocol) {
+  TestFrame p;
+  p.src_port = sport;
+  p.dst_port = dport;
+  p.protocol = protocol;
+  return p;
+}
+
+std::string ipv4_frame(uint32_t src, uint32_t dst, uint16_t sport,
+                       uint16_t dport, uint8_t protocol = 6,
+                       uint16_t flags_fragment = 0) {
+  TestFrame p = ports(sport, dport, protocol);
+  p.src = src;
+  p.dst = dst;
+  p.flags_fragment = flags_fragment;
+  return build_frame(p);
+}
+
+// 2001:db8::<src> -> 2001:db8::<dst>
+std::string ipv6_frame(uint8_t src, uint8_t dst, uint16_t sport,
+                       uint16_t dport, uint8_t next_header = 17) {
+  TestFrame p = ports(sport, dport, next_header);
+  p.ipv6 = true;
+  p.src = src;
+  p.dst = dst;
+  return build_frame(p);
+}
+
+} // namespace
+
+TEST_CASE("symmetric_flow_hash is the same in both directions",
+          "[flow_hash]") {
+  CHECK(symmetric_flow_hash(ipv4_frame(0x0A000001, 0x0A000002, 40000, 80)) ==
+        symmetric_flow_hash(ipv4_frame(0x0A000002, 0x0A000001, 80, 40000)));
+  CHECK(symmetric_flow_hash(ipv6_frame(1, 2, 5353, 53)) ==
+        symmetric_flow_hash(ipv6_frame(2, 1, 53, 5353)));
+
+  // Same address on both ends: only the ports tell the directions apart.
+  CHECK(symmetric_flow_hash(ipv4_frame(0x7F000001, 0x7F000001, 1000, 2000)) ==
+        symmetric_flow_hash(ipv4_frame(0x7F000001, 0x7F000001, 2000, 1000)));
+}
+
+TEST_CASE("symmetric_flow_hash tells flows apart", "[flow_hash]") {
+  const uint64_t base =
+      symmetric_flow_hash(ipv4_frame(0x0A000001, 0x0A000002, 40000, 80));
+  CHECK(base != 0);
+  CHECK(base !=
+        symmetric_flow_hash(ipv4_frame(0x0A000001, 0x0A000002, 40001, 80)));
+  CHECK(base !=
+        symmetric_flow_hash(ipv4_frame(0x0A000001, 0x0A000003, 40000, 80)));
+  CHECK(base != symmetric_flow_hash(
+                    ipv4_frame(0x0A000001, 0x0A000002, 40000, 80, 17)));
+  // Swapping only the ports is a different flow.
+  CHECK(base !=
+        symmetric_flow_hash(ipv4_frame(0x0A000001, 0x0A000002, 80, 40000)));
+}
+
+TEST_CASE("symmetric_flow_hash keeps IPv4 fragments together",
+          "[flow_hash]") {
+  // First fragment (MF set) and a later one (offset 185) carry different
+  // bytes where the ports would be.
+  const uint64_t first = symmetric_flow_hash(
+      ipv4_frame(0x0A000001, 0x0A000002, 40000, 80, 17, 0x2000));
+  const uint64_t later = symmetric_flow_hash(
+      ipv4_frame(0x0A000001, 0x0A000002, 0x1234, 0x5678, 17, 0x00B9));
+  CHECK(first == later);
+}
+
+TEST_CASE("symmetric_flow_hash returns 0 for non-IP and runt frames",
+          "[flow_hash]") {
+  CHECK(symmetric_flow_hash(arp_frame()) == 0);
+  CHECK(symmetric_flow_hash(std::string(10, '\0')) == 0);
+  CHECK(symmetric_flow_hash(
+            ipv4_frame(0x0A000001, 0x0A000002, 1, 2).substr(0, 30)) == 0);
+}
+
+TEST_CASE("symmetric_flow_hash looks past IPv6 extension headers",
+          "[flow_hash]") {
+  const uint64_t plain = symmetric_flow_hash(ipv6_frame(1, 2, 5353, 53));
+
+  TestFrame p = ports(5353, 53, 17);
+  p.ipv6 = true;
+  p.src = 1;
+  p.dst = 2;
+  p.extension_type = 0; // Hop-by-Hop
+  p.extensions = ipv6_extension_header(17, 8);
+  CHECK(symmetric_flow_hash(build_frame(p)) == plain);
+
+  // Fragments hash without ports, like IPv4 ones, but on the upper layer's
+  // protocol.
+  p.extensions = ipv6_fragment_header(17, 0, true);
+  p.extension_type = 44;
+  const uint64_t first = symmetric_flow_hash(build_frame(p));
+  p.extensions = ipv6_fragment_header(17, 185, false);
+  p.src_port = 0x1234;
+  p.dst_port = 0x5678;
+  CHECK(symmetric_flow_hash(build_frame(p)) == first);
+  CHECK(first != plain);
+}
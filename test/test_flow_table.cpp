@@ -0,0 +1,248 @@
+#include "decoder.hpp"
+#include "flow_table.hpp"
+#include "test_frames.hpp"
+#include <arpa/inet.h>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+FlowKey v4_key(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+               uint8_t protocol = IPv4Header::PROTO_TCP) {
+  return FlowKey(Ipv4Address(htonl(src)), sport, Ipv4Address(htonl(dst)),
+                 dport, protocol);
+}
+
+// Distinct keys for table tests
+FlowKey key_n(uint32_t n) { return v4_key(0x0A000000 + n, 1024, 0, 80); }
+
+// Ethernet / IPv4 / TCP or UDP, 192.168.1.1 -> 10.0.0.1
+std::string ipv4_frame(uint8_t protocol, uint16_t sport, uint16_t dport) {
+  TestFrame p;
+  p.protocol = protocol;
+  p.src_port = sport;
+  p.dst_port = dport;
+  p.tcp_flags = 0x12; // SYN + ACK
+  return build_frame(p);
+}
+
+using Table = FlowTable<uint64_t>;
+
+Table::Config config(std::size_t max_flows, uint64_t idle_timeout_ns = 0,
+                     uint64_t lru_slack_ns = 0) {
+  Table::Config c;
+  c.max_flows = max_flows;
+  c.idle_timeout_ns = idle_timeout_ns;
+  c.lru_slack_ns = lru_slack_ns;
+  return c;
+}
+
+} // namespace
+
+TEST_CASE("FlowKey - layout and direction", "[flow_table]") {
+  const FlowKey key = v4_key(0xC0A80101, 51000, 0x0A000001, 80);
+  CHECK(key.family == 4);
+  CHECK(key.src_addr[0] == 192);
+  CHECK(key.src_addr[3] == 1);
+  CHECK(key.src_addr[4] == 0);
+  CHECK(key.dst_addr[0] == 10);
+  CHECK(key.src_port == 51000);
+
+  const FlowKey back = v4_key(0x0A000001, 80, 0xC0A80101, 51000);
+  CHECK(key != back);
+  CHECK(key.reversed() == back);
+  CHECK(key.canonical() == back.canonical());
+  CHECK(key.canonical().hash() == back.canonical().hash());
+  CHECK(key.hash() != back.hash());
+
+  // Same address on both ends: ports decide the order.
+  const FlowKey local = v4_key(0x7F000001, 2000, 0x7F000001, 1000);
+  CHECK(local.canonical().src_port == 1000);
+  CHECK(local.reversed().canonical() == local.canonical());
+
+  // IPv4 and IPv6 keys never collide on layout alone.
+  unsigned char v6[16] = {};
+  v6[0] = 10;
+  const FlowKey six(Ipv6Address(v6), 1024, Ipv6Address(v6), 80, 6);
+  CHECK(six.family == 6);
+  CHECK(six != v4_key(0x0A000000, 1024, 0x0A000000, 80));
+}
+
+TEST_CASE("FlowKey - from decoded packets", "[flow_table]") {
+  Decoder decoder;
+  LayerStack stack;
+  FlowKey key;
+
+  const std::string tcp = ipv4_frame(IPv4Header::PROTO_TCP, 51000, 80);
+  REQUIRE(decoder.decode(tcp, stack));
+  REQUIRE(FlowKey::from_packet(tcp, stack, key));
+  CHECK(key == v4_key(0xC0A80101, 51000, 0x0A000001, 80));
+
+  // UDP is not decoded; its ports come from the IP payload.
+  const std::string udp = ipv4_frame(IPv4Header::PROTO_UDP, 5353, 53);
+  REQUIRE(decoder.decode(udp, stack));
+  REQUIRE(FlowKey::from_packet(udp, stack, key));
+  CHECK(key == v4_key(0xC0A80101, 5353, 0x0A000001, 53,
+                      IPv4Header::PROTO_UDP));
+
+  const std::string arp = arp_frame();
+  REQUIRE(decoder.decode(arp, stack));
+  CHECK_FALSE(FlowKey::from_packet(arp, stack, key));
+}
+
+TEST_CASE("FlowTable - insert, find and erase", "[flow_table]") {
+  Table table(config(100));
+  CHECK(table.empty());
+  CHECK(table.slot_count() >= 100);
+
+  bool inserted = false;
+  table.touch(key_n(1), 10, &inserted) = 7;
+  CHECK(inserted);
+  CHECK(table.touch(key_n(1), 20, &inserted) == 7);
+  CHECK_FALSE(inserted);
+  CHECK(table.size() == 1);
+
+  REQUIRE(table.find(key_n(1)) != nullptr);
+  CHECK(*table.find(key_n(1)) == 7);
+  CHECK(table.find(key_n(2)) == nullptr);
+
+  CHECK(table.erase(key_n(1)));
+  CHECK_FALSE(table.erase(key_n(1)));
+  CHECK(table.find(key_n(1)) == nullptr);
+  CHECK(table.empty());
+
+  // Erased values are reset before the slot is reused.
+  CHECK(table.touch(key_n(1), 30) == 0);
+
+  CHECK_THROWS_AS(Table(config(0)), std::invalid_argument);
+}
+
+TEST_CASE("FlowTable - evicts the least recently used flow when full",
+          "[flow_table]") {
+  std::vector<std::pair<uint32_t, EvictReason>> evicted;
+  Table table(config(3), [&evicted](const FlowKey &key, uint64_t &value,
+                                    EvictReason reason) {
+    CHECK(key == key_n(static_cast<uint32_t>(value)));
+    evicted.emplace_back(static_cast<uint32_t>(value), reason);
+  });
+
+  for (uint32_t n = 1; n <= 3; ++n) {
+    table.touch(key_n(n), n) = n;
+  }
+  table.touch(key_n(1), 4); // 2 is now the oldest
+  table.touch(key_n(4), 5) = 4;
+
+  REQUIRE(evicted.size() == 1);
+  CHECK(evicted[0].first == 2);
+  CHECK(evicted[0].second == EvictReason::Capacity);
+  CHECK(table.size() == 3);
+  CHECK(table.capacity_evictions() == 1);
+
+  std::vector<uint64_t> order;
+  table.for_each([&order](const FlowKey &, const uint64_t &value) {
+    order.push_back(value);
+  });
+  CHECK(order == std::vector<uint64_t>{3, 1, 4});
+
+  // Evicting on demand takes the same path.
+  CHECK(table.evict_lru());
+  CHECK(evicted.back() == std::make_pair(3u, EvictReason::Capacity));
+  CHECK(table.size() == 2);
+  table.clear();
+  CHECK_FALSE(table.evict_lru());
+}
+
+TEST_CASE("FlowTable - LRU slack only reorders occasionally", "[flow_table]") {
+  Table table(config(2, 0, 100));
+  table.touch(key_n(1), 0) = 1;
+  table.touch(key_n(2), 10) = 2;
+
+  // Within the slack, touching flow 1 does not move it.
+  table.touch(key_n(1), 50);
+  table.touch(key_n(3), 60) = 3;
+  CHECK(table.find(key_n(1)) == nullptr);
+
+  // Past it, it does.
+  table.touch(key_n(2), 200);
+  table.touch(key_n(4), 210) = 4;
+  CHECK(table.find(key_n(2)) != nullptr);
+  CHECK(table.find(key_n(3)) == nullptr);
+}
+
+TEST_CASE("FlowTable - idle flows time out", "[flow_table]") {
+  std::vector<uint64_t> idle;
+  Table table(config(100, 1000),
+              [&idle](const FlowKey &, uint64_t &value, EvictReason reason) {
+                CHECK(reason == EvictReason::Idle);
+                idle.push_back(value);
+              });
+
+  table.touch(key_n(1), 0) = 1;
+  table.touch(key_n(2), 500) = 2;
+  table.touch(key_n(3), 900) = 3;
+
+  // Touching any flow expires the ones idle by then.
+  table.touch(key_n(3), 1200);
+  CHECK(idle == std::vector<uint64_t>{1});
+  CHECK(table.find(key_n(1)) == nullptr);
+
+  CHECK(table.expire(1499) == 0);
+  CHECK(table.expire(10000) == 2);
+  CHECK(idle == std::vector<uint64_t>{1, 2, 3});
+  CHECK(table.empty());
+  CHECK(table.idle_evictions() == 3);
+
+  // A flow idle past the timeout starts over.
+  table.touch(key_n(5), 20000) = 9;
+  CHECK(table.touch(key_n(5), 30000) == 0);
+}
+
+TEST_CASE("FlowTable - matches a reference map under churn",
+          "[flow_table]") {
+  // Small enough for groups to fill up, so tombstones and rehashing are
+  // exercised too.
+  constexpr std::size_t MAX = 200;
+  std::map<uint32_t, uint64_t> reference;
+  std::mt19937 rng(42);
+
+  // Capacity evictions must leave the reference too.
+  Table evicting(config(MAX), [&reference](const FlowKey &key, uint64_t &,
+                                           EvictReason) {
+    reference.erase(key.src_addr[3] | (key.src_addr[2] << 8));
+  });
+
+  for (uint64_t step = 0; step < 200000; ++step) {
+    const uint32_t n = rng() % 600;
+    const FlowKey key = key_n(n);
+    switch (rng() % 3) {
+    case 0:
+      CHECK(evicting.erase(key) == (reference.erase(n) == 1));
+      break;
+    default:
+      evicting.touch(key, step) = step;
+      reference[n] = step;
+      break;
+    }
+    REQUIRE(evicting.size() == reference.size());
+    REQUIRE(evicting.size() <= MAX);
+  }
+  for (const auto &[n, value] : reference) {
+    const uint64_t *found = evicting.find(key_n(n));
+    REQUIRE(found != nullptr);
+    CHECK(*found == value);
+  }
+  std::size_t visited = 0;
+  evicting.for_each([&visited](const FlowKey &, const uint64_t &) {
+    ++visited;
+  });
+  CHECK(visited == reference.size());
+
+  evicting.clear();
+  CHECK(evicting.empty());
+  CHECK(evicting.find(key_n(reference.begin()->first)) == nullptr);
+}
@@ -0,0 +1,85 @@
+#include "decoder.hpp"
+#include "flow_tracker.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv4 / TCP between 192.168.1.1:51000 and 10.0.0.1:80 with
+// `flags` set and `payload` bytes of data
+std::string tcp_frame(bool from_client, uint8_t flags,
+                      std::size_t payload = 0) {
+  TestFrame p;
+  if (!from_client) {
+    std::swap(p.src, p.dst);
+    std::swap(p.src_port, p.dst_port);
+  }
+  p.tcp_flags = flags;
+  p.payload.assign(payload, '\0');
+  return build_frame(p);
+}
+
+} // namespace
+
+TEST_CASE("FlowTracker - both directions share one flow",
+          "[flow_tracker]") {
+  Decoder decoder;
+  LayerStack stack;
+  FlowTracker tracker(FlowTracker::Table::Config{});
+
+  const std::string frames[] = {
+      tcp_frame(true, TCPHeader::FLAG_SYN),
+      tcp_frame(false, TCPHeader::FLAG_SYN | TCPHeader::FLAG_ACK),
+      tcp_frame(true, TCPHeader::FLAG_ACK | TCPHeader::FLAG_PSH, 100)};
+  uint64_t now = 1000;
+  for (const std::string &frame : frames) {
+    REQUIRE(decoder.decode(frame, stack));
+    CHECK(tracker.update(PacketRef{frame, now}, stack));
+    now += 10;
+  }
+
+  REQUIRE(tracker.table().size() == 1);
+  tracker.table().for_each([](const FlowKey &key, const FlowStats &stats) {
+    CHECK(key.dst_addr[0] == 192); // canonical order: 10.0.0.1 first
+    CHECK(stats.packets == 3);
+    CHECK(stats.bytes == 54 + 54 + 154);
+    CHECK(stats.first_seen_ns == 1000);
+    CHECK(stats.last_seen_ns == 1020);
+    CHECK(stats.tcp_flags == (TCPHeader::FLAG_SYN | TCPHeader::FLAG_ACK |
+                              TCPHeader::FLAG_PSH));
+  });
+
+  const std::string arp = arp_frame();
+  REQUIRE(decoder.decode(arp, stack));
+  CHECK_FALSE(tracker.update(PacketRef{arp, now}, stack));
+  CHECK(tracker.table().size() == 1);
+}
+
+TEST_CASE("FlowTracker - finished flows reach the eviction callback",
+          "[flow_tracker]") {
+  Decoder decoder;
+  LayerStack stack;
+  FlowTracker::Table::Config config;
+  config.idle_timeout_ns = 1000;
+  std::vector<FlowStats> finished;
+  FlowTracker tracker(config, [&finished](const FlowKey &, FlowStats &stats,
+                                          EvictReason reason) {
+    CHECK(reason == EvictReason::Idle);
+    finished.push_back(stats);
+  });
+
+  const std::string frame = tcp_frame(true, TCPHeader::FLAG_SYN);
+  REQUIRE(decoder.decode(frame, stack));
+  tracker.update(PacketRef{frame, 0}, stack);
+  tracker.update(PacketRef{frame, 500}, stack);
+  CHECK(tracker.table().expire(1499) == 0);
+  CHECK(tracker.table().expire(1500) == 1);
+
+  REQUIRE(finished.size() == 1);
+  CHECK(finished[0].packets == 2);
+  CHECK(finished[0].first_seen_ns == 0);
+  CHECK(finished[0].last_seen_ns == 500);
+}
@@ -0,0 +1,301 @@
+#include "decoder.hpp"
+#include "fragment_reassembler.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+using Result = FragmentReassembler::Result;
+
+// A TCP segment from port 1234 to 80 carrying `body`
+std::string tcp_segment(const std::string &body) {
+  return tcp_header(1234, 80, 0, 0) + body;
+}
+
+// Fragments of datagram `id` carrying `data` at byte `offset`, IPv4 from
+// 192.168.1.1 to 10.0.0.1 or IPv6 between the matching 2001:db8:: hosts
+TestFrame fragment(const std::string &data) {
+  TestFrame p;
+  p.raw_payload = true;
+  p.payload = data;
+  return p;
+}
+
+std::string ipv4_fragment(uint16_t id, uint16_t offset, bool more,
+                          const std::string &data) {
+  TestFrame p = fragment(data);
+  p.id = id;
+  p.flags_fragment = static_cast<uint16_t>((more ? 0x2000 : 0) | offset / 8);
+  return build_frame(p);
+}
+
+// With `hop_by_hop`, an 8-byte Hop-by-Hop header before the Fragment header
+std::string ipv6_fragment(uint32_t id, uint16_t offset, bool more,
+                          const std::string &data, bool hop_by_hop = false) {
+  TestFrame p = fragment(data);
+  p.ipv6 = true;
+  p.extension_type = IPv6Header::NH_FRAG;
+  p.extensions = ipv6_fragment_header(
+      IPv6Header::NH_TCP, static_cast<uint16_t>(offset / 8), more, id);
+  if (hop_by_hop) {
+    p.extension_type = IPv6Header::NH_HOP_BY_HOP;
+    p.extensions = ipv6_extension_header(IPv6Header::NH_FRAG, 8) +
+                   p.extensions;
+  }
+  return build_frame(p);
+}
+
+struct Fixture {
+  explicit Fixture(FragmentReassembler::Config config = {})
+      : reassembler(config) {}
+
+  Result feed(const std::string &frame, uint64_t now = 0) {
+    decoder.decode(frame, stack);
+    return reassembler.process(PacketRef{frame, now}, stack, reassembled);
+  }
+
+  Decoder decoder;
+  LayerStack stack;
+  FragmentReassembler reassembler;
+  PacketRef reassembled;
+};
+
+// Valid if the one's complement sum of the header, checksum included, is 0.
+bool checksum_ok(std::string_view header) {
+  uint32_t sum = 0;
+  for (std::size_t i = 0; i + 1 < header.length(); i += 2) {
+    sum += (static_cast<uint8_t>(header[i]) << 8) |
+           static_cast<uint8_t>(header[i + 1]);
+  }
+  while (sum > 0xFFFF) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return sum == 0xFFFF;
+}
+
+} // namespace
+
+TEST_CASE("FragmentReassembler - packets that are not fragments pass",
+          "[fragment_reassembler]") {
+  Fixture f;
+  CHECK(f.feed(ipv4_fragment(1, 0, false, tcp_segment("hello"))) ==
+        Result::NotFragment);
+  TestFrame ipv6;
+  ipv6.ipv6 = true;
+  CHECK(f.feed(build_frame(ipv6)) == Result::NotFragment);
+  CHECK(f.feed(arp_frame()) == Result::NotFragment);
+  CHECK(f.reassembler.stats().fragments == 0);
+  CHECK(f.reassembler.datagrams() == 0);
+}
+
+TEST_CASE("FragmentReassembler - IPv4 fragments decode as one TCP segment",
+          "[fragment_reassembler]") {
+  const std::string segment = tcp_segment(std::string(3000, 'x') + "end");
+  Fixture f;
+  const std::string first = ipv4_fragment(7, 0, true, segment.substr(0, 1480));
+  const std::string middle =
+      ipv4_fragment(7, 1480, true, segment.substr(1480, 1480));
+  const std::string last = ipv4_fragment(7, 2960, false, segment.substr(2960));
+
+  CHECK(f.feed(middle) == Result::Held);
+  CHECK(f.stack.get<TCP>() == nullptr);
+  CHECK(f.feed(last) == Result::Held);
+  CHECK(f.reassembler.datagrams() == 1);
+  CHECK(f.reassembler.buffered_bytes() > 0);
+  REQUIRE(f.feed(first, 42) == Result::Complete);
+
+  CHECK(f.reassembled.timestamp_ns == 42);
+  CHECK(f.reassembled.data.length() == 14 + 20 + segment.length());
+  CHECK(f.reassembled.data.substr(34) == segment);
+  CHECK(checksum_ok(f.reassembled.data.substr(14, 20)));
+
+  LayerStack stack;
+  REQUIRE(f.decoder.decode(f.reassembled.data, stack));
+  const IPv4Header *ip = stack.get<IPv4>();
+  REQUIRE(ip != nullptr);
+  CHECK(ip->total_length == 20 + segment.length());
+  CHECK_FALSE(ip->more_fragments);
+  CHECK(ip->fragment_offset == 0);
+  const TCPHeader *tcp = stack.get<TCP>();
+  REQUIRE(tcp != nullptr);
+  CHECK(tcp->dst_port == 80);
+  CHECK(LayerStack::layer_payload(f.reassembled.data, *stack.entry<TCP>())
+            .length() == 3003);
+
+  CHECK(f.reassembler.datagrams() == 0);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+  CHECK(f.reassembler.stats().fragments == 3);
+  CHECK(f.reassembler.stats().reassembled == 1);
+}
+
+TEST_CASE("FragmentReassembler - IPv6 drops the fragment header",
+          "[fragment_reassembler]") {
+  const std::string segment = tcp_segment(std::string(100, 'y'));
+  Fixture f;
+  CHECK(f.feed(ipv6_fragment(0x12345678, 0, true, segment.substr(0, 64))) ==
+        Result::Held);
+  REQUIRE(f.feed(ipv6_fragment(0x12345678, 64, false, segment.substr(64))) ==
+          Result::Complete);
+
+  CHECK(f.reassembled.data.length() == 14 + 40 + segment.length());
+  CHECK(f.reassembled.data.substr(54) == segment);
+  LayerStack stack;
+  REQUIRE(f.decoder.decode(f.reassembled.data, stack));
+  const IPv6Header *ip = stack.get<IPv6>();
+  REQUIRE(ip != nullptr);
+  CHECK(ip->next_header == 6);
+  CHECK(ip->payload_length == segment.length());
+  REQUIRE(stack.get<TCP>() != nullptr);
+  CHECK(stack.get<TCP>()->src_port == 1234);
+}
+
+TEST_CASE("FragmentReassembler - IPv6 keeps the unfragmentable part",
+          "[fragment_reassembler]") {
+  const std::string segment = tcp_segment(std::string(100, 'h'));
+  Fixture f;
+  CHECK(f.feed(ipv6_fragment(9, 64, false, segment.substr(64), true)) ==
+        Result::Held);
+  REQUIRE(f.feed(ipv6_fragment(9, 0, true, segment.substr(0, 64), true)) ==
+          Result::Complete);
+
+  CHECK(f.reassembled.data.length() == 14 + 40 + 8 + segment.length());
+  CHECK(f.reassembled.data.substr(62) == segment);
+  LayerStack stack;
+  REQUIRE(f.decoder.decode(f.reassembled.data, stack));
+  const IPv6Header *ip = stack.get<IPv6>();
+  REQUIRE(ip != nullptr);
+  CHECK(ip->next_header == IPv6Header::NH_HOP_BY_HOP);
+  CHECK(ip->payload_length == 8 + segment.length());
+  CHECK(ip->upper_protocol == 6);
+  CHECK(ip->extension_length == 8);
+  CHECK_FALSE(ip->fragmented);
+  REQUIRE(stack.get<TCP>() != nullptr);
+  CHECK(stack.get<TCP>()->src_port == 1234);
+}
+
+TEST_CASE("FragmentReassembler - datagrams are keyed on addresses and id",
+          "[fragment_reassembler]") {
+  Fixture f;
+  CHECK(f.feed(ipv4_fragment(1, 0, true, std::string(8, 'a'))) ==
+        Result::Held);
+  CHECK(f.feed(ipv4_fragment(2, 8, false, "bb")) == Result::Held);
+  std::string other = ipv4_fragment(1, 8, false, "cc");
+  other[33] = 2; // another destination
+  CHECK(f.feed(other) == Result::Held);
+  CHECK(f.reassembler.datagrams() == 3);
+
+  REQUIRE(f.feed(ipv4_fragment(1, 8, false, "dd")) == Result::Complete);
+  CHECK(f.reassembled.data.substr(34) == "aaaaaaaadd");
+  CHECK(f.reassembler.datagrams() == 2);
+}
+
+TEST_CASE("FragmentReassembler - overlapping fragments",
+          "[fragment_reassembler]") {
+  Fixture f;
+  const std::string data(24, 'z');
+  CHECK(f.feed(ipv4_fragment(3, 0, true, data.substr(0, 16))) ==
+        Result::Held);
+
+  SECTION("an exact repeat is ignored") {
+    CHECK(f.feed(ipv4_fragment(3, 0, true, data.substr(0, 16))) ==
+          Result::Held);
+    CHECK(f.feed(ipv4_fragment(3, 8, true, data.substr(0, 8))) ==
+          Result::Held);
+    CHECK(f.reassembler.stats().overlaps == 2);
+    CHECK(f.feed(ipv4_fragment(3, 16, false, data.substr(16))) ==
+          Result::Complete);
+  }
+
+  SECTION("any other overlap drops the datagram") {
+    CHECK(f.feed(ipv4_fragment(3, 8, false, data.substr(8))) ==
+          Result::Dropped);
+    CHECK(f.reassembler.stats().overlaps == 1);
+    CHECK(f.reassembler.datagrams() == 0);
+    CHECK(f.reassembler.buffered_bytes() == 0);
+  }
+}
+
+TEST_CASE("FragmentReassembler - invalid fragments drop their datagram",
+          "[fragment_reassembler]") {
+  Fixture f;
+  CHECK(f.feed(ipv4_fragment(4, 0, true, std::string(16, 'a'))) ==
+        Result::Held);
+
+  SECTION("a middle fragment that is not a multiple of 8 bytes") {
+    CHECK(f.feed(ipv4_fragment(4, 16, true, "odd")) == Result::Dropped);
+  }
+  SECTION("past the end of the payload") {
+    CHECK(f.feed(ipv4_fragment(4, 65528, false, std::string(16, 'b'))) ==
+          Result::Dropped);
+  }
+  SECTION("two different ends") {
+    CHECK(f.feed(ipv4_fragment(4, 32, false, "end")) == Result::Held);
+    CHECK(f.feed(ipv4_fragment(4, 40, false, "end")) == Result::Dropped);
+  }
+  SECTION("data beyond the end") {
+    CHECK(f.feed(ipv4_fragment(4, 8, false, "")) == Result::Dropped);
+  }
+
+  CHECK(f.reassembler.stats().invalid == 1);
+  CHECK(f.reassembler.datagrams() == 0);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("FragmentReassembler - idle datagrams time out",
+          "[fragment_reassembler]") {
+  FragmentReassembler::Config config;
+  config.timeout_ns = 1000;
+  Fixture f(config);
+  CHECK(f.feed(ipv4_fragment(5, 0, true, std::string(8, 'a')), 0) ==
+        Result::Held);
+  CHECK(f.feed(ipv4_fragment(6, 0, true, std::string(8, 'a')), 600) ==
+        Result::Held);
+
+  CHECK(f.reassembler.expire(1200) == 1);
+  CHECK(f.reassembler.stats().timeouts == 1);
+  // The rest of datagram 5 starts a new one; 6 still completes.
+  CHECK(f.feed(ipv4_fragment(5, 8, false, "b"), 1300) == Result::Held);
+  CHECK(f.feed(ipv4_fragment(6, 8, false, "b"), 1300) == Result::Complete);
+
+  f.reassembler.clear();
+  CHECK(f.reassembler.datagrams() == 0);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("FragmentReassembler - memory cap drops the oldest datagrams",
+          "[fragment_reassembler]") {
+  FragmentReassembler::Config config;
+  config.memory_cap = 2 * FragmentReassembler::CHUNK_SIZE;
+  Fixture f(config);
+  const std::string data(1480, 'm');
+  CHECK(f.feed(ipv4_fragment(10, 0, true, data), 1) == Result::Held);
+  CHECK(f.feed(ipv4_fragment(11, 0, true, data), 2) == Result::Held);
+  CHECK(f.reassembler.buffered_bytes() == config.memory_cap);
+
+  // Datagram 10 is the oldest and makes room for 12.
+  CHECK(f.feed(ipv4_fragment(12, 0, true, data), 3) == Result::Held);
+  CHECK(f.reassembler.stats().cap_hits == 1);
+  CHECK(f.reassembler.stats().evictions == 1);
+  CHECK(f.reassembler.datagrams() == 2);
+
+  // A datagram that alone needs more than the cap is dropped.
+  f.reassembler.clear();
+  CHECK(f.feed(ipv4_fragment(13, 0, true, data), 4) == Result::Held);
+  CHECK(f.feed(ipv4_fragment(13, 1480, true, std::string(4096, 'm')), 5) ==
+        Result::Dropped);
+  CHECK(f.reassembler.stats().cap_hits == 2);
+  CHECK(f.reassembler.datagrams() == 0);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("FragmentReassembler - rejects a memory cap below one chunk",
+          "[fragment_reassembler]") {
+  FragmentReassembler::Config config;
+  config.memory_cap = FragmentReassembler::CHUNK_SIZE - 1;
+  CHECK_THROWS_AS(FragmentReassembler(config), std::invalid_argument);
+  config = {};
+  config.max_datagrams = 0;
+  CHECK_THROWS_AS(FragmentReassembler(config), std::invalid_argument);
+}
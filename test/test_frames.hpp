@@ -0,0 +1,149 @@
+#pragma once
+#include "checksum.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Ethernet frames for the tests, described field by field.
+ *
+ * The defaults are a TCP SYN from 192.168.1.1:51000 to 10.0.0.1:80 with no
+ * payload. IPv6 frames use 2001:db8::<src> and 2001:db8::<dst>, with `src`
+ * and `dst` as the low 32 bits. Lengths are always consistent; checksums
+ * are left zero unless `checksums` is set (IPv4 only).
+ */
+struct TestFrame {
+  bool ipv6 = false;
+  uint32_t src = 0xC0A80101; // 192.168.1.1
+  uint32_t dst = 0x0A000001; // 10.0.0.1
+  // IPv4 protocol, or the IPv6 next header after any extension headers
+  uint8_t protocol = 6;
+  uint8_t ttl = 64;            // or hop limit
+  uint16_t id = 0;             // IPv4 identification
+  uint16_t flags_fragment = 0; // IPv4 flags and fragment offset
+  // IPv6 extension headers, the first of type `extension_type`. The first
+  // byte of each names the one after it.
+  uint8_t extension_type = 0;
+  std::string extensions;
+
+  // A 20-byte TCP or 8-byte UDP header, unless `raw_payload` is set: then
+  // `payload` is all of the IP payload (say, a later fragment).
+  bool raw_payload = false;
+  uint16_t src_port = 51000;
+  uint16_t dst_port = 80;
+  uint32_t seq = 0;
+  uint8_t tcp_flags = 0x02; // SYN
+  std::string payload;
+  std::size_t padding = 0; // bytes after the IP packet
+  bool checksums = false;  // IPv4 header and TCP or UDP checksums
+};
+
+// Big-endian stores into a frame under construction
+inline void put16(std::string &f, std::size_t at, uint32_t value) {
+  f[at] = static_cast<char>(value >> 8);
+  f[at + 1] = static_cast<char>(value);
+}
+
+inline void put32(std::string &f, std::size_t at, uint32_t value) {
+  put16(f, at, value >> 16);
+  put16(f, at + 2, value);
+}
+
+// A 20-byte TCP header, without its checksum
+inline std::string tcp_header(uint16_t src_port, uint16_t dst_port,
+                              uint32_t seq = 0, uint8_t flags = 0x02) {
+  std::string h(20, '\0');
+  put16(h, 0, src_port);
+  put16(h, 2, dst_port);
+  put32(h, 4, seq);
+  h[12] = 0x50; // data offset 5
+  h[13] = static_cast<char>(flags);
+  return h;
+}
+
+// A Hop-by-Hop, Routing or Destination Options header of `length` bytes (a
+// multiple of 8)
+inline std::string ipv6_extension_header(uint8_t next_header,
+                                         std::size_t length) {
+  std::string e(length, '\0');
+  e[0] = static_cast<char>(next_header);
+  e[1] = static_cast<char>(length / 8 - 1);
+  return e;
+}
+
+// An IPv6 Fragment header; `offset` is in 8-byte units.
+inline std::string ipv6_fragment_header(uint8_t next_header,
+                                        uint16_t offset, bool more,
+                                        uint32_t id = 0) {
+  std::string e(8, '\0');
+  e[0] = static_cast<char>(next_header);
+  put16(e, 2, static_cast<uint32_t>(offset << 3 | (more ? 1 : 0)));
+  put32(e, 4, id);
+  return e;
+}
+
+inline std::string build_frame(const TestFrame &p) {
+  std::string l4;
+  if (p.raw_payload) {
+    l4 = p.payload;
+  } else if (p.protocol == 6) {
+    l4 = tcp_header(p.src_port, p.dst_port, p.seq, p.tcp_flags) + p.payload;
+  } else if (p.protocol == 17) {
+    l4 = std::string(8, '\0') + p.payload;
+    put16(l4, 0, p.src_port);
+    put16(l4, 2, p.dst_port);
+    put16(l4, 4, static_cast<uint32_t>(l4.length()));
+  } else {
+    l4 = p.payload;
+  }
+
+  std::string f(14, '\0');
+  if (p.ipv6) {
+    put16(f, 12, 0x86DD);
+    std::string h(40, '\0');
+    h[0] = 0x60;
+    put16(h, 4, static_cast<uint32_t>(p.extensions.length() + l4.length()));
+    h[6] = static_cast<char>(p.extensions.empty() ? p.protocol
+                                                  : p.extension_type);
+    h[7] = static_cast<char>(p.ttl);
+    put32(h, 8, 0x20010db8);
+    put32(h, 20, p.src);
+    put32(h, 24, 0x20010db8);
+    put32(h, 36, p.dst);
+    f += h + p.extensions;
+  } else {
+    put16(f, 12, 0x0800);
+    std::string h(20, '\0');
+    h[0] = 0x45;
+    put16(h, 2, static_cast<uint32_t>(20 + l4.length()));
+    put16(h, 4, p.id);
+    put16(h, 6, p.flags_fragment);
+    h[8] = static_cast<char>(p.ttl);
+    h[9] = static_cast<char>(p.protocol);
+    put32(h, 12, p.src);
+    put32(h, 16, p.dst);
+    if (p.checksums) {
+      Checksum ip;
+      ip.add(h);
+      put16(h, 10, ip.checksum());
+      if (!p.raw_payload && (p.protocol == 6 || p.protocol == 17)) {
+        std::string pseudo = h.substr(12, 8) + std::string(4, '\0');
+        pseudo[9] = static_cast<char>(p.protocol);
+        put16(pseudo, 10, static_cast<uint32_t>(l4.length()));
+        Checksum l4_sum;
+        l4_sum.add(pseudo);
+        l4_sum.add(l4);
+        put16(l4, p.protocol == 6 ? 16 : 6, l4_sum.checksum());
+      }
+    }
+    f += h;
+  }
+  return f + l4 + std::string(p.padding, '\0');
+}
+
+// Ethernet carrying ARP, padded to the 60-byte minimum
+inline std::string arp_frame() {
+  std::string f(60, '\0');
+  put16(f, 12, 0x0806);
+  return f;
+}
@@ -0,0 +1,378 @@
+#include "protocols/http.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Copies what the parser reports, since its views do not outlive a call.
+struct Recorder : HttpParser::Handler {
+  struct Message {
+    bool is_request = true;
+    std::string method, uri, version, reason;
+    uint16_t status = 0;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string host, content_type, user_agent;
+    std::string body;
+    bool complete = false;
+  };
+
+  void on_message(const HttpMessage &message) override {
+    Message copy;
+    copy.is_request = message.is_request;
+    copy.method = std::string(message.method);
+    copy.uri = std::string(message.uri);
+    copy.version = std::string(message.http_version);
+    copy.reason = std::string(message.reason_phrase);
+    copy.status = message.status_code;
+    for (std::size_t i = 0; i < message.header_count(); ++i) {
+      const HttpHeaderField field = message.header(i);
+      copy.headers.emplace_back(field.name, field.value);
+    }
+    copy.host = std::string(message.host());
+    copy.content_type = std::string(message.content_type());
+    copy.user_agent = std::string(message.get_header("USER-AGENT"));
+    messages.push_back(copy);
+  }
+  void on_body(std::string_view data) override {
+    messages.back().body += std::string(data);
+    body_views.push_back(data.data());
+  }
+  void on_message_complete() override { messages.back().complete = true; }
+
+  std::vector<Message> messages;
+  std::vector<const char *> body_views;
+};
+
+// Feeds `stream` in pieces of `step` bytes.
+bool feed_in_pieces(HttpParser &parser, Recorder &recorder,
+                    std::string_view stream, std::size_t step) {
+  bool ok = true;
+  for (std::size_t i = 0; i < stream.length(); i += step) {
+    ok = parser.feed(stream.substr(i, step), recorder) && ok;
+  }
+  return ok;
+}
+
+const std::string REQUEST = "GET /index.html?q=1 HTTP/1.1\r\n"
+                            "Host: example.com\r\n"
+                            "User-Agent: curl/8.0\r\n"
+                            "Accept: */*\r\n"
+                            "\r\n";
+
+const std::string RESPONSE = "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: text/plain\r\n"
+                             "Content-Length: 5\r\n"
+                             "\r\n"
+                             "hello";
+
+} // namespace
+
+TEST_CASE("HTTP parser reads a request head in place", "[http]") {
+  HttpParser parser;
+  Recorder recorder;
+  REQUIRE(parser.feed(REQUEST, recorder));
+
+  REQUIRE(recorder.messages.size() == 1);
+  const Recorder::Message &message = recorder.messages[0];
+  CHECK(message.is_request);
+  CHECK(message.method == "GET");
+  CHECK(message.uri == "/index.html?q=1");
+  CHECK(message.version == "HTTP/1.1");
+  CHECK(message.host == "example.com");
+  CHECK(message.user_agent == "curl/8.0");
+  REQUIRE(message.headers.size() == 3);
+  CHECK(message.headers[2].first == "Accept");
+  CHECK(message.headers[2].second == "*/*");
+  CHECK(message.body.empty());
+  CHECK(message.complete);
+  CHECK(parser.messages() == 1);
+  CHECK_FALSE(parser.in_message());
+}
+
+TEST_CASE("HTTP message views point into the fed bytes", "[http]") {
+  struct ViewCheck : HttpParser::Handler {
+    void on_message(const HttpMessage &message) override {
+      head = message.head;
+      host = message.get(HttpField::Host);
+      missing = message.get_header("X-Missing");
+    }
+    std::string_view head, host, missing;
+  } handler;
+
+  HttpParser parser;
+  REQUIRE(parser.feed(REQUEST, handler));
+  CHECK(handler.head.data() == REQUEST.data());
+  CHECK(handler.head.length() == REQUEST.length());
+  CHECK(handler.host.data() == REQUEST.data() + REQUEST.find("example"));
+  CHECK(handler.missing.empty());
+}
+
+TEST_CASE("HTTP parser reads a response with Content-Length", "[http]") {
+  HttpParser parser;
+  Recorder recorder;
+  REQUIRE(parser.feed(RESPONSE, recorder));
+
+  REQUIRE(recorder.messages.size() == 1);
+  const Recorder::Message &message = recorder.messages[0];
+  CHECK_FALSE(message.is_request);
+  CHECK(message.status == 200);
+  CHECK(message.reason == "OK");
+  CHECK(message.content_type == "text/plain");
+  CHECK(message.body == "hello");
+  CHECK(message.complete);
+  // The body is handed over without a copy.
+  REQUIRE(recorder.body_views.size() == 1);
+  CHECK(recorder.body_views[0] == RESPONSE.data() + RESPONSE.find("hello"));
+}
+
+TEST_CASE("HTTP parser gives the same result for any split", "[http]") {
+  const std::string stream = REQUEST + RESPONSE + "\r\n" + REQUEST;
+  HttpParser whole_parser;
+  Recorder whole;
+  REQUIRE(whole_parser.feed(stream, whole));
+  REQUIRE(whole.messages.size() == 3);
+
+  for (const std::size_t step : {1, 2, 3, 7, 16, 31}) {
+    HttpParser parser;
+    Recorder pieces;
+    REQUIRE(feed_in_pieces(parser, pieces, stream, step));
+    REQUIRE(pieces.messages.size() == 3);
+    for (std::size_t i = 0; i < 3; ++i) {
+      CHECK(pieces.messages[i].method == whole.messages[i].method);
+      CHECK(pieces.messages[i].uri == whole.messages[i].uri);
+      CHECK(pieces.messages[i].status == whole.messages[i].status);
+      CHECK(pieces.messages[i].headers == whole.messages[i].headers);
+      CHECK(pieces.messages[i].body == whole.messages[i].body);
+      CHECK(pieces.messages[i].complete);
+    }
+  }
+}
+
+TEST_CASE("HTTP parser handles pipelined requests", "[http]") {
+  const std::string post = "POST /api HTTP/1.1\r\n"
+                           "Host: a\r\n"
+                           "Content-Length: 3\r\n"
+                           "\r\n"
+                           "abc";
+  HttpParser parser;
+  Recorder recorder;
+  REQUIRE(parser.feed(post + REQUEST + post, recorder));
+
+  REQUIRE(recorder.messages.size() == 3);
+  CHECK(recorder.messages[0].method == "POST");
+  CHECK(recorder.messages[0].body == "abc");
+  CHECK(recorder.messages[1].method == "GET");
+  CHECK(recorder.messages[1].body.empty());
+  CHECK(recorder.messages[2].body == "abc");
+  CHECK(parser.messages() == 3);
+}
+
+TEST_CASE("HTTP parser decodes chunked bodies", "[http]") {
+  const std::string stream = "HTTP/1.1 200 OK\r\n"
+                             "Transfer-Encoding: gzip, chunked\r\n"
+                             "Content-Length: 999\r\n"
+                             "\r\n"
+                             "5\r\nhello\r\n"
+                             "1A;name=value\r\n"
+                             "abcdefghijklmnopqrstuvwxyz\r\n"
+                             "0\r\n"
+                             "Trailer: x\r\n"
+                             "\r\n" +
+                             RESPONSE;
+
+  for (const std::size_t step : {stream.length(), std::size_t{1},
+                                 std::size_t{4}}) {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(feed_in_pieces(parser, recorder, stream, step));
+    REQUIRE(recorder.messages.size() == 2);
+    // Transfer-Encoding wins over Content-Length.
+    CHECK(recorder.messages[0].body == "helloabcdefghijklmnopqrstuvwxyz");
+    CHECK(recorder.messages[0].complete);
+    CHECK(recorder.messages[1].body == "hello");
+  }
+}
+
+TEST_CASE("HTTP responses without framing", "[http]") {
+  SECTION("204 and 304 have no body") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(parser.feed("HTTP/1.1 204 No Content\r\n\r\n"
+                        "HTTP/1.1 304 Not Modified\r\nContent-Length: 10\r\n"
+                        "\r\n" +
+                            RESPONSE,
+                        recorder));
+    REQUIRE(recorder.messages.size() == 3);
+    CHECK(recorder.messages[0].complete);
+    CHECK(recorder.messages[1].body.empty());
+    CHECK(recorder.messages[2].body == "hello");
+  }
+
+  SECTION("The body runs until the connection closes") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(parser.feed("HTTP/1.0 200 OK\r\n\r\nsome", recorder));
+    REQUIRE(parser.feed(" data", recorder));
+    REQUIRE(recorder.messages.size() == 1);
+    CHECK_FALSE(recorder.messages[0].complete);
+    CHECK(parser.in_message());
+
+    parser.finish(recorder);
+    CHECK(recorder.messages[0].body == "some data");
+    CHECK(recorder.messages[0].complete);
+  }
+}
+
+TEST_CASE("HTTP parser header lookups", "[http]") {
+  struct Lookup : HttpParser::Handler {
+    void on_message(const HttpMessage &message) override {
+      first_cookie = std::string(message.get(HttpField::Cookie));
+      custom = std::string(message.get_header("x-custom"));
+      host = std::string(message.get_header("hOsT"));
+      empty = std::string(message.get_header("X-Empty"));
+      count = message.header_count();
+    }
+    std::string first_cookie, custom, host, empty;
+    std::size_t count = 0;
+  } lookup;
+
+  HttpParser parser;
+  REQUIRE(parser.feed("GET / HTTP/1.1\r\n"
+                      "HOST:   spaced.example  \r\n"
+                      "Cookie: a=1\r\n"
+                      "Cookie: b=2\r\n"
+                      "X-Custom:\tvalue\r\n"
+                      "X-Empty:\r\n"
+                      "\r\n",
+                      lookup));
+  CHECK(lookup.host == "spaced.example");
+  CHECK(lookup.first_cookie == "a=1");
+  CHECK(lookup.custom == "value");
+  CHECK(lookup.empty.empty());
+  CHECK(lookup.count == 5);
+}
+
+TEST_CASE("HTTP parser accepts bare LF line endings", "[http]") {
+  HttpParser parser;
+  Recorder recorder;
+  REQUIRE(parser.feed("GET / HTTP/1.0\nHost: lf\n\n", recorder));
+  REQUIRE(recorder.messages.size() == 1);
+  CHECK(recorder.messages[0].host == "lf");
+  CHECK(recorder.messages[0].version == "HTTP/1.0");
+}
+
+TEST_CASE("HTTP parser rejects malformed streams", "[http]") {
+  using Error = HttpParser::Error;
+  const auto error_for = [](std::string_view stream) {
+    HttpParser parser;
+    Recorder recorder;
+    const bool ok = parser.feed(stream, recorder);
+    CHECK(ok == (parser.error() == Error::None));
+    return parser.error();
+  };
+
+  CHECK(error_for("\x16\x03\x01\x02\x00") == Error::BadStartLine);
+  CHECK(error_for("GET /\r\n\r\n") == Error::BadStartLine);
+  CHECK(error_for("GET / FTP/1.0\r\n\r\n") == Error::BadStartLine);
+  CHECK(error_for("HTTP/1.1 2x0 OK\r\n\r\n") == Error::BadStartLine);
+  CHECK(error_for("GET / HTTP/1.1\r\nno colon\r\n\r\n") == Error::BadHeader);
+  CHECK(error_for("GET / HTTP/1.1\r\nBad Name: x\r\n\r\n") ==
+        Error::BadHeader);
+  CHECK(error_for("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") ==
+        Error::BadContentLength);
+  CHECK(error_for("POST / HTTP/1.1\r\nContent-Length: 1\r\n"
+                  "Content-Length: 2\r\n\r\n") == Error::BadContentLength);
+  CHECK(error_for("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "zz\r\n") == Error::BadChunk);
+  CHECK(error_for(REQUEST) == Error::None);
+
+  std::string many = "GET / HTTP/1.1\r\n";
+  for (std::size_t i = 0; i <= HttpMessage::MAX_HEADERS; ++i) {
+    many += "X-" + std::to_string(i) + ": v\r\n";
+  }
+  CHECK(error_for(many + "\r\n") == Error::TooManyHeaders);
+
+  SECTION("A failed parser ignores input until reset") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE_FALSE(parser.feed("\x01\x02\x03", recorder));
+    CHECK_FALSE(parser.feed(REQUEST, recorder));
+    CHECK(recorder.messages.empty());
+    parser.reset();
+    CHECK(parser.feed(REQUEST, recorder));
+    CHECK(recorder.messages.size() == 1);
+  }
+}
+
+TEST_CASE("HTTP parser bounds the head size", "[http]") {
+  const std::string huge = "GET / HTTP/1.1\r\nX-Big: " +
+                           std::string(HttpParser::MAX_HEAD_SIZE, 'a');
+
+  SECTION("In one piece") {
+    HttpParser parser;
+    Recorder recorder;
+    CHECK_FALSE(parser.feed(huge, recorder));
+    CHECK(parser.error() == HttpParser::Error::HeadTooLarge);
+  }
+
+  SECTION("In many pieces") {
+    HttpParser parser;
+    Recorder recorder;
+    CHECK_FALSE(feed_in_pieces(parser, recorder, huge, 1000));
+    CHECK(parser.error() == HttpParser::Error::HeadTooLarge);
+  }
+}
+
+TEST_CASE("HTTP parser skips gaps inside bodies", "[http]") {
+  const std::string head = "POST /upload HTTP/1.1\r\n"
+                           "Content-Length: 10\r\n"
+                           "\r\n";
+  SECTION("Within a Content-Length body") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(parser.feed(head + "abc", recorder));
+    REQUIRE(parser.skip(4, recorder));
+    REQUIRE(parser.feed("hij" + REQUEST, recorder));
+    REQUIRE(recorder.messages.size() == 2);
+    CHECK(recorder.messages[0].body == "abchij");
+    CHECK(recorder.messages[0].complete);
+    CHECK(recorder.messages[1].uri == "/index.html?q=1");
+  }
+
+  SECTION("Within a chunk") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(parser.feed("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+                        "\r\n8\r\nab",
+                        recorder));
+    REQUIRE(parser.skip(5, recorder));
+    REQUIRE(parser.feed("h\r\n0\r\n\r\n", recorder));
+    CHECK(recorder.messages[0].body == "abh");
+    CHECK(recorder.messages[0].complete);
+  }
+
+  SECTION("Across the end of a body") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(parser.feed(head + "abc", recorder));
+    CHECK_FALSE(parser.skip(100, recorder));
+    CHECK(parser.error() == HttpParser::Error::Gap);
+  }
+
+  SECTION("Between messages") {
+    HttpParser parser;
+    Recorder recorder;
+    REQUIRE(parser.feed(REQUEST, recorder));
+    CHECK_FALSE(parser.skip(1, recorder));
+    CHECK(parser.error() == HttpParser::Error::Gap);
+  }
+}
+
+TEST_CASE("HTTP tree node keeps the message fields", "[http]") {
+  HTTP http;
+  http.method = "GET";
+  CHECK(http.get_name() == "HTTP");
+  CHECK(http.header_count() == 0);
+  CHECK(http.host().empty());
+}
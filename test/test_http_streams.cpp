@@ -0,0 +1,188 @@
+#include "http_streams.hpp"
+#include <arpa/inet.h>
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+
+const FlowKey CLIENT(Ipv4Address(htonl(0xC0A80101)), 51000,
+                     Ipv4Address(htonl(0x0A000001)), 80, 6);
+const FlowKey SERVER = CLIENT.reversed();
+
+struct Recorder : HttpStreams::Handler {
+  void on_message(const FlowKey &stream,
+                  const HttpMessage &message) override {
+    events.push_back((stream == CLIENT ? "client " : "server ") +
+                     std::string(message.is_request ? message.uri
+                                                    : message.reason_phrase));
+  }
+  void on_body(const FlowKey &stream, std::string_view data) override {
+    events.push_back((stream == CLIENT ? "client body " : "server body ") +
+                     std::string(data));
+  }
+  void on_message_complete(const FlowKey &stream) override {
+    events.push_back(stream == CLIENT ? "client done" : "server done");
+  }
+  void on_error(const FlowKey &stream, HttpParser::Error error) override {
+    static_cast<void>(stream);
+    errors.push_back(error);
+  }
+
+  std::vector<std::string> events;
+  std::vector<HttpParser::Error> errors;
+};
+
+TCPHeader segment(uint32_t seq, bool syn = false, bool fin = false) {
+  TCPHeader tcp{};
+  tcp.seq_number = seq;
+  tcp.data_offset = 5;
+  tcp.flag_syn = syn;
+  tcp.flag_fin = fin;
+  tcp.flag_ack = !syn;
+  return tcp;
+}
+
+} // namespace
+
+TEST_CASE("HTTP streams parse both directions of a connection",
+          "[http_streams]") {
+  Recorder recorder;
+  HttpStreams http(1024, recorder);
+  TcpReassembler reassembler({}, http);
+
+  reassembler.process(CLIENT, segment(99, true), {}, 0);
+  reassembler.process(SERVER, segment(499, true), {}, 0);
+  // The request arrives in two segments, the second one first.
+  reassembler.process(CLIENT, segment(111), "/1.1\r\nHost: a\r\n\r\n", 1);
+  reassembler.process(CLIENT, segment(100), "GET /x HTTP", 2);
+  reassembler.process(SERVER, segment(500),
+                      "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi", 3);
+
+  const std::vector<std::string> expected = {
+      "client /x", "client done", "server OK", "server body hi",
+      "server done"};
+  CHECK(recorder.events == expected);
+  CHECK(http.messages() == 2);
+  CHECK(http.streams() == 2);
+  CHECK(recorder.errors.empty());
+}
+
+TEST_CASE("HTTP streams finish bodies and drop parsers on close",
+          "[http_streams]") {
+  Recorder recorder;
+  HttpStreams http(1024, recorder);
+  TcpReassembler reassembler({}, http);
+
+  reassembler.process(SERVER, segment(499, true), {}, 0);
+  reassembler.process(SERVER, segment(500), "HTTP/1.0 200 OK\r\n\r\nall", 1);
+  reassembler.process(SERVER, segment(522, false, true), {}, 2);
+
+  const std::vector<std::string> expected = {"server OK", "server body all",
+                                             "server done"};
+  CHECK(recorder.events == expected);
+  CHECK(http.messages() == 1);
+  CHECK(http.streams() == 0);
+}
+
+TEST_CASE("HTTP streams report gaps and non-HTTP streams",
+          "[http_streams]") {
+  Recorder recorder;
+  HttpStreams http(1024, recorder);
+
+  SECTION("A gap inside a body is skipped") {
+    http.on_data(CLIENT, "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\nab");
+    http.on_gap(CLIENT, 2);
+    http.on_data(CLIENT, "ef");
+    CHECK(recorder.events.back() == "client done");
+    CHECK(recorder.errors.empty());
+  }
+
+  SECTION("A gap between messages stops the stream") {
+    http.on_data(CLIENT, "GET / HTTP/1.1\r\n\r\n");
+    http.on_gap(CLIENT, 10);
+    http.on_data(CLIENT, "GET / HTTP/1.1\r\n\r\n");
+    REQUIRE(recorder.errors.size() == 1);
+    CHECK(recorder.errors[0] == HttpParser::Error::Gap);
+    CHECK(http.messages() == 1);
+  }
+
+  SECTION("Non-HTTP data is reported once") {
+    http.on_data(SERVER, "\x16\x03\x01 binary");
+    http.on_data(SERVER, "more");
+    REQUIRE(recorder.errors.size() == 1);
+    CHECK(recorder.errors[0] == HttpParser::Error::BadStartLine);
+    CHECK(http.errors() == 1);
+    http.on_close(SERVER, TcpReassembler::CloseReason::Fin);
+    CHECK(http.streams() == 0);
+  }
+}
+
+TEST_CASE("HTTP streams finish parsers evicted for room",
+          "[http_streams]") {
+  Recorder recorder;
+  HttpStreams http(1, recorder);
+
+  http.on_data(SERVER, "HTTP/1.0 200 OK\r\n\r\nuntil close");
+  // A second stream pushes the server's parser out: its body ends there.
+  http.on_data(CLIENT, "GET / HTTP/1.1\r\n\r\n");
+
+  const std::vector<std::string> expected = {
+      "server OK", "server body until close", "server done", "client /",
+      "client done"};
+  CHECK(recorder.events == expected);
+  CHECK(http.messages() == 2);
+  CHECK(http.evicted() == 1);
+  CHECK(http.streams() == 1);
+}
+
+TEST_CASE("HTTP streams evict the least recently fed parser",
+          "[http_streams]") {
+  Recorder recorder;
+  HttpStreams http(2, recorder);
+  const FlowKey other(Ipv4Address(htonl(0xC0A80102)), 52000,
+                      Ipv4Address(htonl(0x0A000001)), 80, 6);
+  const FlowKey third(Ipv4Address(htonl(0xC0A80103)), 53000,
+                      Ipv4Address(htonl(0x0A000001)), 80, 6);
+
+  http.on_data(CLIENT, "POST / HTTP/1.1\r\nContent-Length: 4\r\n\r\nab");
+  http.on_data(other, "GET / HTTP/1.1\r\n\r\n");
+  http.on_data(CLIENT, "c");
+  // The idle stream makes room, not the one in the middle of a body.
+  http.on_data(third, "GET / HTTP/1.1\r\n\r\n");
+  CHECK(http.evicted() == 1);
+  http.on_data(CLIENT, "d");
+
+  CHECK(recorder.events.back() == "client done");
+  CHECK(recorder.errors.empty());
+  CHECK(http.messages() == 3);
+}
+
+TEST_CASE("HTTP streams frame responses by their request's method",
+          "[http_streams]") {
+  Recorder recorder;
+  HttpStreams http(1024, recorder);
+
+  SECTION("A response to HEAD has no body, whatever its length says") {
+    http.on_data(CLIENT, "HEAD /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\n");
+    http.on_data(SERVER, "HTTP/1.1 200 Head\r\nContent-Length: 100\r\n\r\n"
+                         "HTTP/1.1 200 Get\r\nContent-Length: 2\r\n\r\nhi");
+    const std::vector<std::string> expected = {
+        "client /a",   "client done", "client /b",      "client done",
+        "server Head", "server done", "server Get",     "server body hi",
+        "server done"};
+    CHECK(recorder.events == expected);
+    CHECK(http.messages() == 4);
+    CHECK(recorder.errors.empty());
+  }
+
+  SECTION("An accepted CONNECT turns both sides into a tunnel") {
+    http.on_data(CLIENT, "CONNECT a:443 HTTP/1.1\r\n\r\n");
+    http.on_data(SERVER, "HTTP/1.1 200 Connected\r\n\r\n\x16\x03\x01");
+    http.on_data(CLIENT, "\x16\x03\x01 hello");
+    http.on_data(SERVER, "\x16\x03\x01 hello");
+    CHECK(recorder.events.back() == "server done");
+    CHECK(http.messages() == 2);
+    CHECK(recorder.errors.empty());
+  }
+}
@@ -1,7 +1,15 @@
+#include "types/address_format.hpp"
 #include "types/ipv4_address.hpp"
 #include "types/ipv6_address.hpp"
 #include <arpa/inet.h> // For htonl / inet_pton
+#include <array>
 #include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
 
 TEST_CASE("Ipv4Address - Construction and toString", "[Ipv4Address]") {
 
@@ -118,4 +126,118 @@ TEST_CASE("Ipv6Address - toString caching", "[Ipv6Address]") {
   std::string s2 = ip.toString();
   REQUIRE(s1 == s2);
   REQUIRE(!s1.empty());
-}
\ No newline at end of file
+}
+
+TEST_CASE("Address types are plain values", "[Ipv4Address][Ipv6Address]") {
+  STATIC_REQUIRE(sizeof(Ipv4Address) == 4);
+  STATIC_REQUIRE(sizeof(Ipv6Address) == 16);
+  STATIC_REQUIRE(std::is_trivially_copyable<Ipv4Address>::value);
+  STATIC_REQUIRE(std::is_trivially_copyable<Ipv6Address>::value);
+}
+
+TEST_CASE("Ipv4Address - format_to matches inet_ntop", "[Ipv4Address]") {
+  std::mt19937 rng(4);
+  std::vector<uint32_t> values = {0, 0xFFFFFFFF, 0x0A000001, 0x7F000001,
+                                  0x09636364, 0xC0A80001, 0x01020304};
+  for (int i = 0; i < 10000; ++i) {
+    values.push_back(rng());
+  }
+  for (const uint32_t value : values) {
+    const Ipv4Address ip(htonl(value));
+    struct in_addr addr;
+    addr.s_addr = htonl(value);
+    char expected[INET_ADDRSTRLEN];
+    REQUIRE(inet_ntop(AF_INET, &addr, expected, sizeof(expected)) != nullptr);
+
+    char buf[Ipv4Address::MAX_STRING_LENGTH];
+    char *end = ip.format_to(buf);
+    REQUIRE(std::string(buf, end) == expected);
+    REQUIRE(ip.toString() == expected);
+  }
+}
+
+TEST_CASE("Ipv6Address - format_to matches inet_ntop", "[Ipv6Address]") {
+  const char *const fixed[] = {"::",
+                               "::1",
+                               "1::",
+                               "2001:db8::1",
+                               "2001:db8:0:1:1:1:1:1",
+                               "2001:0:0:1::1",
+                               "1:0:0:2:0:0:0:3",
+                               "fe80::1:2:3:4",
+                               "::ffff:192.168.1.1",
+                               "::192.168.1.1",
+                               "::ffff:0:1.2.3.4",
+                               "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"};
+  std::vector<std::array<uint8_t, 16>> inputs;
+  for (const char *text : fixed) {
+    struct in6_addr addr6;
+    REQUIRE(inet_pton(AF_INET6, text, &addr6) == 1);
+    std::array<uint8_t, 16> bytes;
+    std::memcpy(bytes.data(), addr6.s6_addr, 16);
+    inputs.push_back(bytes);
+  }
+  // Random words, each zero half the time, to cover every run layout.
+  std::mt19937 rng(6);
+  for (int i = 0; i < 20000; ++i) {
+    std::array<uint8_t, 16> bytes{};
+    for (std::size_t w = 0; w < 8; ++w) {
+      const uint32_t word = (rng() & 1) ? 0 : rng() >> (rng() % 16);
+      bytes[2 * w] = static_cast<uint8_t>(word >> 8);
+      bytes[2 * w + 1] = static_cast<uint8_t>(word);
+    }
+    inputs.push_back(bytes);
+  }
+
+  for (const auto &bytes : inputs) {
+    const Ipv6Address ip(bytes.data());
+    char expected[INET6_ADDRSTRLEN];
+    REQUIRE(inet_ntop(AF_INET6, bytes.data(), expected, sizeof(expected)) !=
+            nullptr);
+
+    char buf[Ipv6Address::MAX_STRING_LENGTH];
+    char *end = ip.format_to(buf);
+    REQUIRE(std::string(buf, end) == expected);
+  }
+}
+
+TEST_CASE("Address types hash and order", "[Ipv4Address][Ipv6Address]") {
+  std::vector<Ipv4Address> v4;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    v4.emplace_back(htonl(0x0A000000 + i * 7919));
+  }
+  std::unordered_set<Ipv4Address> v4_set(v4.begin(), v4.end());
+  CHECK(v4_set.size() == v4.size());
+  CHECK(v4_set.count(Ipv4Address(htonl(0x0A000000))) == 1);
+
+  // Numeric order, not byte-wise memory order
+  CHECK(Ipv4Address(htonl(0x09000000)) < Ipv4Address(htonl(0x0A000000)));
+  CHECK(Ipv4Address(htonl(0x0A000001)) < Ipv4Address(htonl(0x0A000100)));
+  CHECK(Ipv4Address(htonl(1)) != Ipv4Address());
+
+  struct in6_addr a;
+  struct in6_addr b;
+  REQUIRE(inet_pton(AF_INET6, "2001:db8::ff", &a) == 1);
+  REQUIRE(inet_pton(AF_INET6, "2001:db8::100", &b) == 1);
+  const Ipv6Address low(a.s6_addr);
+  const Ipv6Address high(b.s6_addr);
+  CHECK(low < high);
+  CHECK_FALSE(high < low);
+  CHECK(low != high);
+  CHECK(std::hash<Ipv6Address>()(low) != std::hash<Ipv6Address>()(high));
+  std::unordered_set<Ipv6Address> v6_set = {low, high, low};
+  CHECK(v6_set.size() == 2);
+}
+
+TEST_CASE("format_addresses writes a list", "[Ipv4Address][Ipv6Address]") {
+  const Ipv4Address v4[] = {Ipv4Address(htonl(0x0A000001)),
+                            Ipv4Address(htonl(0xC0A80101))};
+  char buf[2 * (Ipv4Address::MAX_STRING_LENGTH + 1)];
+  char *end = format_addresses(v4, 2, buf);
+  CHECK(std::string(buf, end) == "10.0.0.1\n192.168.1.1\n");
+
+  const Ipv6Address v6[] = {Ipv6Address(), Ipv6Address()};
+  char buf6[2 * (Ipv6Address::MAX_STRING_LENGTH + 1)];
+  end = format_addresses(v6, 2, buf6, ' ');
+  CHECK(std::string(buf6, end) == ":: :: ");
+}
@@ -0,0 +1,109 @@
+#include "decoder.hpp"
+#include "layer_arena.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv4 / TCP, 192.168.1.1:51000 -> 10.0.0.1:80, no payload
+const unsigned char tcp_packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee,
+    0xff, 0x08, 0x00, 0x45, 0x00, 0x00, 0x28, 0x00, 0x01, 0x00, 0x00,
+    0x40, 0x06, 0x00, 0x00, 0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00,
+    0x01, 0xc7, 0x38, 0x00, 0x50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x50, 0x02, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00};
+
+std::string_view packet_view() {
+  return std::string_view(reinterpret_cast<const char *>(tcp_packet),
+                          sizeof(tcp_packet));
+}
+
+} // namespace
+
+TEST_CASE("LayerPool - slots are recycled", "[LayerArena]") {
+  LayerPool<TCP> pool;
+
+  auto first = pool.make();
+  TCP *address = first.get();
+  CHECK(pool.in_use() == 1);
+  CHECK(pool.capacity() == LayerPool<TCP>::SLAB_SIZE);
+
+  first.reset();
+  CHECK(pool.in_use() == 0);
+
+  // The most recently released slot is handed out again.
+  auto second = pool.make();
+  CHECK(second.get() == address);
+}
+
+TEST_CASE("LayerPool - recycled layers start out clean", "[LayerArena]") {
+  LayerPool<Ethernet> pool;
+
+  {
+    auto eth = pool.make();
+    eth->eth_type = Ethernet::ETH_TYPE_IPV6;
+    eth->raw_payload = "leftover";
+  }
+
+  auto eth = pool.make();
+  CHECK(eth->raw_payload.empty());
+  CHECK(eth->payload == nullptr);
+}
+
+TEST_CASE("LayerArena - payload chain returns every layer", "[LayerArena]") {
+  LayerArena arena;
+
+  {
+    LayerPtr eth = arena.make<Ethernet>();
+    eth->payload = arena.make<IPv4>();
+    eth->payload->payload = arena.make<TCP>();
+    CHECK(arena.in_use() == 3);
+  }
+
+  CHECK(arena.in_use() == 0);
+}
+
+TEST_CASE("Decoder - arena stops growing in steady state", "[LayerArena]") {
+  Decoder decoder;
+
+  // A batch of trees alive at the same time, then dropped.
+  std::vector<LayerPtr> batch;
+  for (int i = 0; i < 256; ++i) {
+    batch.push_back(decoder.decodePacket(packet_view()));
+  }
+  CHECK(decoder.arena().in_use() == 3 * 256);
+  batch.clear();
+  CHECK(decoder.arena().in_use() == 0);
+
+  const std::size_t warmed = decoder.arena().capacity();
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 256; ++i) {
+      batch.push_back(decoder.decodePacket(packet_view()));
+    }
+    batch.clear();
+  }
+  CHECK(decoder.arena().capacity() == warmed);
+}
+
+TEST_CASE("Decoder - reserve pre-sizes the arena", "[LayerArena]") {
+  Decoder decoder;
+  decoder.reserve(128);
+  const std::size_t reserved = decoder.arena().capacity();
+
+  std::vector<LayerPtr> batch;
+  for (int i = 0; i < 128; ++i) {
+    batch.push_back(decoder.decodePacket(packet_view()));
+  }
+  CHECK(decoder.arena().capacity() == reserved);
+}
+
+TEST_CASE("Decoder - handles survive moving the decoder", "[LayerArena]") {
+  Decoder decoder;
+  LayerPtr tree = decoder.decodePacket(packet_view());
+  REQUIRE(tree != nullptr);
+
+  Decoder moved(std::move(decoder));
+  tree.reset(); // Returns the layers to the arena now owned by `moved`
+  CHECK(moved.arena().in_use() == 0);
+}
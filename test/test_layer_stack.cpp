@@ -0,0 +1,137 @@
+#include "decoder.hpp"
+#include "layer_stack.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string_view>
+
+namespace {
+
+// Ethernet / IPv4 / TCP, 192.168.1.1:51000 -> 10.0.0.1:80, payload "hi",
+// followed by two bytes of Ethernet padding
+const unsigned char ipv4_tcp_packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x08, 0x00, 0x45, 0x00, 0x00, 0x2a, 0x00, 0x01, 0x00, 0x00, 0x40, 0x06,
+    0x00, 0x00, 0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00, 0x01, 0xc7, 0x38,
+    0x00, 0x50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x50, 0x02,
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 'h',  'i',  0x00, 0x00};
+
+// Ethernet / IPv6 / TCP, 2001:db8::1:443 -> 2001:db8::2:50000, no payload
+const unsigned char ipv6_tcp_packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x86, 0xdd, 0x60, 0x00, 0x00, 0x00, 0x00, 0x14, 0x06, 0x40, 0x20, 0x01,
+    0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x01, 0xbb, 0xc3, 0x50, 0x00, 0x00,
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x50, 0x11, 0xff, 0xff, 0x00, 0x00,
+    0x00, 0x00};
+
+template <std::size_t N> std::string_view view(const unsigned char (&bytes)[N]) {
+  return std::string_view(reinterpret_cast<const char *>(bytes), N);
+}
+
+} // namespace
+
+TEST_CASE("LayerStack - is cache-line aligned", "[LayerStack]") {
+  CHECK(alignof(LayerStack) == 64);
+  CHECK(sizeof(LayerStack) % 64 == 0);
+}
+
+TEST_CASE("LayerStack - Ethernet/IPv4/TCP", "[LayerStack]") {
+  Decoder decoder;
+  LayerStack stack;
+  const std::string_view packet = view(ipv4_tcp_packet);
+
+  REQUIRE(decoder.decode(packet, stack));
+  REQUIRE(stack.size() == 3);
+  CHECK(stack[0].kind == LayerKind::Ethernet);
+  CHECK(stack[1].kind == LayerKind::IPv4);
+  CHECK(stack[2].kind == LayerKind::TCP);
+
+  SECTION("Typed accessors") {
+    REQUIRE(stack.get<Ethernet>() != nullptr);
+    CHECK(stack.get<Ethernet>()->source_mac == "aa:bb:cc:dd:ee:ff");
+
+    const IPv4Header *ipv4 = stack.get<IPv4>();
+    REQUIRE(ipv4 != nullptr);
+    CHECK(ipv4->source_ip.toString() == "192.168.1.1");
+    CHECK(ipv4->protocol == IPv4::PROTO_TCP);
+
+    const TCPHeader *tcp = stack.get<TCP>();
+    REQUIRE(tcp != nullptr);
+    CHECK(tcp->src_port == 51000);
+    CHECK(tcp->dst_port == 80);
+    CHECK(tcp->is_syn_only());
+
+    CHECK(stack.get<IPv6>() == nullptr);
+  }
+
+  SECTION("Offsets and lengths") {
+    CHECK(stack[0].offset == 0);
+    CHECK(stack[0].length == packet.size());
+    CHECK(stack[1].offset == Ethernet::HEADER_SIZE);
+    CHECK(stack[1].header_length == IPv4::MIN_HEADER_SIZE);
+    CHECK(stack[1].length == 42); // total_length, padding dropped
+    CHECK(stack[2].offset == 34);
+    CHECK(stack[2].header_length == TCP::MIN_HEADER_SIZE);
+    CHECK(stack.payload(packet) == "hi");
+  }
+}
+
+TEST_CASE("LayerStack - Ethernet/IPv6/TCP", "[LayerStack]") {
+  Decoder decoder;
+  LayerStack stack;
+
+  REQUIRE(decoder.decode(view(ipv6_tcp_packet), stack));
+  REQUIRE(stack.size() == 3);
+  CHECK(stack.get<IPv4>() == nullptr);
+
+  const IPv6Header *ipv6 = stack.get<IPv6>();
+  REQUIRE(ipv6 != nullptr);
+  CHECK(ipv6->source_ip.toString() == "2001:db8::1");
+  CHECK(ipv6->dest_ip.toString() == "2001:db8::2");
+  CHECK(ipv6->hop_limit == 64);
+
+  const TCPHeader *tcp = stack.get<TCP>();
+  REQUIRE(tcp != nullptr);
+  CHECK(tcp->src_port == 443);
+  CHECK(tcp->flag_fin);
+  CHECK(tcp->flag_ack);
+  CHECK(stack.payload_length() == 0);
+}
+
+TEST_CASE("LayerStack - truncated layers are left out", "[LayerStack]") {
+  Decoder decoder;
+  LayerStack stack;
+
+  // Cut the packet in the middle of the TCP header.
+  const std::string_view packet = view(ipv4_tcp_packet).substr(0, 40);
+  REQUIRE(decoder.decode(packet, stack));
+  CHECK(stack.size() == 2);
+  CHECK(stack.get<TCP>() == nullptr);
+  CHECK(stack.payload_length() == 6);
+
+  CHECK_FALSE(decoder.decode(packet.substr(0, 10), stack));
+  CHECK(stack.empty());
+}
+
+TEST_CASE("LayerStack - tree adapter matches the flat result", "[LayerStack]") {
+  Decoder decoder;
+  LayerStack stack;
+  const std::string_view packet = view(ipv4_tcp_packet);
+  REQUIRE(decoder.decode(packet, stack));
+
+  LayerPtr tree = decoder.toTree(packet, stack);
+  REQUIRE(tree != nullptr);
+  CHECK(tree->get_name() == "Ethernet II");
+  CHECK(tree->raw_payload.size() == packet.size() - Ethernet::HEADER_SIZE);
+
+  REQUIRE(tree->payload != nullptr);
+  auto *ipv4 = dynamic_cast<IPv4 *>(tree->payload.get());
+  REQUIRE(ipv4 != nullptr);
+  CHECK(ipv4->dest_ip == stack.get<IPv4>()->dest_ip);
+
+  auto *tcp = dynamic_cast<TCP *>(ipv4->payload.get());
+  REQUIRE(tcp != nullptr);
+  CHECK(tcp->seq_number == stack.get<TCP>()->seq_number);
+  CHECK(tcp->raw_payload == "hi");
+  CHECK(tcp->payload == nullptr);
+}
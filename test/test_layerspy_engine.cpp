@@ -0,0 +1,507 @@
+#include "layerspy_engine.hpp"
+#include "flow_hash.hpp"
+#include "test_frames.hpp"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv4 / TCP between 10.0.0.<src> and 10.0.0.<dst>, with valid
+// checksums if `checksums` is set.
+std::string tcp_frame(uint8_t src, uint8_t dst, uint16_t sport,
+                      uint16_t dport, bool checksums = false) {
+  TestFrame p;
+  p.src = 0x0A000000 | src;
+  p.dst = 0x0A000000 | dst;
+  p.src_port = sport;
+  p.dst_port = dport;
+  p.tcp_flags = 0;
+  p.checksums = checksums;
+  return build_frame(p);
+}
+
+// Replays a fixed list of frames, once or forever.
+class FakeSniffer : public Sniffer {
+public:
+  explicit FakeSniffer(std::vector<std::string> frames, bool repeat = false)
+      : m_frames(std::move(frames)), m_repeat(repeat) {}
+
+  int poll(int max_packets, const Callback &callback) override {
+    if (m_interrupted.load() || (!m_repeat && m_next == m_frames.size())) {
+      exhausted.store(true);
+      return -1;
+    }
+    int count = 0;
+    while (count < max_packets && m_next < m_frames.size()) {
+      callback(PacketRef{m_frames[m_next], m_next});
+      ++count;
+      ++m_next;
+      if (m_repeat && m_next == m_frames.size()) {
+        m_next = 0;
+      }
+    }
+    return count;
+  }
+
+  void interrupt() override { m_interrupted.store(true); }
+  void clear_interrupt() override { m_interrupted.store(false); }
+
+  SnifferStats stats() const override { return {}; }
+
+  std::atomic<bool> exhausted{false};
+
+private:
+  std::vector<std::string> m_frames;
+  bool m_repeat;
+  std::size_t m_next = 0;
+  std::atomic<bool> m_interrupted{false};
+};
+
+} // namespace
+
+TEST_CASE("LayerSpyEngine decodes every packet and keeps flows on one worker",
+          "[engine][threads]") {
+  constexpr std::size_t WORKERS = 4;
+  std::vector<std::string> frames;
+  for (uint16_t flow = 0; flow < 200; ++flow) {
+    const uint16_t port = static_cast<uint16_t>(40000 + flow);
+    frames.push_back(tcp_frame(1, 2, port, 80));
+    frames.push_back(tcp_frame(2, 1, 80, port));
+  }
+  frames.push_back("runt");
+
+  // Client port -> workers that saw it, filled without locks: each worker
+  // only touches its own map.
+  std::vector<std::map<uint16_t, int>> seen(WORKERS);
+  std::vector<std::size_t> empty_stacks(WORKERS);
+
+  FakeSniffer sniffer(frames);
+  LayerSpyEngine::Config config;
+  config.workers = WORKERS;
+  LayerSpyEngine engine(sniffer, config,
+                        [&](std::size_t worker, const PacketRef &,
+                            const LayerStack &stack) {
+                          const TCPHeader *tcp = stack.get<TCP>();
+                          if (tcp == nullptr) {
+                            ++empty_stacks[worker];
+                            return;
+                          }
+                          const uint16_t client = tcp->src_port == 80
+                                                      ? tcp->dst_port
+                                                      : tcp->src_port;
+                          ++seen[worker][client];
+                        });
+  engine.start();
+  engine.wait();
+
+  const WorkerStats totals = engine.totals();
+  CHECK(totals.enqueued == frames.size());
+  CHECK(totals.dropped == 0);
+  CHECK(totals.decoded == frames.size() - 1);
+  CHECK(totals.malformed == 1);
+  CHECK(totals.queue_depth == 0);
+
+  std::map<uint16_t, std::size_t> owners;
+  std::size_t busy_workers = 0;
+  for (std::size_t worker = 0; worker < WORKERS; ++worker) {
+    busy_workers += seen[worker].empty() ? 0 : 1;
+    for (const auto &[client, packets] : seen[worker]) {
+      CHECK(packets == 2);
+      ++owners[client];
+    }
+  }
+  CHECK(owners.size() == 200);
+  for (const auto &[client, count] : owners) {
+    CHECK(count == 1);
+  }
+  CHECK(busy_workers > 1);
+}
+
+TEST_CASE("LayerSpyEngine counts drops when a worker falls behind",
+          "[engine][threads]") {
+  std::vector<std::string> frames(500, tcp_frame(1, 2, 1234, 80));
+  FakeSniffer sniffer(frames);
+
+  LayerSpyEngine::Config config;
+  config.workers = 1;
+  config.ring_bytes = 1024; // room for about a dozen frames
+  std::size_t handled = 0;
+  LayerSpyEngine engine(sniffer, config,
+                        [&](std::size_t, const PacketRef &, const LayerStack &) {
+                          // Stall until capture has seen every frame.
+                          while (!sniffer.exhausted.load()) {
+                            std::this_thread::yield();
+                          }
+                          ++handled;
+                        });
+  engine.start();
+  engine.wait();
+
+  const WorkerStats stats = engine.stats(0);
+  CHECK(stats.dropped > 0);
+  CHECK(stats.enqueued + stats.dropped == frames.size());
+  CHECK(handled == stats.enqueued);
+  CHECK(stats.queue_depth == 0);
+}
+
+TEST_CASE("LayerSpyEngine::stop drains queued packets and joins",
+          "[engine][threads]") {
+  FakeSniffer sniffer({tcp_frame(1, 2, 1000, 80), tcp_frame(3, 4, 2000, 443)},
+                      true);
+  LayerSpyEngine::Config config;
+  config.workers = 2;
+  std::atomic<uint64_t> handled{0};
+  LayerSpyEngine engine(
+      sniffer, config,
+      [&](std::size_t, const PacketRef &, const LayerStack &) { ++handled; });
+
+  engine.start();
+  CHECK(engine.running());
+  while (handled.load() < 1000) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  engine.stop();
+  CHECK_FALSE(engine.running());
+
+  const WorkerStats totals = engine.totals();
+  CHECK(totals.enqueued == handled.load());
+  CHECK(totals.decoded == totals.enqueued);
+  CHECK(totals.queue_depth == 0);
+
+  engine.stop(); // idempotent
+
+  // And starts again where it left off.
+  const uint64_t before = handled.load();
+  engine.start();
+  CHECK(engine.running());
+  while (handled.load() < before + 1000) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  engine.stop();
+  CHECK(engine.totals().enqueued == handled.load());
+}
+
+TEST_CASE("LayerSpyEngine can wait for room instead of dropping",
+          "[engine][threads]") {
+  std::vector<std::string> frames(2000, tcp_frame(1, 2, 1234, 80));
+  FakeSniffer sniffer(frames);
+
+  LayerSpyEngine::Config config;
+  config.workers = 1;
+  config.ring_bytes = 1024;
+  config.block_when_full = true;
+  std::size_t handled = 0;
+  LayerSpyEngine engine(
+      sniffer, config,
+      [&](std::size_t, const PacketRef &, const LayerStack &) { ++handled; });
+  engine.start();
+  engine.wait();
+
+  CHECK(engine.stats(0).dropped == 0);
+  CHECK(handled == frames.size());
+}
+
+TEST_CASE("LayerSpyEngine drops packets too long for its rings",
+          "[engine][threads]") {
+  TestFrame jumbo;
+  jumbo.payload = std::string(600, 'x');
+  std::vector<std::string> frames(100, tcp_frame(1, 2, 1234, 80));
+  frames[50] = build_frame(jumbo);
+  FakeSniffer sniffer(frames);
+
+  LayerSpyEngine::Config config;
+  config.workers = 1;
+  config.ring_bytes = 1024; // takes 496-byte packets
+  config.block_when_full = true;
+  std::size_t handled = 0;
+  LayerSpyEngine engine(
+      sniffer, config,
+      [&](std::size_t, const PacketRef &, const LayerStack &) { ++handled; });
+  engine.start();
+  engine.wait();
+
+  const WorkerStats stats = engine.stats(0);
+  CHECK(stats.oversized == 1);
+  CHECK(stats.dropped == 1);
+  CHECK(handled == frames.size() - 1);
+}
+
+TEST_CASE("LayerSpyEngine runs one worker per Sniffer without a ring",
+          "[engine][threads]") {
+  FakeSniffer first(std::vector<std::string>(300, tcp_frame(1, 2, 1000, 80)));
+  FakeSniffer second(std::vector<std::string>(200, tcp_frame(3, 4, 2000, 80)));
+
+  std::vector<std::size_t> handled(2);
+  LayerSpyEngine engine({&first, &second}, LayerSpyEngine::Config{},
+                        [&](std::size_t worker, const PacketRef &,
+                            const LayerStack &stack) {
+                          if (stack.get<TCP>() != nullptr) {
+                            ++handled[worker];
+                          }
+                        });
+  REQUIRE(engine.workers() == 2);
+  engine.start();
+  engine.wait();
+
+  CHECK_FALSE(engine.running());
+  CHECK(handled[0] == 300);
+  CHECK(handled[1] == 200);
+  CHECK(engine.stats(0).enqueued == 300);
+  CHECK(engine.totals().decoded == 500);
+  CHECK(engine.totals().queue_depth == 0);
+}
+
+TEST_CASE("LayerSpyEngine drops packets its filter rejects before decoding",
+          "[engine][threads]") {
+  std::vector<std::string> frames;
+  for (uint16_t i = 0; i < 100; ++i) {
+    frames.push_back(tcp_frame(1, 2, static_cast<uint16_t>(1000 + i),
+                               i % 4 == 0 ? 80 : 443));
+  }
+  FakeSniffer sniffer(frames);
+  const PacketFilter filter("tcp.dst_port == 80");
+
+  LayerSpyEngine::Config config;
+  config.workers = 2;
+  config.filter = &filter;
+  std::atomic<uint64_t> handled{0};
+  LayerSpyEngine engine(sniffer, config,
+                        [&](std::size_t, const PacketRef &,
+                            const LayerStack &stack) {
+                          const TCPHeader *tcp = stack.get<TCP>();
+                          if (tcp != nullptr && tcp->dst_port == 80) {
+                            ++handled;
+                          }
+                        });
+  engine.start();
+  engine.wait();
+
+  const WorkerStats totals = engine.totals();
+  CHECK(handled.load() == 25);
+  CHECK(totals.decoded == 25);
+  CHECK(totals.filtered == 75);
+  CHECK(totals.queue_depth == 0);
+}
+
+TEST_CASE("LayerSpyEngine drops packets its classifier does not keep",
+          "[engine][threads]") {
+  std::vector<std::string> frames;
+  for (uint16_t i = 0; i < 100; ++i) {
+    const uint16_t port = static_cast<uint16_t>(1000 + i);
+    frames.push_back(i % 4 == 0 ? arp_frame()
+                                : tcp_frame(1, 2, port, i % 2 == 0 ? 80 : 443));
+  }
+  PacketClassifier classifier;
+  classifier.monitorPort(80);
+
+  LayerSpyEngine::Config config;
+  config.workers = 2;
+  config.decode_batch = 16;
+  config.classifier = &classifier;
+  config.classify_mask = PacketClassifier::TCP | PacketClassifier::MONITORED;
+  std::atomic<uint64_t> handled{0};
+  const LayerSpyEngine::Handler handler =
+      [&](std::size_t, const PacketRef &, const LayerStack &stack) {
+        const TCPHeader *tcp = stack.get<TCP>();
+        if (tcp != nullptr && tcp->dst_port == 80) {
+          ++handled;
+        }
+      };
+
+  SECTION("in batches drained from the rings") {
+    FakeSniffer sniffer(frames);
+    LayerSpyEngine engine(sniffer, config, handler);
+    engine.start();
+    engine.wait();
+    CHECK(engine.totals().filtered == 75);
+    CHECK(engine.totals().decoded == 25);
+  }
+
+  SECTION("one packet at a time from a worker's own Sniffer") {
+    FakeSniffer sniffer(frames);
+    LayerSpyEngine engine({&sniffer}, config, handler);
+    engine.start();
+    engine.wait();
+    CHECK(engine.totals().filtered == 75);
+    CHECK(engine.totals().decoded == 25);
+  }
+  CHECK(handled.load() == 25);
+}
+
+TEST_CASE("LayerSpyEngine counts packets with bad checksums",
+          "[engine][threads]") {
+  std::vector<std::string> frames;
+  for (uint16_t i = 0; i < 100; ++i) {
+    std::string frame =
+        tcp_frame(1, 2, static_cast<uint16_t>(1000 + i), 80, true);
+    if (i % 10 == 0) {
+      frame[40] = static_cast<char>(frame[40] ^ 0x10); // sequence number
+    }
+    frames.push_back(frame);
+  }
+
+  for (bool verify : {false, true}) {
+    FakeSniffer sniffer(frames);
+    LayerSpyEngine::Config config;
+    config.workers = 2;
+    config.verify_checksums = verify;
+    std::atomic<uint64_t> handled{0};
+    LayerSpyEngine engine(
+        sniffer, config,
+        [&](std::size_t, const PacketRef &, const LayerStack &) {
+          ++handled;
+        });
+    engine.start();
+    engine.wait();
+
+    // Bad packets are counted, not dropped.
+    const WorkerStats totals = engine.totals();
+    CHECK(handled.load() == 100);
+    CHECK(totals.decoded == 100);
+    CHECK(totals.bad_checksums == (verify ? 10 : 0));
+  }
+}
+
+TEST_CASE("LayerSpyEngine sheds whole flows when a worker falls behind",
+          "[engine][threads]") {
+  std::vector<std::string> frames;
+  for (int round = 0; round < 40; ++round) {
+    for (uint16_t flow = 0; flow < 256; ++flow) {
+      frames.push_back(tcp_frame(1, 2, static_cast<uint16_t>(1000 + flow),
+                                 80));
+    }
+  }
+  FakeSniffer sniffer(frames);
+
+  LayerSpyEngine::Config config;
+  config.workers = 1;
+  config.ring_bytes = 64 * 1024;
+  config.shed_load = true;
+  config.shedding.queue_high = 0.25;
+  config.shedding.queue_low = 0.05;
+  config.shedding.latency_high_ns = 1000ULL * 1000000ULL;
+  config.shedding.latency_low_ns = 100ULL * 1000000ULL;
+  config.shedding.max_rate = 16;
+  config.shedding.hold_ns = 1000000;
+  std::size_t handled = 0;
+  std::size_t sampled = 0;
+  std::size_t inconsistent = 0;
+  LayerSpyEngine engine(
+      sniffer, config,
+      [&](std::size_t, const PacketRef &packet, const LayerStack &) {
+        // Slow until capture has seen every frame
+        if (!sniffer.exhausted.load()) {
+          std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+        ++handled;
+        sampled += packet.sample_rate > 1 ? 1 : 0;
+        inconsistent += LoadShedder::kept(symmetric_flow_hash(packet.data),
+                                          packet.sample_rate)
+                            ? 0
+                            : 1;
+      });
+  engine.start();
+  engine.wait();
+
+  const WorkerStats stats = engine.stats(0);
+  CHECK(stats.shed > 0);
+  CHECK(stats.sample_rate > 1);
+  CHECK(stats.enqueued + stats.dropped + stats.shed == frames.size());
+  CHECK(handled == stats.enqueued);
+  CHECK(sampled > 0);
+  CHECK(inconsistent == 0);
+
+  // Shedding settings are checked up front.
+  config.shedding.max_rate = 3;
+  CHECK_THROWS_AS(LayerSpyEngine(sniffer, config, {}), std::invalid_argument);
+}
+
+TEST_CASE("LayerSpyEngine judges load by packet age with its own Sniffers",
+          "[engine][threads]") {
+  std::vector<std::string> frames;
+  for (uint16_t flow = 0; flow < 1000; ++flow) {
+    frames.push_back(tcp_frame(1, 2, static_cast<uint16_t>(1000 + flow), 80));
+  }
+  // Timestamped near the epoch, so every packet looks long overdue
+  FakeSniffer sniffer(frames);
+  LayerSpyEngine::Config config;
+  config.shed_load = true;
+  config.shedding.hold_ns = 0;
+  std::size_t inconsistent = 0;
+  LayerSpyEngine engine({&sniffer}, config,
+                        [&](std::size_t, const PacketRef &packet,
+                            const LayerStack &) {
+                          inconsistent +=
+                              LoadShedder::kept(
+                                  symmetric_flow_hash(packet.data),
+                                  packet.sample_rate)
+                                  ? 0
+                                  : 1;
+                        });
+  engine.start();
+  engine.wait();
+
+  const WorkerStats stats = engine.stats(0);
+  CHECK(stats.shed > 0);
+  CHECK(stats.sample_rate > 1);
+  // Shed packets are neither enqueued nor handled, as with a shared capture.
+  CHECK(stats.enqueued + stats.shed == frames.size());
+  CHECK(stats.decoded == stats.enqueued);
+  CHECK(inconsistent == 0);
+}
+
+TEST_CASE("LayerSpyEngine sheds IPv6 packets with extension headers by flow",
+          "[engine][threads]") {
+  // The same TCP flows over IPv6, each packet sent once bare and once
+  // behind a Hop-by-Hop header, after enough traffic to reach max_rate.
+  TestFrame p;
+  p.ipv6 = true;
+  p.src = 1;
+  p.dst = 2;
+  p.tcp_flags = 0;
+  std::vector<std::string> frames;
+  for (uint16_t flow = 0; flow < 256; ++flow) {
+    p.src_port = static_cast<uint16_t>(60000 + flow);
+    frames.push_back(build_frame(p));
+  }
+  for (uint16_t flow = 0; flow < 2000; ++flow) {
+    p.src_port = static_cast<uint16_t>(1000 + flow);
+    p.extensions.clear();
+    frames.push_back(build_frame(p));
+    p.extension_type = 0; // Hop-by-Hop
+    p.extensions = ipv6_extension_header(6, 8);
+    frames.push_back(build_frame(p));
+  }
+  // Timestamped near the epoch, so every packet looks long overdue
+  FakeSniffer sniffer(frames);
+  LayerSpyEngine::Config config;
+  config.shed_load = true;
+  config.shedding.max_rate = 16;
+  config.shedding.hold_ns = 0;
+  std::map<uint16_t, int> copies;
+  LayerSpyEngine engine({&sniffer}, config,
+                        [&](std::size_t, const PacketRef &,
+                            const LayerStack &stack) {
+                          const TCPHeader *tcp = stack.get<TCP>();
+                          if (tcp != nullptr && tcp->src_port < 60000) {
+                            ++copies[tcp->src_port];
+                          }
+                        });
+  engine.start();
+  engine.wait();
+
+  REQUIRE(engine.stats(0).sample_rate == 16);
+  CHECK(engine.stats(0).shed > 0);
+  CHECK_FALSE(copies.empty());
+  // Both packets of a flow are kept, or neither.
+  for (const auto &flow : copies) {
+    CHECK(flow.second == 2);
+  }
+}
@@ -0,0 +1,186 @@
+#include "decoder.hpp"
+#include "lazy_packet.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv4 / TCP 192.168.1.1:51000 -> 10.0.0.1:80 with `payload`,
+// then `padding` trailing bytes.
+std::string ipv4_tcp_frame(std::string_view payload, std::size_t padding = 0,
+                           uint16_t flags_fragment = 0x4000) {
+  TestFrame p;
+  p.flags_fragment = flags_fragment;
+  p.seq = 100;
+  p.tcp_flags = 0x18; // PSH ACK
+  p.payload = payload;
+  p.padding = padding;
+  return build_frame(p);
+}
+
+// Ethernet / IPv6 / TCP 2001:db8::1 -> 2001:db8::2, with a Hop-by-Hop and a
+// Fragment header before the TCP header if `extensions` is set.
+std::string ipv6_tcp_frame(std::string_view payload, bool extensions = false,
+                           uint16_t fragment_offset = 0) {
+  TestFrame p;
+  p.ipv6 = true;
+  p.src = 1;
+  p.dst = 2;
+  p.src_port = 0;
+  p.payload = payload;
+  if (extensions) {
+    p.extension_type = IPv6Header::NH_HOP_BY_HOP;
+    p.extensions =
+        ipv6_extension_header(IPv6Header::NH_FRAG, 8) +
+        ipv6_fragment_header(IPv6Header::NH_TCP, fragment_offset, false);
+  }
+  return build_frame(p);
+}
+
+bool same_entry(const LayerEntry *a, const LayerEntry *b) {
+  if (a == nullptr || b == nullptr) {
+    return a == b;
+  }
+  return a->kind == b->kind && a->offset == b->offset &&
+         a->header_length == b->header_length && a->length == b->length;
+}
+
+// Checks that LazyPacket finds exactly what Decoder::decode() finds.
+void check_matches_decoder(std::string_view frame) {
+  Decoder decoder;
+  LayerStack stack;
+  decoder.decode(frame, stack);
+
+  // Ask for the layers innermost first, so each one is decoded on demand.
+  LazyPacket pkt(frame);
+  const TCPHeader *tcp = pkt.tcp();
+  REQUIRE((tcp != nullptr) == stack.has(LayerKind::TCP));
+  if (tcp != nullptr) {
+    CHECK(tcp->src_port == stack.get<TCP>()->src_port);
+    CHECK(tcp->seq_number == stack.get<TCP>()->seq_number);
+    CHECK(tcp->flags() == stack.get<TCP>()->flags());
+  }
+  const IPv4Header *ipv4 = pkt.ipv4();
+  REQUIRE((ipv4 != nullptr) == stack.has(LayerKind::IPv4));
+  if (ipv4 != nullptr) {
+    CHECK(ipv4->source_ip == stack.get<IPv4>()->source_ip);
+    CHECK(ipv4->total_length == stack.get<IPv4>()->total_length);
+  }
+  const IPv6Header *ipv6 = pkt.ipv6();
+  REQUIRE((ipv6 != nullptr) == stack.has(LayerKind::IPv6));
+  if (ipv6 != nullptr) {
+    CHECK(ipv6->dest_ip == stack.get<IPv6>()->dest_ip);
+  }
+  const EthernetHeader *eth = pkt.ethernet();
+  REQUIRE((eth != nullptr) == stack.has(LayerKind::Ethernet));
+  if (eth != nullptr) {
+    CHECK(eth->eth_type == pkt.eth_type());
+    CHECK(eth->source_mac == stack.get<Ethernet>()->source_mac);
+  }
+
+  CHECK(same_entry(pkt.entry(LayerKind::Ethernet), stack.entry<Ethernet>()));
+  CHECK(same_entry(pkt.entry(LayerKind::IPv4), stack.entry<IPv4>()));
+  CHECK(same_entry(pkt.entry(LayerKind::IPv6), stack.entry<IPv6>()));
+  CHECK(same_entry(pkt.entry(LayerKind::TCP), stack.entry<TCP>()));
+
+  // The payload, asked for on a fresh view
+  LazyPacket fresh(frame);
+  const std::string_view payload = fresh.payload();
+  CHECK(payload.data() == stack.payload(frame).data());
+  CHECK(payload.length() == stack.payload(frame).length());
+}
+
+} // namespace
+
+TEST_CASE("LazyPacket decodes only the layers asked for", "[lazy_packet]") {
+  const std::string frame = ipv4_tcp_frame("GET / HTTP/1.1\r\n");
+  LazyPacket pkt(frame);
+  CHECK_FALSE(pkt.decoded(LayerKind::IPv4));
+
+  const IPv4Header *ipv4 = pkt.ipv4();
+  REQUIRE(ipv4 != nullptr);
+  CHECK(ipv4->source_ip.toString() == "192.168.1.1");
+  CHECK(ipv4->ttl == 64);
+  CHECK(pkt.decoded(LayerKind::IPv4));
+  // The EtherType was peeked at; nothing else was decoded.
+  CHECK_FALSE(pkt.decoded(LayerKind::Ethernet));
+  CHECK_FALSE(pkt.decoded(LayerKind::TCP));
+  CHECK_FALSE(pkt.decoded(LayerKind::IPv6));
+
+  // Repeated calls return the memoized header.
+  CHECK(pkt.ipv4() == ipv4);
+
+  const TCPHeader *tcp = pkt.tcp();
+  REQUIRE(tcp != nullptr);
+  CHECK(tcp->src_port == 51000);
+  CHECK(tcp->dst_port == 80);
+  CHECK(pkt.tcp() == tcp);
+  CHECK(pkt.payload() == "GET / HTTP/1.1\r\n");
+  CHECK_FALSE(pkt.decoded(LayerKind::Ethernet));
+}
+
+TEST_CASE("LazyPacket reports absent layers", "[lazy_packet]") {
+  SECTION("IPv6 packet") {
+    const std::string frame = ipv6_tcp_frame("");
+    LazyPacket pkt(frame);
+    CHECK(pkt.ipv4() == nullptr);
+    CHECK(pkt.ipv4() == nullptr);
+    REQUIRE(pkt.ipv6() != nullptr);
+    REQUIRE(pkt.tcp() != nullptr);
+    CHECK(pkt.tcp()->flag_syn);
+  }
+
+  SECTION("Non-IP frame") {
+    const std::string arp = arp_frame();
+    LazyPacket pkt(arp);
+    CHECK(pkt.eth_type() == 0x0806);
+    CHECK(pkt.tcp() == nullptr);
+    CHECK(pkt.ipv4() == nullptr);
+    CHECK(pkt.ipv6() == nullptr);
+    REQUIRE(pkt.ethernet() != nullptr);
+    CHECK(pkt.payload().length() == 60 - EthernetHeader::HEADER_SIZE);
+  }
+
+  SECTION("Runt frame") {
+    LazyPacket pkt(std::string_view("\x01\x02\x03", 3));
+    CHECK(pkt.eth_type() == 0);
+    CHECK(pkt.ethernet() == nullptr);
+    CHECK(pkt.ethernet() == nullptr);
+    CHECK(pkt.tcp() == nullptr);
+    CHECK(pkt.payload().empty());
+  }
+
+  SECTION("Non-first IPv4 fragment") {
+    const std::string frame = ipv4_tcp_frame("data", 0, 0x2001);
+    LazyPacket pkt(frame);
+    REQUIRE(pkt.ipv4() != nullptr);
+    CHECK(pkt.tcp() == nullptr);
+  }
+}
+
+TEST_CASE("LazyPacket agrees with the Decoder", "[lazy_packet]") {
+  // payload_length 0: the length is in a Jumbo Payload option
+  std::string jumbogram = ipv6_tcp_frame("v6 jumbogram", true);
+  jumbogram[18] = jumbogram[19] = 0;
+  const std::vector<std::string> frames = {
+      ipv4_tcp_frame("hello"),
+      ipv4_tcp_frame("padded", 12),
+      ipv4_tcp_frame("fragment", 0, 0x2000),
+      ipv4_tcp_frame("later fragment", 0, 0x0010),
+      ipv6_tcp_frame("v6 payload"),
+      ipv6_tcp_frame("v6 extensions", true),
+      ipv6_tcp_frame("v6 later fragment", true, 1),
+      jumbogram,
+  };
+  for (const std::string &frame : frames) {
+    // Every truncation, to cover each layer being cut short
+    for (std::size_t length = 0; length <= frame.length(); ++length) {
+      INFO("frame " << &frame - frames.data() << " cut to " << length);
+      check_matches_decoder(std::string_view(frame).substr(0, length));
+    }
+  }
+  CHECK(LazyPacket(jumbogram).payload() == "v6 jumbogram");
+}
@@ -0,0 +1,104 @@
+#include "load_shedder.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t MS = 1000000;
+
+LoadShedder::Config config() {
+  LoadShedder::Config config;
+  config.queue_high = 0.5;
+  config.queue_low = 0.1;
+  config.latency_high_ns = 10 * MS;
+  config.latency_low_ns = MS;
+  config.max_rate = 16;
+  config.hold_ns = 100 * MS;
+  return config;
+}
+
+} // namespace
+
+TEST_CASE("LoadShedder backs off under load and recovers after it",
+          "[load_shedder]") {
+  LoadShedder shedder(config());
+  uint64_t now = 1000 * MS;
+  CHECK(shedder.update(0.2, 5 * MS, now) == 1);
+
+  // A full queue or a long wait each count as overload.
+  CHECK(shedder.update(0.6, 0, now) == 2);
+  // Held for hold_ns before the next step
+  CHECK(shedder.update(0.9, 0, now + 50 * MS) == 2);
+  now += 100 * MS;
+  CHECK(shedder.update(0, 20 * MS, now) == 4);
+  for (int i = 0; i < 10; ++i) {
+    now += 100 * MS;
+    shedder.update(1, 50 * MS, now);
+  }
+  CHECK(shedder.rate() == 16); // capped at max_rate
+
+  // Between the watermarks the rate stays put.
+  now += 100 * MS;
+  CHECK(shedder.update(0.3, 5 * MS, now) == 16);
+  now += 100 * MS;
+  CHECK(shedder.update(0.3, 0, now) == 16);
+  CHECK(shedder.update(0.05, 0, now + 100 * MS) == 8);
+  now += 100 * MS;
+  for (int i = 0; i < 5; ++i) {
+    now += 100 * MS;
+    shedder.update(0, 0, now);
+  }
+  CHECK(shedder.rate() == 1);
+  CHECK(shedder.changes() == 8);
+}
+
+TEST_CASE("LoadShedder keeps whole flows, nested across rates",
+          "[load_shedder]") {
+  uint64_t kept[5] = {};
+  for (uint64_t hash = 1; hash <= 100000; ++hash) {
+    const uint64_t flow = hash * 0x9e3779b97f4a7c15ULL;
+    bool previous = true;
+    for (unsigned step = 0; step < 5; ++step) {
+      const bool keep = LoadShedder::kept(flow, 1U << step);
+      // A flow kept at 1 in 2N is kept at 1 in N too.
+      CHECK((previous || !keep));
+      previous = keep;
+      kept[step] += keep ? 1 : 0;
+    }
+  }
+  CHECK(kept[0] == 100000);
+  for (unsigned step = 1; step < 5; ++step) {
+    const double share = static_cast<double>(kept[step]) / 100000;
+    CHECK(share > 0.9 / (1U << step));
+    CHECK(share < 1.1 / (1U << step));
+  }
+
+  // Not lined up with the worker choice, flow_hash % workers
+  uint64_t per_worker[4] = {};
+  for (uint64_t hash = 0; hash < 40000; ++hash) {
+    per_worker[hash % 4] += LoadShedder::kept(hash, 4) ? 1 : 0;
+  }
+  for (const uint64_t count : per_worker) {
+    CHECK(count > 2000);
+    CHECK(count < 3000);
+  }
+}
+
+TEST_CASE("LoadShedder rejects bad settings", "[load_shedder]") {
+  LoadShedder::Config bad = config();
+  bad.queue_low = 0.5;
+  CHECK_THROWS_AS(LoadShedder(bad), std::invalid_argument);
+  bad = config();
+  bad.queue_high = 1.5;
+  CHECK_THROWS_AS(LoadShedder(bad), std::invalid_argument);
+  bad = config();
+  bad.latency_low_ns = bad.latency_high_ns;
+  CHECK_THROWS_AS(LoadShedder(bad), std::invalid_argument);
+  bad = config();
+  bad.max_rate = 12;
+  CHECK_THROWS_AS(LoadShedder(bad), std::invalid_argument);
+  bad.max_rate = 0;
+  CHECK_THROWS_AS(LoadShedder(bad), std::invalid_argument);
+  CHECK(LoadShedder(LoadShedder::Config{}).rate() == 1);
+}
@@ -1,6 +1,10 @@
 #include "types/mac_address.hpp"
 #include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <string>
 #include <string_view> // Include for std::string_view
+#include <type_traits>
+#include <unordered_set>
 
 TEST_CASE("MacAddress - Construction and toString formatting", "[MacAddress]") {
 
@@ -68,4 +72,33 @@ TEST_CASE("MacAddress - Equality operator (MacAddress to string_view)",
     REQUIRE_FALSE(mac == "");
     REQUIRE_FALSE(mac == "not-a-mac-address");
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("MacAddress - format_to, hashing and ordering", "[MacAddress]") {
+  STATIC_REQUIRE(sizeof(MacAddress) == 6);
+  STATIC_REQUIRE(std::is_trivially_copyable<MacAddress>::value);
+
+  std::unordered_set<MacAddress> seen;
+  for (unsigned i = 0; i < 256; ++i) {
+    const unsigned char bytes[] = {0x02,
+                                   0x00,
+                                   static_cast<unsigned char>(i * 37),
+                                   0x5E,
+                                   static_cast<unsigned char>(255 - i),
+                                   static_cast<unsigned char>(i)};
+    const MacAddress mac(bytes);
+    char expected[18];
+    std::snprintf(expected, sizeof(expected), "%02x:%02x:%02x:%02x:%02x:%02x",
+                  bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5]);
+    char buf[MacAddress::MAX_STRING_LENGTH];
+    REQUIRE(std::string(buf, mac.format_to(buf)) == expected);
+    seen.insert(mac);
+  }
+  CHECK(seen.size() == 256);
+
+  const unsigned char low[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+  const unsigned char high[] = {0x00, 0x11, 0x22, 0x33, 0x45, 0x00};
+  CHECK(MacAddress(low) < MacAddress(high));
+  CHECK_FALSE(MacAddress(high) < MacAddress(low));
+  CHECK(MacAddress(low) != MacAddress(high));
+}
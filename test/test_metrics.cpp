@@ -0,0 +1,158 @@
+#include "decoder.hpp"
+#include "metrics.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// Ethernet + IPv4 + TCP, 54 bytes
+const std::string FRAME = std::string("\x00\x11\x22\x33\x44\x55"
+                                      "\x66\x77\x88\x99\xaa\xbb"
+                                      "\x08\x00",
+                                      14) +
+                          std::string("\x45\x00\x00\x28\x00\x01\x00\x00"
+                                      "\x40\x06\x00\x00"
+                                      "\x0a\x00\x00\x01\x0a\x00\x00\x02",
+                                      20) +
+                          std::string("\x30\x39\x00\x50\x00\x00\x00\x01"
+                                      "\x00\x00\x00\x00\x50\x02\xff\xff"
+                                      "\x00\x00\x00\x00",
+                                      20);
+
+} // namespace
+
+TEST_CASE("LatencyHistogram - buckets are within an eighth",
+          "[metrics]") {
+  for (uint64_t value = 0; value < 8; ++value) {
+    CHECK(LatencyHistogram::bucket_of(value) == value);
+    CHECK(LatencyHistogram::bucket_limit(value) == value);
+  }
+  // The last bucket also holds everything above 2^40.
+  for (uint64_t value = 8; value < (uint64_t{1} << 39); value = value * 9 / 7) {
+    const std::size_t bucket = LatencyHistogram::bucket_of(value);
+    const uint64_t limit = LatencyHistogram::bucket_limit(bucket);
+    CHECK(value <= limit);
+    CHECK(limit - value < value / 8 + 1);
+    CHECK(LatencyHistogram::bucket_limit(bucket - 1) < value);
+  }
+  CHECK(LatencyHistogram::bucket_of(UINT64_MAX) ==
+        LatencyHistogram::BUCKETS - 1);
+  CHECK(LatencyHistogram::bucket_limit(LatencyHistogram::BUCKETS - 1) ==
+        UINT64_MAX);
+  CHECK(LatencyHistogram::BUCKETS == 304);
+}
+
+TEST_CASE("LatencyHistogram - percentiles", "[metrics]") {
+  LatencyHistogram histogram;
+  CHECK(histogram.percentile(0.5) == 0);
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.record(value);
+  }
+  CHECK(histogram.count() == 1000);
+  CHECK(histogram.sum() == 500500);
+  CHECK(histogram.percentile(0.5) >= 500);
+  CHECK(histogram.percentile(0.5) < 500 * 9 / 8);
+  CHECK(histogram.percentile(0.99) >= 990);
+  CHECK(histogram.percentile(1) >= 1000);
+
+  LatencyHistogram other;
+  other.record(3);
+  histogram.merge(other);
+  CHECK(histogram.count() == 1001);
+  CHECK(histogram.percentile(0) == 1);
+}
+
+TEST_CASE("Metrics - Prometheus text format", "[metrics]") {
+  MetricsSnapshot snapshot;
+  snapshot[Stage::Capture].packets = 12;
+  snapshot[Stage::Capture].dropped = 2;
+  snapshot[Stage::TCP].malformed = 1;
+  snapshot[Stage::IPv4].latency.record(5);
+  snapshot[Stage::IPv4].latency.record(100);
+  std::ostringstream out;
+  write_prometheus(out, snapshot);
+  const std::string text = out.str();
+
+  CHECK(text.find("# TYPE layerspy_stage_packets_total counter\n") !=
+        std::string::npos);
+  CHECK(text.find("layerspy_stage_packets_total{stage=\"capture\"} 12\n") !=
+        std::string::npos);
+  CHECK(text.find("layerspy_stage_dropped_total{stage=\"capture\"} 2\n") !=
+        std::string::npos);
+  CHECK(text.find("layerspy_stage_malformed_total{stage=\"tcp\"} 1\n") !=
+        std::string::npos);
+  CHECK(text.find("# TYPE layerspy_stage_latency_cycles histogram\n") !=
+        std::string::npos);
+  // Cumulative: 5 is below 7, 100 below 127
+  const std::string bucket =
+      "layerspy_stage_latency_cycles_bucket{stage=\"ipv4\",";
+  CHECK(text.find(bucket + "le=\"7\"} 1\n") != std::string::npos);
+  CHECK(text.find(bucket + "le=\"63\"} 1\n") != std::string::npos);
+  CHECK(text.find(bucket + "le=\"127\"} 2\n") != std::string::npos);
+  CHECK(text.find(bucket + "le=\"+Inf\"} 2\n") != std::string::npos);
+  CHECK(text.find("layerspy_stage_latency_cycles_sum{stage=\"ipv4\"} 105\n") !=
+        std::string::npos);
+  CHECK(text.find("layerspy_stage_latency_cycles_count{stage=\"ipv4\"} 2\n") !=
+        std::string::npos);
+  CHECK(std::string(stage_name(Stage::Output)) == "output");
+}
+
+TEST_CASE("Metrics - the decoder's hooks", "[metrics]") {
+  const MetricsSnapshot before = collect_metrics();
+  // Decoded on another thread, which has exited by the time of the check
+  std::thread([] {
+    Decoder decoder;
+    LayerStack stack;
+    for (int i = 0; i < 10; ++i) {
+      decoder.decode(FRAME, stack);
+    }
+    decoder.decode(std::string_view(FRAME).substr(0, 40), stack);
+  }).join();
+  const MetricsSnapshot after = collect_metrics();
+
+  const auto delta = [&](Stage stage) {
+    return after[stage].packets - before[stage].packets;
+  };
+  if (METRICS_ENABLED) {
+    CHECK(delta(Stage::Ethernet) == 11);
+    CHECK(delta(Stage::IPv4) == 11);
+    CHECK(delta(Stage::TCP) == 11);
+    CHECK(delta(Stage::IPv6) == 0);
+    CHECK(after[Stage::TCP].malformed - before[Stage::TCP].malformed == 1);
+    CHECK(after[Stage::TCP].latency.count() -
+              before[Stage::TCP].latency.count() ==
+          11);
+  } else {
+    CHECK(after[Stage::Ethernet].packets == 0);
+    CHECK(after[Stage::TCP].latency.count() == 0);
+  }
+}
+
+TEST_CASE("MetricsFileWriter - rewrites the file", "[metrics]") {
+  char name[] = "/tmp/layerspy_test_XXXXXX";
+  const int fd = mkstemp(name);
+  REQUIRE(fd >= 0);
+  close(fd);
+  {
+    MetricsFileWriter writer(name, std::chrono::milliseconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(writer.failures() == 0);
+  }
+  std::ifstream in(name);
+  std::ostringstream text;
+  text << in.rdbuf();
+  CHECK(text.str().find(
+            "layerspy_stage_latency_cycles_count{stage=\"output\"}") !=
+        std::string::npos);
+  std::remove(name);
+
+  CHECK_THROWS_AS(MetricsFileWriter("/nonexistent/dir/stats.prom",
+                                    std::chrono::milliseconds(5)),
+                  std::runtime_error);
+}
@@ -0,0 +1,152 @@
+#include "packet_classifier.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Tag = PacketClassifier::Tag;
+
+// Ethernet / IPv4 (IHL 5) or IPv6 / TCP, UDP, or nothing for another
+// protocol
+std::string ipv4_frame(uint8_t proto, uint16_t src, uint16_t dst,
+                       uint16_t frag = 0) {
+  TestFrame p;
+  p.protocol = proto;
+  p.src_port = src;
+  p.dst_port = dst;
+  p.flags_fragment = frag;
+  return build_frame(p);
+}
+
+std::string ipv6_frame(uint8_t next_header, uint16_t src, uint16_t dst) {
+  TestFrame p;
+  p.ipv6 = true;
+  p.protocol = next_header;
+  p.src_port = src;
+  p.dst_port = dst;
+  return build_frame(p);
+}
+
+std::vector<Tag> classify(const PacketClassifier &classifier,
+                          const std::vector<std::string> &frames) {
+  std::vector<PacketRef> refs;
+  for (const std::string &f : frames) {
+    refs.push_back(PacketRef{f, 0});
+  }
+  std::vector<Tag> tags(refs.size());
+  classifier.classify(refs.data(), refs.size(), tags.data());
+  return tags;
+}
+
+} // namespace
+
+TEST_CASE("PacketClassifier - tags common frame types", "[classifier]") {
+  std::string ipv4_options = ipv4_frame(6, 1000, 80);
+  ipv4_options[14] = '\x46'; // IHL 6: ports move 4 bytes further
+  ipv4_options[38] = '\x00';
+  ipv4_options[39] = '\x35'; // dst port 53 at the new offset
+  ipv4_options[36] = '\x00';
+  ipv4_options[37] = '\x00';
+
+  const std::vector<std::string> frames = {
+      ipv4_frame(6, 51000, 80),         // 0 monitored TCP
+      ipv4_frame(17, 5353, 5353),       // 1 unmonitored UDP
+      ipv4_frame(1, 0, 0),              // 2 ICMP
+      ipv6_frame(6, 443, 50000),        // 3 monitored TCP over IPv6
+      ipv6_frame(17, 1, 2),             // 4 unmonitored UDP over IPv6
+      ipv4_frame(6, 80, 80, 0x2000),    // 5 first fragment (MF)
+      ipv4_frame(6, 80, 80, 0x0010),    // 6 later fragment
+      ipv4_frame(6, 80, 80).substr(0, 36), // 7 ports cut off
+      ipv4_frame(6, 80, 80).substr(0, 20), // 8 IPv4 header cut off
+      std::string("\x00\x11\x22", 3),      // 9 runt
+      ipv4_options,                        // 10 IPv4 with options
+  };
+  std::vector<std::string> all = frames;
+  all.push_back(arp_frame()); // 11 non-IP
+  // 12, 13: an Ethernet header and nothing after it
+  all.push_back(ipv4_frame(6, 80, 80).substr(0, 14));
+  all.push_back(ipv6_frame(6, 80, 80).substr(0, 14));
+
+  PacketClassifier classifier;
+  classifier.monitorPort(80);
+  classifier.monitorPort(443);
+  classifier.monitorPort(53);
+
+  const std::vector<Tag> tags = classify(classifier, all);
+
+  CHECK(tags[0] == (PacketClassifier::L3_IPV4 | PacketClassifier::TCP |
+                    PacketClassifier::MONITORED));
+  CHECK(tags[1] == (PacketClassifier::L3_IPV4 | PacketClassifier::UDP));
+  CHECK(tags[2] == PacketClassifier::L3_IPV4);
+  CHECK(tags[3] == (PacketClassifier::L3_IPV6 | PacketClassifier::TCP |
+                    PacketClassifier::MONITORED));
+  CHECK(tags[4] == (PacketClassifier::L3_IPV6 | PacketClassifier::UDP));
+  CHECK(tags[5] == (PacketClassifier::L3_IPV4 | PacketClassifier::TCP |
+                    PacketClassifier::FRAGMENT |
+                    PacketClassifier::MONITORED));
+  CHECK(tags[6] == (PacketClassifier::L3_IPV4 | PacketClassifier::TCP |
+                    PacketClassifier::FRAGMENT));
+  CHECK(tags[7] == (PacketClassifier::L3_IPV4 | PacketClassifier::TCP |
+                    PacketClassifier::TRUNCATED));
+  CHECK(tags[8] == (PacketClassifier::L3_IPV4 | PacketClassifier::TRUNCATED));
+  CHECK(tags[9] == PacketClassifier::L3_NONE);
+  CHECK(tags[10] == (PacketClassifier::L3_IPV4 | PacketClassifier::TCP |
+                     PacketClassifier::MONITORED));
+  CHECK(tags[11] == PacketClassifier::L3_NONE);
+  CHECK(tags[12] == PacketClassifier::L3_NONE);
+  CHECK(tags[13] == PacketClassifier::L3_NONE);
+}
+
+TEST_CASE("PacketClassifier - stays in bounds on damaged frames",
+          "[classifier]") {
+  std::mt19937 rng(1234);
+  std::vector<std::string> frames;
+  for (int i = 0; i < 2003; ++i) {
+    // Mostly plausible headers with random damage, at random lengths.
+    std::string f = (i % 2) ? ipv4_frame(rng() % 2 ? 6 : 17, rng(), rng())
+                            : ipv6_frame(rng() % 3 ? 6 : 17, rng(), rng());
+    for (int flips = rng() % 3; flips > 0; --flips) {
+      f[rng() % f.size()] = static_cast<char>(rng());
+    }
+    f.resize(rng() % (f.size() + 8));
+    frames.push_back(f);
+  }
+
+  PacketClassifier classifier;
+  classifier.monitorPort(80);
+  classifier.monitorPort(static_cast<uint16_t>(rng()));
+  for (const Tag tag : classify(classifier, frames)) {
+    // At most one transport, and ports only for a transport
+    CHECK((tag & (PacketClassifier::TCP | PacketClassifier::UDP)) !=
+          (PacketClassifier::TCP | PacketClassifier::UDP));
+    if ((tag & PacketClassifier::MONITORED) != 0) {
+      CHECK((tag & (PacketClassifier::TCP | PacketClassifier::UDP)) != 0);
+    }
+  }
+}
+
+TEST_CASE("PacketClassifier - select and count", "[classifier]") {
+  const Tag tags[] = {
+      PacketClassifier::L3_IPV4 | PacketClassifier::TCP |
+          PacketClassifier::MONITORED,
+      PacketClassifier::L3_NONE,
+      PacketClassifier::L3_IPV6 | PacketClassifier::UDP,
+      PacketClassifier::L3_IPV6 | PacketClassifier::TCP |
+          PacketClassifier::MONITORED};
+
+  uint32_t indices[4];
+  REQUIRE(PacketClassifier::select(tags, 4, PacketClassifier::MONITORED,
+                                   indices) == 2);
+  CHECK(indices[0] == 0);
+  CHECK(indices[1] == 3);
+
+  ClassCounters counters;
+  counters.add(tags, 4);
+  CHECK(counters.packets[PacketClassifier::L3_NONE] == 1);
+  CHECK(counters.matching(PacketClassifier::TCP) == 2);
+  CHECK(counters.matching(PacketClassifier::L3_IPV6) == 2);
+}
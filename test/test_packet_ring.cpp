@@ -0,0 +1,176 @@
+#include "packet_ring.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+PacketRef ref(const std::string &bytes, uint64_t timestamp_ns) {
+  return PacketRef{std::string_view(bytes), timestamp_ns};
+}
+
+// Payload of `length` bytes derived from `seq`, so the reader can check it.
+std::string payload(uint32_t seq, std::size_t length) {
+  std::string bytes(length, '\0');
+  for (std::size_t i = 0; i < length; ++i) {
+    bytes[i] = static_cast<char>(seq * 31 + i);
+  }
+  return bytes;
+}
+
+} // namespace
+
+TEST_CASE("PacketRing delivers packets in order", "[packet_ring]") {
+  PacketRing ring(4096);
+  const std::string a = "first";
+  const std::string b(1500, 'x');
+  const std::string empty;
+
+  REQUIRE(ring.push(ref(a, 1)));
+  REQUIRE(ring.push(PacketRef{b, 2, PacketRef::CHECKSUM_VALID}));
+  REQUIRE(ring.push(PacketRef{empty, 3, PacketRef::CHECKSUM_PARTIAL, 64}));
+
+  std::vector<std::string> seen;
+  std::vector<uint64_t> stamps;
+  std::vector<uint32_t> flags;
+  std::vector<uint32_t> rates;
+  const std::size_t count = ring.drain(10, [&](const PacketRef &packet) {
+    seen.emplace_back(packet.data);
+    stamps.push_back(packet.timestamp_ns);
+    flags.push_back(packet.flags);
+    rates.push_back(packet.sample_rate);
+  });
+
+  CHECK(count == 3);
+  CHECK(seen == std::vector<std::string>{a, b, empty});
+  CHECK(stamps == std::vector<uint64_t>{1, 2, 3});
+  CHECK(flags == std::vector<uint32_t>{0, PacketRef::CHECKSUM_VALID,
+                                       PacketRef::CHECKSUM_PARTIAL});
+  CHECK(rates == std::vector<uint32_t>{1, 1, 64});
+  CHECK(ring.used() == 0);
+  CHECK(ring.drain(10, [](const PacketRef &) {}) == 0);
+}
+
+TEST_CASE("PacketRing drains a batch of packets at once", "[packet_ring]") {
+  PacketRing ring(4096);
+  for (uint32_t seq = 0; seq < 5; ++seq) {
+    REQUIRE(ring.push(ref(payload(seq, 100 + seq), seq)));
+  }
+
+  PacketRef batch[3];
+  std::vector<std::string> seen;
+  const auto collect = [&](const PacketRef *packets, std::size_t count) {
+    // Nothing is handed back while the batch is viewed.
+    CHECK(ring.used() > 0);
+    for (std::size_t i = 0; i < count; ++i) {
+      seen.emplace_back(packets[i].data);
+    }
+  };
+  CHECK(ring.drain_batch(batch, 3, collect) == 3);
+  CHECK(ring.drain_batch(batch, 3, collect) == 2);
+  CHECK(ring.drain_batch(batch, 3, collect) == 0);
+
+  REQUIRE(seen.size() == 5);
+  for (uint32_t seq = 0; seq < 5; ++seq) {
+    CHECK(seen[seq] == payload(seq, 100 + seq));
+  }
+  CHECK(ring.used() == 0);
+}
+
+TEST_CASE("PacketRing rejects packets that do not fit", "[packet_ring]") {
+  PacketRing ring(256);
+  REQUIRE(ring.capacity() == 256);
+
+  const std::string big(300, 'x');
+  CHECK_FALSE(ring.push(ref(big, 0)));
+
+  // 100 bytes plus a 16-byte header take 128 bytes each.
+  const std::string packet(100, 'y');
+  CHECK(ring.push(ref(packet, 0)));
+  CHECK(ring.push(ref(packet, 0)));
+  CHECK_FALSE(ring.push(ref(packet, 0)));
+
+  CHECK(ring.drain(1, [](const PacketRef &) {}) == 1);
+  CHECK(ring.push(ref(packet, 0)));
+}
+
+TEST_CASE("PacketRing takes packets up to max_packet() at any position",
+          "[packet_ring]") {
+  PacketRing ring(256);
+  REQUIRE(ring.max_packet() == 112);
+  const std::string largest(ring.max_packet(), 'x');
+  const std::string longer(ring.max_packet() + 1, 'x');
+  for (std::size_t offset = 0; offset < ring.capacity(); offset += 16) {
+    // Once the ring is empty again, a packet this long always fits.
+    CHECK(ring.push(ref(largest, offset)));
+    CHECK(ring.drain(1, [](const PacketRef &) {}) == 1);
+    CHECK_FALSE(ring.push(ref(longer, offset)));
+    // Moves the tail on by one record.
+    CHECK(ring.push(ref(std::string(), offset)));
+    CHECK(ring.drain(1, [](const PacketRef &) {}) == 1);
+  }
+  CHECK(PacketRing(1).capacity() == 32);
+  CHECK(PacketRing(1).max_packet() == 0);
+}
+
+TEST_CASE("PacketRing wraps around the end of its buffer", "[packet_ring]") {
+  PacketRing ring(512);
+  uint32_t next_push = 0;
+  uint32_t next_pop = 0;
+  bool intact = true;
+
+  // Odd lengths make packets end at every possible offset.
+  for (int round = 0; round < 500; ++round) {
+    while (true) {
+      const std::size_t length = (next_push * 37) % 200;
+      const std::string bytes = payload(next_push, length);
+      if (!ring.push(ref(bytes, next_push))) {
+        break;
+      }
+      ++next_push;
+    }
+    ring.drain(2, [&](const PacketRef &packet) {
+      const uint32_t seq = static_cast<uint32_t>(packet.timestamp_ns);
+      intact = intact && seq == next_pop &&
+               packet.data == payload(seq, (seq * 37) % 200);
+      ++next_pop;
+    });
+  }
+
+  CHECK(intact);
+  CHECK(next_pop > 500);
+}
+
+TEST_CASE("PacketRing hands packets between two threads",
+          "[packet_ring][threads]") {
+  constexpr uint32_t PACKETS = 50000;
+  PacketRing ring(8192);
+
+  std::thread producer([&ring] {
+    for (uint32_t seq = 0; seq < PACKETS; ++seq) {
+      const std::string bytes = payload(seq, seq % 300);
+      while (!ring.push(ref(bytes, seq))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t next = 0;
+  bool intact = true;
+  while (next < PACKETS) {
+    const std::size_t count = ring.drain(64, [&](const PacketRef &packet) {
+      intact = intact && packet.timestamp_ns == next &&
+               packet.data == payload(next, next % 300);
+      ++next;
+    });
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  CHECK(intact);
+  CHECK(ring.used() == 0);
+}
@@ -0,0 +1,324 @@
+#include "parallel_capture.hpp"
+#include "decoder.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// A fresh temporary path, removed afterwards
+class TempPath {
+public:
+  TempPath() {
+    char name[] = "/tmp/layerspy_test_XXXXXX";
+    const int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    close(fd);
+    m_path = name;
+  }
+  ~TempPath() { std::remove(m_path.c_str()); }
+
+  const std::string &path() const { return m_path; }
+
+private:
+  std::string m_path;
+};
+
+// Little-endian pcapng with one nanosecond interface
+struct PcapNgWriter {
+  std::string bytes;
+
+  void u16(uint16_t value) {
+    bytes.push_back(static_cast<char>(value));
+    bytes.push_back(static_cast<char>(value >> 8));
+  }
+  void u32(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      bytes.push_back(static_cast<char>(value >> (8 * i)));
+    }
+  }
+  void section() {
+    u32(0x0A0D0D0A);
+    u32(28);
+    u32(0x1A2B3C4D);
+    u16(1);
+    u16(0);
+    u32(0xFFFFFFFF);
+    u32(0xFFFFFFFF);
+    u32(28);
+    u32(1); // interface: Ethernet with if_tsresol 9
+    u32(32);
+    u16(1);
+    u16(0);
+    u32(65535);
+    u16(9);
+    u16(1);
+    bytes += std::string(1, '\x09') + std::string(3, '\0');
+    u32(0);
+    u32(32);
+  }
+  void packet(uint64_t timestamp, std::string_view data) {
+    const uint32_t length =
+        static_cast<uint32_t>(32 + (data.size() + 3) / 4 * 4);
+    u32(6);
+    u32(length);
+    u32(0);
+    u32(static_cast<uint32_t>(timestamp >> 32));
+    u32(static_cast<uint32_t>(timestamp));
+    u32(static_cast<uint32_t>(data.size()));
+    u32(static_cast<uint32_t>(data.size()));
+    bytes += data;
+    bytes.append((4 - data.size() % 4) % 4, '\0');
+    u32(length);
+  }
+};
+
+// Timestamps and lengths of every packet, read sequentially
+std::vector<std::pair<uint64_t, std::size_t>>
+read_all(const std::string &path) {
+  CaptureFileReader reader(path);
+  std::vector<std::pair<uint64_t, std::size_t>> packets;
+  PacketRef packet;
+  while (reader.next(packet)) {
+    packets.emplace_back(packet.timestamp_ns, packet.data.length());
+  }
+  return packets;
+}
+
+// The same packets, read chunk by chunk
+std::vector<std::pair<uint64_t, std::size_t>>
+read_chunks(const std::string &path,
+            const std::vector<CaptureFileReader::Chunk> &chunks) {
+  CaptureFileReader reader(path);
+  std::vector<std::pair<uint64_t, std::size_t>> packets;
+  PacketRef packet;
+  for (const CaptureFileReader::Chunk &chunk : chunks) {
+    reader.seek(chunk.start);
+    while (reader.position() < chunk.end && reader.next(packet)) {
+      packets.emplace_back(packet.timestamp_ns, packet.data.length());
+    }
+    CHECK(reader.position() == chunk.end);
+  }
+  return packets;
+}
+
+void check_split(const std::string &path, std::size_t chunk_bytes) {
+  CaptureFileReader reader(path);
+  const std::vector<CaptureFileReader::Chunk> chunks =
+      reader.split(chunk_bytes);
+  REQUIRE(chunks.size() > 1);
+  CHECK(chunks.back().end == reader.file_size());
+  for (std::size_t i = 1; i < chunks.size(); ++i) {
+    CHECK(chunks[i].start.position == chunks[i - 1].end);
+  }
+  // split() leaves the reader where it was
+  PacketRef packet;
+  REQUIRE(reader.next(packet));
+  CHECK(packet.timestamp_ns == read_all(path).front().first);
+  CHECK(read_chunks(path, chunks) == read_all(path));
+}
+
+// The summary worked out packet by packet on one thread
+CaptureSummary sequential_summary(const std::string &path) {
+  CaptureFileReader reader(path);
+  Decoder decoder;
+  LayerStack stack;
+  CaptureSummary summary;
+  std::map<std::string, std::pair<FlowKey, FlowStats>> flows;
+  PacketRef packet;
+  while (reader.next(packet)) {
+    ++summary.packets;
+    summary.bytes += packet.data.length();
+    if (!decoder.decode(packet.data, stack)) {
+      ++summary.malformed;
+      continue;
+    }
+    summary.ipv4 += stack.has(LayerKind::IPv4) ? 1 : 0;
+    summary.ipv6 += stack.has(LayerKind::IPv6) ? 1 : 0;
+    FlowKey key;
+    if (!FlowKey::from_packet(packet.data, stack, key)) {
+      continue;
+    }
+    summary.tcp += key.protocol == 6 ? 1 : 0;
+    summary.udp += key.protocol == 17 ? 1 : 0;
+    key = key.canonical();
+    const std::string bytes(reinterpret_cast<const char *>(&key), sizeof key);
+    auto [it, inserted] = flows.try_emplace(bytes, key, FlowStats{});
+    FlowStats &flow = it->second.second;
+    if (inserted) {
+      flow.first_seen_ns = packet.timestamp_ns;
+    }
+    flow.last_seen_ns = packet.timestamp_ns;
+    ++flow.packets;
+    flow.bytes += packet.data.length();
+    if (const TCPHeader *tcp = stack.get<TCP>()) {
+      flow.tcp_flags |= tcp->flags();
+    }
+  }
+  for (const auto &entry : flows) {
+    summary.flows.push_back(entry.second);
+  }
+  return summary;
+}
+
+void check_same(const CaptureSummary &a, const CaptureSummary &b) {
+  CHECK(a.packets == b.packets);
+  CHECK(a.bytes == b.bytes);
+  CHECK(a.malformed == b.malformed);
+  CHECK(a.ipv4 == b.ipv4);
+  CHECK(a.ipv6 == b.ipv6);
+  CHECK(a.tcp == b.tcp);
+  CHECK(a.udp == b.udp);
+  REQUIRE(a.flows.size() == b.flows.size());
+  for (std::size_t i = 0; i < a.flows.size(); ++i) {
+    CHECK(a.flows[i].first == b.flows[i].first);
+    CHECK(a.flows[i].second.packets == b.flows[i].second.packets);
+    CHECK(a.flows[i].second.bytes == b.flows[i].second.bytes);
+    CHECK(a.flows[i].second.first_seen_ns ==
+          b.flows[i].second.first_seen_ns);
+    CHECK(a.flows[i].second.last_seen_ns == b.flows[i].second.last_seen_ns);
+    CHECK(a.flows[i].second.tcp_flags == b.flows[i].second.tcp_flags);
+  }
+}
+
+} // namespace
+
+TEST_CASE("CaptureFileReader::split cuts at record boundaries",
+          "[parallel_capture]") {
+  TempPath pcap;
+  TrafficGenerator::Config traffic;
+  traffic.flows = 500;
+  TrafficGenerator generator(traffic);
+  generator.write_pcap(pcap.path(), 20000);
+  for (const std::size_t chunk_bytes : {1, 4096, 100000}) {
+    check_split(pcap.path(), chunk_bytes);
+  }
+  {
+    CaptureFileReader reader(pcap.path());
+    const auto chunks = reader.split(std::size_t{1} << 30);
+    REQUIRE(chunks.size() == 1);
+    CHECK(chunks.front().end == reader.file_size());
+  }
+
+  TempPath pcapng;
+  PcapNgWriter writer;
+  writer.section();
+  for (int i = 0; i < 3000; ++i) {
+    const PacketRef packet = generator.next();
+    writer.packet(packet.timestamp_ns, packet.data);
+  }
+  {
+    std::ofstream out(pcapng.path(), std::ios::binary);
+    out.write(writer.bytes.data(),
+              static_cast<std::streamsize>(writer.bytes.size()));
+  }
+  check_split(pcapng.path(), 4096);
+
+  CaptureFileReader reader(pcap.path());
+  CHECK_THROWS_AS(reader.split(0), std::invalid_argument);
+}
+
+TEST_CASE("ParallelCaptureReader reads every packet once",
+          "[parallel_capture]") {
+  TempPath pcap;
+  TrafficGenerator::Config traffic;
+  traffic.flows = 300;
+  TrafficGenerator(traffic).write_pcap(pcap.path(), 10000);
+  const auto expected = read_all(pcap.path());
+
+  ParallelCaptureReader::Config config;
+  config.threads = 4;
+  config.chunk_bytes = 16384;
+  ParallelCaptureReader reader(pcap.path(), config);
+  REQUIRE(reader.chunks().size() > 8);
+
+  // Per chunk, so the pieces can be put back in file order
+  std::vector<std::vector<std::pair<uint64_t, std::size_t>>> chunks(
+      reader.chunks().size());
+  std::vector<int> done(reader.chunks().size());
+  std::mutex mutex;
+  reader.run(
+      [&chunks](std::size_t, std::size_t chunk, const PacketRef &packet,
+                const LayerStack &) {
+        chunks[chunk].emplace_back(packet.timestamp_ns, packet.data.length());
+      },
+      [&done, &mutex](std::size_t thread, std::size_t chunk) {
+        const std::lock_guard<std::mutex> lock(mutex);
+        CHECK(thread < 4);
+        ++done[chunk];
+      });
+  std::vector<std::pair<uint64_t, std::size_t>> packets;
+  for (const auto &chunk : chunks) {
+    packets.insert(packets.end(), chunk.begin(), chunk.end());
+  }
+  CHECK(packets == expected);
+  CHECK(done == std::vector<int>(done.size(), 1));
+  CHECK(reader.stats().packets == expected.size());
+  CHECK(reader.stats().decoded + reader.stats().malformed ==
+        expected.size());
+  CHECK(reader.stats().filtered == 0);
+}
+
+TEST_CASE("summarize_capture does not depend on the thread count",
+          "[parallel_capture]") {
+  TempPath pcap;
+  TrafficGenerator::Config traffic;
+  traffic.flows = 3000;
+  TrafficGenerator(traffic).write_pcap(pcap.path(), 30000);
+  const CaptureSummary expected = sequential_summary(pcap.path());
+  REQUIRE(expected.flows.size() > 1000);
+
+  for (const std::size_t threads : {1, 2, 8}) {
+    for (const std::size_t chunk_bytes : {8192, 1 << 20}) {
+      ParallelCaptureReader::Config config;
+      config.threads = threads;
+      config.chunk_bytes = chunk_bytes;
+      ParallelCaptureReader::Stats stats;
+      check_same(summarize_capture(pcap.path(), config, &stats), expected);
+      CHECK(stats.packets == expected.packets);
+    }
+  }
+
+  const auto top = expected.top_flows(10);
+  REQUIRE(top.size() == 10);
+  for (std::size_t i = 1; i < top.size(); ++i) {
+    CHECK(top[i - 1].second.bytes >= top[i].second.bytes);
+  }
+  CHECK(expected.top_flows(1 << 20).size() == expected.flows.size());
+}
+
+TEST_CASE("ParallelCaptureReader rethrows and rejects bad settings",
+          "[parallel_capture]") {
+  TempPath pcap;
+  TrafficGenerator(TrafficGenerator::Config{}).write_pcap(pcap.path(), 5000);
+  ParallelCaptureReader::Config config;
+  config.threads = 3;
+  config.chunk_bytes = 4096;
+  ParallelCaptureReader reader(pcap.path(), config);
+  CHECK_THROWS_AS(reader.run([](std::size_t, std::size_t chunk,
+                                const PacketRef &, const LayerStack &) {
+    if (chunk == 5) {
+      throw std::runtime_error("handler failed");
+    }
+  }),
+                  std::runtime_error);
+
+  config.threads = 0;
+  CHECK_THROWS_AS(ParallelCaptureReader(pcap.path(), config),
+                  std::invalid_argument);
+  config.threads = 1;
+  config.chunk_bytes = 0;
+  CHECK_THROWS_AS(ParallelCaptureReader(pcap.path(), config),
+                  std::invalid_argument);
+  CHECK_THROWS(ParallelCaptureReader("/nonexistent/capture.pcap",
+                                     ParallelCaptureReader::Config{}));
+}
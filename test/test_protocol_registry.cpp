@@ -0,0 +1,252 @@
+#include "decoder.hpp"
+#include "protocol_registry.hpp"
+#include "test_frames.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Ethernet / IPv6 / `extensions` / TCP 51000 -> 80 with `payload`. The
+// first byte of each extension header must name the one after it.
+std::string ipv6_frame(uint8_t next_header, const std::string &extensions,
+                       const std::string &payload) {
+  TestFrame p;
+  p.ipv6 = true;
+  p.extension_type = next_header;
+  p.extensions = extensions;
+  p.payload = payload;
+  return build_frame(p);
+}
+
+// Ethernet / 802.1Q tag / IPv4 / TCP 51000 -> 80 with `payload`
+std::string vlan_frame(const std::string &payload) {
+  TestFrame p;
+  p.payload = payload;
+  std::string f = build_frame(p);
+  f.insert(12, std::string("\x81\x00\x00\x2a", 4)); // VLAN ID 42
+  return f;
+}
+
+// What the plugin parsers below find, through Decoder::set_output()
+struct PluginResults {
+  int vlan = 0;
+  std::string_view application;
+};
+
+// Skips an 802.1Q tag and dispatches on the EtherType inside it.
+NextLayer parse_vlan(DecodeState &state, void *) {
+  if (state.data.length() < 4) {
+    return {};
+  }
+  const auto *bytes =
+      reinterpret_cast<const unsigned char *>(state.data.data());
+  static_cast<PluginResults *>(state.output)->vlan =
+      ((bytes[0] & 0x0F) << 8) | bytes[1];
+  const uint16_t inner = static_cast<uint16_t>(bytes[2] << 8 | bytes[3]);
+  state.data.remove_prefix(4);
+  return {Dispatch::EtherType, inner};
+}
+
+// Records the application payload it is dispatched on, cut to the length
+// its (read-only, shared) context points to.
+NextLayer parse_application(DecodeState &state, void *context) {
+  static_cast<PluginResults *>(state.output)->application =
+      state.data.substr(0, *static_cast<const std::size_t *>(context));
+  return {};
+}
+
+} // namespace
+
+TEST_CASE("ProtocolRegistry - IPv6 extension headers are walked",
+          "[protocol_registry]") {
+  Decoder decoder;
+  LayerStack stack;
+
+  SECTION("Hop-by-Hop, Destination Options, then TCP") {
+    const std::string frame =
+        ipv6_frame(IPv6Header::NH_HOP_BY_HOP,
+                   ipv6_extension_header(IPv6Header::NH_DEST_OPTS, 8) +
+                       ipv6_extension_header(6, 16),
+                   "data");
+    REQUIRE(decoder.decode(frame, stack));
+    const IPv6Header *ip = stack.get<IPv6>();
+    REQUIRE(ip != nullptr);
+    CHECK(ip->next_header == IPv6Header::NH_HOP_BY_HOP);
+    CHECK(ip->upper_protocol == 6);
+    CHECK(ip->extension_length == 24);
+    CHECK_FALSE(ip->fragmented);
+    CHECK(stack.entry<IPv6>()->header_length == 40);
+    REQUIRE(stack.get<TCP>() != nullptr);
+    CHECK(stack.entry<TCP>()->offset == 14 + 40 + 24);
+    CHECK(stack.get<TCP>()->dst_port == 80);
+    CHECK(stack.payload(frame) == "data");
+  }
+
+  SECTION("the first fragment carries TCP") {
+    const std::string frame =
+        ipv6_frame(IPv6Header::NH_ROUTING,
+                   ipv6_extension_header(IPv6Header::NH_FRAG, 8) +
+                       ipv6_fragment_header(6, 0, true),
+                   "data");
+    REQUIRE(decoder.decode(frame, stack));
+    CHECK(stack.get<IPv6>()->fragmented);
+    CHECK(stack.get<IPv6>()->fragment_header == 8);
+    CHECK(stack.get<IPv6>()->fragment_link == 40); // the Routing header's
+    CHECK(stack.get<TCP>() != nullptr);
+  }
+
+  SECTION("later fragments do not") {
+    const std::string frame = ipv6_frame(
+        IPv6Header::NH_FRAG, ipv6_fragment_header(6, 185, false), "data");
+    REQUIRE(decoder.decode(frame, stack));
+    CHECK(stack.get<IPv6>()->fragment_offset == 185);
+    CHECK(stack.get<TCP>() == nullptr);
+    CHECK(stack.payload(frame).length() == 8 + 20 + 4);
+  }
+
+  SECTION("a later fragment's payload is not read as headers") {
+    // The middle of a Destination Options header followed by TCP
+    TestFrame p;
+    p.ipv6 = true;
+    p.extension_type = IPv6Header::NH_FRAG;
+    p.extensions = ipv6_fragment_header(IPv6Header::NH_DEST_OPTS, 185, false);
+    p.raw_payload = true;
+    p.payload = ipv6_extension_header(6, 8) + std::string(20, '\0');
+    REQUIRE(decoder.decode(build_frame(p), stack));
+    CHECK(stack.get<IPv6>()->upper_protocol == IPv6Header::NH_DEST_OPTS);
+    CHECK(stack.get<IPv6>()->extension_length == 8);
+    CHECK(stack.get<TCP>() == nullptr);
+  }
+
+  SECTION("a jumbogram is not cut at its payload_length of 0") {
+    std::string frame = ipv6_frame(IPv6Header::NH_HOP_BY_HOP,
+                                   ipv6_extension_header(6, 8), "data");
+    frame[18] = frame[19] = 0; // the length is in a Jumbo Payload option
+    REQUIRE(decoder.decode(frame, stack));
+    CHECK(stack.entry<IPv6>()->length == frame.length() - 14);
+    REQUIRE(stack.get<TCP>() != nullptr);
+    CHECK(stack.payload(frame) == "data");
+  }
+
+  SECTION("a truncated extension header stops the walk") {
+    std::string frame = ipv6_frame(IPv6Header::NH_HOP_BY_HOP,
+                                   ipv6_extension_header(6, 8), "");
+    frame[14 + 40 + 1] = 10; // claims 88 bytes
+    REQUIRE(decoder.decode(frame, stack));
+    CHECK(stack.get<IPv6>()->upper_protocol == IPv6Header::NH_HOP_BY_HOP);
+    CHECK(stack.get<IPv6>()->extension_length == 0);
+    CHECK(stack.get<TCP>() == nullptr);
+  }
+}
+
+TEST_CASE("ProtocolRegistry - parsers are registered without the Decoder",
+          "[protocol_registry]") {
+  ProtocolRegistry registry;
+  std::size_t max_application = 64;
+  registry.add(Dispatch::EtherType, 0x8100, parse_vlan);
+  registry.add(Dispatch::Port, 80, parse_application, &max_application);
+  CHECK(registry.contains(Dispatch::Port, 80));
+  CHECK_FALSE(registry.contains(Dispatch::Port, 81));
+
+  Decoder decoder(registry);
+  PluginResults results;
+  decoder.set_output(&results);
+  LayerStack stack;
+  const std::string frame = vlan_frame("GET / HTTP/1.1\r\n");
+  REQUIRE(decoder.decode(frame, stack));
+  CHECK(results.vlan == 42);
+  REQUIRE(stack.get<IPv4>() != nullptr);
+  CHECK(stack.entry<IPv4>()->offset == 18);
+  REQUIRE(stack.get<TCP>() != nullptr);
+  CHECK(results.application == "GET / HTTP/1.1\r\n");
+
+  // The lower port is tried first, so replies reach the same parser.
+  std::string reply = vlan_frame("HTTP/1.1 200 OK\r\n");
+  std::swap(reply[38], reply[40]);
+  std::swap(reply[39], reply[41]);
+  REQUIRE(decoder.decode(reply, stack));
+  CHECK(stack.get<TCP>()->src_port == 80);
+  CHECK(results.application == "HTTP/1.1 200 OK\r\n");
+
+  SECTION("the default registry is unchanged") {
+    Decoder plain;
+    REQUIRE(plain.decode(frame, stack));
+    CHECK(stack.get<IPv4>() == nullptr);
+    CHECK_FALSE(ProtocolRegistry::global().contains(Dispatch::Port, 80));
+  }
+
+  SECTION("built-in parsers can be removed") {
+    registry.remove(Dispatch::IpProtocol, IPv4Header::PROTO_TCP);
+    REQUIRE(decoder.decode(frame, stack));
+    CHECK(stack.get<IPv4>() != nullptr);
+    CHECK(stack.get<TCP>() == nullptr);
+    CHECK(stack.payload(frame).substr(20, 3) == "GET");
+  }
+}
+
+TEST_CASE("ProtocolRegistry - each Decoder collects its own results",
+          "[protocol_registry][threads]") {
+  ProtocolRegistry registry;
+  std::size_t max_application = 3;
+  registry.add(Dispatch::EtherType, 0x8100, parse_vlan);
+  registry.add(Dispatch::Port, 80, parse_application, &max_application);
+
+  // One registry, and so one context, shared by decoders on four threads
+  std::vector<std::string> frames;
+  for (int i = 0; i < 4; ++i) {
+    frames.push_back(vlan_frame(std::to_string(i) + "00 payload"));
+    frames.back()[15] = static_cast<char>(i);
+  }
+  std::vector<PluginResults> results(frames.size());
+  std::vector<int> mismatches(frames.size());
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < frames.size(); ++i) {
+    threads.emplace_back([&, i] {
+      Decoder decoder(registry);
+      decoder.set_output(&results[i]);
+      LayerStack stack;
+      for (int n = 0; n < 10000; ++n) {
+        decoder.decode(frames[i], stack);
+        if (results[i].vlan != static_cast<int>(i) ||
+            results[i].application != std::to_string(i) + "00") {
+          ++mismatches[i];
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  CHECK(mismatches == std::vector<int>(frames.size(), 0));
+}
+
+TEST_CASE("ProtocolRegistry - rejects bad registrations",
+          "[protocol_registry]") {
+  ProtocolRegistry registry;
+  CHECK_THROWS_AS(registry.add(Dispatch::None, 1, parse_application),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(registry.add(Dispatch::Port, 1, nullptr),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(registry.add(Dispatch::IpProtocol, 256, parse_application),
+                  std::invalid_argument);
+
+  // The same parser and context share one slot however often it is added.
+  for (uint16_t port = 0; port < 1000; ++port) {
+    registry.add(Dispatch::Port, port, parse_application);
+  }
+  int contexts[ProtocolRegistry::MAX_PARSERS];
+  std::size_t added = 0;
+  try {
+    for (int &context : contexts) {
+      registry.add(Dispatch::Port, 2000, parse_application, &context);
+      ++added;
+    }
+  } catch (const std::invalid_argument &) {
+  }
+  // Slots already taken: IPv4, IPv6, TCP and the context-free parser
+  CHECK(added == ProtocolRegistry::MAX_PARSERS - 4);
+}
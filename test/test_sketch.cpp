@@ -0,0 +1,218 @@
+#include "sketch.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// A skewed stream: key k (from 1) appears about `scale / k` times, mixed
+// with `noise` keys seen once each.
+std::vector<uint32_t> skewed_stream(uint32_t keys, uint32_t scale,
+                                    uint32_t noise) {
+  std::vector<uint32_t> stream;
+  for (uint32_t k = 1; k <= keys; ++k) {
+    for (uint32_t i = 0; i < scale / k; ++i) {
+      stream.push_back(k);
+    }
+  }
+  for (uint32_t i = 0; i < noise; ++i) {
+    stream.push_back(1000000 + i);
+  }
+  // Interleave deterministically so heavy keys are not all up front.
+  for (std::size_t i = stream.size(); i > 1; --i) {
+    const std::size_t j = mix64(i) % i;
+    std::swap(stream[i - 1], stream[j]);
+  }
+  return stream;
+}
+
+std::map<uint32_t, uint64_t> exact_counts(const std::vector<uint32_t> &keys) {
+  std::map<uint32_t, uint64_t> counts;
+  for (uint32_t key : keys) {
+    ++counts[key];
+  }
+  return counts;
+}
+
+} // namespace
+
+TEST_CASE("HeavyHitters - bounds hold on a skewed stream", "[sketch]") {
+  const std::vector<uint32_t> stream = skewed_stream(2000, 20000, 50000);
+  const std::map<uint32_t, uint64_t> exact = exact_counts(stream);
+  HeavyHitters<uint32_t> top(100);
+  for (uint32_t key : stream) {
+    top.add(key);
+  }
+  CHECK(top.size() == 100);
+  CHECK(top.total() == stream.size());
+
+  const auto entries = top.top(100);
+  REQUIRE(entries.size() == 100);
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const uint64_t truth = exact.at(entries[i].key);
+    CHECK(entries[i].count >= truth);
+    CHECK(entries[i].count - entries[i].error <= truth);
+    if (i > 0) {
+      CHECK(entries[i - 1].count >= entries[i].count);
+    }
+  }
+  // Every key above total / capacity is monitored, and the heaviest come
+  // first.
+  CHECK(entries[0].key == 1);
+  CHECK(entries[1].key == 2);
+  for (const auto &[key, count] : exact) {
+    if (count > stream.size() / 100) {
+      bool found = false;
+      for (const auto &entry : entries) {
+        found = found || entry.key == key;
+      }
+      CHECK(found);
+    }
+  }
+  CHECK(top.top(3).size() == 3);
+}
+
+TEST_CASE("HeavyHitters - admission and replacement", "[sketch]") {
+  HeavyHitters<uint32_t> top(2, 1024, 4);
+  top.add(1, 10);
+  top.add(2, 5);
+  CHECK(top.min_count() == 5);
+  // A new key must outweigh the smallest entry to take its place.
+  top.add(3, 5);
+  CHECK(top.top(2)[1].key == 2);
+  top.add(3, 1);
+  auto entries = top.top(2);
+  REQUIRE(entries.size() == 2);
+  CHECK(entries[0].key == 1);
+  CHECK(entries[0].count == 10);
+  CHECK(entries[0].error == 0);
+  CHECK(entries[1].key == 3);
+  CHECK(entries[1].count == 6);
+  CHECK(entries[1].error == 5); // only the last weight was seen exactly
+  // The sketch remembers key 2's weight while it is not monitored.
+  CHECK(top.estimate(2) == 5);
+  top.add(2, 2);
+  entries = top.top(2);
+  CHECK(entries[1].key == 2);
+  CHECK(entries[1].count == 7);
+  CHECK(entries[1].error == 5);
+  CHECK(top.total() == 23);
+
+  top.clear();
+  CHECK(top.size() == 0);
+  CHECK(top.total() == 0);
+  CHECK(top.min_count() == 0);
+  CHECK(top.estimate(2) == 0);
+  CHECK_THROWS_AS(HeavyHitters<uint32_t>(0), std::invalid_argument);
+  CHECK_THROWS_AS(HeavyHitters<uint32_t>(8, 0, 4), std::invalid_argument);
+}
+
+TEST_CASE("HeavyHitters - index survives heavy churn", "[sketch]") {
+  // Each new key outweighs everything but key 7, so it evicts an entry;
+  // lookups must still find the keys that stayed, whatever their place
+  // in the probe runs. A wide sketch keeps collisions below one round's
+  // weight.
+  HeavyHitters<uint32_t> top(64, 1 << 16, 4);
+  for (uint32_t round = 0; round < 200; ++round) {
+    top.add(7, 1000);
+    for (uint32_t i = 0; i < 50; ++i) {
+      top.add(1000 + round * 100 + i, round + 1);
+    }
+  }
+  const auto entries = top.top(64);
+  CHECK(entries[0].key == 7);
+  CHECK(entries[0].count >= 200000);
+  CHECK(entries[0].count - entries[0].error == 200000);
+  CHECK(top.size() == 64);
+  // The rest were each added once, so their seen weight is exact.
+  for (std::size_t i = 1; i < entries.size(); ++i) {
+    const uint32_t round = (entries[i].key - 1000) / 100;
+    CHECK(round >= 150);
+    CHECK(entries[i].count - entries[i].error == round + 1);
+  }
+}
+
+TEST_CASE("HeavyHitters - merging keeps the bounds", "[sketch]") {
+  const std::vector<uint32_t> stream = skewed_stream(1000, 10000, 20000);
+  const std::map<uint32_t, uint64_t> exact = exact_counts(stream);
+  HeavyHitters<uint32_t> first(50);
+  HeavyHitters<uint32_t> second(50);
+  for (std::size_t i = 0; i < stream.size(); ++i) {
+    (i % 3 == 0 ? first : second).add(stream[i]);
+  }
+  first.merge(second);
+  CHECK(first.total() == stream.size());
+  CHECK(first.size() == 50);
+  for (const auto &entry : first.top(50)) {
+    const uint64_t truth = exact.at(entry.key);
+    CHECK(entry.count >= truth);
+    CHECK(entry.count - entry.error <= truth);
+  }
+  CHECK(first.top(1)[0].key == 1);
+
+  HeavyHitters<uint32_t> other(10);
+  CHECK_THROWS_AS(first.merge(other), std::invalid_argument);
+  HeavyHitters<uint32_t> narrower(50, 1024, 4);
+  CHECK_THROWS_AS(first.merge(narrower), std::invalid_argument);
+}
+
+TEST_CASE("CountMinSketch - never underestimates", "[sketch]") {
+  const std::vector<uint32_t> stream = skewed_stream(2000, 20000, 50000);
+  const std::map<uint32_t, uint64_t> exact = exact_counts(stream);
+  CountMinSketch first(4096, 4);
+  CountMinSketch second(4096, 4);
+  for (std::size_t i = 0; i < stream.size(); ++i) {
+    (i % 2 == 0 ? first : second).add(mix64(stream[i]), 3);
+  }
+  first.merge(second);
+  CHECK(first.total() == 3 * stream.size());
+
+  // Error bound e/width * N, which all but a few keys meet
+  const double bound = 2.72 / 4096 * static_cast<double>(first.total());
+  std::size_t over = 0;
+  for (const auto &[key, count] : exact) {
+    const uint64_t estimate = first.estimate(mix64(key));
+    CHECK(estimate >= 3 * count);
+    over += static_cast<double>(estimate - 3 * count) > bound ? 1 : 0;
+  }
+  CHECK(over < exact.size() / 20);
+
+  CHECK(CountMinSketch(1000, 2).width() == 1024);
+  CHECK_THROWS_AS(first.merge(CountMinSketch(1024, 4)),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(CountMinSketch(0, 4), std::invalid_argument);
+  first.clear();
+  CHECK(first.estimate(mix64(1)) == 0);
+}
+
+TEST_CASE("HyperLogLog - estimates distinct keys", "[sketch]") {
+  HyperLogLog small;
+  for (uint64_t i = 0; i < 100; ++i) {
+    small.add(mix64(i));
+    small.add(mix64(i)); // repeats do not count
+  }
+  CHECK(std::fabs(small.estimate() - 100) < 3);
+
+  HyperLogLog first(14);
+  HyperLogLog second(14);
+  for (uint64_t i = 0; i < 1000000; ++i) {
+    (i % 2 == 0 ? first : second).add(mix64(i));
+  }
+  // Overlapping halves: the union is 1.5M keys.
+  for (uint64_t i = 0; i < 500000; ++i) {
+    second.add(mix64(1000000 + i));
+    first.add(mix64(1000000 + i));
+  }
+  first.merge(second);
+  // Standard error 0.8% at precision 14; allow four of them
+  CHECK(std::fabs(first.estimate() / 1500000 - 1) < 0.033);
+
+  CHECK_THROWS_AS(first.merge(HyperLogLog(12)), std::invalid_argument);
+  CHECK_THROWS_AS(HyperLogLog(3), std::invalid_argument);
+  CHECK_THROWS_AS(HyperLogLog(19), std::invalid_argument);
+  first.clear();
+  CHECK(first.estimate() == 0);
+}
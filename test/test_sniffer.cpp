@@ -0,0 +1,199 @@
+#include "decoder.hpp"
+#include "sniffer.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <system_error>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Opens a TPACKET sniffer on loopback, or returns nullptr if this process
+// may not open packet sockets.
+std::unique_ptr<TpacketSniffer> open_loopback(TpacketSniffer::Options options) {
+  options.ignore_outgoing = true; // otherwise lo shows every frame twice
+  try {
+    return std::make_unique<TpacketSniffer>("lo", options);
+  } catch (const std::system_error &e) {
+    WARN("skipping, cannot open an AF_PACKET socket: " << e.what());
+    return nullptr;
+  }
+}
+
+// UDP socket bound to 127.0.0.1:<port>.
+class UdpSocket {
+public:
+  explicit UdpSocket(uint16_t port) : m_fd(socket(AF_INET, SOCK_DGRAM, 0)) {
+    sockaddr_in address = loopback(port);
+    bind(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+  }
+  ~UdpSocket() { close(m_fd); }
+
+  void send_to(uint16_t port, const std::string &payload) const {
+    sockaddr_in address = loopback(port);
+    sendto(m_fd, payload.data(), payload.size(), 0,
+           reinterpret_cast<sockaddr *>(&address), sizeof(address));
+  }
+
+private:
+  static sockaddr_in loopback(uint16_t port) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+  }
+
+  int m_fd;
+};
+
+// Polls until `done()` or two seconds have passed.
+template <typename Done>
+void poll_until(Sniffer &sniffer, const Sniffer::Callback &callback,
+                Done done) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (!done() && std::chrono::steady_clock::now() < deadline) {
+    sniffer.poll(64, callback);
+  }
+}
+
+// "layerspy <seq>" markers found in UDP payloads between the two ports.
+std::string udp_payload(Decoder &decoder, const PacketRef &packet,
+                        uint16_t port_a, uint16_t port_b) {
+  LayerStack stack;
+  if (!decoder.decode(packet.data, stack) || stack.get<IPv4>() == nullptr ||
+      stack.get<IPv4>()->protocol != IPv4Header::PROTO_UDP) {
+    return {};
+  }
+  const std::string_view udp = stack.payload(packet.data);
+  if (udp.size() < 8) {
+    return {};
+  }
+  const auto *bytes = reinterpret_cast<const unsigned char *>(udp.data());
+  const uint16_t sport = static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+  const uint16_t dport = static_cast<uint16_t>((bytes[2] << 8) | bytes[3]);
+  if (!((sport == port_a && dport == port_b) ||
+        (sport == port_b && dport == port_a))) {
+    return {};
+  }
+  return std::string(udp.substr(8));
+}
+
+} // namespace
+
+TEST_CASE("TpacketSniffer captures loopback traffic in place",
+          "[sniffer][tpacket]") {
+  // A tiny ring, so the test also goes round it several times.
+  TpacketSniffer::Options options;
+  options.block_size = 4096;
+  options.block_count = 4;
+  options.block_timeout_ms = 1;
+  auto sniffer = open_loopback(options);
+  if (!sniffer) {
+    return;
+  }
+
+  const UdpSocket sender(47001);
+  const UdpSocket receiver(47002);
+  Decoder decoder;
+  std::set<std::string> seen;
+  std::size_t views_with_time = 0;
+
+  const Sniffer::Callback callback = [&](const PacketRef &packet) {
+    const std::string payload = udp_payload(decoder, packet, 47001, 47002);
+    if (payload.rfind("layerspy ", 0) == 0) {
+      seen.insert(payload);
+      views_with_time += packet.timestamp_ns != 0 ? 1 : 0;
+    }
+  };
+
+  constexpr int PACKETS = 100;
+  for (int burst = 0; burst < PACKETS; burst += 10) {
+    for (int i = burst; i < burst + 10; ++i) {
+      sender.send_to(47002, "layerspy " + std::to_string(i) +
+                                std::string(600, '.'));
+    }
+    poll_until(*sniffer, callback,
+               [&] { return seen.size() == std::size_t(burst + 10); });
+  }
+
+  CHECK(seen.size() == PACKETS);
+  CHECK(views_with_time == PACKETS);
+  CHECK(sniffer->stats().received >= PACKETS);
+
+  sniffer->interrupt();
+  CHECK(sniffer->poll(64, callback) == -1);
+}
+
+TEST_CASE("TpacketSniffer fanout keeps both directions of a flow together",
+          "[sniffer][tpacket]") {
+  TpacketSniffer::Options options;
+  options.block_size = 1 << 16;
+  options.block_count = 8;
+  options.block_timeout_ms = 1;
+  options.fanout_group = static_cast<int>(getpid() & 0xFFFF) ^ 0x5A5A;
+  auto first = open_loopback(options);
+  auto second = open_loopback(options);
+  if (!first || !second) {
+    return;
+  }
+
+  // Eight flows, each with one datagram in either direction.
+  constexpr uint16_t BASE = 47100;
+  std::map<uint16_t, std::set<int>> sockets_per_flow;
+  std::size_t seen = 0;
+  Decoder decoder;
+  const auto collect = [&](int socket_index) {
+    return [&, socket_index](const PacketRef &packet) {
+      for (uint16_t flow = 0; flow < 8; ++flow) {
+        const uint16_t a = static_cast<uint16_t>(BASE + 2 * flow);
+        if (udp_payload(decoder, packet, a, a + 1).rfind("layerspy", 0) ==
+            0) {
+          sockets_per_flow[flow].insert(socket_index);
+          ++seen;
+        }
+      }
+    };
+  };
+
+  for (uint16_t flow = 0; flow < 8; ++flow) {
+    const uint16_t a = static_cast<uint16_t>(BASE + 2 * flow);
+    const UdpSocket left(a);
+    const UdpSocket right(static_cast<uint16_t>(a + 1));
+    left.send_to(a + 1, "layerspy ping");
+    right.send_to(a, "layerspy pong");
+  }
+
+  const Sniffer::Callback from_first = collect(0);
+  const Sniffer::Callback from_second = collect(1);
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (seen < 16 && std::chrono::steady_clock::now() < deadline) {
+    first->poll(64, from_first);
+    second->poll(64, from_second);
+  }
+
+  REQUIRE(seen == 16);
+  for (const auto &[flow, sockets] : sockets_per_flow) {
+    INFO("flow " << flow);
+    CHECK(sockets.size() == 1);
+  }
+}
+
+TEST_CASE("open_sniffers falls back to libpcap only when asked to",
+          "[sniffer]") {
+  CHECK_THROWS_AS(open_sniffers("no-such-interface0", CaptureBackend::Tpacket,
+                                1),
+                  std::system_error);
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "decoder.hpp"
+#include "flow_key.hpp"
+#include "talker_sketch.hpp"
+#include "test_frames.hpp"
+#include "traffic_generator.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+Ipv6Address source_of(const LayerStack &stack) {
+  if (const IPv4Header *ipv4 = stack.get<IPv4>()) {
+    return Ipv6Address::mapped_ipv4(ipv4->source_ip.hostOrder());
+  }
+  return stack.get<IPv6>()->source_ip;
+}
+
+} // namespace
+
+TEST_CASE("TalkerSketch - top sources of generated traffic",
+          "[talker_sketch]") {
+  TrafficGenerator::Config traffic;
+  traffic.zipf_skew = 1.2;
+  TrafficGenerator generator(traffic);
+  Decoder decoder;
+  LayerStack stack;
+
+  TalkerSketch::Config config;
+  config.capacity = 256;
+  TalkerSketch first(config);
+  TalkerSketch second(config);
+  std::map<Ipv6Address, uint64_t> bytes;
+  std::set<Ipv6Address> sources;
+  for (int i = 0; i < 200000; ++i) {
+    const PacketRef packet = generator.next();
+    REQUIRE(decoder.decode(packet.data, stack));
+    // Two workers, each seeing part of the traffic
+    REQUIRE((i % 2 == 0 ? first : second).update(packet, stack));
+    const Ipv6Address source = source_of(stack);
+    bytes[source] += packet.data.length();
+    sources.insert(source);
+  }
+  first.merge(second);
+  CHECK(first.packets() == 200000);
+
+  uint64_t heaviest = 0;
+  Ipv6Address heaviest_source;
+  for (const auto &[source, count] : bytes) {
+    if (count > heaviest) {
+      heaviest = count;
+      heaviest_source = source;
+    }
+  }
+  const auto top = first.sources(TalkerSketch::Weight::Bytes).top(10);
+  REQUIRE(top.size() == 10);
+  CHECK(top[0].key == heaviest_source);
+  for (const auto &entry : top) {
+    CHECK(entry.count >= bytes.at(entry.key));
+    CHECK(entry.count - entry.error <= bytes.at(entry.key));
+    CHECK(first.source_bytes(entry.key) >= bytes.at(entry.key));
+  }
+
+  const double distinct = static_cast<double>(sources.size());
+  CHECK(std::fabs(first.distinct_sources() / distinct - 1) < 0.07);
+  CHECK(first.distinct_destinations() > 0);
+  CHECK(first.ports(TalkerSketch::Weight::Packets).total() > 0);
+}
+
+TEST_CASE("TalkerSketch - memory stays fixed under a source flood",
+          "[talker_sketch]") {
+  TalkerSketch::Config config;
+  config.capacity = 64;
+  TalkerSketch sketch(config);
+  Decoder decoder;
+  LayerStack stack;
+  const unsigned char target[4] = {192, 0, 2, 1};
+
+  // A heavy sender hidden among a flood of mostly one-packet sources
+  const unsigned char heavy[4] = {198, 51, 100, 7};
+  TestFrame heavy_frame;
+  heavy_frame.src = 0xC6336407;
+  heavy_frame.dst = 0xC0000201;
+  heavy_frame.payload.assign(500, '\0');
+  const std::string frame = build_frame(heavy_frame);
+  LayerStack rewritten;
+  REQUIRE(decoder.decode(frame, rewritten));
+  TrafficGenerator::Config traffic;
+  traffic.flows = 1000000;
+  traffic.zipf_skew = 0;
+  TrafficGenerator generator(traffic);
+  for (int i = 0; i < 300000; ++i) {
+    const PacketRef packet = generator.next();
+    decoder.decode(packet.data, stack);
+    sketch.update(packet, stack);
+    if (i % 10 == 0) {
+      sketch.update(PacketRef{frame, packet.timestamp_ns}, rewritten);
+    }
+  }
+  const auto &top = sketch.sources(TalkerSketch::Weight::Packets);
+  CHECK(top.size() == 64);
+  CHECK(top.top(1)[0].key ==
+        Ipv6Address::mapped_ipv4(Ipv4Address(heavy).hostOrder()));
+  CHECK(sketch.destinations(TalkerSketch::Weight::Packets).top(1)[0].key ==
+        Ipv6Address::mapped_ipv4(Ipv4Address(target).hostOrder()));
+  CHECK(sketch.distinct_sources() > 100000);
+
+  sketch.clear();
+  CHECK(sketch.packets() == 0);
+  CHECK(sketch.sources(TalkerSketch::Weight::Bytes).size() == 0);
+  CHECK(sketch.distinct_sources() == 0);
+}
+
+TEST_CASE("TalkerSketch - keys and rejects", "[talker_sketch]") {
+  const unsigned char address[4] = {10, 1, 2, 3};
+  const Ipv6Address host =
+      Ipv6Address::mapped_ipv4(Ipv4Address(address).hostOrder());
+  CHECK(host.toString() == "::ffff:10.1.2.3");
+
+  TalkerSketch sketch(TalkerSketch::Config{});
+  LayerStack stack;
+  CHECK_FALSE(sketch.update(PacketRef{"not ip", 0}, stack));
+  CHECK(sketch.packets() == 0);
+
+  TalkerSketch::Config config;
+  config.capacity = 0;
+  CHECK_THROWS_AS(TalkerSketch(config), std::invalid_argument);
+  config.capacity = 8;
+  TalkerSketch smaller(config);
+  CHECK_THROWS_AS(sketch.merge(smaller), std::invalid_argument);
+}
+
+TEST_CASE("TalkerSketch - scales sampled packets by their rate",
+          "[talker_sketch]") {
+  TrafficGenerator generator(TrafficGenerator::Config{});
+  Decoder decoder;
+  LayerStack stack;
+  TalkerSketch sketch(TalkerSketch::Config{});
+  PacketRef packet = generator.next();
+  REQUIRE(decoder.decode(packet.data, stack));
+  packet.sample_rate = 8;
+  REQUIRE(sketch.update(packet, stack));
+  CHECK(sketch.packets() == 8);
+  CHECK(sketch.bytes() == 8 * packet.data.length());
+  const auto top = sketch.sources(TalkerSketch::Weight::Packets).top(1);
+  REQUIRE(top.size() == 1);
+  CHECK(top.front().count == 8);
+}
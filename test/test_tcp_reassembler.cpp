@@ -0,0 +1,274 @@
+#include "decoder.hpp"
+#include "tcp_reassembler.hpp"
+#include "test_frames.hpp"
+#include <arpa/inet.h>
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+using CloseReason = TcpReassembler::CloseReason;
+
+const FlowKey CLIENT(Ipv4Address(htonl(0xC0A80101)), 51000,
+                     Ipv4Address(htonl(0x0A000001)), 80, 6);
+const FlowKey SERVER = CLIENT.reversed();
+
+// Records everything the reassembler hands over, per stream.
+struct Recorder : TcpReassembler::Handler {
+  void on_data(const FlowKey &stream, std::string_view data) override {
+    streams[stream] += std::string(data);
+    views.push_back(data.data());
+  }
+  void on_gap(const FlowKey &stream, uint64_t bytes) override {
+    streams[stream] += "[" + std::to_string(bytes) + "]";
+  }
+  void on_close(const FlowKey &stream, CloseReason reason) override {
+    closed.emplace_back(stream, reason);
+  }
+
+  struct Less {
+    bool operator()(const FlowKey &a, const FlowKey &b) const {
+      return std::memcmp(&a, &b, sizeof(FlowKey)) < 0;
+    }
+  };
+  std::map<FlowKey, std::string, Less> streams;
+  std::vector<const char *> views;
+  std::vector<std::pair<FlowKey, CloseReason>> closed;
+};
+
+TCPHeader segment(uint32_t seq, uint8_t flags = TCPHeader::FLAG_ACK) {
+  TCPHeader tcp{};
+  tcp.seq_number = seq;
+  tcp.data_offset = 5;
+  tcp.flag_syn = (flags & TCPHeader::FLAG_SYN) != 0;
+  tcp.flag_fin = (flags & TCPHeader::FLAG_FIN) != 0;
+  tcp.flag_rst = (flags & TCPHeader::FLAG_RST) != 0;
+  tcp.flag_ack = (flags & TCPHeader::FLAG_ACK) != 0;
+  return tcp;
+}
+
+struct Fixture {
+  explicit Fixture(TcpReassembler::Config config = {})
+      : reassembler(config, recorder) {}
+
+  void send(const FlowKey &key, uint32_t seq, std::string_view data,
+            uint8_t flags = TCPHeader::FLAG_ACK, uint64_t now = 0) {
+    reassembler.process(key, segment(seq, flags), data, now);
+  }
+
+  Recorder recorder;
+  TcpReassembler reassembler;
+};
+
+} // namespace
+
+TEST_CASE("TcpReassembler - in-order data is not copied",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 1000, "", TCPHeader::FLAG_SYN);
+  const std::string first = "GET / HTTP/1.1\r\n";
+  const std::string second = "Host: example\r\n\r\n";
+  f.send(CLIENT, 1001, first);
+  f.send(CLIENT, 1001 + 16, second);
+
+  CHECK(f.recorder.streams[CLIENT] == first + second);
+  REQUIRE(f.recorder.views.size() == 2);
+  CHECK(f.recorder.views[0] == first.data());
+  CHECK(f.recorder.views[1] == second.data());
+  CHECK(f.reassembler.stats().in_order == 2);
+  CHECK(f.reassembler.stats().out_of_order == 0);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("TcpReassembler - out-of-order segments wait for the hole",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 99, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 108, "cc");
+  f.send(CLIENT, 104, "bbbb");
+  CHECK(f.recorder.streams[CLIENT].empty());
+  CHECK(f.reassembler.buffered_bytes() == 6);
+
+  f.send(CLIENT, 100, "aaaa");
+  CHECK(f.recorder.streams[CLIENT] == "aaaabbbbcc");
+  CHECK(f.reassembler.buffered_bytes() == 0);
+  CHECK(f.reassembler.stats().out_of_order == 2);
+  CHECK(f.reassembler.stats().gaps == 0);
+}
+
+TEST_CASE("TcpReassembler - retransmissions and overlaps are trimmed",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 0, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 1, "hello");
+  f.send(CLIENT, 1, "hello");      // full retransmission
+  f.send(CLIENT, 4, "lo world");   // overlaps "lo"
+  f.send(CLIENT, 20, "!");         // out of order ...
+  f.send(CLIENT, 20, "!");         // ... and again
+  f.send(CLIENT, 12, "--------!"); // fills the hole, overlaps the "!"
+
+  CHECK(f.recorder.streams[CLIENT] == "hello world--------!");
+  const ReassemblyStats &stats = f.reassembler.stats();
+  CHECK(stats.overlaps == 4);
+  CHECK(stats.overlap_bytes == 5 + 2 + 1 + 1);
+  CHECK(stats.delivered_bytes == 20);
+}
+
+TEST_CASE("TcpReassembler - sequence numbers wrap around",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 0xFFFFFFFD, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 0x00000002, "cd"); // past the wrap, out of order
+  f.send(CLIENT, 0xFFFFFFFE, "ab");
+  CHECK(f.recorder.streams[CLIENT] == "ab");
+  f.reassembler.flush();
+  CHECK(f.recorder.streams[CLIENT] == "ab[2]cd");
+
+  Fixture g;
+  g.send(CLIENT, 0xFFFFFFFD, "", TCPHeader::FLAG_SYN);
+  g.send(CLIENT, 0x00000002, "ef");
+  g.send(CLIENT, 0xFFFFFFFE, "abcd");
+  CHECK(g.recorder.streams[CLIENT] == "abcdef");
+}
+
+TEST_CASE("TcpReassembler - a full stream buffer skips the hole",
+          "[tcp_reassembler]") {
+  TcpReassembler::Config config;
+  config.max_stream_buffer = 8;
+  Fixture f(config);
+  f.send(CLIENT, 0, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 1, "aa");
+  f.send(CLIENT, 10, "cccc"); // 7 bytes missing before this
+  f.send(CLIENT, 14, "dddd");
+  f.send(CLIENT, 18, "e"); // would exceed the buffer
+
+  CHECK(f.recorder.streams[CLIENT] == "aa[7]ccccdddde");
+  CHECK(f.reassembler.stats().stream_buffer_full == 1);
+  CHECK(f.reassembler.stats().gaps == 1);
+  CHECK(f.reassembler.stats().gap_bytes == 7);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+
+  // The late segment is now old news.
+  f.send(CLIENT, 3, "bbbbbbb");
+  CHECK(f.recorder.streams[CLIENT] == "aa[7]ccccdddde");
+}
+
+TEST_CASE("TcpReassembler - the global cap drops out-of-order data",
+          "[tcp_reassembler]") {
+  TcpReassembler::Config config;
+  config.memory_cap = 6;
+  Fixture f(config);
+  f.send(CLIENT, 0, "", TCPHeader::FLAG_SYN);
+  f.send(SERVER, 0, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 5, "1111");
+  f.send(SERVER, 5, "2222"); // does not fit next to the client's data
+  CHECK(f.reassembler.stats().pressure_drops == 1);
+  CHECK(f.reassembler.buffered_bytes() == 4);
+
+  f.send(SERVER, 1, "abcd");
+  CHECK(f.recorder.streams[SERVER] == "abcd");
+
+  // Ending the stream delivers what is buffered and reports the hole.
+  f.reassembler.flush();
+  CHECK(f.recorder.streams[CLIENT] == "[4]1111");
+  CHECK(f.reassembler.streams() == 0);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("TcpReassembler - FIN closes once all data is in",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 0, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 4, "def", TCPHeader::FLAG_FIN | TCPHeader::FLAG_ACK);
+  CHECK(f.recorder.closed.empty());
+
+  f.send(CLIENT, 1, "abc");
+  CHECK(f.recorder.streams[CLIENT] == "abcdef");
+  REQUIRE(f.recorder.closed.size() == 1);
+  CHECK(f.recorder.closed[0].first == CLIENT);
+  CHECK(f.recorder.closed[0].second == CloseReason::Fin);
+  CHECK(f.reassembler.streams() == 0);
+
+  // A retransmitted FIN or a trailing ACK does not reopen it.
+  f.send(CLIENT, 7, "", TCPHeader::FLAG_FIN | TCPHeader::FLAG_ACK);
+  f.send(CLIENT, 8, "");
+  CHECK(f.reassembler.streams() == 0);
+  CHECK(f.recorder.closed.size() == 1);
+}
+
+TEST_CASE("TcpReassembler - RST closes both directions",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 0, "", TCPHeader::FLAG_SYN);
+  f.send(SERVER, 500, "", TCPHeader::FLAG_SYN | TCPHeader::FLAG_ACK);
+  f.send(CLIENT, 1, "hi");
+  f.send(SERVER, 501, "ho");
+  f.send(SERVER, 503, "", TCPHeader::FLAG_RST);
+
+  CHECK(f.recorder.closed.size() == 2);
+  for (const auto &closed : f.recorder.closed) {
+    CHECK(closed.second == CloseReason::Reset);
+  }
+  CHECK(f.reassembler.streams() == 0);
+}
+
+TEST_CASE("TcpReassembler - joins connections already in progress",
+          "[tcp_reassembler]") {
+  Fixture f;
+  f.send(CLIENT, 123456, "middle");
+  f.send(CLIENT, 123462, " end");
+  CHECK(f.recorder.streams[CLIENT] == "middle end");
+
+  // A new SYN on the same tuple starts a new connection.
+  f.send(CLIENT, 9, "", TCPHeader::FLAG_SYN);
+  f.send(CLIENT, 9, "", TCPHeader::FLAG_SYN); // retransmitted SYN
+  f.send(CLIENT, 10, "new");
+  REQUIRE(f.recorder.closed.size() == 1);
+  CHECK(f.recorder.closed[0].second == CloseReason::Reset);
+  CHECK(f.recorder.streams[CLIENT] == "middle endnew");
+}
+
+TEST_CASE("TcpReassembler - idle streams are evicted and flushed",
+          "[tcp_reassembler]") {
+  TcpReassembler::Config config;
+  config.idle_timeout_ns = 1000;
+  Fixture f(config);
+  f.send(CLIENT, 0, "", TCPHeader::FLAG_SYN, 0);
+  f.send(CLIENT, 1, "a", TCPHeader::FLAG_ACK, 10);
+  f.send(CLIENT, 5, "e", TCPHeader::FLAG_ACK, 20);
+
+  CHECK(f.reassembler.expire(500) == 0);
+  CHECK(f.reassembler.expire(2000) == 1);
+  CHECK(f.recorder.streams[CLIENT] == "a[3]e");
+  REQUIRE(f.recorder.closed.size() == 1);
+  CHECK(f.recorder.closed[0].second == CloseReason::Evicted);
+  CHECK(f.reassembler.buffered_bytes() == 0);
+}
+
+TEST_CASE("TcpReassembler - takes decoded packets", "[tcp_reassembler]") {
+  // Ethernet / IPv4 / TCP 192.168.1.1:51000 -> 10.0.0.1:80, seq 1, "hi",
+  // plus two bytes of Ethernet padding that must not reach the stream
+  const unsigned char packet[] = {
+      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+      0x08, 0x00, 0x45, 0x00, 0x00, 0x2a, 0x00, 0x01, 0x00, 0x00, 0x40, 0x06,
+      0x00, 0x00, 0xc0, 0xa8, 0x01, 0x01, 0x0a, 0x00, 0x00, 0x01, 0xc7, 0x38,
+      0x00, 0x50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x50, 0x18,
+      0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 'h',  'i',  0x00, 0x00};
+  const std::string_view data(reinterpret_cast<const char *>(packet),
+                              sizeof(packet));
+  Decoder decoder;
+  LayerStack stack;
+  REQUIRE(decoder.decode(data, stack));
+
+  Fixture f;
+  CHECK(f.reassembler.process(PacketRef{data, 0}, stack));
+  CHECK(f.recorder.streams[CLIENT] == "hi");
+  CHECK(f.recorder.views[0] == data.data() + 54);
+
+  const std::string arp = arp_frame();
+  REQUIRE(decoder.decode(arp, stack));
+  CHECK_FALSE(f.reassembler.process(PacketRef{arp, 0}, stack));
+}
@@ -0,0 +1,295 @@
+#include "capture_file.hpp"
+#include "decoder.hpp"
+#include "flow_key.hpp"
+#include "fragment_reassembler.hpp"
+#include "layerspy_engine.hpp"
+#include "traffic_generator.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+uint16_t get16(std::string_view f, std::size_t at) {
+  return static_cast<uint16_t>(static_cast<unsigned char>(f[at]) << 8 |
+                               static_cast<unsigned char>(f[at + 1]));
+}
+
+uint32_t add_words(std::string_view bytes, uint32_t sum) {
+  for (std::size_t i = 0; i < bytes.length(); i += 2) {
+    sum += i + 1 < bytes.length()
+               ? get16(bytes, i)
+               : static_cast<uint32_t>(static_cast<unsigned char>(bytes[i]))
+                     << 8;
+  }
+  return sum;
+}
+
+// True if a ones' complement sum including its checksum field is valid.
+bool valid(uint32_t sum) {
+  while (sum > 0xFFFF) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return sum == 0xFFFF;
+}
+
+// Checks the IP and TCP/UDP checksums of an unfragmented IP packet.
+bool checksums_valid(std::string_view frame) {
+  const bool ipv6 = get16(frame, 12) == 0x86DD;
+  const std::string_view ip = frame.substr(14);
+  const std::size_t header = ipv6 ? 40 : 20;
+  const uint8_t protocol = static_cast<uint8_t>(ip[ipv6 ? 6 : 9]);
+  const std::string_view l4 = ip.substr(header);
+  const uint32_t pseudo = protocol + static_cast<uint32_t>(l4.length());
+  if (!ipv6 && !valid(add_words(ip.substr(0, header), 0))) {
+    return false;
+  }
+  return valid(add_words(l4, add_words(ipv6 ? ip.substr(8, 32)
+                                            : ip.substr(12, 8),
+                                       pseudo)));
+}
+
+std::vector<std::string> take(TrafficGenerator &generator,
+                              std::size_t count) {
+  std::vector<std::string> frames;
+  for (std::size_t i = 0; i < count; ++i) {
+    frames.emplace_back(generator.next().data);
+  }
+  return frames;
+}
+
+} // namespace
+
+TEST_CASE("TrafficGenerator - the seed fixes the traffic",
+          "[traffic_generator]") {
+  TrafficGenerator::Config config;
+  config.fragment_ratio = 0.1;
+  TrafficGenerator generator(config);
+  const std::vector<std::string> first = take(generator, 2000);
+
+  TrafficGenerator same(config);
+  CHECK(take(same, 2000) == first);
+  generator.reset();
+  CHECK(take(generator, 2000) == first);
+
+  config.seed = 2;
+  TrafficGenerator other(config);
+  CHECK(take(other, 2000) != first);
+}
+
+TEST_CASE("TrafficGenerator - packets decode with valid checksums",
+          "[traffic_generator]") {
+  TrafficGenerator::Config config;
+  config.zipf_skew = 0; // so every flow contributes to the ratios
+  config.ipv6_ratio = 0.25;
+  config.udp_ratio = 0.2;
+  config.http_ratio = 0.5;
+  config.start_ns = 5000;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+
+  std::size_t ipv6 = 0;
+  std::size_t udp = 0;
+  std::size_t http = 0;
+  std::size_t sizes[3] = {};
+  const std::size_t count = 20000;
+  for (std::size_t i = 0; i < count; ++i) {
+    const PacketRef packet = generator.next();
+    CHECK(packet.timestamp_ns == 5000 + i * config.interval_ns);
+    REQUIRE(decoder.decode(packet.data, stack));
+    REQUIRE(checksums_valid(packet.data));
+    const std::size_t ip_length = packet.data.length() - 14;
+    CHECK(ip_length <= config.mtu);
+    // HTTP heads make small packets larger.
+    const std::size_t size = ip_length <= 100 ? 0 : ip_length <= 600 ? 1 : 2;
+
+    ipv6 += stack.get<IPv6>() != nullptr ? 1 : 0;
+    if (stack.get<TCP>() == nullptr) {
+      ++udp;
+      ++sizes[size];
+      continue;
+    }
+    const std::string_view payload = stack.payload(packet.data);
+    const TCPHeader *tcp = stack.get<TCP>();
+    if (tcp->dst_port == 80) {
+      REQUIRE(payload.substr(0, 5) == "POST ");
+    } else if (tcp->src_port == 80) {
+      REQUIRE(payload.substr(0, 9) == "HTTP/1.1 ");
+    } else {
+      CHECK(payload.find_first_not_of('\0') == std::string_view::npos);
+      ++sizes[size];
+      continue;
+    }
+    ++http;
+    const std::size_t head = payload.find("\r\n\r\n") + 4;
+    const std::size_t length = payload.find("Content-Length: ") + 16;
+    CHECK(std::stoul(std::string(payload.substr(length, 5))) ==
+          payload.length() - head);
+  }
+  // Each ratio is of 10000 flows drawn at random.
+  CHECK(ipv6 > count * 22 / 100);
+  CHECK(ipv6 < count * 28 / 100);
+  CHECK(udp > count * 17 / 100);
+  CHECK(udp < count * 23 / 100);
+  CHECK(http > count * 37 / 100);
+  CHECK(http < count * 43 / 100);
+  // IMIX: 7 small, 4 medium and 1 full-size packet in 12
+  const std::size_t sized = count - http;
+  CHECK(sizes[0] > sized * 7 / 12 * 95 / 100);
+  CHECK(sizes[1] > sized * 4 / 12 * 95 / 100);
+  CHECK(sizes[2] > sized * 1 / 12 * 90 / 100);
+}
+
+TEST_CASE("TrafficGenerator - flows follow the Zipf skew",
+          "[traffic_generator]") {
+  TrafficGenerator::Config config;
+  config.flows = 1000;
+  config.zipf_skew = 1.0;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+
+  std::map<uint64_t, std::size_t> flows;
+  const std::size_t count = 50000;
+  for (std::size_t i = 0; i < count; ++i) {
+    const PacketRef packet = generator.next();
+    REQUIRE(decoder.decode(packet.data, stack));
+    FlowKey key;
+    REQUIRE(FlowKey::from_packet(packet.data, stack, key));
+    ++flows[key.canonical().hash()];
+  }
+  std::size_t top = 0;
+  for (const auto &flow : flows) {
+    top = std::max(top, flow.second);
+  }
+  // The first of 1000 flows has 1 / H(1000) = 13.4% of the packets.
+  CHECK(top > count * 125 / 1000);
+  CHECK(top < count * 145 / 1000);
+  CHECK(flows.size() > 500);
+}
+
+TEST_CASE("TrafficGenerator - fragmented datagrams reassemble",
+          "[traffic_generator]") {
+  TrafficGenerator::Config config;
+  config.udp_ratio = 1;
+  config.ipv6_ratio = 0.5;
+  config.fragment_ratio = 0.5;
+  config.fragmented_size = 3000;
+  TrafficGenerator generator(config);
+  Decoder decoder;
+  LayerStack stack;
+  FragmentReassembler reassembler(FragmentReassembler::Config{});
+  PacketRef reassembled;
+
+  std::size_t whole = 0;
+  std::size_t completed = 0;
+  for (int i = 0; i < 5000; ++i) {
+    const PacketRef packet = generator.next();
+    REQUIRE(decoder.decode(packet.data, stack));
+    const FragmentReassembler::Result result =
+        reassembler.process(packet, stack, reassembled);
+    REQUIRE(result != FragmentReassembler::Result::Dropped);
+    if (result == FragmentReassembler::Result::NotFragment) {
+      CHECK(checksums_valid(packet.data));
+      ++whole;
+    } else if (result == FragmentReassembler::Result::Complete) {
+      CHECK(reassembled.data.length() - 14 ==
+            (stack.get<IPv6>() != nullptr ? 40 : 20) + 3000);
+      CHECK(checksums_valid(reassembled.data));
+      ++completed;
+    }
+  }
+  CHECK(whole > 1000);
+  CHECK(completed > 800);
+  CHECK(reassembler.datagrams() <= 1);
+}
+
+TEST_CASE("TrafficGenerator - pcap output reads back",
+          "[traffic_generator]") {
+  TrafficGenerator::Config config;
+  config.start_ns = 1700000000123456789ULL;
+  TrafficGenerator generator(config);
+  const std::vector<std::string> frames = take(generator, 100);
+
+  char name[] = "/tmp/layerspy_test_XXXXXX";
+  const int fd = mkstemp(name);
+  REQUIRE(fd >= 0);
+  close(fd);
+  generator.reset();
+  generator.write_pcap(name, 100);
+  {
+    CaptureFileReader reader(name);
+    PacketRef packet;
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+      REQUIRE(reader.next(packet));
+      CHECK(packet.data == frames[i]);
+      CHECK(packet.timestamp_ns == config.start_ns + i * config.interval_ns);
+    }
+    CHECK_FALSE(reader.next(packet));
+    CHECK_FALSE(reader.truncated());
+  }
+  std::remove(name);
+
+  CHECK_THROWS_AS(generator.write_pcap("/nonexistent/dir/out.pcap", 1),
+                  std::runtime_error);
+}
+
+TEST_CASE("TrafficGenerator - sniffer stops after its packets",
+          "[traffic_generator]") {
+  TrafficGeneratorSniffer sniffer(TrafficGenerator::Config{}, 250);
+  std::size_t seen = 0;
+  const auto count = [&seen](const PacketRef &) { ++seen; };
+  CHECK(sniffer.poll(100, count) == 100);
+  sniffer.interrupt();
+  CHECK(sniffer.poll(100, count) == -1);
+  CHECK(sniffer.poll(100, count) == -1);
+  sniffer.clear_interrupt();
+  CHECK(sniffer.poll(100, count) == 100);
+  CHECK(sniffer.poll(100, count) == 50);
+  CHECK(sniffer.poll(100, count) == -1);
+  CHECK(seen == 250);
+  CHECK(sniffer.stats().received == 250);
+
+  SECTION("one per LayerSpyEngine worker") {
+    TrafficGenerator::Config config;
+    TrafficGeneratorSniffer first(config, 3000);
+    config.seed = 2;
+    TrafficGeneratorSniffer second(config, 2000);
+    LayerSpyEngine engine({&first, &second}, LayerSpyEngine::Config{},
+                          [](std::size_t, const PacketRef &,
+                             const LayerStack &) {});
+    engine.start();
+    engine.wait();
+    CHECK(engine.stats(0).decoded == 3000);
+    CHECK(engine.stats(1).decoded == 2000);
+    CHECK(engine.totals().malformed == 0);
+  }
+}
+
+TEST_CASE("TrafficGenerator - rejects bad configurations",
+          "[traffic_generator]") {
+  const auto make = [](void (*change)(TrafficGenerator::Config &)) {
+    TrafficGenerator::Config config;
+    change(config);
+    TrafficGenerator generator(config);
+  };
+  CHECK_THROWS_AS(make([](auto &c) { c.flows = 0; }), std::invalid_argument);
+  CHECK_THROWS_AS(make([](auto &c) { c.ipv6_ratio = 1.5; }),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(make([](auto &c) { c.zipf_skew = -1; }),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(make([](auto &c) { c.mtu = 100; }), std::invalid_argument);
+  CHECK_THROWS_AS(make([](auto &c) { c.sizes.clear(); }),
+                  std::invalid_argument);
+  CHECK_THROWS_AS(make([](auto &c) {
+                    c.fragment_ratio = 0.1;
+                    c.fragmented_size = 1000;
+                  }),
+                  std::invalid_argument);
+}